@@ -0,0 +1,137 @@
+/*
+ * EdgeX OS - ACPI Tables
+ *
+ * This file defines the ACPI table layouts the kernel reads at boot:
+ * the RSDP/RSDT/XSDT chain and the MADT, which describes the local
+ * APICs, IOAPICs and ISA interrupt overrides of the machine.
+ */
+
+#ifndef EDGEX_ACPI_H
+#define EDGEX_ACPI_H
+
+#include <edgex/kernel.h>
+
+/* Root System Description Pointer */
+typedef struct __attribute__((packed)) {
+    char signature[8];           /* "RSD PTR " */
+    uint8_t checksum;            /* Covers the first 20 bytes */
+    char oem_id[6];
+    uint8_t revision;            /* 0 = ACPI 1.0, 2 = ACPI 2.0+ */
+    uint32_t rsdt_address;
+    /* ACPI 2.0+ */
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} acpi_rsdp_t;
+
+/* Common header of every system description table */
+typedef struct __attribute__((packed)) {
+    char signature[4];
+    uint32_t length;             /* Including the header */
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} acpi_sdt_header_t;
+
+/* Multiple APIC Description Table */
+typedef struct __attribute__((packed)) {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;      /* Physical address of the local APICs */
+    uint32_t flags;              /* ACPI_MADT_PCAT_COMPAT */
+    uint8_t entries[];
+} acpi_madt_t;
+
+#define ACPI_MADT_PCAT_COMPAT        (1 << 0)  /* Dual 8259 PICs are installed */
+
+/* MADT entry types */
+#define ACPI_MADT_LAPIC              0
+#define ACPI_MADT_IOAPIC             1
+#define ACPI_MADT_INT_OVERRIDE       2
+#define ACPI_MADT_LAPIC_NMI          4
+#define ACPI_MADT_LAPIC_OVERRIDE     5
+#define ACPI_MADT_X2APIC             9
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t length;
+} acpi_madt_entry_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_madt_entry_t header;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;              /* ACPI_MADT_ENABLED */
+} acpi_madt_lapic_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_madt_entry_t header;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;           /* First global system interrupt it handles */
+} acpi_madt_ioapic_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_madt_entry_t header;
+    uint8_t bus;                 /* Always 0 (ISA) */
+    uint8_t source;              /* ISA IRQ */
+    uint32_t gsi;
+    uint16_t flags;              /* ACPI_MADT_POLARITY_* | ACPI_MADT_TRIGGER_* */
+} acpi_madt_override_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_madt_entry_t header;
+    uint16_t reserved;
+    uint64_t address;
+} acpi_madt_lapic_override_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_madt_entry_t header;
+    uint16_t reserved;
+    uint32_t x2apic_id;
+    uint32_t flags;              /* ACPI_MADT_ENABLED */
+    uint32_t uid;
+} acpi_madt_x2apic_t;
+
+/* Processor flags */
+#define ACPI_MADT_ENABLED            (1 << 0)
+#define ACPI_MADT_ONLINE_CAPABLE     (1 << 1)
+
+/* Interrupt override flags (MPS INTI flags) */
+#define ACPI_MADT_POLARITY_MASK      0x03
+#define ACPI_MADT_POLARITY_HIGH      0x01
+#define ACPI_MADT_POLARITY_LOW       0x03
+#define ACPI_MADT_TRIGGER_MASK       0x0C
+#define ACPI_MADT_TRIGGER_EDGE       0x04
+#define ACPI_MADT_TRIGGER_LEVEL      0x0C
+
+/* PCI Express memory-mapped configuration space (MCFG) */
+typedef struct __attribute__((packed)) {
+    uint64_t base_address;       /* ECAM base for start_bus */
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    uint32_t reserved;
+} acpi_mcfg_entry_t;
+
+typedef struct __attribute__((packed)) {
+    acpi_sdt_header_t header;
+    uint64_t reserved;
+    acpi_mcfg_entry_t entries[];
+} acpi_mcfg_t;
+
+/* Record the RSDP copy passed by the boot loader */
+void acpi_set_rsdp(const void* rsdp, size_t size);
+
+/* Locate the RSDP and the root table; returns false without ACPI */
+bool init_acpi(void);
+
+/* Find a table by signature (e.g. "APIC", "MCFG"); instance counts from 0 */
+acpi_sdt_header_t* acpi_find_table(const char* signature, uint32_t instance);
+
+#endif /* EDGEX_ACPI_H */
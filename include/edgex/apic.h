@@ -0,0 +1,99 @@
+/*
+ * EdgeX OS - Local APIC and IOAPIC
+ *
+ * This file declares the APIC interrupt controllers: the per-CPU local
+ * APIC (xAPIC over MMIO, or x2APIC over MSRs when available), its timer,
+ * and the IOAPICs that route device interrupts to CPUs. The 8259 PIC is
+ * only used when the firmware does not describe any APIC.
+ */
+
+#ifndef EDGEX_APIC_H
+#define EDGEX_APIC_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/tick.h>
+
+/* IA32_APIC_BASE MSR */
+#define MSR_APIC_BASE              0x1B
+#define APIC_BASE_BSP              (1ULL << 8)
+#define APIC_BASE_X2APIC           (1ULL << 10)
+#define APIC_BASE_ENABLE           (1ULL << 11)
+#define APIC_BASE_ADDR_MASK        0xFFFFFFFFF000ULL
+#define APIC_DEFAULT_PHYS_BASE     0xFEE00000
+
+/* x2APIC registers are MSRs at 0x800 + (xAPIC offset >> 4) */
+#define MSR_X2APIC_BASE            0x800
+
+/* Local APIC register offsets (xAPIC MMIO) */
+#define APIC_REG_ID                0x020
+#define APIC_REG_VERSION           0x030
+#define APIC_REG_TPR               0x080
+#define APIC_REG_EOI               0x0B0
+#define APIC_REG_LDR               0x0D0
+#define APIC_REG_DFR               0x0E0
+#define APIC_REG_SVR               0x0F0
+#define APIC_REG_ESR               0x280
+#define APIC_REG_ICR_LOW           0x300
+#define APIC_REG_ICR_HIGH          0x310
+#define APIC_REG_LVT_TIMER         0x320
+#define APIC_REG_LVT_LINT0         0x350
+#define APIC_REG_LVT_LINT1         0x360
+#define APIC_REG_LVT_ERROR         0x370
+#define APIC_REG_TIMER_INITIAL     0x380
+#define APIC_REG_TIMER_CURRENT     0x390
+#define APIC_REG_TIMER_DIVIDE      0x3E0
+
+/* Register fields */
+#define APIC_SVR_ENABLE            (1 << 8)
+#define APIC_LVT_MASKED            (1 << 16)
+#define APIC_LVT_LEVEL             (1 << 15)
+#define APIC_LVT_DELIVERY_NMI      (4 << 8)
+#define APIC_LVT_DELIVERY_EXTINT   (7 << 8)
+#define APIC_TIMER_PERIODIC        (1 << 17)
+#define APIC_TIMER_DIVIDE_16       0x3
+#define APIC_ICR_DELIVERY_INIT     (5 << 8)
+#define APIC_ICR_DELIVERY_STARTUP  (6 << 8)
+#define APIC_ICR_PENDING           (1 << 12)
+#define APIC_ICR_ASSERT            (1 << 14)
+#define APIC_ICR_LEVEL             (1 << 15)
+
+/* IOAPIC redirection entry fields */
+#define IOAPIC_RTE_MASKED          (1ULL << 16)
+#define IOAPIC_RTE_LEVEL           (1ULL << 15)
+#define IOAPIC_RTE_ACTIVE_LOW      (1ULL << 13)
+#define IOAPIC_RTE_DEST_SHIFT      56
+
+/* Maximum number of IOAPICs */
+#define MAX_IOAPICS                8
+
+/* Local APIC */
+bool apic_available(void);
+bool x2apic_enabled(void);
+void lapic_init_local(void);
+void lapic_eoi(void);
+uint32_t lapic_id(void);
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint64_t start_phys);
+
+/* Per-CPU local APIC timer (per-CPU tick device) */
+tick_device_t* lapic_timer_device(uint32_t cpu);
+
+/* IOAPICs */
+void ioapic_register(uint8_t id, uint64_t phys_addr, uint32_t gsi_base);
+void ioapic_set_isa_override(uint8_t isa_irq, uint32_t gsi, uint16_t flags);
+int ioapic_setup_isa_irqs(void);
+int ioapic_map_gsi(uint32_t gsi, bool level, bool active_low);
+uint32_t ioapic_count(void);
+
+/*
+ * Switch interrupt delivery to the APICs
+ *
+ * Parses the ACPI MADT, enables the boot CPU's local APIC, routes the
+ * ISA IRQs through the IOAPICs and registers the IPI transport. Falls
+ * back to the 8259 PIC when no MADT is found. Call after init_tsc().
+ */
+void init_apic(void);
+
+#endif /* EDGEX_APIC_H */
@@ -0,0 +1,135 @@
+/*
+ * EdgeX OS - Block Buffer Cache
+ *
+ * This file defines the buffer cache that sits between services and a
+ * virtio-blk device. Blocks are 4KB and each is cached in one page of a
+ * pool that tasks can map read-only as a shared memory region
+ * ("bcache<N>"). Lookups go through a hash table and reclaim takes the
+ * least recently used clean buffer. Sequential misses start readahead,
+ * and dirty blocks are written back in the background in block order so
+ * the driver merges neighbours into large requests.
+ */
+
+#ifndef EDGEX_BCACHE_H
+#define EDGEX_BCACHE_H
+
+#include <edgex/kernel.h>
+#include <edgex/ipc.h>
+#include <edgex/spinlock.h>
+#include <edgex/virtio_blk.h>
+
+/* Geometry */
+#define BCACHE_BLOCK_SIZE         PAGE_SIZE
+#define BCACHE_BLOCK_SECTORS      (BCACHE_BLOCK_SIZE / VIRTIO_BLK_SECTOR_SIZE)
+#define BCACHE_DEFAULT_BUFFERS    1024          /* 4MB */
+
+/* Readahead window, in blocks, grows while reads stay sequential */
+#define BCACHE_RA_MIN             4
+#define BCACHE_RA_MAX             32            /* One merged 128KB request */
+
+/* Write-back: age and amount of dirty data that start a flush */
+#define BCACHE_WRITEBACK_MS       500
+#define BCACHE_DIRTY_RATIO        4             /* Flush at 1/4 of the cache dirty */
+#define BCACHE_FLUSH_PERIOD_MS    100
+
+/* Buffer state */
+#define BCACHE_VALID              (1 << 0)      /* Data matches or is newer than the disk */
+#define BCACHE_DIRTY              (1 << 1)      /* Needs writing */
+#define BCACHE_READING            (1 << 2)
+#define BCACHE_WRITING            (1 << 3)
+#define BCACHE_ERROR              (1 << 4)      /* Last read failed */
+#define BCACHE_READAHEAD          (1 << 5)      /* Read ahead, not used yet */
+
+struct bcache;
+
+typedef struct bcache_buf {
+    struct bcache* cache;
+    struct bcache_buf* hash_next;
+    struct bcache_buf* lru_prev;     /* Least recently used at the head */
+    struct bcache_buf* lru_next;
+    struct bcache_buf* dirty_next;   /* Flush batch link */
+
+    uint64_t block;
+    uint32_t index;                  /* Page of the pool (offset index * BCACHE_BLOCK_SIZE) */
+    uint8_t* data;
+    volatile uint32_t flags;
+    uint32_t refcount;
+    uint64_t dirtied;                /* Tick the buffer became dirty */
+
+    blk_request_t req;
+} bcache_buf_t;
+
+/* A task waiting for a buffer's I/O */
+typedef struct bcache_waiter {
+    struct bcache_waiter* next;
+    bcache_buf_t* buf;
+    pid_t pid;
+} bcache_waiter_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t readahead;              /* Blocks read ahead */
+    uint64_t readahead_hits;         /* ... that were then used */
+    uint64_t evictions;
+    uint64_t writebacks;             /* Blocks written */
+    uint64_t flushes;                /* Write-back batches */
+    uint64_t read_errors;
+    uint64_t write_errors;
+} bcache_stats_t;
+
+typedef struct bcache {
+    virtio_blk_t* blk;
+    uint32_t id;
+    uint64_t nr_blocks;              /* Device size in blocks */
+    char name[16];
+
+    shared_memory_t shm;             /* NULL when the pool is kernel-private */
+    bcache_buf_t* bufs;
+    uint32_t nr_bufs;
+    bcache_buf_t** hash;
+    uint32_t hash_mask;
+
+    spinlock_t lock;
+    bcache_buf_t* lru_head;
+    bcache_buf_t* lru_tail;
+    uint32_t nr_dirty;
+    uint32_t nr_writing;
+    uint64_t completions;            /* Reads and writes finished */
+    bcache_waiter_t* waiters;
+
+    /* Sequential read detection */
+    uint64_t ra_next;                /* Block a sequential reader asks for next */
+    uint64_t ra_end;                 /* First block not yet read ahead */
+    uint32_t ra_window;
+
+    bcache_stats_t stats;
+} bcache_t;
+
+/* Create a cache over a device (0 buffers: BCACHE_DEFAULT_BUFFERS) */
+bcache_t* bcache_create(virtio_blk_t* blk, uint32_t nr_buffers);
+
+/*
+ * Get a block with its data read in, blocking on I/O; NULL on a read
+ * error. The buffer stays in the cache until bcache_release().
+ */
+bcache_buf_t* bcache_read(bcache_t* cache, uint64_t block);
+
+/* Get a block without reading it, for callers that overwrite all of it */
+bcache_buf_t* bcache_get(bcache_t* cache, uint64_t block);
+
+/* Mark a buffer's data changed; write-back happens later */
+void bcache_mark_dirty(bcache_buf_t* buf);
+
+void bcache_release(bcache_buf_t* buf);
+
+/* Write all dirty blocks and flush the device's write cache */
+int bcache_sync(bcache_t* cache);
+
+/* Drop every unused clean buffer (cold-cache measurements) */
+void bcache_invalidate(bcache_t* cache);
+
+/* Print counters */
+void dump_bcache_stats(bcache_t* cache);
+
+#endif /* EDGEX_BCACHE_H */
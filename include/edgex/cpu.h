@@ -0,0 +1,144 @@
+/*
+ * EdgeX OS - Per-CPU State
+ *
+ * This file defines the per-CPU data block, CPU masks, and the
+ * housekeeping/isolation policy used to keep selected CPUs free of
+ * kernel background activity.
+ */
+
+#ifndef EDGEX_CPU_H
+#define EDGEX_CPU_H
+
+#include <edgex/kernel.h>
+#include <edgex/percpu.h>
+
+/* Maximum number of logical CPUs supported (one bit per CPU in cpumask_t) */
+#define MAX_CPUS 64
+
+/* The boot CPU always does housekeeping and can never be isolated */
+#define BOOT_CPU_ID 0
+
+/* CPU flags */
+#define CPU_FLAG_PRESENT     (1 << 0)  /* CPU was enumerated by firmware */
+#define CPU_FLAG_ONLINE      (1 << 1)  /* CPU is running kernel code */
+#define CPU_FLAG_ISOLATED    (1 << 2)  /* No load balancing or housekeeping */
+#define CPU_FLAG_NOHZ_FULL   (1 << 3)  /* Stop the tick while running a single task */
+
+/* IA32_GS_BASE and IA32_KERNEL_GS_BASE MSRs */
+#define MSR_GS_BASE          0xC0000101
+#define MSR_KERNEL_GS_BASE   0xC0000102
+
+/* CPU mask - one bit per logical CPU */
+typedef uint64_t cpumask_t;
+
+#define CPU_MASK_NONE        ((cpumask_t)0)
+#define CPU_MASK_ALL         (~(cpumask_t)0)
+#define cpumask_of(cpu)      ((cpumask_t)1 << (cpu))
+
+static inline bool cpumask_test(cpumask_t mask, uint32_t cpu) {
+    return cpu < MAX_CPUS && (mask & cpumask_of(cpu)) != 0;
+}
+
+static inline void cpumask_set(cpumask_t* mask, uint32_t cpu) {
+    if (cpu < MAX_CPUS) {
+        *mask |= cpumask_of(cpu);
+    }
+}
+
+static inline void cpumask_clear(cpumask_t* mask, uint32_t cpu) {
+    if (cpu < MAX_CPUS) {
+        *mask &= ~cpumask_of(cpu);
+    }
+}
+
+static inline uint32_t cpumask_weight(cpumask_t mask) {
+    return (uint32_t)__builtin_popcountll(mask);
+}
+
+/* Returns MAX_CPUS if the mask is empty */
+static inline uint32_t cpumask_first(cpumask_t mask) {
+    return mask ? (uint32_t)__builtin_ctzll(mask) : MAX_CPUS;
+}
+
+/* Iterate over every CPU set in a mask */
+#define for_each_cpu(cpu, mask) \
+    for ((cpu) = 0; (cpu) < MAX_CPUS; (cpu)++) \
+        if (cpumask_test((mask), (cpu)))
+
+struct tick_device;
+
+/*
+ * Per-CPU data block
+ *
+ * Each CPU's GS base points at its own cpu_t, so the running CPU can
+ * find its state with a single %gs-relative load and without taking
+ * any lock. The self pointer must stay the first member.
+ */
+typedef struct cpu {
+    struct cpu* self;               /* Must be first: loaded via %gs:0 */
+    uint32_t id;                    /* Logical CPU number */
+    uint32_t apic_id;               /* Local APIC ID */
+    uint32_t flags;                 /* CPU_FLAG_* */
+    uint32_t reserved;
+
+    /* Tick state */
+    struct tick_device* tick_dev;   /* Per-CPU tick source */
+    bool tick_stopped;              /* Tick is stopped (nohz_full) */
+    bool tick_restart_pending;      /* Remote request to restart the tick */
+    uint64_t tick_stop_count;       /* Times the tick was stopped */
+    uint64_t tick_restart_count;    /* Times the tick was restarted */
+    uint64_t ticks;                 /* Ticks handled by this CPU */
+    uint64_t tick_handler_cycles;   /* TSC cycles spent in the tick handler */
+    uint64_t tick_handler_max;      /* Longest tick handler run, in cycles */
+    uint64_t tick_last_tsc;         /* TSC at the previous tick */
+    uint64_t tick_max_lateness;     /* Worst tick delay past its period, in cycles */
+
+    /* Preemption state (see edgex/preempt.h) */
+    uint32_t preempt_count;         /* Preemption disable depth and IRQ nesting */
+    volatile bool need_resched;     /* A higher priority task is waiting (MWAIT target) */
+    volatile bool idle_polling;     /* Idle loop watches need_resched, no IPI needed */
+
+    /* Bottom halves (see edgex/softirq.h) */
+    volatile uint32_t softirq_pending; /* Bitmask of raised softirq vectors */
+
+    /* Statistics counters (see edgex/percpu.h), off the lines other CPUs write */
+    pcpu_area_t pcpu __attribute__((aligned(64)));
+} __attribute__((aligned(64))) cpu_t;
+
+/* Get the per-CPU block of the running CPU */
+static inline cpu_t* this_cpu(void) {
+    cpu_t* cpu;
+    __asm__ volatile("movq %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+/* Get the logical ID of the running CPU */
+static inline uint32_t smp_processor_id(void) {
+    uint32_t id;
+    __asm__ volatile("movl %%gs:%c1, %0" : "=r"(id) : "i"(__builtin_offsetof(cpu_t, id)));
+    return id;
+}
+
+/* Initialization */
+void init_boot_cpu(void);
+cpu_t* cpu_add(uint32_t apic_id);
+void cpu_init_local(cpu_t* cpu);
+void cpu_parse_cmdline(const char* cmdline);
+
+/* Lookup */
+cpu_t* get_cpu(uint32_t id);
+uint32_t num_online_cpus(void);
+cpumask_t cpu_online_mask(void);
+
+/* Housekeeping and isolation */
+cpumask_t housekeeping_mask(void);
+uint32_t housekeeping_any_cpu(void);
+bool cpu_is_isolated(uint32_t cpu);
+bool cpu_is_nohz_full(uint32_t cpu);
+
+/* Inter-processor interrupts */
+typedef void (*ipi_send_fn_t)(uint32_t apic_id, uint8_t vector);
+void cpu_register_ipi_sender(ipi_send_fn_t fn);
+bool cpu_send_ipi(uint32_t cpu, uint8_t vector);
+
+#endif /* EDGEX_CPU_H */
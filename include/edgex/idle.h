@@ -0,0 +1,55 @@
+/*
+ * EdgeX OS - CPU Idle
+ *
+ * This file defines the idle driver and governor. An idle CPU either
+ * polls, waits in MWAIT on its need_resched word, or halts; which one
+ * depends on how long it is expected to stay idle.
+ */
+
+#ifndef EDGEX_IDLE_H
+#define EDGEX_IDLE_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+/* Maximum number of idle states (poll + C-states) */
+#define IDLE_MAX_STATES 4
+
+/* Idle state description */
+typedef struct idle_state {
+    const char* name;
+    uint32_t mwait_hint;          /* MWAIT EAX hint (MWAIT states only) */
+    uint32_t exit_latency_us;     /* Worst-case wakeup latency */
+    uint32_t target_residency_us; /* Minimum stay for the state to pay off */
+    void (*enter)(cpu_t* cpu, const struct idle_state* state, uint64_t budget_ns);
+} idle_state_t;
+
+/* Per-CPU idle statistics */
+typedef struct {
+    uint64_t predicted_ns;        /* EWMA of recent idle periods */
+    uint64_t poll_timeouts;       /* Poll windows that ended without work */
+    uint64_t usage[IDLE_MAX_STATES];
+    uint64_t time_ns[IDLE_MAX_STATES];
+} idle_stats_t;
+
+/* Detect MONITOR/MWAIT and build the idle state table (after init_tsc) */
+void init_idle(void);
+
+/* Idle the calling CPU once; returns after an interrupt or a wakeup */
+void cpu_idle(void);
+
+/*
+ * Wake an idle CPU by storing to its need_resched word
+ *
+ * Returns true if the CPU is polling or in MWAIT and will notice the store,
+ * false if the caller has to send a reschedule IPI.
+ */
+bool idle_wake_by_store(cpu_t* cpu);
+
+/* Exclude idle states whose exit latency exceeds the limit (0 = no limit) */
+void idle_set_latency_limit(uint32_t latency_us);
+
+/* Print the idle states and per-CPU usage */
+void dump_idle_stats(void);
+
+#endif /* EDGEX_IDLE_H */
@@ -0,0 +1,77 @@
+/*
+ * EdgeX OS - Initial Ramdisk
+ *
+ * This file defines the read-only archive the boot loader loads as a
+ * multiboot2 module (tools/mkinitrd.py builds it). Every file starts on a
+ * page boundary, so a file is used where the boot loader put it: tasks
+ * map its pages read-only into their address space and share them, and
+ * nothing is copied. A file is mapped at the same address in every task,
+ * INITRD_VADDR_BASE plus its offset in the archive.
+ */
+
+#ifndef EDGEX_INITRD_H
+#define EDGEX_INITRD_H
+
+#include <edgex/kernel.h>
+
+#define INITRD_MAGIC            0x44525845   /* "EXRD" */
+#define INITRD_VERSION          1
+#define INITRD_NAME_MAX         48
+#define INITRD_VADDR_BASE       0x0000300000000000ULL
+
+/*
+ * Archive layout: this header, the file table, then the file data from
+ * data_offset on, each file page-aligned. Offsets are from the start of
+ * the archive.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nr_files;
+    uint32_t data_offset;
+    uint64_t total_size;
+    uint8_t reserved[40];
+} initrd_header_t;
+
+typedef struct __attribute__((packed)) {
+    char name[INITRD_NAME_MAX];  /* NUL-terminated path */
+    uint64_t offset;
+    uint64_t size;
+} initrd_entry_t;
+
+typedef struct {
+    const char* name;
+    uint64_t phys;               /* First page of the data */
+    uint64_t size;
+    uint64_t vaddr;              /* Where tasks see it */
+    volatile uint32_t mappers;
+} initrd_file_t;
+
+/* Record a boot module (from parse_multiboot_info) */
+void initrd_add_module(uint64_t start, uint64_t end, const char* cmdline);
+
+/* Keep the physical allocator off the module (from memory init) */
+void initrd_reserve(void);
+
+/* Check the archive and build the file list */
+void init_initrd(void);
+
+/* Look up a file by path; NULL if there is none */
+const initrd_file_t* initrd_lookup(const char* name);
+uint32_t initrd_count(void);
+const initrd_file_t* initrd_file(uint32_t index);
+
+/* Kernel view of a file's data */
+const void* initrd_data(const initrd_file_t* file);
+
+/*
+ * Map a file read-only into a task, or remove the mapping; returns the
+ * address in the task or 0. Only page tables are set up.
+ */
+uint64_t initrd_map(pid_t owner, const initrd_file_t* file);
+int initrd_unmap(pid_t owner, const initrd_file_t* file);
+
+/* Print the file list */
+void dump_initrd(void);
+
+#endif /* EDGEX_INITRD_H */
@@ -9,6 +9,7 @@
 #define EDGEX_INTERRUPT_H
 
 #include <edgex/kernel.h>
+#include <edgex/cpu.h>
 
 /* Interrupt vector numbers */
 #define INT_VECTOR_DIVIDE_ERROR        0x00
@@ -55,10 +56,28 @@
 #define IRQ_PRIMARY_ATA                14
 #define IRQ_SECONDARY_ATA              15
 
-/* Software interrupts - starts at 0x80 */
+/* Device vectors handed out by the IRQ layer (APIC mode) */
+#define INT_VECTOR_DYNAMIC_FIRST       0x30
+#define INT_VECTOR_DYNAMIC_LAST        0xDF
+
+/* Software interrupts - starts at 0x80 (reserved in the dynamic range) */
 #define INT_VECTOR_SYSCALL             0x80
 #define INT_VECTOR_YIELD               0x81
 
+/* Local APIC timer, delivered as IRQ_TIMER in APIC mode */
+#define INT_VECTOR_LOCAL_TIMER         0xEF
+
+/* Inter-processor interrupts */
+#define INT_VECTOR_RESCHEDULE          0xF0
+
+/* Local APIC error and spurious vectors */
+#define INT_VECTOR_APIC_ERROR          0xFE
+#define INT_VECTOR_SPURIOUS            0xFF
+
+/* IRQ numbers: 0-15 are the ISA IRQs, the rest are allocated */
+#define NR_LEGACY_IRQS                 16
+#define NR_IRQS                        128
+
 /* Maximum number of interrupt vectors */
 #define IDT_ENTRIES                    256
 
@@ -144,23 +163,108 @@ typedef void (*irq_handler_t)(cpu_context_t* context);
 /* General ISR handler function type */
 typedef void (*isr_handler_t)(cpu_context_t* context);
 
+/*
+ * Interrupt controller operations
+ *
+ * Each IRQ is bound to the chip that delivers it (8259 PIC, IOAPIC pin,
+ * local APIC timer, MSI). Chips find their own per-IRQ state with
+ * irq_get_hwirq() and irq_get_chip_data().
+ */
+typedef struct irq_chip {
+    const char* name;
+    void (*mask)(uint8_t irq);
+    void (*unmask)(uint8_t irq);
+    void (*eoi)(uint8_t irq);
+    /* Deliver the IRQ on a vector to a CPU; NULL if the route is fixed */
+    int (*set_route)(uint8_t irq, uint8_t vector, uint32_t apic_id);
+} irq_chip_t;
+
+/* Result of a threaded IRQ's primary handler */
+typedef enum {
+    IRQ_NONE = 0,                /* Not raised by our device */
+    IRQ_HANDLED = 1,             /* Fully handled in the primary handler */
+    IRQ_WAKE_THREAD = 2          /* Run the IRQ thread */
+} irqreturn_t;
+
+/* Primary handler: runs in the interrupt, only acknowledges the device */
+typedef irqreturn_t (*irq_primary_handler_t)(uint8_t irq, void* dev_data);
+
+/* Thread handler: runs in the IRQ's kernel thread, preemptible */
+typedef void (*irq_thread_handler_t)(uint8_t irq, void* dev_data);
+
+/* Per-IRQ statistics */
+typedef struct {
+    uint64_t count;              /* Interrupts received */
+    uint64_t thread_runs;        /* Thread handler runs */
+    uint64_t max_primary_ns;     /* Longest time spent in the interrupt */
+    uint64_t max_wakeup_ns;      /* Longest interrupt-to-thread delay */
+    uint64_t max_thread_ns;      /* Longest thread handler run */
+} irq_stats_t;
+
 /* Initialize the interrupt subsystem */
 void init_interrupts(void);
 
+/* Load the IDT on an application processor */
+void init_interrupts_ap(void);
+
 /* ISR handler registration */
 void register_exception_handler(uint8_t vector, isr_handler_t handler);
 void register_irq_handler(uint8_t irq, irq_handler_t handler);
 void register_isr_handler(uint8_t vector, isr_handler_t handler);
 
+/*
+ * Threaded IRQs
+ *
+ * The primary handler (NULL for the default) runs in the interrupt and
+ * returns IRQ_WAKE_THREAD to hand the rest of the work to a kernel thread
+ * of the given task priority. The line stays masked until the thread
+ * handler returns, so a level-triggered device cannot storm meanwhile.
+ */
+int request_threaded_irq(uint8_t irq, irq_primary_handler_t handler,
+                         irq_thread_handler_t thread_fn, uint32_t priority,
+                         const char* name, void* dev_data);
+void free_irq(uint8_t irq);
+
+/* Handler that runs entirely in the interrupt (no thread) */
+int request_irq(uint8_t irq, irq_primary_handler_t handler, const char* name, void* dev_data);
+int set_irq_thread_priority(uint8_t irq, uint32_t priority);
+
+/* IRQ statistics */
+void get_irq_stats(uint8_t irq, irq_stats_t* stats);
+void dump_irq_stats(void);
+
 /* Enable or disable IRQs */
 void enable_irq(uint8_t irq);
 void disable_irq(uint8_t irq);
 void mask_all_irqs(void);
 void unmask_all_irqs(void);
 
-/* Send EOI to PIC */
+/* Acknowledge an IRQ at its interrupt controller */
 void send_eoi(uint8_t irq);
 
+/*
+ * IRQ descriptors and vectors
+ *
+ * irq_set_chip() binds a fixed IRQ number (e.g. an ISA IRQ) to a chip,
+ * irq_alloc() picks a free number above the ISA range. A vector of 0
+ * allocates one from the dynamic range. New IRQs are routed to a
+ * housekeeping CPU and start masked.
+ */
+int irq_set_chip(uint8_t irq, irq_chip_t* chip, uint32_t hwirq, void* chip_data, uint8_t vector);
+int irq_alloc(irq_chip_t* chip, uint32_t hwirq, void* chip_data);
+void irq_release(uint8_t irq);
+uint32_t irq_get_hwirq(uint8_t irq);
+void* irq_get_chip_data(uint8_t irq);
+uint8_t irq_get_vector(uint8_t irq);
+
+/* Route an IRQ to one of the online CPUs in a mask */
+int irq_set_affinity(uint8_t irq, cpumask_t mask);
+cpumask_t irq_get_affinity(uint8_t irq);
+
+/* Stop using the 8259 PIC once the IOAPICs have taken over */
+void irq_disable_pic(void);
+bool irq_pic_mode(void);
+
 /* Reprogram the PIC with specified IRQ base */
 void reprogram_pic(uint8_t pic1_base, uint8_t pic2_base);
 
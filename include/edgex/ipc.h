@@ -82,6 +82,8 @@ void destroy_shared_memory(shared_memory_t shm);
 void* map_shared_memory(shared_memory_t shm, void* addr_hint, uint32_t permissions);
 int unmap_shared_memory(void* addr, size_t size);
 int resize_shared_memory(shared_memory_t shm, size_t new_size);
+size_t shared_memory_size(shared_memory_t shm);
+uint64_t shared_memory_phys(shared_memory_t shm, size_t offset);
 
 /*
  * IPC Initialization
@@ -38,8 +38,19 @@
  * IPC_STAT_OBJECT_CREATED: Increment when an IPC object is created
  * IPC_STAT_OBJECT_DESTROYED: Increment when an IPC object is destroyed
  */
-#define IPC_STAT_OBJECT_CREATED   1  /* An IPC object was created */
-#define IPC_STAT_OBJECT_DESTROYED 2  /* An IPC object was destroyed */
+#define IPC_STAT_OBJECT_CREATED           1  /* An IPC object was created */
+#define IPC_STAT_OBJECT_DESTROYED         2  /* An IPC object was destroyed */
+#define IPC_STAT_MUTEX_OPERATIONS         3  /* Mutex lock/unlock */
+#define IPC_STAT_SEMAPHORE_OPERATIONS     4  /* Semaphore wait/post */
+#define IPC_STAT_EVENT_OPERATIONS         5  /* Event wait/signal */
+#define IPC_STAT_MESSAGE_OPERATIONS       6  /* Message send/receive */
+#define IPC_STAT_SHARED_MEMORY_OPERATIONS 7  /* Shared memory map/unmap */
+#define IPC_STAT_WAIT_TIME                8  /* Milliseconds spent waiting */
+#define IPC_STAT_ACTIVE_WAITERS           9  /* +1 when a wait starts, -1 when it ends */
+#define IPC_STAT_TIMEOUTS                 10 /* A wait timed out */
+#define IPC_STAT_ALLOCATION_FAILURES      11
+#define IPC_STAT_PERMISSION_FAILURES      12
+#define IPC_STAT_TIMEOUT_FAILURES         13
 
 /* IPC object types 
  * This enumeration defines all the types of IPC objects supported in EdgeX OS.
@@ -135,6 +146,18 @@ typedef struct ipc_stats {
  */
 void update_ipc_stats(int stat_type, int value);
 
+/**
+ * Count an IPC object created or destroyed
+ *
+ * @param type   Type of the object
+ * @param delta  1 when the object was created, -1 when it was destroyed
+ *
+ * Counts IPC_STAT_OBJECT_CREATED or IPC_STAT_OBJECT_DESTROYED and moves the
+ * current count of the type, as one update: get_ipc_stats() sees both
+ * changes or neither.
+ */
+void update_ipc_object_count(ipc_object_type_t type, int delta);
+
 /**
  * Get the current IPC statistics
  *
@@ -250,6 +273,45 @@ bool check_ipc_health(void);
  */
 void dump_ipc_objects(void);
 
+/**
+ * Dump lock contention statistics to the system log
+ *
+ * Prints the lock classes (mutexes and semaphores by name, kernel spinlocks
+ * by the call site that takes them) ranked by total wait time, with their
+ * acquisition and contention counts, wait and hold time percentiles and
+ * histograms, and the tasks that waited longest. Needs a kernel built with
+ * CONFIG_LOCK_STAT (see include/edgex/lockstat.h).
+ *
+ * Example:
+ *   // After a run that seemed to serialize on a lock
+ *   dump_lock_stats();
+ *
+ *   // Output might look like:
+ *   //   fs_access  mutex  1200  310  25.8%  4812000
+ *   //       wait avg 15522 ns, p50 <=8192, p99 <=131072, max 190000
+ *   //       waiter pid 7: 120 waits, 2400000 ns
+ */
+void dump_lock_stats(void);
+
+/**
+ * Dump IPC latency histograms to the system log
+ *
+ * Prints, for every IPC object that has seen operations, the count and
+ * the average, p50, p99, p99.9 and maximum latency in nanoseconds:
+ * lock wait for mutexes, wait for semaphores, signal-to-wake for events
+ * and send-to-receive for message queues (see include/edgex/ipc/latency.h).
+ * The histograms are always on and are cleared by reset_ipc_stats().
+ *
+ * Example:
+ *   // When a pipeline of tasks seems slow to hand work along
+ *   dump_ipc_latency();
+ *
+ *   // Output might look like:
+ *   //   message send-to-receive (ns):
+ *   //     net_rx     48210   5120   3839   61439   245759   301200
+ */
+void dump_ipc_latency(void);
+
 /**
  * Register an IPC object in the system registry
  *
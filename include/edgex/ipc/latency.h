@@ -0,0 +1,71 @@
+/*
+ * EdgeX OS - IPC Latency Histograms
+ *
+ * This file defines the latency histograms kept for each IPC object:
+ * lock wait for mutexes, wait for semaphores, signal-to-wake for events
+ * and send-to-receive for message queues.
+ *
+ * Histograms are log-linear in TSC cycles, in the manner of HDR
+ * histograms: every power of two is split into IPC_LAT_SUB_BUCKETS
+ * linear buckets, so a bucket is never wider than 1/8 of its values.
+ * Each CPU counts into its own buckets, and recording takes no lock and
+ * no atomic instruction, so the histograms stay on in production kernels.
+ * Readers merge the buckets of all CPUs.
+ */
+
+#ifndef EDGEX_IPC_LATENCY_H
+#define EDGEX_IPC_LATENCY_H
+
+#include <edgex/kernel.h>
+
+#define IPC_LAT_MAX_OBJECTS     128      /* Objects created later are not tracked */
+#define IPC_LAT_NAME_LEN        32
+#define IPC_LAT_SUB_BITS        3
+#define IPC_LAT_SUB_BUCKETS     (1 << IPC_LAT_SUB_BITS)
+#define IPC_LAT_BUCKETS         256      /* Up to 2^34 cycles; longer in the last */
+
+/* Operations measured */
+typedef enum {
+    IPC_LAT_MUTEX_WAIT = 0,      /* mutex_lock() call to ownership */
+    IPC_LAT_SEM_WAIT,            /* semaphore_wait() call to return */
+    IPC_LAT_EVENT_WAKE,          /* event_signal() to the waiter running */
+    IPC_LAT_MSG_DELIVERY,        /* Message queued to received */
+    IPC_LAT_OPS
+} ipc_lat_op_t;
+
+/* Histogram handle of an object, IPC_LAT_NONE if not tracked */
+typedef int32_t ipc_lat_id_t;
+#define IPC_LAT_NONE            (-1)
+
+/* Merged histogram of an object, in nanoseconds */
+typedef struct {
+    char name[IPC_LAT_NAME_LEN];
+    ipc_lat_op_t op;
+    uint64_t count;
+    uint64_t avg_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;             /* Upper bound of the bucket holding the percentile */
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} ipc_lat_summary_t;
+
+/* Allocate the buckets of the CPUs online now */
+void init_ipc_latency(void);
+
+/* Start and stop tracking an object */
+ipc_lat_id_t ipc_lat_register(ipc_lat_op_t op, const char* name);
+void ipc_lat_unregister(ipc_lat_id_t id);
+
+/* Count one operation that took a number of TSC cycles */
+void ipc_lat_record(ipc_lat_id_t id, uint64_t cycles);
+
+/* Merge the buckets of an object; 0 on success, -1 if not tracked */
+int ipc_lat_summary(ipc_lat_id_t id, ipc_lat_summary_t* summary);
+
+/* Clear the histograms of every object */
+void ipc_lat_reset(void);
+
+/* Print the tracked objects with operations, grouped by operation */
+void ipc_lat_report(void);
+
+#endif /* EDGEX_IPC_LATENCY_H */
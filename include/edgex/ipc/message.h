@@ -520,5 +520,30 @@ void unregister_task_queue(uint32_t pid, message_queue_t queue);
  */
 void dump_all_message_queues(void);
 
+/**
+ * Depth of a message queue, as sampled for statistics
+ */
+typedef struct {
+    char name[32];            /* Queue name, truncated */
+    pid_t owner;              /* Owner task PID */
+    uint32_t depth;           /* Messages queued */
+    uint32_t max_messages;    /* Capacity */
+    uint64_t messages_sent;
+    uint64_t messages_received;
+} message_queue_depth_t;
+
+/**
+ * Sample the depth of every message queue
+ *
+ * @param depths  Array to fill, one entry per queue
+ * @param max     Number of entries in the array
+ *
+ * @return Number of entries filled
+ *
+ * The queues are read without taking their locks, so a depth may be one
+ * operation behind. Meant for statistics, not for flow control.
+ */
+uint32_t get_message_queue_depths(message_queue_depth_t* depths, uint32_t max);
+
 #endif /* EDGEX_IPC_MESSAGE_H */
 
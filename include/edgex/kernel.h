@@ -14,6 +14,9 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <stdarg.h>
+#include <stdio.h>
 #define UNIT_TEST_DEFINITION 1
 #else
 /* Basic type definitions */
@@ -27,11 +30,19 @@ typedef signed int         int32_t;
 typedef signed long long   int64_t;
 typedef uint64_t           size_t;
 typedef int64_t            ssize_t;
+typedef uint64_t           uintptr_t;
+typedef int32_t            pid_t;
 typedef uint8_t            bool;
 
 /* Boolean constants */
 #define true  1
 #define false 0
+
+/* Variable arguments */
+typedef __builtin_va_list va_list;
+#define va_start(v,l) __builtin_va_start(v,l)
+#define va_end(v) __builtin_va_end(v)
+#define va_arg(v,l) __builtin_va_arg(v,l)
 #endif /* UNIT_TEST */
 
 /* Ensure NULL is defined */
@@ -67,19 +78,15 @@ typedef struct {
 /* Current log level - can be changed at runtime */
 extern int kernel_log_level;
 
-/* Debug macros */
-#define LOG_ERROR(fmt, ...)   kprintf("[ERROR] " fmt "\n", ##__VA_ARGS__)
-#define LOG_WARNING(fmt, ...) if (kernel_log_level >= LOG_LEVEL_WARNING) kprintf("[WARN]  " fmt "\n", ##__VA_ARGS__)
-#define LOG_INFO(fmt, ...)    if (kernel_log_level >= LOG_LEVEL_INFO)    kprintf("[INFO]  " fmt "\n", ##__VA_ARGS__)
-#define LOG_DEBUG(fmt, ...)   if (kernel_log_level >= LOG_LEVEL_DEBUG)   kprintf("[DEBUG] " fmt "\n", ##__VA_ARGS__)
-#define LOG_TRACE(fmt, ...)   if (kernel_log_level >= LOG_LEVEL_TRACE)   kprintf("[TRACE] " fmt "\n", ##__VA_ARGS__)
+/* Debug macros - messages go through the kernel log (see klog.h) */
+#define LOG_ERROR(fmt, ...)   klog_printf(LOG_LEVEL_ERROR, "[ERROR] " fmt "\n", ##__VA_ARGS__)
+#define LOG_WARNING(fmt, ...) if (kernel_log_level >= LOG_LEVEL_WARNING) klog_printf(LOG_LEVEL_WARNING, "[WARN]  " fmt "\n", ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)    if (kernel_log_level >= LOG_LEVEL_INFO)    klog_printf(LOG_LEVEL_INFO, "[INFO]  " fmt "\n", ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...)   if (kernel_log_level >= LOG_LEVEL_DEBUG)   klog_printf(LOG_LEVEL_DEBUG, "[DEBUG] " fmt "\n", ##__VA_ARGS__)
+#define LOG_TRACE(fmt, ...)   if (kernel_log_level >= LOG_LEVEL_TRACE)   klog_printf(LOG_LEVEL_TRACE, "[TRACE] " fmt "\n", ##__VA_ARGS__)
 
 /* Panic - halts the system with a message */
-#define PANIC(fmt, ...) do { \
-    kprintf("[PANIC] " fmt "\n", ##__VA_ARGS__); \
-    __asm__ volatile("cli; hlt"); \
-    for(;;); \
-} while(0)
+#define PANIC(fmt, ...) kernel_panic(fmt "\n", ##__VA_ARGS__)
 
 /* Assert - checks a condition and panics if false */
 #define ASSERT(cond, fmt, ...) do { \
@@ -149,6 +156,14 @@ typedef struct {
     /* Entries follow */
 } multiboot2_mmap_t;
 
+/* Multiboot2 module tag */
+typedef struct {
+    multiboot2_tag_t tag;
+    uint32_t mod_start;       /* Physical, page-aligned (see boot.S) */
+    uint32_t mod_end;
+    char cmdline[];
+} multiboot2_module_t;
+
 /* Virtual memory mapping flags */
 #define VM_READ     (1 << 0)  /* Readable */
 #define VM_WRITE    (1 << 1)  /* Writable */
@@ -167,7 +182,12 @@ void parse_multiboot_info(void);
 /* Console/output functions */
 void kputchar(char c);
 void kputs(const char* str);
-int kprintf(const char* fmt, ...);
+void vga_console_write(const char* buf, size_t len);
+int kprintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+int kernel_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+int klog_printf(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+void klog_flush(void);
+void kernel_panic(const char* fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
 
 /* Memory management functions */
 void* alloc_page(void);
@@ -179,10 +199,12 @@ uint64_t page_get_flags(void* page);
 void page_set_flags(void* page, uint64_t flags);
 void reserve_page_range(void* start, size_t size);
 void get_memory_stats(uint64_t* total, uint64_t* free, uint64_t* used);
+uint64_t get_zone_free_pages(memory_zone_type_t zone);
 
 void* kmalloc(size_t size);
 void* kzalloc(size_t size);
 void kfree(void* ptr);
+void get_heap_stats(size_t* used, size_t* size);
 void* vmalloc(size_t size);
 void vfree(void* ptr);
 
@@ -192,6 +214,11 @@ void* memset(void* s, int c, size_t n);
 void* memcpy(void* dest, const void* src, size_t n);
 int memcmp(const void* s1, const void* s2, size_t n);
 void* memmove(void* dest, const void* src, size_t n);
+char* strncpy(char* dest, const char* src, size_t n);
+
+/* String formatting (kernel/vsprintf.c) */
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args) __attribute__((format(printf, 3, 0)));
+int snprintf(char* buf, size_t size, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
 #endif /* UNIT_TEST */
 /* Inline assembly wrapper */
 static inline void outb(uint16_t port, uint8_t value) {
@@ -204,6 +231,26 @@ static inline uint8_t inb(uint16_t port) {
     return value;
 }
 
+static inline void outw(uint16_t port, uint16_t value) {
+    __asm__ volatile("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t value;
+    __asm__ volatile("inw %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static inline void outl(uint16_t port, uint32_t value) {
+    __asm__ volatile("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t value;
+    __asm__ volatile("inl %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
 static inline void io_wait(void) {
     outb(0x80, 0);
 }
@@ -220,4 +267,71 @@ static inline void hlt(void) {
     __asm__ volatile("hlt");
 }
 
+/* RFLAGS.IF - interrupts enabled */
+#define RFLAGS_IF (1ULL << 9)
+
+/* Compiler barrier */
+#define barrier() __asm__ volatile("" ::: "memory")
+
+/* Disable interrupts and return the previous RFLAGS */
+static inline uint64_t local_irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/* Restore the interrupt state saved by local_irq_save() */
+static inline void local_irq_restore(uint64_t flags) {
+    if (flags & RFLAGS_IF) {
+        __asm__ volatile("sti" ::: "memory");
+    }
+}
+
+/* Enable interrupts on the local CPU */
+static inline void local_irq_enable(void) {
+    __asm__ volatile("sti" ::: "memory");
+}
+
+/* Disable interrupts on the local CPU */
+static inline void local_irq_disable(void) {
+    __asm__ volatile("cli" ::: "memory");
+}
+
+/* Check whether interrupts are disabled on this CPU */
+static inline bool irqs_disabled(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; popq %0" : "=r"(flags));
+    return !(flags & RFLAGS_IF);
+}
+
+/* Spin-wait hint for busy loops */
+static inline void cpu_relax(void) {
+    __asm__ volatile("pause" ::: "memory");
+}
+
+/* Read the time stamp counter */
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Model specific register access */
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    __asm__ volatile("cpuid"
+                     : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                     : "a"(leaf), "c"(subleaf));
+}
+
 #endif /* EDGEX_KERNEL_H */
@@ -0,0 +1,69 @@
+/*
+ * EdgeX OS - Kernel Log
+ *
+ * This file defines the kernel log. A message is formatted on the
+ * caller's stack and copied into the ring of the CPU it runs on, with a
+ * global sequence number and a TSC timestamp; no lock is shared between
+ * CPUs. The klogd task merges the rings in sequence order and renders
+ * the messages to the consoles, so the caller never waits for the VGA
+ * buffer or a UART. Until klogd runs, and on a panic, messages go to the
+ * consoles directly.
+ */
+
+#ifndef EDGEX_KLOG_H
+#define EDGEX_KLOG_H
+
+#include <edgex/kernel.h>
+
+#define KLOG_RING_SIZE          16384        /* Bytes per CPU (power of two) */
+#define KLOG_MAX_MSG            256          /* Longer messages are cut */
+#define KLOG_DRAIN_MS           10           /* klogd polling period */
+
+/* What a full ring does with a new message */
+typedef enum {
+    KLOG_OVERWRITE = 0,          /* Drop the oldest messages (default) */
+    KLOG_DROP                    /* Drop the new message */
+} klog_policy_t;
+
+/* Record header in a ring; the text follows, padded to 8 bytes */
+typedef struct {
+    uint64_t seq;
+    uint64_t tsc;
+    uint16_t len;                /* Text bytes; KLOG_PAD: skip to the ring end */
+    uint8_t level;
+    uint8_t cpu;
+    uint32_t reserved;
+} klog_record_t;
+
+#define KLOG_PAD                0xFFFF
+
+/* A console klogd renders to */
+typedef struct klog_console {
+    const char* name;
+    void (*write)(const char* buf, size_t len);
+    void (*flush)(void);         /* Panic: send what is buffered by polling (optional) */
+    struct klog_console* next;
+} klog_console_t;
+
+typedef struct {
+    uint64_t messages;
+    uint64_t dropped;            /* New messages refused (KLOG_DROP) */
+    uint64_t overwritten;        /* Old messages lost (KLOG_OVERWRITE or a slow reader) */
+    uint64_t truncated;
+} klog_stats_t;
+
+/* Start klogd (needs the scheduler) */
+void init_klog(void);
+
+/* Log a message at a LOG_LEVEL_* level (klog_printf() is in kernel.h) */
+int vklog(int level, const char* fmt, va_list args) __attribute__((format(printf, 2, 0)));
+
+void klog_set_policy(klog_policy_t policy);
+void klog_register_console(klog_console_t* console);
+void klog_unregister_console(klog_console_t* console);
+
+/* Sum of the per-CPU counters */
+void klog_get_stats(klog_stats_t* stats);
+void dump_klog_stats(void);
+
+#endif /* EDGEX_KLOG_H */
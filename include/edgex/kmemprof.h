@@ -0,0 +1,70 @@
+/*
+ * EdgeX OS - Kernel Heap Profiler
+ *
+ * This file defines the allocation profiler of the kernel heap. Built
+ * with CONFIG_KMEM_PROFILE, kmalloc() and kzalloc() count against their
+ * call site: allocations, bytes, bytes still live and, for objects that
+ * are kfree()d, a histogram of how long they lived.
+ *
+ * Allocations are sampled by bytes, in the manner of heap profilers: a
+ * CPU counts allocated bytes down from a random interval averaging the
+ * sample rate and records the allocation that crosses zero. A sample
+ * stands for rate/size allocations of its size (one if it is larger),
+ * so the per-site figures are estimates whose error shrinks with the
+ * bytes a site allocates. Allocations that are not sampled only update
+ * the countdown of their CPU. A rate of 0 records every allocation.
+ *
+ * Without CONFIG_KMEM_PROFILE the hooks compile to nothing.
+ */
+
+#ifndef EDGEX_KMEMPROF_H
+#define EDGEX_KMEMPROF_H
+
+#include <edgex/kernel.h>
+
+#define KMEMPROF_MAX_SITES          256      /* Power of two */
+#define KMEMPROF_MAX_OBJECTS        4096     /* Sampled objects live at once, power of two */
+#define KMEMPROF_LIFE_BUCKETS       48       /* Power-of-two TSC cycle buckets */
+#define KMEMPROF_DEFAULT_RATE       4096     /* Bytes between samples, on average */
+
+typedef struct kmemprof_site {
+    volatile uint32_t state;     /* Table slot: empty, claimed, ready */
+    uintptr_t site;              /* Return address of the kmalloc()/kzalloc() call */
+
+    uint64_t samples;            /* Allocations recorded */
+    uint64_t allocs;             /* Estimated allocations */
+    uint64_t bytes;              /* Estimated bytes allocated */
+    uint64_t frees;              /* Estimated allocations freed */
+    uint64_t freed_bytes;
+    uint64_t max_size;           /* Largest sampled allocation */
+    uint64_t life_hist[KMEMPROF_LIFE_BUCKETS];
+} kmemprof_site_t;
+
+#ifdef CONFIG_KMEM_PROFILE
+
+/* Allocation and free hooks (memory.c) */
+void kmemprof_alloc(void* ptr, size_t size, uintptr_t site);
+void kmemprof_free(void* ptr);
+
+#else
+
+#define kmemprof_alloc(ptr, size, site) do { (void)(ptr); (void)(size); (void)(site); } while (0)
+#define kmemprof_free(ptr)              do { (void)(ptr); } while (0)
+
+#endif /* CONFIG_KMEM_PROFILE */
+
+/*
+ * Start recording with a sample rate in bytes (0: every allocation);
+ * needs the per-CPU blocks, so allocations before init_boot_cpu() are
+ * never recorded
+ */
+void kmemprof_start(uint32_t rate);
+void kmemprof_stop(void);
+
+/* Forget every site and sampled object */
+void kmemprof_reset(void);
+
+/* Print the sites holding the most live bytes, with lifetime histograms */
+void kmemprof_report(uint32_t max_sites);
+
+#endif /* EDGEX_KMEMPROF_H */
@@ -0,0 +1,135 @@
+/*
+ * EdgeX OS - Statistics Page
+ *
+ * This file defines the statistics the kernel publishes for monitoring
+ * tasks: memory, IPC counters, per-CPU scheduling and run queue depth,
+ * per-task CPU time and message queue depths. kstatsd refreshes them
+ * every KSTATS_INTERVAL_MS into a few pages that tasks map read-only at
+ * KSTATS_VADDR, so an agent samples them with plain loads: no system
+ * call, and nothing on the paths that produce the numbers.
+ *
+ * The pages are updated under a sequence count. A reader copies what it
+ * needs between kstats_read_begin() and kstats_read_retry() and starts
+ * over if the retry check fails:
+ *
+ *     do {
+ *         seq = kstats_read_begin(page);
+ *         memcpy(&copy, page, sizeof(copy));
+ *     } while (kstats_read_retry(page, seq));
+ *
+ * Fields are only ever added at the end of kstats_page_t; a change to
+ * existing ones bumps KSTATS_VERSION.
+ */
+
+#ifndef EDGEX_KSTATS_H
+#define EDGEX_KSTATS_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/ipc/common.h>
+
+#define KSTATS_MAGIC            0x53544b45   /* "EKTS" */
+#define KSTATS_VERSION          1
+#define KSTATS_VADDR            0x0000380000000000ULL
+#define KSTATS_PAGES            4
+#define KSTATS_INTERVAL_MS      500
+#define KSTATS_MAX_TASKS        64
+#define KSTATS_MAX_QUEUES       32
+#define KSTATS_NAME_LEN         32
+
+/* One CPU, counts since boot or the last reset_sched_stats() */
+typedef struct {
+    uint32_t online;
+    uint32_t nr_running;          /* Run queue depth now */
+    uint64_t avg_nr_running_x100; /* Time-weighted run queue depth, x100 */
+    uint64_t window_ns;
+    uint64_t idle_ns;
+    uint64_t nr_switches;
+    uint64_t nr_wakeups;
+    uint64_t nr_remote_wakeups;
+    uint64_t nr_wake_ipis;
+} kstats_cpu_t;
+
+/* One task, times since it started or the last reset_sched_stats() */
+typedef struct {
+    int32_t pid;
+    uint32_t state;               /* task_state_t */
+    uint32_t priority;            /* task_priority_t */
+    uint32_t cpu;
+    char name[KSTATS_NAME_LEN];
+    uint64_t run_ns;
+    uint64_t wait_ns;             /* Ready but not running */
+    uint64_t nr_voluntary;
+    uint64_t nr_involuntary;
+    uint64_t wake_latency_avg_ns;
+    uint64_t wake_latency_max_ns;
+} kstats_task_t;
+
+/* One message queue */
+typedef struct {
+    char name[KSTATS_NAME_LEN];
+    int32_t owner;
+    uint32_t depth;
+    uint32_t max_messages;
+    uint32_t reserved;
+    uint64_t messages_sent;
+    uint64_t messages_received;
+} kstats_queue_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                /* sizeof(kstats_page_t) */
+    volatile uint32_t seq;        /* Odd while an update is in progress */
+    uint64_t updates;
+    uint64_t timestamp_ns;        /* Since boot, when the update was taken */
+    uint32_t interval_ms;
+    uint32_t reserved;
+
+    /* Memory, in pages */
+    uint64_t total_pages;
+    uint64_t free_pages;
+    uint64_t zone_free_pages[ZONE_TYPES_COUNT];
+
+    /* IPC */
+    ipc_stats_t ipc;
+
+    /* CPUs, indexed by CPU number */
+    uint32_t nr_cpus;             /* Entries in use */
+    uint32_t nr_tasks;
+    uint32_t tasks_dropped;       /* Tasks beyond KSTATS_MAX_TASKS */
+    uint32_t nr_queues;
+    kstats_cpu_t cpus[MAX_CPUS];
+    kstats_task_t tasks[KSTATS_MAX_TASKS];
+    kstats_queue_t queues[KSTATS_MAX_QUEUES];
+} kstats_page_t;
+
+/* Allocate the pages and start kstatsd (after init_scheduler) */
+void init_kstats(void);
+
+/* Map the pages read-only into a task at KSTATS_VADDR; returns it, or 0 */
+uint64_t kstats_map(pid_t owner);
+int kstats_unmap(pid_t owner);
+
+/*
+ * Start a read; waits out an update in progress
+ */
+static inline uint32_t kstats_read_begin(const kstats_page_t* page) {
+    uint32_t seq;
+
+    while ((seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE)) & 1) {
+        __asm__ volatile("pause");
+    }
+    return seq;
+}
+
+/*
+ * True if the page changed since kstats_read_begin() and the copy must
+ * be taken again
+ */
+static inline bool kstats_read_retry(const kstats_page_t* page, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&page->seq, __ATOMIC_RELAXED) != seq;
+}
+
+#endif /* EDGEX_KSTATS_H */
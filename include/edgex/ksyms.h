@@ -0,0 +1,31 @@
+/*
+ * EdgeX OS - Kernel Symbols
+ *
+ * This file declares the symbol table embedded in the kernel image. The
+ * kernel is linked twice: tools/mksyms.py turns the code symbols of the
+ * first link into a table that the second link places at the end of
+ * .rodata, after all code, so no function moves between the two links.
+ */
+
+#ifndef EDGEX_KSYMS_H
+#define EDGEX_KSYMS_H
+
+#include <edgex/kernel.h>
+
+/* Number of symbols in the table */
+uint32_t ksym_count(void);
+
+/* Whether an address is inside the kernel's code */
+bool ksym_in_text(uint64_t addr);
+
+/* Index of the symbol containing an address, -1 if none */
+int32_t ksym_index(uint64_t addr);
+
+/* Name and start address of a symbol by index */
+const char* ksym_name(uint32_t index);
+uint64_t ksym_addr(uint32_t index);
+
+/* Name of the symbol containing an address (and the offset into it), NULL if none */
+const char* ksym_lookup(uint64_t addr, uint64_t* offset);
+
+#endif /* EDGEX_KSYMS_H */
@@ -0,0 +1,103 @@
+/*
+ * EdgeX OS - Lock Statistics
+ *
+ * This file defines per-class lock contention statistics. Built with
+ * CONFIG_LOCK_STAT, every acquisition of a mutex, semaphore or spinlock
+ * is counted against its class: IPC objects by name, spinlocks by the
+ * call site that takes them. A class keeps acquisition and contention
+ * counts, wait and hold time histograms, and the tasks that waited
+ * longest. Without CONFIG_LOCK_STAT the hooks compile to nothing and
+ * locks keep their size.
+ */
+
+#ifndef EDGEX_LOCKSTAT_H
+#define EDGEX_LOCKSTAT_H
+
+#include <edgex/kernel.h>
+
+#define LOCKSTAT_MAX_CLASSES    512      /* Power of two */
+#define LOCKSTAT_NAME_LEN       32
+#define LOCKSTAT_HIST_BUCKETS   40       /* Power-of-two TSC cycle buckets */
+#define LOCKSTAT_TOP_WAITERS    4
+
+/* Lock types */
+#define LOCKSTAT_SPINLOCK       1
+#define LOCKSTAT_MUTEX          2
+#define LOCKSTAT_SEMAPHORE      3
+
+typedef struct lockstat_waiter {
+    pid_t pid;
+    uint32_t contended;          /* Times this task had to wait */
+    uint64_t wait_cycles;
+} lockstat_waiter_t;
+
+typedef struct lockstat_class {
+    volatile uint32_t state;     /* Table slot: empty, claimed, ready */
+    uint8_t type;                /* LOCKSTAT_* */
+    uintptr_t site;              /* Spinlocks: where the lock was taken */
+    char name[LOCKSTAT_NAME_LEN]; /* IPC objects: the object name */
+
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t wait_cycles;
+    uint64_t wait_max;
+    uint64_t hold_cycles;
+    uint64_t hold_max;
+    uint64_t releases;           /* Holds timed */
+    uint64_t wait_hist[LOCKSTAT_HIST_BUCKETS];
+    uint64_t hold_hist[LOCKSTAT_HIST_BUCKETS];
+
+    volatile uint32_t waiters_lock;
+    lockstat_waiter_t waiters[LOCKSTAT_TOP_WAITERS];
+} lockstat_class_t;
+
+struct spinlock;
+
+#ifdef CONFIG_LOCK_STAT
+
+/* Class of a named IPC object (NULL once the class table is full) */
+lockstat_class_t* lockstat_class_named(uint8_t type, const char* name);
+
+/* Count an acquisition; wait_cycles is 0 unless it was contended */
+void lockstat_acquired(lockstat_class_t* cls, uint64_t wait_cycles, bool contended);
+
+/* Count the hold time of a release */
+void lockstat_released(lockstat_class_t* cls, uint64_t acquired_tsc);
+
+/* Spinlock acquisition and release (spinlock.h) */
+void lockstat_spin_lock(struct spinlock* lock, uintptr_t site);
+bool lockstat_spin_trylock(struct spinlock* lock, uintptr_t site);
+void lockstat_spin_release(struct spinlock* lock);
+
+/* Fields of a lock that is timed from acquisition to release */
+#define LOCKSTAT_LOCK_FIELDS \
+    lockstat_class_t* lock_class; \
+    uint64_t acquired_tsc;
+
+/* Hooks for IPC objects that carry LOCKSTAT_LOCK_FIELDS */
+#define lockstat_ipc_init(obj, type) \
+    ((obj)->lock_class = lockstat_class_named((type), (obj)->header.name))
+#define lockstat_ipc_acquired(obj, start, was_contended) do { \
+    uint64_t __now = rdtsc(); \
+    lockstat_acquired((obj)->lock_class, (was_contended) ? __now - (start) : 0, (was_contended)); \
+    (obj)->acquired_tsc = __now; \
+} while (0)
+#define lockstat_ipc_released(obj)      lockstat_released((obj)->lock_class, (obj)->acquired_tsc)
+
+#else
+
+#define LOCKSTAT_LOCK_FIELDS
+
+#define lockstat_ipc_init(obj, type)    do { } while (0)
+#define lockstat_ipc_acquired(obj, start, was_contended) do { (void)(start); } while (0)
+#define lockstat_ipc_released(obj)      do { } while (0)
+
+#endif /* CONFIG_LOCK_STAT */
+
+/* Clear the statistics of every class */
+void lockstat_reset(void);
+
+/* Print the classes ranked by total wait time, with histograms and top waiters */
+void lockstat_report(uint32_t max_classes);
+
+#endif /* EDGEX_LOCKSTAT_H */
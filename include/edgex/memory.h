@@ -47,6 +47,20 @@ void free_pages(void* addr, size_t count);
 int map_pages(uint64_t vaddr, uint64_t paddr, size_t size, uint64_t flags);
 int unmap_pages(uint64_t vaddr, size_t size);
 
+/* Device memory (MMIO) mapping, uncached */
+void* ioremap(uint64_t phys_addr, size_t size);
+void iounmap(void* addr, size_t size);
+
+/* Device memory and DMA pinning in task address spaces */
+struct page_directory;
+struct page_directory* find_page_directory(pid_t owner_pid);
+int map_device_memory(struct page_directory* pd, uint64_t vaddr, uint64_t paddr, size_t size,
+                      bool writable, bool uncached);
+int pin_user_pages(struct page_directory* pd, uint64_t vaddr, size_t size,
+                   uint64_t* phys, size_t max_pages);
+int unpin_user_pages(struct page_directory* pd, uint64_t vaddr, size_t size);
+int unmap_memory_range(struct page_directory* pd, uint64_t vaddr, size_t size, bool free_phys);
+
 /* Memory information function */
 void memory_init(void);
 void memory_late_init(void);
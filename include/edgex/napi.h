@@ -0,0 +1,69 @@
+/*
+ * EdgeX OS - Interrupt Mitigation by Polling (NAPI)
+ *
+ * This file defines the poll contexts that let receive queues switch
+ * between interrupt mode and polling. The first interrupt disables the
+ * queue's interrupts and schedules its poll function in the NET_RX
+ * softirq; the queue stays in polling mode for as long as each poll
+ * finds a full budget of work, and re-enables interrupts once it drains.
+ * Under load a queue costs no interrupts at all.
+ */
+
+#ifndef EDGEX_NAPI_H
+#define EDGEX_NAPI_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+/* Default packets per poll call */
+#define NAPI_POLL_WEIGHT      64
+
+struct napi;
+
+/*
+ * Poll function: process up to budget packets and return how many were
+ * processed. Returning less than budget means the queue is drained and
+ * the function has called napi_complete() (and re-enabled interrupts).
+ */
+typedef int (*napi_poll_t)(struct napi* napi, int budget);
+
+/* Per-context counters */
+typedef struct {
+    uint64_t schedules;          /* Switches from interrupt to polling mode */
+    uint64_t polls;              /* Poll function calls */
+    uint64_t packets;            /* Work done across all polls */
+    uint64_t budget_exhausted;   /* Polls that stayed in polling mode */
+} napi_stats_t;
+
+typedef struct napi {
+    struct napi* next;           /* Per-CPU poll list link */
+    napi_poll_t poll;
+    int weight;
+    volatile uint32_t state;     /* NAPI_STATE_* */
+    uint32_t cpu;                /* CPU whose list it is on */
+    void* priv;                  /* Owned by the driver */
+    napi_stats_t stats;
+} napi_t;
+
+#define NAPI_STATE_SCHED      (1 << 0)   /* On a poll list or being polled */
+
+/* Register the NET_RX softirq (after init_softirqs) */
+void init_napi(void);
+
+/* Set up a poll context */
+void napi_init(napi_t* napi, napi_poll_t poll, int weight, void* priv);
+
+/*
+ * Schedule a poll on the calling CPU (from the queue's interrupt)
+ *
+ * Returns false if the context was already scheduled.
+ */
+bool napi_schedule(napi_t* napi);
+
+/* Leave polling mode; call from the poll function before re-enabling interrupts */
+void napi_complete(napi_t* napi);
+
+/* Print per-context and per-CPU poll statistics */
+void dump_napi_stats(napi_t* napi, const char* name);
+
+#endif /* EDGEX_NAPI_H */
@@ -0,0 +1,187 @@
+/*
+ * EdgeX OS - Network Protocols
+ *
+ * This file defines the wire formats and interface configuration of the
+ * network stack: Ethernet, ARP, IPv4, IPv6 with neighbor discovery, and
+ * UDP. The stack runs on a virtio-net device; received frames are parsed
+ * where the device wrote them and UDP payloads are handed to sockets
+ * without a copy (see udp.h).
+ */
+
+#ifndef EDGEX_NET_H
+#define EDGEX_NET_H
+
+#include <edgex/kernel.h>
+#include <edgex/virtio_net.h>
+
+/* Byte order (the wire is big-endian, x86 is not) */
+static inline uint16_t htons(uint16_t v) {
+    return __builtin_bswap16(v);
+}
+
+static inline uint32_t htonl(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+#define ntohs(v)  htons(v)
+#define ntohl(v)  htonl(v)
+
+/* Ethernet */
+#define ETH_ALEN              6
+#define ETH_HLEN              14
+#define ETH_TYPE_IPV4         0x0800
+#define ETH_TYPE_ARP          0x0806
+#define ETH_TYPE_IPV6         0x86DD
+
+typedef struct __attribute__((packed)) {
+    uint8_t dst[ETH_ALEN];
+    uint8_t src[ETH_ALEN];
+    uint16_t type;
+} eth_hdr_t;
+
+/* ARP (Ethernet/IPv4 only) */
+#define ARP_OP_REQUEST        1
+#define ARP_OP_REPLY          2
+
+typedef struct __attribute__((packed)) {
+    uint16_t htype;
+    uint16_t ptype;
+    uint8_t hlen;
+    uint8_t plen;
+    uint16_t op;
+    uint8_t sha[ETH_ALEN];
+    uint32_t spa;
+    uint8_t tha[ETH_ALEN];
+    uint32_t tpa;
+} arp_pkt_t;
+
+/* IPv4 */
+#define IP_PROTO_UDP          17
+#define IP_PROTO_ICMPV6       58
+#define IPV4_DEFAULT_TTL      64
+
+typedef struct __attribute__((packed)) {
+    uint8_t ver_ihl;
+    uint8_t tos;
+    uint16_t total_len;
+    uint16_t id;
+    uint16_t frag_off;
+    uint8_t ttl;
+    uint8_t proto;
+    uint16_t csum;
+    uint32_t src;
+    uint32_t dst;
+} ipv4_hdr_t;
+
+#define IPV4_FRAG_MASK        0x3FFF    /* More fragments flag and offset */
+
+/* IPv6 */
+#define IPV6_HLEN             40
+#define IPV6_DEFAULT_HOPS     64
+
+typedef struct __attribute__((packed)) {
+    uint32_t ver_tc_flow;
+    uint16_t payload_len;
+    uint8_t next_hdr;
+    uint8_t hop_limit;
+    uint8_t src[16];
+    uint8_t dst[16];
+} ipv6_hdr_t;
+
+/* ICMPv6 neighbor discovery */
+#define ICMPV6_NS             135
+#define ICMPV6_NA             136
+#define ND_OPT_SOURCE_LLADDR  1
+#define ND_OPT_TARGET_LLADDR  2
+#define ND_NA_SOLICITED       0x40000000
+#define ND_NA_OVERRIDE        0x20000000
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t code;
+    uint16_t csum;
+    uint32_t flags;              /* Reserved in NS */
+    uint8_t target[16];
+    uint8_t opt_type;            /* Link-layer address option */
+    uint8_t opt_len;             /* In units of 8 bytes */
+    uint8_t opt_lladdr[ETH_ALEN];
+} nd_msg_t;
+
+/* UDP */
+typedef struct __attribute__((packed)) {
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint16_t len;
+    uint16_t csum;
+} udp_hdr_t;
+
+/* Headroom a UDP payload needs in front of it for the largest headers */
+#define NET_UDP_HEADROOM      64
+#define NET_MTU               1500
+
+/* An IPv4 or IPv6 address */
+#define NET_AF_INET           4
+#define NET_AF_INET6          6
+
+typedef struct {
+    uint8_t family;              /* NET_AF_* */
+    uint8_t addr[16];            /* IPv4 uses the first 4 bytes (network order) */
+} net_addr_t;
+
+/* Interface configuration */
+typedef struct {
+    uint32_t ipv4;               /* Network order */
+    uint32_t ipv4_mask;
+    uint32_t ipv4_gateway;
+    uint8_t ipv6[16];            /* Global address (all zero if none) */
+    uint8_t ipv6_gateway[16];    /* Off-link destinations go here (all zero: all on-link) */
+} net_config_t;
+
+/* Interface counters */
+typedef struct {
+    uint64_t rx_frames;
+    uint64_t rx_udp;
+    uint64_t rx_dropped;         /* Malformed, bad checksum or no socket */
+    uint64_t rx_csum_offloaded;  /* Checksums the device already verified */
+    uint64_t tx_udp;
+    uint64_t tx_csum_offloaded;
+    uint64_t tx_unresolved;      /* Packets dropped waiting for a neighbor */
+    uint64_t arp_requests;
+    uint64_t nd_solicits;
+} net_stats_t;
+
+/* Bring the stack up on the first virtio-net device */
+int init_net(const net_config_t* config);
+
+/* Make an address from dotted-quad parts or from 16 bytes */
+net_addr_t net_addr_ipv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+net_addr_t net_addr_ipv6(const uint8_t* addr);
+
+/* Interface state */
+virtio_net_t* net_device(void);
+const uint8_t* net_mac(void);
+void net_get_stats(net_stats_t* stats);
+void dump_net_stats(void);
+
+/*
+ * Internet checksum: sum 16-bit words into a 32-bit accumulator, then
+ * fold and complement
+ */
+uint32_t net_csum_add(uint32_t sum, const void* data, size_t len);
+uint16_t net_csum_fold(uint32_t sum);
+
+/*
+ * Transmit a UDP datagram whose payload sits at payload_phys with
+ * NET_UDP_HEADROOM free bytes before it (the headers are built there).
+ * With more set the doorbell waits for a later call. Returns 0, or -1
+ * if the neighbor is unresolved or the TX ring is full.
+ */
+int net_udp_output(uint16_t queue, const net_addr_t* dst, uint16_t dst_port,
+                   uint16_t src_port, uint8_t* payload, uint64_t payload_phys,
+                   uint16_t len, void* cookie, bool more);
+void net_flush(uint16_t queue);
+
+/* Service work: neighbor retransmits and cache aging (from netd) */
+void net_periodic(void);
+
+#endif /* EDGEX_NET_H */
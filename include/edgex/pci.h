@@ -0,0 +1,181 @@
+/*
+ * EdgeX OS - PCI Bus
+ *
+ * This file defines PCI configuration-space access, device enumeration,
+ * BAR mapping and MSI/MSI-X interrupt allocation. Each MSI-X vector is
+ * an ordinary IRQ, so a multi-queue driver can steer every queue's
+ * interrupt to the CPU that services that queue.
+ */
+
+#ifndef EDGEX_PCI_H
+#define EDGEX_PCI_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+/* Configuration space header (type 0 and common fields) */
+#define PCI_VENDOR_ID              0x00
+#define PCI_DEVICE_ID              0x02
+#define PCI_COMMAND                0x04
+#define PCI_STATUS                 0x06
+#define PCI_REVISION_ID            0x08
+#define PCI_PROG_IF                0x09
+#define PCI_SUBCLASS               0x0A
+#define PCI_CLASS                  0x0B
+#define PCI_HEADER_TYPE            0x0E
+#define PCI_BAR0                   0x10
+#define PCI_SECONDARY_BUS          0x19   /* Type 1 (bridge) header */
+#define PCI_SUBSYSTEM_ID           0x2E
+#define PCI_CAPABILITY_LIST        0x34
+#define PCI_INTERRUPT_LINE         0x3C
+#define PCI_INTERRUPT_PIN          0x3D
+
+/* Command register */
+#define PCI_COMMAND_IO             (1 << 0)
+#define PCI_COMMAND_MEMORY         (1 << 1)
+#define PCI_COMMAND_MASTER         (1 << 2)
+#define PCI_COMMAND_INTX_DISABLE   (1 << 10)
+
+/* Status register */
+#define PCI_STATUS_CAP_LIST        (1 << 4)
+
+/* Header type */
+#define PCI_HEADER_TYPE_MASK       0x7F
+#define PCI_HEADER_TYPE_BRIDGE     0x01
+#define PCI_HEADER_MULTI_FUNCTION  0x80
+
+/* BAR fields */
+#define PCI_BAR_IO                 (1 << 0)
+#define PCI_BAR_MEM_TYPE_64        (2 << 1)
+#define PCI_BAR_MEM_PREFETCH       (1 << 3)
+
+/* Capability IDs */
+#define PCI_CAP_ID_MSI             0x05
+#define PCI_CAP_ID_VNDR            0x09
+#define PCI_CAP_ID_EXP             0x10
+#define PCI_CAP_ID_MSIX            0x11
+
+/* MSI capability */
+#define PCI_MSI_FLAGS              0x02
+#define PCI_MSI_FLAGS_ENABLE       (1 << 0)
+#define PCI_MSI_FLAGS_64BIT        (1 << 7)
+#define PCI_MSI_FLAGS_MASKBIT      (1 << 8)
+#define PCI_MSI_ADDRESS_LO         0x04
+
+/* MSI-X capability */
+#define PCI_MSIX_FLAGS             0x02
+#define PCI_MSIX_FLAGS_QSIZE       0x07FF
+#define PCI_MSIX_FLAGS_MASKALL     (1 << 14)
+#define PCI_MSIX_FLAGS_ENABLE      (1 << 15)
+#define PCI_MSIX_TABLE             0x04
+#define PCI_MSIX_PBA               0x08
+#define PCI_MSIX_BIR_MASK          0x07
+
+/* MSI-X table entry */
+#define PCI_MSIX_ENTRY_SIZE        16
+#define PCI_MSIX_ENTRY_ADDR_LO     0x0
+#define PCI_MSIX_ENTRY_ADDR_HI     0x4
+#define PCI_MSIX_ENTRY_DATA        0x8
+#define PCI_MSIX_ENTRY_CTRL        0xC
+#define PCI_MSIX_ENTRY_CTRL_MASKED (1 << 0)
+
+/* Enumeration limits */
+#define PCI_MAX_DEVICES            64
+#define PCI_MAX_BARS               6
+#define PCI_MAX_VECTORS            32
+
+/* Interrupt mode of a device */
+typedef enum {
+    PCI_IRQ_NONE = 0,
+    PCI_IRQ_LEGACY,
+    PCI_IRQ_MSI,
+    PCI_IRQ_MSIX
+} pci_irq_mode_t;
+
+/* A decoded base address register */
+typedef struct {
+    uint64_t phys;               /* Bus address */
+    uint64_t size;               /* Decoded length (0 if unused) */
+    bool is_io;                  /* I/O port BAR */
+    bool is_64;                  /* Upper half lives in the next BAR */
+    bool prefetchable;
+    void* virt;                  /* Mapping from pci_map_bar() */
+} pci_bar_t;
+
+/* A PCI function */
+typedef struct pci_device {
+    uint16_t segment;
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint16_t subsystem_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t header_type;
+    uint8_t irq_line;            /* Legacy IRQ from firmware */
+    uint8_t irq_pin;             /* INTA..INTD, 0 if none */
+
+    pci_bar_t bars[PCI_MAX_BARS];
+
+    /* Interrupts */
+    uint8_t msi_cap;             /* Capability offsets (0 if absent) */
+    uint8_t msix_cap;
+    uint16_t msix_table_size;    /* Entries in the MSI-X table */
+    volatile uint32_t* msix_table;
+    pci_irq_mode_t irq_mode;
+    uint32_t nr_irqs;
+    uint8_t irqs[PCI_MAX_VECTORS]; /* IRQ number of each vector */
+
+    void* driver_data;           /* Owned by the bound driver */
+} pci_device_t;
+
+/* Scan the bus (ECAM from the ACPI MCFG, else the legacy 0xCF8 ports) */
+void init_pci(void);
+
+/* Configuration space access */
+uint8_t pci_read_config8(pci_device_t* dev, uint16_t offset);
+uint16_t pci_read_config16(pci_device_t* dev, uint16_t offset);
+uint32_t pci_read_config32(pci_device_t* dev, uint16_t offset);
+void pci_write_config8(pci_device_t* dev, uint16_t offset, uint8_t value);
+void pci_write_config16(pci_device_t* dev, uint16_t offset, uint16_t value);
+void pci_write_config32(pci_device_t* dev, uint16_t offset, uint32_t value);
+
+/* Device lookup; index selects among identical devices */
+uint32_t pci_device_count(void);
+pci_device_t* pci_get_device(uint32_t index);
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id, uint32_t index);
+
+/* Turn on memory decoding and bus mastering (DMA) */
+void pci_enable_device(pci_device_t* dev);
+
+/* Find a capability; pass the previous offset (or 0) to iterate */
+uint8_t pci_find_capability(pci_device_t* dev, uint8_t cap_id, uint8_t start);
+
+/* Map a memory BAR uncached; returns the cached mapping on later calls */
+void* pci_map_bar(pci_device_t* dev, uint32_t bar);
+
+/*
+ * Allocate up to nvec interrupt vectors
+ *
+ * Uses MSI-X if the device has it, else a single MSI vector. Vectors
+ * start masked; request_threaded_irq() on pci_irq_vector() unmasks them.
+ * Returns the number of vectors allocated, or -1.
+ */
+int pci_alloc_irq_vectors(pci_device_t* dev, uint32_t nvec);
+void pci_free_irq_vectors(pci_device_t* dev);
+
+/* IRQ number of vector n (-1 if not allocated) */
+int pci_irq_vector(pci_device_t* dev, uint32_t n);
+
+/* Steer vector n to the CPU that services its queue */
+int pci_irq_set_cpu(pci_device_t* dev, uint32_t n, uint32_t cpu);
+
+/* Print the device list */
+void dump_pci_devices(void);
+
+#endif /* EDGEX_PCI_H */
@@ -0,0 +1,113 @@
+/*
+ * EdgeX OS - Per-CPU Counters
+ *
+ * This file defines the statistics counters kept in every CPU's per-CPU
+ * block (cpu_t). A CPU only ever writes its own counters, with a single
+ * %gs-relative add, so counting needs no lock, no atomic instruction and
+ * no cache line shared with another CPU, and it is safe against
+ * preemption and interrupts. Readers add up the CPUs.
+ *
+ * Counters come in two kinds:
+ *   - event counters, summed over the CPUs when read. Updates that must
+ *     be seen together go through this_cpu_counters_add2(), and
+ *     pcpu_counters_snapshot() never sees half of one.
+ *   - batched counters (pcpu_batch_t), for values read often: each CPU
+ *     keeps a pending delta in its slot and folds it into a global count
+ *     once it reaches the batch size.
+ */
+
+#ifndef EDGEX_PERCPU_H
+#define EDGEX_PERCPU_H
+
+#include <edgex/kernel.h>
+
+typedef enum {
+    /* IPC (see update_ipc_stats()) */
+    PCPU_IPC_OBJECTS_CREATED,
+    PCPU_IPC_OBJECTS_DESTROYED,
+    PCPU_IPC_MUTEXES,
+    PCPU_IPC_SEMAPHORES,
+    PCPU_IPC_EVENTS,
+    PCPU_IPC_EVENT_SETS,
+    PCPU_IPC_MESSAGE_QUEUES,
+    PCPU_IPC_SHARED_MEMORY,
+    PCPU_IPC_MUTEX_OPS,
+    PCPU_IPC_SEMAPHORE_OPS,
+    PCPU_IPC_EVENT_OPS,
+    PCPU_IPC_MESSAGE_OPS,
+    PCPU_IPC_SHARED_MEMORY_OPS,
+    PCPU_IPC_WAIT_TIME,             /* Milliseconds */
+    PCPU_IPC_ACTIVE_WAITERS,
+    PCPU_IPC_TIMEOUTS,
+    PCPU_IPC_ALLOCATION_FAILURES,
+    PCPU_IPC_PERMISSION_FAILURES,
+    PCPU_IPC_TIMEOUT_FAILURES,
+
+    /* Physical memory (batched, see kernel/memory.c) */
+    PCPU_MEM_FREE_PAGES,
+    PCPU_MEM_DMA_FREE_PAGES,
+    PCPU_MEM_NORMAL_FREE_PAGES,
+    PCPU_MEM_PAGE_ALLOCS,
+    PCPU_MEM_PAGE_FREES,
+
+    /* Scheduler */
+    PCPU_SCHED_SWITCHES,
+    PCPU_SCHED_WAKEUPS,             /* Tasks made ready by this CPU */
+    PCPU_SCHED_REMOTE_WAKEUPS,      /* Tasks taken off this CPU's wake list */
+    PCPU_SCHED_WAKE_IPIS,           /* Reschedule IPIs sent for wake lists */
+
+    PCPU_NR_COUNTERS
+} pcpu_counter_t;
+
+/* Counters of one CPU, embedded in its cpu_t */
+typedef struct {
+    volatile uint32_t seq;          /* Odd while a grouped update is in progress */
+    uint32_t reserved;
+    int64_t counters[PCPU_NR_COUNTERS];
+} pcpu_area_t;
+
+/* Counter kept as a global count plus per-CPU pending deltas */
+typedef struct {
+    pcpu_counter_t id;              /* Slot holding each CPU's pending delta */
+    int64_t batch;                  /* Pending delta folded at this size */
+    volatile int64_t count;         /* Folded count */
+} pcpu_batch_t;
+
+#define PCPU_BATCH_INIT(counter, size) { .id = (counter), .batch = (size), .count = 0 }
+
+/* Offset of a counter from the GS base (cpu_t, see edgex/cpu.h) */
+#define PCPU_COUNTER_OFFSET(id) \
+    (__builtin_offsetof(cpu_t, pcpu.counters) + (uint64_t)(id) * sizeof(int64_t))
+
+/* Add to a counter of the running CPU, in one instruction */
+#define this_cpu_counter_add(id, delta) \
+    __asm__ volatile("addq %0, %%gs:(%1)" \
+                     : : "er"((int64_t)(delta)), "r"(PCPU_COUNTER_OFFSET(id)) : "memory")
+
+#define this_cpu_counter_inc(id)    this_cpu_counter_add((id), 1)
+#define this_cpu_counter_dec(id)    this_cpu_counter_add((id), -1)
+
+/* Add to two counters of the running CPU as one update */
+void this_cpu_counters_add2(pcpu_counter_t a, int64_t delta_a, pcpu_counter_t b, int64_t delta_b);
+
+/* Sum of a counter over the online CPUs */
+int64_t pcpu_counter_sum(pcpu_counter_t id);
+
+/* Sum of every counter over the online CPUs, without torn grouped updates */
+void pcpu_counters_snapshot(int64_t counters[PCPU_NR_COUNTERS]);
+
+/* Batched counters */
+void pcpu_batch_add(pcpu_batch_t* counter, int64_t delta);
+
+/* Folded count: cheap, off by less than batch for each CPU */
+static inline int64_t pcpu_batch_read(pcpu_batch_t* counter) {
+    return __atomic_load_n(&counter->count, __ATOMIC_RELAXED);
+}
+
+/* Folded count plus the deltas every CPU has pending */
+int64_t pcpu_batch_sum(pcpu_batch_t* counter);
+
+/* cpu_t embeds pcpu_area_t, so this comes after the types above */
+#include <edgex/cpu.h>
+
+#endif /* EDGEX_PERCPU_H */
@@ -0,0 +1,136 @@
+/*
+ * EdgeX OS - Kernel Preemption
+ *
+ * This file defines the per-CPU preemption counter. Code that must not be
+ * preempted raises the counter instead of disabling interrupts; when it
+ * drops back to zero with a reschedule pending, the CPU switches to the
+ * waiting task right away instead of at the next timer tick.
+ */
+
+#ifndef EDGEX_PREEMPT_H
+#define EDGEX_PREEMPT_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+/*
+ * preempt_count layout:
+ *   bits 0-15   preempt_disable() nesting (spinlocks, explicit sections)
+ *   bits 16-23  hardware interrupt nesting
+ *   bits 24-31  softirq nesting (running softirqs, local_bh_disable())
+ */
+#define PREEMPT_OFFSET   1
+#define PREEMPT_MASK     0x0000FFFF
+#define HARDIRQ_OFFSET   (1 << 16)
+#define HARDIRQ_MASK     0x00FF0000
+#define SOFTIRQ_OFFSET   (1 << 24)
+#define SOFTIRQ_MASK     0xFF000000
+
+#define PREEMPT_COUNT_OFFSET __builtin_offsetof(cpu_t, preempt_count)
+#define NEED_RESCHED_OFFSET  __builtin_offsetof(cpu_t, need_resched)
+
+/* Reschedule now (implemented by the scheduler) */
+void preempt_schedule(void);
+
+/* Reschedule on the way out of an interrupt, interrupts disabled */
+void preempt_schedule_irq(void);
+
+static inline uint32_t preempt_count(void) {
+    uint32_t count;
+    __asm__ volatile("movl %%gs:%c1, %0" : "=r"(count) : "i"(PREEMPT_COUNT_OFFSET));
+    return count;
+}
+
+static inline void preempt_count_add(uint32_t val) {
+    __asm__ volatile("addl %0, %%gs:%c1" : : "ri"(val), "i"(PREEMPT_COUNT_OFFSET) : "memory");
+}
+
+static inline void preempt_count_sub(uint32_t val) {
+    __asm__ volatile("subl %0, %%gs:%c1" : : "ri"(val), "i"(PREEMPT_COUNT_OFFSET) : "memory");
+}
+
+/* Check whether the running CPU has a reschedule pending */
+static inline bool need_resched(void) {
+    uint8_t flag;
+    __asm__ volatile("movb %%gs:%c1, %0" : "=r"(flag) : "i"(NEED_RESCHED_OFFSET));
+    return flag != 0;
+}
+
+static inline void set_need_resched(void) {
+    __asm__ volatile("movb $1, %%gs:%c0" : : "i"(NEED_RESCHED_OFFSET) : "memory");
+}
+
+static inline void clear_need_resched(void) {
+    __asm__ volatile("movb $0, %%gs:%c0" : : "i"(NEED_RESCHED_OFFSET) : "memory");
+}
+
+/* Running in a hardware interrupt handler */
+static inline bool in_irq(void) {
+    return (preempt_count() & HARDIRQ_MASK) != 0;
+}
+
+/* Running softirqs, or softirqs are disabled */
+static inline bool in_softirq(void) {
+    return (preempt_count() & SOFTIRQ_MASK) != 0;
+}
+
+/* Running in any interrupt context, hard or soft */
+static inline bool in_interrupt(void) {
+    return (preempt_count() & (HARDIRQ_MASK | SOFTIRQ_MASK)) != 0;
+}
+
+/* Scheduling is allowed: no locks held, not in an interrupt */
+static inline bool preemptible(void) {
+    return preempt_count() == 0 && !irqs_disabled();
+}
+
+static inline void preempt_disable(void) {
+    preempt_count_add(PREEMPT_OFFSET);
+    barrier();
+}
+
+/* Re-enable preemption without acting on a pending reschedule */
+static inline void preempt_enable_no_resched(void) {
+    barrier();
+    preempt_count_sub(PREEMPT_OFFSET);
+}
+
+/* Re-enable preemption; this is a preemption point */
+static inline void preempt_enable(void) {
+    barrier();
+    preempt_count_sub(PREEMPT_OFFSET);
+    if (need_resched() && preemptible()) {
+        preempt_schedule();
+    }
+}
+
+/*
+ * Preemption point for code that woke a task with interrupts disabled
+ * and has just re-enabled them
+ */
+static inline void preempt_check_resched(void) {
+    if (need_resched() && preemptible()) {
+        preempt_schedule();
+    }
+}
+
+/* Interrupt entry/exit accounting, called by the IRQ dispatcher */
+static inline void irq_enter(void) {
+    preempt_count_add(HARDIRQ_OFFSET);
+    barrier();
+}
+
+static inline void irq_exit(void) {
+    barrier();
+    preempt_count_sub(HARDIRQ_OFFSET);
+}
+
+/* Keep softirqs from running on this CPU (they run on the next enable) */
+static inline void local_bh_disable(void) {
+    preempt_count_add(SOFTIRQ_OFFSET);
+    barrier();
+}
+
+void local_bh_enable(void);
+
+#endif /* EDGEX_PREEMPT_H */
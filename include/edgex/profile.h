@@ -0,0 +1,68 @@
+/*
+ * EdgeX OS - Sampling Profiler
+ *
+ * This file defines the statistical profiler. Built with CONFIG_PROFILE,
+ * the timer tick of every CPU samples the interrupted instruction, the
+ * running task and the kernel stack (walked through frame pointers) into
+ * a per-CPU buffer. No performance counters are needed, so it works under
+ * QEMU TCG. The reports resolve addresses with the embedded symbol table
+ * (ksyms.h): a flat profile printed to the log, and folded stacks, one
+ * "task;outer;...;inner count" line per stack, for flamegraph tools.
+ */
+
+#ifndef EDGEX_PROFILE_H
+#define EDGEX_PROFILE_H
+
+#include <edgex/kernel.h>
+#include <edgex/interrupt.h>
+#include <edgex/uart.h>
+
+#define PROFILE_BUF_SAMPLES     4096     /* Per CPU; later samples are dropped */
+#define PROFILE_MAX_DEPTH       12       /* Return addresses kept per sample */
+#define PROFILE_DEFAULT_HZ      1000     /* At most TICK_HZ */
+
+typedef struct {
+    uint64_t rip;                /* Interrupted instruction */
+    int32_t pid;                 /* Task running */
+    uint16_t depth;              /* Return addresses in stack[] */
+    uint8_t user;                /* Interrupted in user mode (no stack) */
+    uint8_t reserved;
+    uint64_t stack[PROFILE_MAX_DEPTH]; /* Innermost caller first */
+} profile_sample_t;
+
+#ifdef CONFIG_PROFILE
+
+extern volatile bool profile_on;
+
+void profile_tick(cpu_context_t* context);
+
+/* Called from the timer interrupt with the interrupted context */
+#define profile_timer_tick(context) do { \
+    if (__builtin_expect(profile_on, 0)) { \
+        profile_tick(context); \
+    } \
+} while (0)
+
+/* Allocate the sample buffers of the CPUs online now */
+void init_profile(void);
+
+/* Start sampling every CPU at a rate (buffers are cleared) and stop */
+void profile_start(uint32_t hz);
+void profile_stop(void);
+
+/* Stop sampling and aggregate the buffers for the reports; returns the samples */
+uint64_t profile_collect(void);
+
+/* Print the symbols with the most samples to the log */
+void profile_print_flat(void);
+
+/* Write the folded stacks out of a port as plain text */
+void profile_write_folded(uart_t* uart);
+
+#else
+
+#define profile_timer_tick(context) do { (void)(context); } while (0)
+
+#endif /* CONFIG_PROFILE */
+
+#endif /* EDGEX_PROFILE_H */
@@ -11,6 +11,7 @@
 #include <edgex/kernel.h>
 #include <edgex/interrupt.h>
 #include <edgex/memory.h>
+#include <edgex/cpu.h>
 
 /* Forward declaration for page directory type */
 #ifndef __page_directory_t_defined
@@ -72,6 +73,27 @@ typedef struct {
     uint64_t ss;
 } task_context_t;
 
+/* Wake-to-run latency histogram: bucket b counts latencies below 2^b ns */
+#define SCHED_LAT_BUCKETS 32
+
+/*
+ * Per-task scheduling statistics, in TSC cycles
+ * (updated under the task's run queue lock by __schedule())
+ */
+typedef struct {
+    uint64_t run_cycles;          /* Time on a CPU */
+    uint64_t wait_cycles;         /* Time ready in a run queue */
+    uint64_t nr_voluntary;        /* Switched out blocking, sleeping or exiting */
+    uint64_t nr_involuntary;      /* Switched out still runnable (preempted, yielded) */
+    uint64_t nr_wakeups;          /* Wakeups that reached a CPU */
+    uint64_t wake_latency_sum;    /* Nanoseconds, summed over nr_wakeups */
+    uint64_t wake_latency_max;    /* Nanoseconds */
+    uint32_t wake_latency_hist[SCHED_LAT_BUCKETS];
+    uint64_t ready_tsc;           /* When it last became ready */
+    uint64_t run_tsc;             /* When it last got a CPU */
+    bool woken;                   /* Became ready by a wakeup, not a preemption */
+} task_sched_stats_t;
+
 /*
  * Task Control Block (TCB) structure
  * Contains all information about a task
@@ -99,10 +121,20 @@ typedef struct task {
     uint64_t remaining_ticks;     /* Remaining ticks in current time slice */
     uint64_t total_ticks;         /* Total ticks consumed by this task */
     uint64_t wake_tick;           /* Tick when sleeping task should wake up */
+    task_sched_stats_t sched_stats; /* Latency and CPU time accounting */
+    
+    /* CPU placement */
+    uint32_t cpu;                 /* CPU whose run queue holds this task */
+    cpumask_t cpus_allowed;       /* CPUs this task may run on */
+    volatile bool on_cpu;         /* Still running, or its context is being saved */
+    volatile uint32_t wake_pending; /* Queued on a remote CPU's wake list */
+    bool waiting;                 /* Between prepare_to_block() and its schedule() */
+    struct task* wake_next;       /* Next task in that wake list */
     
     /* Linked list pointers for task queue */
     struct task* next;            /* Next task in queue */
     struct task* prev;            /* Previous task in queue */
+    struct task* all_next;        /* Next task in the global task list */
 } task_t;
 
 /*
@@ -111,12 +143,17 @@ typedef struct task {
 
 /* Initialization */
 void init_scheduler(void);
+void init_scheduler_cpu(uint32_t cpu);
+void start_scheduler(void);
+void start_scheduler_ap(void);
 
 /* Task management */
 pid_t create_kernel_task(const char* name, void (*entry_point)(void), task_priority_t priority);
 pid_t create_user_task(const char* name, void (*entry_point)(void), task_priority_t priority);
 void terminate_task(pid_t pid);
 void exit_task(void);
+void register_task_cleanup_handler(void (*handler)(pid_t pid));
+void for_each_task(void (*fn)(task_t* task, void* arg), void* arg);
 
 /* Scheduling operations */
 void schedule(void);
@@ -129,9 +166,18 @@ void sleep_task(uint64_t milliseconds);
 void wake_task(pid_t pid);
 void block_task(pid_t pid);
 void unblock_task(pid_t pid);
+void prepare_to_block(void);
+void cancel_block(void);
 void suspend_task(pid_t pid);
 void resume_task(pid_t pid);
 
+/* Task priority */
+int set_task_priority(pid_t pid, task_priority_t priority);
+
+/* CPU affinity */
+int set_task_affinity(pid_t pid, cpumask_t mask);
+cpumask_t get_task_affinity(pid_t pid);
+
 /* Timer-related functions */
 void timer_tick(void);
 uint64_t get_tick_count(void);
@@ -139,4 +185,43 @@ uint64_t get_tick_count(void);
 /* Idle task */
 void idle_task(void);
 
+/* Scheduling statistics of a task, times in nanoseconds */
+typedef struct {
+    pid_t pid;
+    char name[32];
+    task_state_t state;
+    task_priority_t priority;
+    uint32_t cpu;
+    uint64_t run_ns;              /* CPU time, including the current run */
+    uint64_t wait_ns;             /* Time ready but not running */
+    uint64_t nr_voluntary;
+    uint64_t nr_involuntary;
+    uint64_t nr_wakeups;
+    uint64_t wake_latency_avg_ns;
+    uint64_t wake_latency_max_ns;
+    uint32_t wake_latency_hist[SCHED_LAT_BUCKETS];
+} task_sched_info_t;
+
+/* Scheduling statistics of a CPU since boot or the last reset */
+typedef struct {
+    uint64_t window_ns;           /* Time covered */
+    uint64_t idle_ns;             /* Time in the idle task */
+    uint64_t nr_switches;
+    uint64_t nr_wakeups;          /* Tasks made ready by this CPU */
+    uint64_t nr_remote_wakeups;   /* Tasks other CPUs woke onto this one */
+    uint64_t nr_wake_ipis;        /* Reschedule IPIs this CPU sent for wakeups */
+    uint64_t avg_nr_running_x100; /* Time-weighted run queue length, x100 */
+    uint32_t nr_running;          /* Run queue length now */
+} cpu_sched_info_t;
+
+/* Query statistics; 0 on success, -1 for an unknown task or offline CPU */
+int get_task_sched_info(pid_t pid, task_sched_info_t* info);
+int get_cpu_sched_info(uint32_t cpu, cpu_sched_info_t* info);
+
+/* Start a new statistics window on every CPU and task */
+void reset_sched_stats(void);
+
+/* Print per-CPU and per-task scheduling statistics */
+void dump_sched_stats(void);
+
 #endif /* EDGEX_SCHEDULER_H */
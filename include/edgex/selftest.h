@@ -0,0 +1,23 @@
+/*
+ * EdgeX OS - Boot Tests and Benchmarks
+ *
+ * This file declares the entry point of the in-kernel tests, benchmarks
+ * and boot reports. Each one is built in with its own CONFIG_ flag
+ * (e.g. KCFLAGS=-DCONFIG_KLOG_BENCH) and runs as a task once the
+ * scheduler starts; without any of them nothing is created.
+ */
+
+#ifndef EDGEX_SELFTEST_H
+#define EDGEX_SELFTEST_H
+
+#include <edgex/kernel.h>
+
+/*
+ * Create the tasks of the configured tests and benchmarks
+ *
+ * Called at the end of kernel initialization, before the scheduler
+ * starts.
+ */
+void start_selftests(void);
+
+#endif /* EDGEX_SELFTEST_H */
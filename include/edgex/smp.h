@@ -0,0 +1,28 @@
+/*
+ * EdgeX OS - Application Processor Startup
+ *
+ * This file declares the bring-up of the CPUs other than the boot CPU.
+ * They are the CPUs the ACPI MADT lists, so this needs the local APIC;
+ * with the 8259 PIC the system runs on the boot CPU alone.
+ */
+
+#ifndef EDGEX_SMP_H
+#define EDGEX_SMP_H
+
+#include <edgex/kernel.h>
+
+/* Real-mode entry page of the APs, in the reserved first megabyte */
+#define SMP_TRAMPOLINE_BASE   0x8000
+
+/*
+ * Start every enumerated application processor
+ *
+ * Each AP gets a run queue and idle task, loads the IDT, enables its
+ * local APIC and APIC timer tick, comes online and then waits for
+ * start_scheduler(). Call after init_scheduler() and before anything
+ * that sets up per-CPU threads or buffers for the online CPUs.
+ * Returns the number of APs started.
+ */
+uint32_t smp_boot_cpus(void);
+
+#endif /* EDGEX_SMP_H */
@@ -0,0 +1,64 @@
+/*
+ * EdgeX OS - Software Interrupts
+ *
+ * This file defines softirqs: per-CPU bottom halves that interrupt
+ * handlers raise to batch work (timers, network and block completions)
+ * outside the hardware interrupt. Pending softirqs run on interrupt exit
+ * with interrupts enabled; whatever exceeds the time budget there is
+ * handed to the CPU's ksoftirqd thread.
+ */
+
+#ifndef EDGEX_SOFTIRQ_H
+#define EDGEX_SOFTIRQ_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+/* Softirq vectors, lower numbers run first */
+typedef enum {
+    SOFTIRQ_HI = 0,          /* High priority deferred work */
+    SOFTIRQ_TIMER = 1,       /* Expired kernel timers */
+    SOFTIRQ_NET_TX = 2,      /* Network transmit completions */
+    SOFTIRQ_NET_RX = 3,      /* Network receive processing */
+    SOFTIRQ_BLOCK = 4,       /* Block I/O completions */
+    SOFTIRQ_SCHED = 5,       /* Scheduler housekeeping */
+    NR_SOFTIRQS
+} softirq_nr_t;
+
+/* Softirq action */
+typedef void (*softirq_action_t)(void);
+
+/* Per-CPU softirq statistics */
+typedef struct {
+    uint64_t raised[NR_SOFTIRQS];     /* Times each vector was raised */
+    uint64_t runs[NR_SOFTIRQS];       /* Times each action ran */
+    uint64_t max_latency_ns;          /* Longest raise-to-run delay */
+    uint64_t max_run_ns;              /* Longest single action run */
+    uint64_t deferred;                /* Times work was handed to ksoftirqd */
+} softirq_stats_t;
+
+/* Initialization (after init_scheduler) */
+void init_softirqs(void);
+
+/* Install the action of a softirq vector */
+void open_softirq(softirq_nr_t nr, softirq_action_t action);
+
+/* Mark a softirq pending on the local CPU */
+void raise_softirq(softirq_nr_t nr);
+
+/* Same, with interrupts already disabled */
+void raise_softirq_irqoff(softirq_nr_t nr);
+
+/* Run pending softirqs (called on interrupt exit) */
+void do_softirq(void);
+
+/* Bitmask of softirqs pending on the local CPU */
+static inline uint32_t local_softirq_pending(void) {
+    return this_cpu()->softirq_pending;
+}
+
+/* Statistics */
+void get_softirq_stats(uint32_t cpu, softirq_stats_t* stats);
+void dump_softirq_stats(void);
+
+#endif /* EDGEX_SOFTIRQ_H */
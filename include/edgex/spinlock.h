@@ -0,0 +1,98 @@
+/*
+ * EdgeX OS - Spinlocks
+ *
+ * This file defines the kernel spinlock. Holding a spinlock disables
+ * preemption; the _irqsave variants also disable interrupts and must be
+ * used for locks that are taken from interrupt handlers. With
+ * CONFIG_LOCK_STAT the lock calls are out of line and counted against
+ * the call site (lockstat.h); the arch_ calls never are.
+ */
+
+#ifndef EDGEX_SPINLOCK_H
+#define EDGEX_SPINLOCK_H
+
+#include <edgex/kernel.h>
+#include <edgex/preempt.h>
+#include <edgex/lockstat.h>
+
+typedef struct spinlock {
+    volatile uint32_t locked;
+    LOCKSTAT_LOCK_FIELDS
+} spinlock_t;
+
+#ifdef CONFIG_LOCK_STAT
+/* Not inlined, so the return address is the caller's call site */
+#define SPIN_LOCK_INLINE static __attribute__((noinline, unused))
+#define spin_acquire(lock)      lockstat_spin_lock((lock), (uintptr_t)__builtin_return_address(0))
+#define spin_tryacquire(lock)   lockstat_spin_trylock((lock), (uintptr_t)__builtin_return_address(0))
+#define spin_release(lock)      do { lockstat_spin_release(lock); arch_spin_unlock(lock); } while (0)
+#else
+#define SPIN_LOCK_INLINE static inline
+#define spin_acquire(lock)      arch_spin_lock(lock)
+#define spin_tryacquire(lock)   arch_spin_trylock(lock)
+#define spin_release(lock)      arch_spin_unlock(lock)
+#endif
+
+#define SPINLOCK_INIT { .locked = 0 }
+
+static inline void spin_lock_init(spinlock_t* lock) {
+    lock->locked = 0;
+}
+
+/* Acquire the lock word without touching preemption */
+static inline void arch_spin_lock(spinlock_t* lock) {
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+        // Spin on a plain read so the cache line stays shared while waiting
+        while (lock->locked) {
+            cpu_relax();
+        }
+    }
+}
+
+static inline bool arch_spin_trylock(spinlock_t* lock) {
+    return __atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE) == 0;
+}
+
+static inline void arch_spin_unlock(spinlock_t* lock) {
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline bool spin_is_locked(spinlock_t* lock) {
+    return lock->locked != 0;
+}
+
+SPIN_LOCK_INLINE void spin_lock(spinlock_t* lock) {
+    preempt_disable();
+    spin_acquire(lock);
+}
+
+SPIN_LOCK_INLINE bool spin_trylock(spinlock_t* lock) {
+    preempt_disable();
+    if (spin_tryacquire(lock)) {
+        return true;
+    }
+    preempt_enable();
+    return false;
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    spin_release(lock);
+    preempt_enable();
+}
+
+/* Lock and disable local interrupts, returning the previous RFLAGS */
+#define spin_lock_irqsave(lock, flags)      \
+    do {                                    \
+        (flags) = local_irq_save();         \
+        spin_lock(lock);                    \
+    } while (0)
+
+/* Unlock, restore interrupts, then allow a pending preemption */
+#define spin_unlock_irqrestore(lock, flags) \
+    do {                                    \
+        spin_release(lock);                 \
+        local_irq_restore(flags);           \
+        preempt_enable();                   \
+    } while (0)
+
+#endif /* EDGEX_SPINLOCK_H */
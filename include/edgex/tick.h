@@ -0,0 +1,55 @@
+/*
+ * EdgeX OS - Tick Management
+ *
+ * This file defines per-CPU tick devices and the full-tickless (nohz_full)
+ * mode that stops the periodic tick on isolated CPUs running a single task.
+ */
+
+#ifndef EDGEX_TICK_H
+#define EDGEX_TICK_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+/* Scheduler tick rate */
+#define TICK_HZ 1000
+
+/* Tick device features */
+#define TICK_FEAT_PERIODIC  (1 << 0)  /* Can generate a periodic tick */
+#define TICK_FEAT_ONESHOT   (1 << 1)  /* Can fire a single programmed event */
+#define TICK_FEAT_PERCPU    (1 << 2)  /* Interrupts only its own CPU */
+
+/* Per-CPU tick source (PIT, local APIC timer, ...) */
+typedef struct tick_device {
+    const char* name;
+    uint32_t features;                                     /* TICK_FEAT_* */
+    void (*set_periodic)(struct tick_device* dev, uint32_t hz);
+    void (*stop)(struct tick_device* dev);
+    void* private_data;
+} tick_device_t;
+
+/* Register the tick device that drives a CPU's scheduler tick */
+void tick_register_device(uint32_t cpu, tick_device_t* dev);
+
+/* CPU that advances the global tick count and runs timer housekeeping */
+uint32_t tick_do_timer_cpu(void);
+
+/* Called by the scheduler with the number of runnable tasks on this CPU */
+void tick_nohz_update(uint32_t nr_running);
+
+/* Ask a (possibly remote) CPU to restart its tick */
+void tick_nohz_kick(uint32_t cpu);
+
+/* Handle a pending remote tick restart on the local CPU */
+void tick_nohz_handle_kick(void);
+
+/* Account one tick handler run (entry TSC and duration) on the calling CPU */
+void tick_account_handler(uint64_t start, uint64_t cycles);
+
+/* Print per-CPU tick handler cost */
+void dump_tick_stats(void);
+
+/* Measure interference seen by a tight polling loop on the calling CPU */
+void tick_nohz_jitter_probe(uint64_t duration_ms);
+
+#endif /* EDGEX_TICK_H */
@@ -0,0 +1,244 @@
+/*
+ * EdgeX OS - Telemetry Log Store
+ *
+ * This file defines an append-only store for telemetry records, kept on
+ * a range of a virtio-blk device as a log of fixed-size segments. Records
+ * are appended to the head segment in memory and made durable by group
+ * commit: one writer at a time writes out everything appended so far and
+ * flushes the device, and every writer whose record was in that batch is
+ * done. An in-memory index maps each key to its latest record. Records
+ * are trimmed per key once the uplink has taken them, and the tlogd
+ * service compacts the oldest segment by copying what is still live to
+ * the head. Producers reach the store through shared rings.
+ */
+
+#ifndef EDGEX_TLOG_H
+#define EDGEX_TLOG_H
+
+#include <edgex/kernel.h>
+#include <edgex/ipc.h>
+#include <edgex/spinlock.h>
+#include <edgex/virtio_blk.h>
+
+/* Geometry */
+#define TLOG_BLOCK_SIZE         PAGE_SIZE
+#define TLOG_BLOCK_SECTORS      (TLOG_BLOCK_SIZE / VIRTIO_BLK_SECTOR_SIZE)
+#define TLOG_SEG_BLOCKS         256          /* 1MB segments */
+#define TLOG_MAX_SEGMENTS       1024
+#define TLOG_BATCH_BLOCKS       32           /* Blocks per commit: one merged 128KB write */
+
+#define TLOG_INDEX_SIZE         4096         /* Keys (power of two) */
+#define TLOG_COMPACT_FREE_MIN   2            /* Compact below this many free segments */
+#define TLOG_COMMIT_MS          10           /* Commit window for unsynced appends */
+
+/* On-disk formats */
+#define TLOG_MAGIC              0x474F4C54   /* "TLOG" */
+#define TLOG_SEG_MAGIC          0x47455354   /* "TSEG" */
+#define TLOG_VERSION            1
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seg_blocks;
+    uint32_t nr_segments;
+    uint32_t epoch;              /* Chosen at format; seeds record CRCs */
+} tlog_super_t;
+
+/* First block of a segment; a zero generation marks it free */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t generation;         /* Increases with every segment opened */
+} tlog_seg_hdr_t;
+
+#define TLOG_REC_DATA           0
+#define TLOG_REC_TRIM           1            /* Records of key up to seq are gone */
+
+/*
+ * Record header, followed by len bytes of data padded to 8 bytes
+ *
+ * Records do not cross blocks; the rest of a block is zero. The CRC
+ * (seeded with the format's epoch) covers the header after it and the
+ * data, and generation must match the segment's, so a torn write or a
+ * stale record from the segment's previous use ends the segment.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t crc;
+    uint32_t generation;
+    uint16_t len;
+    uint16_t type;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t seq;
+    uint64_t timestamp;          /* Nanoseconds since boot of the writer */
+} tlog_rec_hdr_t;
+
+#define TLOG_MAX_RECORD         (TLOG_BLOCK_SIZE - sizeof(tlog_rec_hdr_t))
+
+/* Latest record of a key */
+typedef struct {
+    uint64_t key;                /* 0: empty slot */
+    uint64_t latest_seq;
+    uint64_t trim_seq;           /* Records up to this one are trimmed */
+    uint32_t segment;
+    uint16_t block;
+    uint16_t offset;
+} tlog_index_entry_t;
+
+typedef enum {
+    TLOG_SEG_FREE = 0,
+    TLOG_SEG_OPEN,               /* Head segment, being appended to */
+    TLOG_SEG_SEALED
+} tlog_seg_state_t;
+
+typedef struct {
+    tlog_seg_state_t state;
+    uint32_t generation;
+    uint32_t records;
+    uint32_t dead;               /* Trimmed, counted before compaction */
+} tlog_segment_t;
+
+/* Appended records not yet written, for one run of blocks in one segment */
+typedef struct {
+    uint8_t* pages[TLOG_BATCH_BLOCKS];
+    uint32_t segment;
+    uint32_t first_block;        /* Segment block of pages[0] */
+    uint32_t nr_blocks;          /* Blocks with data (the last may be partial) */
+    uint32_t offset;             /* Fill level of the last block */
+    uint64_t last_seq;           /* Highest seq appended to the batch */
+    bool full;                   /* No more room: commit before appending */
+} tlog_batch_t;
+
+typedef struct {
+    uint64_t appends;
+    uint64_t commits;            /* Group commits (one device flush each) */
+    uint64_t committed_records;
+    uint64_t blocks_written;
+    uint64_t compactions;
+    uint64_t compacted_records;  /* Live records copied */
+    uint64_t compact_errors;
+    uint64_t recovered_records;
+    uint64_t recovery_us;
+    uint64_t full_errors;        /* Appends refused: no free segment */
+} tlog_stats_t;
+
+struct tlog_ring;
+
+typedef struct tlog {
+    virtio_blk_t* blk;
+    uint64_t start_block;        /* Device range, in 4KB blocks */
+    uint32_t nr_segments;
+    uint32_t epoch;
+
+    spinlock_t lock;
+    tlog_segment_t segments[TLOG_MAX_SEGMENTS];
+    uint32_t head;               /* Open segment */
+    uint32_t generation;         /* Last one used */
+    uint32_t free_segments;
+    uint64_t next_seq;
+    volatile bool compacting;    /* tlogd may take the last free segment */
+    volatile bool compact_blocked;   /* Oldest segment all live: wait for a trim */
+
+    /* Group commit */
+    tlog_batch_t batches[2];
+    tlog_batch_t* filling;
+    bool committing;
+    bool io_error;               /* A commit failed: the log is read-only */
+    volatile uint64_t durable_seq;
+    uint64_t batches_taken;      /* Batches handed to committers */
+    volatile uint64_t batches_durable;
+    pid_t waiters[16];           /* Tasks waiting for a commit */
+    uint32_t nr_waiters;
+    uint64_t first_pending_tick; /* Oldest unsynced append */
+    tlog_batch_t* writing;       /* Batch being committed, or NULL */
+    blk_request_t reqs[TLOG_BATCH_BLOCKS + 1];   /* The committer's requests */
+    uint8_t* scan_pages[TLOG_BATCH_BLOCKS];       /* Recovery and compaction reads */
+
+    tlog_index_entry_t* index;
+    uint32_t nr_keys;
+
+    struct tlog_ring* rings;
+    pid_t service;
+    tlog_stats_t stats;
+} tlog_t;
+
+/*
+ * Open the store on nr_blocks blocks of a device starting at start_block,
+ * recovering the log, or formatting it if there is none (or format is
+ * set). Starts the tlogd service task.
+ */
+tlog_t* tlog_open(virtio_blk_t* blk, uint64_t start_block, uint64_t nr_blocks, bool format);
+
+/*
+ * Append a record; returns its sequence number, or 0 if the log is full.
+ * The record is durable once tlog_commit() returns for it, or within
+ * TLOG_COMMIT_MS when nobody asks.
+ */
+uint64_t tlog_append(tlog_t* log, uint64_t key, const void* data, uint16_t len);
+
+/* Wait until seq is durable, committing if no one else is */
+int tlog_commit(tlog_t* log, uint64_t seq);
+
+/* Drop a key's records up to seq (they have been uploaded) */
+uint64_t tlog_trim(tlog_t* log, uint64_t key, uint64_t seq);
+
+/* Copy out a key's latest record; returns its length or -1 */
+int tlog_latest(tlog_t* log, uint64_t key, void* data, uint16_t max, uint64_t* seq);
+
+/*
+ * Shared ring
+ *
+ * A single producer task appends fixed-size entries to a ring in a
+ * shared memory region ("tlog.<n>"); tlogd drains it into the log and
+ * publishes in durable how far the producer's entries are durable,
+ * counting in the ring's own entry numbers. An entry with sync set makes
+ * tlogd commit at once instead of waiting for the commit window.
+ */
+#define TLOG_RING_ENTRIES       256
+#define TLOG_RING_DATA          240          /* Entries are 256 bytes */
+
+typedef struct {
+    uint64_t key;
+    uint16_t len;
+    uint16_t sync;
+    uint32_t reserved;
+    uint8_t data[TLOG_RING_DATA];
+} tlog_ring_entry_t;
+
+typedef struct {
+    volatile uint32_t head;      /* Consumer (tlogd) */
+    uint8_t pad0[60];
+    volatile uint32_t tail;      /* Producer */
+    uint8_t pad1[60];
+    volatile uint64_t durable;   /* Entries (by count) known durable */
+    volatile uint32_t dropped;   /* Entries refused (log full) */
+    uint8_t pad2[52];
+} tlog_ring_hdr_t;
+
+typedef struct tlog_ring {
+    struct tlog_ring* next;
+    tlog_t* log;
+    uint32_t id;
+    char name[16];
+    shared_memory_t shm;         /* NULL when the ring is kernel-private */
+    uint64_t* pages;             /* Physical address of each region page */
+    uint32_t nr_pages;
+    tlog_ring_hdr_t* hdr;
+    uint64_t produced;           /* Entries put (producer side) */
+    uint64_t consumed;           /* Entries drained */
+    uint64_t last_seq;           /* Log seq of the last entry drained */
+    volatile pid_t waiter;       /* Producer blocked in tlog_ring_wait() */
+} tlog_ring_t;
+
+tlog_ring_t* tlog_ring_create(tlog_t* log);
+
+/*
+ * Producer side: put an entry (returns its entry number, or 0 if the
+ * ring is full) and wait until an entry number is durable
+ */
+uint64_t tlog_ring_put(tlog_ring_t* ring, uint64_t key, const void* data, uint16_t len, bool sync);
+void tlog_ring_wait(tlog_ring_t* ring, uint64_t entry);
+
+/* Print counters */
+void dump_tlog_stats(tlog_t* log);
+
+#endif /* EDGEX_TLOG_H */
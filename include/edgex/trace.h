@@ -0,0 +1,116 @@
+/*
+ * EdgeX OS - Tracepoints
+ *
+ * This file defines the static tracepoints. Built with CONFIG_TRACE, a
+ * tracepoint is a load and a predicted-not-taken branch until tracing
+ * is started, and then writes one fixed-size record into the ring of the
+ * CPU it runs on; no lock is shared between CPUs. Without CONFIG_TRACE
+ * the tracepoints compile to nothing. trace_dump() sends the rings out
+ * of a serial port as frames, and tools/trace2json.py turns a capture
+ * into Chrome/Perfetto trace JSON.
+ */
+
+#ifndef EDGEX_TRACE_H
+#define EDGEX_TRACE_H
+
+#include <edgex/kernel.h>
+#include <edgex/uart.h>
+
+#define TRACE_BUF_RECORDS       4096     /* Per CPU (power of two) */
+
+/* Events */
+typedef enum {
+    TRACE_SCHED_SWITCH = 1,      /* arg0: prev pid, arg1: next pid | prev state << 32 */
+    TRACE_SCHED_WAKE,            /* arg0: woken pid, arg1: its CPU */
+    TRACE_SCHED_BLOCK,           /* arg0: pid, arg1: TRACE_BLOCK_* */
+    TRACE_MSG_SEND,              /* arg0: queue, arg1: message id */
+    TRACE_MSG_RECEIVE,           /* arg0: queue, arg1: message id */
+    TRACE_MUTEX_CONTEND,         /* arg0: mutex, arg1: owner pid */
+    TRACE_MUTEX_ACQUIRE,         /* arg0: mutex (after contention) */
+    TRACE_PAGE_FAULT,            /* arg0: address, arg1: error code */
+    TRACE_IRQ_ENTRY,             /* arg0: IRQ */
+    TRACE_IRQ_EXIT,              /* arg0: IRQ */
+    TRACE_EVENT_COUNT
+} trace_event_t;
+
+/* Why a task blocked */
+#define TRACE_BLOCK_WAIT        0
+#define TRACE_BLOCK_SLEEP       1
+
+/* Record in a CPU's ring and on the wire (little endian) */
+typedef struct {
+    uint64_t tsc;
+    uint16_t event;
+    uint8_t cpu;
+    uint8_t reserved;
+    int32_t pid;                 /* Task running when the event happened */
+    uint64_t arg0;
+    uint64_t arg1;
+} trace_record_t;
+
+/* Frame payloads written by trace_dump() (types in uart.h) */
+#define TRACE_INFO_MAGIC        0x45435254   /* "TRCE" */
+#define TRACE_INFO_VERSION      1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t tsc_khz;
+    uint32_t nr_cpus;
+    uint32_t reserved;
+    uint64_t lost;               /* Records overwritten before the dump */
+} trace_info_t;
+
+typedef struct {
+    int32_t pid;
+    uint32_t reserved;
+    char name[32];
+} trace_task_t;
+
+#ifdef CONFIG_TRACE
+
+extern volatile bool trace_on;
+
+void trace_emit(uint16_t event, uint64_t arg0, uint64_t arg1);
+
+#define TRACE(event, arg0, arg1) do { \
+    if (__builtin_expect(trace_on, 0)) { \
+        trace_emit((event), (uint64_t)(arg0), (uint64_t)(arg1)); \
+    } \
+} while (0)
+
+#else
+
+#define TRACE(event, arg0, arg1) do { } while (0)
+
+#endif /* CONFIG_TRACE */
+
+/* Tracepoints */
+#define trace_sched_switch(prev, next) \
+    TRACE(TRACE_SCHED_SWITCH, (prev)->pid, (uint32_t)(next)->pid | ((uint64_t)(prev)->state << 32))
+#define trace_sched_wake(task)          TRACE(TRACE_SCHED_WAKE, (task)->pid, (task)->cpu)
+#define trace_sched_block(task, why)    TRACE(TRACE_SCHED_BLOCK, (task)->pid, (why))
+#define trace_msg_send(queue, id)       TRACE(TRACE_MSG_SEND, (uintptr_t)(queue), (id))
+#define trace_msg_receive(queue, id)    TRACE(TRACE_MSG_RECEIVE, (uintptr_t)(queue), (id))
+#define trace_mutex_contend(mutex, owner) TRACE(TRACE_MUTEX_CONTEND, (uintptr_t)(mutex), (owner))
+#define trace_mutex_acquire(mutex)      TRACE(TRACE_MUTEX_ACQUIRE, (uintptr_t)(mutex), 0)
+#define trace_page_fault(addr, error)   TRACE(TRACE_PAGE_FAULT, (addr), (error))
+#define trace_irq_entry(irq)            TRACE(TRACE_IRQ_ENTRY, (irq), 0)
+#define trace_irq_exit(irq)             TRACE(TRACE_IRQ_EXIT, (irq), 0)
+
+#ifdef CONFIG_TRACE
+
+/* Allocate a ring per online CPU */
+void init_trace(void);
+
+/* Start recording (rings are cleared) and stop; records stay until the next start */
+void trace_start(void);
+void trace_stop(void);
+
+/* Send the rings out of a serial port as frames (stops tracing); returns the records sent */
+uint64_t trace_dump(uart_t* uart);
+
+#endif /* CONFIG_TRACE */
+
+#endif /* EDGEX_TRACE_H */
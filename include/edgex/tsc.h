@@ -0,0 +1,28 @@
+/*
+ * EdgeX OS - Time Stamp Counter
+ *
+ * This file declares the TSC calibration and conversion helpers used
+ * for fine-grained timing below the resolution of the scheduler tick.
+ */
+
+#ifndef EDGEX_TSC_H
+#define EDGEX_TSC_H
+
+#include <edgex/kernel.h>
+
+/* Calibrate the TSC against the PIT (call once, with interrupts disabled) */
+void init_tsc(void);
+
+/* TSC frequency in kHz (0 if not calibrated) */
+uint64_t tsc_khz(void);
+
+/* Convert TSC cycles to nanoseconds */
+uint64_t tsc_to_ns(uint64_t cycles);
+
+/* Convert nanoseconds to TSC cycles */
+uint64_t ns_to_tsc(uint64_t ns);
+
+/* Nanoseconds since TSC calibration */
+uint64_t tsc_now_ns(void);
+
+#endif /* EDGEX_TSC_H */
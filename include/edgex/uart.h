@@ -0,0 +1,142 @@
+/*
+ * EdgeX OS - 16550 UART
+ *
+ * This file defines the serial port driver. Output goes into a software
+ * ring per port and the TX FIFO is refilled a whole FIFO at a time, from
+ * the THRE interrupt once IRQs are up and by polling before that. COM1
+ * is a kernel log console. Binary data travels in frames that a host
+ * tool (tools/uartsplit.py) separates from the text, and binary mode
+ * keeps the text off a port so frames get the whole line. After a panic
+ * a port only polls.
+ */
+
+#ifndef EDGEX_UART_H
+#define EDGEX_UART_H
+
+#include <edgex/kernel.h>
+#include <edgex/spinlock.h>
+
+/* Register offsets */
+#define UART_THR                0    /* Transmit holding (write) */
+#define UART_RBR                0    /* Receive buffer (read) */
+#define UART_DLL                0    /* Divisor latch low (DLAB) */
+#define UART_IER                1
+#define UART_DLM                1    /* Divisor latch high (DLAB) */
+#define UART_IIR                2    /* Interrupt identification (read) */
+#define UART_FCR                2    /* FIFO control (write) */
+#define UART_LCR                3
+#define UART_MCR                4
+#define UART_LSR                5
+#define UART_SCR                7
+
+#define UART_IER_RDI            0x01
+#define UART_IER_THRI           0x02
+#define UART_IER_RLSI           0x04
+
+#define UART_IIR_NO_INT         0x01
+#define UART_IIR_ID_MASK        0x0E
+#define UART_IIR_THRI           0x02
+#define UART_IIR_RDI            0x04
+#define UART_IIR_RLSI           0x06
+#define UART_IIR_TIMEOUT        0x0C
+#define UART_IIR_FIFO_MASK      0xC0 /* Both set: 16550A FIFO enabled */
+
+#define UART_FCR_ENABLE         0x01
+#define UART_FCR_CLEAR_RX       0x02
+#define UART_FCR_CLEAR_TX       0x04
+#define UART_FCR_64BYTE         0x20 /* 16750 */
+#define UART_FCR_TRIGGER_14     0xC0
+
+#define UART_LCR_8N1            0x03
+#define UART_LCR_DLAB           0x80
+
+#define UART_MCR_DTR            0x01
+#define UART_MCR_RTS            0x02
+#define UART_MCR_OUT2           0x08 /* Gates the IRQ line on PCs */
+
+#define UART_LSR_DR             0x01
+#define UART_LSR_THRE           0x20 /* TX FIFO empty */
+#define UART_LSR_TEMT           0x40 /* TX FIFO and shift register empty */
+
+/* Standard PC ports */
+#define UART_COM1_PORT          0x3F8
+#define UART_COM2_PORT          0x2F8
+
+#define UART_CLOCK_BAUD         115200   /* 1.8432 MHz / 16: divisor 1 */
+#define UART_DEFAULT_BAUD       115200
+
+#define UART_MAX_PORTS          2
+#define UART_TX_RING_SIZE       16384    /* Bytes (power of two) */
+
+/*
+ * Binary frame: sync bytes, a type, the payload length (little endian),
+ * the payload and a Fletcher-16 checksum of type, length and payload.
+ * Log text never contains the NUL and 0xFF of the sync.
+ */
+#define UART_FRAME_SYNC         "\x00\xFF" "EX"
+#define UART_FRAME_SYNC_LEN     4
+#define UART_FRAME_HDR_LEN      (UART_FRAME_SYNC_LEN + 3)
+#define UART_FRAME_MAX          4096     /* Larger writes are split */
+
+/* Frame types */
+#define UART_FRAME_RAW          0
+#define UART_FRAME_BENCH        1
+#define UART_FRAME_TRACE_INFO   2        /* trace_info_t (trace.h) */
+#define UART_FRAME_TRACE_TASK   3        /* trace_task_t entries */
+#define UART_FRAME_TRACE_DATA   4        /* trace_record_t entries */
+
+typedef struct {
+    uint64_t tx_bytes;
+    uint64_t tx_irqs;            /* THRE interrupts */
+    uint64_t fifo_fills;         /* Writes of up to a FIFO of bytes */
+    uint64_t polled_bytes;       /* Sent by polling (early boot, full ring, panic) */
+    uint64_t ring_full;          /* Writers that had to wait for the line */
+    uint64_t frames;
+    uint64_t text_suppressed;    /* Console bytes dropped in binary mode */
+} uart_stats_t;
+
+typedef struct {
+    uint16_t base;
+    uint8_t irq;
+    uint8_t fifo_size;           /* 1, 16 or 64 */
+    uint32_t baud;
+    spinlock_t lock;             /* Raw: used before per-CPU data and from the IRQ */
+    bool present;
+    bool irq_mode;               /* THRE interrupt drains the ring */
+    bool thri_enabled;
+    bool polled;                 /* Panic: never wait for an interrupt again */
+    volatile bool binary;        /* Text is kept off the port */
+    uint32_t head;               /* Ring positions, free running */
+    uint32_t tail;
+    uart_stats_t stats;
+    uint8_t ring[UART_TX_RING_SIZE];
+} uart_t;
+
+/* Probe COM1 and COM2; COM1 becomes a log console (polled until uart_enable_irqs) */
+void init_uart(void);
+
+/* Drain from the THRE interrupt (needs the interrupt controllers) */
+void uart_enable_irqs(void);
+
+/* A port by index (0 = COM1), NULL if absent */
+uart_t* uart_get(uint32_t index);
+
+/* Change the line speed once everything queued has been sent */
+int uart_set_baud(uart_t* uart, uint32_t baud);
+
+/* Queue bytes as they are (no newline translation) */
+void uart_write(uart_t* uart, const void* data, size_t len);
+
+/* Queue binary data as frames of a type */
+void uart_write_frame(uart_t* uart, uint8_t type, const void* data, size_t len);
+
+/* Keep log text off the port while streaming binary data */
+void uart_set_binary(uart_t* uart, bool binary);
+
+/* Wait until everything queued is on the wire */
+void uart_drain(uart_t* uart);
+
+void uart_get_stats(uart_t* uart, uart_stats_t* stats);
+void dump_uart_stats(void);
+
+#endif /* EDGEX_UART_H */
@@ -0,0 +1,144 @@
+/*
+ * EdgeX OS - UDP Sockets
+ *
+ * This file defines the socket interface of the UDP stack. A socket is a
+ * shared memory region ("udp.<port>") holding one receive ring per
+ * network queue and a pool of transmit slots. Received datagrams stay in
+ * the device's RX buffers; the ring carries descriptors that point into
+ * them, and the consumer hands each one back when done. To send, the
+ * consumer writes payloads into transmit slots and passes descriptors in
+ * batches; the headers are built in the slot's headroom and the device
+ * reads the slot directly.
+ */
+
+#ifndef EDGEX_UDP_H
+#define EDGEX_UDP_H
+
+#include <edgex/kernel.h>
+#include <edgex/ipc.h>
+#include <edgex/spinlock.h>
+#include <edgex/net.h>
+
+/* Limits */
+#define UDP_MAX_SOCKETS         16
+#define UDP_RING_SIZE           256          /* Descriptors per receive ring */
+#define UDP_MAX_RX_QUEUES       8
+#define UDP_TX_SLOTS            128
+#define UDP_TX_SLOT_SIZE        2048         /* NET_UDP_HEADROOM + payload */
+#define UDP_MAX_PAYLOAD         (NET_MTU - 20 - 8)
+
+/*
+ * A datagram descriptor (32 bytes)
+ *
+ * Received: buf is the RX buffer (in "virtio-net0.rx") and the payload
+ * is at offset from the start of its frame. Sent: buf is the transmit
+ * slot and the payload is at NET_UDP_HEADROOM in it. peer and port are
+ * the remote end.
+ */
+typedef struct {
+    uint32_t buf;
+    uint16_t offset;
+    uint16_t len;
+    uint16_t queue;              /* Network queue the datagram arrived on */
+    uint16_t port;
+    net_addr_t peer;
+    uint8_t reserved[3];
+} udp_desc_t;
+
+/*
+ * Ring indices, one cache line each side so producer and consumer do not
+ * share a line. The producer owns tail, the consumer owns head.
+ */
+typedef struct {
+    volatile uint32_t head;
+    uint8_t pad0[60];
+    volatile uint32_t tail;
+    uint8_t pad1[60];
+} udp_ring_idx_t;
+
+/*
+ * Region layout: this header in the first page, then the receive rings
+ * (UDP_RING_SIZE descriptors per queue), then the transmit slots
+ */
+typedef struct {
+    uint32_t nr_rings;
+    uint32_t rings_offset;
+    uint32_t tx_offset;
+    uint32_t tx_slots;
+    uint8_t pad[48];
+    udp_ring_idx_t rx[UDP_MAX_RX_QUEUES];
+} udp_shared_t;
+
+/* Per-socket counters */
+typedef struct {
+    uint64_t rx_packets;
+    uint64_t rx_ring_full;       /* Dropped: consumer fell behind */
+    uint64_t tx_packets;
+    uint64_t tx_failed;          /* Refused (ring full or unresolved) or dropped later */
+    uint64_t tx_bad_free;        /* Slots freed twice or out of range, ignored */
+    uint64_t wakeups;
+} udp_stats_t;
+
+typedef struct udp_socket {
+    uint16_t port;
+    uint32_t id;
+    bool in_use;                 /* Slot taken (open, opening or closing) */
+    volatile bool open;          /* Receiving */
+    char name[16];
+
+    shared_memory_t shm;         /* NULL when the region is kernel-private */
+    uint32_t nr_pages;
+    uint64_t* pages;             /* Physical address of each region page */
+    udp_shared_t* shared;
+
+    spinlock_t tx_lock;
+    uint16_t tx_free[UDP_TX_SLOTS];
+    uint32_t tx_free_count;
+    bool tx_is_free[UDP_TX_SLOTS];   /* Slot is on the free list */
+
+    volatile pid_t waiter;       /* Task blocked in udp_wait() */
+    udp_stats_t stats;
+} udp_socket_t;
+
+/* Set up the socket table (from init_net) */
+void init_udp(void);
+
+/* Open a socket bound to a local port; returns NULL if in use */
+udp_socket_t* udp_open(uint16_t port);
+void udp_close(udp_socket_t* sock);
+
+/*
+ * Receive
+ *
+ * udp_recv() takes up to max descriptors from the receive rings without
+ * blocking; udp_wait() blocks until there is at least one. Every
+ * descriptor must be returned with udp_release(), in any order.
+ */
+uint32_t udp_recv(udp_socket_t* sock, udp_desc_t* descs, uint32_t max);
+uint32_t udp_wait(udp_socket_t* sock, udp_desc_t* descs, uint32_t max);
+void* udp_rx_data(udp_socket_t* sock, const udp_desc_t* desc);
+void udp_release(udp_socket_t* sock, const udp_desc_t* descs, uint32_t count);
+
+/*
+ * Send
+ *
+ * udp_alloc_tx() takes up to count free transmit slots and returns how
+ * many it got. udp_send() sends the descriptors as one batch with one
+ * doorbell and returns how many went out; the slots of those come back
+ * when the device is done with them, the rest still belong to the
+ * caller.
+ */
+uint32_t udp_alloc_tx(udp_socket_t* sock, uint32_t* slots, uint32_t count);
+void* udp_tx_data(udp_socket_t* sock, uint32_t slot);
+uint32_t udp_send(udp_socket_t* sock, const udp_desc_t* descs, uint32_t count);
+void udp_free_tx(udp_socket_t* sock, const uint32_t* slots, uint32_t count);
+
+/* Stack side: queue a received datagram, return a sent slot */
+bool udp_deliver(uint16_t port, uint16_t queue, uint32_t buf, uint32_t offset, uint32_t len,
+                 const net_addr_t* peer, uint16_t peer_port);
+void udp_tx_complete(void* cookie, bool sent);
+
+/* Print open sockets */
+void dump_udp_sockets(void);
+
+#endif /* EDGEX_UDP_H */
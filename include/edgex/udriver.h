@@ -0,0 +1,130 @@
+/*
+ * EdgeX OS - User-Space Device Drivers
+ *
+ * This file defines the interface that lets a task drive a PCI function
+ * itself. The kernel binds the function to the task, maps its BARs
+ * (uncached) and DMA memory into the task's address space, pins the
+ * task's own buffers for DMA, and turns the function's interrupts into
+ * counters in a page the task can read and, optionally, event_t
+ * signals. A polling driver then runs its queues with no kernel entry
+ * per packet or request.
+ */
+
+#ifndef EDGEX_UDRIVER_H
+#define EDGEX_UDRIVER_H
+
+#include <edgex/kernel.h>
+#include <edgex/ipc.h>
+#include <edgex/pci.h>
+
+/* Limits */
+#define UDRIVER_MAX_DEVICES       8
+#define UDRIVER_MAX_IRQS          8
+#define UDRIVER_MAX_DMA           16     /* DMA pool allocations per device */
+#define UDRIVER_MAX_PINS          16     /* Pinned buffers per device */
+
+/*
+ * Each device gets its own window of the owner's address space for BARs
+ * and DMA pools, above the range tasks use for code, heap and stacks
+ */
+#define UDRIVER_VADDR_BASE        0x0000400000000000ULL
+#define UDRIVER_WINDOW_SIZE       (1ULL << 36)   /* 64GB per device */
+
+/*
+ * Page shared with the driver task (mapped read-only)
+ *
+ * irq_count[i] counts interrupts on vector i. A polling driver compares
+ * it with the last value it saw instead of waiting on an event.
+ */
+typedef struct {
+    volatile uint64_t irq_count[UDRIVER_MAX_IRQS];
+} udriver_shared_t;
+
+/* A DMA pool allocation */
+typedef struct {
+    uint64_t vaddr;              /* In the owner's address space */
+    uint32_t pages;
+    uint64_t* phys;              /* Physical address of each page */
+} udriver_dma_t;
+
+/* A pinned buffer owned by the task */
+typedef struct {
+    uint64_t vaddr;
+    size_t size;
+} udriver_pin_t;
+
+struct udriver;
+
+/* Per-vector interrupt binding */
+typedef struct {
+    struct udriver* drv;
+    uint32_t index;
+    uint8_t irq;                 /* 0 when not bound */
+    event_t event;               /* Signalled from the IRQ thread, or NULL */
+} udriver_irq_t;
+
+typedef struct udriver {
+    pci_device_t* pci;           /* NULL when the slot is free */
+    pid_t owner;
+    struct page_directory* pd;   /* Owner's address space */
+    uint32_t id;
+
+    uint64_t window;             /* Base of the device's address window */
+    uint64_t window_used;        /* Bump allocator within the window */
+    uint64_t bar_vaddr[PCI_MAX_BARS];
+
+    udriver_shared_t* shared;
+    uint64_t shared_vaddr;
+
+    uint32_t nr_vectors;         /* MSI/MSI-X vectors allocated */
+    udriver_irq_t irqs[UDRIVER_MAX_IRQS];
+
+    udriver_dma_t dma[UDRIVER_MAX_DMA];
+    udriver_pin_t pins[UDRIVER_MAX_PINS];
+} udriver_t;
+
+/* Set up the framework (after init_pci and init_scheduler) */
+void init_udriver(void);
+
+/*
+ * Bind a PCI function to a task
+ *
+ * Fails if a kernel driver or another task already owns the function or
+ * the task has no address space of its own. The task can find the
+ * shared page at drv->shared_vaddr.
+ */
+udriver_t* udriver_attach(pci_device_t* pci, pid_t owner);
+
+/* Unbind: stop the device's DMA and interrupts and undo all mappings */
+void udriver_detach(udriver_t* drv);
+
+/* Map a memory BAR into the owner; returns its address there, or 0 */
+uint64_t udriver_map_bar(udriver_t* drv, uint32_t bar);
+
+/*
+ * Allocate a DMA pool of whole pages and map it into the owner
+ *
+ * phys receives each page's physical address for the device's
+ * descriptors. Returns the pool's address in the owner, or 0.
+ */
+uint64_t udriver_dma_alloc(udriver_t* drv, uint32_t pages, uint64_t* phys);
+
+/* Pin a buffer in the owner's address space for DMA */
+int udriver_dma_pin(udriver_t* drv, uint64_t vaddr, size_t size, uint64_t* phys, size_t max_pages);
+int udriver_dma_unpin(udriver_t* drv, uint64_t vaddr, size_t size);
+
+/*
+ * Interrupts
+ *
+ * udriver_alloc_irqs() sets up to nvec MSI/MSI-X vectors and returns how
+ * many it got; each one counts into the shared page from then on.
+ * Binding an event makes the vector signal it as well.
+ */
+int udriver_alloc_irqs(udriver_t* drv, uint32_t nvec);
+int udriver_bind_irq_event(udriver_t* drv, uint32_t index, event_t event);
+int udriver_irq_set_cpu(udriver_t* drv, uint32_t index, uint32_t cpu);
+
+/* Print bound devices */
+void dump_udrivers(void);
+
+#endif /* EDGEX_UDRIVER_H */
@@ -0,0 +1,250 @@
+/*
+ * EdgeX OS - Virtio
+ *
+ * This file defines the virtio 1.x PCI transport and virtqueues in both
+ * ring layouts: the split ring (descriptor table plus avail and used
+ * rings) and the packed ring (one descriptor ring written by both
+ * sides). Device drivers (virtio-net, virtio-blk) sit on top of this.
+ */
+
+#ifndef EDGEX_VIRTIO_H
+#define EDGEX_VIRTIO_H
+
+#include <edgex/kernel.h>
+#include <edgex/pci.h>
+
+/* PCI IDs */
+#define VIRTIO_PCI_VENDOR_ID           0x1AF4
+#define VIRTIO_PCI_MODERN_DEVICE_BASE  0x1040   /* + virtio device ID */
+
+/* Virtio device IDs */
+#define VIRTIO_ID_NET                  1
+#define VIRTIO_ID_BLOCK                2
+
+/* Device status bits */
+#define VIRTIO_STATUS_ACKNOWLEDGE      1
+#define VIRTIO_STATUS_DRIVER           2
+#define VIRTIO_STATUS_DRIVER_OK        4
+#define VIRTIO_STATUS_FEATURES_OK      8
+#define VIRTIO_STATUS_NEEDS_RESET      64
+#define VIRTIO_STATUS_FAILED           128
+
+/* Transport feature bits */
+#define VIRTIO_F_INDIRECT_DESC         28
+#define VIRTIO_F_EVENT_IDX             29
+#define VIRTIO_F_VERSION_1             32
+#define VIRTIO_F_ACCESS_PLATFORM       33
+#define VIRTIO_F_RING_PACKED           34
+#define VIRTIO_F_IN_ORDER              35
+
+/* PCI vendor capability types */
+#define VIRTIO_PCI_CAP_COMMON_CFG      1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG      2
+#define VIRTIO_PCI_CAP_ISR_CFG         3
+#define VIRTIO_PCI_CAP_DEVICE_CFG      4
+
+/* No MSI-X vector assigned */
+#define VIRTIO_MSI_NO_VECTOR           0xFFFF
+
+/* Largest ring we allocate; keeps each ring part within one page */
+#define VIRTIO_MAX_QUEUE_SIZE          256
+#define VIRTIO_MAX_QUEUES              32
+
+/* Common configuration structure (BAR-mapped) */
+typedef struct __attribute__((packed)) {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t config_msix_vector;
+    uint16_t num_queues;
+    uint8_t device_status;
+    uint8_t config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    uint64_t queue_desc;
+    uint64_t queue_driver;
+    uint64_t queue_device;
+} virtio_pci_common_cfg_t;
+
+/* Split ring layout */
+#define VRING_DESC_F_NEXT              1
+#define VRING_DESC_F_WRITE             2
+#define VRING_DESC_F_INDIRECT          4
+
+#define VRING_AVAIL_F_NO_INTERRUPT     1
+#define VRING_USED_F_NO_NOTIFY         1
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];             /* Followed by used_event */
+} vring_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} vring_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    vring_used_elem_t ring[];    /* Followed by avail_event */
+} vring_used_t;
+
+/* Packed ring layout */
+#define VRING_PACKED_DESC_F_AVAIL      (1 << 7)
+#define VRING_PACKED_DESC_F_USED       (1 << 15)
+
+#define VRING_PACKED_EVENT_F_ENABLE    0
+#define VRING_PACKED_EVENT_F_DISABLE   1
+#define VRING_PACKED_EVENT_F_DESC      2
+#define VRING_PACKED_EVENT_WRAP_SHIFT  15
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t id;
+    uint16_t flags;
+} vring_packed_desc_t;
+
+typedef struct {
+    uint16_t off_wrap;
+    uint16_t flags;
+} vring_packed_event_t;
+
+/* Scatter-gather element for virtqueue_add() */
+typedef struct {
+    uint64_t addr;               /* Physical address */
+    uint32_t len;
+} virtio_sg_t;
+
+struct virtio_device;
+struct virtqueue;
+
+/* Called from the queue's interrupt when buffers were used */
+typedef void (*virtqueue_callback_t)(struct virtqueue* vq);
+
+/* Per-queue counters */
+typedef struct {
+    uint64_t added;              /* Buffers posted */
+    uint64_t completed;          /* Buffers returned by the device */
+    uint64_t kicks;              /* Doorbell writes */
+    uint64_t kicks_suppressed;   /* Kicks skipped: device asked not to be notified */
+    uint64_t interrupts;
+} virtqueue_stats_t;
+
+/* A virtqueue in either ring layout */
+typedef struct virtqueue {
+    struct virtio_device* vdev;
+    uint16_t index;
+    uint16_t num;                /* Ring size */
+    uint16_t num_free;           /* Free descriptors */
+    bool packed;
+    bool event_idx;              /* VIRTIO_F_EVENT_IDX negotiated */
+    uint16_t last_used_idx;      /* Next used entry to look at */
+    uint16_t added;              /* Buffers added since the last kick */
+
+    /* Split ring */
+    vring_desc_t* desc;
+    vring_avail_t* avail;
+    vring_used_t* used;
+    uint16_t free_head;          /* Free descriptor chain */
+    uint16_t avail_idx;          /* Shadow of avail->idx */
+    uint16_t avail_flags;        /* Shadow of avail->flags */
+
+    /* Packed ring */
+    vring_packed_desc_t* pdesc;
+    vring_packed_event_t* driver_event;
+    vring_packed_event_t* device_event;
+    uint16_t next_avail;         /* Next ring slot to fill */
+    bool avail_wrap;             /* Driver ring wrap counter */
+    bool used_wrap;              /* Device ring wrap counter */
+    uint16_t event_flags;        /* Shadow of driver_event->flags */
+    uint16_t free_id;            /* Free buffer ID list head */
+    uint16_t* id_next;           /* Free buffer ID links */
+    uint16_t* id_len;            /* Descriptors used by each buffer ID */
+
+    void** tokens;               /* Caller cookie per head descriptor / ID */
+    volatile uint16_t* notify;   /* Doorbell */
+
+    int irq;                     /* -1 when polled only */
+    virtqueue_callback_t callback;
+    void* priv;                  /* Owned by the device driver */
+    virtqueue_stats_t stats;
+} virtqueue_t;
+
+/* A virtio PCI device */
+typedef struct virtio_device {
+    pci_device_t* pci;
+    uint16_t device_id;          /* VIRTIO_ID_* */
+    volatile virtio_pci_common_cfg_t* common;
+    volatile uint8_t* notify_base;
+    uint32_t notify_multiplier;
+    volatile uint8_t* isr;
+    volatile uint8_t* device_cfg;
+    uint64_t features;           /* Negotiated features */
+    uint32_t nr_vectors;         /* MSI-X vectors allocated */
+    virtqueue_t* vqs[VIRTIO_MAX_QUEUES];
+    uint16_t nr_vqs;
+} virtio_device_t;
+
+/* Find the index'th virtio function of a type (modern or transitional) */
+pci_device_t* virtio_pci_find(uint16_t device_id, uint32_t index);
+
+/*
+ * Device bring-up, in order: virtio_init_device(), virtio_negotiate(),
+ * virtio_alloc_vectors() (optional), virtio_setup_vq() for each queue,
+ * virtio_device_ready().
+ */
+int virtio_init_device(virtio_device_t* vdev, pci_device_t* pci, uint16_t device_id);
+int virtio_negotiate(virtio_device_t* vdev, uint64_t driver_features);
+int virtio_alloc_vectors(virtio_device_t* vdev, uint32_t nvec);
+virtqueue_t* virtio_setup_vq(virtio_device_t* vdev, uint16_t index, uint16_t max_size,
+                             int vector, virtqueue_callback_t callback, void* priv);
+void virtio_device_ready(virtio_device_t* vdev);
+void virtio_reset(virtio_device_t* vdev);
+
+static inline bool virtio_has_feature(virtio_device_t* vdev, uint32_t bit) {
+    return (vdev->features >> bit) & 1;
+}
+
+/* Read the device-specific config, retrying across config changes */
+void virtio_read_config(virtio_device_t* vdev, uint32_t offset, void* buf, uint32_t len);
+
+/* Steer a queue's interrupt to a CPU */
+int virtio_vq_set_cpu(virtqueue_t* vq, uint32_t cpu);
+
+/*
+ * Virtqueue operations
+ *
+ * The caller serializes operations on one queue (one CPU owns a queue).
+ * virtqueue_add() only writes the ring; the device is told by
+ * virtqueue_kick(), so a batch of buffers costs one doorbell write, and
+ * none at all while the device is already processing the ring.
+ */
+int virtqueue_add(virtqueue_t* vq, const virtio_sg_t* sg, uint32_t out, uint32_t in, void* token);
+bool virtqueue_kick(virtqueue_t* vq);
+void* virtqueue_get_buf(virtqueue_t* vq, uint32_t* len);
+bool virtqueue_has_used(virtqueue_t* vq);
+void virtqueue_disable_cb(virtqueue_t* vq);
+bool virtqueue_enable_cb(virtqueue_t* vq);
+
+/* Interrupt coalescing: re-enable, interrupting after count more used buffers */
+bool virtqueue_enable_cb_delayed(virtqueue_t* vq, uint16_t count);
+
+static inline uint16_t virtqueue_num_free(virtqueue_t* vq) {
+    return vq->num_free;
+}
+
+#endif /* EDGEX_VIRTIO_H */
@@ -0,0 +1,204 @@
+/*
+ * EdgeX OS - Virtio Block Device
+ *
+ * This file defines the virtio-blk driver interface. The device gets one
+ * request queue per CPU; a request is submitted on the caller's CPU and
+ * completes on the same CPU from the BLOCK softirq. Requests to adjacent
+ * sectors submitted back to back are merged into one device request, and
+ * completion interrupts are coalesced. Completions are delivered either
+ * to a callback or to a completion queue a task can wait on.
+ */
+
+#ifndef EDGEX_VIRTIO_BLK_H
+#define EDGEX_VIRTIO_BLK_H
+
+#include <edgex/kernel.h>
+#include <edgex/spinlock.h>
+#include <edgex/virtio.h>
+
+/* Feature bits */
+#define VIRTIO_BLK_F_SIZE_MAX          1    /* Maximum segment size in size_max */
+#define VIRTIO_BLK_F_SEG_MAX           2    /* Maximum segments per request in seg_max */
+#define VIRTIO_BLK_F_RO                5
+#define VIRTIO_BLK_F_BLK_SIZE          6
+#define VIRTIO_BLK_F_FLUSH             9
+#define VIRTIO_BLK_F_MQ                12
+
+/* Request header types */
+#define VIRTIO_BLK_T_IN                0
+#define VIRTIO_BLK_T_OUT               1
+#define VIRTIO_BLK_T_FLUSH             4
+
+/* Request status */
+#define VIRTIO_BLK_S_OK                0
+#define VIRTIO_BLK_S_IOERR             1
+#define VIRTIO_BLK_S_UNSUPP            2
+
+typedef struct __attribute__((packed)) {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} virtio_blk_req_hdr_t;
+
+/* Device configuration (up to num_queues) */
+typedef struct __attribute__((packed)) {
+    uint64_t capacity;           /* In 512-byte sectors */
+    uint32_t size_max;
+    uint32_t seg_max;
+    uint16_t cylinders;
+    uint8_t heads;
+    uint8_t sectors;
+    uint32_t blk_size;
+    uint8_t physical_block_exp;
+    uint8_t alignment_offset;
+    uint16_t min_io_size;
+    uint32_t opt_io_size;
+    uint8_t writeback;
+    uint8_t unused0;
+    uint16_t num_queues;
+} virtio_blk_config_t;
+
+#define VIRTIO_BLK_SECTOR_SIZE         512
+
+/* Limits */
+#define VIRTIO_BLK_MAX_DEVICES         2
+#define VIRTIO_BLK_MAX_QUEUES          8
+#define VIRTIO_BLK_RING_SIZE           256
+#define VIRTIO_BLK_MAX_CMDS            128    /* Device requests in flight per queue */
+#define VIRTIO_BLK_MAX_SEGS            32     /* Merged requests per device request */
+#define VIRTIO_BLK_MAX_MERGE_SECTORS   256    /* 128KB per device request */
+
+/* Completions needed before the device interrupts (if it has more in flight) */
+#define VIRTIO_BLK_COALESCE_DEFAULT    8
+
+/* Request operations */
+#define BLK_OP_READ                    VIRTIO_BLK_T_IN
+#define BLK_OP_WRITE                   VIRTIO_BLK_T_OUT
+#define BLK_OP_FLUSH                   VIRTIO_BLK_T_FLUSH   /* Covers writes completed before it */
+
+struct blk_request;
+struct virtio_blk_cq;
+
+/* Completion callback, run in the BLOCK softirq */
+typedef void (*blk_done_t)(struct blk_request* req);
+
+/* A block I/O request, owned by the caller until it completes */
+typedef struct blk_request {
+    struct blk_request* next;    /* Owned by the driver while in flight */
+    uint32_t op;                 /* BLK_OP_* */
+    uint64_t sector;
+    uint32_t nr_sectors;
+    uint64_t phys;               /* Physical address of the data buffer */
+    int status;                  /* 0 or -1, valid on completion */
+    uint64_t submit_tsc;         /* Set by virtio_blk_submit() */
+    uint64_t complete_tsc;       /* Set on completion */
+
+    /* Completion delivery: to cq if set, else to done */
+    struct virtio_blk_cq* cq;
+    blk_done_t done;
+    void* priv;
+} blk_request_t;
+
+/*
+ * Completion queue
+ *
+ * A ring of completed requests, filled from the BLOCK softirq and
+ * drained by one task. Submitting to a queue reserves a slot, so the
+ * ring never overflows: submission fails instead once the caller has as
+ * many requests in flight as the ring holds.
+ */
+typedef struct virtio_blk_cq {
+    spinlock_t lock;
+    blk_request_t** ring;
+    uint32_t size;               /* Power of two */
+    uint32_t head;               /* Next entry to reap */
+    uint32_t tail;               /* Next entry to fill */
+    uint32_t reserved;           /* Slots held by in-flight requests */
+    pid_t waiter;                /* Task blocked in virtio_blk_cq_wait() */
+} virtio_blk_cq_t;
+
+/* Per-queue counters */
+typedef struct {
+    uint64_t requests;           /* Requests submitted */
+    uint64_t merged;             /* Requests merged into another's device request */
+    uint64_t dispatched;         /* Device requests */
+    uint64_t completed;          /* Device requests completed */
+    uint64_t errors;
+    uint64_t deferred;           /* Device requests that waited for ring space */
+    uint64_t irq_polls;          /* Softirq runs */
+} virtio_blk_queue_stats_t;
+
+/* One device request: header, merged data segments, status */
+typedef struct virtio_blk_cmd {
+    struct virtio_blk_cmd* next; /* Free / deferred list link */
+    virtio_blk_req_hdr_t* hdr;   /* DMA: header followed by the status byte */
+    uint64_t hdr_phys;
+    blk_request_t* reqs;         /* Merged requests, in sector order */
+    blk_request_t* last;
+    uint32_t nr_segs;
+    uint32_t nr_sectors;
+} virtio_blk_cmd_t;
+
+struct virtio_blk;
+
+typedef struct virtio_blk_queue {
+    struct virtio_blk* blk;
+    struct virtio_blk_queue* next;  /* Per-CPU softirq list link */
+    uint16_t index;
+    uint32_t cpu;                /* CPU the queue's interrupt goes to */
+    virtqueue_t* vq;
+    spinlock_t lock;
+    volatile uint32_t scheduled; /* On a softirq list */
+
+    virtio_blk_cmd_t* cmds;
+    virtio_blk_cmd_t* free_cmds;
+    virtio_blk_cmd_t* plug;      /* Being merged into, not yet on the ring */
+    virtio_blk_cmd_t* deferred;  /* Waiting for ring space, in order */
+    virtio_blk_cmd_t* deferred_tail;
+    uint32_t inflight;           /* Device requests on the ring */
+
+    virtio_blk_queue_stats_t stats;
+} virtio_blk_queue_t;
+
+typedef struct virtio_blk {
+    virtio_device_t vdev;
+    uint32_t id;
+    uint64_t capacity;           /* In sectors */
+    uint32_t seg_max;
+    bool read_only;
+    uint16_t coalesce;           /* Completions per interrupt under load */
+    uint16_t nr_queues;
+    virtio_blk_queue_t queues[VIRTIO_BLK_MAX_QUEUES];
+} virtio_blk_t;
+
+/* Probe all virtio-blk devices (after init_softirqs) */
+void init_virtio_blk(void);
+
+/* Get a probed device */
+virtio_blk_t* virtio_blk_get(uint32_t index);
+
+/*
+ * Submit a request on the calling CPU's queue
+ *
+ * With more set the request may be held back to be merged with the next
+ * one; the batch goes to the device on the first call without it (or on
+ * virtio_blk_unplug()). Returns 0, or -1 if the request is invalid or its
+ * completion queue is full.
+ */
+int virtio_blk_submit(virtio_blk_t* blk, blk_request_t* req, bool more);
+
+/* Send requests held back for merging to the device */
+void virtio_blk_unplug(virtio_blk_t* blk);
+
+/* Set how many completions the device batches per interrupt (1 = none) */
+void virtio_blk_set_coalesce(virtio_blk_t* blk, uint16_t count);
+
+/* Completion queues (size is rounded up to a power of two) */
+int virtio_blk_cq_init(virtio_blk_cq_t* cq, uint32_t size);
+uint32_t virtio_blk_cq_reap(virtio_blk_cq_t* cq, blk_request_t** reqs, uint32_t max);
+uint32_t virtio_blk_cq_wait(virtio_blk_cq_t* cq, blk_request_t** reqs, uint32_t max);
+
+/* Print per-queue statistics */
+void dump_virtio_blk_stats(virtio_blk_t* blk);
+
+#endif /* EDGEX_VIRTIO_BLK_H */
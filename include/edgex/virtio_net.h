@@ -0,0 +1,195 @@
+/*
+ * EdgeX OS - Virtio Network Device
+ *
+ * This file defines the virtio-net driver interface. Each queue pair is
+ * owned by one CPU: its RX interrupt is steered there and switches the
+ * queue into NAPI polling under load. Receive buffers live in a shared
+ * memory region, so a service that maps the region reads packets where
+ * the device wrote them; transmit takes physical addresses of frames the
+ * caller already built, and doorbells are batched.
+ */
+
+#ifndef EDGEX_VIRTIO_NET_H
+#define EDGEX_VIRTIO_NET_H
+
+#include <edgex/kernel.h>
+#include <edgex/ipc.h>
+#include <edgex/spinlock.h>
+#include <edgex/virtio.h>
+#include <edgex/napi.h>
+
+/* Feature bits */
+#define VIRTIO_NET_F_CSUM              0    /* Device checksums partial TX packets */
+#define VIRTIO_NET_F_GUEST_CSUM        1    /* Driver handles partially checksummed RX */
+#define VIRTIO_NET_F_MTU               3
+#define VIRTIO_NET_F_MAC               5
+#define VIRTIO_NET_F_MRG_RXBUF         15
+#define VIRTIO_NET_F_STATUS            16
+#define VIRTIO_NET_F_CTRL_VQ           17
+#define VIRTIO_NET_F_MQ                22
+
+/* Per-packet header (VIRTIO_F_VERSION_1 layout) */
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM    1
+#define VIRTIO_NET_HDR_F_DATA_VALID    2
+#define VIRTIO_NET_HDR_GSO_NONE        0
+
+typedef struct __attribute__((packed)) {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers;
+} virtio_net_hdr_t;
+
+/* Device configuration */
+typedef struct __attribute__((packed)) {
+    uint8_t mac[6];
+    uint16_t status;
+    uint16_t max_virtqueue_pairs;
+    uint16_t mtu;
+} virtio_net_config_t;
+
+#define VIRTIO_NET_S_LINK_UP           1
+
+/* Limits */
+#define VIRTIO_NET_MAX_DEVICES         2
+#define VIRTIO_NET_MAX_QUEUES          8
+#define VIRTIO_NET_RING_SIZE           256
+#define VIRTIO_NET_RX_BUF_SIZE         2048   /* Header + a full Ethernet frame */
+
+/* RX buffers are refilled in batches of this many (one doorbell each) */
+#define VIRTIO_NET_RX_REFILL_BATCH     32
+
+struct virtio_net;
+
+/*
+ * Receive handler, called in the NET_RX softirq (or from
+ * virtio_net_poll()) on the queue's CPU
+ *
+ * buf identifies the buffer in the RX pool (its offset in the shared
+ * region is buf * VIRTIO_NET_RX_BUF_SIZE). Return true to keep the
+ * buffer (release it later with virtio_net_rx_release()), false to let
+ * the driver reuse it right away.
+ */
+typedef bool (*virtio_net_rx_handler_t)(struct virtio_net* net, uint16_t queue, uint32_t buf,
+                                        void* data, uint32_t len, void* ctx);
+
+/* Transmit completion: the device is done reading the frame */
+typedef void (*virtio_net_tx_done_t)(struct virtio_net* net, uint16_t queue, void* cookie);
+
+/* A frame to transmit */
+typedef struct {
+    uint64_t phys;               /* Physical address of the Ethernet frame */
+    uint32_t len;
+    uint16_t csum_start;         /* With csum_offset: checksum offload request */
+    uint16_t csum_offset;        /* (only if virtio_net_has_csum_offload()) */
+    void* cookie;                /* Passed to the TX completion handler */
+} virtio_net_tx_t;
+
+/* Per-queue counters */
+typedef struct {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_kept;            /* Buffers held by the consumer */
+    uint64_t rx_refills;         /* Refill batches (each one doorbell at most) */
+    uint64_t rx_starved;         /* Polls that found no free buffer to post */
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_full;            /* Transmit attempts on a full ring */
+    uint64_t busy_polls;         /* virtio_net_poll() calls */
+} virtio_net_queue_stats_t;
+
+/* One RX/TX queue pair */
+typedef struct {
+    struct virtio_net* net;
+    uint16_t index;
+    uint32_t cpu;                /* CPU the queue's interrupt goes to */
+    virtqueue_t* rx;
+    virtqueue_t* tx;
+    napi_t napi;
+    bool busy_poll;              /* Interrupts off; the consumer polls */
+
+    /* RX buffers owned by the driver but not posted */
+    spinlock_t rx_lock;
+    uint32_t rx_first;           /* First buffer ID of this queue */
+    uint32_t* rx_free;
+    uint32_t rx_free_count;
+
+    /* TX headers, one per in-flight frame */
+    spinlock_t tx_lock;
+    virtio_net_hdr_t* tx_hdrs;
+    uint64_t tx_hdrs_phys;
+    uint16_t* tx_free;
+    uint16_t tx_free_count;
+    void** tx_cookies;
+
+    virtio_net_queue_stats_t stats;
+} virtio_net_queue_t;
+
+typedef struct virtio_net {
+    virtio_device_t vdev;
+    uint32_t id;
+    uint8_t mac[6];
+    uint16_t mtu;
+    uint16_t nr_queues;
+    virtio_net_queue_t queues[VIRTIO_NET_MAX_QUEUES];
+    virtqueue_t* ctrl;
+
+    /* Receive buffer pool */
+    shared_memory_t rx_pool;     /* NULL if it had to come from kernel pages */
+    char rx_pool_name[32];
+    uint32_t rx_bufs;
+    uint64_t* rx_buf_phys;
+
+    virtio_net_rx_handler_t rx_handler;
+    void* rx_ctx;
+    virtio_net_tx_done_t tx_done;
+} virtio_net_t;
+
+/* Probe all virtio-net devices (after init_napi and init_scheduler) */
+void init_virtio_net(void);
+
+/* Get a probed device */
+virtio_net_t* virtio_net_get(uint32_t index);
+
+/* Install the consumer callbacks */
+void virtio_net_set_handlers(virtio_net_t* net, virtio_net_rx_handler_t rx,
+                             virtio_net_tx_done_t tx_done, void* ctx);
+
+/* Steer a queue's interrupt to the CPU that consumes it */
+int virtio_net_set_queue_cpu(virtio_net_t* net, uint16_t queue, uint32_t cpu);
+
+/*
+ * Transmit a frame; with more set the doorbell is deferred until a
+ * later call without it (or virtio_net_flush()). Returns 0 or -1 if the
+ * ring is full.
+ */
+int virtio_net_xmit(virtio_net_t* net, uint16_t queue, const virtio_net_tx_t* pkt, bool more);
+void virtio_net_flush(virtio_net_t* net, uint16_t queue);
+
+/* Return a buffer kept by the receive handler */
+void virtio_net_rx_release(virtio_net_t* net, uint16_t queue, uint32_t buf);
+
+/* Kernel address of an RX buffer's packet data */
+void* virtio_net_rx_data(virtio_net_t* net, uint32_t buf);
+
+/*
+ * Busy polling: with enable set the queue stops interrupting and the
+ * consumer drives it with virtio_net_poll(), which processes up to
+ * budget packets and returns how many it handled.
+ */
+void virtio_net_set_busy_poll(virtio_net_t* net, uint16_t queue, bool enable);
+int virtio_net_poll(virtio_net_t* net, uint16_t queue, int budget);
+
+/* Checksum offload on transmit is available */
+bool virtio_net_has_csum_offload(virtio_net_t* net);
+
+/* The device verified a received packet's checksum (GUEST_CSUM) */
+bool virtio_net_rx_csum_valid(virtio_net_t* net, uint32_t buf);
+
+/* Print per-queue statistics */
+void dump_virtio_net_stats(virtio_net_t* net);
+
+#endif /* EDGEX_VIRTIO_NET_H */
@@ -0,0 +1,80 @@
+/*
+ * EdgeX OS - Work Queues
+ *
+ * This file defines deferred work: per-CPU kernel worker threads that run
+ * queued work items in task context, delayed work driven by the tick, and
+ * periodic maintenance that used to run inside the timer interrupt.
+ */
+
+#ifndef EDGEX_WORKQUEUE_H
+#define EDGEX_WORKQUEUE_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+struct work;
+
+/* Work function type */
+typedef void (*work_func_t)(struct work* work);
+
+/*
+ * Work item
+ *
+ * A work item is queued at most once: queueing it again while it is still
+ * pending is coalesced into the pending run. It may be requeued (including
+ * by its own function) as soon as it starts running.
+ */
+typedef struct work {
+    work_func_t func;             /* Function to run */
+    void* data;                   /* Caller data */
+    volatile uint32_t pending;    /* Queued and not yet started */
+    uint32_t cpu;                 /* CPU whose worker runs it */
+    uint64_t queued_tsc;          /* When it was queued (latency stats) */
+    struct work* next;            /* Next item in the queue */
+} work_t;
+
+/* Work item that is queued after a delay */
+typedef struct delayed_work {
+    work_t work;
+    uint64_t expires;             /* Tick at which to queue the work */
+    volatile uint32_t timer_pending; /* Waiting for its expiry */
+    struct delayed_work* next;    /* Next timer, sorted by expiry */
+} delayed_work_t;
+
+/* Per-CPU work queue statistics */
+typedef struct {
+    uint64_t queued;              /* Items queued */
+    uint64_t coalesced;           /* Queue requests merged into a pending item */
+    uint64_t executed;            /* Items run */
+    uint64_t redirected;          /* Items moved off isolated CPUs */
+    uint64_t max_latency_ns;      /* Longest queue-to-start delay */
+} workqueue_stats_t;
+
+/* Initialization (after init_scheduler) */
+void init_workqueues(void);
+void workqueue_init_cpu(uint32_t cpu);
+
+/* Work items */
+void init_work(work_t* work, work_func_t func, void* data);
+void init_delayed_work(delayed_work_t* dwork, work_func_t func, void* data);
+
+/*
+ * Queue work; returns false if it was already pending (coalesced).
+ * Work aimed at an isolated CPU runs on a housekeeping CPU instead.
+ */
+bool queue_work(work_t* work);
+bool queue_work_on(uint32_t cpu, work_t* work);
+bool queue_delayed_work(delayed_work_t* dwork, uint64_t delay_ms);
+bool cancel_delayed_work(delayed_work_t* dwork);
+
+/* Tick hook: raise the timer softirq when delayed work has expired */
+void workqueue_tick(void);
+
+/* Run a timeout sweep periodically from a worker thread */
+void register_timeout_checker(void (*checker)(void));
+
+/* Statistics */
+void get_workqueue_stats(uint32_t cpu, workqueue_stats_t* stats);
+void dump_workqueue_stats(void);
+
+#endif /* EDGEX_WORKQUEUE_H */
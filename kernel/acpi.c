@@ -0,0 +1,194 @@
+/*
+ * EdgeX OS - ACPI Tables
+ *
+ * This file locates the ACPI root table, either from the copy of the RSDP
+ * handed over by the boot loader or by scanning the BIOS areas, and looks
+ * up system description tables by signature. Only static tables are
+ * used; there is no AML interpreter.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/acpi.h>
+
+/* Physical memory below this address is identity mapped at boot */
+#define ACPI_IDENTITY_LIMIT   (1ULL << 30)
+
+/* BIOS areas searched for the RSDP */
+#define BIOS_EBDA_SEGMENT_PTR 0x40E
+#define BIOS_ROM_START        0xE0000
+#define BIOS_ROM_END          0x100000
+
+/* RSDP from the boot loader (multiboot2 ACPI tag), if any */
+static acpi_rsdp_t boot_rsdp;
+static bool boot_rsdp_valid = false;
+
+/* Root table: XSDT (64-bit entries) or RSDT (32-bit entries) */
+static acpi_sdt_header_t* root_table = NULL;
+static bool root_is_xsdt = false;
+
+/*
+ * Get a virtual address for an ACPI table
+ */
+static void* acpi_map(uint64_t phys, size_t size) {
+    if (phys + size <= ACPI_IDENTITY_LIMIT) {
+        return (void*)phys;
+    }
+    return ioremap(phys, size);
+}
+
+/*
+ * Read a 16-bit value from the BIOS data area
+ *
+ * The pointer goes through an empty asm: to GCC a constant address in
+ * the first page looks like a null pointer dereference (-Warray-bounds).
+ */
+static uint16_t bios_read16(uint64_t phys) {
+    volatile uint16_t* ptr = acpi_map(phys, sizeof(uint16_t));
+    __asm__("" : "+r"(ptr));
+    return *ptr;
+}
+
+/*
+ * Sum bytes; valid ACPI structures sum to zero
+ */
+static uint8_t acpi_checksum(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    return sum;
+}
+
+/*
+ * Check an RSDP candidate
+ */
+static bool rsdp_valid(const acpi_rsdp_t* rsdp) {
+    if (memcmp(rsdp->signature, "RSD PTR ", 8) != 0 || acpi_checksum(rsdp, 20) != 0) {
+        return false;
+    }
+    return rsdp->revision < 2 || acpi_checksum(rsdp, rsdp->length) == 0;
+}
+
+/*
+ * Scan a memory range for the RSDP (16-byte aligned)
+ */
+static acpi_rsdp_t* scan_rsdp(uint64_t start, uint64_t end) {
+    for (uint64_t addr = start; addr + sizeof(acpi_rsdp_t) <= end; addr += 16) {
+        acpi_rsdp_t* rsdp = (acpi_rsdp_t*)addr;
+        if (rsdp_valid(rsdp)) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Record the RSDP copy from the boot loader (multiboot2 tags 14 and 15)
+ */
+void acpi_set_rsdp(const void* rsdp, size_t size) {
+    if (size > sizeof(boot_rsdp)) {
+        size = sizeof(boot_rsdp);
+    }
+    memset(&boot_rsdp, 0, sizeof(boot_rsdp));
+    memcpy(&boot_rsdp, rsdp, size);
+    boot_rsdp_valid = true;
+}
+
+/*
+ * Map a whole system description table given its physical address
+ */
+static acpi_sdt_header_t* map_table(uint64_t phys) {
+    acpi_sdt_header_t* header = acpi_map(phys, sizeof(acpi_sdt_header_t));
+    if (!header) {
+        return NULL;
+    }
+    return acpi_map(phys, header->length);
+}
+
+/*
+ * Locate the RSDP and the root table
+ */
+bool init_acpi(void) {
+    acpi_rsdp_t* rsdp = NULL;
+
+    if (boot_rsdp_valid) {
+        rsdp = &boot_rsdp;
+    } else {
+        // The first KB of the EBDA, then the BIOS read-only area
+        uint64_t ebda = (uint64_t)bios_read16(BIOS_EBDA_SEGMENT_PTR) << 4;
+        if (ebda) {
+            rsdp = scan_rsdp(ebda, ebda + 1024);
+        }
+        if (!rsdp) {
+            rsdp = scan_rsdp(BIOS_ROM_START, BIOS_ROM_END);
+        }
+    }
+
+    if (!rsdp) {
+        kernel_printf("ACPI: no RSDP found\n");
+        return false;
+    }
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_address) {
+        root_table = map_table(rsdp->xsdt_address);
+        root_is_xsdt = true;
+    } else {
+        root_table = map_table(rsdp->rsdt_address);
+        root_is_xsdt = false;
+    }
+
+    if (!root_table || acpi_checksum(root_table, root_table->length) != 0) {
+        kernel_printf("ACPI: invalid root table\n");
+        root_table = NULL;
+        return false;
+    }
+
+    kernel_printf("ACPI: revision %u, %s at %p\n", rsdp->revision,
+                  root_is_xsdt ? "XSDT" : "RSDT", (void*)root_table);
+    return true;
+}
+
+/*
+ * Find a table by signature
+ *
+ * instance selects among tables with the same signature (e.g. SSDTs).
+ * Returns NULL if not found or the checksum is bad.
+ */
+acpi_sdt_header_t* acpi_find_table(const char* signature, uint32_t instance) {
+    if (!root_table) {
+        return NULL;
+    }
+
+    uint32_t entry_size = root_is_xsdt ? 8 : 4;
+    uint32_t count = (root_table->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t* entries = (uint8_t*)root_table + sizeof(acpi_sdt_header_t);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t phys;
+        if (root_is_xsdt) {
+            memcpy(&phys, entries + i * 8, sizeof(phys));
+        } else {
+            uint32_t phys32;
+            memcpy(&phys32, entries + i * 4, sizeof(phys32));
+            phys = phys32;
+        }
+
+        acpi_sdt_header_t* table = map_table(phys);
+        if (!table || memcmp(table->signature, signature, 4) != 0) {
+            continue;
+        }
+        if (instance-- > 0) {
+            continue;
+        }
+        if (acpi_checksum(table, table->length) != 0) {
+            kernel_printf("ACPI: bad checksum in %.4s\n", signature);
+            return NULL;
+        }
+        return table;
+    }
+
+    return NULL;
+}
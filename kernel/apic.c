@@ -0,0 +1,447 @@
+/*
+ * EdgeX OS - Local APIC
+ *
+ * This file drives the per-CPU local APIC: enabling it (in x2APIC mode
+ * when the CPU supports it), EOI, IPIs and the APIC timer, which becomes
+ * each CPU's own tick device. init_apic() switches the machine from the
+ * 8259 PIC to the APICs described by the ACPI MADT.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/interrupt.h>
+#include <edgex/apic.h>
+#include <edgex/acpi.h>
+#include <edgex/cpu.h>
+#include <edgex/tick.h>
+#include <edgex/tsc.h>
+
+/* CPUID.01H feature bits */
+#define CPUID_EDX_APIC        (1 << 9)
+#define CPUID_ECX_X2APIC      (1 << 21)
+
+/* x2APIC-only registers */
+#define MSR_X2APIC_EOI        (MSR_X2APIC_BASE + (APIC_REG_EOI >> 4))
+#define MSR_X2APIC_ICR        (MSR_X2APIC_BASE + (APIC_REG_ICR_LOW >> 4))
+
+/* IMCR: routes the PIC output to the BSP's LINT0 or to the APIC */
+#define IMCR_SELECT_PORT      0x22
+#define IMCR_DATA_PORT        0x23
+#define IMCR_SELECT           0x70
+#define IMCR_APIC_MODE        0x01
+
+/* APIC timer calibration window */
+#define LAPIC_CALIBRATE_MS    10
+
+/* Per-CPU local APIC timer */
+typedef struct {
+    tick_device_t dev;
+    uint32_t cpu;
+    bool masked;                /* LVT timer masked by disable_irq(IRQ_TIMER) */
+    bool running;               /* Programmed by the tick code */
+} lapic_timer_t;
+
+static lapic_timer_t lapic_timers[MAX_CPUS];
+
+static bool apic_present = false;
+static bool x2apic_mode = false;
+static uint64_t lapic_phys = APIC_DEFAULT_PHYS_BASE;
+static volatile uint32_t* lapic_regs = NULL;
+
+/* APIC timer ticks per millisecond at divide-by-16 */
+static uint32_t lapic_timer_ticks_per_ms = 0;
+
+/* Local APIC errors reported through the error LVT */
+static uint64_t lapic_error_count = 0;
+
+/*
+ * Read a local APIC register
+ */
+static uint32_t lapic_read(uint32_t reg) {
+    if (x2apic_mode) {
+        return (uint32_t)rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+    }
+    return lapic_regs[reg / 4];
+}
+
+/*
+ * Write a local APIC register
+ */
+static void lapic_write(uint32_t reg, uint32_t value) {
+    if (x2apic_mode) {
+        wrmsr(MSR_X2APIC_BASE + (reg >> 4), value);
+        return;
+    }
+    lapic_regs[reg / 4] = value;
+}
+
+/*
+ * Check if the local APIC is in use
+ */
+bool apic_available(void) {
+    return apic_present;
+}
+
+/*
+ * Check if the local APIC runs in x2APIC mode
+ */
+bool x2apic_enabled(void) {
+    return x2apic_mode;
+}
+
+/*
+ * Signal end of interrupt to the local APIC
+ *
+ * In x2APIC mode this is a single non-serializing MSR write instead of
+ * an uncached MMIO store.
+ */
+void lapic_eoi(void) {
+    if (x2apic_mode) {
+        wrmsr(MSR_X2APIC_EOI, 0);
+        return;
+    }
+    if (lapic_regs) {
+        lapic_regs[APIC_REG_EOI / 4] = 0;
+    }
+}
+
+/*
+ * Get the local APIC ID of the running CPU
+ */
+uint32_t lapic_id(void) {
+    if (x2apic_mode) {
+        return lapic_read(APIC_REG_ID);
+    }
+    return lapic_read(APIC_REG_ID) >> 24;
+}
+
+/*
+ * Write the interrupt command register: send an IPI to a CPU by APIC ID
+ */
+static void lapic_write_icr(uint32_t apic_id, uint32_t command) {
+    if (x2apic_mode) {
+        // The ICR MSR write is not serializing: order earlier stores (the
+        // wakeup the IPI announces) before it, and keep the compiler from
+        // sinking them past it
+        __asm__ volatile("mfence; lfence" : : : "memory");
+        // One 64-bit write; no delivery status to poll
+        wrmsr(MSR_X2APIC_ICR, ((uint64_t)apic_id << 32) | command);
+        return;
+    }
+
+    uint64_t flags = local_irq_save();
+    while (lapic_read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING) {
+        __asm__ volatile("pause");
+    }
+    lapic_write(APIC_REG_ICR_HIGH, apic_id << 24);
+    lapic_write(APIC_REG_ICR_LOW, command);
+    local_irq_restore(flags);
+}
+
+/*
+ * Send a fixed IPI to a CPU by APIC ID
+ */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector) {
+    lapic_write_icr(apic_id, APIC_ICR_ASSERT | vector);
+}
+
+/*
+ * Send an INIT IPI: the CPU resets and waits for a STARTUP IPI
+ */
+void lapic_send_init(uint32_t apic_id) {
+    lapic_write_icr(apic_id, APIC_ICR_DELIVERY_INIT | APIC_ICR_LEVEL | APIC_ICR_ASSERT);
+}
+
+/*
+ * Send a STARTUP IPI: the CPU starts in real mode at start_phys, which
+ * must be page-aligned and below 1MB
+ */
+void lapic_send_startup(uint32_t apic_id, uint64_t start_phys) {
+    lapic_write_icr(apic_id, APIC_ICR_DELIVERY_STARTUP | (uint32_t)(start_phys >> 12));
+}
+
+/*
+ * Enable the local APIC of the running CPU
+ */
+void lapic_init_local(void) {
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+
+    // x2APIC must be entered from xAPIC mode, never directly from disabled
+    base |= APIC_BASE_ENABLE;
+    wrmsr(MSR_APIC_BASE, base);
+    if (x2apic_mode) {
+        wrmsr(MSR_APIC_BASE, base | APIC_BASE_X2APIC);
+    }
+
+    // Accept every priority; mask the PIC input, LINT1 is the NMI line
+    lapic_write(APIC_REG_TPR, 0);
+    lapic_write(APIC_REG_LVT_LINT0, APIC_LVT_MASKED);
+    lapic_write(APIC_REG_LVT_LINT1, APIC_LVT_DELIVERY_NMI);
+    lapic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED | INT_VECTOR_LOCAL_TIMER);
+    lapic_write(APIC_REG_LVT_ERROR, INT_VECTOR_APIC_ERROR);
+
+    // The ESR latches errors until written
+    lapic_write(APIC_REG_ESR, 0);
+    lapic_write(APIC_REG_ESR, 0);
+
+    lapic_write(APIC_REG_SVR, APIC_SVR_ENABLE | INT_VECTOR_SPURIOUS);
+    lapic_eoi();
+
+    cpu_t* cpu = this_cpu();
+    cpu->apic_id = lapic_id();
+}
+
+/*
+ * Measure the APIC timer rate against the TSC
+ */
+static void lapic_timer_calibrate(void) {
+    uint64_t window = tsc_khz() * LAPIC_CALIBRATE_MS;
+
+    lapic_write(APIC_REG_TIMER_DIVIDE, APIC_TIMER_DIVIDE_16);
+    lapic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED | INT_VECTOR_LOCAL_TIMER);
+    lapic_write(APIC_REG_TIMER_INITIAL, 0xFFFFFFFF);
+
+    uint64_t start = rdtsc();
+    while (rdtsc() - start < window) {
+        __asm__ volatile("pause");
+    }
+
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(APIC_REG_TIMER_CURRENT);
+    lapic_write(APIC_REG_TIMER_INITIAL, 0);
+
+    lapic_timer_ticks_per_ms = elapsed / LAPIC_CALIBRATE_MS;
+    kernel_printf("APIC timer: %u ticks/ms (divide 16)\n", lapic_timer_ticks_per_ms);
+}
+
+/*
+ * Write the local CPU's LVT timer entry
+ */
+static void lapic_timer_update_lvt(lapic_timer_t* timer) {
+    uint32_t lvt = APIC_TIMER_PERIODIC | INT_VECTOR_LOCAL_TIMER;
+    if (timer->masked || !timer->running) {
+        lvt |= APIC_LVT_MASKED;
+    }
+    lapic_write(APIC_REG_LVT_TIMER, lvt);
+}
+
+/*
+ * Start the local CPU's APIC timer as a periodic tick
+ */
+static void lapic_timer_set_periodic(tick_device_t* dev, uint32_t hz) {
+    lapic_timer_t* timer = (lapic_timer_t*)dev->private_data;
+    uint32_t count = (lapic_timer_ticks_per_ms * 1000) / hz;
+
+    timer->running = true;
+    lapic_write(APIC_REG_TIMER_DIVIDE, APIC_TIMER_DIVIDE_16);
+    lapic_timer_update_lvt(timer);
+    lapic_write(APIC_REG_TIMER_INITIAL, count ? count : 1);
+}
+
+/*
+ * Stop the local CPU's APIC timer
+ */
+static void lapic_timer_stop(tick_device_t* dev) {
+    lapic_timer_t* timer = (lapic_timer_t*)dev->private_data;
+
+    timer->running = false;
+    lapic_write(APIC_REG_TIMER_INITIAL, 0);
+    lapic_timer_update_lvt(timer);
+}
+
+/*
+ * Get a CPU's APIC timer tick device
+ *
+ * The timer only interrupts its own CPU, so nohz_full can stop it.
+ */
+tick_device_t* lapic_timer_device(uint32_t cpu) {
+    if (!apic_present || cpu >= MAX_CPUS) {
+        return NULL;
+    }
+
+    lapic_timer_t* timer = &lapic_timers[cpu];
+    if (!timer->dev.name) {
+        timer->cpu = cpu;
+        timer->dev.name = "lapic";
+        timer->dev.features = TICK_FEAT_PERIODIC | TICK_FEAT_ONESHOT | TICK_FEAT_PERCPU;
+        timer->dev.set_periodic = lapic_timer_set_periodic;
+        timer->dev.stop = lapic_timer_stop;
+        timer->dev.private_data = timer;
+    }
+    return &timer->dev;
+}
+
+/*
+ * IRQ_TIMER mask/unmask act on the calling CPU's LVT timer entry
+ */
+static void lapic_timer_mask(uint8_t irq) {
+    (void)irq;
+    lapic_timer_t* timer = &lapic_timers[smp_processor_id()];
+    timer->masked = true;
+    lapic_timer_update_lvt(timer);
+}
+
+static void lapic_timer_unmask(uint8_t irq) {
+    (void)irq;
+    lapic_timer_t* timer = &lapic_timers[smp_processor_id()];
+    timer->masked = false;
+    lapic_timer_update_lvt(timer);
+}
+
+static void lapic_timer_eoi(uint8_t irq) {
+    (void)irq;
+    lapic_eoi();
+}
+
+/* Per-CPU interrupt: no routing, every CPU has its own */
+static irq_chip_t lapic_timer_chip = {
+    .name = "lapic",
+    .mask = lapic_timer_mask,
+    .unmask = lapic_timer_unmask,
+    .eoi = lapic_timer_eoi,
+    .set_route = NULL,
+};
+
+/*
+ * Local APIC error interrupt
+ */
+static void lapic_error_handler(cpu_context_t* context) {
+    (void)context;
+
+    lapic_write(APIC_REG_ESR, 0);
+    uint32_t esr = lapic_read(APIC_REG_ESR);
+    lapic_error_count++;
+
+    kernel_printf("APIC error on CPU %u: ESR %x\n", smp_processor_id(), esr);
+}
+
+/*
+ * Spurious interrupt (no EOI)
+ */
+static void lapic_spurious_handler(cpu_context_t* context) {
+    (void)context;
+}
+
+/*
+ * Walk the MADT: CPUs, IOAPICs and ISA overrides
+ */
+static uint32_t parse_madt(acpi_madt_t* madt) {
+    uint8_t* entry = madt->entries;
+    uint8_t* end = (uint8_t*)madt + madt->header.length;
+    uint32_t cpus = 0;
+
+    lapic_phys = madt->lapic_address;
+
+    while (entry + sizeof(acpi_madt_entry_t) <= end) {
+        acpi_madt_entry_t* header = (acpi_madt_entry_t*)entry;
+        if (header->length < sizeof(acpi_madt_entry_t) || entry + header->length > end) {
+            break;
+        }
+
+        switch (header->type) {
+            case ACPI_MADT_LAPIC: {
+                acpi_madt_lapic_t* lapic = (acpi_madt_lapic_t*)header;
+                if (lapic->flags & (ACPI_MADT_ENABLED | ACPI_MADT_ONLINE_CAPABLE)) {
+                    cpu_add(lapic->apic_id);
+                    cpus++;
+                }
+                break;
+            }
+            case ACPI_MADT_X2APIC: {
+                acpi_madt_x2apic_t* x2apic = (acpi_madt_x2apic_t*)header;
+                if (x2apic->flags & (ACPI_MADT_ENABLED | ACPI_MADT_ONLINE_CAPABLE)) {
+                    cpu_add(x2apic->x2apic_id);
+                    cpus++;
+                }
+                break;
+            }
+            case ACPI_MADT_IOAPIC: {
+                acpi_madt_ioapic_t* ioapic = (acpi_madt_ioapic_t*)header;
+                ioapic_register(ioapic->ioapic_id, ioapic->address, ioapic->gsi_base);
+                break;
+            }
+            case ACPI_MADT_INT_OVERRIDE: {
+                acpi_madt_override_t* override = (acpi_madt_override_t*)header;
+                ioapic_set_isa_override(override->source, override->gsi, override->flags);
+                break;
+            }
+            case ACPI_MADT_LAPIC_OVERRIDE: {
+                acpi_madt_lapic_override_t* override = (acpi_madt_lapic_override_t*)header;
+                lapic_phys = override->address;
+                break;
+            }
+            default:
+                break;
+        }
+
+        entry += header->length;
+    }
+
+    return cpus;
+}
+
+/*
+ * Switch interrupt delivery from the 8259 PIC to the APICs
+ */
+void init_apic(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_APIC)) {
+        kernel_printf("No local APIC, using the 8259 PIC\n");
+        return;
+    }
+
+    if (!init_acpi()) {
+        kernel_printf("No ACPI tables, using the 8259 PIC\n");
+        return;
+    }
+
+    acpi_madt_t* madt = (acpi_madt_t*)acpi_find_table("APIC", 0);
+    if (!madt) {
+        kernel_printf("No MADT, using the 8259 PIC\n");
+        return;
+    }
+
+    uint32_t cpus = parse_madt(madt);
+    if (ioapic_count() == 0) {
+        kernel_printf("No IOAPIC in the MADT, using the 8259 PIC\n");
+        return;
+    }
+
+    x2apic_mode = (ecx & CPUID_ECX_X2APIC) != 0;
+    if (!x2apic_mode) {
+        lapic_regs = (volatile uint32_t*)ioremap(lapic_phys, PAGE_SIZE);
+        if (!lapic_regs) {
+            kernel_printf("Cannot map the local APIC, using the 8259 PIC\n");
+            return;
+        }
+    }
+
+    uint64_t flags = local_irq_save();
+
+    // Systems with PIC mode wired through the IMCR must be switched over
+    if (madt->flags & ACPI_MADT_PCAT_COMPAT) {
+        outb(IMCR_SELECT_PORT, IMCR_SELECT);
+        outb(IMCR_DATA_PORT, IMCR_APIC_MODE);
+    }
+
+    apic_present = true;
+    lapic_init_local();
+    lapic_timer_calibrate();
+
+    register_isr_handler(INT_VECTOR_APIC_ERROR, lapic_error_handler);
+    register_isr_handler(INT_VECTOR_SPURIOUS, lapic_spurious_handler);
+
+    irq_disable_pic();
+    int isa = ioapic_setup_isa_irqs();
+
+    // The scheduler tick comes from each CPU's own APIC timer
+    irq_set_chip(IRQ_TIMER, &lapic_timer_chip, 0, NULL, INT_VECTOR_LOCAL_TIMER);
+
+    local_irq_restore(flags);
+
+    cpu_register_ipi_sender(lapic_send_ipi);
+
+    kernel_printf("APIC: %s mode, %u CPUs, %u IOAPICs, %d ISA IRQs routed\n",
+                  x2apic_mode ? "x2APIC" : "xAPIC", cpus, ioapic_count(), isa);
+}
@@ -0,0 +1,655 @@
+/*
+ * EdgeX OS - Block Buffer Cache
+ *
+ * This file implements the buffer cache over virtio-blk. Every buffer
+ * sits on the LRU list; the least recently used one that is unreferenced,
+ * clean and idle is reused on a miss. Reads and writes complete in the
+ * BLOCK softirq and wake the tasks waiting on the buffer. The flusher task
+ * writes dirty blocks back once they are old enough or a cache is
+ * filling up, in block order and with one doorbell per batch.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/scheduler.h>
+#include <edgex/ipc.h>
+#include <edgex/virtio_blk.h>
+#include <edgex/bcache.h>
+
+#define BCACHE_MAX_CACHES   VIRTIO_BLK_MAX_DEVICES
+#define BCACHE_NO_BLOCK     (~0ULL)
+
+static bcache_t bcaches[BCACHE_MAX_CACHES];
+static volatile uint32_t nr_bcaches;
+static pid_t bcache_flusher_pid;
+
+/*
+ * Hash bucket of a block
+ */
+static inline uint32_t bcache_hash(bcache_t* cache, uint64_t block) {
+    return (uint32_t)((block * 0x9E3779B97F4A7C15ULL) >> 32) & cache->hash_mask;
+}
+
+/*
+ * Find a cached block (lock held)
+ */
+static bcache_buf_t* bcache_lookup(bcache_t* cache, uint64_t block) {
+    bcache_buf_t* buf = cache->hash[bcache_hash(cache, block)];
+
+    while (buf && buf->block != block) {
+        buf = buf->hash_next;
+    }
+    return buf;
+}
+
+static void bcache_hash_insert(bcache_t* cache, bcache_buf_t* buf) {
+    uint32_t bucket = bcache_hash(cache, buf->block);
+
+    buf->hash_next = cache->hash[bucket];
+    cache->hash[bucket] = buf;
+}
+
+static void bcache_hash_remove(bcache_t* cache, bcache_buf_t* buf) {
+    bcache_buf_t** link = &cache->hash[bcache_hash(cache, buf->block)];
+
+    while (*link && *link != buf) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = buf->hash_next;
+    }
+    buf->block = BCACHE_NO_BLOCK;
+}
+
+/*
+ * Move a buffer to the most recently used end (lock held)
+ */
+static void bcache_lru_touch(bcache_t* cache, bcache_buf_t* buf) {
+    if (cache->lru_tail == buf) {
+        return;
+    }
+
+    // Unlink
+    if (buf->lru_prev) {
+        buf->lru_prev->lru_next = buf->lru_next;
+    } else {
+        cache->lru_head = buf->lru_next;
+    }
+    buf->lru_next->lru_prev = buf->lru_prev;
+
+    // Append
+    buf->lru_prev = cache->lru_tail;
+    buf->lru_next = NULL;
+    cache->lru_tail->lru_next = buf;
+    cache->lru_tail = buf;
+}
+
+/*
+ * Take the least recently used idle buffer for a block (lock held)
+ *
+ * Returns NULL if every buffer is in use, dirty or under I/O.
+ */
+static bcache_buf_t* bcache_reuse(bcache_t* cache, uint64_t block) {
+    bcache_buf_t* buf = cache->lru_head;
+
+    while (buf && (buf->refcount || (buf->flags & (BCACHE_DIRTY | BCACHE_READING | BCACHE_WRITING)))) {
+        buf = buf->lru_next;
+    }
+    if (!buf) {
+        return NULL;
+    }
+
+    if (buf->block != BCACHE_NO_BLOCK) {
+        bcache_hash_remove(cache, buf);
+        cache->stats.evictions++;
+    }
+    buf->block = block;
+    buf->flags = 0;
+    bcache_hash_insert(cache, buf);
+    bcache_lru_touch(cache, buf);
+    return buf;
+}
+
+/*
+ * Wake the tasks waiting on a buffer, or on any completion (lock held)
+ */
+static void bcache_wake(bcache_t* cache, bcache_buf_t* buf) {
+    bcache_waiter_t** link = &cache->waiters;
+
+    while (*link) {
+        bcache_waiter_t* w = *link;
+        if (w->buf == buf || w->buf == NULL) {
+            *link = w->next;
+            unblock_task(w->pid);
+        } else {
+            link = &w->next;
+        }
+    }
+}
+
+/*
+ * Block until cond holds, checking it under the lock
+ *
+ * A NULL buf waits for any completion.
+ */
+static void bcache_wait(bcache_t* cache, bcache_buf_t* buf,
+                        bool (*cond)(bcache_t* cache, bcache_buf_t* buf, void* arg), void* arg) {
+    bcache_waiter_t w = { .buf = buf, .pid = get_current_pid() };
+    uint64_t flags;
+
+    for (;;) {
+        // Blocked before the check, so a completion in between is not lost
+        prepare_to_block();
+
+        spin_lock_irqsave(&cache->lock, flags);
+        if (cond(cache, buf, arg)) {
+            spin_unlock_irqrestore(&cache->lock, flags);
+            cancel_block();
+            return;
+        }
+        w.next = cache->waiters;
+        cache->waiters = &w;
+        spin_unlock_irqrestore(&cache->lock, flags);
+
+        schedule();
+    }
+}
+
+static bool bcache_read_done(bcache_t* cache, bcache_buf_t* buf, void* arg) {
+    (void)cache;
+    (void)arg;
+    return !(buf->flags & BCACHE_READING);
+}
+
+static bool bcache_writes_done(bcache_t* cache, bcache_buf_t* buf, void* arg) {
+    (void)buf;
+    (void)arg;
+    return cache->nr_writing == 0;
+}
+
+static bool bcache_progress(bcache_t* cache, bcache_buf_t* buf, void* arg) {
+    (void)buf;
+    return cache->completions != *(uint64_t*)arg;
+}
+
+/*
+ * Read or write completion (BLOCK softirq)
+ */
+static void bcache_io_done(blk_request_t* req) {
+    bcache_buf_t* buf = (bcache_buf_t*)req->priv;
+    bcache_t* cache = buf->cache;
+    uint64_t flags;
+
+    spin_lock_irqsave(&cache->lock, flags);
+    if (req->op == BLK_OP_READ) {
+        if (req->status == 0) {
+            buf->flags |= BCACHE_VALID;
+        } else {
+            buf->flags |= BCACHE_ERROR;
+            cache->stats.read_errors++;
+        }
+        buf->flags &= ~BCACHE_READING;
+    } else {
+        buf->flags &= ~BCACHE_WRITING;
+        cache->nr_writing--;
+        cache->stats.writebacks++;
+
+        // Keep the data dirty so the next flush retries it
+        if (req->status != 0) {
+            cache->stats.write_errors++;
+            if (!(buf->flags & BCACHE_DIRTY)) {
+                buf->flags |= BCACHE_DIRTY;
+                buf->dirtied = get_tick_count();
+                cache->nr_dirty++;
+            }
+        }
+    }
+    cache->completions++;
+    bcache_wake(cache, buf);
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Send a buffer's request to the device
+ */
+static void bcache_submit(bcache_buf_t* buf, uint32_t op, bool more) {
+    blk_request_t* req = &buf->req;
+
+    req->op = op;
+    req->sector = buf->block * BCACHE_BLOCK_SECTORS;
+    req->nr_sectors = BCACHE_BLOCK_SECTORS;
+    req->phys = (uint64_t)buf->data;   // Identity-mapped page
+    req->cq = NULL;
+    req->done = bcache_io_done;
+    req->priv = buf;
+
+    if (virtio_blk_submit(buf->cache->blk, req, more) < 0) {
+        req->status = -1;
+        bcache_io_done(req);
+    }
+}
+
+/*
+ * Write dirty blocks back in block order
+ *
+ * All dirty blocks go out as one batch: the driver merges runs of
+ * adjacent blocks into single requests and rings the doorbell once.
+ */
+static void bcache_writeback(bcache_t* cache) {
+    bcache_buf_t* batch = NULL;
+    uint32_t count = 0;
+    uint64_t flags;
+
+    spin_lock_irqsave(&cache->lock, flags);
+    for (uint32_t i = 0; i < cache->nr_bufs; i++) {
+        bcache_buf_t* buf = &cache->bufs[i];
+        if ((buf->flags & (BCACHE_DIRTY | BCACHE_WRITING)) != BCACHE_DIRTY) {
+            continue;
+        }
+
+        // Data changed during the write gets dirty again and goes in the next batch
+        buf->flags = (buf->flags & ~BCACHE_DIRTY) | BCACHE_WRITING;
+        cache->nr_dirty--;
+        cache->nr_writing++;
+
+        // Insertion into a list sorted by block
+        bcache_buf_t** link = &batch;
+        while (*link && (*link)->block < buf->block) {
+            link = &(*link)->dirty_next;
+        }
+        buf->dirty_next = *link;
+        *link = buf;
+        count++;
+    }
+    if (count) {
+        cache->stats.flushes++;
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+
+    while (batch) {
+        bcache_buf_t* buf = batch;
+        batch = buf->dirty_next;
+        bcache_submit(buf, BLK_OP_WRITE, batch != NULL);
+    }
+}
+
+/*
+ * Read ahead of a sequential reader
+ *
+ * Called with the block just missed or hit; issues reads for the next
+ * window once the reader is halfway through the previous one.
+ */
+static void bcache_readahead(bcache_t* cache, uint64_t block) {
+    bcache_buf_t* batch = NULL;
+    bcache_buf_t** tail = &batch;
+    uint64_t flags;
+
+    spin_lock_irqsave(&cache->lock, flags);
+    if (block != cache->ra_next) {
+        // Random access: start over
+        cache->ra_next = block + 1;
+        cache->ra_end = block + 1;
+        cache->ra_window = BCACHE_RA_MIN;
+        spin_unlock_irqrestore(&cache->lock, flags);
+        return;
+    }
+    cache->ra_next = block + 1;
+    if (block + cache->ra_window / 2 < cache->ra_end) {
+        spin_unlock_irqrestore(&cache->lock, flags);
+        return;
+    }
+
+    uint64_t start = cache->ra_end > block + 1 ? cache->ra_end : block + 1;
+    uint64_t end = start + cache->ra_window;
+    if (end > cache->nr_blocks) {
+        end = cache->nr_blocks;
+    }
+
+    for (uint64_t b = start; b < end; b++) {
+        if (bcache_lookup(cache, b)) {
+            continue;
+        }
+        bcache_buf_t* buf = bcache_reuse(cache, b);
+        if (!buf) {
+            end = b;
+            break;
+        }
+        buf->flags = BCACHE_READING | BCACHE_READAHEAD;
+        buf->dirty_next = NULL;
+        *tail = buf;
+        tail = &buf->dirty_next;
+        cache->stats.readahead++;
+    }
+    cache->ra_end = end;
+    if (cache->ra_window < BCACHE_RA_MAX) {
+        cache->ra_window *= 2;
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+
+    while (batch) {
+        bcache_buf_t* buf = batch;
+        batch = buf->dirty_next;
+        bcache_submit(buf, BLK_OP_READ, batch != NULL);
+    }
+}
+
+/*
+ * Get a referenced buffer for a block, reusing an idle one on a miss
+ *
+ * A reused buffer starts with miss_flags and *miss set. Writes back and
+ * waits when every buffer is busy.
+ */
+static bcache_buf_t* bcache_grab(bcache_t* cache, uint64_t block, uint32_t miss_flags, bool* miss) {
+    uint64_t flags;
+
+    for (;;) {
+        spin_lock_irqsave(&cache->lock, flags);
+        bcache_buf_t* buf = bcache_lookup(cache, block);
+        if (buf) {
+            buf->refcount++;
+            bcache_lru_touch(cache, buf);
+            if (buf->flags & BCACHE_READAHEAD) {
+                buf->flags &= ~BCACHE_READAHEAD;
+                cache->stats.readahead_hits++;
+            }
+            cache->stats.hits++;
+            spin_unlock_irqrestore(&cache->lock, flags);
+            *miss = false;
+            return buf;
+        }
+
+        buf = bcache_reuse(cache, block);
+        if (buf) {
+            buf->refcount = 1;
+            buf->flags = miss_flags;
+            cache->stats.misses++;
+            spin_unlock_irqrestore(&cache->lock, flags);
+            *miss = true;
+            return buf;
+        }
+        uint64_t seen = cache->completions;
+        bool writing = cache->nr_writing > 0;
+        spin_unlock_irqrestore(&cache->lock, flags);
+
+        // Everything is dirty or busy: make clean buffers and wait for one
+        bcache_writeback(cache);
+        if (writing || cache->nr_writing > 0) {
+            bcache_wait(cache, NULL, bcache_progress, &seen);
+        } else {
+            sleep_task(1);
+        }
+    }
+}
+
+/*
+ * Get a block with its data read in
+ */
+bcache_buf_t* bcache_read(bcache_t* cache, uint64_t block) {
+    bool miss;
+    uint64_t flags;
+
+    if (block >= cache->nr_blocks) {
+        return NULL;
+    }
+
+    bcache_buf_t* buf = bcache_grab(cache, block, BCACHE_READING, &miss);
+    bool submit = miss;
+
+    // Retry a block whose last read failed
+    if (!miss && (buf->flags & BCACHE_ERROR)) {
+        spin_lock_irqsave(&cache->lock, flags);
+        if (!(buf->flags & BCACHE_READING)) {
+            buf->flags = (buf->flags & ~BCACHE_ERROR) | BCACHE_READING;
+            submit = true;
+        }
+        spin_unlock_irqrestore(&cache->lock, flags);
+    }
+
+    // Readahead rides on the same doorbell
+    if (submit) {
+        bcache_submit(buf, BLK_OP_READ, true);
+    }
+    bcache_readahead(cache, block);
+    virtio_blk_unplug(cache->blk);
+
+    if (buf->flags & BCACHE_READING) {
+        bcache_wait(cache, buf, bcache_read_done, NULL);
+    }
+
+    if (buf->flags & BCACHE_ERROR) {
+        bcache_release(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+/*
+ * Get a block without reading it
+ */
+bcache_buf_t* bcache_get(bcache_t* cache, uint64_t block) {
+    bool miss;
+    uint64_t flags;
+
+    if (block >= cache->nr_blocks) {
+        return NULL;
+    }
+
+    bcache_buf_t* buf = bcache_grab(cache, block, BCACHE_VALID, &miss);
+    if (!miss && (buf->flags & BCACHE_READING)) {
+        // Let a read in flight land before the caller overwrites the data
+        bcache_wait(cache, buf, bcache_read_done, NULL);
+    }
+
+    spin_lock_irqsave(&cache->lock, flags);
+    buf->flags = (buf->flags & ~BCACHE_ERROR) | BCACHE_VALID;
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return buf;
+}
+
+/*
+ * Mark a buffer's data changed
+ */
+void bcache_mark_dirty(bcache_buf_t* buf) {
+    bcache_t* cache = buf->cache;
+    uint64_t flags;
+
+    spin_lock_irqsave(&cache->lock, flags);
+    if (!(buf->flags & BCACHE_DIRTY)) {
+        buf->flags |= BCACHE_DIRTY | BCACHE_VALID;
+        buf->dirtied = get_tick_count();
+        cache->nr_dirty++;
+    }
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Drop a reference
+ */
+void bcache_release(bcache_buf_t* buf) {
+    bcache_t* cache = buf->cache;
+    uint64_t flags;
+
+    spin_lock_irqsave(&cache->lock, flags);
+    buf->refcount--;
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Flush request completion (BLOCK softirq)
+ */
+static void bcache_flush_done(blk_request_t* req) {
+    bcache_t* cache = (bcache_t*)req->priv;
+    uint64_t flags;
+
+    spin_lock_irqsave(&cache->lock, flags);
+    req->priv = NULL;
+    bcache_wake(cache, NULL);
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+static bool bcache_flush_finished(bcache_t* cache, bcache_buf_t* buf, void* arg) {
+    (void)cache;
+    (void)buf;
+    return ((blk_request_t*)arg)->priv == NULL;
+}
+
+/*
+ * Write all dirty blocks and flush the device's write cache
+ */
+int bcache_sync(bcache_t* cache) {
+    uint64_t errors = cache->stats.write_errors;
+
+    // Blocks dirtied again while being written need another pass
+    for (int pass = 0; pass < 3 && (cache->nr_dirty > 0 || cache->nr_writing > 0); pass++) {
+        bcache_writeback(cache);
+        bcache_wait(cache, NULL, bcache_writes_done, NULL);
+    }
+
+    blk_request_t req = {
+        .op = BLK_OP_FLUSH,
+        .done = bcache_flush_done,
+        .priv = cache,
+    };
+    if (virtio_blk_submit(cache->blk, &req, false) < 0) {
+        return -1;
+    }
+    bcache_wait(cache, NULL, bcache_flush_finished, &req);
+
+    return req.status == 0 && cache->stats.write_errors == errors && cache->nr_dirty == 0 ? 0 : -1;
+}
+
+/*
+ * Drop every unused clean buffer
+ */
+void bcache_invalidate(bcache_t* cache) {
+    uint64_t flags;
+
+    spin_lock_irqsave(&cache->lock, flags);
+    for (uint32_t i = 0; i < cache->nr_bufs; i++) {
+        bcache_buf_t* buf = &cache->bufs[i];
+        if (buf->block != BCACHE_NO_BLOCK && buf->refcount == 0 &&
+            !(buf->flags & (BCACHE_DIRTY | BCACHE_READING | BCACHE_WRITING))) {
+            bcache_hash_remove(cache, buf);
+            buf->flags = 0;
+        }
+    }
+    cache->ra_next = BCACHE_NO_BLOCK;
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Flusher task: write back old dirty data, or early when a cache is
+ * filling up with it
+ */
+static void bcache_flusher(void) {
+    while (1) {
+        sleep_task(BCACHE_FLUSH_PERIOD_MS);
+
+        for (uint32_t c = 0; c < nr_bcaches; c++) {
+            bcache_t* cache = &bcaches[c];
+            if (cache->nr_dirty == 0) {
+                continue;
+            }
+
+            bool flush = cache->nr_dirty >= cache->nr_bufs / BCACHE_DIRTY_RATIO;
+            uint64_t now = get_tick_count();
+            for (uint32_t i = 0; i < cache->nr_bufs && !flush; i++) {
+                bcache_buf_t* buf = &cache->bufs[i];
+                flush = (buf->flags & BCACHE_DIRTY) && now - buf->dirtied >= BCACHE_WRITEBACK_MS;
+            }
+
+            if (flush) {
+                bcache_writeback(cache);
+            }
+        }
+    }
+}
+
+/*
+ * Create a cache over a device
+ */
+bcache_t* bcache_create(virtio_blk_t* blk, uint32_t nr_buffers) {
+    if (!blk || nr_bcaches >= BCACHE_MAX_CACHES) {
+        return NULL;
+    }
+    if (nr_buffers == 0) {
+        nr_buffers = BCACHE_DEFAULT_BUFFERS;
+    }
+
+    bcache_t* cache = &bcaches[nr_bcaches];
+    memset(cache, 0, sizeof(*cache));
+    cache->blk = blk;
+    cache->id = nr_bcaches;
+    cache->nr_blocks = blk->capacity / BCACHE_BLOCK_SECTORS;
+    cache->nr_bufs = nr_buffers;
+    cache->lock = (spinlock_t)SPINLOCK_INIT;
+    cache->ra_next = BCACHE_NO_BLOCK;
+    cache->ra_window = BCACHE_RA_MIN;
+
+    uint32_t buckets = 1;
+    while (buckets < nr_buffers) {
+        buckets <<= 1;
+    }
+    cache->hash_mask = buckets - 1;
+    cache->hash = (bcache_buf_t**)kzalloc(buckets * sizeof(bcache_buf_t*));
+    cache->bufs = (bcache_buf_t*)kzalloc(nr_buffers * sizeof(bcache_buf_t));
+    if (!cache->hash || !cache->bufs) {
+        LOG_ERROR("bcache%u: out of memory", cache->id);
+        return NULL;
+    }
+
+    // Tasks map the pool read-only and find block data by buffer index
+    strncpy(cache->name, "bcache0", sizeof(cache->name) - 1);
+    cache->name[6] = (char)('0' + cache->id);
+    cache->shm = create_shared_memory(cache->name, (size_t)nr_buffers * BCACHE_BLOCK_SIZE,
+                                      SHM_PERM_READ, SHM_FLAG_CREATE);
+
+    for (uint32_t i = 0; i < nr_buffers; i++) {
+        bcache_buf_t* buf = &cache->bufs[i];
+
+        if (cache->shm) {
+            buf->data = (uint8_t*)(uintptr_t)shared_memory_phys(cache->shm,
+                                                                (size_t)i * BCACHE_BLOCK_SIZE);
+        } else {
+            buf->data = (uint8_t*)alloc_page();
+        }
+        if (!buf->data) {
+            LOG_ERROR("bcache%u: out of memory", cache->id);
+            return NULL;
+        }
+
+        buf->cache = cache;
+        buf->index = i;
+        buf->block = BCACHE_NO_BLOCK;
+        buf->lru_prev = i > 0 ? &cache->bufs[i - 1] : NULL;
+        buf->lru_next = i + 1 < nr_buffers ? &cache->bufs[i + 1] : NULL;
+    }
+    cache->lru_head = &cache->bufs[0];
+    cache->lru_tail = &cache->bufs[nr_buffers - 1];
+
+    nr_bcaches++;
+    if (!bcache_flusher_pid) {
+        bcache_flusher_pid = create_kernel_task("bcached", bcache_flusher, TASK_PRIORITY_NORMAL);
+    }
+
+    kernel_printf("bcache%u: %u buffers (%u KB) over virtio-blk%u%s\n", cache->id, nr_buffers,
+                  nr_buffers * (BCACHE_BLOCK_SIZE / 1024), blk->id,
+                  cache->shm ? "" : ", not shared (no shared memory)");
+    return cache;
+}
+
+/*
+ * Print counters
+ */
+void dump_bcache_stats(bcache_t* cache) {
+    bcache_stats_t* s = &cache->stats;
+    uint64_t lookups = s->hits + s->misses;
+
+    kernel_printf("bcache%u: %llu hits, %llu misses (%llu%% hit rate), %llu evictions\n",
+                  cache->id, s->hits, s->misses, lookups ? s->hits * 100 / lookups : 0,
+                  s->evictions);
+    kernel_printf("         readahead %llu blocks, %llu used; write-back %llu blocks in %llu "
+                  "batches; %u dirty; errors %llu read, %llu write\n",
+                  s->readahead, s->readahead_hits, s->writebacks, s->flushes, cache->nr_dirty,
+                  s->read_errors, s->write_errors);
+}
@@ -0,0 +1,330 @@
+/*
+ * EdgeX OS - Per-CPU State
+ *
+ * This file manages the per-CPU data blocks, CPU enumeration, and the
+ * boot-time CPU isolation policy (isolcpus= and nohz_full=).
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+/* Per-CPU data blocks, indexed by logical CPU ID */
+static cpu_t cpus[MAX_CPUS];
+static uint32_t cpu_count = 0;
+
+/* CPU masks */
+static cpumask_t present_mask = CPU_MASK_NONE;
+static cpumask_t online_mask = CPU_MASK_NONE;
+static cpumask_t isolated_mask = CPU_MASK_NONE;   /* From isolcpus= */
+static cpumask_t nohz_full_mask = CPU_MASK_NONE;  /* From nohz_full= */
+
+/* IPI transport, registered by the interrupt controller driver */
+static ipi_send_fn_t ipi_send_fn = NULL;
+
+/*
+ * Apply the isolation policy to a CPU's flags
+ */
+static void apply_isolation_flags(cpu_t* cpu) {
+    cpu->flags &= ~(CPU_FLAG_ISOLATED | CPU_FLAG_NOHZ_FULL);
+
+    // The boot CPU keeps timekeeping and housekeeping duties
+    if (cpu->id == BOOT_CPU_ID) {
+        return;
+    }
+
+    if (cpumask_test(isolated_mask, cpu->id)) {
+        cpu->flags |= CPU_FLAG_ISOLATED;
+    }
+    if (cpumask_test(nohz_full_mask, cpu->id)) {
+        cpu->flags |= CPU_FLAG_NOHZ_FULL;
+    }
+}
+
+/*
+ * Initialize the boot CPU's per-CPU block and point GS at it
+ */
+void init_boot_cpu(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    memset(cpus, 0, sizeof(cpus));
+    cpu_count = 0;
+    present_mask = CPU_MASK_NONE;
+    online_mask = CPU_MASK_NONE;
+
+    // Initial APIC ID of the boot processor is in CPUID.1:EBX[31:24]
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+    cpu_t* cpu = cpu_add(ebx >> 24);
+    cpu_init_local(cpu);
+
+    kernel_printf("Boot CPU %u (APIC ID %u) initialized\n", cpu->id, cpu->apic_id);
+}
+
+/*
+ * Register a CPU discovered by firmware enumeration
+ *
+ * Returns the existing entry if the APIC ID is already known.
+ */
+cpu_t* cpu_add(uint32_t apic_id) {
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        if (cpus[i].apic_id == apic_id) {
+            return &cpus[i];
+        }
+    }
+
+    if (cpu_count >= MAX_CPUS) {
+        kernel_printf("Ignoring CPU with APIC ID %u: MAX_CPUS reached\n", apic_id);
+        return NULL;
+    }
+
+    cpu_t* cpu = &cpus[cpu_count];
+    cpu->self = cpu;
+    cpu->id = cpu_count;
+    cpu->apic_id = apic_id;
+    cpu->flags = CPU_FLAG_PRESENT;
+    apply_isolation_flags(cpu);
+
+    cpumask_set(&present_mask, cpu->id);
+    cpu_count++;
+
+    return cpu;
+}
+
+/*
+ * Bring the calling CPU online using the given per-CPU block
+ */
+void cpu_init_local(cpu_t* cpu) {
+    if (!cpu) {
+        return;
+    }
+
+    wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+    wrmsr(MSR_KERNEL_GS_BASE, 0);
+
+    cpu->flags |= CPU_FLAG_ONLINE;
+    cpumask_set(&online_mask, cpu->id);
+}
+
+/*
+ * Parse one CPU number, rejecting numbers past the mask
+ */
+static bool parse_cpu_number(const char** str, uint32_t* value) {
+    const char* p = *str;
+    uint32_t v = 0;
+
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    while (*p >= '0' && *p <= '9') {
+        v = v * 10 + (uint32_t)(*p++ - '0');
+        if (v >= MAX_CPUS) {
+            return false;
+        }
+    }
+
+    *str = p;
+    *value = v;
+    return true;
+}
+
+/*
+ * Parse a CPU list such as "1-3,6" into a mask
+ *
+ * The list runs to the end of the command line word. A malformed list
+ * (an empty entry, "1-", a reversed range like "3-1" or a CPU past
+ * MAX_CPUS) is ignored as a whole and leaves the mask empty. Returns
+ * the end of the word.
+ */
+static const char* parse_cpu_list(const char* str, cpumask_t* mask) {
+    cpumask_t result = CPU_MASK_NONE;
+    const char* p = str;
+    bool valid = true;
+
+    while (1) {
+        uint32_t first;
+        uint32_t last;
+
+        if (!parse_cpu_number(&p, &first)) {
+            valid = false;
+            break;
+        }
+        last = first;
+
+        if (*p == '-') {
+            p++;
+            if (!parse_cpu_number(&p, &last) || last < first) {
+                valid = false;
+                break;
+            }
+        }
+
+        for (uint32_t cpu = first; cpu <= last; cpu++) {
+            cpumask_set(&result, cpu);
+        }
+
+        if (*p != ',') {
+            break;
+        }
+        p++;
+    }
+
+    if (*p && *p != ' ') {
+        valid = false;
+    }
+    while (*p && *p != ' ') {
+        p++;
+    }
+
+    if (!valid) {
+        kernel_printf("Ignoring malformed CPU list \"%.*s\"\n", (int)(p - str), str);
+        result = CPU_MASK_NONE;
+    }
+
+    *mask = result;
+    return p;
+}
+
+/*
+ * Check whether a command line word starts with the given option name
+ */
+static bool option_matches(const char* word, const char* option) {
+    while (*option) {
+        if (*word++ != *option++) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Parse CPU isolation options from the kernel command line
+ *
+ *   isolcpus=<list>   Exclude CPUs from task placement, load balancing
+ *                     and kernel housekeeping work
+ *   nohz_full=<list>  Stop the periodic tick on these CPUs whenever they
+ *                     run a single task
+ */
+void cpu_parse_cmdline(const char* cmdline) {
+    if (!cmdline) {
+        return;
+    }
+
+    const char* p = cmdline;
+    while (*p) {
+        while (*p == ' ') {
+            p++;
+        }
+
+        if (option_matches(p, "isolcpus=")) {
+            p = parse_cpu_list(p + 9, &isolated_mask);
+        } else if (option_matches(p, "nohz_full=")) {
+            p = parse_cpu_list(p + 10, &nohz_full_mask);
+        } else {
+            while (*p && *p != ' ') {
+                p++;
+            }
+        }
+    }
+
+    if (cpumask_test(isolated_mask | nohz_full_mask, BOOT_CPU_ID)) {
+        kernel_printf("CPU %u is the housekeeping CPU and cannot be isolated\n", BOOT_CPU_ID);
+        cpumask_clear(&isolated_mask, BOOT_CPU_ID);
+        cpumask_clear(&nohz_full_mask, BOOT_CPU_ID);
+    }
+
+    // CPUs may already have been enumerated, refresh their flags
+    for (uint32_t i = 0; i < cpu_count; i++) {
+        apply_isolation_flags(&cpus[i]);
+    }
+
+    if (isolated_mask || nohz_full_mask) {
+        kernel_printf("CPU isolation: isolcpus=0x%llx nohz_full=0x%llx\n",
+                      (unsigned long long)isolated_mask, (unsigned long long)nohz_full_mask);
+    }
+}
+
+/*
+ * Get the per-CPU block for a logical CPU
+ */
+cpu_t* get_cpu(uint32_t id) {
+    if (id >= cpu_count) {
+        return NULL;
+    }
+    return &cpus[id];
+}
+
+/*
+ * Get the number of online CPUs
+ */
+uint32_t num_online_cpus(void) {
+    return cpumask_weight(online_mask);
+}
+
+/*
+ * Get the mask of online CPUs
+ */
+cpumask_t cpu_online_mask(void) {
+    return online_mask;
+}
+
+/*
+ * Get the mask of online CPUs that may run housekeeping work
+ * and unpinned tasks
+ */
+cpumask_t housekeeping_mask(void) {
+    cpumask_t mask = online_mask & ~isolated_mask;
+
+    // Never leave the system without a housekeeping CPU
+    if (mask == CPU_MASK_NONE) {
+        mask = cpumask_of(BOOT_CPU_ID);
+    }
+    return mask;
+}
+
+/*
+ * Pick a housekeeping CPU, preferring the caller's own CPU
+ */
+uint32_t housekeeping_any_cpu(void) {
+    cpumask_t mask = housekeeping_mask();
+    uint32_t self = smp_processor_id();
+
+    if (cpumask_test(mask, self)) {
+        return self;
+    }
+    return cpumask_first(mask);
+}
+
+/*
+ * Check whether a CPU is isolated from housekeeping and load balancing
+ */
+bool cpu_is_isolated(uint32_t cpu) {
+    return cpu < cpu_count && (cpus[cpu].flags & CPU_FLAG_ISOLATED);
+}
+
+/*
+ * Check whether a CPU runs in full tickless mode
+ */
+bool cpu_is_nohz_full(uint32_t cpu) {
+    return cpu < cpu_count && (cpus[cpu].flags & CPU_FLAG_NOHZ_FULL);
+}
+
+/*
+ * Register the function used to deliver inter-processor interrupts
+ */
+void cpu_register_ipi_sender(ipi_send_fn_t fn) {
+    ipi_send_fn = fn;
+}
+
+/*
+ * Send an IPI to a logical CPU
+ *
+ * Returns false if no IPI transport is available or the CPU is offline.
+ */
+bool cpu_send_ipi(uint32_t cpu, uint8_t vector) {
+    if (!ipi_send_fn || !cpumask_test(online_mask, cpu)) {
+        return false;
+    }
+
+    ipi_send_fn(cpus[cpu].apic_id, vector);
+    return true;
+}
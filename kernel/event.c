@@ -9,6 +9,8 @@
 #include <edgex/memory.h>
 #include <edgex/scheduler.h>
 #include <edgex/ipc.h>
+#include <edgex/ipc/latency.h>
+#include <edgex/percpu.h>
 
 /* Maximum number of events in the system */
 #define MAX_EVENTS 64
@@ -45,6 +47,8 @@ struct event {
     mutex_t mutex;                   /* Synchronization mutex */
     event_waiter_t* waiters;         /* List of waiting tasks */
     uint32_t waiter_count;           /* Number of waiting tasks */
+    uint64_t signal_tsc;             /* Last signal or broadcast */
+    ipc_lat_id_t lat_id;             /* Signal-to-wake histogram (ipc/latency.h) */
 };
 
 /* Event set structure */
@@ -130,8 +134,11 @@ event_t create_event(const char* name) {
     event->state = EVENT_STATE_NONSIGNALED;
     event->waiters = NULL;
     event->waiter_count = 0;
+    event->signal_tsc = 0;
+    event->lat_id = ipc_lat_register(IPC_LAT_EVENT_WAKE, event->header.name);
     
     event_count++;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_CREATED, 1, PCPU_IPC_EVENTS, 1);
     return event;
 }
 
@@ -154,11 +161,13 @@ static void destroy_event(void* event_ptr) {
     // Unlock and destroy mutex
     mutex_unlock(event->mutex);
     destroy_mutex(event->mutex);
+    ipc_lat_unregister(event->lat_id);
     
     // Clear the event
     memset(event, 0, sizeof(struct event));
     
     event_count--;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_DESTROYED, 1, PCPU_IPC_EVENTS, -1);
 }
 
 /*
@@ -261,6 +270,8 @@ int event_timedwait(event_t event, uint64_t timeout_ms) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_EVENT_OPS);
+    
     pid_t current_pid = get_current_pid();
     int result = 0;
     
@@ -289,16 +300,23 @@ int event_timedwait(event_t event, uint64_t timeout_ms) {
     
     // Event is not signaled, need to wait
     add_event_waiter(event, current_pid, timeout_ticks);
+    uint64_t wait_start = rdtsc();
     
     // Unlock the event before blocking
     mutex_unlock(event->mutex);
     
     // Block the task
     block_task(current_pid);
+    uint64_t woken = rdtsc();
     
     // When we wake up, check if the event is signaled
     mutex_lock(event->mutex);
     
+    // Woken by a signal that came while we waited, rather than a timeout
+    if (event->signal_tsc > wait_start) {
+        ipc_lat_record(event->lat_id, woken - event->signal_tsc);
+    }
+    
     // If we timed out, the event might not be signaled
     if (event->state != EVENT_STATE_SIGNALED) {
         // We timed out, remove ourselves from the waiters list
@@ -321,11 +339,14 @@ int event_signal(event_t event) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_EVENT_OPS);
+    
     // Lock the event
     mutex_lock(event->mutex);
     
     // Mark as signaled
     event->state = EVENT_STATE_SIGNALED;
+    event->signal_tsc = rdtsc();
     
     // For auto-reset events, only wake one waiter
     if (!(event->flags & EVENT_FLAG_MANUAL_RESET)) {
@@ -350,11 +371,14 @@ int event_broadcast(event_t event) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_EVENT_OPS);
+    
     // Lock the event
     mutex_lock(event->mutex);
     
     // Mark as signaled
     event->state = EVENT_STATE_SIGNALED;
+    event->signal_tsc = rdtsc();
     
     // Wake all waiters
     wake_event_waiters(event, 0);
@@ -418,6 +442,7 @@ event_set_t create_event_set(const char* name, uint32_t max_events) {
     event_set->waiter_count = 0;
     
     event_set_count++;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_CREATED, 1, PCPU_IPC_EVENT_SETS, 1);
     return event_set;
 }
 
@@ -461,6 +486,7 @@ static void destroy_event_set(void* event_set_ptr) {
     memset(event_set, 0, sizeof(struct event_set));
     
     event_set_count--;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_DESTROYED, 1, PCPU_IPC_EVENT_SETS, -1);
 }
 
 /*
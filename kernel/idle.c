@@ -0,0 +1,310 @@
+/*
+ * EdgeX OS - CPU Idle
+ *
+ * This file implements the idle driver and its governor. The idle loop
+ * advertises that it is watching need_resched (idle_polling) while it
+ * polls or sits in MWAIT, so a remote waker only has to store to that
+ * word instead of sending an IPI. CPUs without MWAIT fall back to HLT.
+ *
+ * The governor predicts the next idle period from an exponentially
+ * weighted average of past ones, capped by the next tick, and picks the
+ * deepest state whose target residency fits the prediction.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/idle.h>
+#include <edgex/tick.h>
+#include <edgex/tsc.h>
+#include <edgex/preempt.h>
+
+/* CPUID feature bits */
+#define CPUID_1_ECX_MONITOR     (1 << 3)
+#define CPUID_5_ECX_EMX         (1 << 0)   /* Leaf 5 enumerates MWAIT extensions */
+
+/* Prediction weight: new = (7 * old + sample) / 8 */
+#define IDLE_EWMA_SHIFT         3
+
+/* Longest poll window, after which the CPU goes to sleep */
+#define IDLE_POLL_MAX_NS        20000
+
+static idle_state_t idle_states[IDLE_MAX_STATES];
+static uint32_t idle_state_count = 0;
+static uint32_t idle_latency_limit_us = 0;
+static bool idle_has_mwait = false;
+
+static idle_stats_t idle_stats[MAX_CPUS];
+
+/*
+ * Arm the monitor on an address
+ */
+static inline void cpu_monitor(const volatile void* addr) {
+    __asm__ volatile("monitor" : : "a"(addr), "c"(0), "d"(0));
+}
+
+/*
+ * Enable interrupts and wait; the STI shadow closes the wakeup race
+ */
+static inline void cpu_sti_mwait(uint32_t hint) {
+    __asm__ volatile("sti; mwait" : : "a"(hint), "c"(0) : "memory");
+}
+
+static inline void cpu_sti_hlt(void) {
+    __asm__ volatile("sti; hlt" ::: "memory");
+}
+
+/*
+ * Advertise that this CPU watches need_resched
+ *
+ * The full barrier pairs with the one in idle_wake_by_store(): either the
+ * waker sees idle_polling set, or we see its need_resched store.
+ */
+static inline void idle_set_polling(cpu_t* cpu) {
+    __atomic_store_n(&cpu->idle_polling, true, __ATOMIC_SEQ_CST);
+}
+
+static inline void idle_clear_polling(cpu_t* cpu) {
+    __atomic_store_n(&cpu->idle_polling, false, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Poll need_resched for up to budget_ns
+ */
+static void idle_enter_poll(cpu_t* cpu, const idle_state_t* state, uint64_t budget_ns) {
+    (void)state; // Unused parameter
+    
+    uint64_t end = rdtsc() + ns_to_tsc(budget_ns);
+    
+    idle_set_polling(cpu);
+    while (!need_resched()) {
+        if (rdtsc() >= end) {
+            idle_stats[cpu->id].poll_timeouts++;
+            break;
+        }
+        cpu_relax();
+    }
+    idle_clear_polling(cpu);
+}
+
+/*
+ * Wait in MWAIT until need_resched is written or an interrupt arrives
+ */
+static void idle_enter_mwait(cpu_t* cpu, const idle_state_t* state, uint64_t budget_ns) {
+    (void)budget_ns; // Unused parameter
+    
+    idle_set_polling(cpu);
+    
+    cli();
+    cpu_monitor(&cpu->need_resched);
+    if (!need_resched()) {
+        cpu_sti_mwait(state->mwait_hint);
+    } else {
+        sti();
+    }
+    
+    idle_clear_polling(cpu);
+}
+
+/*
+ * Halt until the next interrupt; remote wakers must send an IPI
+ */
+static void idle_enter_hlt(cpu_t* cpu, const idle_state_t* state, uint64_t budget_ns) {
+    (void)cpu;       // Unused parameter
+    (void)state;     // Unused parameter
+    (void)budget_ns; // Unused parameter
+    
+    cli();
+    if (!need_resched()) {
+        cpu_sti_hlt();
+    } else {
+        sti();
+    }
+}
+
+/*
+ * Append a state to the table
+ */
+static void idle_add_state(const char* name, uint32_t hint, uint32_t latency_us,
+                           uint32_t residency_us,
+                           void (*enter)(cpu_t*, const idle_state_t*, uint64_t)) {
+    if (idle_state_count >= IDLE_MAX_STATES) {
+        return;
+    }
+    
+    idle_state_t* state = &idle_states[idle_state_count++];
+    state->name = name;
+    state->mwait_hint = hint;
+    state->exit_latency_us = latency_us;
+    state->target_residency_us = residency_us;
+    state->enter = enter;
+}
+
+/*
+ * Detect MONITOR/MWAIT and build the idle state table
+ *
+ * Without ACPI _CST data the latencies below are conservative defaults
+ * for the generic C1/C2/C3 MWAIT hints. Under QEMU, MWAIT is only
+ * exposed with e.g. "-cpu host -overcommit cpu-pm=on"; otherwise HLT
+ * is used.
+ */
+void init_idle(void) {
+    uint32_t eax, ebx, ecx, edx;
+    
+    idle_state_count = 0;
+    idle_has_mwait = false;
+    
+    idle_add_state("POLL", 0, 0, 0, idle_enter_poll);
+    
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+    
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if ((ecx & CPUID_1_ECX_MONITOR) && max_leaf >= 5) {
+        idle_has_mwait = true;
+        
+        // EDX[4n+3:4n] is the number of MWAIT sub-states of C(n)
+        uint32_t substates = 0;
+        cpuid(5, 0, &eax, &ebx, &ecx, &edx);
+        if (ecx & CPUID_5_ECX_EMX) {
+            substates = edx;
+        }
+        
+        idle_add_state("C1", 0x00, 2, 2, idle_enter_mwait);
+        if ((substates >> 8) & 0xF) {
+            idle_add_state("C2", 0x10, 20, 80, idle_enter_mwait);
+        }
+        if ((substates >> 12) & 0xF) {
+            idle_add_state("C3", 0x20, 100, 400, idle_enter_mwait);
+        }
+    } else {
+        idle_add_state("HLT", 0, 2, 2, idle_enter_hlt);
+    }
+    
+    kernel_printf("Idle: %s, %u states\n",
+                  idle_has_mwait ? "MONITOR/MWAIT" : "HLT", idle_state_count);
+}
+
+/*
+ * Exclude idle states whose exit latency exceeds the limit (0 = no limit)
+ */
+void idle_set_latency_limit(uint32_t latency_us) {
+    idle_latency_limit_us = latency_us;
+}
+
+/*
+ * Predict how long this CPU will stay idle
+ */
+static uint64_t idle_predict(cpu_t* cpu, idle_stats_t* stats) {
+    uint64_t predicted = stats->predicted_ns;
+    
+    // A running periodic tick ends every idle period within one tick
+    if (cpu->tick_dev && !cpu->tick_stopped) {
+        uint64_t tick_ns = 1000000000ULL / TICK_HZ;
+        if (predicted > tick_ns) {
+            predicted = tick_ns;
+        }
+    }
+    
+    return predicted;
+}
+
+/*
+ * Pick the deepest state whose target residency fits the prediction
+ */
+static uint32_t idle_select(uint64_t predicted_ns) {
+    for (uint32_t i = idle_state_count - 1; i > 0; i--) {
+        const idle_state_t* state = &idle_states[i];
+        
+        if (idle_latency_limit_us && state->exit_latency_us > idle_latency_limit_us) {
+            continue;
+        }
+        if ((uint64_t)state->target_residency_us * 1000 <= predicted_ns) {
+            return i;
+        }
+    }
+    
+    // Shorter than any sleep state pays off: poll
+    return 0;
+}
+
+/*
+ * Idle the calling CPU once
+ *
+ * Called by the idle task with preemption disabled, so the interrupt that
+ * ends the idle period does not switch away in the middle of accounting.
+ */
+void cpu_idle(void) {
+    cpu_t* cpu = this_cpu();
+    idle_stats_t* stats = &idle_stats[cpu->id];
+    
+    if (idle_state_count == 0) {
+        idle_enter_hlt(cpu, NULL, 0);
+        return;
+    }
+    
+    uint64_t predicted = idle_predict(cpu, stats);
+    uint32_t index = idle_select(predicted);
+    const idle_state_t* state = &idle_states[index];
+    
+    // Poll window; a timeout pushes the next prediction towards sleeping
+    uint64_t budget = IDLE_POLL_MAX_NS;
+    
+    uint64_t poll_timeouts = stats->poll_timeouts;
+    uint64_t start = rdtsc();
+    
+    state->enter(cpu, state, budget);
+    
+    uint64_t measured = tsc_to_ns(rdtsc() - start);
+    
+    stats->usage[index]++;
+    stats->time_ns[index] += measured;
+    
+    if (stats->poll_timeouts != poll_timeouts) {
+        // Polling did not pay off: make the next period sleep
+        uint64_t floor = idle_state_count > 1 ? idle_states[1].target_residency_us * 1000ULL : 0;
+        stats->predicted_ns = (stats->predicted_ns * 2 > floor) ? stats->predicted_ns * 2 : floor;
+    } else {
+        stats->predicted_ns = stats->predicted_ns - (stats->predicted_ns >> IDLE_EWMA_SHIFT) +
+                              (measured >> IDLE_EWMA_SHIFT);
+    }
+}
+
+/*
+ * Wake an idle CPU by storing to its need_resched word
+ */
+bool idle_wake_by_store(cpu_t* cpu) {
+    if (!__atomic_load_n(&cpu->idle_polling, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    
+    __atomic_store_n(&cpu->need_resched, true, __ATOMIC_SEQ_CST);
+    
+    // Still polling after the store: it will see it
+    return __atomic_load_n(&cpu->idle_polling, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Print the idle states and per-CPU usage
+ */
+void dump_idle_stats(void) {
+    kernel_printf("Idle states (%s):\n", idle_has_mwait ? "MWAIT" : "HLT");
+    for (uint32_t i = 0; i < idle_state_count; i++) {
+        kernel_printf("  %u: %-5s latency %u us, residency %u us\n", i,
+                      idle_states[i].name, idle_states[i].exit_latency_us,
+                      idle_states[i].target_residency_us);
+    }
+    
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpumask_test(cpu_online_mask(), cpu)) {
+            continue;
+        }
+        
+        idle_stats_t* stats = &idle_stats[cpu];
+        kernel_printf("CPU %u: predicted %llu ns, poll timeouts %llu\n",
+                      cpu, stats->predicted_ns, stats->poll_timeouts);
+        for (uint32_t i = 0; i < idle_state_count; i++) {
+            kernel_printf("  %-5s usage %llu, time %llu us\n", idle_states[i].name,
+                          stats->usage[i], stats->time_ns[i] / 1000);
+        }
+    }
+}
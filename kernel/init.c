@@ -9,6 +9,28 @@
 #include <edgex/memory.h>
 #include <edgex/interrupt.h>
 #include <edgex/scheduler.h>
+#include <edgex/cpu.h>
+#include <edgex/tick.h>
+#include <edgex/tsc.h>
+#include <edgex/idle.h>
+#include <edgex/workqueue.h>
+#include <edgex/softirq.h>
+#include <edgex/apic.h>
+#include <edgex/pci.h>
+#include <edgex/napi.h>
+#include <edgex/virtio_net.h>
+#include <edgex/virtio_blk.h>
+#include <edgex/udriver.h>
+#include <edgex/net.h>
+#include <edgex/initrd.h>
+#include <edgex/klog.h>
+#include <edgex/uart.h>
+#include <edgex/trace.h>
+#include <edgex/profile.h>
+#include <edgex/kstats.h>
+#include <edgex/kmemprof.h>
+#include <edgex/smp.h>
+#include <edgex/selftest.h>
 
 /* PIT (Programmable Interval Timer) ports */
 #define PIT_DATA_PORT_0    0x40
@@ -32,15 +54,16 @@
 static void test_task_1(void);
 static void test_task_2(void);
 static void test_task_3(void);
+static void net_boot_config(net_config_t* config);
 
 /*
- * Initialize PIT for scheduling timer
+ * Program PIT channel 0 as a periodic tick
  */
-static void init_pit(void) {
-    kernel_printf("Initializing PIT...\n");
+static void pit_set_periodic(tick_device_t* dev, uint32_t hz) {
+    (void)dev; // Unused parameter
     
     /* Calculate divisor for desired frequency */
-    uint16_t divisor = PIT_DIVISOR;
+    uint16_t divisor = (uint16_t)(PIT_FREQUENCY / hz);
     
     /* Set command byte: channel 0, lobyte/hibyte access, square wave mode */
     outb(PIT_COMMAND_PORT, PIT_CHANNEL_0 | PIT_ACCESS_BOTH | PIT_MODE_SQUARE);
@@ -48,6 +71,44 @@ static void init_pit(void) {
     /* Set divisor */
     outb(PIT_DATA_PORT_0, divisor & 0xFF);         /* Low byte */
     outb(PIT_DATA_PORT_0, (divisor >> 8) & 0xFF);  /* High byte */
+}
+
+/*
+ * Stop PIT channel 0 (one-shot mode waits for a count that never comes)
+ */
+static void pit_stop(tick_device_t* dev) {
+    (void)dev; // Unused parameter
+    
+    outb(PIT_COMMAND_PORT, PIT_CHANNEL_0 | PIT_ACCESS_BOTH | PIT_MODE_ONESHOT);
+}
+
+/*
+ * The PIT interrupts every CPU routed to it, so it is not a per-CPU
+ * tick and is never stopped by nohz_full
+ */
+static tick_device_t pit_tick_device = {
+    .name = "pit",
+    .features = TICK_FEAT_PERIODIC,
+    .set_periodic = pit_set_periodic,
+    .stop = pit_stop,
+    .private_data = NULL,
+};
+
+/*
+ * Initialize PIT for scheduling timer
+ */
+static void init_pit(void) {
+    kernel_printf("Initializing PIT...\n");
+    
+    /* With the APICs up each CPU ticks from its own APIC timer */
+    if (!irq_pic_mode()) {
+        pit_stop(&pit_tick_device);
+        tick_register_device(BOOT_CPU_ID, lapic_timer_device(BOOT_CPU_ID));
+        return;
+    }
+    
+    /* Drive the boot CPU's tick */
+    tick_register_device(BOOT_CPU_ID, &pit_tick_device);
     
     kernel_printf("PIT initialized at %d Hz\n", TIMER_FREQUENCY);
 }
@@ -56,21 +117,91 @@ static void init_pit(void) {
  * Initialize kernel subsystems
  */
 static void init_kernel(void) {
+    /* Set up the boot CPU's per-CPU data (GS base) */
+    init_boot_cpu();
+    
+#ifdef CONFIG_KMEM_PROFILE
+    /* Profile kernel heap allocations from here on (reported by kmemprof_boot_task) */
+    kmemprof_start(KMEMPROF_DEFAULT_RATE);
+#endif
+    
     /* Initialize memory management subsystem */
     kernel_printf("Initializing memory management...\n");
     init_memory();
     
+    /* Find the files of the boot archive (models are mapped from it) */
+    init_initrd();
+    
     /* Initialize interrupt subsystem */
     kernel_printf("Initializing interrupt handling...\n");
     init_interrupts();
     
+    /* Calibrate the TSC, it needs PIT channel 2 and no interrupts */
+    init_tsc();
+    
+    /* Move from the 8259 PIC to the local APIC and IOAPICs if present */
+    init_apic();
+    
+    /* Serial output drains from the THRE interrupt from here on */
+    uart_enable_irqs();
+    
+    /* Enumerate PCI devices (uses the MCFG table found above) */
+    init_pci();
+    
     /* Initialize timer */
     init_pit();
     
+    /* Pick idle states (needs the calibrated TSC) */
+    init_idle();
+    
     /* Initialize scheduler */
     kernel_printf("Initializing task scheduler...\n");
     init_scheduler();
     
+    /* Start the other CPUs (needs the APIC and the scheduler) */
+    smp_boot_cpus();
+    
+    /* Buffer log messages from here on; klogd writes them out */
+    init_klog();
+    
+#ifdef CONFIG_TRACE
+    /* Record the first seconds of scheduling (dumped by trace_boot_task) */
+    init_trace();
+    trace_start();
+#endif
+    
+#ifdef CONFIG_PROFILE
+    /* Sample the first seconds of scheduling (reported by profile_boot_task) */
+    init_profile();
+    profile_start(PROFILE_DEFAULT_HZ);
+#endif
+    
+    /* Start ksoftirqd threads for bottom halves */
+    init_softirqs();
+    
+    /* Register the NET_RX softirq for polled receive queues */
+    init_napi();
+    
+    /* Start worker threads for deferred work */
+    init_workqueues();
+    
+    /* Probe network devices (needs PCI, softirqs and the scheduler) */
+    init_virtio_net();
+    init_virtio_blk();
+    
+    /* UDP/IP service on the first network device */
+    net_config_t net_config;
+    net_boot_config(&net_config);
+    if (init_net(&net_config) < 0) {
+        kernel_printf("net: no network device\n");
+    }
+    
+    /* Devices no kernel driver claimed can be bound to user-space drivers */
+    init_udriver();
+    
+    /* Publish statistics for monitoring tasks to map */
+    init_kstats();
+    
     /* Create test tasks */
     kernel_printf("Creating test tasks...\n");
     pid_t pid1 = create_kernel_task("test1", test_task_1, TASK_PRIORITY_NORMAL);
@@ -78,6 +209,12 @@ static void init_kernel(void) {
     pid_t pid3 = create_kernel_task("test3", test_task_3, TASK_PRIORITY_HIGH);
     
     kernel_printf("Created test tasks with PIDs: %d, %d, %d\n", pid1, pid2, pid3);
+    
+    /* Tests and benchmarks configured in with CONFIG_ flags */
+    start_selftests();
+    
+    /* Start scheduling; the tasks above run from here on */
+    start_scheduler();
 }
 
 /*
@@ -125,6 +262,37 @@ static void test_task_3(void) {
     }
 }
 
+/*
+ * Interface addresses
+ *
+ * By default these fit QEMU's user-mode network. The UDP benchmark runs
+ * two instances on a socket netdev and numbers each one by the last
+ * byte of its MAC address instead.
+ */
+static void net_boot_config(net_config_t* config) {
+    memset(config, 0, sizeof(*config));
+    
+#ifdef CONFIG_UDP_BENCH
+    virtio_net_t* net = virtio_net_get(0);
+    uint8_t host = net ? net->mac[5] : 1;
+    static const uint8_t bench_prefix[8] = { 0xFD, 0x00, 0, 0, 0, 0, 0, 0 };
+    
+    config->ipv4 = htonl(0x0A000000 | host);         /* 10.0.0.<host>/24 */
+    config->ipv4_mask = htonl(0xFFFFFF00);
+    memcpy(config->ipv6, bench_prefix, 8);            /* fd00::<host>/64 */
+    config->ipv6[15] = host;
+#else
+    static const uint8_t qemu_ipv6[16] = { 0xFE, 0xC0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x15 };
+    static const uint8_t qemu_ipv6_gw[16] = { 0xFE, 0xC0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02 };
+    
+    config->ipv4 = htonl(0x0A00020F);                /* 10.0.2.15/24 */
+    config->ipv4_mask = htonl(0xFFFFFF00);
+    config->ipv4_gateway = htonl(0x0A000202);        /* 10.0.2.2 */
+    memcpy(config->ipv6, qemu_ipv6, 16);              /* fec0::15 */
+    memcpy(config->ipv6_gateway, qemu_ipv6_gw, 16);
+#endif
+}
+
 /*
  * Print OS banner
  */
@@ -144,6 +312,9 @@ static void print_banner(void) {
 void kernel_main(void) {
     /* Basic early initialization (printing, etc.) happens before kernel_main() */
     
+    /* Serial console first, so headless boots see everything */
+    init_uart();
+    
     /* Print banner */
     print_banner();
     
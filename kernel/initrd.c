@@ -0,0 +1,211 @@
+/*
+ * EdgeX OS - Initial Ramdisk
+ *
+ * This file finds the archive among the boot modules, keeps its pages out
+ * of the physical allocator and serves its files. Mapping a file only
+ * writes page table entries for the module's own pages, so the time to
+ * "load" a model is the time to map it, whatever its size, and every
+ * task that maps it shares the same physical pages.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/scheduler.h>
+#include <edgex/tsc.h>
+#include <edgex/initrd.h>
+
+#define INITRD_MAX_FILES        256
+
+/* The module, as the boot loader reported it */
+static uint64_t initrd_start;
+static uint64_t initrd_end;
+static bool initrd_named;          /* Chosen by name, not as a fallback */
+
+static initrd_file_t initrd_files[INITRD_MAX_FILES];
+static uint32_t initrd_nr_files;
+
+/*
+ * Compare a path with a NUL-terminated name of at most INITRD_NAME_MAX bytes
+ */
+static bool initrd_name_equal(const char* a, const char* b) {
+    for (uint32_t i = 0; i < INITRD_NAME_MAX; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+        if (a[i] == '\0') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Check whether a module command line names the initrd
+ *
+ * The first whitespace-separated word must be exactly "initrd": the
+ * rest of the line is left for arguments, and "initrd2" or "initrd.img"
+ * do not match. The line is never read past its terminating NUL.
+ */
+static bool initrd_module_named(const char* cmdline) {
+    static const char name[] = "initrd";
+    uint32_t i;
+
+    if (!cmdline) {
+        return false;
+    }
+    for (i = 0; name[i] != '\0'; i++) {
+        if (cmdline[i] != name[i]) {
+            return false;
+        }
+    }
+    return cmdline[i] == '\0' || cmdline[i] == ' ' || cmdline[i] == '\t';
+}
+
+/*
+ * Record a boot module
+ *
+ * The first module named "initrd" wins; a module with no name is taken
+ * if nothing better comes.
+ */
+void initrd_add_module(uint64_t start, uint64_t end, const char* cmdline) {
+    bool named = initrd_module_named(cmdline);
+
+    if (initrd_named || (initrd_end != 0 && !named)) {
+        return;
+    }
+    if (named || !cmdline || cmdline[0] == '\0') {
+        initrd_start = start;
+        initrd_end = end;
+        initrd_named = named;
+    }
+}
+
+/*
+ * Keep the physical allocator off the module
+ */
+void initrd_reserve(void) {
+    if (initrd_end > initrd_start) {
+        reserve_page_range((void*)initrd_start, initrd_end - initrd_start);
+    }
+}
+
+/*
+ * Check the archive and build the file list
+ */
+void init_initrd(void) {
+    if (initrd_end <= initrd_start) {
+        return;
+    }
+
+    uint64_t size = initrd_end - initrd_start;
+    const initrd_header_t* hdr = (const initrd_header_t*)initrd_start;   // Identity-mapped
+
+    if ((initrd_start & (PAGE_SIZE - 1)) != 0) {
+        LOG_ERROR("initrd: module at 0x%llx is not page-aligned", initrd_start);
+        return;
+    }
+    if (size < sizeof(*hdr) || hdr->magic != INITRD_MAGIC || hdr->version != INITRD_VERSION ||
+        hdr->total_size > size ||
+        hdr->data_offset < sizeof(*hdr) + (uint64_t)hdr->nr_files * sizeof(initrd_entry_t)) {
+        LOG_ERROR("initrd: module is not an archive");
+        return;
+    }
+
+    const initrd_entry_t* entries = (const initrd_entry_t*)(hdr + 1);
+    for (uint32_t i = 0; i < hdr->nr_files && initrd_nr_files < INITRD_MAX_FILES; i++) {
+        const initrd_entry_t* e = &entries[i];
+
+        // Files must be whole pages of the module for mapping
+        if ((e->offset & (PAGE_SIZE - 1)) != 0 || e->offset < hdr->data_offset ||
+            e->offset + e->size > hdr->total_size ||
+            e->name[INITRD_NAME_MAX - 1] != '\0') {
+            LOG_ERROR("initrd: bad entry %u", i);
+            continue;
+        }
+
+        initrd_file_t* file = &initrd_files[initrd_nr_files++];
+        file->name = e->name;
+        file->phys = initrd_start + e->offset;
+        file->size = e->size;
+        file->vaddr = INITRD_VADDR_BASE + e->offset;
+        file->mappers = 0;
+    }
+
+    kernel_printf("initrd: %u files, %llu KB at 0x%llx\n", initrd_nr_files,
+                  hdr->total_size / 1024, initrd_start);
+}
+
+/*
+ * Look up a file by path
+ */
+const initrd_file_t* initrd_lookup(const char* name) {
+    for (uint32_t i = 0; i < initrd_nr_files; i++) {
+        if (initrd_name_equal(initrd_files[i].name, name)) {
+            return &initrd_files[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t initrd_count(void) {
+    return initrd_nr_files;
+}
+
+const initrd_file_t* initrd_file(uint32_t index) {
+    return index < initrd_nr_files ? &initrd_files[index] : NULL;
+}
+
+/*
+ * Kernel view of a file's data
+ */
+const void* initrd_data(const initrd_file_t* file) {
+    return (const void*)(uintptr_t)file->phys;
+}
+
+/*
+ * Map a file read-only into a task
+ */
+uint64_t initrd_map(pid_t owner, const initrd_file_t* file) {
+    struct page_directory* pd = find_page_directory(owner);
+    if (!pd || !file || file->size == 0) {
+        return 0;
+    }
+
+    uint64_t start = rdtsc();
+    if (map_device_memory(pd, file->vaddr, file->phys, file->size, false, false) != 0) {
+        kernel_printf("initrd: cannot map %s into task %d\n", file->name, owner);
+        return 0;
+    }
+    __atomic_fetch_add(&((initrd_file_t*)file)->mappers, 1, __ATOMIC_RELAXED);
+
+    LOG_DEBUG("initrd: mapped %s (%llu KB) into task %d in %llu us", file->name,
+              file->size / 1024, owner, tsc_to_ns(rdtsc() - start) / 1000);
+    return file->vaddr;
+}
+
+/*
+ * Remove a task's mapping of a file (the pages stay with the module)
+ */
+int initrd_unmap(pid_t owner, const initrd_file_t* file) {
+    struct page_directory* pd = find_page_directory(owner);
+    if (!pd || !file) {
+        return -1;
+    }
+
+    int ret = unmap_memory_range(pd, file->vaddr, file->size, false);
+    if (ret == 0) {
+        __atomic_fetch_sub(&((initrd_file_t*)file)->mappers, 1, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+/*
+ * Print the file list
+ */
+void dump_initrd(void) {
+    for (uint32_t i = 0; i < initrd_nr_files; i++) {
+        const initrd_file_t* file = &initrd_files[i];
+        kernel_printf("  %-40s %10llu bytes at 0x%llx, %u mappers\n", file->name, file->size,
+                      file->vaddr, file->mappers);
+    }
+}
@@ -8,6 +8,13 @@
 
 #include <edgex/kernel.h>
 #include <edgex/interrupt.h>
+#include <edgex/preempt.h>
+#include <edgex/scheduler.h>
+#include <edgex/softirq.h>
+#include <edgex/tsc.h>
+#include <edgex/apic.h>
+#include <edgex/spinlock.h>
+#include <edgex/trace.h>
 
 /* IDT and IDT register */
 static idt_entry_t idt[IDT_ENTRIES];
@@ -15,9 +22,53 @@ static idtr_t idtr;
 
 /* Handler tables */
 static isr_handler_t exception_handlers[32];
-static irq_handler_t irq_handlers[16];
 static isr_handler_t isr_handlers[IDT_ENTRIES];
 
+/* IRQ thread state, one word so the interrupt and the thread agree */
+#define IRQ_THREAD_BUSY      0       /* Running, nothing to do yet */
+#define IRQ_THREAD_PENDING   1       /* Thread handler has to run */
+#define IRQ_THREAD_IDLE      2       /* Blocked or about to, needs a wakeup */
+
+/* IRQ descriptors */
+typedef struct {
+    /* Delivery */
+    irq_chip_t* chip;                /* Controller that delivers the IRQ */
+    void* chip_data;                 /* Controller state (e.g. the IOAPIC) */
+    uint32_t hwirq;                  /* Pin or index on the controller */
+    uint8_t vector;                  /* IDT vector it arrives on */
+    bool enabled;                    /* Unmasked by enable_irq() */
+    cpumask_t affinity;              /* CPUs it may be routed to */
+    uint32_t cpu;                    /* CPU it is routed to */
+    
+    /* Handlers */
+    irq_handler_t legacy_handler;    /* register_irq_handler() */
+    irq_primary_handler_t handler;   /* Runs in the interrupt */
+    irq_thread_handler_t thread_fn;  /* Runs in the IRQ thread */
+    void* dev_data;
+    const char* name;
+    pid_t thread_pid;                /* IRQ thread */
+    volatile uint32_t thread_state;  /* IRQ_THREAD_* */
+    uint64_t wake_tsc;               /* When the thread was last woken */
+    irq_stats_t stats;
+} irq_desc_t;
+
+static irq_desc_t irq_descs[NR_IRQS];
+
+/* IRQ bound to each vector, -1 if none */
+static int16_t vector_irq[IDT_ENTRIES];
+
+/* Dynamic vectors in use */
+static uint64_t vector_used[IDT_ENTRIES / 64];
+
+/* Vectors 0x20-0x2F belong to the PIC until the IOAPICs take over */
+static bool pic_mode = true;
+
+/* Interrupts that arrived on a vector with no IRQ bound */
+static uint64_t spurious_irq_count = 0;
+
+/* Protects descriptor setup and the vector allocator */
+static spinlock_t irq_desc_lock = SPINLOCK_INIT;
+
 /* IRQ mask tracking */
 static uint16_t irq_mask = 0xFFFF; /* All IRQs masked initially */
 
@@ -77,6 +128,13 @@ extern void irq_stub_15(void);
 
 extern void isr_stub_syscall(void);
 extern void isr_stub_yield(void);
+extern void isr_stub_resched(void);
+extern void isr_stub_apic_error(void);
+extern void isr_stub_spurious(void);
+
+/* Stubs for the dynamic vectors and the local timer, 16 bytes apart */
+extern char irq_entries_start[];
+#define IRQ_ENTRY_SIZE 16
 
 /* Array of ISR stub addresses, indexed by vector number */
 static void* isr_stubs[IDT_ENTRIES] = {
@@ -98,7 +156,14 @@ static void* isr_stubs[IDT_ENTRIES] = {
     
     /* Software interrupts */
     [0x80] = isr_stub_syscall,
-    [0x81] = isr_stub_yield
+    [0x81] = isr_stub_yield,
+
+    /* Inter-processor interrupts */
+    [0xF0] = isr_stub_resched,
+    
+    /* Local APIC */
+    [0xFE] = isr_stub_apic_error,
+    [0xFF] = isr_stub_spurious
 };
 
 /*
@@ -226,13 +291,26 @@ __asm__(
     "IRQ_STUB 14 46\n"
     "IRQ_STUB 15 47\n"
     "\n"
+    "# Stubs for vectors 0x30-0xEF, indexed by vector from irq_entries_start\n"
+    ".global irq_entries_start\n"
+    ".align 16\n"
+    "irq_entries_start:\n"
+    "    vector = 0x30\n"
+    "    .rept (0xF0 - 0x30)\n"
+    "    pushq $0              # Push dummy error code\n"
+    "    pushq $vector         # Push interrupt number\n"
+    "    jmp irq_common_stub   # Jump to common handler\n"
+    "    .align 16\n"
+    "    vector = vector + 1\n"
+    "    .endr\n"
+    "\n"
     "# Syscall stub\n"
     ".global isr_stub_syscall\n"
     ".type isr_stub_syscall, @function\n"
     "isr_stub_syscall:\n"
     "    pushq $0              # Push dummy error code\n"
     "    pushq $0x80           # Push interrupt number\n"
-    "    jmp isr_common_stub   # Jump to common handler\n"
+    "    jmp soft_common_stub  # Jump to software interrupt handler\n"
     "\n"
     "# Yield stub\n"
     ".global isr_stub_yield\n"
@@ -240,7 +318,31 @@ __asm__(
     "isr_stub_yield:\n"
     "    pushq $0              # Push dummy error code\n"
     "    pushq $0x81           # Push interrupt number\n"
-    "    jmp isr_common_stub   # Jump to common handler\n"
+    "    jmp soft_common_stub  # Jump to software interrupt handler\n"
+    "\n"
+    "# Reschedule IPI stub\n"
+    ".global isr_stub_resched\n"
+    ".type isr_stub_resched, @function\n"
+    "isr_stub_resched:\n"
+    "    pushq $0              # Push dummy error code\n"
+    "    pushq $0xF0           # Push interrupt number\n"
+    "    jmp soft_common_stub  # Jump to software interrupt handler\n"
+    "\n"
+    "# Local APIC error stub\n"
+    ".global isr_stub_apic_error\n"
+    ".type isr_stub_apic_error, @function\n"
+    "isr_stub_apic_error:\n"
+    "    pushq $0              # Push dummy error code\n"
+    "    pushq $0xFE           # Push interrupt number\n"
+    "    jmp soft_common_stub  # Jump to software interrupt handler\n"
+    "\n"
+    "# Local APIC spurious interrupt stub\n"
+    ".global isr_stub_spurious\n"
+    ".type isr_stub_spurious, @function\n"
+    "isr_stub_spurious:\n"
+    "    pushq $0              # Push dummy error code\n"
+    "    pushq $0xFF           # Push interrupt number\n"
+    "    jmp soft_common_stub  # Jump to software interrupt handler\n"
     "\n"
     "# Common ISR stub (for CPU exceptions)\n"
     ".type isr_common_stub, @function\n"
@@ -289,6 +391,53 @@ __asm__(
     "    # Return from interrupt\n"
     "    iretq\n"
     "\n"
+    "# Common stub for software interrupts and IPIs\n"
+    ".type soft_common_stub, @function\n"
+    "soft_common_stub:\n"
+    "    # Save all general purpose registers\n"
+    "    pushq %rax\n"
+    "    pushq %rbx\n"
+    "    pushq %rcx\n"
+    "    pushq %rdx\n"
+    "    pushq %rsi\n"
+    "    pushq %rdi\n"
+    "    pushq %rbp\n"
+    "    pushq %r8\n"
+    "    pushq %r9\n"
+    "    pushq %r10\n"
+    "    pushq %r11\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "\n"
+    "    # Call the C software interrupt handler\n"
+    "    movq %rsp, %rdi\n"
+    "    call handle_isr\n"
+    "\n"
+    "    # Restore all registers\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %r11\n"
+    "    popq %r10\n"
+    "    popq %r9\n"
+    "    popq %r8\n"
+    "    popq %rbp\n"
+    "    popq %rdi\n"
+    "    popq %rsi\n"
+    "    popq %rdx\n"
+    "    popq %rcx\n"
+    "    popq %rbx\n"
+    "    popq %rax\n"
+    "\n"
+    "    # Remove error code and interrupt number\n"
+    "    addq $16, %rsp\n"
+    "\n"
+    "    # Return from interrupt\n"
+    "    iretq\n"
+    "\n"
     "# Common IRQ stub (for hardware interrupts)\n"
     ".type irq_common_stub, @function\n"
     "irq_common_stub:\n"
@@ -371,16 +520,39 @@ static void init_idt(void) {
         set_idt_entry(INT_VECTOR_IRQ(i), isr_stubs[INT_VECTOR_IRQ(i)], IDT_ATTR_INTERRUPT_KERNEL);
     }
 
+    // Set up dynamic vectors and the local timer (48-239); the software
+    // interrupt gates below take precedence
+    for (int v = INT_VECTOR_DYNAMIC_FIRST; v <= INT_VECTOR_LOCAL_TIMER; v++) {
+        set_idt_entry(v, irq_entries_start + (v - INT_VECTOR_DYNAMIC_FIRST) * IRQ_ENTRY_SIZE,
+                      IDT_ATTR_INTERRUPT_KERNEL);
+    }
+
     // Set up syscall handler
     set_idt_entry(INT_VECTOR_SYSCALL, isr_stubs[INT_VECTOR_SYSCALL], IDT_ATTR_TRAP_USER);
 
     // Set up yield handler
     set_idt_entry(INT_VECTOR_YIELD, isr_stubs[INT_VECTOR_YIELD], IDT_ATTR_TRAP_KERNEL);
 
+    // Set up reschedule IPI handler
+    set_idt_entry(INT_VECTOR_RESCHEDULE, isr_stubs[INT_VECTOR_RESCHEDULE], IDT_ATTR_INTERRUPT_KERNEL);
+
+    // Set up local APIC error and spurious handlers
+    set_idt_entry(INT_VECTOR_APIC_ERROR, isr_stubs[INT_VECTOR_APIC_ERROR], IDT_ATTR_INTERRUPT_KERNEL);
+    set_idt_entry(INT_VECTOR_SPURIOUS, isr_stubs[INT_VECTOR_SPURIOUS], IDT_ATTR_INTERRUPT_KERNEL);
+
     // Load the IDT
     __asm__ volatile("lidt %0" : : "m"(idtr));
 }
 
+/*
+ * Load the IDT on an application processor
+ *
+ * Every CPU shares the table built by init_interrupts().
+ */
+void init_interrupts_ap(void) {
+    __asm__ volatile("lidt %0" : : "m"(idtr));
+}
+
 /*
  * I/O port functions
  */
@@ -437,9 +609,9 @@ static void init_pic(void) {
 }
 
 /*
- * Enable a specific IRQ
+ * Unmask a line at the PIC
  */
-void enable_irq(uint8_t irq) {
+static void pic_unmask(uint8_t irq) {
     uint16_t port;
     uint8_t value;
 
@@ -467,9 +639,9 @@ void enable_irq(uint8_t irq) {
 }
 
 /*
- * Disable a specific IRQ
+ * Mask a line at the PIC
  */
-void disable_irq(uint8_t irq) {
+static void pic_mask(uint8_t irq) {
     uint16_t port;
     uint8_t value;
 
@@ -512,7 +684,7 @@ void unmask_all_irqs(void) {
 /*
  * Send End-Of-Interrupt signal to the PIC
  */
-void send_eoi(uint8_t irq) {
+static void pic_eoi(uint8_t irq) {
     if (irq >= 8) {
         // Send EOI to slave PIC
         outb(PIC2_COMMAND, PIC_EOI);
@@ -521,6 +693,291 @@ void send_eoi(uint8_t irq) {
     outb(PIC1_COMMAND, PIC_EOI);
 }
 
+/* Legacy 8259 PIC, vectors fixed at INT_VECTOR_IRQ_BASE */
+static irq_chip_t pic_chip = {
+    .name = "8259",
+    .mask = pic_mask,
+    .unmask = pic_unmask,
+    .eoi = pic_eoi,
+    .set_route = NULL,
+};
+
+/*
+ * Enable a specific IRQ
+ */
+void enable_irq(uint8_t irq) {
+    if (irq >= NR_IRQS || !irq_descs[irq].chip) {
+        return;
+    }
+    irq_descs[irq].enabled = true;
+    irq_descs[irq].chip->unmask(irq);
+}
+
+/*
+ * Disable a specific IRQ
+ */
+void disable_irq(uint8_t irq) {
+    if (irq >= NR_IRQS || !irq_descs[irq].chip) {
+        return;
+    }
+    irq_descs[irq].enabled = false;
+    irq_descs[irq].chip->mask(irq);
+}
+
+/*
+ * Send End-Of-Interrupt to the controller of an IRQ
+ */
+void send_eoi(uint8_t irq) {
+    if (irq < NR_IRQS && irq_descs[irq].chip) {
+        irq_descs[irq].chip->eoi(irq);
+    }
+}
+
+/*
+ * Allocate a free dynamic vector (irq_desc_lock held)
+ *
+ * Returns 0 if the dynamic range is exhausted.
+ */
+static uint8_t alloc_vector(void) {
+    for (int v = INT_VECTOR_DYNAMIC_FIRST; v <= INT_VECTOR_DYNAMIC_LAST; v++) {
+        if (!(vector_used[v / 64] & (1ULL << (v % 64)))) {
+            vector_used[v / 64] |= 1ULL << (v % 64);
+            return (uint8_t)v;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Return a dynamic vector to the allocator (irq_desc_lock held)
+ */
+static void free_vector(uint8_t vector) {
+    if (vector >= INT_VECTOR_DYNAMIC_FIRST && vector <= INT_VECTOR_DYNAMIC_LAST) {
+        vector_used[vector / 64] &= ~(1ULL << (vector % 64));
+    }
+}
+
+/*
+ * Pick the CPU an IRQ is routed to: the first online CPU in its mask,
+ * or a housekeeping CPU if none is online
+ */
+static uint32_t irq_target_cpu(cpumask_t mask) {
+    cpumask_t online = mask & cpu_online_mask();
+    return online ? cpumask_first(online) : housekeeping_any_cpu();
+}
+
+/*
+ * Bind an IRQ number to an interrupt controller (irq_desc_lock held)
+ */
+static int setup_irq_locked(uint8_t irq, irq_chip_t* chip, uint32_t hwirq,
+                            void* chip_data, uint8_t vector) {
+    irq_desc_t* desc = &irq_descs[irq];
+    
+    // Quiesce the old binding
+    if (desc->chip) {
+        desc->chip->mask(irq);
+        if (vector_irq[desc->vector] == irq) {
+            vector_irq[desc->vector] = -1;
+        }
+        if (desc->chip->set_route) {
+            free_vector(desc->vector);
+        }
+    }
+    
+    if (vector == 0) {
+        vector = alloc_vector();
+        if (vector == 0) {
+            desc->chip = NULL;
+            return -1;
+        }
+    }
+    
+    desc->chip = chip;
+    desc->chip_data = chip_data;
+    desc->hwirq = hwirq;
+    desc->vector = vector;
+    if (desc->affinity == CPU_MASK_NONE) {
+        desc->affinity = housekeeping_mask();
+    }
+    desc->cpu = irq_target_cpu(desc->affinity);
+    vector_irq[vector] = irq;
+    
+    // Program the route masked, then restore the enable state
+    chip->mask(irq);
+    if (chip->set_route) {
+        chip->set_route(irq, vector, get_cpu(desc->cpu)->apic_id);
+    }
+    if (desc->enabled) {
+        chip->unmask(irq);
+    }
+    
+    return vector;
+}
+
+/*
+ * Bind an IRQ number to an interrupt controller
+ *
+ * Replaces any previous binding (e.g. an ISA IRQ moving from the PIC to
+ * an IOAPIC); registered handlers are kept. Returns the vector, or -1.
+ */
+int irq_set_chip(uint8_t irq, irq_chip_t* chip, uint32_t hwirq, void* chip_data, uint8_t vector) {
+    if (irq >= NR_IRQS || chip == NULL) {
+        return -1;
+    }
+    
+    uint64_t flags;
+    spin_lock_irqsave(&irq_desc_lock, flags);
+    int ret = setup_irq_locked(irq, chip, hwirq, chip_data, vector);
+    spin_unlock_irqrestore(&irq_desc_lock, flags);
+    
+    if (ret < 0) {
+        kernel_printf("Error: Out of interrupt vectors for IRQ %u\n", irq);
+    }
+    return ret;
+}
+
+/*
+ * Allocate an IRQ number above the ISA range for a controller input
+ *
+ * Returns the IRQ number, or -1 if none is free.
+ */
+int irq_alloc(irq_chip_t* chip, uint32_t hwirq, void* chip_data) {
+    uint64_t flags;
+    int irq = -1;
+    
+    if (chip == NULL) {
+        return -1;
+    }
+    
+    spin_lock_irqsave(&irq_desc_lock, flags);
+    for (int i = NR_LEGACY_IRQS; i < NR_IRQS; i++) {
+        if (irq_descs[i].chip == NULL) {
+            if (setup_irq_locked((uint8_t)i, chip, hwirq, chip_data, 0) >= 0) {
+                irq = i;
+            }
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&irq_desc_lock, flags);
+    
+    if (irq < 0) {
+        kernel_printf("Error: Out of IRQ numbers or vectors\n");
+    }
+    return irq;
+}
+
+/*
+ * Release an IRQ allocated with irq_alloc()
+ */
+void irq_release(uint8_t irq) {
+    if (irq < NR_LEGACY_IRQS || irq >= NR_IRQS || irq_descs[irq].chip == NULL) {
+        return;
+    }
+    
+    free_irq(irq);
+    
+    irq_desc_t* desc = &irq_descs[irq];
+    uint64_t flags;
+    
+    spin_lock_irqsave(&irq_desc_lock, flags);
+    desc->chip->mask(irq);
+    vector_irq[desc->vector] = -1;
+    free_vector(desc->vector);
+    desc->chip = NULL;
+    desc->chip_data = NULL;
+    desc->enabled = false;
+    desc->legacy_handler = NULL;
+    desc->affinity = CPU_MASK_NONE;
+    memset(&desc->stats, 0, sizeof(desc->stats));
+    spin_unlock_irqrestore(&irq_desc_lock, flags);
+}
+
+/*
+ * Get the controller input of an IRQ
+ */
+uint32_t irq_get_hwirq(uint8_t irq) {
+    return irq < NR_IRQS ? irq_descs[irq].hwirq : 0;
+}
+
+/*
+ * Get the controller state of an IRQ
+ */
+void* irq_get_chip_data(uint8_t irq) {
+    return irq < NR_IRQS ? irq_descs[irq].chip_data : NULL;
+}
+
+/*
+ * Get the vector an IRQ arrives on (0 if unbound)
+ */
+uint8_t irq_get_vector(uint8_t irq) {
+    return (irq < NR_IRQS && irq_descs[irq].chip) ? irq_descs[irq].vector : 0;
+}
+
+/*
+ * Route an IRQ to the CPUs in a mask
+ *
+ * The IRQ is delivered to the first online CPU in the mask; its vector
+ * stays the same. Returns 0 on success, -1 if the controller has a
+ * fixed route or the mask has no online CPU.
+ */
+int irq_set_affinity(uint8_t irq, cpumask_t mask) {
+    if (irq >= NR_IRQS || irq_descs[irq].chip == NULL ||
+        irq_descs[irq].chip->set_route == NULL ||
+        (mask & cpu_online_mask()) == CPU_MASK_NONE) {
+        return -1;
+    }
+    
+    irq_desc_t* desc = &irq_descs[irq];
+    uint64_t flags;
+    int ret;
+    
+    spin_lock_irqsave(&irq_desc_lock, flags);
+    desc->affinity = mask;
+    desc->cpu = irq_target_cpu(mask);
+    ret = desc->chip->set_route(irq, desc->vector, get_cpu(desc->cpu)->apic_id);
+    spin_unlock_irqrestore(&irq_desc_lock, flags);
+    
+    return ret;
+}
+
+/*
+ * Get the CPUs an IRQ may be routed to
+ */
+cpumask_t irq_get_affinity(uint8_t irq) {
+    return irq < NR_IRQS ? irq_descs[irq].affinity : CPU_MASK_NONE;
+}
+
+/*
+ * Stop taking interrupts from the 8259 PIC
+ *
+ * Called by the APIC code before it rebinds the ISA IRQs to IOAPIC pins.
+ * The PIC vectors stay in the IDT so a spurious PIC interrupt is counted
+ * and dropped instead of being mistaken for a device IRQ.
+ */
+void irq_disable_pic(void) {
+    uint64_t flags;
+    
+    spin_lock_irqsave(&irq_desc_lock, flags);
+    
+    mask_all_irqs();
+    for (int i = 0; i < NR_LEGACY_IRQS; i++) {
+        if (irq_descs[i].chip == &pic_chip) {
+            irq_descs[i].chip = NULL;
+        }
+        vector_irq[INT_VECTOR_IRQ(i)] = -1;
+    }
+    pic_mode = false;
+    
+    spin_unlock_irqrestore(&irq_desc_lock, flags);
+}
+
+/*
+ * Check whether the ISA IRQs are still delivered by the PIC
+ */
+bool irq_pic_mode(void) {
+    return pic_mode;
+}
+
 /*
  * Enable interrupts (clear interrupt flag)
  */
@@ -539,7 +996,7 @@ static inline void disable_interrupts(void) {
  * Default exception handler
  */
 static void default_exception_handler(cpu_context_t* context) {
-    kernel_panic("Unhandled CPU exception %u (%s) at RIP=%p, error code=%lx\n",
+    kernel_panic("Unhandled CPU exception %llu (%s) at RIP=%p, error code=%llx\n",
                  context->int_num,
                  context->int_num < 32 ? exception_names[context->int_num] : "Unknown",
                  (void*)context->rip,
@@ -553,6 +1010,7 @@ static void page_fault_handler(cpu_context_t* context) {
     // Get the faulting address from CR2 register
     uint64_t fault_addr;
     __asm__ volatile("mov %%cr2, %0" : "=r"(fault_addr));
+    trace_page_fault(fault_addr, context->error_code);
 
     // Page fault error code:
     // Bit 0: Present - 0 = non-present page, 1 = protection violation
@@ -583,7 +1041,7 @@ static void page_fault_handler(cpu_context_t* context) {
     const char* mode_str = (context->error_code & 4) ? "user" : "supervisor";
 
     kernel_panic("Page fault: %s during %s in %s mode at address %p\n"
-                 "Instruction pointer: %p, Error code: 0x%lx\n",
+                 "Instruction pointer: %p, Error code: 0x%llx\n",
                  type_str, access_str, mode_str, (void*)fault_addr,
                  (void*)context->rip, context->error_code);
 }
@@ -609,31 +1067,83 @@ void handle_exception(cpu_context_t* context) {
     }
 }
 
+/*
+ * Hand a threaded IRQ to its thread (in the interrupt)
+ */
+static void irq_wake_thread(uint8_t irq, irq_desc_t* desc) {
+    // Keep the line masked until the thread handler has run
+    disable_irq(irq);
+    
+    desc->wake_tsc = rdtsc();
+    
+    // Only the interrupt that finds the thread idle wakes it, whichever
+    // CPU it arrives on
+    uint32_t old = __atomic_exchange_n(&desc->thread_state, IRQ_THREAD_PENDING, __ATOMIC_ACQ_REL);
+    if (old == IRQ_THREAD_IDLE && desc->thread_pid != PID_INVALID) {
+        unblock_task(desc->thread_pid);
+    }
+}
+
 /*
  * C handler for hardware interrupts (IRQs)
  * Called from assembly with the CPU context on the stack
  */
 void handle_irq(cpu_context_t* context) {
-    uint8_t interrupt_num = context->int_num;
-    
-    // Calculate the IRQ number (IRQs start at INT_VECTOR_IRQ_BASE)
-    uint8_t irq = interrupt_num - INT_VECTOR_IRQ_BASE;
+    uint8_t vector = context->int_num;
+    int irq = vector_irq[vector];
     
-    // Validate IRQ number
-    if (irq >= 16) {
-        kernel_panic("Invalid IRQ number: %u in handle_irq\n", irq);
+    if (irq < 0) {
+        // A PIC line firing after the switch to the IOAPICs (spurious
+        // IRQ 7/15), or a vector released while the interrupt was in flight
+        spurious_irq_count++;
+        if (vector >= INT_VECTOR_DYNAMIC_FIRST) {
+            lapic_eoi();
+        }
         return;
     }
     
-    // Call the registered handler if exists
-    if (irq_handlers[irq] != NULL) {
-        irq_handlers[irq](context);
+    irq_enter();
+    trace_irq_entry(irq);
+    
+    irq_desc_t* desc = &irq_descs[irq];
+    uint64_t start = rdtsc();
+    desc->stats.count++;
+    
+    if (desc->thread_fn != NULL) {
+        // Threaded IRQ: acknowledge the device, defer the rest
+        irqreturn_t ret = desc->handler ? desc->handler(irq, desc->dev_data)
+                                        : IRQ_WAKE_THREAD;
+        if (ret == IRQ_WAKE_THREAD) {
+            irq_wake_thread(irq, desc);
+        }
+    } else if (desc->handler != NULL) {
+        // Hard IRQ handler, typically schedules a softirq poll
+        desc->handler(irq, desc->dev_data);
+    } else if (desc->legacy_handler != NULL) {
+        // Call the registered handler if exists
+        desc->legacy_handler(context);
     } else {
         kernel_printf("Warning: Unhandled IRQ %u\n", irq);
     }
     
-    // Send end-of-interrupt signal to the PIC
-    send_eoi(irq);
+    uint64_t primary_ns = tsc_to_ns(rdtsc() - start);
+    if (primary_ns > desc->stats.max_primary_ns) {
+        desc->stats.max_primary_ns = primary_ns;
+    }
+    
+    // Acknowledge the interrupt at its controller
+    desc->chip->eoi(irq);
+    
+    trace_irq_exit(irq);
+    irq_exit();
+    
+    // Bottom halves raised by the handler run now, with interrupts enabled
+    do_softirq();
+    
+    // Preemption point: switch now if the handler woke a more important task
+    if (need_resched()) {
+        preempt_schedule_irq();
+    }
 }
 
 /*
@@ -649,6 +1159,17 @@ void handle_isr(cpu_context_t* context) {
     } else {
         kernel_printf("Warning: Unhandled ISR %u\n", vector);
     }
+    
+    // IPIs and APIC errors are in service at the local APIC; spurious
+    // interrupts never are
+    if (vector >= INT_VECTOR_RESCHEDULE && vector != INT_VECTOR_SPURIOUS) {
+        lapic_eoi();
+    }
+    
+    // Preemption point for yield and reschedule IPIs
+    if (need_resched()) {
+        preempt_schedule_irq();
+    }
 }
 
 /*
@@ -666,8 +1187,8 @@ void register_exception_handler(uint8_t vector, isr_handler_t handler) {
  * Register an IRQ handler for a specific hardware interrupt
  */
 void register_irq_handler(uint8_t irq, irq_handler_t handler) {
-    if (irq < 16) {
-        irq_handlers[irq] = handler;
+    if (irq < NR_IRQS) {
+        irq_descs[irq].legacy_handler = handler;
     } else {
         kernel_printf("Error: Invalid IRQ: %u\n", irq);
     }
@@ -684,6 +1205,226 @@ void register_isr_handler(uint8_t vector, isr_handler_t handler) {
     }
 }
 
+/*
+ * Find the descriptor whose thread is the running task
+ */
+static irq_desc_t* current_irq_desc(void) {
+    pid_t pid = get_current_pid();
+    
+    for (int i = 0; i < NR_IRQS; i++) {
+        if (irq_descs[i].thread_fn != NULL && irq_descs[i].thread_pid == pid) {
+            return &irq_descs[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * IRQ thread - one per threaded IRQ
+ */
+static void irq_thread(void) {
+    irq_desc_t* desc;
+    
+    // The creator publishes our PID right after create_kernel_task()
+    while ((desc = current_irq_desc()) == NULL) {
+        yield();
+    }
+    
+    uint8_t irq = (uint8_t)(desc - irq_descs);
+    
+    while (1) {
+        if (__atomic_exchange_n(&desc->thread_state, IRQ_THREAD_BUSY, __ATOMIC_ACQ_REL) ==
+            IRQ_THREAD_PENDING) {
+            irq_thread_handler_t thread_fn = desc->thread_fn;
+            if (thread_fn == NULL) {
+                // Released by free_irq()
+                break;
+            }
+            
+            uint64_t t0 = rdtsc();
+            uint64_t wakeup_ns = tsc_to_ns(t0 - desc->wake_tsc);
+            
+            thread_fn(irq, desc->dev_data);
+            
+            uint64_t run_ns = tsc_to_ns(rdtsc() - t0);
+            desc->stats.thread_runs++;
+            if (wakeup_ns > desc->stats.max_wakeup_ns) {
+                desc->stats.max_wakeup_ns = wakeup_ns;
+            }
+            if (run_ns > desc->stats.max_thread_ns) {
+                desc->stats.max_thread_ns = run_ns;
+            }
+            
+            // Done with the device: let the line interrupt again
+            uint64_t flags = local_irq_save();
+            enable_irq(irq);
+            local_irq_restore(flags);
+            continue;
+        }
+        
+        // Blocked and published idle in one step with the final check: an
+        // interrupt on any CPU either sees IDLE and wakes us, or made the
+        // state PENDING first and the exchange fails
+        prepare_to_block();
+        
+        uint32_t expected = IRQ_THREAD_BUSY;
+        if (__atomic_compare_exchange_n(&desc->thread_state, &expected, IRQ_THREAD_IDLE,
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            schedule();
+        } else {
+            cancel_block();
+        }
+    }
+    
+    exit_task();
+}
+
+/*
+ * Install a threaded IRQ handler
+ *
+ * Returns 0 on success, -1 if the IRQ is invalid or already threaded.
+ */
+int request_threaded_irq(uint8_t irq, irq_primary_handler_t handler,
+                         irq_thread_handler_t thread_fn, uint32_t priority,
+                         const char* name, void* dev_data) {
+    if (irq >= NR_IRQS || thread_fn == NULL || priority > TASK_PRIORITY_REALTIME) {
+        kernel_printf("Error: Invalid threaded IRQ: %u\n", irq);
+        return -1;
+    }
+    
+    irq_desc_t* desc = &irq_descs[irq];
+    if (desc->thread_fn != NULL || desc->handler != NULL) {
+        kernel_printf("Error: IRQ %u is already in use\n", irq);
+        return -1;
+    }
+    
+    pid_t pid = create_kernel_task(name ? name : "irq", irq_thread,
+                                   (task_priority_t)priority);
+    if (pid == PID_INVALID) {
+        return -1;
+    }
+    
+    uint64_t flags = local_irq_save();
+    desc->handler = handler;
+    desc->dev_data = dev_data;
+    desc->name = name;
+    desc->thread_state = IRQ_THREAD_BUSY;
+    desc->thread_pid = pid;
+    desc->thread_fn = thread_fn;
+    local_irq_restore(flags);
+    
+    enable_irq(irq);
+    return 0;
+}
+
+/*
+ * Install a handler that runs entirely in the interrupt
+ *
+ * For handlers that only acknowledge the device and schedule a softirq
+ * (e.g. NAPI polling); anything longer belongs in a threaded IRQ.
+ */
+int request_irq(uint8_t irq, irq_primary_handler_t handler, const char* name, void* dev_data) {
+    if (irq >= NR_IRQS || handler == NULL) {
+        kernel_printf("Error: Invalid IRQ: %u\n", irq);
+        return -1;
+    }
+    
+    irq_desc_t* desc = &irq_descs[irq];
+    if (desc->handler != NULL || desc->thread_fn != NULL) {
+        kernel_printf("Error: IRQ %u is already in use\n", irq);
+        return -1;
+    }
+    
+    uint64_t flags = local_irq_save();
+    desc->handler = handler;
+    desc->dev_data = dev_data;
+    desc->name = name;
+    local_irq_restore(flags);
+    
+    enable_irq(irq);
+    return 0;
+}
+
+/*
+ * Remove an IRQ handler, stopping its thread if it has one
+ */
+void free_irq(uint8_t irq) {
+    if (irq >= NR_IRQS) {
+        return;
+    }
+    
+    irq_desc_t* desc = &irq_descs[irq];
+    uint64_t flags;
+    
+    if (desc->thread_fn == NULL) {
+        if (desc->handler != NULL) {
+            disable_irq(irq);
+            flags = local_irq_save();
+            desc->handler = NULL;
+            desc->dev_data = NULL;
+            local_irq_restore(flags);
+        }
+        return;
+    }
+    
+    disable_irq(irq);
+    
+    flags = local_irq_save();
+    pid_t pid = desc->thread_pid;
+    desc->thread_fn = NULL;
+    desc->handler = NULL;
+    desc->thread_pid = PID_INVALID;
+    __atomic_store_n(&desc->thread_state, IRQ_THREAD_PENDING, __ATOMIC_RELEASE);
+    local_irq_restore(flags);
+    
+    // The thread exits once it sees the handler gone
+    unblock_task(pid);
+}
+
+/*
+ * Change the task priority of a threaded IRQ's thread
+ */
+int set_irq_thread_priority(uint8_t irq, uint32_t priority) {
+    if (irq >= NR_IRQS || irq_descs[irq].thread_fn == NULL) {
+        return -1;
+    }
+    return set_task_priority(irq_descs[irq].thread_pid, (task_priority_t)priority);
+}
+
+/*
+ * Get statistics for an IRQ
+ */
+void get_irq_stats(uint8_t irq, irq_stats_t* stats) {
+    if (irq < NR_IRQS && stats) {
+        *stats = irq_descs[irq].stats;
+    }
+}
+
+/*
+ * Print per-IRQ statistics
+ */
+void dump_irq_stats(void) {
+    kernel_printf("IRQ statistics (%s, %llu spurious):\n",
+                  pic_mode ? "8259 PIC" : "APIC", spurious_irq_count);
+    for (int i = 0; i < NR_IRQS; i++) {
+        irq_desc_t* desc = &irq_descs[i];
+        if (desc->stats.count == 0) {
+            continue;
+        }
+        
+        kernel_printf("  IRQ %d (%s, %s, vector 0x%x, CPU %u): %llu interrupts, max in-IRQ %llu ns",
+                      i, desc->name ? desc->name : "-", desc->chip ? desc->chip->name : "-",
+                      desc->vector, desc->cpu, desc->stats.count,
+                      desc->stats.max_primary_ns);
+        if (desc->thread_fn != NULL) {
+            kernel_printf(", thread runs %llu, max wakeup %llu ns, max thread %llu ns",
+                          desc->stats.thread_runs, desc->stats.max_wakeup_ns,
+                          desc->stats.max_thread_ns);
+        }
+        kernel_printf("\n");
+    }
+}
+
 /*
  * Setup special exception handlers
  * Currently only configures a special page fault handler
@@ -706,10 +1447,29 @@ void init_interrupts(void) {
         exception_handlers[i] = NULL;
     }
     
-    for (int i = 0; i < 16; i++) {
-        irq_handlers[i] = NULL;
+    for (int i = 0; i < NR_IRQS; i++) {
+        memset(&irq_descs[i], 0, sizeof(irq_desc_t));
+        irq_descs[i].thread_pid = PID_INVALID;
     }
     
+    for (int i = 0; i < IDT_ENTRIES; i++) {
+        vector_irq[i] = -1;
+    }
+    
+    // Until an IOAPIC is found, the ISA IRQs come from the PIC
+    for (int i = 0; i < NR_LEGACY_IRQS; i++) {
+        irq_descs[i].chip = &pic_chip;
+        irq_descs[i].hwirq = i;
+        irq_descs[i].vector = INT_VECTOR_IRQ(i);
+        irq_descs[i].affinity = cpumask_of(BOOT_CPU_ID);
+        irq_descs[i].cpu = BOOT_CPU_ID;
+        vector_irq[INT_VECTOR_IRQ(i)] = i;
+    }
+    
+    // The software interrupt vectors inside the dynamic range are taken
+    vector_used[INT_VECTOR_SYSCALL / 64] |= 1ULL << (INT_VECTOR_SYSCALL % 64);
+    vector_used[INT_VECTOR_YIELD / 64] |= 1ULL << (INT_VECTOR_YIELD % 64);
+    
     for (int i = 0; i < IDT_ENTRIES; i++) {
         isr_handlers[i] = NULL;
     }
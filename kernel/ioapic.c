@@ -0,0 +1,283 @@
+/*
+ * EdgeX OS - IOAPIC
+ *
+ * This file drives the IOAPICs described by the ACPI MADT. Every IOAPIC
+ * pin in use is bound to an IRQ through the irq_chip interface: the IRQ
+ * layer hands out the vector and picks the destination CPU, this file
+ * writes them into the pin's redirection entry.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/interrupt.h>
+#include <edgex/apic.h>
+#include <edgex/acpi.h>
+#include <edgex/spinlock.h>
+
+/* MMIO registers: an index register and a data window */
+#define IOAPIC_REGSEL         0x00
+#define IOAPIC_WINDOW         0x10
+
+/* Indirect registers */
+#define IOAPIC_REG_ID         0x00
+#define IOAPIC_REG_VERSION    0x01
+#define IOAPIC_REG_RTE(pin)   (0x10 + 2 * (pin))
+
+/* Pins tracked per IOAPIC */
+#define IOAPIC_MAX_PINS       120
+
+typedef struct {
+    uint8_t id;
+    volatile uint32_t* regs;
+    uint32_t gsi_base;                   /* First GSI handled */
+    uint32_t nr_pins;
+    spinlock_t lock;                     /* Serializes index/data accesses */
+    uint64_t rte[IOAPIC_MAX_PINS];       /* Shadow of the redirection entries */
+} ioapic_t;
+
+static ioapic_t ioapics[MAX_IOAPICS];
+static uint32_t nr_ioapics = 0;
+
+/* ISA IRQ to GSI overrides from the MADT */
+static uint32_t isa_gsi[NR_LEGACY_IRQS];
+static uint16_t isa_flags[NR_LEGACY_IRQS];
+static uint16_t isa_override_mask = 0;
+
+/*
+ * Read an IOAPIC register (ioapic->lock held)
+ */
+static uint32_t ioapic_read(ioapic_t* io, uint32_t reg) {
+    io->regs[IOAPIC_REGSEL / 4] = reg;
+    return io->regs[IOAPIC_WINDOW / 4];
+}
+
+/*
+ * Write an IOAPIC register (ioapic->lock held)
+ */
+static void ioapic_write(ioapic_t* io, uint32_t reg, uint32_t value) {
+    io->regs[IOAPIC_REGSEL / 4] = reg;
+    io->regs[IOAPIC_WINDOW / 4] = value;
+}
+
+/*
+ * Write a pin's redirection entry from its shadow copy (ioapic->lock held)
+ *
+ * The high half (destination) goes first, so the entry never points an
+ * unmasked interrupt at a stale CPU.
+ */
+static void ioapic_write_rte(ioapic_t* io, uint32_t pin) {
+    uint64_t rte = io->rte[pin];
+    ioapic_write(io, IOAPIC_REG_RTE(pin) + 1, (uint32_t)(rte >> 32));
+    ioapic_write(io, IOAPIC_REG_RTE(pin), (uint32_t)rte);
+}
+
+/*
+ * Mask an IOAPIC-routed IRQ
+ */
+static void ioapic_mask(uint8_t irq) {
+    ioapic_t* io = (ioapic_t*)irq_get_chip_data(irq);
+    uint32_t pin = irq_get_hwirq(irq);
+    uint64_t flags;
+
+    spin_lock_irqsave(&io->lock, flags);
+    io->rte[pin] |= IOAPIC_RTE_MASKED;
+    ioapic_write(io, IOAPIC_REG_RTE(pin), (uint32_t)io->rte[pin]);
+    spin_unlock_irqrestore(&io->lock, flags);
+}
+
+/*
+ * Unmask an IOAPIC-routed IRQ
+ */
+static void ioapic_unmask(uint8_t irq) {
+    ioapic_t* io = (ioapic_t*)irq_get_chip_data(irq);
+    uint32_t pin = irq_get_hwirq(irq);
+    uint64_t flags;
+
+    spin_lock_irqsave(&io->lock, flags);
+    io->rte[pin] &= ~IOAPIC_RTE_MASKED;
+    ioapic_write(io, IOAPIC_REG_RTE(pin), (uint32_t)io->rte[pin]);
+    spin_unlock_irqrestore(&io->lock, flags);
+}
+
+/*
+ * Acknowledge an IOAPIC-routed IRQ
+ *
+ * The local APIC broadcasts the EOI of level-triggered vectors to the
+ * IOAPICs, which clears their remote IRR bit.
+ */
+static void ioapic_eoi(uint8_t irq) {
+    (void)irq;
+    lapic_eoi();
+}
+
+/*
+ * Point a pin at a vector on a CPU (physical destination mode)
+ */
+static int ioapic_set_route(uint8_t irq, uint8_t vector, uint32_t apic_id) {
+    ioapic_t* io = (ioapic_t*)irq_get_chip_data(irq);
+    uint32_t pin = irq_get_hwirq(irq);
+    uint64_t flags;
+
+    // Without interrupt remapping only 8-bit destinations are reachable
+    if (apic_id > 0xFF) {
+        return -1;
+    }
+
+    spin_lock_irqsave(&io->lock, flags);
+    io->rte[pin] &= ~(0xFFULL | (0xFFULL << IOAPIC_RTE_DEST_SHIFT));
+    io->rte[pin] |= vector | ((uint64_t)apic_id << IOAPIC_RTE_DEST_SHIFT);
+    ioapic_write_rte(io, pin);
+    spin_unlock_irqrestore(&io->lock, flags);
+
+    return 0;
+}
+
+static irq_chip_t ioapic_chip = {
+    .name = "ioapic",
+    .mask = ioapic_mask,
+    .unmask = ioapic_unmask,
+    .eoi = ioapic_eoi,
+    .set_route = ioapic_set_route,
+};
+
+/*
+ * Register an IOAPIC found in the MADT and mask all its pins
+ */
+void ioapic_register(uint8_t id, uint64_t phys_addr, uint32_t gsi_base) {
+    if (nr_ioapics >= MAX_IOAPICS) {
+        kernel_printf("IOAPIC %u ignored: MAX_IOAPICS reached\n", id);
+        return;
+    }
+
+    ioapic_t* io = &ioapics[nr_ioapics];
+    io->regs = (volatile uint32_t*)ioremap(phys_addr, 0x20);
+    if (!io->regs) {
+        return;
+    }
+    io->id = id;
+    io->gsi_base = gsi_base;
+    io->lock = (spinlock_t)SPINLOCK_INIT;
+
+    io->nr_pins = ((ioapic_read(io, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+    if (io->nr_pins > IOAPIC_MAX_PINS) {
+        io->nr_pins = IOAPIC_MAX_PINS;
+    }
+
+    for (uint32_t pin = 0; pin < io->nr_pins; pin++) {
+        io->rte[pin] = IOAPIC_RTE_MASKED;
+        ioapic_write_rte(io, pin);
+    }
+
+    nr_ioapics++;
+    kernel_printf("IOAPIC %u at %p: GSIs %u-%u\n", id, (void*)phys_addr,
+                  gsi_base, gsi_base + io->nr_pins - 1);
+}
+
+/*
+ * Number of registered IOAPICs
+ */
+uint32_t ioapic_count(void) {
+    return nr_ioapics;
+}
+
+/*
+ * Record a MADT interrupt source override for an ISA IRQ
+ */
+void ioapic_set_isa_override(uint8_t isa_irq, uint32_t gsi, uint16_t flags) {
+    if (isa_irq >= NR_LEGACY_IRQS) {
+        return;
+    }
+    isa_gsi[isa_irq] = gsi;
+    isa_flags[isa_irq] = flags;
+    isa_override_mask |= (uint16_t)(1 << isa_irq);
+}
+
+/*
+ * Find the IOAPIC and pin handling a GSI
+ */
+static ioapic_t* ioapic_for_gsi(uint32_t gsi, uint32_t* pin) {
+    for (uint32_t i = 0; i < nr_ioapics; i++) {
+        ioapic_t* io = &ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->nr_pins) {
+            *pin = gsi - io->gsi_base;
+            return io;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Prepare a pin's trigger mode and polarity (leaves it masked)
+ */
+static void ioapic_config_pin(ioapic_t* io, uint32_t pin, bool level, bool active_low) {
+    uint64_t flags;
+
+    spin_lock_irqsave(&io->lock, flags);
+    io->rte[pin] = IOAPIC_RTE_MASKED;
+    if (level) {
+        io->rte[pin] |= IOAPIC_RTE_LEVEL;
+    }
+    if (active_low) {
+        io->rte[pin] |= IOAPIC_RTE_ACTIVE_LOW;
+    }
+    ioapic_write_rte(io, pin);
+    spin_unlock_irqrestore(&io->lock, flags);
+}
+
+/*
+ * Bind the ISA IRQs to their IOAPIC pins
+ *
+ * ISA interrupts are edge-triggered and active high unless the MADT
+ * overrides them. IRQ 2 is the PIC cascade and never fires. Returns the
+ * number of IRQs bound.
+ */
+int ioapic_setup_isa_irqs(void) {
+    int count = 0;
+
+    for (uint8_t irq = 0; irq < NR_LEGACY_IRQS; irq++) {
+        uint32_t gsi = irq;
+        uint16_t flags = 0;
+        uint32_t pin;
+
+        if (irq == IRQ_CASCADE) {
+            continue;
+        }
+
+        if (isa_override_mask & (1 << irq)) {
+            gsi = isa_gsi[irq];
+            flags = isa_flags[irq];
+        }
+
+        ioapic_t* io = ioapic_for_gsi(gsi, &pin);
+        if (!io) {
+            continue;
+        }
+
+        ioapic_config_pin(io, pin,
+                          (flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL,
+                          (flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW);
+
+        if (irq_set_chip(irq, &ioapic_chip, pin, io, 0) >= 0) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Allocate an IRQ for a GSI above the ISA range (e.g. PCI INTx)
+ *
+ * Returns the IRQ number, or -1 if no IOAPIC handles the GSI.
+ */
+int ioapic_map_gsi(uint32_t gsi, bool level, bool active_low) {
+    uint32_t pin;
+    ioapic_t* io = ioapic_for_gsi(gsi, &pin);
+
+    if (!io) {
+        return -1;
+    }
+
+    ioapic_config_pin(io, pin, level, active_low);
+    return irq_alloc(&ioapic_chip, pin, io);
+}
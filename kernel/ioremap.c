@@ -0,0 +1,71 @@
+/*
+ * EdgeX OS - Device Memory Mapping
+ *
+ * This file maps device registers (local APIC, IOAPIC, PCI BARs, ...)
+ * into a dedicated kernel virtual window with caching disabled. Only the
+ * first 1GB of physical memory is identity mapped at boot, and that
+ * mapping is write-back cached, so MMIO always goes through here.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/spinlock.h>
+
+/* Virtual window for device memory mappings */
+#define IOREMAP_START       0xFFFFFE0000000000ULL
+#define IOREMAP_SIZE        (1ULL << 30)    /* 1GB of MMIO space */
+
+/* Present, writable, write-through, cache disabled */
+#define IOREMAP_PAGE_FLAGS  ((1ULL << 0) | (1ULL << 1) | (1ULL << 3) | (1ULL << 4))
+
+static uint64_t ioremap_next = IOREMAP_START;
+static spinlock_t ioremap_lock = SPINLOCK_INIT;
+
+/*
+ * Map a physical MMIO range uncached
+ *
+ * Returns the virtual address of phys_addr, or NULL on failure. Mappings
+ * are long-lived, so virtual space is handed out by a bump allocator.
+ */
+void* ioremap(uint64_t phys_addr, size_t size) {
+    uint64_t offset = phys_addr & (PAGE_SIZE - 1);
+    uint64_t base = phys_addr - offset;
+    uint64_t flags;
+    uint64_t vaddr;
+
+    if (size == 0) {
+        return NULL;
+    }
+    size = (size + offset + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+
+    spin_lock_irqsave(&ioremap_lock, flags);
+    if (ioremap_next + size > IOREMAP_START + IOREMAP_SIZE) {
+        spin_unlock_irqrestore(&ioremap_lock, flags);
+        LOG_ERROR("Out of ioremap space mapping %p", (void*)phys_addr);
+        return NULL;
+    }
+    vaddr = ioremap_next;
+    ioremap_next += size;
+    spin_unlock_irqrestore(&ioremap_lock, flags);
+
+    if (map_pages(vaddr, base, size, IOREMAP_PAGE_FLAGS) != 0) {
+        LOG_ERROR("Failed to map MMIO at %p", (void*)phys_addr);
+        return NULL;
+    }
+
+    return (void*)(vaddr + offset);
+}
+
+/*
+ * Unmap an MMIO range (the virtual range is not reused)
+ */
+void iounmap(void* addr, size_t size) {
+    uint64_t vaddr = (uint64_t)addr & ~(uint64_t)(PAGE_SIZE - 1);
+
+    if (addr == NULL || size == 0) {
+        return;
+    }
+    size = (size + ((uint64_t)addr - vaddr) + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+
+    unmap_pages(vaddr, size);
+}
@@ -9,6 +9,12 @@
 #include <edgex/memory.h>
 #include <edgex/scheduler.h>
 #include <edgex/ipc.h>
+#include <edgex/preempt.h>
+#include <edgex/workqueue.h>
+#include <edgex/trace.h>
+#include <edgex/lockstat.h>
+#include <edgex/percpu.h>
+#include <edgex/ipc/latency.h>
 
 /* Maximum name length for IPC objects */
 #define MAX_IPC_NAME_LENGTH 64
@@ -61,17 +67,23 @@ typedef struct {
 /* Mutex structure */
 struct mutex {
     ipc_object_header_t header;   /* Common header */
+    spinlock_t lock;              /* Protects owner, lock_count, wait_queue */
     pid_t owner;                  /* Current owner (0 if unlocked) */
     uint32_t lock_count;          /* For recursive mutexes */
     wait_queue_t wait_queue;      /* Queue of waiting tasks */
+    ipc_lat_id_t lat_id;          /* Wait latency histogram (ipc/latency.h) */
+    LOCKSTAT_LOCK_FIELDS          /* Contention statistics (lockstat.h) */
 };
 
 /* Semaphore structure */
 struct semaphore {
     ipc_object_header_t header;   /* Common header */
+    spinlock_t lock;              /* Protects value and wait_queue */
     int32_t value;                /* Current semaphore value */
     int32_t max_value;            /* Maximum value */
     wait_queue_t wait_queue;      /* Queue of waiting tasks */
+    ipc_lat_id_t lat_id;          /* Wait latency histogram (ipc/latency.h) */
+    LOCKSTAT_LOCK_FIELDS          /* Contention statistics (lockstat.h) */
 };
 
 /* Array of all mutexes */
@@ -277,13 +289,17 @@ mutex_t create_mutex(const char* name) {
     mutex->header.ref_count = 1;
     mutex->header.destroy_fn = destroy_mutex;
     
+    spin_lock_init(&mutex->lock);
     mutex->owner = 0;
     mutex->lock_count = 0;
     
     // Initialize wait queue
     init_wait_queue(&mutex->wait_queue, name, WAIT_QUEUE_MUTEX, mutex);
+    lockstat_ipc_init(mutex, LOCKSTAT_MUTEX);
+    mutex->lat_id = ipc_lat_register(IPC_LAT_MUTEX_WAIT, mutex->header.name);
     
     mutex_count++;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_CREATED, 1, PCPU_IPC_MUTEXES, 1);
     return mutex;
 }
 
@@ -298,12 +314,17 @@ void destroy_mutex(void* mutex_ptr) {
     }
     
     // Wake up all waiters
+    uint64_t flags;
+    spin_lock_irqsave(&mutex->lock, flags);
     wake_waiters(&mutex->wait_queue, 0);
+    spin_unlock_irqrestore(&mutex->lock, flags);
+    ipc_lat_unregister(mutex->lat_id);
     
     // Clear the mutex
     memset(mutex, 0, sizeof(struct mutex));
     
     mutex_count--;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_DESTROYED, 1, PCPU_IPC_MUTEXES, -1);
 }
 
 /*
@@ -314,15 +335,17 @@ int mutex_lock(mutex_t mutex) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_MUTEX_OPS);
+    
     pid_t current_pid = get_current_pid();
+    uint64_t flags;
     
-    // Disable interrupts for atomic operation
-    __asm__ volatile("cli");
+    spin_lock_irqsave(&mutex->lock, flags);
     
     // If mutex is already owned by current task, increment lock count (recursive mutex)
     if (mutex->owner == current_pid) {
         mutex->lock_count++;
-        __asm__ volatile("sti");
+        spin_unlock_irqrestore(&mutex->lock, flags);
         return 0;
     }
     
@@ -330,22 +353,34 @@ int mutex_lock(mutex_t mutex) {
     if (mutex->owner == 0) {
         mutex->owner = current_pid;
         mutex->lock_count = 1;
-        __asm__ volatile("sti");
+        lockstat_ipc_acquired(mutex, 0, false);
+        spin_unlock_irqrestore(&mutex->lock, flags);
+        ipc_lat_record(mutex->lat_id, 0);
         return 0;
     }
     
-    // Mutex is locked by another task, so block
-    add_waiter(&mutex->wait_queue, current_pid, 0);
-    
-    // Re-enable interrupts before blocking
-    __asm__ volatile("sti");
-    
-    // Block the current task
-    block_task(current_pid);
+    // Mutex is locked by another task, so block until it is released
+    uint64_t wait_start = rdtsc();
+    trace_mutex_contend(mutex, mutex->owner);
+    while (mutex->owner != 0) {
+        // Blocked before the lock is dropped: an unlock in between wakes us
+        add_waiter(&mutex->wait_queue, current_pid, 0);
+        prepare_to_block();
+        spin_unlock_irqrestore(&mutex->lock, flags);
+        schedule();
+        
+        // Still queued if we were preempted rather than woken
+        spin_lock_irqsave(&mutex->lock, flags);
+        remove_waiter(&mutex->wait_queue, current_pid);
+    }
     
-    // When we're unblocked, the mutex should be ours
     mutex->owner = current_pid;
     mutex->lock_count = 1;
+    spin_unlock_irqrestore(&mutex->lock, flags);
+    
+    trace_mutex_acquire(mutex);
+    lockstat_ipc_acquired(mutex, wait_start, true);
+    ipc_lat_record(mutex->lat_id, rdtsc() - wait_start);
     
     return 0;
 }
@@ -359,14 +394,14 @@ int mutex_trylock(mutex_t mutex) {
     }
     
     pid_t current_pid = get_current_pid();
+    uint64_t flags;
     
-    // Disable interrupts for atomic operation
-    __asm__ volatile("cli");
+    spin_lock_irqsave(&mutex->lock, flags);
     
     // If mutex is already owned by current task, increment lock count
     if (mutex->owner == current_pid) {
         mutex->lock_count++;
-        __asm__ volatile("sti");
+        spin_unlock_irqrestore(&mutex->lock, flags);
         return 0;
     }
     
@@ -374,12 +409,13 @@ int mutex_trylock(mutex_t mutex) {
     if (mutex->owner == 0) {
         mutex->owner = current_pid;
         mutex->lock_count = 1;
-        __asm__ volatile("sti");
+        lockstat_ipc_acquired(mutex, 0, false);
+        spin_unlock_irqrestore(&mutex->lock, flags);
         return 0;
     }
     
     // Mutex is locked by another task
-    __asm__ volatile("sti");
+    spin_unlock_irqrestore(&mutex->lock, flags);
     return -1;
 }
 
@@ -391,14 +427,16 @@ int mutex_unlock(mutex_t mutex) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_MUTEX_OPS);
+    
     pid_t current_pid = get_current_pid();
+    uint64_t flags;
     
-    // Disable interrupts for atomic operation
-    __asm__ volatile("cli");
+    spin_lock_irqsave(&mutex->lock, flags);
     
     // Check if we own the mutex
     if (mutex->owner != current_pid) {
-        __asm__ volatile("sti");
+        spin_unlock_irqrestore(&mutex->lock, flags);
         return -1;
     }
     
@@ -407,6 +445,7 @@ int mutex_unlock(mutex_t mutex) {
     
     // If lock count reaches 0, release the mutex
     if (mutex->lock_count == 0) {
+        lockstat_ipc_released(mutex);
         mutex->owner = 0;
         
         // Wake up one waiter if any
@@ -415,7 +454,10 @@ int mutex_unlock(mutex_t mutex) {
         }
     }
     
-    __asm__ volatile("sti");
+    spin_unlock_irqrestore(&mutex->lock, flags);
+    
+    // Hand the CPU to the woken waiter right away if it outranks us
+    preempt_check_resched();
     return 0;
 }
 
@@ -436,13 +478,17 @@ semaphore_t create_semaphore(const char* name, uint32_t initial_value) {
     sem->header.ref_count = 1;
     sem->header.destroy_fn = destroy_semaphore;
     
+    spin_lock_init(&sem->lock);
     sem->value = initial_value;
     sem->max_value = 0x7FFFFFFF; // INT32_MAX
     
     // Initialize wait queue
     init_wait_queue(&sem->wait_queue, name, WAIT_QUEUE_SEMAPHORE, sem);
+    lockstat_ipc_init(sem, LOCKSTAT_SEMAPHORE);
+    sem->lat_id = ipc_lat_register(IPC_LAT_SEM_WAIT, sem->header.name);
     
     semaphore_count++;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_CREATED, 1, PCPU_IPC_SEMAPHORES, 1);
     return sem;
 }
 
@@ -457,12 +503,17 @@ void destroy_semaphore(void* sem_ptr) {
     }
     
     // Wake up all waiters
+    uint64_t flags;
+    spin_lock_irqsave(&sem->lock, flags);
     wake_waiters(&sem->wait_queue, 0);
+    spin_unlock_irqrestore(&sem->lock, flags);
+    ipc_lat_unregister(sem->lat_id);
     
     // Clear the semaphore
     memset(sem, 0, sizeof(struct semaphore));
     
     semaphore_count--;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_DESTROYED, 1, PCPU_IPC_SEMAPHORES, -1);
 }
 
 /*
@@ -473,28 +524,41 @@ int semaphore_wait(semaphore_t sem) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_SEMAPHORE_OPS);
+    
     pid_t current_pid = get_current_pid();
+    uint64_t flags;
     
-    // Disable interrupts for atomic operation
-    __asm__ volatile("cli");
+    spin_lock_irqsave(&sem->lock, flags);
     
     // If semaphore value is greater than 0, decrement and return
     if (sem->value > 0) {
         sem->value--;
-        __asm__ volatile("sti");
+        lockstat_ipc_acquired(sem, 0, false);
+        spin_unlock_irqrestore(&sem->lock, flags);
+        ipc_lat_record(sem->lat_id, 0);
         return 0;
     }
     
-    // Semaphore is at 0, need to block
-    add_waiter(&sem->wait_queue, current_pid, 0);
-    
-    // Re-enable interrupts before blocking
-    __asm__ volatile("sti");
+    // Semaphore is at 0, block until a post raises it
+    uint64_t wait_start = rdtsc();
+    while (sem->value == 0) {
+        // Blocked before the lock is dropped: a post in between wakes us
+        add_waiter(&sem->wait_queue, current_pid, 0);
+        prepare_to_block();
+        spin_unlock_irqrestore(&sem->lock, flags);
+        schedule();
+        
+        // Still queued if we were preempted rather than woken
+        spin_lock_irqsave(&sem->lock, flags);
+        remove_waiter(&sem->wait_queue, current_pid);
+    }
     
-    // Block the current task
-    block_task(current_pid);
+    sem->value--;
+    spin_unlock_irqrestore(&sem->lock, flags);
     
-    // When we're unblocked, the semaphore has been decremented for us
+    lockstat_ipc_acquired(sem, wait_start, true);
+    ipc_lat_record(sem->lat_id, rdtsc() - wait_start);
     return 0;
 }
 
@@ -506,18 +570,20 @@ int semaphore_trywait(semaphore_t sem) {
         return -1;
     }
     
-    // Disable interrupts for atomic operation
-    __asm__ volatile("cli");
+    uint64_t flags;
+    
+    spin_lock_irqsave(&sem->lock, flags);
     
     // If semaphore value is greater than 0, decrement and return success
     if (sem->value > 0) {
         sem->value--;
-        __asm__ volatile("sti");
+        lockstat_ipc_acquired(sem, 0, false);
+        spin_unlock_irqrestore(&sem->lock, flags);
         return 0;
     }
     
     // Semaphore is at 0, cannot wait
-    __asm__ volatile("sti");
+    spin_unlock_irqrestore(&sem->lock, flags);
     return -1;
 }
 
@@ -529,24 +595,27 @@ int semaphore_post(semaphore_t sem) {
         return -1;
     }
     
-    // Disable interrupts for atomic operation
-    __asm__ volatile("cli");
+    this_cpu_counter_inc(PCPU_IPC_SEMAPHORE_OPS);
+    
+    uint64_t flags;
+    spin_lock_irqsave(&sem->lock, flags);
     
     // Check if we're at maximum value
     if (sem->value == sem->max_value) {
-        __asm__ volatile("sti");
+        spin_unlock_irqrestore(&sem->lock, flags);
         return -1;
     }
     
-    // If there are waiters, wake one instead of incrementing
+    // The woken waiter takes the count when it runs
+    sem->value++;
     if (sem->wait_queue.waiter_count > 0) {
         wake_waiters(&sem->wait_queue, 1);
-    } else {
-        // No waiters, just increment the value
-        sem->value++;
     }
     
-    __asm__ volatile("sti");
+    spin_unlock_irqrestore(&sem->lock, flags);
+    
+    // Hand the CPU to the woken waiter right away if it outranks us
+    preempt_check_resched();
     return 0;
 }
 
@@ -558,30 +627,36 @@ int semaphore_getvalue(semaphore_t sem, int* value) {
         return -1;
     }
     
-    // Disable interrupts for atomic read
-    __asm__ volatile("cli");
+    uint64_t flags;
+    spin_lock_irqsave(&sem->lock, flags);
     *value = sem->value;
-    __asm__ volatile("sti");
+    spin_unlock_irqrestore(&sem->lock, flags);
     
     return 0;
 }
 
 /*
  * Periodic check for timeouts in all wait queues
- * (Called from timer interrupt handler)
+ * (Called from a worker thread, see register_timeout_checker())
  */
 void check_all_timeouts(void) {
+    uint64_t flags;
+    
     // Check mutex timeouts
     for (uint32_t i = 0; i < MAX_WAIT_QUEUES; i++) {
         if (mutex_pool[i].header.type == IPC_TYPE_MUTEX) {
+            spin_lock_irqsave(&mutex_pool[i].lock, flags);
             check_timeouts(&mutex_pool[i].wait_queue);
+            spin_unlock_irqrestore(&mutex_pool[i].lock, flags);
         }
     }
     
     // Check semaphore timeouts
     for (uint32_t i = 0; i < MAX_WAIT_QUEUES; i++) {
         if (semaphore_pool[i].header.type == IPC_TYPE_SEMAPHORE) {
+            spin_lock_irqsave(&semaphore_pool[i].lock, flags);
             check_timeouts(&semaphore_pool[i].wait_queue);
+            spin_unlock_irqrestore(&semaphore_pool[i].lock, flags);
         }
     }
     
@@ -613,6 +688,9 @@ void init_ipc(void) {
         kernel_panic("Failed to create kernel semaphore");
     }
     
+    // Sweep wait queue timeouts outside the tick
+    register_timeout_checker(check_all_timeouts);
+    
     kernel_printf("IPC subsystem initialized: %d mutexes, %d semaphores\n", 
                  mutex_count, semaphore_count);
 }
@@ -9,6 +9,11 @@
 #include <edgex/memory.h>
 #include <edgex/scheduler.h>
 #include <edgex/ipc.h>
+#include <edgex/ipc/common.h>
+#include <edgex/percpu.h>
+#include <edgex/workqueue.h>
+#include <edgex/lockstat.h>
+#include <edgex/ipc/latency.h>
 
 /* Forward declarations of subsystem initialization functions */
 extern void init_mutex_subsystem(void);
@@ -28,40 +33,8 @@ extern void cleanup_task_shared_memory(pid_t pid);
 extern void check_event_timeouts(void);
 extern void check_message_timeouts(void);
 
-/* IPC statistics */
-typedef struct ipc_stats {
-    /* General stats */
-    uint64_t ipc_objects_created;
-    uint64_t ipc_objects_destroyed;
-    
-    /* Object counts */
-    uint32_t mutex_count;
-    uint32_t semaphore_count;
-    uint32_t event_count;
-    uint32_t event_set_count;
-    uint32_t message_queue_count;
-    uint32_t shared_memory_count;
-    
-    /* Operation counts */
-    uint64_t mutex_operations;
-    uint64_t semaphore_operations;
-    uint64_t event_operations;
-    uint64_t message_operations;
-    uint64_t shared_memory_operations;
-    
-    /* Wait statistics */
-    uint64_t total_wait_time;
-    uint32_t active_waiters;
-    uint32_t timeouts;
-    
-    /* Error counts */
-    uint32_t allocation_failures;
-    uint32_t permission_failures;
-    uint32_t timeout_failures;
-} ipc_stats_t;
-
-/* Global IPC statistics */
-static ipc_stats_t ipc_stats;
+/* Counter values at the last reset_ipc_stats(), subtracted on read */
+static int64_t ipc_stats_base[PCPU_NR_COUNTERS];
 
 /* IPC subsystem initialization status */
 static bool mutex_initialized = false;
@@ -85,30 +58,64 @@ static void record_error(const char* format, ...) {
     kernel_printf("IPC INIT ERROR: %s\n", last_error);
 }
 
+/* Per-CPU counter of each IPC_STAT_* type */
+static const pcpu_counter_t ipc_stat_counters[] = {
+    [IPC_STAT_OBJECT_CREATED] = PCPU_IPC_OBJECTS_CREATED,
+    [IPC_STAT_OBJECT_DESTROYED] = PCPU_IPC_OBJECTS_DESTROYED,
+    [IPC_STAT_MUTEX_OPERATIONS] = PCPU_IPC_MUTEX_OPS,
+    [IPC_STAT_SEMAPHORE_OPERATIONS] = PCPU_IPC_SEMAPHORE_OPS,
+    [IPC_STAT_EVENT_OPERATIONS] = PCPU_IPC_EVENT_OPS,
+    [IPC_STAT_MESSAGE_OPERATIONS] = PCPU_IPC_MESSAGE_OPS,
+    [IPC_STAT_SHARED_MEMORY_OPERATIONS] = PCPU_IPC_SHARED_MEMORY_OPS,
+    [IPC_STAT_WAIT_TIME] = PCPU_IPC_WAIT_TIME,
+    [IPC_STAT_ACTIVE_WAITERS] = PCPU_IPC_ACTIVE_WAITERS,
+    [IPC_STAT_TIMEOUTS] = PCPU_IPC_TIMEOUTS,
+    [IPC_STAT_ALLOCATION_FAILURES] = PCPU_IPC_ALLOCATION_FAILURES,
+    [IPC_STAT_PERMISSION_FAILURES] = PCPU_IPC_PERMISSION_FAILURES,
+    [IPC_STAT_TIMEOUT_FAILURES] = PCPU_IPC_TIMEOUT_FAILURES,
+};
+
+/* Per-CPU object count of each IPC_TYPE_* */
+static const pcpu_counter_t ipc_type_counters[] = {
+    [IPC_TYPE_MUTEX] = PCPU_IPC_MUTEXES,
+    [IPC_TYPE_SEMAPHORE] = PCPU_IPC_SEMAPHORES,
+    [IPC_TYPE_EVENT] = PCPU_IPC_EVENTS,
+    [IPC_TYPE_EVENT_SET] = PCPU_IPC_EVENT_SETS,
+    [IPC_TYPE_MESSAGE_QUEUE] = PCPU_IPC_MESSAGE_QUEUES,
+    [IPC_TYPE_SHARED_MEMORY] = PCPU_IPC_SHARED_MEMORY,
+};
+
 /*
  * Initialize IPC statistics
  */
 static void init_ipc_stats(void) {
-    memset(&ipc_stats, 0, sizeof(ipc_stats_t));
+    memset(ipc_stats_base, 0, sizeof(ipc_stats_base));
 }
 
 /*
  * Update IPC statistics
+ *
+ * Counts go to the running CPU's counters, so concurrent updates from
+ * different CPUs never share a cache line.
  */
 void update_ipc_stats(int stat_type, int value) {
-    // In a real implementation, this would be protected with a mutex
-    
-    switch (stat_type) {
-        case IPC_STAT_OBJECT_CREATED:
-            ipc_stats.ipc_objects_created++;
-            break;
-        case IPC_STAT_OBJECT_DESTROYED:
-            ipc_stats.ipc_objects_destroyed++;
-            break;
-        // Add cases for other statistics as needed
-        default:
-            break;
+    if (stat_type < IPC_STAT_OBJECT_CREATED || stat_type > IPC_STAT_TIMEOUT_FAILURES) {
+        return;
     }
+    this_cpu_counter_add(ipc_stat_counters[stat_type], value);
+}
+
+/*
+ * Count an IPC object created (delta 1) or destroyed (delta -1)
+ *
+ * The total and the count of the type change as one update.
+ */
+void update_ipc_object_count(ipc_object_type_t type, int delta) {
+    if (type < IPC_TYPE_MUTEX || type > IPC_TYPE_SHARED_MEMORY) {
+        return;
+    }
+    this_cpu_counters_add2(delta > 0 ? PCPU_IPC_OBJECTS_CREATED : PCPU_IPC_OBJECTS_DESTROYED, 1,
+                           ipc_type_counters[type], delta > 0 ? 1 : -1);
 }
 
 /*
@@ -134,7 +141,7 @@ void cleanup_task_ipc(pid_t pid) {
  * Check all timeouts for IPC objects
  */
 void check_ipc_timeouts(void) {
-    // This is called periodically by the scheduler
+    // This is called periodically from a worker thread
     
     // Check timeouts for various IPC objects
     check_event_timeouts();
@@ -254,6 +261,7 @@ bool init_ipc_subsystems(void) {
     
     // Initialize statistics tracking
     init_ipc_stats();
+    init_ipc_latency();
     
     // Initialize subsystems in dependency order
     if (!initialize_mutex_subsystem()) {
@@ -279,7 +287,7 @@ bool init_ipc_subsystems(void) {
     // Register the task cleanup handler with the scheduler
     register_task_cleanup_handler(cleanup_task_ipc);
     
-    // Register the timeout checker with the scheduler
+    // Sweep IPC timeouts periodically from a worker thread
     register_timeout_checker(check_ipc_timeouts);
     
     kernel_printf("IPC subsystems initialized successfully\n");
@@ -288,20 +296,51 @@ bool init_ipc_subsystems(void) {
 
 /*
  * Get the current IPC statistics
+ *
+ * A snapshot of the per-CPU counters: an object created or destroyed is
+ * either in both the totals and the count of its type, or in neither.
  */
 void get_ipc_stats(ipc_stats_t* stats) {
+    int64_t counters[PCPU_NR_COUNTERS];
+    
     if (!stats) {
         return;
     }
     
-    // Copy the current statistics
-    *stats = ipc_stats;
+    pcpu_counters_snapshot(counters);
+    for (uint32_t i = 0; i < PCPU_NR_COUNTERS; i++) {
+        counters[i] -= ipc_stats_base[i];
+    }
+    
+    memset(stats, 0, sizeof(*stats));
+    stats->ipc_objects_created = (uint64_t)counters[PCPU_IPC_OBJECTS_CREATED];
+    stats->ipc_objects_destroyed = (uint64_t)counters[PCPU_IPC_OBJECTS_DESTROYED];
+    stats->mutex_count = (uint32_t)counters[PCPU_IPC_MUTEXES];
+    stats->semaphore_count = (uint32_t)counters[PCPU_IPC_SEMAPHORES];
+    stats->event_count = (uint32_t)counters[PCPU_IPC_EVENTS];
+    stats->event_set_count = (uint32_t)counters[PCPU_IPC_EVENT_SETS];
+    stats->message_queue_count = (uint32_t)counters[PCPU_IPC_MESSAGE_QUEUES];
+    stats->shared_memory_count = (uint32_t)counters[PCPU_IPC_SHARED_MEMORY];
+    stats->mutex_operations = (uint64_t)counters[PCPU_IPC_MUTEX_OPS];
+    stats->semaphore_operations = (uint64_t)counters[PCPU_IPC_SEMAPHORE_OPS];
+    stats->event_operations = (uint64_t)counters[PCPU_IPC_EVENT_OPS];
+    stats->message_operations = (uint64_t)counters[PCPU_IPC_MESSAGE_OPS];
+    stats->shared_memory_operations = (uint64_t)counters[PCPU_IPC_SHARED_MEMORY_OPS];
+    stats->total_wait_time = (uint64_t)counters[PCPU_IPC_WAIT_TIME];
+    stats->active_waiters = (uint32_t)counters[PCPU_IPC_ACTIVE_WAITERS];
+    stats->timeouts = (uint32_t)counters[PCPU_IPC_TIMEOUTS];
+    stats->allocation_failures = (uint32_t)counters[PCPU_IPC_ALLOCATION_FAILURES];
+    stats->permission_failures = (uint32_t)counters[PCPU_IPC_PERMISSION_FAILURES];
+    stats->timeout_failures = (uint32_t)counters[PCPU_IPC_TIMEOUT_FAILURES];
 }
 
 /*
  * Print IPC statistics
  */
 void print_ipc_stats(void) {
+    ipc_stats_t ipc_stats;
+    get_ipc_stats(&ipc_stats);
+    
     kernel_printf("===== IPC SUBSYSTEM STATISTICS =====\n");
     kernel_printf("Total objects created: %llu\n", ipc_stats.ipc_objects_created);
     kernel_printf("Total objects destroyed: %llu\n", ipc_stats.ipc_objects_destroyed);
@@ -358,11 +397,35 @@ void dump_ipc_objects(void) {
     kernel_printf("==========================\n");
 }
 
+/* Lock classes in dump_lock_stats() */
+#define LOCK_STATS_TOP 20
+
+/*
+ * Dump the most contended lock classes for debugging
+ */
+void dump_lock_stats(void) {
+    kernel_printf("===== LOCK CONTENTION =====\n");
+    lockstat_report(LOCK_STATS_TOP);
+    kernel_printf("===========================\n");
+}
+
+/*
+ * Dump the latency histograms of the IPC objects for debugging
+ */
+void dump_ipc_latency(void) {
+    kernel_printf("===== IPC LATENCY =====\n");
+    ipc_lat_report();
+    kernel_printf("=======================\n");
+}
+
 /*
  * Check the health of the IPC subsystems
  */
 bool check_ipc_health(void) {
     bool healthy = true;
+    ipc_stats_t ipc_stats;
+    
+    get_ipc_stats(&ipc_stats);
     
     // Verify that all expected subsystems are initialized
     if (!mutex_initialized) {
@@ -417,19 +480,22 @@ const char* get_last_ipc_error(void) {
  * Reset IPC statistics
  */
 void reset_ipc_stats(void) {
-    // Keep count information but reset operation stats
-    ipc_stats.mutex_operations = 0;
-    ipc_stats.semaphore_operations = 0;
-    ipc_stats.event_operations = 0;
-    ipc_stats.message_operations = 0;
-    ipc_stats.shared_memory_operations = 0;
-    
-    ipc_stats.total_wait_time = 0;
-    ipc_stats.timeouts = 0;
-    
-    ipc_stats.allocation_failures = 0;
-    ipc_stats.permission_failures = 0;
-    ipc_stats.timeout_failures = 0;
+    static const pcpu_counter_t reset_counters[] = {
+        PCPU_IPC_MUTEX_OPS, PCPU_IPC_SEMAPHORE_OPS, PCPU_IPC_EVENT_OPS,
+        PCPU_IPC_MESSAGE_OPS, PCPU_IPC_SHARED_MEMORY_OPS,
+        PCPU_IPC_WAIT_TIME, PCPU_IPC_TIMEOUTS,
+        PCPU_IPC_ALLOCATION_FAILURES, PCPU_IPC_PERMISSION_FAILURES, PCPU_IPC_TIMEOUT_FAILURES,
+    };
+    int64_t counters[PCPU_NR_COUNTERS];
+    
+    // Keep count information but reset operation stats; other CPUs own
+    // the counters, so move the baseline rather than clearing them
+    pcpu_counters_snapshot(counters);
+    for (uint32_t i = 0; i < sizeof(reset_counters) / sizeof(reset_counters[0]); i++) {
+        ipc_stats_base[reset_counters[i]] = counters[reset_counters[i]];
+    }
+    
+    ipc_lat_reset();
     
     kernel_printf("IPC statistics reset\n");
 }
@@ -0,0 +1,292 @@
+/*
+ * EdgeX OS - IPC Latency Histograms
+ *
+ * This file implements the per-object IPC latency histograms (see
+ * include/edgex/ipc/latency.h). Every CPU owns an array of histograms,
+ * one per tracked object, and only ever writes its own; readers add
+ * them up.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/cpu.h>
+#include <edgex/preempt.h>
+#include <edgex/tsc.h>
+#include <edgex/ipc/latency.h>
+
+/* Object table slot states */
+#define LAT_SLOT_FREE       0
+#define LAT_SLOT_CLAIMED    1
+#define LAT_SLOT_READY      2
+
+typedef struct {
+    volatile uint32_t state;
+    ipc_lat_op_t op;
+    char name[IPC_LAT_NAME_LEN];
+} ipc_lat_object_t;
+
+/* One CPU's counts for one object */
+typedef struct {
+    uint32_t counts[IPC_LAT_BUCKETS];
+    uint64_t sum;                /* Cycles */
+    uint64_t max;
+} ipc_lat_hist_t;
+
+static const char* const ipc_lat_op_names[IPC_LAT_OPS] = {
+    "mutex wait", "semaphore wait", "event signal-to-wake", "message send-to-receive"
+};
+
+static ipc_lat_object_t ipc_lat_objects[IPC_LAT_MAX_OBJECTS];
+
+/* Per CPU, IPC_LAT_MAX_OBJECTS histograms (NULL: not recording) */
+static ipc_lat_hist_t* ipc_lat_cpus[MAX_CPUS];
+
+static uint32_t ipc_lat_untracked;
+
+/*
+ * Bucket of a value: exact below IPC_LAT_SUB_BUCKETS, then
+ * IPC_LAT_SUB_BUCKETS linear buckets per power of two
+ */
+static inline uint32_t ipc_lat_bucket(uint64_t cycles) {
+    if (cycles < IPC_LAT_SUB_BUCKETS) {
+        return (uint32_t)cycles;
+    }
+
+    uint32_t exp = 63 - (uint32_t)__builtin_clzll(cycles);
+    uint32_t sub = (uint32_t)(cycles >> (exp - IPC_LAT_SUB_BITS)) & (IPC_LAT_SUB_BUCKETS - 1);
+    uint32_t bucket = (exp - IPC_LAT_SUB_BITS + 1) * IPC_LAT_SUB_BUCKETS + sub;
+
+    return bucket < IPC_LAT_BUCKETS ? bucket : IPC_LAT_BUCKETS - 1;
+}
+
+/*
+ * Smallest value of a bucket
+ */
+static uint64_t ipc_lat_bucket_start(uint32_t bucket) {
+    if (bucket < IPC_LAT_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    uint32_t exp = bucket / IPC_LAT_SUB_BUCKETS + IPC_LAT_SUB_BITS - 1;
+    uint64_t sub = bucket % IPC_LAT_SUB_BUCKETS;
+    return (IPC_LAT_SUB_BUCKETS + sub) << (exp - IPC_LAT_SUB_BITS);
+}
+
+/*
+ * Allocate the histograms of the CPUs online now
+ */
+void init_ipc_latency(void) {
+    cpumask_t online = cpu_online_mask();
+    uint32_t cpus = 0;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpumask_test(online, cpu) || ipc_lat_cpus[cpu]) {
+            continue;
+        }
+        ipc_lat_hist_t* hists = kzalloc(IPC_LAT_MAX_OBJECTS * sizeof(ipc_lat_hist_t));
+        if (!hists) {
+            kernel_printf("ipc: no memory for latency histograms on CPU %u\n", cpu);
+            continue;
+        }
+        __atomic_store_n(&ipc_lat_cpus[cpu], hists, __ATOMIC_RELEASE);
+        cpus++;
+    }
+
+    kernel_printf("ipc: latency histograms for %u objects on %u CPUs\n",
+                  IPC_LAT_MAX_OBJECTS, cpus);
+}
+
+/*
+ * Clear the counts of one object on every CPU
+ */
+static void ipc_lat_clear(ipc_lat_id_t id) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (ipc_lat_cpus[cpu]) {
+            memset(&ipc_lat_cpus[cpu][id], 0, sizeof(ipc_lat_hist_t));
+        }
+    }
+}
+
+/*
+ * Claim a histogram for a new object
+ */
+ipc_lat_id_t ipc_lat_register(ipc_lat_op_t op, const char* name) {
+    for (ipc_lat_id_t id = 0; id < IPC_LAT_MAX_OBJECTS; id++) {
+        ipc_lat_object_t* obj = &ipc_lat_objects[id];
+        uint32_t expected = LAT_SLOT_FREE;
+
+        if (!__atomic_compare_exchange_n(&obj->state, &expected, LAT_SLOT_CLAIMED, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        uint32_t len = 0;
+        while (name && name[len] && len < IPC_LAT_NAME_LEN - 1) {
+            obj->name[len] = name[len];
+            len++;
+        }
+        obj->name[len] = '\0';
+        obj->op = op;
+        ipc_lat_clear(id);
+
+        __atomic_store_n(&obj->state, LAT_SLOT_READY, __ATOMIC_RELEASE);
+        return id;
+    }
+
+    __atomic_fetch_add(&ipc_lat_untracked, 1, __ATOMIC_RELAXED);
+    return IPC_LAT_NONE;
+}
+
+/*
+ * Release the histogram of a destroyed object
+ */
+void ipc_lat_unregister(ipc_lat_id_t id) {
+    if (id < 0 || id >= IPC_LAT_MAX_OBJECTS) {
+        return;
+    }
+    __atomic_store_n(&ipc_lat_objects[id].state, LAT_SLOT_FREE, __ATOMIC_RELEASE);
+}
+
+/*
+ * Count an operation on this CPU (task context)
+ *
+ * Only this CPU writes its histograms, and preemption is off so the task
+ * cannot migrate halfway, which makes plain increments safe.
+ */
+void ipc_lat_record(ipc_lat_id_t id, uint64_t cycles) {
+    if (id < 0 || id >= IPC_LAT_MAX_OBJECTS) {
+        return;
+    }
+
+    preempt_disable();
+
+    ipc_lat_hist_t* hists = ipc_lat_cpus[smp_processor_id()];
+    if (hists) {
+        ipc_lat_hist_t* hist = &hists[id];
+        hist->counts[ipc_lat_bucket(cycles)]++;
+        hist->sum += cycles;
+        if (cycles > hist->max) {
+            hist->max = cycles;
+        }
+    }
+
+    preempt_enable_no_resched();
+}
+
+/*
+ * Count of a bucket over all CPUs
+ */
+static uint64_t ipc_lat_bucket_count(ipc_lat_id_t id, uint32_t bucket) {
+    uint64_t count = 0;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        ipc_lat_hist_t* hists = __atomic_load_n(&ipc_lat_cpus[cpu], __ATOMIC_ACQUIRE);
+        if (hists) {
+            count += hists[id].counts[bucket];
+        }
+    }
+    return count;
+}
+
+/*
+ * Upper bound, in cycles, of the bucket at which the running count
+ * reaches a fraction (per mille) of the total
+ */
+static uint64_t ipc_lat_percentile(ipc_lat_id_t id, uint64_t total, uint32_t permille,
+                                   uint64_t max) {
+    uint64_t target = (total * permille + 999) / 1000;
+    uint64_t seen = 0;
+
+    for (uint32_t bucket = 0; bucket < IPC_LAT_BUCKETS - 1; bucket++) {
+        seen += ipc_lat_bucket_count(id, bucket);
+        if (seen >= target) {
+            uint64_t end = ipc_lat_bucket_start(bucket + 1) - 1;
+            return end < max ? end : max;
+        }
+    }
+    return max;
+}
+
+/*
+ * Merge the histograms of an object across CPUs
+ */
+int ipc_lat_summary(ipc_lat_id_t id, ipc_lat_summary_t* summary) {
+    if (id < 0 || id >= IPC_LAT_MAX_OBJECTS ||
+        __atomic_load_n(&ipc_lat_objects[id].state, __ATOMIC_ACQUIRE) != LAT_SLOT_READY) {
+        return -1;
+    }
+
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        ipc_lat_hist_t* hists = __atomic_load_n(&ipc_lat_cpus[cpu], __ATOMIC_ACQUIRE);
+        if (!hists) {
+            continue;
+        }
+
+        ipc_lat_hist_t* hist = &hists[id];
+        for (uint32_t bucket = 0; bucket < IPC_LAT_BUCKETS; bucket++) {
+            total += hist->counts[bucket];
+        }
+        sum += hist->sum;
+        if (hist->max > max) {
+            max = hist->max;
+        }
+    }
+
+    // Counts keep moving while they are read: percentiles are approximate
+    memset(summary, 0, sizeof(*summary));
+    memcpy(summary->name, ipc_lat_objects[id].name, IPC_LAT_NAME_LEN);
+    summary->op = ipc_lat_objects[id].op;
+    summary->count = total;
+    if (total) {
+        summary->avg_ns = tsc_to_ns(sum / total);
+        summary->max_ns = tsc_to_ns(max);
+        summary->p50_ns = tsc_to_ns(ipc_lat_percentile(id, total, 500, max));
+        summary->p99_ns = tsc_to_ns(ipc_lat_percentile(id, total, 990, max));
+        summary->p999_ns = tsc_to_ns(ipc_lat_percentile(id, total, 999, max));
+    }
+    return 0;
+}
+
+/*
+ * Clear every histogram
+ */
+void ipc_lat_reset(void) {
+    for (ipc_lat_id_t id = 0; id < IPC_LAT_MAX_OBJECTS; id++) {
+        ipc_lat_clear(id);
+    }
+}
+
+/*
+ * Print the objects with recorded operations
+ */
+void ipc_lat_report(void) {
+    ipc_lat_summary_t summary;
+
+    for (uint32_t op = 0; op < IPC_LAT_OPS; op++) {
+        bool header = false;
+
+        for (ipc_lat_id_t id = 0; id < IPC_LAT_MAX_OBJECTS; id++) {
+            if (ipc_lat_summary(id, &summary) != 0 || summary.op != op || summary.count == 0) {
+                continue;
+            }
+
+            if (!header) {
+                kernel_printf("%s (ns):\n", ipc_lat_op_names[op]);
+                kernel_printf("  %-24s %10s %10s %10s %10s %10s %10s\n",
+                              "OBJECT", "COUNT", "AVG", "P50", "P99", "P99.9", "MAX");
+                header = true;
+            }
+            kernel_printf("  %-24s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+                          summary.name, summary.count, summary.avg_ns, summary.p50_ns,
+                          summary.p99_ns, summary.p999_ns, summary.max_ns);
+        }
+    }
+
+    if (ipc_lat_untracked) {
+        kernel_printf("%u objects not tracked (table full)\n", ipc_lat_untracked);
+    }
+}
@@ -0,0 +1,421 @@
+/*
+ * EdgeX OS - Kernel Log
+ *
+ * This file implements the per-CPU log rings and the klogd drain. Each
+ * ring has one producer, its CPU with interrupts off, and positions that
+ * only grow. A reader claims a record by moving tail past it with a
+ * compare-and-swap after copying it out; a producer that overwrites old
+ * records moves tail the same way before reusing the space, so a reader
+ * whose copy was overwritten sees its claim fail and drops the copy.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/spinlock.h>
+#include <edgex/scheduler.h>
+#include <edgex/tsc.h>
+#include <edgex/klog.h>
+
+#define KLOG_RING_MASK          (KLOG_RING_SIZE - 1)
+#define KLOG_RENDER_SIZE        4096
+
+typedef struct {
+    volatile uint64_t head;      /* Producer */
+    uint8_t pad0[56];
+    volatile uint64_t tail;      /* Readers, and the producer when overwriting */
+    uint8_t pad1[56];
+    klog_stats_t stats;
+    uint8_t data[KLOG_RING_SIZE];
+} __attribute__((aligned(64))) klog_ring_t;
+
+/* A record copied out of a ring */
+typedef struct {
+    bool valid;
+    klog_record_t rec;
+    char text[KLOG_MAX_MSG];
+} klog_entry_t;
+
+static klog_ring_t klog_rings[MAX_CPUS];
+static volatile uint64_t klog_seq;
+static volatile bool klog_async;             /* klogd is running */
+static klog_policy_t klog_policy = KLOG_OVERWRITE;
+
+static klog_console_t klog_vga_console = {
+    .name = "vga",
+    .write = vga_console_write,
+    .flush = NULL,
+    .next = NULL
+};
+
+/*
+ * Consoles are written under console_lock. It is a raw lock (no
+ * preemption count) because the direct path runs before the per-CPU
+ * data exists.
+ */
+static spinlock_t console_lock = SPINLOCK_INIT;
+static klog_console_t* klog_consoles = &klog_vga_console;
+static bool console_line_start = true;
+
+/* klogd's merge state: the next record of each CPU */
+static klog_entry_t klog_pending[MAX_CPUS];
+static char klog_render_buf[KLOG_RENDER_SIZE];
+static size_t klog_render_len;
+
+static inline uint32_t klog_record_size(uint32_t len) {
+    return (uint32_t)((sizeof(klog_record_t) + len + 7) & ~7UL);
+}
+
+static void console_write_locked(const char* buf, size_t len) {
+    for (klog_console_t* con = klog_consoles; con; con = con->next) {
+        con->write(buf, len);
+    }
+}
+
+/*
+ * Format a record into the render buffer: a timestamp at the start of
+ * each line, then the text
+ */
+static void klog_render(const klog_record_t* rec, const char* text, char* out, size_t* out_len) {
+    size_t len = *out_len;
+
+    if (console_line_start) {
+        uint64_t ns = tsc_to_ns(rec->tsc);
+        len += (size_t)snprintf(out + len, KLOG_RENDER_SIZE - len, "[%5llu.%06llu] ",
+                                ns / 1000000000ULL, ns / 1000 % 1000000ULL);
+    }
+    memcpy(out + len, text, rec->len);
+    len += rec->len;
+    console_line_start = rec->len > 0 && text[rec->len - 1] == '\n';
+    *out_len = len;
+}
+
+/*
+ * Skip the record at position t; returns the position after it
+ */
+static uint64_t klog_ring_next(klog_ring_t* ring, uint64_t t) {
+    uint32_t off = (uint32_t)(t & KLOG_RING_MASK);
+    uint32_t room = KLOG_RING_SIZE - off;
+
+    // Too little room for a header at the end is an implicit pad
+    if (room < sizeof(klog_record_t)) {
+        return t + room;
+    }
+    const klog_record_t* rec = (const klog_record_t*)&ring->data[off];
+    uint16_t len = rec->len;
+    if (len == KLOG_PAD) {
+        return t + room;
+    }
+    return t + klog_record_size(len < KLOG_MAX_MSG ? len : KLOG_MAX_MSG);
+}
+
+/*
+ * Producer: append a record (interrupts off, on the ring's CPU)
+ */
+static void klog_ring_put(klog_ring_t* ring, uint8_t level, uint8_t cpu, const char* text,
+                          uint32_t len) {
+    uint32_t size = klog_record_size(len);
+    uint64_t head = ring->head;
+    uint32_t off = (uint32_t)(head & KLOG_RING_MASK);
+    uint32_t pad = KLOG_RING_SIZE - off < size ? KLOG_RING_SIZE - off : 0;
+    uint64_t need = pad + size;
+
+    for (;;) {
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (KLOG_RING_SIZE - (head - tail) >= need) {
+            break;
+        }
+        if (klog_policy == KLOG_DROP) {
+            ring->stats.dropped++;
+            return;
+        }
+
+        // Claim the oldest record for ourselves; a reader may beat us to it
+        if (__atomic_compare_exchange_n(&ring->tail, &tail, klog_ring_next(ring, tail), false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            ring->stats.overwritten++;
+        }
+    }
+
+    if (pad >= sizeof(klog_record_t)) {
+        ((klog_record_t*)&ring->data[off])->len = KLOG_PAD;
+    }
+
+    klog_record_t* rec = (klog_record_t*)&ring->data[(head + pad) & KLOG_RING_MASK];
+    rec->seq = __atomic_fetch_add(&klog_seq, 1, __ATOMIC_RELAXED);
+    rec->tsc = rdtsc();
+    rec->len = (uint16_t)len;
+    rec->level = level;
+    rec->cpu = cpu;
+    rec->reserved = 0;
+    memcpy(rec + 1, text, len);
+    ring->stats.messages++;
+
+    __atomic_store_n(&ring->head, head + need, __ATOMIC_RELEASE);
+}
+
+/*
+ * Reader: take the oldest record; false if the ring is empty
+ */
+static bool klog_ring_get(klog_ring_t* ring, klog_entry_t* entry) {
+    for (;;) {
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (tail == head) {
+            return false;
+        }
+
+        uint32_t off = (uint32_t)(tail & KLOG_RING_MASK);
+        uint64_t next = klog_ring_next(ring, tail);
+        bool pad = KLOG_RING_SIZE - off < sizeof(klog_record_t) ||
+                   ((const klog_record_t*)&ring->data[off])->len == KLOG_PAD;
+
+        if (!pad) {
+            // A record being overwritten may have any length; stay in the ring
+            uint32_t room = KLOG_RING_SIZE - off - sizeof(klog_record_t);
+            memcpy(&entry->rec, &ring->data[off], sizeof(klog_record_t));
+            if (entry->rec.len > KLOG_MAX_MSG) {
+                entry->rec.len = KLOG_MAX_MSG;
+            }
+            if (entry->rec.len > room) {
+                entry->rec.len = (uint16_t)room;
+            }
+            memcpy(entry->text, &ring->data[off + sizeof(klog_record_t)], entry->rec.len);
+        }
+
+        // The copy is good only if the record was still ours to take
+        if (__atomic_compare_exchange_n(&ring->tail, &tail, next, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) && !pad) {
+            return true;
+        }
+    }
+}
+
+/*
+ * Move every buffered record to the consoles, oldest first across CPUs
+ */
+static void klog_drain(void) {
+    for (;;) {
+        int best = -1;
+        for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+            klog_entry_t* e = &klog_pending[cpu];
+            if (!e->valid) {
+                e->valid = klog_ring_get(&klog_rings[cpu], e);
+            }
+            if (e->valid && (best < 0 || e->rec.seq < klog_pending[best].rec.seq)) {
+                best = (int)cpu;
+            }
+        }
+
+        // Write out a full render buffer, or everything at the end
+        if (best < 0 || klog_render_len + KLOG_MAX_MSG + 32 > KLOG_RENDER_SIZE) {
+            if (klog_render_len > 0) {
+                console_write_locked(klog_render_buf, klog_render_len);
+                klog_render_len = 0;
+            }
+            if (best < 0) {
+                return;
+            }
+        }
+
+        klog_entry_t* e = &klog_pending[best];
+        klog_render(&e->rec, e->text, klog_render_buf, &klog_render_len);
+        e->valid = false;
+    }
+}
+
+/*
+ * Early and panic path: straight to the consoles
+ */
+static void klog_write_direct(uint8_t level, const char* text, uint32_t len) {
+    char out[KLOG_MAX_MSG + 32];
+    size_t out_len = 0;
+    klog_record_t rec = {
+        .seq = __atomic_fetch_add(&klog_seq, 1, __ATOMIC_RELAXED),
+        .tsc = rdtsc(),
+        .len = (uint16_t)len,
+        .level = level,
+    };
+
+    uint64_t flags = local_irq_save();
+    arch_spin_lock(&console_lock);
+    klog_render(&rec, text, out, &out_len);
+    console_write_locked(out, out_len);
+    arch_spin_unlock(&console_lock);
+    local_irq_restore(flags);
+}
+
+/*
+ * Log a message
+ */
+int vklog(int level, const char* fmt, va_list args) {
+    char text[KLOG_MAX_MSG];
+    int len = vsnprintf(text, sizeof(text), fmt, args);
+    bool truncated = len >= KLOG_MAX_MSG;
+
+    if (len < 0) {
+        return len;
+    }
+    if (truncated) {
+        len = KLOG_MAX_MSG - 1;
+    }
+
+    if (!klog_async) {
+        klog_write_direct((uint8_t)level, text, (uint32_t)len);
+        return len;
+    }
+
+    uint64_t flags = local_irq_save();
+    uint32_t cpu = smp_processor_id();
+    klog_ring_t* ring = &klog_rings[cpu];
+    klog_ring_put(ring, (uint8_t)level, (uint8_t)cpu, text, (uint32_t)len);
+    if (truncated) {
+        ring->stats.truncated++;
+    }
+    local_irq_restore(flags);
+    return len;
+}
+
+int klog_printf(int level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vklog(level, fmt, args);
+    va_end(args);
+    return len;
+}
+
+int kprintf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vklog(LOG_LEVEL_INFO, fmt, args);
+    va_end(args);
+    return len;
+}
+
+/* The older name of kprintf(), the same function */
+int kernel_printf(const char* fmt, ...) __attribute__((alias("kprintf")));
+
+/*
+ * Write out everything buffered
+ *
+ * klogd may hold the console lock on another CPU, or on this one if it
+ * was interrupted; after a while we write anyway.
+ */
+void klog_flush(void) {
+    uint64_t flags = local_irq_save();
+    bool locked = false;
+
+    for (uint32_t spins = 0; spins < 10000000 && !locked; spins++) {
+        locked = arch_spin_trylock(&console_lock);
+        if (!locked) {
+            cpu_relax();
+        }
+    }
+
+    klog_drain();
+    for (klog_console_t* con = klog_consoles; con; con = con->next) {
+        if (con->flush) {
+            con->flush();
+        }
+    }
+
+    if (locked) {
+        arch_spin_unlock(&console_lock);
+    }
+    local_irq_restore(flags);
+}
+
+/*
+ * Log a message, write out the log and stop this CPU
+ */
+void kernel_panic(const char* fmt, ...) {
+    char msg[KLOG_MAX_MSG];
+    va_list args;
+
+    local_irq_disable();
+    va_start(args, fmt);
+    int len = vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+
+    bool newline = len > 0 && len < (int)sizeof(msg) && msg[len - 1] == '\n';
+    klog_printf(LOG_LEVEL_ERROR, "[PANIC] %s%s", msg, newline ? "" : "\n");
+
+    // Later messages go straight out, not to a ring nobody drains
+    klog_async = false;
+    klog_flush();
+    for (;;) {
+        __asm__ volatile("cli; hlt");
+    }
+}
+
+/*
+ * klogd: drain the rings every KLOG_DRAIN_MS
+ */
+static void klogd_main(void) {
+    klog_async = true;
+
+    while (1) {
+        arch_spin_lock(&console_lock);
+        klog_drain();
+        arch_spin_unlock(&console_lock);
+        sleep_task(KLOG_DRAIN_MS);
+    }
+}
+
+/*
+ * Start klogd; messages are buffered from when it first runs
+ */
+void init_klog(void) {
+    create_kernel_task("klogd", klogd_main, TASK_PRIORITY_LOW);
+}
+
+void klog_set_policy(klog_policy_t policy) {
+    klog_policy = policy;
+}
+
+/*
+ * Add a console; it gets messages from the next drain on
+ */
+void klog_register_console(klog_console_t* console) {
+    uint64_t flags = local_irq_save();
+    arch_spin_lock(&console_lock);
+    console->next = klog_consoles;
+    klog_consoles = console;
+    arch_spin_unlock(&console_lock);
+    local_irq_restore(flags);
+}
+
+void klog_unregister_console(klog_console_t* console) {
+    uint64_t flags = local_irq_save();
+    arch_spin_lock(&console_lock);
+    for (klog_console_t** p = &klog_consoles; *p; p = &(*p)->next) {
+        if (*p == console) {
+            *p = console->next;
+            break;
+        }
+    }
+    arch_spin_unlock(&console_lock);
+    local_irq_restore(flags);
+}
+
+/*
+ * Sum of the per-CPU counters
+ */
+void klog_get_stats(klog_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        klog_stats_t* s = &klog_rings[cpu].stats;
+        stats->messages += s->messages;
+        stats->dropped += s->dropped;
+        stats->overwritten += s->overwritten;
+        stats->truncated += s->truncated;
+    }
+}
+
+void dump_klog_stats(void) {
+    klog_stats_t stats;
+
+    klog_get_stats(&stats);
+    kernel_printf("klog: %llu messages, %llu dropped, %llu overwritten, %llu truncated (%s)\n",
+                  stats.messages, stats.dropped, stats.overwritten, stats.truncated,
+                  klog_policy == KLOG_DROP ? "drop" : "overwrite");
+}
@@ -0,0 +1,396 @@
+/*
+ * EdgeX OS - Kernel Heap Profiler
+ *
+ * This file implements the call-site table, the sampled object table and
+ * the report of the heap profiler (see include/edgex/kmemprof.h). Both
+ * tables are fixed and open-addressed, so recording never allocates:
+ * a site slot is claimed with a compare-and-swap and never freed, and an
+ * object slot holds a sampled allocation until it is kfree()d. Counters
+ * are updated with relaxed atomics.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/tsc.h>
+#include <edgex/ksyms.h>
+#include <edgex/kmemprof.h>
+
+#ifdef CONFIG_KMEM_PROFILE
+
+#define KMEMPROF_EMPTY          0
+#define KMEMPROF_CLAIMED        1
+#define KMEMPROF_READY          2
+
+/* Object slot pointers that are not objects */
+#define KMEMPROF_OBJ_EMPTY      0
+#define KMEMPROF_OBJ_BUSY       1        /* Being filled in */
+#define KMEMPROF_OBJ_FREED      2        /* Tombstone: probes go on past it */
+
+#define KMEMPROF_MAX_PROBES     32
+
+/* A sampled allocation not yet freed */
+typedef struct {
+    volatile uintptr_t ptr;
+    uint32_t size;
+    uint32_t weight;             /* Allocations it stands for */
+    kmemprof_site_t* site;
+    uint64_t tsc;
+} kmemprof_object_t;
+
+/* Sampling state of a CPU, on a line of its own */
+typedef struct {
+    int64_t countdown;           /* Bytes to the next sample */
+    uint64_t rng;
+} __attribute__((aligned(64))) kmemprof_cpu_t;
+
+static kmemprof_site_t kmemprof_sites[KMEMPROF_MAX_SITES];
+static kmemprof_object_t kmemprof_objects[KMEMPROF_MAX_OBJECTS];
+static kmemprof_cpu_t kmemprof_cpus[MAX_CPUS];
+
+static volatile bool kmemprof_enabled;
+static uint32_t kmemprof_rate;
+static uint64_t kmemprof_overflow;    /* Samples with no free site */
+static uint64_t kmemprof_dropped;     /* Samples with no free object slot */
+static uint32_t kmemprof_objects_used;
+
+/*
+ * Hash of an address: call sites and objects
+ */
+static uint32_t kmemprof_hash(uintptr_t addr) {
+    uint64_t x = (uint64_t)addr * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(x >> 32);
+}
+
+/*
+ * Find or create the entry of a call site
+ */
+static kmemprof_site_t* kmemprof_site_get(uintptr_t site) {
+    uint32_t hash = kmemprof_hash(site);
+
+    for (uint32_t probe = 0; probe < KMEMPROF_MAX_SITES; probe++) {
+        kmemprof_site_t* entry = &kmemprof_sites[(hash + probe) & (KMEMPROF_MAX_SITES - 1)];
+        uint32_t state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+
+        if (state == KMEMPROF_EMPTY) {
+            uint32_t expected = KMEMPROF_EMPTY;
+            if (__atomic_compare_exchange_n(&entry->state, &expected, KMEMPROF_CLAIMED, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                entry->site = site;
+                __atomic_store_n(&entry->state, KMEMPROF_READY, __ATOMIC_RELEASE);
+                return entry;
+            }
+            state = expected;
+        }
+
+        // Another CPU is filling this slot in
+        while (state == KMEMPROF_CLAIMED) {
+            cpu_relax();
+            state = __atomic_load_n(&entry->state, __ATOMIC_ACQUIRE);
+        }
+        if (entry->site == site) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Bytes to the next sample: uniform in [rate/2, 3*rate/2), so periodic
+ * allocation patterns do not always put the same call in the sample
+ */
+static int64_t kmemprof_next_interval(kmemprof_cpu_t* pc) {
+    if (kmemprof_rate == 0) {
+        return 0;
+    }
+
+    // xorshift64
+    uint64_t x = pc->rng ? pc->rng : rdtsc() | 1;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    pc->rng = x;
+
+    return (int64_t)(kmemprof_rate / 2 + x % kmemprof_rate);
+}
+
+/*
+ * Power-of-two bucket of a lifetime in cycles
+ */
+static uint32_t kmemprof_bucket(uint64_t cycles) {
+    uint32_t bucket = cycles ? 64 - (uint32_t)__builtin_clzll(cycles) : 0;
+    return bucket < KMEMPROF_LIFE_BUCKETS ? bucket : KMEMPROF_LIFE_BUCKETS - 1;
+}
+
+/*
+ * Record a sampled allocation against its site
+ */
+static void kmemprof_record(void* ptr, size_t size, uintptr_t site) {
+    kmemprof_site_t* entry = kmemprof_site_get(site);
+    if (!entry) {
+        __atomic_fetch_add(&kmemprof_overflow, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint32_t weight = (size && size < kmemprof_rate) ? (uint32_t)(kmemprof_rate / size) : 1;
+
+    __atomic_fetch_add(&entry->samples, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->allocs, weight, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->bytes, (uint64_t)weight * size, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&entry->max_size, __ATOMIC_RELAXED);
+    while (size > max &&
+           !__atomic_compare_exchange_n(&entry->max_size, &max, size, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    // Remember the object so that kfree() can close its lifetime
+    uint32_t hash = kmemprof_hash((uintptr_t)ptr);
+    for (uint32_t probe = 0; probe < KMEMPROF_MAX_PROBES; probe++) {
+        kmemprof_object_t* obj = &kmemprof_objects[(hash + probe) & (KMEMPROF_MAX_OBJECTS - 1)];
+        uintptr_t old = __atomic_load_n(&obj->ptr, __ATOMIC_RELAXED);
+
+        if (old != KMEMPROF_OBJ_EMPTY && old != KMEMPROF_OBJ_FREED) {
+            continue;
+        }
+        if (!__atomic_compare_exchange_n(&obj->ptr, &old, KMEMPROF_OBJ_BUSY, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        obj->size = (uint32_t)size;
+        obj->weight = weight;
+        obj->site = entry;
+        obj->tsc = rdtsc();
+        __atomic_store_n(&obj->ptr, (uintptr_t)ptr, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&kmemprof_objects_used, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // Still counted as allocated, but its free will go unseen
+    __atomic_fetch_add(&kmemprof_dropped, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Allocation hook: count the bytes down and record the allocation that
+ * crosses zero
+ */
+void kmemprof_alloc(void* ptr, size_t size, uintptr_t site) {
+    if (!kmemprof_enabled || !ptr) {
+        return;
+    }
+
+    uint64_t flags = local_irq_save();
+    kmemprof_cpu_t* pc = &kmemprof_cpus[smp_processor_id()];
+    pc->countdown -= (int64_t)size;
+    if (pc->countdown > 0) {
+        local_irq_restore(flags);
+        return;
+    }
+    pc->countdown = kmemprof_next_interval(pc);
+    local_irq_restore(flags);
+
+    kmemprof_record(ptr, size, site);
+}
+
+/*
+ * Free hook: close the lifetime of a sampled object
+ */
+void kmemprof_free(void* ptr) {
+    if (!ptr || __atomic_load_n(&kmemprof_objects_used, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    uint32_t hash = kmemprof_hash((uintptr_t)ptr);
+    for (uint32_t probe = 0; probe < KMEMPROF_MAX_PROBES; probe++) {
+        kmemprof_object_t* obj = &kmemprof_objects[(hash + probe) & (KMEMPROF_MAX_OBJECTS - 1)];
+        uintptr_t cur = __atomic_load_n(&obj->ptr, __ATOMIC_ACQUIRE);
+
+        if (cur == KMEMPROF_OBJ_EMPTY) {
+            return;
+        }
+        if (cur != (uintptr_t)ptr) {
+            continue;
+        }
+
+        // Read the object before giving up the slot
+        kmemprof_site_t* entry = obj->site;
+        uint64_t weight = obj->weight;
+        uint64_t size = obj->size;
+        uint64_t lifetime = rdtsc() - obj->tsc;
+
+        if (!__atomic_compare_exchange_n(&obj->ptr, &cur, KMEMPROF_OBJ_FREED, false,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        __atomic_fetch_sub(&kmemprof_objects_used, 1, __ATOMIC_RELAXED);
+
+        __atomic_fetch_add(&entry->frees, weight, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&entry->freed_bytes, weight * size, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&entry->life_hist[kmemprof_bucket(lifetime)], 1, __ATOMIC_RELAXED);
+        return;
+    }
+}
+
+void kmemprof_start(uint32_t rate) {
+    kmemprof_rate = rate;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        kmemprof_cpus[cpu].countdown = kmemprof_next_interval(&kmemprof_cpus[cpu]);
+    }
+    __atomic_store_n(&kmemprof_enabled, true, __ATOMIC_RELEASE);
+    kernel_printf("kmemprof: sampling kernel heap allocations every %u bytes\n", rate);
+}
+
+void kmemprof_stop(void) {
+    __atomic_store_n(&kmemprof_enabled, false, __ATOMIC_RELEASE);
+}
+
+void kmemprof_reset(void) {
+    // Racing updates may survive; the report is statistical anyway
+    for (uint32_t i = 0; i < KMEMPROF_MAX_OBJECTS; i++) {
+        __atomic_store_n(&kmemprof_objects[i].ptr, KMEMPROF_OBJ_EMPTY, __ATOMIC_RELAXED);
+    }
+    kmemprof_objects_used = 0;
+    for (uint32_t i = 0; i < KMEMPROF_MAX_SITES; i++) {
+        kmemprof_site_t* entry = &kmemprof_sites[i];
+        if (__atomic_load_n(&entry->state, __ATOMIC_ACQUIRE) == KMEMPROF_READY) {
+            entry->samples = 0;
+            entry->allocs = 0;
+            entry->bytes = 0;
+            entry->frees = 0;
+            entry->freed_bytes = 0;
+            entry->max_size = 0;
+            memset(entry->life_hist, 0, sizeof(entry->life_hist));
+        }
+    }
+    kmemprof_overflow = 0;
+    kmemprof_dropped = 0;
+}
+
+/*
+ * Estimated bytes of a site still allocated
+ */
+static uint64_t kmemprof_live_bytes(const kmemprof_site_t* entry) {
+    return entry->bytes > entry->freed_bytes ? entry->bytes - entry->freed_bytes : 0;
+}
+
+/*
+ * Upper bound in nanoseconds of the bucket holding a percentile
+ */
+static uint64_t kmemprof_percentile(const uint64_t* hist, uint64_t count, uint32_t pct) {
+    uint64_t want = (count * pct + 99) / 100;
+    uint64_t seen = 0;
+
+    for (uint32_t bucket = 0; bucket < KMEMPROF_LIFE_BUCKETS; bucket++) {
+        seen += hist[bucket];
+        if (seen >= want) {
+            return tsc_to_ns(bucket ? 1ULL << bucket : 1);
+        }
+    }
+    return tsc_to_ns(1ULL << (KMEMPROF_LIFE_BUCKETS - 1));
+}
+
+/*
+ * Lifetime histogram line: the sampled frees under each power-of-two bound
+ */
+static void kmemprof_print_hist(const uint64_t* hist) {
+    char line[256];
+    int len = snprintf(line, sizeof(line), "      life us<=");
+
+    for (uint32_t bucket = 0; bucket < KMEMPROF_LIFE_BUCKETS && len < (int)sizeof(line); bucket++) {
+        if (hist[bucket]) {
+            len += snprintf(line + len, sizeof(line) - len, " %llu:%llu",
+                            tsc_to_ns(1ULL << bucket) / 1000, hist[bucket]);
+        }
+    }
+    kernel_printf("%s\n", line);
+}
+
+static void kmemprof_print_site(const kmemprof_site_t* entry) {
+    char key[80];
+    uint64_t offset;
+    const char* sym = ksym_lookup(entry->site, &offset);
+    uint64_t live_objects = entry->allocs > entry->frees ? entry->allocs - entry->frees : 0;
+
+    if (sym) {
+        snprintf(key, sizeof(key), "%s+0x%llx", sym, offset);
+    } else {
+        snprintf(key, sizeof(key), "0x%llx", (uint64_t)entry->site);
+    }
+
+    kernel_printf("  %-40s %10llu %10llu %10llu %8llu %8llu %8llu\n",
+                  key, entry->allocs, entry->bytes / 1024, kmemprof_live_bytes(entry) / 1024,
+                  live_objects, entry->allocs ? entry->bytes / entry->allocs : 0,
+                  entry->max_size);
+
+    uint64_t freed = 0;
+    for (uint32_t bucket = 0; bucket < KMEMPROF_LIFE_BUCKETS; bucket++) {
+        freed += entry->life_hist[bucket];
+    }
+    if (freed) {
+        kernel_printf("      %llu sampled frees, lifetime p50 <=%llu us, p99 <=%llu us\n",
+                      freed, kmemprof_percentile(entry->life_hist, freed, 50) / 1000,
+                      kmemprof_percentile(entry->life_hist, freed, 99) / 1000);
+        kmemprof_print_hist(entry->life_hist);
+    }
+}
+
+void kmemprof_report(uint32_t max_sites) {
+    bool shown[KMEMPROF_MAX_SITES];
+    uint32_t sites = 0;
+    size_t heap_used, heap_size;
+
+    get_heap_stats(&heap_used, &heap_size);
+    memset(shown, 0, sizeof(shown));
+    for (uint32_t i = 0; i < KMEMPROF_MAX_SITES; i++) {
+        if (kmemprof_sites[i].state == KMEMPROF_READY) {
+            sites++;
+        }
+    }
+    kernel_printf("Kernel heap: %llu of %llu KB used; %u call sites, sampled every %u bytes "
+                  "(%llu samples without a site, %llu frees not tracked)\n",
+                  (uint64_t)heap_used / 1024, (uint64_t)heap_size / 1024, sites, kmemprof_rate,
+                  kmemprof_overflow, kmemprof_dropped);
+    kernel_printf("  %-40s %10s %10s %10s %8s %8s %8s\n",
+                  "call site", "allocs", "KB", "live KB", "live", "avg B", "max B");
+
+    // Sites holding the most live bytes first, then the most allocated
+    for (uint32_t n = 0; n < max_sites; n++) {
+        kmemprof_site_t* best = NULL;
+        uint32_t best_index = 0;
+
+        for (uint32_t i = 0; i < KMEMPROF_MAX_SITES; i++) {
+            kmemprof_site_t* entry = &kmemprof_sites[i];
+            if (shown[i] || entry->state != KMEMPROF_READY || entry->samples == 0) {
+                continue;
+            }
+            if (!best || kmemprof_live_bytes(entry) > kmemprof_live_bytes(best) ||
+                (kmemprof_live_bytes(entry) == kmemprof_live_bytes(best) &&
+                 entry->bytes > best->bytes)) {
+                best = entry;
+                best_index = i;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        shown[best_index] = true;
+        kmemprof_print_site(best);
+    }
+}
+
+#else
+
+void kmemprof_start(uint32_t rate) {
+    (void)rate;
+}
+
+void kmemprof_stop(void) {
+}
+
+void kmemprof_reset(void) {
+}
+
+void kmemprof_report(uint32_t max_sites) {
+    (void)max_sites;
+    kernel_printf("Heap profiling is not built in (CONFIG_KMEM_PROFILE)\n");
+}
+
+#endif /* CONFIG_KMEM_PROFILE */
@@ -0,0 +1,234 @@
+/*
+ * EdgeX OS - Statistics Page
+ *
+ * This file implements kstatsd, which samples the kernel's statistics
+ * into a private buffer and publishes them to the pages monitoring tasks
+ * map (see include/edgex/kstats.h). Sampling takes the same short locks
+ * as the other statistics queries, once per interval; the sequence count
+ * is odd only while the buffer is copied out.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/scheduler.h>
+#include <edgex/tsc.h>
+#include <edgex/kstats.h>
+#include <edgex/ipc/message.h>
+
+_Static_assert(sizeof(kstats_page_t) <= KSTATS_PAGES * PAGE_SIZE,
+               "kstats_page_t must fit in KSTATS_PAGES pages");
+
+/* Published pages, not contiguous; tasks see them in order at KSTATS_VADDR */
+static uint64_t kstats_phys[KSTATS_PAGES];
+
+/* kstatsd's buffer, copied to the pages once complete */
+static kstats_page_t* kstats_buffer;
+
+/* Tasks found by kstats_collect_task() */
+typedef struct {
+    uint32_t count;
+    uint32_t dropped;
+    pid_t pids[KSTATS_MAX_TASKS];
+} kstats_pids_t;
+
+/*
+ * Collect the PID of a task (scheduler lock held)
+ */
+static void kstats_collect_task(task_t* task, void* arg) {
+    kstats_pids_t* list = (kstats_pids_t*)arg;
+
+    if (list->count < KSTATS_MAX_TASKS) {
+        list->pids[list->count++] = task->pid;
+    } else {
+        list->dropped++;
+    }
+}
+
+/*
+ * Sample every statistic into the buffer
+ */
+static void kstats_sample(kstats_page_t* stats) {
+    uint64_t total, free;
+
+    get_memory_stats(&total, &free, NULL);
+    stats->total_pages = total / PAGE_SIZE;
+    stats->free_pages = free / PAGE_SIZE;
+    for (uint32_t zone = 0; zone < ZONE_TYPES_COUNT; zone++) {
+        stats->zone_free_pages[zone] = get_zone_free_pages((memory_zone_type_t)zone);
+    }
+
+    get_ipc_stats(&stats->ipc);
+
+    cpu_sched_info_t cpu_info;
+    stats->nr_cpus = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        kstats_cpu_t* out = &stats->cpus[cpu];
+
+        memset(out, 0, sizeof(*out));
+        if (get_cpu_sched_info(cpu, &cpu_info) != 0) {
+            continue;
+        }
+        out->online = 1;
+        out->nr_running = cpu_info.nr_running;
+        out->avg_nr_running_x100 = cpu_info.avg_nr_running_x100;
+        out->window_ns = cpu_info.window_ns;
+        out->idle_ns = cpu_info.idle_ns;
+        out->nr_switches = cpu_info.nr_switches;
+        out->nr_wakeups = cpu_info.nr_wakeups;
+        out->nr_remote_wakeups = cpu_info.nr_remote_wakeups;
+        out->nr_wake_ipis = cpu_info.nr_wake_ipis;
+        stats->nr_cpus = cpu + 1;
+    }
+
+    // Query each task outside the lock for_each_task() holds
+    kstats_pids_t list = { .count = 0, .dropped = 0 };
+    task_sched_info_t info;
+
+    for_each_task(kstats_collect_task, &list);
+
+    stats->nr_tasks = 0;
+    stats->tasks_dropped = list.dropped;
+    for (uint32_t i = 0; i < list.count; i++) {
+        if (get_task_sched_info(list.pids[i], &info) != 0) {
+            continue;
+        }
+
+        kstats_task_t* out = &stats->tasks[stats->nr_tasks++];
+        out->pid = info.pid;
+        out->state = info.state;
+        out->priority = info.priority;
+        out->cpu = info.cpu;
+        memcpy(out->name, info.name, KSTATS_NAME_LEN);
+        out->name[KSTATS_NAME_LEN - 1] = '\0';
+        out->run_ns = info.run_ns;
+        out->wait_ns = info.wait_ns;
+        out->nr_voluntary = info.nr_voluntary;
+        out->nr_involuntary = info.nr_involuntary;
+        out->wake_latency_avg_ns = info.wake_latency_avg_ns;
+        out->wake_latency_max_ns = info.wake_latency_max_ns;
+    }
+
+    message_queue_depth_t depths[KSTATS_MAX_QUEUES];
+    stats->nr_queues = get_message_queue_depths(depths, KSTATS_MAX_QUEUES);
+    for (uint32_t i = 0; i < stats->nr_queues; i++) {
+        kstats_queue_t* out = &stats->queues[i];
+
+        memcpy(out->name, depths[i].name, KSTATS_NAME_LEN);
+        out->owner = depths[i].owner;
+        out->depth = depths[i].depth;
+        out->max_messages = depths[i].max_messages;
+        out->messages_sent = depths[i].messages_sent;
+        out->messages_received = depths[i].messages_received;
+    }
+
+    stats->timestamp_ns = tsc_to_ns(rdtsc());
+}
+
+/*
+ * Copy the buffer to the published pages under the sequence count
+ *
+ * Only kstatsd writes the pages, so the count needs no lock. Stores on
+ * x86 become visible in order: readers that see an even count after
+ * their copy saw none of this update or all of it.
+ */
+static void kstats_publish(kstats_page_t* stats) {
+    kstats_page_t* page = (kstats_page_t*)(uintptr_t)kstats_phys[0];
+    uint32_t seq = page->seq;
+    const uint8_t* src = (const uint8_t*)stats;
+
+    __atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    stats->seq = seq + 1;
+    for (uint32_t i = 0; i < KSTATS_PAGES; i++) {
+        size_t offset = (size_t)i * PAGE_SIZE;
+        if (offset >= sizeof(*stats)) {
+            break;
+        }
+        size_t len = sizeof(*stats) - offset < PAGE_SIZE ? sizeof(*stats) - offset : PAGE_SIZE;
+        memcpy((void*)(uintptr_t)kstats_phys[i], src + offset, len);
+    }
+
+    __atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * kstatsd: refresh the pages every KSTATS_INTERVAL_MS
+ */
+static void kstatsd_main(void) {
+    while (1) {
+        kstats_sample(kstats_buffer);
+        kstats_buffer->updates++;
+        kstats_publish(kstats_buffer);
+        sleep_task(KSTATS_INTERVAL_MS);
+    }
+}
+
+/*
+ * Allocate the pages and start kstatsd
+ */
+void init_kstats(void) {
+    kstats_buffer = (kstats_page_t*)kzalloc(sizeof(kstats_page_t));
+    if (!kstats_buffer) {
+        kernel_printf("kstats: no memory for the statistics buffer\n");
+        return;
+    }
+
+    for (uint32_t i = 0; i < KSTATS_PAGES; i++) {
+        void* page = alloc_page();
+        if (!page) {
+            kernel_printf("kstats: no memory for the statistics pages\n");
+            while (i > 0) {
+                free_page((void*)(uintptr_t)kstats_phys[--i]);
+                kstats_phys[i] = 0;
+            }
+            return;
+        }
+        memset(page, 0, PAGE_SIZE);
+        kstats_phys[i] = (uint64_t)page;
+    }
+
+    // Tasks that map the pages before the first update see an empty set
+    kstats_buffer->magic = KSTATS_MAGIC;
+    kstats_buffer->version = KSTATS_VERSION;
+    kstats_buffer->size = sizeof(kstats_page_t);
+    kstats_buffer->interval_ms = KSTATS_INTERVAL_MS;
+    kstats_publish(kstats_buffer);
+
+    create_kernel_task("kstatsd", kstatsd_main, TASK_PRIORITY_LOW);
+    kernel_printf("kstats: %u pages at 0x%llx in tasks, updated every %u ms\n",
+                  KSTATS_PAGES, KSTATS_VADDR, KSTATS_INTERVAL_MS);
+}
+
+/*
+ * Map the pages read-only into a task
+ */
+uint64_t kstats_map(pid_t owner) {
+    struct page_directory* pd = find_page_directory(owner);
+    if (!pd || !kstats_phys[0]) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < KSTATS_PAGES; i++) {
+        uint64_t vaddr = KSTATS_VADDR + (uint64_t)i * PAGE_SIZE;
+        if (map_device_memory(pd, vaddr, kstats_phys[i], PAGE_SIZE, false, false) != 0) {
+            kernel_printf("kstats: cannot map the statistics pages into task %d\n", owner);
+            if (i > 0) {
+                unmap_memory_range(pd, KSTATS_VADDR, (size_t)i * PAGE_SIZE, false);
+            }
+            return 0;
+        }
+    }
+    return KSTATS_VADDR;
+}
+
+/*
+ * Remove a task's mapping of the pages
+ */
+int kstats_unmap(pid_t owner) {
+    struct page_directory* pd = find_page_directory(owner);
+    if (!pd) {
+        return -1;
+    }
+    return unmap_memory_range(pd, KSTATS_VADDR, KSTATS_PAGES * PAGE_SIZE, false);
+}
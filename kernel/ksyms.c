@@ -0,0 +1,69 @@
+/*
+ * EdgeX OS - Kernel Symbols
+ *
+ * This file looks up addresses in the symbol table generated at link
+ * time (tools/mksyms.py). The table is sorted by address; a symbol runs
+ * up to the next one, and the last one up to the end of .text.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/ksyms.h>
+
+/* Generated table (.ksyms section) */
+extern const uint64_t ksym_table_count;
+extern const uint64_t ksym_table_addrs[];
+extern const uint32_t ksym_table_name_offsets[];
+extern const char ksym_table_names[];
+
+/* Linker script */
+extern char _text_start[], _text_end[];
+
+uint32_t ksym_count(void) {
+    return (uint32_t)ksym_table_count;
+}
+
+bool ksym_in_text(uint64_t addr) {
+    return addr >= (uintptr_t)_text_start && addr < (uintptr_t)_text_end;
+}
+
+/*
+ * Binary search for the last symbol at or below an address
+ */
+int32_t ksym_index(uint64_t addr) {
+    uint32_t lo = 0;
+    uint32_t hi = ksym_count();
+
+    if (!ksym_in_text(addr) || hi == 0 || addr < ksym_table_addrs[0]) {
+        return -1;
+    }
+
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ksym_table_addrs[mid] <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return (int32_t)lo;
+}
+
+const char* ksym_name(uint32_t index) {
+    return index < ksym_count() ? &ksym_table_names[ksym_table_name_offsets[index]] : NULL;
+}
+
+uint64_t ksym_addr(uint32_t index) {
+    return index < ksym_count() ? ksym_table_addrs[index] : 0;
+}
+
+const char* ksym_lookup(uint64_t addr, uint64_t* offset) {
+    int32_t index = ksym_index(addr);
+
+    if (index < 0) {
+        return NULL;
+    }
+    if (offset) {
+        *offset = addr - ksym_table_addrs[index];
+    }
+    return ksym_name((uint32_t)index);
+}
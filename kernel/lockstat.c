@@ -0,0 +1,394 @@
+/*
+ * EdgeX OS - Lock Statistics
+ *
+ * This file implements the lock class table and its report. Classes live
+ * in a fixed open-addressed table, so they can be created from any
+ * context, before the allocator and with spinlocks held; a slot is
+ * claimed with a compare-and-swap and never freed. Counters are updated
+ * with relaxed atomics. Times are kept in TSC cycles and converted to
+ * nanoseconds for the report.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/spinlock.h>
+#include <edgex/scheduler.h>
+#include <edgex/tsc.h>
+#include <edgex/ksyms.h>
+#include <edgex/lockstat.h>
+
+#ifdef CONFIG_LOCK_STAT
+
+#define LOCKSTAT_EMPTY          0
+#define LOCKSTAT_CLAIMED        1
+#define LOCKSTAT_READY          2
+
+static lockstat_class_t lockstat_classes[LOCKSTAT_MAX_CLASSES];
+static uint64_t lockstat_overflow;    /* Acquisitions with no free class */
+
+/*
+ * FNV-1a over a class key
+ */
+static uint32_t lockstat_hash(uint8_t type, uintptr_t site, const char* name) {
+    uint32_t hash = 2166136261u;
+
+    hash = (hash ^ type) * 16777619u;
+    if (name) {
+        for (uint32_t i = 0; i < LOCKSTAT_NAME_LEN - 1 && name[i]; i++) {
+            hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+        }
+    } else {
+        for (uint32_t i = 0; i < sizeof(site); i++) {
+            hash = (hash ^ (uint8_t)(site >> (i * 8))) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static bool lockstat_match(const lockstat_class_t* cls, uint8_t type, uintptr_t site,
+                           const char* name) {
+    if (cls->type != type) {
+        return false;
+    }
+    if (!name) {
+        return cls->site == site;
+    }
+    // Names are compared as far as a class stores them
+    for (uint32_t i = 0; i < LOCKSTAT_NAME_LEN - 1; i++) {
+        if (cls->name[i] != name[i]) {
+            return false;
+        }
+        if (!name[i]) {
+            break;
+        }
+    }
+    return true;
+}
+
+/*
+ * Find or create the class of a key (a name, or else a call site)
+ */
+static lockstat_class_t* lockstat_class_get(uint8_t type, uintptr_t site, const char* name) {
+    uint32_t hash = lockstat_hash(type, site, name);
+
+    for (uint32_t probe = 0; probe < LOCKSTAT_MAX_CLASSES; probe++) {
+        lockstat_class_t* cls = &lockstat_classes[(hash + probe) & (LOCKSTAT_MAX_CLASSES - 1)];
+        uint32_t state = __atomic_load_n(&cls->state, __ATOMIC_ACQUIRE);
+
+        if (state == LOCKSTAT_EMPTY) {
+            uint32_t expected = LOCKSTAT_EMPTY;
+            if (__atomic_compare_exchange_n(&cls->state, &expected, LOCKSTAT_CLAIMED, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                cls->type = type;
+                cls->site = site;
+                for (uint32_t i = 0; name && i < LOCKSTAT_NAME_LEN - 1 && name[i]; i++) {
+                    cls->name[i] = name[i];
+                }
+                __atomic_store_n(&cls->state, LOCKSTAT_READY, __ATOMIC_RELEASE);
+                return cls;
+            }
+            state = expected;
+        }
+
+        // Another CPU is filling this slot in
+        while (state == LOCKSTAT_CLAIMED) {
+            cpu_relax();
+            state = __atomic_load_n(&cls->state, __ATOMIC_ACQUIRE);
+        }
+        if (lockstat_match(cls, type, site, name)) {
+            return cls;
+        }
+    }
+    return NULL;
+}
+
+lockstat_class_t* lockstat_class_named(uint8_t type, const char* name) {
+    return lockstat_class_get(type, 0, name ? name : "");
+}
+
+/*
+ * Power-of-two bucket of a time in cycles
+ */
+static uint32_t lockstat_bucket(uint64_t cycles) {
+    uint32_t bucket = cycles ? 64 - (uint32_t)__builtin_clzll(cycles) : 0;
+    return bucket < LOCKSTAT_HIST_BUCKETS ? bucket : LOCKSTAT_HIST_BUCKETS - 1;
+}
+
+static void lockstat_max(uint64_t* max, uint64_t value) {
+    uint64_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/*
+ * Charge a wait to the task, keeping the tasks that waited longest
+ */
+static void lockstat_add_waiter(lockstat_class_t* cls, pid_t pid, uint64_t wait_cycles) {
+    uint64_t flags = local_irq_save();
+
+    while (__atomic_exchange_n(&cls->waiters_lock, 1, __ATOMIC_ACQUIRE)) {
+        cpu_relax();
+    }
+
+    // The task's entry, else a free one, else the one that waited least
+    lockstat_waiter_t* slot = NULL;
+    for (uint32_t i = 0; i < LOCKSTAT_TOP_WAITERS; i++) {
+        lockstat_waiter_t* waiter = &cls->waiters[i];
+        if (waiter->contended && waiter->pid == pid) {
+            slot = waiter;
+            break;
+        }
+        if (!slot || (slot->contended && waiter->wait_cycles < slot->wait_cycles)) {
+            slot = waiter;
+        }
+    }
+
+    if (slot->contended == 0 || slot->pid != pid) {
+        if (slot->contended && slot->wait_cycles >= wait_cycles) {
+            // Every task listed waited longer
+            slot = NULL;
+        } else {
+            slot->pid = pid;
+            slot->contended = 0;
+            slot->wait_cycles = 0;
+        }
+    }
+    if (slot) {
+        slot->contended++;
+        slot->wait_cycles += wait_cycles;
+    }
+
+    __atomic_store_n(&cls->waiters_lock, 0, __ATOMIC_RELEASE);
+    local_irq_restore(flags);
+}
+
+void lockstat_acquired(lockstat_class_t* cls, uint64_t wait_cycles, bool contended) {
+    if (!cls) {
+        __atomic_fetch_add(&lockstat_overflow, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_fetch_add(&cls->acquisitions, 1, __ATOMIC_RELAXED);
+    if (!contended) {
+        return;
+    }
+
+    __atomic_fetch_add(&cls->contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cls->wait_cycles, wait_cycles, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cls->wait_hist[lockstat_bucket(wait_cycles)], 1, __ATOMIC_RELAXED);
+    lockstat_max(&cls->wait_max, wait_cycles);
+    lockstat_add_waiter(cls, get_current_pid(), wait_cycles);
+}
+
+void lockstat_released(lockstat_class_t* cls, uint64_t acquired_tsc) {
+    if (!cls) {
+        return;
+    }
+
+    uint64_t hold = rdtsc() - acquired_tsc;
+    __atomic_fetch_add(&cls->releases, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cls->hold_cycles, hold, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cls->hold_hist[lockstat_bucket(hold)], 1, __ATOMIC_RELAXED);
+    lockstat_max(&cls->hold_max, hold);
+}
+
+/*
+ * Spinlocks: try once, and time the spin only if that fails
+ */
+void lockstat_spin_lock(struct spinlock* lock, uintptr_t site) {
+    lockstat_class_t* cls = lockstat_class_get(LOCKSTAT_SPINLOCK, site, NULL);
+    uint64_t wait = 0;
+    bool contended = false;
+
+    if (!arch_spin_trylock(lock)) {
+        uint64_t start = rdtsc();
+        arch_spin_lock(lock);
+        wait = rdtsc() - start;
+        contended = true;
+    }
+
+    lock->lock_class = cls;
+    lock->acquired_tsc = rdtsc();
+    lockstat_acquired(cls, wait, contended);
+}
+
+bool lockstat_spin_trylock(struct spinlock* lock, uintptr_t site) {
+    if (!arch_spin_trylock(lock)) {
+        return false;
+    }
+
+    lockstat_class_t* cls = lockstat_class_get(LOCKSTAT_SPINLOCK, site, NULL);
+    lock->lock_class = cls;
+    lock->acquired_tsc = rdtsc();
+    lockstat_acquired(cls, 0, false);
+    return true;
+}
+
+void lockstat_spin_release(struct spinlock* lock) {
+    lockstat_released(lock->lock_class, lock->acquired_tsc);
+    lock->lock_class = NULL;
+}
+
+void lockstat_reset(void) {
+    for (uint32_t i = 0; i < LOCKSTAT_MAX_CLASSES; i++) {
+        lockstat_class_t* cls = &lockstat_classes[i];
+        if (__atomic_load_n(&cls->state, __ATOMIC_ACQUIRE) != LOCKSTAT_READY) {
+            continue;
+        }
+        // Racing updates may survive; the report is statistical anyway
+        memset(&cls->acquisitions, 0,
+               (size_t)((char*)&cls->waiters_lock - (char*)&cls->acquisitions));
+        memset(cls->waiters, 0, sizeof(cls->waiters));
+    }
+    lockstat_overflow = 0;
+}
+
+static const char* lockstat_type_name(uint8_t type) {
+    switch (type) {
+        case LOCKSTAT_SPINLOCK:
+            return "spin";
+        case LOCKSTAT_MUTEX:
+            return "mutex";
+        case LOCKSTAT_SEMAPHORE:
+            return "sem";
+        default:
+            return "?";
+    }
+}
+
+/*
+ * Print the class key: the object name, or the function taking the lock
+ */
+static void lockstat_print_key(const lockstat_class_t* cls, char* buf, size_t size) {
+    if (cls->type != LOCKSTAT_SPINLOCK) {
+        snprintf(buf, size, "%s", cls->name[0] ? cls->name : "(unnamed)");
+        return;
+    }
+
+    uint64_t offset;
+    const char* sym = ksym_lookup(cls->site, &offset);
+    if (sym) {
+        snprintf(buf, size, "%s+0x%llx", sym, offset);
+    } else {
+        snprintf(buf, size, "0x%llx", (uint64_t)cls->site);
+    }
+}
+
+/*
+ * Upper bound in nanoseconds of the bucket holding a percentile
+ */
+static uint64_t lockstat_percentile(const uint64_t* hist, uint64_t count, uint32_t pct) {
+    uint64_t want = (count * pct + 99) / 100;
+    uint64_t seen = 0;
+
+    for (uint32_t bucket = 0; bucket < LOCKSTAT_HIST_BUCKETS; bucket++) {
+        seen += hist[bucket];
+        if (seen >= want) {
+            return tsc_to_ns(bucket ? 1ULL << bucket : 1);
+        }
+    }
+    return tsc_to_ns(1ULL << (LOCKSTAT_HIST_BUCKETS - 1));
+}
+
+/*
+ * One histogram line: the count under each power-of-two bound
+ */
+static void lockstat_print_hist(const char* label, const uint64_t* hist) {
+    char line[256];
+    int len = snprintf(line, sizeof(line), "      %s ns<=", label);
+
+    for (uint32_t bucket = 0; bucket < LOCKSTAT_HIST_BUCKETS && len < (int)sizeof(line); bucket++) {
+        if (hist[bucket]) {
+            len += snprintf(line + len, sizeof(line) - len, " %llu:%llu",
+                            tsc_to_ns(bucket ? 1ULL << bucket : 1), hist[bucket]);
+        }
+    }
+    kernel_printf("%s\n", line);
+}
+
+static void lockstat_print_class(const lockstat_class_t* cls) {
+    char key[LOCKSTAT_NAME_LEN + 48];
+    uint64_t contended_pct = cls->acquisitions ? cls->contended * 1000 / cls->acquisitions : 0;
+
+    lockstat_print_key(cls, key, sizeof(key));
+    kernel_printf("  %-40s %-5s %10llu %10llu %4llu.%llu%% %12llu\n",
+                  key, lockstat_type_name(cls->type), cls->acquisitions, cls->contended,
+                  contended_pct / 10, contended_pct % 10, tsc_to_ns(cls->wait_cycles));
+
+    if (cls->contended) {
+        kernel_printf("      wait avg %llu ns, p50 <=%llu, p99 <=%llu, max %llu\n",
+                      tsc_to_ns(cls->wait_cycles / cls->contended),
+                      lockstat_percentile(cls->wait_hist, cls->contended, 50),
+                      lockstat_percentile(cls->wait_hist, cls->contended, 99),
+                      tsc_to_ns(cls->wait_max));
+        lockstat_print_hist("wait", cls->wait_hist);
+    }
+    if (cls->releases) {
+        kernel_printf("      hold avg %llu ns, p50 <=%llu, p99 <=%llu, max %llu\n",
+                      tsc_to_ns(cls->hold_cycles / cls->releases),
+                      lockstat_percentile(cls->hold_hist, cls->releases, 50),
+                      lockstat_percentile(cls->hold_hist, cls->releases, 99),
+                      tsc_to_ns(cls->hold_max));
+        lockstat_print_hist("hold", cls->hold_hist);
+    }
+    for (uint32_t i = 0; i < LOCKSTAT_TOP_WAITERS; i++) {
+        const lockstat_waiter_t* waiter = &cls->waiters[i];
+        if (waiter->contended) {
+            kernel_printf("      waiter pid %d: %u waits, %llu ns\n",
+                          waiter->pid, waiter->contended, tsc_to_ns(waiter->wait_cycles));
+        }
+    }
+}
+
+void lockstat_report(uint32_t max_classes) {
+    bool shown[LOCKSTAT_MAX_CLASSES];
+    uint32_t classes = 0;
+
+    memset(shown, 0, sizeof(shown));
+    for (uint32_t i = 0; i < LOCKSTAT_MAX_CLASSES; i++) {
+        if (lockstat_classes[i].state == LOCKSTAT_READY) {
+            classes++;
+        }
+    }
+    kernel_printf("%u lock classes (%llu acquisitions without a class)\n",
+                  classes, lockstat_overflow);
+    kernel_printf("  %-40s %-5s %10s %10s %6s %12s\n",
+                  "class", "type", "acquired", "contended", "", "wait ns");
+
+    // Classes that waited longest first, then the most acquired
+    for (uint32_t n = 0; n < max_classes; n++) {
+        lockstat_class_t* best = NULL;
+        uint32_t best_index = 0;
+
+        for (uint32_t i = 0; i < LOCKSTAT_MAX_CLASSES; i++) {
+            lockstat_class_t* cls = &lockstat_classes[i];
+            if (shown[i] || cls->state != LOCKSTAT_READY || cls->acquisitions == 0) {
+                continue;
+            }
+            if (!best || cls->wait_cycles > best->wait_cycles ||
+                (cls->wait_cycles == best->wait_cycles && cls->acquisitions > best->acquisitions)) {
+                best = cls;
+                best_index = i;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        shown[best_index] = true;
+        lockstat_print_class(best);
+    }
+}
+
+#else
+
+void lockstat_reset(void) {
+}
+
+void lockstat_report(uint32_t max_classes) {
+    (void)max_classes;
+    kernel_printf("Lock statistics are not built in (CONFIG_LOCK_STAT)\n");
+}
+
+#endif /* CONFIG_LOCK_STAT */
@@ -6,6 +6,9 @@
  */
 
 #include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/acpi.h>
+#include <edgex/initrd.h>
 
 /* Global kernel information */
 const kernel_info_t kernel_info = {
@@ -32,9 +35,20 @@ int kernel_log_level = LOG_LEVEL_INFO;
 extern uint64_t multiboot_info;
 
 /* VGA text mode buffer */
+#define VGA_WIDTH  80
+#define VGA_HEIGHT 25
 static uint16_t* const vga_buffer = (uint16_t*)0xFFFFFFFF800B8000;
-static const int vga_width = 80;
-static const int vga_height = 25;
+static const int vga_width = VGA_WIDTH;
+static const int vga_height = VGA_HEIGHT;
+
+/*
+ * Text is drawn into a copy in RAM and the changed rows are copied to
+ * the (uncached) VGA memory once per write, instead of touching VGA
+ * memory per character and per scrolled cell.
+ */
+static uint16_t vga_shadow[VGA_WIDTH * VGA_HEIGHT];
+static int vga_dirty_first = VGA_HEIGHT;
+static int vga_dirty_last = -1;
 static int vga_row = 0;
 static int vga_column = 0;
 static uint8_t vga_color = 0x0F; /* White on black */
@@ -57,46 +71,53 @@ static size_t strlen(const char* str) {
 /* Initialize VGA text mode console */
 static void init_vga_console(void) {
     /* Clear the screen */
-    for (int y = 0; y < vga_height; y++) {
-        for (int x = 0; x < vga_width; x++) {
-            const int index = y * vga_width + x;
-            vga_buffer[index] = (uint16_t)(' ' | (vga_color << 8));
-        }
+    for (int i = 0; i < vga_width * vga_height; i++) {
+        vga_shadow[i] = (uint16_t)(' ' | (vga_color << 8));
     }
+    memcpy(vga_buffer, vga_shadow, sizeof(vga_shadow));
     
     vga_row = 0;
     vga_column = 0;
 }
 
+static inline void vga_mark_dirty(int first, int last) {
+    if (first < vga_dirty_first) {
+        vga_dirty_first = first;
+    }
+    if (last > vga_dirty_last) {
+        vga_dirty_last = last;
+    }
+}
+
 /* Scroll the screen up one line */
 static void vga_scroll(void) {
     /* Move all lines up one */
-    for (int y = 0; y < vga_height - 1; y++) {
-        for (int x = 0; x < vga_width; x++) {
-            const int dst_index = y * vga_width + x;
-            const int src_index = (y + 1) * vga_width + x;
-            vga_buffer[dst_index] = vga_buffer[src_index];
-        }
-    }
+    memmove(vga_shadow, vga_shadow + vga_width,
+            (size_t)(vga_height - 1) * vga_width * sizeof(uint16_t));
     
     /* Clear the last line */
     for (int x = 0; x < vga_width; x++) {
         const int index = (vga_height - 1) * vga_width + x;
-        vga_buffer[index] = (uint16_t)(' ' | (vga_color << 8));
+        vga_shadow[index] = (uint16_t)(' ' | (vga_color << 8));
     }
     
     vga_row = vga_height - 1;
+    vga_mark_dirty(0, vga_height - 1);
 }
 
-/* Put a character to the VGA console */
-void kputchar(char c) {
+static void vga_newline(void) {
+    vga_column = 0;
+    vga_row++;
+    if (vga_row >= vga_height) {
+        vga_scroll();
+    }
+}
+
+/* Draw a character into the shadow buffer */
+static void vga_draw(char c) {
     /* Handle special characters */
     if (c == '\n') {
-        vga_column = 0;
-        vga_row++;
-        if (vga_row >= vga_height) {
-            vga_scroll();
-        }
+        vga_newline();
         return;
     }
     
@@ -109,43 +130,47 @@ void kputchar(char c) {
         /* Tab aligns to 8-character boundary */
         vga_column = (vga_column + 8) & ~7;
         if (vga_column >= vga_width) {
-            vga_column = 0;
-            vga_row++;
-            if (vga_row >= vga_height) {
-                vga_scroll();
-            }
+            vga_newline();
         }
         return;
     }
     
     /* Put the character at the current position */
     const int index = vga_row * vga_width + vga_column;
-    vga_buffer[index] = (uint16_t)(c | (vga_color << 8));
+    vga_shadow[index] = (uint16_t)((uint8_t)c | (vga_color << 8));
+    vga_mark_dirty(vga_row, vga_row);
     
     /* Advance the cursor */
     vga_column++;
     if (vga_column >= vga_width) {
-        vga_column = 0;
-        vga_row++;
-        if (vga_row >= vga_height) {
-            vga_scroll();
-        }
+        vga_newline();
     }
 }
 
-/* Put a string to the VGA console */
-void kputs(const char* str) {
-    for (size_t i = 0; i < strlen(str); i++) {
-        kputchar(str[i]);
+/* Write characters to the VGA console (also the klog "vga" console) */
+void vga_console_write(const char* buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        vga_draw(buf[i]);
     }
+    
+    /* Copy the changed rows to the screen */
+    if (vga_dirty_last >= vga_dirty_first) {
+        const int offset = vga_dirty_first * vga_width;
+        memcpy(vga_buffer + offset, vga_shadow + offset,
+               (size_t)(vga_dirty_last - vga_dirty_first + 1) * vga_width * sizeof(uint16_t));
+    }
+    vga_dirty_first = vga_height;
+    vga_dirty_last = -1;
 }
 
-/* Simple printf-like function */
-int kprintf(const char* fmt, ...) {
-    // A very minimal implementation for now - just print the format string
-    // Later, we'll implement a proper formatted output
-    kputs(fmt);
-    return 0;
+/* Put a character to the VGA console */
+void kputchar(char c) {
+    vga_console_write(&c, 1);
+}
+
+/* Put a string to the VGA console */
+void kputs(const char* str) {
+    vga_console_write(str, strlen(str));
 }
 
 /* Initialize memory subsystem */
@@ -278,6 +303,7 @@ void parse_multiboot_info(void) {
                 
             case 1: /* Boot Command Line */
                 LOG_INFO("Boot command line: %s", (char*)(tag + 1));
+                cpu_parse_cmdline((char*)(tag + 1));
                 break;
                 
             case 2: /* Boot Loader Name */
@@ -289,7 +315,12 @@ void parse_multiboot_info(void) {
                 break;
                 
             case 3: /* Modules */
-                LOG_DEBUG("Modules present");
+                {
+                    multiboot2_module_t* mod = (multiboot2_module_t*)tag;
+                    LOG_INFO("Module: 0x%x - 0x%x %s", mod->mod_start, mod->mod_end,
+                             mod->cmdline);
+                    initrd_add_module(mod->mod_start, mod->mod_end, mod->cmdline);
+                }
                 break;
                 
             case 4: /* Basic Memory Info */
@@ -304,6 +335,12 @@ void parse_multiboot_info(void) {
                 LOG_DEBUG("Framebuffer info present");
                 break;
                 
+            case 14: /* ACPI 1.0 RSDP */
+            case 15: /* ACPI 2.0 RSDP */
+                LOG_DEBUG("ACPI RSDP present");
+                acpi_set_rsdp(tag + 1, tag->size - sizeof(multiboot2_tag_t));
+                break;
+                
             default:
                 LOG_DEBUG("Unknown multiboot tag: %u", tag->type);
                 break;
@@ -6,6 +6,9 @@
  */
 
 #include <edgex/kernel.h>
+#include <edgex/initrd.h>
+#include <edgex/percpu.h>
+#include <edgex/kmemprof.h>
 
 /* Physical memory management */
 #define PAGE_FLAG_FREE     0x0000
@@ -21,11 +24,24 @@
 /* Page frame database */
 static page_frame_t* page_frames = NULL;
 static uint64_t total_pages = 0;
-static uint64_t free_pages = 0;
+
+/* Free page counts, per-CPU until a CPU's delta reaches the batch size */
+#define FREE_PAGES_BATCH   64
+static pcpu_batch_t free_pages = PCPU_BATCH_INIT(PCPU_MEM_FREE_PAGES, FREE_PAGES_BATCH);
+static pcpu_batch_t zone_free_pages[ZONE_TYPES_COUNT] = {
+    [ZONE_NORMAL] = PCPU_BATCH_INIT(PCPU_MEM_NORMAL_FREE_PAGES, FREE_PAGES_BATCH),
+    [ZONE_DMA] = PCPU_BATCH_INIT(PCPU_MEM_DMA_FREE_PAGES, FREE_PAGES_BATCH),
+};
 
 /* Memory zones, defined in main.c */
 extern memory_zone_t memory_zones[ZONE_TYPES_COUNT];
 
+/* Count pages becoming free (delta > 0) or used in the zone of a page */
+static void account_free_pages(uint64_t flags, int64_t delta) {
+    pcpu_batch_add(&free_pages, delta);
+    pcpu_batch_add(&zone_free_pages[(flags & PAGE_FLAG_DMA) ? ZONE_DMA : ZONE_NORMAL], delta);
+}
+
 /* Simple physical memory allocator */
 static void* early_alloc(size_t size) {
     /* This is a very simple bump allocator used during early boot */
@@ -87,17 +103,20 @@ static void init_physical_memory(void) {
     memory_zone_t* dma_zone = &memory_zones[ZONE_DMA];
     
     /* Process DMA zone */
+    uint64_t dma_free = 0;
     if (dma_zone->size > 0) {
         uint64_t start_page = dma_zone->start_address / PAGE_SIZE;
         uint64_t end_page = (dma_zone->end_address + PAGE_SIZE - 1) / PAGE_SIZE;
         
         for (uint64_t i = start_page; i < end_page && i < total_pages; i++) {
             page_frames[i].flags = PAGE_FLAG_FREE | PAGE_FLAG_DMA;
-            free_pages++;
+            dma_free++;
         }
     }
+    account_free_pages(PAGE_FLAG_DMA, (int64_t)dma_free);
     
     /* Process normal zone */
+    uint64_t normal_free = 0;
     if (normal_zone->size > 0) {
         uint64_t start_page = normal_zone->start_address / PAGE_SIZE;
         uint64_t end_page = (normal_zone->end_address + PAGE_SIZE - 1) / PAGE_SIZE;
@@ -106,10 +125,11 @@ static void init_physical_memory(void) {
             /* Check if already marked as DMA (overlapping zones) */
             if ((page_frames[i].flags & PAGE_FLAG_FREE) == 0) {
                 page_frames[i].flags = PAGE_FLAG_FREE;
-                free_pages++;
+                normal_free++;
             }
         }
     }
+    account_free_pages(0, (int64_t)normal_free);
     
     /* Reserve kernel pages */
     extern uint64_t _kernel_physical_start;
@@ -124,22 +144,25 @@ static void init_physical_memory(void) {
     
     for (uint64_t i = kernel_start_page; i < kernel_end_page && i < total_pages; i++) {
         if (page_frames[i].flags & PAGE_FLAG_FREE) {
+            account_free_pages(page_frames[i].flags, -1);
             page_frames[i].flags = PAGE_FLAG_USED | PAGE_FLAG_KERNEL;
             page_frames[i].ref_count = 1;
-            free_pages--;
         }
     }
     
     /* Reserve first 1MB for BIOS and early boot structures */
     for (uint64_t i = 0; i < 256 && i < total_pages; i++) {
         if (page_frames[i].flags & PAGE_FLAG_FREE) {
+            account_free_pages(page_frames[i].flags, -1);
             page_frames[i].flags = PAGE_FLAG_RESERVED;
-            free_pages--;
         }
     }
     
+    /* Keep the boot archive where the boot loader put it */
+    initrd_reserve();
+    
     LOG_INFO("Physical memory initialized: %llu pages total, %llu pages free",
-           total_pages, free_pages);
+           total_pages, (uint64_t)pcpu_batch_sum(&free_pages));
 }
 
 /* Allocate a single physical page */
@@ -149,7 +172,8 @@ void* alloc_page(void) {
         if (page_frames[i].flags == PAGE_FLAG_FREE) {
             page_frames[i].flags = PAGE_FLAG_USED;
             page_frames[i].ref_count = 1;
-            free_pages--;
+            account_free_pages(0, -1);
+            this_cpu_counter_inc(PCPU_MEM_PAGE_ALLOCS);
             return (void*)(i * PAGE_SIZE);
         }
     }
@@ -167,7 +191,8 @@ void* alloc_dma_page(void) {
             (PAGE_FLAG_FREE | PAGE_FLAG_DMA)) {
             page_frames[i].flags = (page_frames[i].flags & ~PAGE_FLAG_FREE) | PAGE_FLAG_USED;
             page_frames[i].ref_count = 1;
-            free_pages--;
+            account_free_pages(PAGE_FLAG_DMA, -1);
+            this_cpu_counter_inc(PCPU_MEM_PAGE_ALLOCS);
             return (void*)(i * PAGE_SIZE);
         }
     }
@@ -204,7 +229,8 @@ void free_page(void* page) {
     if (page_frames[idx].ref_count == 0) {
         /* Keep DMA flag if present, but set page as free */
         page_frames[idx].flags = (page_frames[idx].flags & PAGE_FLAG_DMA) | PAGE_FLAG_FREE;
-        free_pages++;
+        account_free_pages(page_frames[idx].flags, 1);
+        this_cpu_counter_inc(PCPU_MEM_PAGE_FREES);
     }
 }
 
@@ -269,8 +295,8 @@ void reserve_page_range(void* start, size_t size) {
     
     for (uint64_t i = start_page; i < end_page && i < total_pages; i++) {
         if (page_frames[i].flags & PAGE_FLAG_FREE) {
+            account_free_pages(page_frames[i].flags, -1);
             page_frames[i].flags = PAGE_FLAG_RESERVED;
-            free_pages--;
         }
     }
     
@@ -280,47 +306,65 @@ void reserve_page_range(void* start, size_t size) {
 
 /* Get memory statistics */
 void get_memory_stats(uint64_t* total, uint64_t* free, uint64_t* used) {
+    uint64_t free_count = (uint64_t)pcpu_batch_sum(&free_pages);
+    
     if (total) {
         *total = total_pages * PAGE_SIZE;
     }
     
     if (free) {
-        *free = free_pages * PAGE_SIZE;
+        *free = free_count * PAGE_SIZE;
     }
     
     if (used) {
-        *used = (total_pages - free_pages) * PAGE_SIZE;
+        *used = (total_pages - free_count) * PAGE_SIZE;
+    }
+}
+
+/* Get the number of free pages in a zone */
+uint64_t get_zone_free_pages(memory_zone_type_t zone) {
+    if (zone != ZONE_NORMAL && zone != ZONE_DMA) {
+        return 0;
     }
+    return (uint64_t)pcpu_batch_sum(&zone_free_pages[zone]);
 }
 
 /* Basic kernel heap - very simple for now, will be replaced later */
 #define HEAP_START 0xFFFFFFFF90000000
 #define HEAP_SIZE  (16 * 1024 * 1024) /* 16MB initial heap */
 
+/* Very simple bump allocator */
+static void* heap_next = (void*)HEAP_START;
+static size_t heap_remaining = HEAP_SIZE;
+
 /* Extremely simple kmalloc/kfree implementation - just for early boot */
-void* kmalloc(size_t size) {
+static void* heap_alloc(size_t size) {
     /* Align to 16 bytes */
     size = (size + 15) & ~15;
     
-    /* Very simple bump allocator */
-    static void* next_addr = (void*)HEAP_START;
-    static size_t remaining = HEAP_SIZE;
-    
-    if (size > remaining) {
+    if (size > heap_remaining) {
         LOG_ERROR("Out of kernel heap memory!");
         return NULL;
     }
     
-    void* result = next_addr;
-    next_addr = (void*)((uint64_t)next_addr + size);
-    remaining -= size;
+    void* result = heap_next;
+    heap_next = (void*)((uint64_t)heap_next + size);
+    heap_remaining -= size;
     
     return result;
 }
 
+/* Allocate memory, counted against the caller by the heap profiler */
+void* kmalloc(size_t size) {
+    void* ptr = heap_alloc(size);
+    kmemprof_alloc(ptr, size, (uintptr_t)__builtin_return_address(0));
+    return ptr;
+}
+
 /* Allocate zeroed memory */
 void* kzalloc(size_t size) {
-    void* ptr = kmalloc(size);
+    void* ptr = heap_alloc(size);
+    kmemprof_alloc(ptr, size, (uintptr_t)__builtin_return_address(0));
     if (ptr) {
         /* Zero the memory */
         for (size_t i = 0; i < size; i++) {
@@ -334,6 +378,17 @@ void* kzalloc(size_t size) {
 void kfree(void* ptr) {
     /* Not implemented in the simple bump allocator */
     /* Will be implemented in the real kernel heap */
+    kmemprof_free(ptr);
+}
+
+/* Get kernel heap usage in bytes */
+void get_heap_stats(size_t* used, size_t* size) {
+    if (used) {
+        *used = HEAP_SIZE - heap_remaining;
+    }
+    if (size) {
+        *size = HEAP_SIZE;
+    }
 }
 
 /* Basic memory operations */
@@ -384,6 +439,20 @@ void* memmove(void* dest, const void* src, size_t n) {
     return dest;
 }
 
+/* Copy at most n characters, padding the rest of dest with zeros */
+char* strncpy(char* dest, const char* src, size_t n) {
+    size_t i = 0;
+    
+    for (; i < n && src[i] != '\0'; i++) {
+        dest[i] = src[i];
+    }
+    for (; i < n; i++) {
+        dest[i] = '\0';
+    }
+    
+    return dest;
+}
+
 /* Called from init_memory() in main.c */
 void init_physical_memory_manager(void) {
     /* Initialize the physical memory manager */
@@ -24,6 +24,7 @@
 #define PAGE_GLOBAL         (1ULL << 8)
 #define PAGE_COW            (1ULL << 9)  /* Custom: Copy-on-write */
 #define PAGE_READ_ONLY      (1ULL << 10) /* Custom: Read-only */
+#define PAGE_PINNED         (1ULL << 11) /* Custom: Pinned for device DMA */
 #define PAGE_EXEC_DISABLE   (1ULL << 63) /* NX bit */
 
 /* Page directory levels (for x86_64 4-level paging) */
@@ -89,6 +90,7 @@ static int handle_cow_page_fault(struct page_directory* pd, uint64_t fault_addr,
 static void track_page_fault(struct page_directory* pd, uint64_t fault_addr, uint64_t error_code);
 static void* get_physical_address(struct page_directory* pd, uint64_t virtual_addr);
 static int set_page_flags(struct page_directory* pd, uint64_t virtual_addr, uint64_t flags, uint64_t mask);
+static uint64_t get_page_entry(struct page_directory* pd, uint64_t virtual_addr);
 
 /*
  * Initialize the page directory management system
@@ -564,6 +566,15 @@ int unmap_memory_range(page_directory_t pd, uint64_t vaddr, size_t size, bool fr
     /* Lock the page directory */
     mutex_lock(&directory->lock);
     
+    /* Pages pinned for DMA must be unpinned first */
+    for (uint64_t i = 0; i < num_pages; i++) {
+        if (get_page_entry(directory, start_vaddr + (i * PAGE_SIZE_4K)) & PAGE_PINNED) {
+            LOG_ERROR("Address %p is pinned for DMA", (void*)(start_vaddr + (i * PAGE_SIZE_4K)));
+            mutex_unlock(&directory->lock);
+            return -EBUSY;
+        }
+    }
+    
     /* For each page to be unmapped */
     for (uint64_t i = 0; i < num_pages; i++) {
         uint64_t curr_vaddr = start_vaddr + (i * PAGE_SIZE_4K);
@@ -891,6 +902,11 @@ static int mark_pages_cow(struct page_directory* pd, uint64_t start_addr, uint64
     
     /* For each page in the range */
     for (uint64_t addr = start_page; addr < end_page; addr += PAGE_SIZE_4K) {
+        /* A device may be writing to a pinned page, so it stays shared */
+        if (get_page_entry(pd, addr) & PAGE_PINNED) {
+            continue;
+        }
+        
         /* Make writable pages COW by removing write permission and adding COW flag */
         if (set_page_flags(pd, addr, PAGE_COW, PAGE_WRITABLE) == 0) {
             modified_pages++;
@@ -1299,6 +1315,178 @@ static int set_page_flags(struct page_directory* pd, uint64_t virtual_addr, uint
     return 0;
 }
 
+/*
+ * Get the leaf page table entry for a virtual address
+ *
+ * pd: Page directory to look in
+ * virtual_addr: Virtual address of the page
+ *
+ * Returns: The entry (4K, 2MB or 1GB), or 0 if not mapped
+ */
+static uint64_t get_page_entry(struct page_directory* pd, uint64_t virtual_addr) {
+    uint64_t pml4_entry = pd->pml4_table[(virtual_addr >> 39) & 0x1FF];
+    if (!(pml4_entry & PAGE_PRESENT)) {
+        return 0;
+    }
+    
+    uint64_t pdpt_entry = ((uint64_t*)(pml4_entry & ~0xFFF))[(virtual_addr >> 30) & 0x1FF];
+    if (!(pdpt_entry & PAGE_PRESENT) || (pdpt_entry & PAGE_SIZE)) {
+        return pdpt_entry;
+    }
+    
+    uint64_t pd_entry = ((uint64_t*)(pdpt_entry & ~0xFFF))[(virtual_addr >> 21) & 0x1FF];
+    if (!(pd_entry & PAGE_PRESENT) || (pd_entry & PAGE_SIZE)) {
+        return pd_entry;
+    }
+    
+    return ((uint64_t*)(pd_entry & ~0xFFF))[(virtual_addr >> 12) & 0x1FF];
+}
+
+/*
+ * Find the page directory owned by a task
+ *
+ * owner_pid: PID of the owning task
+ *
+ * Returns: The page directory or NULL if the task has none
+ */
+page_directory_t find_page_directory(pid_t owner_pid) {
+    struct page_directory* pd;
+    
+    if (!pd_system_initialized) {
+        return NULL;
+    }
+    
+    mutex_lock(&global_pd_lock);
+    for (pd = all_page_directories; pd != NULL; pd = pd->next) {
+        if (pd->owner_pid == (uint32_t)owner_pid) {
+            break;
+        }
+    }
+    mutex_unlock(&global_pd_lock);
+    
+    return pd;
+}
+
+/*
+ * Map device memory into a task's address space
+ *
+ * Device registers must not be cached, and nothing in them is code.
+ * DMA buffers are cache coherent on x86 and are mapped cached.
+ *
+ * pd: Page directory of the task
+ * vaddr: Starting virtual address
+ * paddr: Starting physical address
+ * size: Size of the range to map in bytes
+ * writable: Whether the task may write to the range
+ * uncached: Whether to map with PAGE_CACHE_DISABLE (MMIO)
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+int map_device_memory(page_directory_t pd, uint64_t vaddr, uint64_t paddr, size_t size,
+                      bool writable, bool uncached) {
+    uint64_t flags = PAGE_USER | PAGE_EXEC_DISABLE;
+    
+    if (writable) {
+        flags |= PAGE_WRITABLE;
+    }
+    if (uncached) {
+        flags |= PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH;
+    }
+    
+    return map_memory_range(pd, vaddr, paddr, size, flags);
+}
+
+/*
+ * Pin a task's buffer for device DMA
+ *
+ * Copy-on-write pages are broken first, since the copy would move the
+ * page away from the device. Pinned pages cannot be unmapped and stay
+ * shared across copy_page_directory().
+ *
+ * pd: Page directory of the task
+ * vaddr: Starting virtual address of the buffer
+ * size: Size of the buffer in bytes
+ * phys: Receives the physical address of each page
+ * max_pages: Size of the phys array
+ *
+ * Returns: Number of pages pinned, or negative error code on failure
+ */
+int pin_user_pages(page_directory_t pd, uint64_t vaddr, size_t size,
+                   uint64_t* phys, size_t max_pages) {
+    struct page_directory* directory = (struct page_directory*)pd;
+    
+    if (!pd_system_initialized || directory == NULL || size == 0) {
+        return -EINVAL;
+    }
+    
+    uint64_t start_vaddr = vaddr & ~(PAGE_SIZE_4K - 1);
+    uint64_t end_vaddr = (vaddr + size + PAGE_SIZE_4K - 1) & ~(PAGE_SIZE_4K - 1);
+    uint64_t num_pages = (end_vaddr - start_vaddr) / PAGE_SIZE_4K;
+    
+    if (num_pages > max_pages) {
+        return -EINVAL;
+    }
+    
+    mutex_lock(&directory->lock);
+    
+    /* Resolve copy-on-write before looking up the final physical pages */
+    for (uint64_t i = 0; i < num_pages; i++) {
+        uint64_t curr_vaddr = start_vaddr + (i * PAGE_SIZE_4K);
+        uint64_t entry = get_page_entry(directory, curr_vaddr);
+        
+        if (!(entry & PAGE_PRESENT) || !(entry & PAGE_USER)) {
+            mutex_unlock(&directory->lock);
+            return -EFAULT;
+        }
+        if ((entry & PAGE_COW) &&
+            handle_cow_page_fault(directory, curr_vaddr, MEM_ACCESS_WRITE | MEM_ACCESS_USER) != 0) {
+            mutex_unlock(&directory->lock);
+            return -ENOMEM;
+        }
+    }
+    
+    for (uint64_t i = 0; i < num_pages; i++) {
+        uint64_t curr_vaddr = start_vaddr + (i * PAGE_SIZE_4K);
+        
+        phys[i] = (uint64_t)get_physical_address(directory, curr_vaddr);
+        set_page_flags(directory, curr_vaddr, PAGE_PINNED, 0);
+    }
+    
+    mutex_unlock(&directory->lock);
+    
+    return (int)num_pages;
+}
+
+/*
+ * Release pages pinned by pin_user_pages()
+ *
+ * pd: Page directory of the task
+ * vaddr: Starting virtual address of the buffer
+ * size: Size of the buffer in bytes
+ *
+ * Returns: 0 on success, negative error code on failure
+ */
+int unpin_user_pages(page_directory_t pd, uint64_t vaddr, size_t size) {
+    struct page_directory* directory = (struct page_directory*)pd;
+    
+    if (!pd_system_initialized || directory == NULL || size == 0) {
+        return -EINVAL;
+    }
+    
+    uint64_t start_vaddr = vaddr & ~(PAGE_SIZE_4K - 1);
+    uint64_t end_vaddr = (vaddr + size + PAGE_SIZE_4K - 1) & ~(PAGE_SIZE_4K - 1);
+    
+    mutex_lock(&directory->lock);
+    
+    for (uint64_t addr = start_vaddr; addr < end_vaddr; addr += PAGE_SIZE_4K) {
+        set_page_flags(directory, addr, 0, PAGE_PINNED);
+    }
+    
+    mutex_unlock(&directory->lock);
+    
+    return 0;
+}
+
 /*
  * Dump page directory information for debugging
  *
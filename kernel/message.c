@@ -9,6 +9,9 @@
 #include <edgex/memory.h>
 #include <edgex/scheduler.h>
 #include <edgex/ipc.h>
+#include <edgex/ipc/latency.h>
+#include <edgex/percpu.h>
+#include <edgex/trace.h>
 
 /* Maximum number of message queues in the system */
 #define MAX_MESSAGE_QUEUES 32
@@ -20,6 +23,7 @@
 /* Message node in a queue */
 typedef struct message_node {
     message_t message;              /* The actual message */
+    uint64_t queued_tsc;            /* When it was queued */
     struct message_node* next;      /* Next message in queue */
 } message_node_t;
 
@@ -41,6 +45,7 @@ struct message_queue {
     /* Statistics */
     uint64_t messages_sent;         /* Total messages sent */
     uint64_t messages_received;     /* Total messages received */
+    ipc_lat_id_t lat_id;            /* Send-to-receive histogram (ipc/latency.h) */
 };
 
 /* Pool of all message queues */
@@ -125,8 +130,10 @@ message_queue_t create_message_queue(const char* name, uint32_t max_messages) {
     
     queue->messages_sent = 0;
     queue->messages_received = 0;
+    queue->lat_id = ipc_lat_register(IPC_LAT_MSG_DELIVERY, queue->header.name);
     
     message_queue_count++;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_CREATED, 1, PCPU_IPC_MESSAGE_QUEUES, 1);
     return queue;
 }
 
@@ -163,11 +170,13 @@ static void destroy_message_queue(void* queue_ptr) {
     destroy_mutex(queue->mutex);
     destroy_semaphore(queue->free_slots);
     destroy_semaphore(queue->used_slots);
+    ipc_lat_unregister(queue->lat_id);
     
     // Clear the queue
     memset(queue, 0, sizeof(struct message_queue));
     
     message_queue_count--;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_DESTROYED, 1, PCPU_IPC_MESSAGE_QUEUES, -1);
 }
 
 /*
@@ -224,6 +233,7 @@ static int enqueue_message(message_queue_t queue, message_t* message, uint32_t f
     
     // Copy the message
     memcpy(&node->message, message, sizeof(message_t));
+    node->queued_tsc = rdtsc();
     node->next = NULL;
     
     // Lock the queue
@@ -282,6 +292,7 @@ static int dequeue_message(message_queue_t queue, message_t* message, uint32_t f
     
     // Copy the message
     memcpy(message, &node->message, sizeof(message_t));
+    uint64_t latency = rdtsc() - node->queued_tsc;
     
     queue->message_count--;
     queue->messages_received++;
@@ -291,6 +302,7 @@ static int dequeue_message(message_queue_t queue, message_t* message, uint32_t f
     
     // Free the node
     free_message_node(node);
+    ipc_lat_record(queue->lat_id, latency);
     
     // Signal that a slot is available
     semaphore_post(queue->free_slots);
@@ -306,6 +318,8 @@ int send_message(message_queue_t queue, message_t* message, uint32_t flags) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_MESSAGE_OPS);
+    
     // Fill in missing header fields
     message->header.sender = get_current_pid();
     message->header.message_id = next_message_id++;
@@ -326,6 +340,9 @@ int send_message(message_queue_t queue, message_t* message, uint32_t flags) {
     
     // Enqueue the message
     int result = enqueue_message(queue, message, flags);
+    if (result == 0) {
+        trace_msg_send(queue, message->header.message_id);
+    }
     
     // If message is urgent, put it at the front
     if (result == 0 && (flags & MESSAGE_FLAG_URGENT)) {
@@ -348,6 +365,8 @@ int receive_message(message_queue_t queue, message_t* message, uint32_t flags) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_MESSAGE_OPS);
+    
     // Check if queue is private and caller is not the owner
     if ((queue->flags & MSG_QUEUE_FLAG_PRIVATE) && queue->owner != get_current_pid()) {
         return -1;
@@ -367,7 +386,11 @@ int receive_message(message_queue_t queue, message_t* message, uint32_t flags) {
     }
     
     // Dequeue the message
-    return dequeue_message(queue, message, flags);
+    int result = dequeue_message(queue, message, flags);
+    if (result == 0) {
+        trace_msg_receive(queue, message->header.message_id);
+    }
+    return result;
 }
 
 /*
@@ -390,6 +413,31 @@ int reply_to_message(message_t* original, message_t* reply, uint32_t flags) {
     return 0;
 }
 
+/*
+ * Sample the depth of every message queue, without their locks
+ */
+uint32_t get_message_queue_depths(message_queue_depth_t* depths, uint32_t max) {
+    uint32_t count = 0;
+    
+    for (uint32_t i = 0; i < MAX_MESSAGE_QUEUES && count < max; i++) {
+        message_queue_t queue = &message_queue_pool[i];
+        
+        if (queue->header.type != IPC_TYPE_MESSAGE_QUEUE) {
+            continue;
+        }
+        
+        message_queue_depth_t* depth = &depths[count++];
+        strncpy(depth->name, queue->header.name, sizeof(depth->name) - 1);
+        depth->name[sizeof(depth->name) - 1] = '\0';
+        depth->owner = queue->owner;
+        depth->depth = queue->message_count;
+        depth->max_messages = queue->max_messages;
+        depth->messages_sent = queue->messages_sent;
+        depth->messages_received = queue->messages_received;
+    }
+    return count;
+}
+
 /*
  * Clean up message queues for a terminated task
  */
@@ -0,0 +1,148 @@
+/*
+ * EdgeX OS - Interrupt Mitigation by Polling (NAPI)
+ *
+ * This file implements the per-CPU poll lists run by the NET_RX softirq.
+ * A scheduled context stays on its CPU's list until its poll function
+ * drains the queue; each softirq run is bounded by a packet budget and
+ * a time limit, and leftover work re-raises the softirq (which moves to
+ * ksoftirqd if it keeps going).
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/softirq.h>
+#include <edgex/tsc.h>
+#include <edgex/napi.h>
+
+/* Packets processed per NET_RX run across all contexts */
+#define NAPI_SOFTIRQ_BUDGET   300
+
+/* Time limit for one NET_RX run */
+#define NAPI_SOFTIRQ_TIME_NS  2000000
+
+/* Per-CPU poll list (only touched by its CPU, interrupts disabled) */
+typedef struct {
+    napi_t* head;
+    napi_t* tail;
+    uint64_t runs;               /* NET_RX runs */
+    uint64_t time_squeezed;      /* Runs stopped by the budget or time limit */
+} napi_cpu_t;
+
+static napi_cpu_t napi_cpus[MAX_CPUS];
+
+/*
+ * Append a context to the local poll list (interrupts disabled)
+ */
+static void napi_list_add(napi_cpu_t* nc, napi_t* napi) {
+    napi->next = NULL;
+    if (nc->tail) {
+        nc->tail->next = napi;
+    } else {
+        nc->head = napi;
+    }
+    nc->tail = napi;
+}
+
+/*
+ * Set up a poll context
+ */
+void napi_init(napi_t* napi, napi_poll_t poll, int weight, void* priv) {
+    memset(napi, 0, sizeof(*napi));
+    napi->poll = poll;
+    napi->weight = weight > 0 ? weight : NAPI_POLL_WEIGHT;
+    napi->priv = priv;
+}
+
+/*
+ * Schedule a poll on the calling CPU
+ */
+bool napi_schedule(napi_t* napi) {
+    if (__atomic_fetch_or(&napi->state, NAPI_STATE_SCHED, __ATOMIC_ACQUIRE) & NAPI_STATE_SCHED) {
+        return false;
+    }
+
+    uint64_t flags = local_irq_save();
+    napi->cpu = smp_processor_id();
+    napi->stats.schedules++;
+    napi_list_add(&napi_cpus[napi->cpu], napi);
+    raise_softirq_irqoff(SOFTIRQ_NET_RX);
+    local_irq_restore(flags);
+    return true;
+}
+
+/*
+ * Leave polling mode
+ */
+void napi_complete(napi_t* napi) {
+    __atomic_fetch_and(&napi->state, ~NAPI_STATE_SCHED, __ATOMIC_RELEASE);
+}
+
+/*
+ * NET_RX softirq: poll the scheduled contexts round-robin
+ */
+static void net_rx_action(void) {
+    napi_cpu_t* nc = &napi_cpus[smp_processor_id()];
+    uint64_t deadline = rdtsc() + ns_to_tsc(NAPI_SOFTIRQ_TIME_NS);
+    int budget = NAPI_SOFTIRQ_BUDGET;
+    uint64_t flags;
+
+    nc->runs++;
+
+    for (;;) {
+        flags = local_irq_save();
+        napi_t* napi = nc->head;
+        if (!napi) {
+            local_irq_restore(flags);
+            return;
+        }
+        nc->head = napi->next;
+        if (!nc->head) {
+            nc->tail = NULL;
+        }
+        local_irq_restore(flags);
+
+        int work = napi->poll(napi, napi->weight);
+        napi->stats.polls++;
+        napi->stats.packets += (uint64_t)work;
+        budget -= work;
+
+        // A full weight means more is waiting: stay in polling mode
+        if (work >= napi->weight) {
+            napi->stats.budget_exhausted++;
+            flags = local_irq_save();
+            napi_list_add(nc, napi);
+            local_irq_restore(flags);
+        }
+
+        if (budget <= 0 || rdtsc() > deadline) {
+            flags = local_irq_save();
+            if (nc->head) {
+                nc->time_squeezed++;
+                raise_softirq_irqoff(SOFTIRQ_NET_RX);
+            }
+            local_irq_restore(flags);
+            return;
+        }
+    }
+}
+
+/*
+ * Register the NET_RX softirq
+ */
+void init_napi(void) {
+    open_softirq(SOFTIRQ_NET_RX, net_rx_action);
+}
+
+/*
+ * Print poll statistics
+ */
+void dump_napi_stats(napi_t* napi, const char* name) {
+    kernel_printf("%s: %llu schedules, %llu polls, %llu packets, %llu budget exhausted\n",
+                  name, napi->stats.schedules, napi->stats.polls, napi->stats.packets,
+                  napi->stats.budget_exhausted);
+
+    for (uint32_t cpu = 0; cpu < num_online_cpus(); cpu++) {
+        kernel_printf("  CPU %u: %llu NET_RX runs, %llu squeezed\n",
+                      cpu, napi_cpus[cpu].runs, napi_cpus[cpu].time_squeezed);
+    }
+}
@@ -0,0 +1,916 @@
+/*
+ * EdgeX OS - Network Stack
+ *
+ * This file implements Ethernet, ARP, IPv4, IPv6 neighbor discovery and
+ * UDP on top of the virtio-net driver. Receive runs in the NET_RX softirq
+ * of the queue's CPU: a frame is parsed where the device wrote it and a
+ * UDP payload is handed to its socket as a descriptor, keeping the
+ * buffer until the consumer releases it. Transmit builds the headers in
+ * the headroom in front of the caller's payload and lets the device
+ * compute the UDP checksum when it can. The netd service task resends
+ * neighbor requests and ages the neighbor cache.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/cpu.h>
+#include <edgex/scheduler.h>
+#include <edgex/spinlock.h>
+#include <edgex/virtio_net.h>
+#include <edgex/net.h>
+#include <edgex/udp.h>
+
+/* Neighbor cache */
+#define NET_NEIGH_ENTRIES       64
+#define NET_NEIGH_RETRIES       3
+#define NET_NEIGH_RETRY_TICKS   1000       /* ms between requests */
+#define NET_NEIGH_TIMEOUT_TICKS 300000     /* Forget entries after 5 minutes */
+#define NETD_PERIOD_MS          100
+
+typedef enum {
+    NEIGH_FREE = 0,
+    NEIGH_INCOMPLETE,            /* Request sent, no answer yet */
+    NEIGH_REACHABLE
+} neigh_state_t;
+
+/* A frame waiting for its neighbor's link-layer address */
+typedef struct {
+    uint8_t* frame;              /* Ethernet header; destination filled on resolve */
+    virtio_net_tx_t pkt;
+    uint16_t queue;
+    bool valid;
+} neigh_pending_t;
+
+typedef struct {
+    net_addr_t addr;
+    uint8_t mac[ETH_ALEN];
+    neigh_state_t state;
+    uint32_t retries;
+    uint64_t updated;            /* Tick of the last answer or request */
+    neigh_pending_t pending;
+} neigh_entry_t;
+
+/* Buffers for ARP and neighbor discovery frames */
+#define NET_CTL_BUFS            32
+#define NET_CTL_BUF_SIZE        128
+#define NET_CTL_COOKIE          (1ULL << 62)
+
+static virtio_net_t* net_dev;
+static net_config_t net_cfg;
+static uint8_t net_ipv6_ll[16];             /* Link-local address (EUI-64) */
+static net_stats_t net_stats;
+
+static neigh_entry_t neigh_cache[NET_NEIGH_ENTRIES];
+static spinlock_t neigh_lock = SPINLOCK_INIT;
+
+static uint8_t* ctl_bufs;
+static uint32_t ctl_free_mask;              /* Bit set: buffer free */
+static spinlock_t ctl_lock = SPINLOCK_INIT;
+
+static const uint8_t eth_broadcast[ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint8_t ipv6_all_nodes[16] = { 0xFF, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+
+/*
+ * Add data to a checksum accumulator
+ */
+uint32_t net_csum_add(uint32_t sum, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t acc = sum;
+
+    while (len >= 4) {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        acc += word;
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t half;
+        memcpy(&half, p, 2);
+        acc += half;
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        acc += *p;   // Odd trailing byte, padded with zero (little-endian)
+    }
+
+    while (acc >> 32) {
+        acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+    }
+    return (uint32_t)acc;
+}
+
+/*
+ * Fold an accumulator into the final (complemented) checksum
+ */
+uint16_t net_csum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/*
+ * Pseudo-header sum for a UDP or ICMPv6 checksum
+ */
+static uint32_t net_pseudo_sum(uint8_t family, const void* src, const void* dst,
+                               uint8_t proto, uint16_t len) {
+    uint32_t sum = 0;
+    size_t alen = family == NET_AF_INET ? 4 : 16;
+
+    sum = net_csum_add(sum, src, alen);
+    sum = net_csum_add(sum, dst, alen);
+    sum += htons(proto);
+    sum += htons(len);
+    return sum;
+}
+
+/*
+ * Make an IPv4 address
+ */
+net_addr_t net_addr_ipv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    net_addr_t addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.family = NET_AF_INET;
+    addr.addr[0] = a;
+    addr.addr[1] = b;
+    addr.addr[2] = c;
+    addr.addr[3] = d;
+    return addr;
+}
+
+/*
+ * Make an IPv6 address
+ */
+net_addr_t net_addr_ipv6(const uint8_t* bytes) {
+    net_addr_t addr;
+
+    addr.family = NET_AF_INET6;
+    memcpy(addr.addr, bytes, 16);
+    return addr;
+}
+
+/*
+ * Compare addresses
+ */
+static bool net_addr_equal(const net_addr_t* a, const net_addr_t* b) {
+    if (a->family != b->family) {
+        return false;
+    }
+    return memcmp(a->addr, b->addr, a->family == NET_AF_INET ? 4 : 16) == 0;
+}
+
+static inline bool ipv6_is_zero(const uint8_t* addr) {
+    static const uint8_t zero[16];
+    return memcmp(addr, zero, 16) == 0;
+}
+
+static inline bool ipv6_is_link_local(const uint8_t* addr) {
+    return addr[0] == 0xFE && (addr[1] & 0xC0) == 0x80;
+}
+
+/*
+ * Solicited-node multicast group of an address (ff02::1:ffXX:XXXX)
+ */
+static void ipv6_solicited_node(const uint8_t* addr, uint8_t* group) {
+    static const uint8_t prefix[13] = { 0xFF, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0xFF };
+
+    memcpy(group, prefix, sizeof(prefix));
+    memcpy(group + 13, addr + 13, 3);
+}
+
+/*
+ * Ethernet address of an IPv6 multicast group (33:33 + low 32 bits)
+ */
+static void ipv6_multicast_mac(const uint8_t* group, uint8_t* mac) {
+    mac[0] = 0x33;
+    mac[1] = 0x33;
+    memcpy(mac + 2, group + 12, 4);
+}
+
+/*
+ * Check whether an IPv6 destination is one of ours
+ */
+static bool ipv6_is_local(const uint8_t* addr) {
+    uint8_t group[16];
+
+    if (memcmp(addr, net_ipv6_ll, 16) == 0) {
+        return true;
+    }
+    if (!ipv6_is_zero(net_cfg.ipv6) && memcmp(addr, net_cfg.ipv6, 16) == 0) {
+        return true;
+    }
+
+    // Neighbor solicitations for either address
+    ipv6_solicited_node(net_ipv6_ll, group);
+    if (memcmp(addr, group, 16) == 0) {
+        return true;
+    }
+    if (!ipv6_is_zero(net_cfg.ipv6)) {
+        ipv6_solicited_node(net_cfg.ipv6, group);
+        if (memcmp(addr, group, 16) == 0) {
+            return true;
+        }
+    }
+
+    return memcmp(addr, ipv6_all_nodes, 16) == 0;
+}
+
+/*
+ * Source address for an IPv6 destination
+ */
+static const uint8_t* ipv6_source_for(const uint8_t* dst) {
+    if (ipv6_is_link_local(dst) || ipv6_is_zero(net_cfg.ipv6)) {
+        return net_ipv6_ll;
+    }
+    return net_cfg.ipv6;
+}
+
+/*
+ * Take a control frame buffer
+ */
+static int ctl_buf_alloc(void) {
+    uint64_t flags;
+    int idx = -1;
+
+    spin_lock_irqsave(&ctl_lock, flags);
+    if (ctl_free_mask) {
+        idx = __builtin_ctz(ctl_free_mask);
+        ctl_free_mask &= ~(1U << idx);
+    }
+    spin_unlock_irqrestore(&ctl_lock, flags);
+
+    return idx;
+}
+
+static void ctl_buf_free(int idx) {
+    uint64_t flags;
+
+    spin_lock_irqsave(&ctl_lock, flags);
+    ctl_free_mask |= 1U << idx;
+    spin_unlock_irqrestore(&ctl_lock, flags);
+}
+
+/*
+ * Send a control frame built in a control buffer
+ */
+static void ctl_xmit(uint16_t queue, int idx, uint16_t len) {
+    virtio_net_tx_t pkt = {
+        .phys = (uint64_t)(ctl_bufs + idx * NET_CTL_BUF_SIZE),   // Identity-mapped page
+        .len = len,
+        .cookie = (void*)(uintptr_t)(NET_CTL_COOKIE | (uint64_t)idx),
+    };
+
+    if (virtio_net_xmit(net_dev, queue, &pkt, false) < 0) {
+        ctl_buf_free(idx);
+    }
+}
+
+/*
+ * Transmit completion: return the buffer to its owner
+ */
+static void net_tx_done(virtio_net_t* net, uint16_t queue, void* cookie) {
+    uintptr_t value = (uintptr_t)cookie;
+    (void)net;
+    (void)queue;
+
+    if (value & NET_CTL_COOKIE) {
+        ctl_buf_free((int)(value & ~NET_CTL_COOKIE));
+    } else {
+        udp_tx_complete(cookie, true);
+    }
+}
+
+/*
+ * Send an ARP request or reply
+ */
+static void arp_send(uint16_t queue, uint16_t op, const uint8_t* dst_mac, uint32_t target_ip) {
+    int idx = ctl_buf_alloc();
+    if (idx < 0) {
+        return;
+    }
+
+    uint8_t* frame = ctl_bufs + idx * NET_CTL_BUF_SIZE;
+    eth_hdr_t* eth = (eth_hdr_t*)frame;
+    arp_pkt_t* arp = (arp_pkt_t*)(frame + ETH_HLEN);
+
+    memcpy(eth->dst, dst_mac, ETH_ALEN);
+    memcpy(eth->src, net_dev->mac, ETH_ALEN);
+    eth->type = htons(ETH_TYPE_ARP);
+
+    arp->htype = htons(1);
+    arp->ptype = htons(ETH_TYPE_IPV4);
+    arp->hlen = ETH_ALEN;
+    arp->plen = 4;
+    arp->op = htons(op);
+    memcpy(arp->sha, net_dev->mac, ETH_ALEN);
+    arp->spa = net_cfg.ipv4;
+    if (op == ARP_OP_REPLY) {
+        memcpy(arp->tha, dst_mac, ETH_ALEN);
+    } else {
+        memset(arp->tha, 0, ETH_ALEN);
+        net_stats.arp_requests++;
+    }
+    arp->tpa = target_ip;
+
+    ctl_xmit(queue, idx, ETH_HLEN + sizeof(arp_pkt_t));
+}
+
+/*
+ * Send a neighbor solicitation or advertisement
+ */
+static void nd_send(uint16_t queue, uint8_t type, const uint8_t* dst_mac, const uint8_t* dst_ip,
+                    const uint8_t* target, uint32_t flags) {
+    int idx = ctl_buf_alloc();
+    if (idx < 0) {
+        return;
+    }
+
+    uint8_t* frame = ctl_bufs + idx * NET_CTL_BUF_SIZE;
+    eth_hdr_t* eth = (eth_hdr_t*)frame;
+    ipv6_hdr_t* ip6 = (ipv6_hdr_t*)(frame + ETH_HLEN);
+    nd_msg_t* nd = (nd_msg_t*)(frame + ETH_HLEN + IPV6_HLEN);
+    const uint8_t* src_ip = ipv6_source_for(target);
+
+    memcpy(eth->dst, dst_mac, ETH_ALEN);
+    memcpy(eth->src, net_dev->mac, ETH_ALEN);
+    eth->type = htons(ETH_TYPE_IPV6);
+
+    ip6->ver_tc_flow = htonl(6U << 28);
+    ip6->payload_len = htons(sizeof(nd_msg_t));
+    ip6->next_hdr = IP_PROTO_ICMPV6;
+    ip6->hop_limit = 255;   // Required for neighbor discovery
+    memcpy(ip6->src, src_ip, 16);
+    memcpy(ip6->dst, dst_ip, 16);
+
+    nd->type = type;
+    nd->code = 0;
+    nd->csum = 0;
+    nd->flags = htonl(flags);
+    memcpy(nd->target, target, 16);
+    nd->opt_type = type == ICMPV6_NS ? ND_OPT_SOURCE_LLADDR : ND_OPT_TARGET_LLADDR;
+    nd->opt_len = 1;
+    memcpy(nd->opt_lladdr, net_dev->mac, ETH_ALEN);
+
+    uint32_t sum = net_pseudo_sum(NET_AF_INET6, ip6->src, ip6->dst, IP_PROTO_ICMPV6,
+                                  sizeof(nd_msg_t));
+    nd->csum = net_csum_fold(net_csum_add(sum, nd, sizeof(nd_msg_t)));
+
+    if (type == ICMPV6_NS) {
+        net_stats.nd_solicits++;
+    }
+    ctl_xmit(queue, idx, ETH_HLEN + IPV6_HLEN + sizeof(nd_msg_t));
+}
+
+/*
+ * Ask for a neighbor's link-layer address
+ */
+static void neigh_solicit(uint16_t queue, const net_addr_t* addr) {
+    if (addr->family == NET_AF_INET) {
+        uint32_t ip;
+        memcpy(&ip, addr->addr, 4);
+        arp_send(queue, ARP_OP_REQUEST, eth_broadcast, ip);
+    } else {
+        uint8_t group[16];
+        uint8_t mac[ETH_ALEN];
+        ipv6_solicited_node(addr->addr, group);
+        ipv6_multicast_mac(group, mac);
+        nd_send(queue, ICMPV6_NS, mac, group, addr->addr, 0);
+    }
+}
+
+/*
+ * Find a neighbor entry (neigh_lock held)
+ */
+static neigh_entry_t* neigh_find(const net_addr_t* addr) {
+    for (uint32_t i = 0; i < NET_NEIGH_ENTRIES; i++) {
+        if (neigh_cache[i].state != NEIGH_FREE && net_addr_equal(&neigh_cache[i].addr, addr)) {
+            return &neigh_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Take a free entry, or the oldest one without a pending frame (neigh_lock held)
+ */
+static neigh_entry_t* neigh_alloc(const net_addr_t* addr) {
+    neigh_entry_t* victim = NULL;
+
+    for (uint32_t i = 0; i < NET_NEIGH_ENTRIES; i++) {
+        neigh_entry_t* e = &neigh_cache[i];
+        if (e->state == NEIGH_FREE) {
+            victim = e;
+            break;
+        }
+        if (!e->pending.valid && (!victim || e->updated < victim->updated)) {
+            victim = e;
+        }
+    }
+
+    if (victim) {
+        memset(victim, 0, sizeof(*victim));
+        victim->addr = *addr;
+    }
+    return victim;
+}
+
+/*
+ * Record a neighbor's link-layer address and send what was waiting for it
+ *
+ * Only updates known entries unless create is set (the frame was for us).
+ */
+static void neigh_update(const net_addr_t* addr, const uint8_t* mac, bool create) {
+    neigh_pending_t pending;
+    uint64_t flags;
+
+    pending.valid = false;
+
+    spin_lock_irqsave(&neigh_lock, flags);
+    neigh_entry_t* e = neigh_find(addr);
+    if (!e && create) {
+        e = neigh_alloc(addr);
+    }
+    if (e) {
+        memcpy(e->mac, mac, ETH_ALEN);
+        e->state = NEIGH_REACHABLE;
+        e->retries = 0;
+        e->updated = get_tick_count();
+        pending = e->pending;
+        e->pending.valid = false;
+    }
+    spin_unlock_irqrestore(&neigh_lock, flags);
+
+    if (pending.valid) {
+        memcpy(((eth_hdr_t*)pending.frame)->dst, mac, ETH_ALEN);
+        if (virtio_net_xmit(net_dev, pending.queue, &pending.pkt, false) < 0) {
+            udp_tx_complete(pending.pkt.cookie, false);
+        }
+    }
+}
+
+/*
+ * Resolve the next hop of a frame and send it, or park it until the
+ * neighbor answers
+ *
+ * Returns 0 if the frame was sent or parked, -1 if it was not taken.
+ */
+static int neigh_output(uint16_t queue, const net_addr_t* next_hop, uint8_t* frame,
+                        const virtio_net_tx_t* pkt, bool more) {
+    eth_hdr_t* eth = (eth_hdr_t*)frame;
+    bool solicit = false;
+    uint64_t flags;
+
+    spin_lock_irqsave(&neigh_lock, flags);
+    neigh_entry_t* e = neigh_find(next_hop);
+    if (e && e->state == NEIGH_REACHABLE) {
+        memcpy(eth->dst, e->mac, ETH_ALEN);
+        spin_unlock_irqrestore(&neigh_lock, flags);
+        return virtio_net_xmit(net_dev, queue, pkt, more);
+    }
+
+    // One frame per neighbor waits for the answer; later ones are refused
+    if (!e) {
+        e = neigh_alloc(next_hop);
+        if (e) {
+            e->state = NEIGH_INCOMPLETE;
+            e->updated = get_tick_count();
+            solicit = true;
+        }
+    }
+    int ret = -1;
+    if (e && !e->pending.valid) {
+        e->pending.frame = frame;
+        e->pending.pkt = *pkt;
+        e->pending.queue = queue;
+        e->pending.valid = true;
+        ret = 0;
+    }
+    spin_unlock_irqrestore(&neigh_lock, flags);
+
+    if (ret < 0) {
+        net_stats.tx_unresolved++;
+    }
+    if (solicit) {
+        neigh_solicit(queue, next_hop);
+    }
+    if (more) {
+        // The caller expects earlier frames of the batch to go out eventually
+        virtio_net_flush(net_dev, queue);
+    }
+    return ret;
+}
+
+/*
+ * Transmit a UDP datagram
+ */
+int net_udp_output(uint16_t queue, const net_addr_t* dst, uint16_t dst_port,
+                   uint16_t src_port, uint8_t* payload, uint64_t payload_phys,
+                   uint16_t len, void* cookie, bool more) {
+    bool offload = virtio_net_has_csum_offload(net_dev);
+    uint16_t ip_len = dst->family == NET_AF_INET ? sizeof(ipv4_hdr_t) : IPV6_HLEN;
+    uint16_t hdr_len = ETH_HLEN + ip_len + sizeof(udp_hdr_t);
+    uint8_t* frame = payload - hdr_len;
+    eth_hdr_t* eth = (eth_hdr_t*)frame;
+    udp_hdr_t* udp = (udp_hdr_t*)(frame + ETH_HLEN + ip_len);
+    net_addr_t next_hop = *dst;
+    uint32_t sum;
+
+    // Checked before the 16-bit UDP length is formed, which would wrap
+    if (!net_dev || len > NET_MTU - ip_len - sizeof(udp_hdr_t)) {
+        return -1;
+    }
+    uint16_t udp_len = sizeof(udp_hdr_t) + len;
+
+    memcpy(eth->src, net_dev->mac, ETH_ALEN);
+    udp->src_port = htons(src_port);
+    udp->dst_port = htons(dst_port);
+    udp->len = htons(udp_len);
+    udp->csum = 0;
+
+    if (dst->family == NET_AF_INET) {
+        ipv4_hdr_t* ip = (ipv4_hdr_t*)(frame + ETH_HLEN);
+        uint32_t dst_ip;
+        memcpy(&dst_ip, dst->addr, 4);
+
+        eth->type = htons(ETH_TYPE_IPV4);
+        ip->ver_ihl = 0x45;
+        ip->tos = 0;
+        ip->total_len = htons(ip_len + udp_len);
+        ip->id = 0;
+        ip->frag_off = htons(0x4000);   // Don't fragment
+        ip->ttl = IPV4_DEFAULT_TTL;
+        ip->proto = IP_PROTO_UDP;
+        ip->csum = 0;
+        ip->src = net_cfg.ipv4;
+        ip->dst = dst_ip;
+        ip->csum = net_csum_fold(net_csum_add(0, ip, sizeof(*ip)));
+        sum = net_pseudo_sum(NET_AF_INET, &ip->src, &ip->dst, IP_PROTO_UDP, udp_len);
+
+        if (dst_ip == 0xFFFFFFFF) {
+            memcpy(eth->dst, eth_broadcast, ETH_ALEN);
+            next_hop.family = 0;
+        } else if ((dst_ip & net_cfg.ipv4_mask) != (net_cfg.ipv4 & net_cfg.ipv4_mask)) {
+            memcpy(next_hop.addr, &net_cfg.ipv4_gateway, 4);
+        }
+    } else {
+        ipv6_hdr_t* ip6 = (ipv6_hdr_t*)(frame + ETH_HLEN);
+
+        eth->type = htons(ETH_TYPE_IPV6);
+        ip6->ver_tc_flow = htonl(6U << 28);
+        ip6->payload_len = htons(udp_len);
+        ip6->next_hdr = IP_PROTO_UDP;
+        ip6->hop_limit = IPV6_DEFAULT_HOPS;
+        memcpy(ip6->src, ipv6_source_for(dst->addr), 16);
+        memcpy(ip6->dst, dst->addr, 16);
+        sum = net_pseudo_sum(NET_AF_INET6, ip6->src, ip6->dst, IP_PROTO_UDP, udp_len);
+
+        if (dst->addr[0] == 0xFF) {
+            ipv6_multicast_mac(dst->addr, eth->dst);
+            next_hop.family = 0;
+        } else if (!ipv6_is_link_local(dst->addr) && !ipv6_is_zero(net_cfg.ipv6_gateway) &&
+                   memcmp(dst->addr, net_cfg.ipv6, 8) != 0) {
+            memcpy(next_hop.addr, net_cfg.ipv6_gateway, 16);
+        }
+    }
+
+    virtio_net_tx_t pkt = {
+        .phys = payload_phys - hdr_len,
+        .len = (uint32_t)hdr_len + len,
+        .cookie = cookie,
+    };
+
+    if (offload) {
+        // The device finishes the sum over the UDP header and payload
+        udp->csum = (uint16_t)~net_csum_fold(sum);
+        pkt.csum_start = ETH_HLEN + ip_len;
+        pkt.csum_offset = 6;
+        net_stats.tx_csum_offloaded++;
+    } else {
+        uint16_t csum = net_csum_fold(net_csum_add(sum, udp, udp_len));
+        udp->csum = csum ? csum : 0xFFFF;
+    }
+    net_stats.tx_udp++;
+
+    // Multicast and broadcast need no resolution
+    if (next_hop.family == 0) {
+        return virtio_net_xmit(net_dev, queue, &pkt, more);
+    }
+    return neigh_output(queue, &next_hop, frame, &pkt, more);
+}
+
+/*
+ * Ring the TX doorbell for datagrams sent with more set
+ */
+void net_flush(uint16_t queue) {
+    if (net_dev) {
+        virtio_net_flush(net_dev, queue);
+    }
+}
+
+/*
+ * Handle an ARP packet
+ */
+static void arp_input(uint16_t queue, const uint8_t* data, uint32_t len) {
+    const arp_pkt_t* arp = (const arp_pkt_t*)data;
+
+    if (len < sizeof(arp_pkt_t) || arp->htype != htons(1) || arp->ptype != htons(ETH_TYPE_IPV4) ||
+        arp->hlen != ETH_ALEN || arp->plen != 4) {
+        net_stats.rx_dropped++;
+        return;
+    }
+
+    bool for_us = arp->tpa == net_cfg.ipv4;
+    net_addr_t sender;
+    memset(&sender, 0, sizeof(sender));
+    sender.family = NET_AF_INET;
+    memcpy(sender.addr, &arp->spa, 4);
+    neigh_update(&sender, arp->sha, for_us);
+
+    if (for_us && arp->op == htons(ARP_OP_REQUEST)) {
+        arp_send(queue, ARP_OP_REPLY, arp->sha, arp->spa);
+    }
+}
+
+/*
+ * Handle a neighbor solicitation or advertisement
+ */
+static void nd_input(uint16_t queue, const ipv6_hdr_t* ip6, const uint8_t* data, uint32_t len) {
+    const nd_msg_t* nd = (const nd_msg_t*)data;
+
+    // Off-link senders cannot do neighbor discovery
+    if (len < sizeof(nd_msg_t) - 8 || ip6->hop_limit != 255 || nd->code != 0) {
+        net_stats.rx_dropped++;
+        return;
+    }
+
+    uint32_t sum = net_pseudo_sum(NET_AF_INET6, ip6->src, ip6->dst, IP_PROTO_ICMPV6, (uint16_t)len);
+    if (net_csum_fold(net_csum_add(sum, data, len)) != 0) {
+        net_stats.rx_dropped++;
+        return;
+    }
+
+    bool has_lladdr = len >= sizeof(nd_msg_t) && nd->opt_len == 1;
+    bool target_ours = ipv6_is_local(nd->target) && nd->target[0] != 0xFF;
+
+    if (nd->type == ICMPV6_NS && target_ours) {
+        uint8_t mac[ETH_ALEN];
+
+        if (ipv6_is_zero(ip6->src)) {
+            // Duplicate address detection probe: answer all nodes
+            ipv6_multicast_mac(ipv6_all_nodes, mac);
+            nd_send(queue, ICMPV6_NA, mac, ipv6_all_nodes, nd->target, ND_NA_OVERRIDE);
+            return;
+        }
+        if (!has_lladdr || nd->opt_type != ND_OPT_SOURCE_LLADDR) {
+            return;
+        }
+
+        net_addr_t sender = net_addr_ipv6(ip6->src);
+        neigh_update(&sender, nd->opt_lladdr, true);
+        nd_send(queue, ICMPV6_NA, nd->opt_lladdr, ip6->src, nd->target,
+                ND_NA_SOLICITED | ND_NA_OVERRIDE);
+    } else if (nd->type == ICMPV6_NA && has_lladdr && nd->opt_type == ND_OPT_TARGET_LLADDR) {
+        net_addr_t target = net_addr_ipv6(nd->target);
+        neigh_update(&target, nd->opt_lladdr, false);
+    }
+}
+
+/*
+ * Handle a UDP datagram; returns true if a socket kept the buffer
+ */
+static bool udp_input(uint16_t queue, uint32_t buf, const uint8_t* frame, uint32_t l4_off,
+                      uint32_t l4_len, const net_addr_t* src, uint32_t pseudo, bool csum_ok) {
+    const udp_hdr_t* udp = (const udp_hdr_t*)(frame + l4_off);
+    uint16_t udp_len = ntohs(udp->len);
+
+    if (l4_len < sizeof(udp_hdr_t) || udp_len < sizeof(udp_hdr_t) || udp_len > l4_len) {
+        net_stats.rx_dropped++;
+        return false;
+    }
+
+    // A zero checksum means none (IPv4 only)
+    if (!csum_ok && (udp->csum != 0 || src->family == NET_AF_INET6)) {
+        if (net_csum_fold(net_csum_add(pseudo, udp, udp_len)) != 0) {
+            net_stats.rx_dropped++;
+            return false;
+        }
+    }
+    net_stats.rx_udp++;
+
+    if (!udp_deliver(ntohs(udp->dst_port), queue, buf, l4_off + sizeof(udp_hdr_t),
+                     udp_len - sizeof(udp_hdr_t), src, ntohs(udp->src_port))) {
+        net_stats.rx_dropped++;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Receive handler: runs on the queue's CPU for every frame
+ */
+static bool net_rx(virtio_net_t* net, uint16_t queue, uint32_t buf, void* data, uint32_t len,
+                   void* ctx) {
+    const uint8_t* frame = (const uint8_t*)data;
+    const eth_hdr_t* eth = (const eth_hdr_t*)frame;
+    (void)ctx;
+
+    net_stats.rx_frames++;
+    if (len < ETH_HLEN) {
+        net_stats.rx_dropped++;
+        return false;
+    }
+
+    bool csum_ok = virtio_net_rx_csum_valid(net, buf);
+    if (csum_ok) {
+        net_stats.rx_csum_offloaded++;
+    }
+
+    uint16_t type = ntohs(eth->type);
+    const uint8_t* l3 = frame + ETH_HLEN;
+    uint32_t l3_len = len - ETH_HLEN;
+
+    if (type == ETH_TYPE_ARP) {
+        arp_input(queue, l3, l3_len);
+        return false;
+    }
+
+    if (type == ETH_TYPE_IPV4) {
+        const ipv4_hdr_t* ip = (const ipv4_hdr_t*)l3;
+        uint32_t ihl = (uint32_t)(ip->ver_ihl & 0x0F) * 4;
+
+        if (l3_len < sizeof(ipv4_hdr_t) || (ip->ver_ihl >> 4) != 4 || ihl < sizeof(ipv4_hdr_t) ||
+            ntohs(ip->total_len) > l3_len || ntohs(ip->total_len) < ihl ||
+            net_csum_fold(net_csum_add(0, ip, ihl)) != 0) {
+            net_stats.rx_dropped++;
+            return false;
+        }
+
+        // No reassembly: fragments are dropped
+        if ((ntohs(ip->frag_off) & IPV4_FRAG_MASK) != 0 || ip->proto != IP_PROTO_UDP ||
+            (ip->dst != net_cfg.ipv4 && ip->dst != 0xFFFFFFFF)) {
+            return false;
+        }
+
+        net_addr_t src;
+        memset(&src, 0, sizeof(src));
+        src.family = NET_AF_INET;
+        memcpy(src.addr, &ip->src, 4);
+
+        uint32_t l4_len = ntohs(ip->total_len) - ihl;
+        uint32_t pseudo = net_pseudo_sum(NET_AF_INET, &ip->src, &ip->dst, IP_PROTO_UDP,
+                                         (uint16_t)l4_len);
+        return udp_input(queue, buf, frame, ETH_HLEN + ihl, l4_len, &src, pseudo, csum_ok);
+    }
+
+    if (type == ETH_TYPE_IPV6) {
+        const ipv6_hdr_t* ip6 = (const ipv6_hdr_t*)l3;
+        uint32_t l4_len = l3_len >= IPV6_HLEN ? ntohs(ip6->payload_len) : 0;
+
+        if (l3_len < IPV6_HLEN || (ntohl(ip6->ver_tc_flow) >> 28) != 6 ||
+            l4_len > l3_len - IPV6_HLEN) {
+            net_stats.rx_dropped++;
+            return false;
+        }
+        if (!ipv6_is_local(ip6->dst)) {
+            return false;
+        }
+
+        // Extension headers are not supported
+        if (ip6->next_hdr == IP_PROTO_ICMPV6) {
+            nd_input(queue, ip6, l3 + IPV6_HLEN, l4_len);
+            return false;
+        }
+        if (ip6->next_hdr != IP_PROTO_UDP) {
+            return false;
+        }
+
+        net_addr_t src = net_addr_ipv6(ip6->src);
+        uint32_t pseudo = net_pseudo_sum(NET_AF_INET6, ip6->src, ip6->dst, IP_PROTO_UDP,
+                                         (uint16_t)l4_len);
+        return udp_input(queue, buf, frame, ETH_HLEN + IPV6_HLEN, l4_len, &src, pseudo, csum_ok);
+    }
+
+    return false;
+}
+
+/*
+ * Resend unanswered neighbor requests and forget old entries
+ */
+void net_periodic(void) {
+    uint64_t now = get_tick_count();
+    net_addr_t resend[NET_NEIGH_ENTRIES];
+    void* dropped[NET_NEIGH_ENTRIES];
+    uint32_t nr_resend = 0, nr_dropped = 0;
+    uint64_t flags;
+
+    spin_lock_irqsave(&neigh_lock, flags);
+    for (uint32_t i = 0; i < NET_NEIGH_ENTRIES; i++) {
+        neigh_entry_t* e = &neigh_cache[i];
+
+        if (e->state == NEIGH_INCOMPLETE && now - e->updated >= NET_NEIGH_RETRY_TICKS) {
+            if (++e->retries >= NET_NEIGH_RETRIES) {
+                if (e->pending.valid) {
+                    dropped[nr_dropped++] = e->pending.pkt.cookie;
+                }
+                e->state = NEIGH_FREE;
+                e->pending.valid = false;
+            } else {
+                e->updated = now;
+                resend[nr_resend++] = e->addr;
+            }
+        } else if (e->state == NEIGH_REACHABLE && now - e->updated >= NET_NEIGH_TIMEOUT_TICKS) {
+            e->state = NEIGH_FREE;
+        }
+    }
+    spin_unlock_irqrestore(&neigh_lock, flags);
+
+    for (uint32_t i = 0; i < nr_resend; i++) {
+        neigh_solicit(0, &resend[i]);
+    }
+    for (uint32_t i = 0; i < nr_dropped; i++) {
+        net_stats.tx_unresolved++;
+        udp_tx_complete(dropped[i], false);
+    }
+}
+
+/*
+ * Network service task
+ */
+static void netd_main(void) {
+    while (1) {
+        net_periodic();
+        sleep_task(NETD_PERIOD_MS);
+    }
+}
+
+/*
+ * Bring the stack up on the first virtio-net device
+ */
+int init_net(const net_config_t* config) {
+    net_dev = virtio_net_get(0);
+    if (!net_dev) {
+        return -1;
+    }
+
+    net_cfg = *config;
+
+    // Link-local address from the MAC (modified EUI-64)
+    memset(net_ipv6_ll, 0, sizeof(net_ipv6_ll));
+    net_ipv6_ll[0] = 0xFE;
+    net_ipv6_ll[1] = 0x80;
+    net_ipv6_ll[8] = net_dev->mac[0] ^ 0x02;
+    net_ipv6_ll[9] = net_dev->mac[1];
+    net_ipv6_ll[10] = net_dev->mac[2];
+    net_ipv6_ll[11] = 0xFF;
+    net_ipv6_ll[12] = 0xFE;
+    net_ipv6_ll[13] = net_dev->mac[3];
+    net_ipv6_ll[14] = net_dev->mac[4];
+    net_ipv6_ll[15] = net_dev->mac[5];
+
+    ctl_bufs = (uint8_t*)alloc_page();
+    if (!ctl_bufs) {
+        return -1;
+    }
+    ctl_free_mask = 0xFFFFFFFF;
+
+    init_udp();
+    virtio_net_set_handlers(net_dev, net_rx, net_tx_done, NULL);
+    create_kernel_task("netd", netd_main, TASK_PRIORITY_HIGH);
+
+    uint8_t* ip = (uint8_t*)&net_cfg.ipv4;
+    kernel_printf("net: %u.%u.%u.%u on virtio-net%u, %s checksum offload\n",
+                  ip[0], ip[1], ip[2], ip[3], net_dev->id,
+                  virtio_net_has_csum_offload(net_dev) ? "with" : "without");
+    return 0;
+}
+
+/*
+ * Interface state
+ */
+virtio_net_t* net_device(void) {
+    return net_dev;
+}
+
+const uint8_t* net_mac(void) {
+    return net_dev ? net_dev->mac : NULL;
+}
+
+void net_get_stats(net_stats_t* stats) {
+    *stats = net_stats;
+}
+
+/*
+ * Print interface counters
+ */
+void dump_net_stats(void) {
+    kernel_printf("net: rx %llu frames, %llu udp, %llu dropped, %llu csum offloaded\n",
+                  net_stats.rx_frames, net_stats.rx_udp, net_stats.rx_dropped,
+                  net_stats.rx_csum_offloaded);
+    kernel_printf("     tx %llu udp, %llu csum offloaded, %llu unresolved; "
+                  "%llu ARP requests, %llu neighbor solicitations\n",
+                  net_stats.tx_udp, net_stats.tx_csum_offloaded, net_stats.tx_unresolved,
+                  net_stats.arp_requests, net_stats.nd_solicits);
+}
@@ -0,0 +1,703 @@
+/*
+ * EdgeX OS - PCI Bus
+ *
+ * This file enumerates PCI functions through the memory-mapped ECAM
+ * windows listed in the ACPI MCFG table (falling back to the legacy
+ * 0xCF8/0xCFC ports), decodes their BARs and capabilities, and binds
+ * MSI and MSI-X vectors to IRQs. An MSI-X vector is an irq_chip input
+ * whose route is the message address and data in the device's table,
+ * so irq_set_affinity() retargets it without touching other vectors.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/interrupt.h>
+#include <edgex/apic.h>
+#include <edgex/acpi.h>
+#include <edgex/spinlock.h>
+#include <edgex/pci.h>
+
+/* Legacy configuration mechanism #1 */
+#define PCI_CONFIG_ADDRESS    0xCF8
+#define PCI_CONFIG_DATA       0xCFC
+
+/* ECAM layout: 4KB of config space per function, 1MB per bus */
+#define ECAM_BUS_SHIFT        20
+#define ECAM_BUS_SIZE         (1ULL << ECAM_BUS_SHIFT)
+#define PCI_MAX_ECAM_REGIONS  4
+
+/* MSI message address for a physical APIC destination */
+#define MSI_ADDRESS_BASE      0xFEE00000
+#define MSI_DEST_SHIFT        12
+
+typedef struct {
+    uint64_t phys;                      /* ECAM base of start_bus */
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    volatile uint8_t* bus_virt[256];    /* Per-bus mappings, made on first use */
+} ecam_region_t;
+
+static ecam_region_t ecam_regions[PCI_MAX_ECAM_REGIONS];
+static uint32_t nr_ecam_regions = 0;
+
+static pci_device_t pci_devices[PCI_MAX_DEVICES];
+static uint32_t nr_pci_devices = 0;
+
+/* Serializes legacy port accesses and ECAM bus mapping */
+static spinlock_t pci_config_lock = SPINLOCK_INIT;
+
+/*
+ * Get the ECAM address of a config register (NULL if not ECAM-covered)
+ */
+static volatile uint8_t* ecam_address(pci_device_t* dev, uint16_t offset) {
+    for (uint32_t i = 0; i < nr_ecam_regions; i++) {
+        ecam_region_t* region = &ecam_regions[i];
+        if (region->segment != dev->segment ||
+            dev->bus < region->start_bus || dev->bus > region->end_bus) {
+            continue;
+        }
+
+        uint32_t bus = dev->bus - region->start_bus;
+        if (!region->bus_virt[bus]) {
+            uint64_t flags;
+            spin_lock_irqsave(&pci_config_lock, flags);
+            if (!region->bus_virt[bus]) {
+                region->bus_virt[bus] = (volatile uint8_t*)ioremap(
+                    region->phys + ((uint64_t)bus << ECAM_BUS_SHIFT), ECAM_BUS_SIZE);
+            }
+            spin_unlock_irqrestore(&pci_config_lock, flags);
+            if (!region->bus_virt[bus]) {
+                return NULL;
+            }
+        }
+
+        return region->bus_virt[bus] + ((uint32_t)dev->slot << 15) +
+               ((uint32_t)dev->func << 12) + offset;
+    }
+    return NULL;
+}
+
+/*
+ * Select a register through the legacy ports (pci_config_lock held)
+ */
+static bool legacy_select(pci_device_t* dev, uint16_t offset) {
+    // Only segment 0 and the first 256 bytes are reachable this way
+    if (dev->segment != 0 || offset >= 256) {
+        return false;
+    }
+    outl(PCI_CONFIG_ADDRESS, 0x80000000U | ((uint32_t)dev->bus << 16) |
+         ((uint32_t)dev->slot << 11) | ((uint32_t)dev->func << 8) | (offset & 0xFC));
+    return true;
+}
+
+/*
+ * Read a 32-bit config register
+ */
+uint32_t pci_read_config32(pci_device_t* dev, uint16_t offset) {
+    volatile uint8_t* addr = ecam_address(dev, offset);
+    if (addr) {
+        return *(volatile uint32_t*)addr;
+    }
+
+    uint64_t flags;
+    uint32_t value = 0xFFFFFFFF;
+    spin_lock_irqsave(&pci_config_lock, flags);
+    if (legacy_select(dev, offset)) {
+        value = inl(PCI_CONFIG_DATA);
+    }
+    spin_unlock_irqrestore(&pci_config_lock, flags);
+    return value;
+}
+
+/*
+ * Read a 16-bit config register
+ */
+uint16_t pci_read_config16(pci_device_t* dev, uint16_t offset) {
+    volatile uint8_t* addr = ecam_address(dev, offset);
+    if (addr) {
+        return *(volatile uint16_t*)addr;
+    }
+
+    uint64_t flags;
+    uint16_t value = 0xFFFF;
+    spin_lock_irqsave(&pci_config_lock, flags);
+    if (legacy_select(dev, offset)) {
+        value = inw(PCI_CONFIG_DATA + (offset & 2));
+    }
+    spin_unlock_irqrestore(&pci_config_lock, flags);
+    return value;
+}
+
+/*
+ * Read an 8-bit config register
+ */
+uint8_t pci_read_config8(pci_device_t* dev, uint16_t offset) {
+    volatile uint8_t* addr = ecam_address(dev, offset);
+    if (addr) {
+        return *addr;
+    }
+
+    uint64_t flags;
+    uint8_t value = 0xFF;
+    spin_lock_irqsave(&pci_config_lock, flags);
+    if (legacy_select(dev, offset)) {
+        value = inb(PCI_CONFIG_DATA + (offset & 3));
+    }
+    spin_unlock_irqrestore(&pci_config_lock, flags);
+    return value;
+}
+
+/*
+ * Write a 32-bit config register
+ */
+void pci_write_config32(pci_device_t* dev, uint16_t offset, uint32_t value) {
+    volatile uint8_t* addr = ecam_address(dev, offset);
+    if (addr) {
+        *(volatile uint32_t*)addr = value;
+        return;
+    }
+
+    uint64_t flags;
+    spin_lock_irqsave(&pci_config_lock, flags);
+    if (legacy_select(dev, offset)) {
+        outl(PCI_CONFIG_DATA, value);
+    }
+    spin_unlock_irqrestore(&pci_config_lock, flags);
+}
+
+/*
+ * Write a 16-bit config register
+ */
+void pci_write_config16(pci_device_t* dev, uint16_t offset, uint16_t value) {
+    volatile uint8_t* addr = ecam_address(dev, offset);
+    if (addr) {
+        *(volatile uint16_t*)addr = value;
+        return;
+    }
+
+    uint64_t flags;
+    spin_lock_irqsave(&pci_config_lock, flags);
+    if (legacy_select(dev, offset)) {
+        outw(PCI_CONFIG_DATA + (offset & 2), value);
+    }
+    spin_unlock_irqrestore(&pci_config_lock, flags);
+}
+
+/*
+ * Write an 8-bit config register
+ */
+void pci_write_config8(pci_device_t* dev, uint16_t offset, uint8_t value) {
+    volatile uint8_t* addr = ecam_address(dev, offset);
+    if (addr) {
+        *addr = value;
+        return;
+    }
+
+    uint64_t flags;
+    spin_lock_irqsave(&pci_config_lock, flags);
+    if (legacy_select(dev, offset)) {
+        outb(PCI_CONFIG_DATA + (offset & 3), value);
+    }
+    spin_unlock_irqrestore(&pci_config_lock, flags);
+}
+
+/*
+ * Find a capability in the standard capability list
+ */
+uint8_t pci_find_capability(pci_device_t* dev, uint8_t cap_id, uint8_t start) {
+    uint8_t pos;
+
+    if (start) {
+        pos = pci_read_config8(dev, start + 1);
+    } else {
+        if (!(pci_read_config16(dev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+            return 0;
+        }
+        pos = pci_read_config8(dev, PCI_CAPABILITY_LIST);
+    }
+
+    // The list lives in the first 256 bytes; bound the walk against loops
+    for (int ttl = 48; pos >= 0x40 && ttl > 0; ttl--) {
+        pos &= 0xFC;
+        if (pci_read_config8(dev, pos) == cap_id) {
+            return pos;
+        }
+        pos = pci_read_config8(dev, pos + 1);
+    }
+    return 0;
+}
+
+/*
+ * Size the BARs of a type 0 function
+ */
+static void pci_probe_bars(pci_device_t* dev) {
+    uint16_t command = pci_read_config16(dev, PCI_COMMAND);
+
+    // Stop decoding while the BARs hold all-ones
+    pci_write_config16(dev, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (uint32_t i = 0; i < PCI_MAX_BARS; i++) {
+        uint16_t reg = PCI_BAR0 + i * 4;
+        uint32_t orig = pci_read_config32(dev, reg);
+        pci_bar_t* bar = &dev->bars[i];
+
+        pci_write_config32(dev, reg, 0xFFFFFFFF);
+        uint32_t mask = pci_read_config32(dev, reg);
+        pci_write_config32(dev, reg, orig);
+
+        if (mask == 0 || mask == 0xFFFFFFFF) {
+            continue;
+        }
+
+        if (orig & PCI_BAR_IO) {
+            bar->is_io = true;
+            bar->phys = orig & ~0x3U;
+            bar->size = (uint16_t)~(mask & ~0x3U) + 1;
+            continue;
+        }
+
+        uint64_t phys = orig & ~0xFULL;
+        uint64_t size_mask = 0xFFFFFFFF00000000ULL | (mask & ~0xFU);
+        bar->prefetchable = (orig & PCI_BAR_MEM_PREFETCH) != 0;
+
+        if ((orig & 0x6) == PCI_BAR_MEM_TYPE_64 && i + 1 < PCI_MAX_BARS) {
+            uint16_t reg_hi = reg + 4;
+            uint32_t orig_hi = pci_read_config32(dev, reg_hi);
+
+            pci_write_config32(dev, reg_hi, 0xFFFFFFFF);
+            uint32_t mask_hi = pci_read_config32(dev, reg_hi);
+            pci_write_config32(dev, reg_hi, orig_hi);
+
+            phys |= (uint64_t)orig_hi << 32;
+            size_mask = ((uint64_t)mask_hi << 32) | (mask & ~0xFU);
+            bar->is_64 = true;
+        }
+
+        bar->phys = phys;
+        bar->size = ~size_mask + 1;
+
+        if (bar->is_64) {
+            i++;
+        }
+    }
+
+    pci_write_config16(dev, PCI_COMMAND, command);
+}
+
+/*
+ * Record one function
+ */
+static pci_device_t* pci_add_device(pci_device_t* probe) {
+    if (nr_pci_devices >= PCI_MAX_DEVICES) {
+        kernel_printf("PCI: device table full, ignoring %x:%x.%x\n",
+                      probe->bus, probe->slot, probe->func);
+        return NULL;
+    }
+
+    pci_device_t* dev = &pci_devices[nr_pci_devices++];
+    *dev = *probe;
+
+    dev->vendor_id = pci_read_config16(dev, PCI_VENDOR_ID);
+    dev->device_id = pci_read_config16(dev, PCI_DEVICE_ID);
+    dev->revision = pci_read_config8(dev, PCI_REVISION_ID);
+    dev->prog_if = pci_read_config8(dev, PCI_PROG_IF);
+    dev->subclass = pci_read_config8(dev, PCI_SUBCLASS);
+    dev->class_code = pci_read_config8(dev, PCI_CLASS);
+    dev->header_type = pci_read_config8(dev, PCI_HEADER_TYPE) & PCI_HEADER_TYPE_MASK;
+    dev->irq_line = pci_read_config8(dev, PCI_INTERRUPT_LINE);
+    dev->irq_pin = pci_read_config8(dev, PCI_INTERRUPT_PIN);
+
+    if (dev->header_type == 0) {
+        dev->subsystem_id = pci_read_config16(dev, PCI_SUBSYSTEM_ID);
+        pci_probe_bars(dev);
+    }
+
+    dev->msi_cap = pci_find_capability(dev, PCI_CAP_ID_MSI, 0);
+    dev->msix_cap = pci_find_capability(dev, PCI_CAP_ID_MSIX, 0);
+    if (dev->msix_cap) {
+        uint16_t ctrl = pci_read_config16(dev, dev->msix_cap + PCI_MSIX_FLAGS);
+        dev->msix_table_size = (ctrl & PCI_MSIX_FLAGS_QSIZE) + 1;
+    }
+
+    return dev;
+}
+
+/*
+ * Scan a bus and the buses behind its bridges
+ */
+static void pci_scan_bus(uint16_t segment, uint8_t bus, uint64_t* visited) {
+    if (visited[bus / 64] & (1ULL << (bus % 64))) {
+        return;
+    }
+    visited[bus / 64] |= 1ULL << (bus % 64);
+
+    for (uint8_t slot = 0; slot < 32; slot++) {
+        for (uint8_t func = 0; func < 8; func++) {
+            pci_device_t probe = {
+                .segment = segment,
+                .bus = bus,
+                .slot = slot,
+                .func = func,
+            };
+
+            if (pci_read_config16(&probe, PCI_VENDOR_ID) == 0xFFFF) {
+                if (func == 0) {
+                    break;
+                }
+                continue;
+            }
+
+            uint8_t header = pci_read_config8(&probe, PCI_HEADER_TYPE);
+            pci_device_t* dev = pci_add_device(&probe);
+
+            if (dev && dev->header_type == PCI_HEADER_TYPE_BRIDGE) {
+                uint8_t secondary = pci_read_config8(dev, PCI_SECONDARY_BUS);
+                if (secondary > bus) {
+                    pci_scan_bus(segment, secondary, visited);
+                }
+            }
+
+            if (func == 0 && !(header & PCI_HEADER_MULTI_FUNCTION)) {
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Discover ECAM windows and enumerate every function
+ */
+void init_pci(void) {
+    acpi_mcfg_t* mcfg = (acpi_mcfg_t*)acpi_find_table("MCFG", 0);
+
+    if (mcfg) {
+        uint32_t count = (mcfg->header.length - sizeof(acpi_mcfg_t)) / sizeof(acpi_mcfg_entry_t);
+        for (uint32_t i = 0; i < count && nr_ecam_regions < PCI_MAX_ECAM_REGIONS; i++) {
+            ecam_region_t* region = &ecam_regions[nr_ecam_regions++];
+            region->phys = mcfg->entries[i].base_address;
+            region->segment = mcfg->entries[i].segment;
+            region->start_bus = mcfg->entries[i].start_bus;
+            region->end_bus = mcfg->entries[i].end_bus;
+            kernel_printf("PCI: ECAM segment %u buses %u-%u at %p\n", region->segment,
+                          region->start_bus, region->end_bus, (void*)region->phys);
+        }
+    } else {
+        kernel_printf("PCI: no MCFG, using legacy configuration ports\n");
+    }
+
+    if (nr_ecam_regions == 0) {
+        uint64_t visited[4] = { 0 };
+        pci_scan_bus(0, 0, visited);
+    }
+    for (uint32_t i = 0; i < nr_ecam_regions; i++) {
+        uint64_t visited[4] = { 0 };
+        pci_scan_bus(ecam_regions[i].segment, ecam_regions[i].start_bus, visited);
+    }
+
+    kernel_printf("PCI: %u functions found\n", nr_pci_devices);
+}
+
+/*
+ * Number of enumerated functions
+ */
+uint32_t pci_device_count(void) {
+    return nr_pci_devices;
+}
+
+/*
+ * Get a function by enumeration index
+ */
+pci_device_t* pci_get_device(uint32_t index) {
+    return index < nr_pci_devices ? &pci_devices[index] : NULL;
+}
+
+/*
+ * Find the index'th function with a vendor and device ID
+ */
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id, uint32_t index) {
+    for (uint32_t i = 0; i < nr_pci_devices; i++) {
+        pci_device_t* dev = &pci_devices[i];
+        if (dev->vendor_id == vendor_id && dev->device_id == device_id && index-- == 0) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Enable memory decoding and DMA for a function
+ */
+void pci_enable_device(pci_device_t* dev) {
+    uint16_t command = pci_read_config16(dev, PCI_COMMAND);
+    command |= PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER;
+    pci_write_config16(dev, PCI_COMMAND, command);
+}
+
+/*
+ * Map a memory BAR uncached
+ */
+void* pci_map_bar(pci_device_t* dev, uint32_t bar) {
+    if (bar >= PCI_MAX_BARS || dev->bars[bar].size == 0 || dev->bars[bar].is_io) {
+        return NULL;
+    }
+    if (!dev->bars[bar].virt) {
+        dev->bars[bar].virt = ioremap(dev->bars[bar].phys, dev->bars[bar].size);
+    }
+    return dev->bars[bar].virt;
+}
+
+/*
+ * MSI-X: each table entry is one IRQ; hwirq is the entry index
+ */
+static volatile uint32_t* msix_entry(uint8_t irq) {
+    pci_device_t* dev = (pci_device_t*)irq_get_chip_data(irq);
+    return dev->msix_table + irq_get_hwirq(irq) * (PCI_MSIX_ENTRY_SIZE / 4);
+}
+
+static void msix_mask(uint8_t irq) {
+    volatile uint32_t* entry = msix_entry(irq);
+    entry[PCI_MSIX_ENTRY_CTRL / 4] |= PCI_MSIX_ENTRY_CTRL_MASKED;
+}
+
+static void msix_unmask(uint8_t irq) {
+    volatile uint32_t* entry = msix_entry(irq);
+    entry[PCI_MSIX_ENTRY_CTRL / 4] &= ~PCI_MSIX_ENTRY_CTRL_MASKED;
+}
+
+static void msi_eoi(uint8_t irq) {
+    (void)irq;
+    lapic_eoi();
+}
+
+/*
+ * Rewrite an MSI-X entry's message; the entry is masked meanwhile so the
+ * device never sends a half-updated address/data pair
+ */
+static int msix_set_route(uint8_t irq, uint8_t vector, uint32_t apic_id) {
+    volatile uint32_t* entry = msix_entry(irq);
+
+    // Without interrupt remapping only 8-bit destinations are reachable
+    if (apic_id > 0xFF) {
+        return -1;
+    }
+
+    uint32_t ctrl = entry[PCI_MSIX_ENTRY_CTRL / 4];
+    entry[PCI_MSIX_ENTRY_CTRL / 4] = ctrl | PCI_MSIX_ENTRY_CTRL_MASKED;
+    entry[PCI_MSIX_ENTRY_ADDR_LO / 4] = MSI_ADDRESS_BASE | (apic_id << MSI_DEST_SHIFT);
+    entry[PCI_MSIX_ENTRY_ADDR_HI / 4] = 0;
+    entry[PCI_MSIX_ENTRY_DATA / 4] = vector;
+    entry[PCI_MSIX_ENTRY_CTRL / 4] = ctrl;
+
+    return 0;
+}
+
+static irq_chip_t msix_chip = {
+    .name = "msi-x",
+    .mask = msix_mask,
+    .unmask = msix_unmask,
+    .eoi = msi_eoi,
+    .set_route = msix_set_route,
+};
+
+/*
+ * MSI: a single vector; masking needs the optional per-vector mask bit
+ */
+static uint16_t msi_mask_offset(pci_device_t* dev, uint16_t ctrl) {
+    return dev->msi_cap + ((ctrl & PCI_MSI_FLAGS_64BIT) ? 0x10 : 0x0C);
+}
+
+static void msi_set_mask(uint8_t irq, bool masked) {
+    pci_device_t* dev = (pci_device_t*)irq_get_chip_data(irq);
+    uint16_t ctrl = pci_read_config16(dev, dev->msi_cap + PCI_MSI_FLAGS);
+
+    if (ctrl & PCI_MSI_FLAGS_MASKBIT) {
+        pci_write_config32(dev, msi_mask_offset(dev, ctrl), masked ? 1 : 0);
+    }
+}
+
+static void msi_mask(uint8_t irq) {
+    msi_set_mask(irq, true);
+}
+
+static void msi_unmask(uint8_t irq) {
+    msi_set_mask(irq, false);
+}
+
+static int msi_set_route(uint8_t irq, uint8_t vector, uint32_t apic_id) {
+    pci_device_t* dev = (pci_device_t*)irq_get_chip_data(irq);
+    uint16_t ctrl = pci_read_config16(dev, dev->msi_cap + PCI_MSI_FLAGS);
+
+    if (apic_id > 0xFF) {
+        return -1;
+    }
+
+    pci_write_config32(dev, dev->msi_cap + PCI_MSI_ADDRESS_LO,
+                       MSI_ADDRESS_BASE | (apic_id << MSI_DEST_SHIFT));
+    if (ctrl & PCI_MSI_FLAGS_64BIT) {
+        pci_write_config32(dev, dev->msi_cap + 0x08, 0);
+        pci_write_config16(dev, dev->msi_cap + 0x0C, vector);
+    } else {
+        pci_write_config16(dev, dev->msi_cap + 0x08, vector);
+    }
+
+    return 0;
+}
+
+static irq_chip_t msi_chip = {
+    .name = "msi",
+    .mask = msi_mask,
+    .unmask = msi_unmask,
+    .eoi = msi_eoi,
+    .set_route = msi_set_route,
+};
+
+/*
+ * Set up the MSI-X table and bind up to nvec entries
+ */
+static int pci_setup_msix(pci_device_t* dev, uint32_t nvec) {
+    uint32_t table = pci_read_config32(dev, dev->msix_cap + PCI_MSIX_TABLE);
+    uint8_t* bar = (uint8_t*)pci_map_bar(dev, table & PCI_MSIX_BIR_MASK);
+    if (!bar) {
+        return -1;
+    }
+    dev->msix_table = (volatile uint32_t*)(bar + (table & ~PCI_MSIX_BIR_MASK));
+
+    // Enable with the function masked, mask every entry, then bind
+    uint16_t ctrl = pci_read_config16(dev, dev->msix_cap + PCI_MSIX_FLAGS);
+    pci_write_config16(dev, dev->msix_cap + PCI_MSIX_FLAGS,
+                       ctrl | PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL);
+
+    for (uint32_t i = 0; i < dev->msix_table_size; i++) {
+        dev->msix_table[i * (PCI_MSIX_ENTRY_SIZE / 4) + PCI_MSIX_ENTRY_CTRL / 4] |=
+            PCI_MSIX_ENTRY_CTRL_MASKED;
+    }
+
+    if (nvec > dev->msix_table_size) {
+        nvec = dev->msix_table_size;
+    }
+
+    dev->nr_irqs = 0;
+    for (uint32_t i = 0; i < nvec; i++) {
+        int irq = irq_alloc(&msix_chip, i, dev);
+        if (irq < 0) {
+            break;
+        }
+        dev->irqs[dev->nr_irqs++] = (uint8_t)irq;
+    }
+
+    ctrl = pci_read_config16(dev, dev->msix_cap + PCI_MSIX_FLAGS);
+    if (dev->nr_irqs == 0) {
+        pci_write_config16(dev, dev->msix_cap + PCI_MSIX_FLAGS,
+                           ctrl & ~(PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL));
+        return -1;
+    }
+    pci_write_config16(dev, dev->msix_cap + PCI_MSIX_FLAGS, ctrl & ~PCI_MSIX_FLAGS_MASKALL);
+
+    dev->irq_mode = PCI_IRQ_MSIX;
+    return (int)dev->nr_irqs;
+}
+
+/*
+ * Bind a single MSI vector
+ */
+static int pci_setup_msi(pci_device_t* dev) {
+    int irq = irq_alloc(&msi_chip, 0, dev);
+    if (irq < 0) {
+        return -1;
+    }
+
+    // One message: the multiple-message enable field stays 0
+    uint16_t ctrl = pci_read_config16(dev, dev->msi_cap + PCI_MSI_FLAGS);
+    pci_write_config16(dev, dev->msi_cap + PCI_MSI_FLAGS, ctrl | PCI_MSI_FLAGS_ENABLE);
+
+    dev->irqs[0] = (uint8_t)irq;
+    dev->nr_irqs = 1;
+    dev->irq_mode = PCI_IRQ_MSI;
+    return 1;
+}
+
+/*
+ * Allocate interrupt vectors for a function
+ */
+int pci_alloc_irq_vectors(pci_device_t* dev, uint32_t nvec) {
+    int ret = -1;
+
+    // Message-signalled interrupts are delivered to local APICs
+    if (!apic_available() || nvec == 0 || dev->nr_irqs) {
+        return -1;
+    }
+    if (nvec > PCI_MAX_VECTORS) {
+        nvec = PCI_MAX_VECTORS;
+    }
+
+    if (dev->msix_cap) {
+        ret = pci_setup_msix(dev, nvec);
+    }
+    if (ret < 0 && dev->msi_cap) {
+        ret = pci_setup_msi(dev);
+    }
+
+    if (ret > 0) {
+        uint16_t command = pci_read_config16(dev, PCI_COMMAND);
+        pci_write_config16(dev, PCI_COMMAND, command | PCI_COMMAND_INTX_DISABLE);
+    }
+    return ret;
+}
+
+/*
+ * Release a function's vectors and turn MSI/MSI-X off
+ */
+void pci_free_irq_vectors(pci_device_t* dev) {
+    for (uint32_t i = 0; i < dev->nr_irqs; i++) {
+        irq_release(dev->irqs[i]);
+    }
+
+    if (dev->irq_mode == PCI_IRQ_MSIX) {
+        uint16_t ctrl = pci_read_config16(dev, dev->msix_cap + PCI_MSIX_FLAGS);
+        pci_write_config16(dev, dev->msix_cap + PCI_MSIX_FLAGS, ctrl & ~PCI_MSIX_FLAGS_ENABLE);
+    } else if (dev->irq_mode == PCI_IRQ_MSI) {
+        uint16_t ctrl = pci_read_config16(dev, dev->msi_cap + PCI_MSI_FLAGS);
+        pci_write_config16(dev, dev->msi_cap + PCI_MSI_FLAGS, ctrl & ~PCI_MSI_FLAGS_ENABLE);
+    }
+
+    dev->nr_irqs = 0;
+    dev->irq_mode = PCI_IRQ_NONE;
+}
+
+/*
+ * Get the IRQ number of a vector
+ */
+int pci_irq_vector(pci_device_t* dev, uint32_t n) {
+    return n < dev->nr_irqs ? dev->irqs[n] : -1;
+}
+
+/*
+ * Steer a vector to one CPU
+ *
+ * Multi-queue drivers call this so a queue's completions arrive on the
+ * CPU that polls that queue, keeping its data in that CPU's cache.
+ */
+int pci_irq_set_cpu(pci_device_t* dev, uint32_t n, uint32_t cpu) {
+    if (n >= dev->nr_irqs || cpu >= MAX_CPUS) {
+        return -1;
+    }
+    return irq_set_affinity(dev->irqs[n], cpumask_of(cpu));
+}
+
+/*
+ * Print the enumerated functions
+ */
+void dump_pci_devices(void) {
+    static const char* irq_modes[] = { "none", "intx", "msi", "msi-x" };
+
+    kernel_printf("PCI devices:\n");
+    for (uint32_t i = 0; i < nr_pci_devices; i++) {
+        pci_device_t* dev = &pci_devices[i];
+        kernel_printf("  %x:%x:%x.%x %x:%x class %x.%x irq %s/%u%s\n",
+                      dev->segment, dev->bus, dev->slot, dev->func,
+                      dev->vendor_id, dev->device_id, dev->class_code, dev->subclass,
+                      irq_modes[dev->irq_mode], dev->nr_irqs,
+                      dev->msix_cap ? " msix-capable" : "");
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * EdgeX OS - Per-CPU Counters
+ *
+ * This file implements the readers of the per-CPU statistics counters,
+ * grouped updates and batched counters (see include/edgex/percpu.h).
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/percpu.h>
+
+/*
+ * Add to two counters of the running CPU as one update
+ *
+ * The sequence count is odd for the duration, and interrupts are off so
+ * no other update on this CPU can nest inside.
+ */
+void this_cpu_counters_add2(pcpu_counter_t a, int64_t delta_a, pcpu_counter_t b, int64_t delta_b) {
+    uint64_t flags = local_irq_save();
+    pcpu_area_t* area = &this_cpu()->pcpu;
+
+    area->seq++;
+    barrier();
+    area->counters[a] += delta_a;
+    area->counters[b] += delta_b;
+    barrier();
+    area->seq++;
+
+    local_irq_restore(flags);
+}
+
+/*
+ * Sum of a counter over the online CPUs
+ */
+int64_t pcpu_counter_sum(pcpu_counter_t id) {
+    cpumask_t online = cpu_online_mask();
+    int64_t sum = 0;
+    uint32_t cpu;
+
+    for_each_cpu(cpu, online) {
+        sum += __atomic_load_n(&get_cpu(cpu)->pcpu.counters[id], __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+/*
+ * Sum of every counter over the online CPUs
+ *
+ * Each CPU's counters are copied between two reads of its sequence count
+ * and copied again if a grouped update ran in between. Stores on x86 are
+ * seen in order, so compiler barriers are enough.
+ */
+void pcpu_counters_snapshot(int64_t counters[PCPU_NR_COUNTERS]) {
+    cpumask_t online = cpu_online_mask();
+    int64_t copy[PCPU_NR_COUNTERS];
+    uint32_t cpu;
+
+    memset(counters, 0, PCPU_NR_COUNTERS * sizeof(int64_t));
+
+    for_each_cpu(cpu, online) {
+        pcpu_area_t* area = &get_cpu(cpu)->pcpu;
+        uint32_t seq;
+
+        do {
+            while ((seq = area->seq) & 1) {
+                cpu_relax();
+            }
+            barrier();
+            for (uint32_t i = 0; i < PCPU_NR_COUNTERS; i++) {
+                copy[i] = area->counters[i];
+            }
+            barrier();
+        } while (area->seq != seq);
+
+        for (uint32_t i = 0; i < PCPU_NR_COUNTERS; i++) {
+            counters[i] += copy[i];
+        }
+    }
+}
+
+/*
+ * Add to a batched counter: the delta stays on this CPU until it
+ * reaches the batch size
+ */
+void pcpu_batch_add(pcpu_batch_t* counter, int64_t delta) {
+    uint64_t flags = local_irq_save();
+    int64_t* pending = &this_cpu()->pcpu.counters[counter->id];
+    int64_t value = *pending + delta;
+
+    if (value >= counter->batch || value <= -counter->batch) {
+        __atomic_fetch_add(&counter->count, value, __ATOMIC_RELAXED);
+        value = 0;
+    }
+    *pending = value;
+
+    local_irq_restore(flags);
+}
+
+/*
+ * Folded count plus the deltas every CPU has pending
+ */
+int64_t pcpu_batch_sum(pcpu_batch_t* counter) {
+    return pcpu_batch_read(counter) + pcpu_counter_sum(counter->id);
+}
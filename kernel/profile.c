@@ -0,0 +1,423 @@
+/*
+ * EdgeX OS - Sampling Profiler
+ *
+ * This file implements the tick-driven profiler. A CPU fills only its own
+ * buffer, from its timer interrupt, so taking a sample needs no lock. The
+ * stack walk follows saved frame pointers and stops at the first frame
+ * outside the interrupted task's kernel stack or return address outside
+ * the kernel's code. Buffers keep the first samples of a run; the report
+ * is made after sampling has stopped.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/scheduler.h>
+#include <edgex/tick.h>
+#include <edgex/ksyms.h>
+#include <edgex/profile.h>
+
+#ifdef CONFIG_PROFILE
+
+#define PROFILE_FOLD_SLOTS      4096     /* Distinct stacks (power of two) */
+#define PROFILE_MAX_TASKS       256      /* Task names in the report */
+#define PROFILE_REPORT_TOP      25       /* Symbols in the flat profile */
+#define PROFILE_LINE_MAX        1024
+
+/* Frames that are not kernel symbols (indices past the table) */
+#define PROFILE_SYM_USER        0
+#define PROFILE_SYM_UNKNOWN     1
+#define PROFILE_SYM_EXTRA       2
+
+typedef struct {
+    uint64_t count;              /* Samples kept */
+    uint64_t dropped;            /* Samples lost to a full buffer */
+    uint32_t countdown;          /* Ticks until the next sample */
+    volatile uint32_t busy;      /* Inside profile_tick() */
+    profile_sample_t* samples;
+} __attribute__((aligned(64))) profile_buf_t;
+
+/* A distinct stack of one task; frames[0] is where the sample hit */
+typedef struct {
+    uint32_t count;
+    int32_t pid;
+    uint32_t depth;
+    uint32_t frames[PROFILE_MAX_DEPTH + 1];
+} profile_fold_t;
+
+typedef struct {
+    int32_t pid;
+    char name[32];
+} profile_task_t;
+
+volatile bool profile_on;
+
+static profile_buf_t profile_bufs[MAX_CPUS];
+static uint32_t profile_period = 1;   /* Ticks per sample */
+
+/* Report state, allocated once by init_profile() */
+static uint32_t* profile_self;        /* Samples that hit each symbol */
+static uint32_t* profile_total;       /* Samples with each symbol on the stack */
+static profile_fold_t* profile_folds;
+static uint64_t profile_fold_overflow;
+static profile_task_t* profile_tasks;
+static uint32_t profile_nr_tasks;
+static uint64_t profile_samples;      /* Aggregated by profile_collect() */
+
+/* Linker script */
+extern char _stack_bottom[], _stack_top[];
+
+/*
+ * Walk the frame pointer chain from the interrupted frame
+ */
+static uint16_t profile_walk(uint64_t fp, task_t* task, uint64_t* stack) {
+    uintptr_t lo;
+    uintptr_t hi;
+    uint16_t depth = 0;
+
+    // Bounds of the stack the interrupted code was running on
+    if (task && task->kernel_stack &&
+        fp >= (uintptr_t)task->kernel_stack &&
+        fp < (uintptr_t)task->kernel_stack + task->kernel_stack_size) {
+        lo = (uintptr_t)task->kernel_stack;
+        hi = lo + task->kernel_stack_size;
+    } else if (fp >= (uintptr_t)_stack_bottom && fp < (uintptr_t)_stack_top) {
+        lo = (uintptr_t)_stack_bottom;
+        hi = (uintptr_t)_stack_top;
+    } else {
+        return 0;
+    }
+
+    while (depth < PROFILE_MAX_DEPTH && fp >= lo && fp + 16 <= hi && (fp & 7) == 0) {
+        const uint64_t* frame = (const uint64_t*)fp;
+        uint64_t ret = frame[1];
+
+        if (!ksym_in_text(ret)) {
+            break;
+        }
+        stack[depth++] = ret;
+
+        // Frames only move towards the top of the stack
+        if (frame[0] <= fp) {
+            break;
+        }
+        fp = frame[0];
+    }
+    return depth;
+}
+
+/*
+ * Take a sample on this CPU (timer interrupt, interrupts off)
+ */
+void profile_tick(cpu_context_t* context) {
+    uint32_t cpu = smp_processor_id();
+    profile_buf_t* buf = &profile_bufs[cpu];
+
+    buf->busy = 1;
+    barrier();
+    if (profile_on && buf->samples) {
+        if (buf->countdown > 1) {
+            buf->countdown--;
+        } else if (buf->count >= PROFILE_BUF_SAMPLES) {
+            buf->countdown = profile_period;
+            buf->dropped++;
+        } else {
+            task_t* current = get_current_task();
+            profile_sample_t* sample = &buf->samples[buf->count++];
+
+            buf->countdown = profile_period;
+            sample->rip = context->rip;
+            sample->pid = current ? current->pid : 0;
+            sample->user = (context->cs & 3) != 0;
+            sample->reserved = 0;
+            sample->depth = sample->user ? 0 : profile_walk(context->rbp, current, sample->stack);
+        }
+    }
+    barrier();
+    buf->busy = 0;
+}
+
+/*
+ * Allocate the buffers of the CPUs online now and the report tables
+ */
+void init_profile(void) {
+    cpumask_t online = cpu_online_mask();
+    uint32_t symbols = ksym_count() + PROFILE_SYM_EXTRA;
+    uint32_t cpus = 0;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpumask_test(online, cpu)) {
+            continue;
+        }
+        profile_bufs[cpu].samples = kzalloc(PROFILE_BUF_SAMPLES * sizeof(profile_sample_t));
+        if (!profile_bufs[cpu].samples) {
+            kernel_printf("profile: no memory for CPU %u\n", cpu);
+            continue;
+        }
+        cpus++;
+    }
+
+    profile_self = kzalloc(symbols * sizeof(uint32_t));
+    profile_total = kzalloc(symbols * sizeof(uint32_t));
+    profile_folds = kzalloc(PROFILE_FOLD_SLOTS * sizeof(profile_fold_t));
+    profile_tasks = kzalloc(PROFILE_MAX_TASKS * sizeof(profile_task_t));
+    if (!profile_self || !profile_total || !profile_folds || !profile_tasks) {
+        kernel_printf("profile: no memory for the report\n");
+    }
+
+    kernel_printf("profile: %u samples per CPU on %u CPUs, %u symbols\n",
+                  PROFILE_BUF_SAMPLES, cpus, ksym_count());
+}
+
+/*
+ * Wait until no CPU is inside profile_tick() (sampling off)
+ */
+static void profile_quiesce(void) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        while (profile_bufs[cpu].busy) {
+            cpu_relax();
+        }
+    }
+}
+
+void profile_start(uint32_t hz) {
+    profile_on = false;
+    profile_quiesce();
+
+    // Samples are taken every profile_period ticks
+    if (hz == 0 || hz > TICK_HZ) {
+        hz = TICK_HZ;
+    }
+    profile_period = TICK_HZ / hz;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        profile_bufs[cpu].count = 0;
+        profile_bufs[cpu].dropped = 0;
+        profile_bufs[cpu].countdown = profile_period;
+    }
+    __atomic_store_n(&profile_on, true, __ATOMIC_RELEASE);
+}
+
+void profile_stop(void) {
+    __atomic_store_n(&profile_on, false, __ATOMIC_RELEASE);
+    profile_quiesce();
+}
+
+/*
+ * Symbol index of an address, or one of the PROFILE_SYM_* past the table
+ */
+static uint32_t profile_symbol(uint64_t addr) {
+    int32_t index = ksym_index(addr);
+    return index >= 0 ? (uint32_t)index : ksym_count() + PROFILE_SYM_UNKNOWN;
+}
+
+static const char* profile_symbol_name(uint32_t symbol) {
+    uint32_t count = ksym_count();
+
+    if (symbol < count) {
+        return ksym_name(symbol);
+    }
+    return symbol == count + PROFILE_SYM_USER ? "[user]" : "[unknown]";
+}
+
+/*
+ * Count a stack in the fold table (open addressing on an FNV-1a hash)
+ */
+static void profile_fold_add(int32_t pid, const uint32_t* frames, uint32_t depth) {
+    uint32_t hash = 2166136261u;
+
+    hash = (hash ^ (uint32_t)pid) * 16777619u;
+    for (uint32_t i = 0; i < depth; i++) {
+        hash = (hash ^ frames[i]) * 16777619u;
+    }
+
+    for (uint32_t probe = 0; probe < PROFILE_FOLD_SLOTS; probe++) {
+        profile_fold_t* fold = &profile_folds[(hash + probe) & (PROFILE_FOLD_SLOTS - 1)];
+
+        if (fold->count == 0) {
+            fold->count = 1;
+            fold->pid = pid;
+            fold->depth = depth;
+            memcpy(fold->frames, frames, depth * sizeof(uint32_t));
+            return;
+        }
+        if (fold->pid == pid && fold->depth == depth &&
+            memcmp(fold->frames, frames, depth * sizeof(uint32_t)) == 0) {
+            fold->count++;
+            return;
+        }
+    }
+    profile_fold_overflow++;
+}
+
+/*
+ * Add a sample to the flat profile and the fold table
+ */
+static void profile_account(const profile_sample_t* sample) {
+    uint32_t frames[PROFILE_MAX_DEPTH + 1];
+    uint32_t depth = 0;
+
+    if (sample->user) {
+        frames[depth++] = ksym_count() + PROFILE_SYM_USER;
+    } else {
+        frames[depth++] = profile_symbol(sample->rip);
+    }
+    // A return address is just past its call: look up the call itself
+    for (uint32_t i = 0; i < sample->depth; i++) {
+        frames[depth++] = profile_symbol(sample->stack[i] - 1);
+    }
+
+    profile_self[frames[0]]++;
+    for (uint32_t i = 0; i < depth; i++) {
+        // Recursion counts once per sample
+        bool seen = false;
+        for (uint32_t j = 0; j < i; j++) {
+            if (frames[j] == frames[i]) {
+                seen = true;
+                break;
+            }
+        }
+        if (!seen) {
+            profile_total[frames[i]]++;
+        }
+    }
+
+    profile_fold_add(sample->pid, frames, depth);
+}
+
+static void profile_add_task(task_t* task, void* arg) {
+    (void)arg;
+
+    if (profile_nr_tasks < PROFILE_MAX_TASKS) {
+        profile_task_t* entry = &profile_tasks[profile_nr_tasks++];
+        entry->pid = task->pid;
+        memcpy(entry->name, task->name, sizeof(entry->name) - 1);
+        entry->name[sizeof(entry->name) - 1] = '\0';
+    }
+}
+
+static const char* profile_task_name(int32_t pid) {
+    for (uint32_t i = 0; i < profile_nr_tasks; i++) {
+        if (profile_tasks[i].pid == pid) {
+            return profile_tasks[i].name;
+        }
+    }
+    return "[exited]";
+}
+
+/*
+ * Print the symbols with the most samples, as tenths of a percent
+ */
+void profile_print_flat(void) {
+    uint32_t symbols = ksym_count() + PROFILE_SYM_EXTRA;
+    uint32_t shown[PROFILE_REPORT_TOP];
+    uint32_t nr_shown = 0;
+    uint64_t samples = profile_samples;
+
+    if (samples == 0) {
+        return;
+    }
+
+    kernel_printf("  self%%  total%%  samples  symbol\n");
+    while (nr_shown < PROFILE_REPORT_TOP) {
+        uint32_t best = symbols;
+
+        for (uint32_t sym = 0; sym < symbols; sym++) {
+            bool done = false;
+            for (uint32_t i = 0; i < nr_shown; i++) {
+                if (shown[i] == sym) {
+                    done = true;
+                    break;
+                }
+            }
+            if (!done && profile_self[sym] > 0 &&
+                (best == symbols || profile_self[sym] > profile_self[best])) {
+                best = sym;
+            }
+        }
+        if (best == symbols) {
+            break;
+        }
+        shown[nr_shown++] = best;
+
+        uint64_t self = (uint64_t)profile_self[best] * 1000 / samples;
+        uint64_t total = (uint64_t)profile_total[best] * 1000 / samples;
+        kernel_printf("  %3llu.%llu%%  %3llu.%llu%%  %7u  %s\n",
+                      self / 10, self % 10, total / 10, total % 10,
+                      profile_self[best], profile_symbol_name(best));
+    }
+}
+
+/*
+ * Write the fold table as "task;outer;...;inner count" lines
+ */
+void profile_write_folded(uart_t* uart) {
+    char line[PROFILE_LINE_MAX];
+
+    if (!profile_folds) {
+        return;
+    }
+
+    for (uint32_t slot = 0; slot < PROFILE_FOLD_SLOTS; slot++) {
+        const profile_fold_t* fold = &profile_folds[slot];
+        if (fold->count == 0) {
+            continue;
+        }
+
+        int len = snprintf(line, sizeof(line), "%s", profile_task_name(fold->pid));
+        for (uint32_t i = fold->depth; i > 0 && len < (int)sizeof(line); i--) {
+            len += snprintf(line + len, sizeof(line) - len, ";%s",
+                            profile_symbol_name(fold->frames[i - 1]));
+        }
+        if (len < (int)sizeof(line)) {
+            len += snprintf(line + len, sizeof(line) - len, " %u\n", fold->count);
+        }
+        if (len >= (int)sizeof(line)) {
+            // Truncated: keep the count, which tools need at the end
+            len = snprintf(line, sizeof(line), "%s;[truncated] %u\n",
+                           profile_task_name(fold->pid), fold->count);
+        }
+        uart_write(uart, line, (size_t)len);
+    }
+    uart_drain(uart);
+}
+
+uint64_t profile_collect(void) {
+    uint32_t symbols = ksym_count() + PROFILE_SYM_EXTRA;
+    uint64_t dropped = 0;
+    uint32_t cpus = 0;
+
+    profile_stop();
+
+    profile_samples = 0;
+    if (!profile_self || !profile_total || !profile_folds || !profile_tasks) {
+        kernel_printf("profile: no report tables\n");
+        return 0;
+    }
+
+    memset(profile_self, 0, symbols * sizeof(uint32_t));
+    memset(profile_total, 0, symbols * sizeof(uint32_t));
+    memset(profile_folds, 0, PROFILE_FOLD_SLOTS * sizeof(profile_fold_t));
+    profile_fold_overflow = 0;
+
+    profile_nr_tasks = 0;
+    for_each_task(profile_add_task, NULL);
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        profile_buf_t* buf = &profile_bufs[cpu];
+        if (!buf->samples) {
+            continue;
+        }
+        cpus++;
+        for (uint64_t i = 0; i < buf->count; i++) {
+            profile_account(&buf->samples[i]);
+        }
+        profile_samples += buf->count;
+        dropped += buf->dropped;
+    }
+
+    kernel_printf("profile: %llu samples at %u Hz on %u CPUs (%llu dropped, %llu stacks not folded)\n",
+                  profile_samples, TICK_HZ / profile_period, cpus, dropped, profile_fold_overflow);
+    return profile_samples;
+}
+
+#endif /* CONFIG_PROFILE */
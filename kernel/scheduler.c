@@ -9,6 +9,16 @@
 #include <edgex/scheduler.h>
 #include <edgex/memory.h>
 #include <edgex/interrupt.h>
+#include <edgex/cpu.h>
+#include <edgex/percpu.h>
+#include <edgex/tick.h>
+#include <edgex/preempt.h>
+#include <edgex/spinlock.h>
+#include <edgex/idle.h>
+#include <edgex/workqueue.h>
+#include <edgex/tsc.h>
+#include <edgex/trace.h>
+#include <edgex/profile.h>
 
 /* Default kernel stack size for tasks (64KB) */
 #define DEFAULT_KERNEL_STACK_SIZE (64 * 1024)
@@ -16,14 +26,48 @@
 /* Default time slice in timer ticks */
 #define DEFAULT_TIME_SLICE 10
 
+/* Maximum number of task cleanup handlers */
+#define MAX_CLEANUP_HANDLERS 8
+
+/* Maximum number of tasks listed by dump_sched_stats() */
+#define SCHED_DUMP_MAX_TASKS 128
+
+/*
+ * Per-CPU run queue
+ *
+ * Lock order: scheduler.lock, then a single run queue lock. Both are
+ * taken with interrupts disabled because the tick uses them.
+ */
+typedef struct runqueue {
+    spinlock_t lock;              /* Protects this run queue */
+    task_t* current_task;         /* Task running on this CPU */
+    task_t* prev_task;            /* Task switched out, finished by finish_task_switch() */
+    task_t* migrate_task;         /* Switched-out task no longer allowed on this CPU */
+    task_t* migrate_list;         /* Woken tasks no longer allowed on this CPU */
+    task_t* idle_task_tcb;        /* This CPU's idle task */
+    task_t* ready_queue[5];       /* Ready queues by priority (indexed by task_priority_t) */
+    uint32_t ready_count;         /* Number of tasks in the ready queues */
+    
+    /* Remote wakeups, pushed without the lock and drained by this CPU */
+    task_t* wake_list;            /* Lock-free LIFO, linked through wake_next */
+    
+    /* Statistics since stats_start, see reset_sched_stats(); the event
+     * counts are this CPU's PCPU_SCHED_* counters less counters_base */
+    int64_t counters_base[PCPU_NR_COUNTERS - PCPU_SCHED_SWITCHES];
+    uint64_t stats_start;         /* TSC */
+    uint64_t load_sum;            /* Run queue length x cycles */
+    uint64_t load_tsc;            /* Last change of the run queue length */
+    uint32_t load_nr;             /* Run queue length since load_tsc */
+} runqueue_t;
+
+static runqueue_t runqueues[MAX_CPUS];
+
 /* Scheduler state */
 static struct {
-    task_t* current_task;         /* Currently running task */
-    task_t* idle_task_tcb;        /* Idle task TCB */
+    spinlock_t lock;              /* Protects the task list and wait queues */
     task_t* task_list_head;       /* Head of all tasks list */
     
     /* Task queues */
-    task_t* ready_queue[5];       /* Ready queues by priority (indexed by task_priority_t) */
     task_t* blocked_queue;        /* Queue of blocked tasks */
     task_t* sleeping_queue;       /* Queue of sleeping tasks */
     
@@ -31,48 +75,73 @@ static struct {
     uint64_t tick_count;          /* Number of timer ticks since boot */
     pid_t next_pid;               /* Next available PID */
     uint32_t task_count;          /* Total number of tasks */
-    uint32_t ready_count;         /* Number of tasks in ready state */
     uint32_t blocked_count;       /* Number of tasks in blocked state */
     uint32_t sleeping_count;      /* Number of tasks in sleeping state */
     
+    /* Terminated tasks waiting for their cleanup handlers to run */
+    task_t* reap_list;
+    
     /* Scheduling flags */
     bool scheduler_running;       /* Is the scheduler actively running? */
     bool preemption_enabled;      /* Is preemptive multitasking enabled? */
-    bool in_critical_section;     /* Are we in a critical section? */
 } scheduler;
 
+/* Resource cleanup for terminated tasks, run from a worker thread */
+static void (*cleanup_handlers[MAX_CLEANUP_HANDLERS])(pid_t pid);
+static uint32_t cleanup_handler_count = 0;
+
+static void reap_terminated_tasks(work_t* work);
+static work_t task_reap_work = { .func = reap_terminated_tasks };
+
 /* Forward declarations */
 static void idle_task_function(void);
 static void timer_tick_handler(cpu_context_t* context);
 static void yield_handler(cpu_context_t* context);
-static void switch_to_task(task_t* task);
-static void schedule_next_task(void);
-static void add_task_to_ready_queue(task_t* task);
+static void reschedule_ipi_handler(cpu_context_t* context);
+static void __schedule(bool preempt);
+static void activate_task(task_t* task);
 static void remove_task_from_queue(task_t** queue, task_t* task);
-static task_t* get_next_ready_task(void);
+static task_t* get_next_ready_task(runqueue_t* rq);
 static task_t* create_task(const char* name, void (*entry_point)(void), 
                            task_priority_t priority, uint32_t flags);
 
+/* Called from task_entry_trampoline */
+void task_start(void (*entry_point)(void));
+
 /*
  * Assembly for context switching
+ *
+ * A switched-out task is saved as a task_context_t on its own stack: the
+ * general purpose registers followed by an interrupt return frame. Tasks
+ * preempted from an interrupt and tasks that called schedule() therefore
+ * resume the same way, with iretq. context_load() resumes a saved context
+ * without saving the current one.
  */
 extern void context_switch(task_context_t** old_context, task_context_t* new_context);
+extern void context_load(task_context_t* context) __attribute__((noreturn));
+extern void task_entry_trampoline(void);
 
 __asm__(
     ".global context_switch\n"
     ".type context_switch, @function\n"
     "context_switch:\n"
-    "    # Save current context\n"
-    "    pushq %rbp\n"
-    "    movq %rsp, %rbp\n"
-    
-    "    # Save all registers to the stack\n"
+    "    # Turn the call into an interrupt return frame\n"
+    "    popq %rax\n"             /* rax = return address */
+    "    movq %rsp, %rdx\n"       /* rdx = caller's stack pointer */
+    "    pushq $0x10\n"           /* ss */
+    "    pushq %rdx\n"            /* rsp */
+    "    pushfq\n"                /* rflags */
+    "    pushq $0x08\n"           /* cs */
+    "    pushq %rax\n"            /* rip */
+    
+    "    # Save all registers (same order as the interrupt stubs)\n"
     "    pushq %rax\n"
     "    pushq %rbx\n"
     "    pushq %rcx\n"
     "    pushq %rdx\n"
     "    pushq %rsi\n"
     "    pushq %rdi\n"
+    "    pushq %rbp\n"
     "    pushq %r8\n"
     "    pushq %r9\n"
     "    pushq %r10\n"
@@ -82,18 +151,15 @@ __asm__(
     "    pushq %r14\n"
     "    pushq %r15\n"
     
-    "    # Get RFLAGS and save it\n"
-    "    pushfq\n"
-    
     "    # Save stack pointer to old context\n"
-    "    movq (%rdi), %rax\n"     /* rax = *old_context */
-    "    movq %rsp, (%rax)\n"     /* *old_context->rsp = rsp */
+    "    movq %rsp, (%rdi)\n"     /* *old_context = rsp */
+    "    movq %rsi, %rdi\n"
     
+    ".global context_load\n"
+    ".type context_load, @function\n"
+    "context_load:\n"
     "    # Load new context\n"
-    "    movq %rsi, %rsp\n"       /* rsp = new_context */
-    
-    "    # Restore RFLAGS\n"
-    "    popfq\n"
+    "    movq %rdi, %rsp\n"       /* rsp = new_context */
     
     "    # Restore registers\n"
     "    popq %r15\n"
@@ -104,6 +170,7 @@ __asm__(
     "    popq %r10\n"
     "    popq %r9\n"
     "    popq %r8\n"
+    "    popq %rbp\n"
     "    popq %rdi\n"
     "    popq %rsi\n"
     "    popq %rdx\n"
@@ -111,40 +178,82 @@ __asm__(
     "    popq %rbx\n"
     "    popq %rax\n"
     
-    "    # Return\n"
-    "    leave\n"
-    "    ret\n"
+    "    # Return into the new task\n"
+    "    iretq\n"
+    
+    "# First instruction of every new task: entry point is in rbx\n"
+    ".global task_entry_trampoline\n"
+    ".type task_entry_trampoline, @function\n"
+    "task_entry_trampoline:\n"
+    "    movq %rbx, %rdi\n"
+    "    call task_start\n"
+    "    ud2\n"
 );
 
 /*
- * Enter a critical section - disable interrupts and set flag
+ * Get the run queue of the running CPU
+ */
+static inline runqueue_t* this_rq(void) {
+    return &runqueues[smp_processor_id()];
+}
+
+/*
+ * Get the run queue a task is assigned to
+ */
+static inline runqueue_t* task_rq(task_t* task) {
+    return &runqueues[task->cpu];
+}
+
+/*
+ * Get the CPU a run queue belongs to
+ */
+static inline uint32_t rq_cpu(runqueue_t* rq) {
+    return (uint32_t)(rq - runqueues);
+}
+
+/*
+ * Number of runnable tasks on a run queue, including the running
+ * task but not the idle task
  */
-static inline void enter_critical(void) {
-    __asm__ volatile("cli");
-    scheduler.in_critical_section = true;
+static uint32_t rq_nr_running(runqueue_t* rq) {
+    uint32_t nr = rq->ready_count;
+    
+    if (rq->current_task && rq->current_task != rq->idle_task_tcb &&
+        rq->current_task->state == TASK_STATE_RUNNING) {
+        nr++;
+    }
+    return nr;
 }
 
 /*
- * Exit a critical section - clear flag and enable interrupts
+ * Account the run queue length up to now and pass the new one on to
+ * the tick (rq->lock held)
  */
-static inline void exit_critical(void) {
-    scheduler.in_critical_section = false;
-    __asm__ volatile("sti");
+static void rq_update_nr_running(runqueue_t* rq) {
+    uint64_t now = rdtsc();
+    uint32_t nr = rq_nr_running(rq);
+    
+    rq->load_sum += (uint64_t)rq->load_nr * (now - rq->load_tsc);
+    rq->load_tsc = now;
+    rq->load_nr = nr;
+    
+    tick_nohz_update(nr);
 }
 
 /*
  * Get current task pointer
  */
 task_t* get_current_task(void) {
-    return scheduler.current_task;
+    return this_rq()->current_task;
 }
 
 /*
  * Get current task PID
  */
 pid_t get_current_pid(void) {
-    if (scheduler.current_task) {
-        return scheduler.current_task->pid;
+    task_t* current = get_current_task();
+    if (current) {
+        return current->pid;
     }
     return PID_INVALID;
 }
@@ -215,54 +324,338 @@ static void remove_task_from_queue(task_t** queue, task_t* task) {
 }
 
 /*
- * Add a task to the ready queue based on its priority
+ * Insert a task into the sleeping queue, keeping it sorted by wake tick
+ * (scheduler.lock held)
+ */
+static void add_sleeping_task(task_t* task) {
+    task_t* prev = NULL;
+    task_t* current = scheduler.sleeping_queue;
+    
+    // Equal wake ticks keep their FIFO order
+    while (current && current->wake_tick <= task->wake_tick) {
+        prev = current;
+        current = current->next;
+    }
+    
+    task->prev = prev;
+    task->next = current;
+    if (current) {
+        current->prev = task;
+    }
+    if (prev) {
+        prev->next = task;
+    } else {
+        scheduler.sleeping_queue = task;
+    }
+    
+    scheduler.sleeping_count++;
+}
+
+/*
+ * Get a task's ready queue index, clamping invalid priorities
+ */
+static inline task_priority_t ready_queue_index(task_t* task) {
+    if (task->priority > TASK_PRIORITY_REALTIME) {
+        return TASK_PRIORITY_NORMAL;
+    }
+    return task->priority;
+}
+
+/*
+ * Add a task to the ready queue of a specific CPU (rq->lock held)
+ */
+static void enqueue_task(runqueue_t* rq, task_t* task) {
+    add_task_to_queue(&rq->ready_queue[ready_queue_index(task)], task);
+    
+    task->cpu = rq_cpu(rq);
+    task->state = TASK_STATE_READY;
+    rq->ready_count++;
+}
+
+/*
+ * Remove a ready task from its CPU's ready queue (run queue lock held)
+ *
+ * A task still sitting on a wake list is not in any ready queue; the
+ * draining CPU drops it once it sees the task is no longer READY.
+ */
+static void dequeue_task(task_t* task) {
+    if (task->state != TASK_STATE_READY || task->wake_pending) {
+        return;
+    }
+    
+    runqueue_t* rq = task_rq(task);
+    remove_task_from_queue(&rq->ready_queue[ready_queue_index(task)], task);
+    rq->ready_count--;
+}
+
+/*
+ * Remove a ready task from its run queue, taking the run queue lock
+ */
+static void dequeue_task_locked(task_t* task) {
+    runqueue_t* rq = task_rq(task);
+    uint64_t flags;
+    
+    spin_lock_irqsave(&rq->lock, flags);
+    dequeue_task(task);
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+/*
+ * Ask a CPU to reschedule as soon as it leaves its current
+ * non-preemptible section
+ */
+static void resched_cpu(uint32_t cpu) {
+    if (cpu == smp_processor_id()) {
+        set_need_resched();
+        return;
+    }
+    
+    cpu_t* target = get_cpu(cpu);
+    if (target && !target->need_resched) {
+        // An idle CPU watching need_resched wakes up from the store alone
+        if (!idle_wake_by_store(target)) {
+            target->need_resched = true;
+            cpu_send_ipi(cpu, INT_VECTOR_RESCHEDULE);
+        }
+    }
+}
+
+/*
+ * Preempt the running task of a run queue if a newly woken task
+ * has a higher priority (rq->lock held)
+ */
+static void check_preempt_wakeup(runqueue_t* rq, task_t* task) {
+    task_t* curr = rq->current_task;
+    
+    if (!curr || curr == rq->idle_task_tcb ||
+        curr->state != TASK_STATE_RUNNING ||
+        task->priority > curr->priority) {
+        resched_cpu(rq_cpu(rq));
+    }
+}
+
+/*
+ * Choose the CPU a task should be queued on
+ *
+ * Tasks stay within their affinity mask. Unpinned tasks default to the
+ * housekeeping CPUs, so isolated CPUs only ever run tasks that were
+ * explicitly placed there. Among the allowed CPUs, the least loaded
+ * one wins, with ties going to the CPU the task last ran on.
+ */
+static uint32_t select_task_cpu(task_t* task) {
+    cpumask_t allowed = task->cpus_allowed & cpu_online_mask();
+    if (allowed == CPU_MASK_NONE) {
+        allowed = housekeeping_mask();
+    }
+    
+    uint32_t best = cpumask_test(allowed, task->cpu) ? task->cpu : cpumask_first(allowed);
+    uint32_t best_load = rq_nr_running(&runqueues[best]);
+    uint32_t cpu;
+    
+    for_each_cpu(cpu, allowed) {
+        uint32_t load = rq_nr_running(&runqueues[cpu]);
+        if (load < best_load) {
+            best = cpu;
+            best_load = load;
+        }
+    }
+    
+    return best;
+}
+
+/*
+ * Queue a wakeup on a remote CPU without touching its run queue lock
+ *
+ * The task is pushed onto the target's lock-free wake list. Only the push
+ * that finds the list empty sends a reschedule IPI; later wakers piggyback
+ * on it, so a broadcast waking many tasks costs one IPI per target CPU.
+ */
+static void queue_remote_wakeup(uint32_t cpu, task_t* task) {
+    runqueue_t* rq = &runqueues[cpu];
+    task_t* head = __atomic_load_n(&rq->wake_list, __ATOMIC_RELAXED);
+    
+    task->cpu = cpu;
+    do {
+        task->wake_next = head;
+    } while (!__atomic_compare_exchange_n(&rq->wake_list, &head, task, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    
+    if (head != NULL) {
+        return;
+    }
+    
+    // A polling or MWAITing idle CPU drains the list in schedule()
+    if (!idle_wake_by_store(get_cpu(cpu)) && cpu_send_ipi(cpu, INT_VECTOR_RESCHEDULE)) {
+        this_cpu_counter_inc(PCPU_SCHED_WAKE_IPIS);
+    }
+}
+
+/*
+ * Move remotely woken tasks from the wake list to the ready queues
+ * (rq->lock held, interrupts disabled)
+ *
+ * Returns tasks whose affinity no longer includes this CPU, linked
+ * through wake_next, for the caller to activate after dropping the lock.
+ */
+static task_t* drain_wake_list(runqueue_t* rq) {
+    task_t* list = __atomic_exchange_n(&rq->wake_list, NULL, __ATOMIC_ACQUIRE);
+    task_t* reversed = NULL;
+    task_t* misplaced = NULL;
+    uint32_t cpu = rq_cpu(rq);
+    
+    if (!list) {
+        return NULL;
+    }
+    
+    // The list is LIFO, restore wakeup order
+    while (list) {
+        task_t* next = list->wake_next;
+        list->wake_next = reversed;
+        reversed = list;
+        list = next;
+    }
+    
+    while (reversed) {
+        task_t* task = reversed;
+        reversed = task->wake_next;
+        task->wake_next = NULL;
+        
+        // Clear the flag before looking at the state, see activate_task()
+        __atomic_store_n(&task->wake_pending, 0, __ATOMIC_SEQ_CST);
+        
+        // Blocked or terminated again before we got to it
+        if (__atomic_load_n(&task->state, __ATOMIC_SEQ_CST) != TASK_STATE_READY) {
+            continue;
+        }
+        
+        if (!cpumask_test(task->cpus_allowed, cpu)) {
+            task->wake_next = misplaced;
+            misplaced = task;
+            continue;
+        }
+        
+        enqueue_task(rq, task);
+        check_preempt_wakeup(rq, task);
+        this_cpu_counter_inc(PCPU_SCHED_REMOTE_WAKEUPS);
+    }
+    
+    rq_update_nr_running(rq);
+    return misplaced;
+}
+
+/*
+ * Activate the tasks returned by drain_wake_list() (no run queue lock held)
+ */
+static void activate_misplaced(task_t* list) {
+    while (list) {
+        task_t* task = list;
+        list = task->wake_next;
+        task->wake_next = NULL;
+        activate_task(task);
+    }
+}
+
+/*
+ * Drain this CPU's wake list, taking the run queue lock
  */
-static void add_task_to_ready_queue(task_t* task) {
+static void sched_wake_pending(void) {
+    runqueue_t* rq = this_rq();
+    uint64_t flags;
+    
+    if (!__atomic_load_n(&rq->wake_list, __ATOMIC_RELAXED)) {
+        return;
+    }
+    
+    spin_lock_irqsave(&rq->lock, flags);
+    task_t* misplaced = drain_wake_list(rq);
+    spin_unlock_irqrestore(&rq->lock, flags);
+    
+    activate_misplaced(misplaced);
+}
+
+/*
+ * Make a task runnable: pick its CPU, queue it there and preempt
+ * that CPU's current task if the new one is more important
+ *
+ * Local wakeups go straight to the ready queue. Remote ones go through
+ * the target's wake list. Must not be called with a run queue lock held.
+ */
+static void activate_task(task_t* task) {
     if (!task) {
         return;
     }
     
-    task_priority_t priority = task->priority;
+    // Publish READY before testing wake_pending; the draining CPU does
+    // the opposite, so one of the two always sees the other's update
+    task_state_t old_state = __atomic_exchange_n(&task->state, TASK_STATE_READY,
+                                                 __ATOMIC_SEQ_CST);
     
-    // Validate priority
-    if (priority > TASK_PRIORITY_REALTIME) {
-        priority = TASK_PRIORITY_NORMAL;
+    uint32_t expected = 0;
+    if (!__atomic_compare_exchange_n(&task->wake_pending, &expected, 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        // Still on a wake list: the drain will queue it
+        return;
+    }
+    
+    // Wake-to-run latency starts here, unless it was ready already
+    if (old_state != TASK_STATE_READY) {
+        task->sched_stats.ready_tsc = rdtsc();
+        task->sched_stats.woken = true;
+        this_cpu_counter_inc(PCPU_SCHED_WAKEUPS);
     }
     
-    // Add to appropriate ready queue
-    add_task_to_queue(&scheduler.ready_queue[priority], task);
+    // A task whose context is still live stays where it is
+    uint32_t cpu = task->on_cpu ? task->cpu : select_task_cpu(task);
+    runqueue_t* rq = &runqueues[cpu];
+    uint64_t flags;
     
-    // Update task state and counters
-    task->state = TASK_STATE_READY;
-    scheduler.ready_count++;
+    if (cpu != smp_processor_id()) {
+        queue_remote_wakeup(cpu, task);
+        return;
+    }
+    
+    spin_lock_irqsave(&rq->lock, flags);
+    
+    task->wake_pending = 0;
+    enqueue_task(rq, task);
+    check_preempt_wakeup(rq, task);
+    
+    // A tickless CPU must restart its tick once it has tasks to time-slice
+    rq_update_nr_running(rq);
+    
+    spin_unlock_irqrestore(&rq->lock, flags);
 }
 
 /*
- * Get the highest priority task from the ready queues
+ * Get the highest priority task from a CPU's ready queues
  */
-static task_t* get_next_ready_task(void) {
+static task_t* get_next_ready_task(runqueue_t* rq) {
     // Start from highest priority queue
     for (int priority = TASK_PRIORITY_REALTIME; priority >= TASK_PRIORITY_IDLE; priority--) {
-        if (scheduler.ready_queue[priority]) {
+        if (rq->ready_queue[priority]) {
             // Get the first task in this priority queue
-            task_t* task = scheduler.ready_queue[priority];
+            task_t* task = rq->ready_queue[priority];
             
             // Remove it from the ready queue
-            remove_task_from_queue(&scheduler.ready_queue[priority], task);
+            remove_task_from_queue(&rq->ready_queue[priority], task);
             
             // Update counters
-            scheduler.ready_count--;
+            rq->ready_count--;
             
             return task;
         }
     }
     
     // No tasks ready, return idle task
-    return scheduler.idle_task_tcb;
+    return rq->idle_task_tcb;
 }
 
 /*
  * Create a new task stack frame for initial execution
+ *
+ * The frame is resumed by context_load()/context_switch() like any other
+ * saved context and enters task_entry_trampoline with the entry point in
+ * rbx and interrupts disabled, since the run queue lock is still held.
  */
 static task_context_t* setup_initial_stack(task_t* task, void (*entry_point)(void)) {
     // Calculate where the stack top would be
@@ -271,37 +664,79 @@ static task_context_t* setup_initial_stack(task_t* task, void (*entry_point)(voi
     // Align stack to 16-byte boundary (x86_64 ABI requirement)
     stack_top &= ~15ULL;
     
-    // Leave space for the task context
-    stack_top -= sizeof(task_context_t);
-    
-    // Initialize the task context
-    task_context_t* context = (task_context_t*)stack_top;
+    // The context sits just below the task's initial stack pointer
+    task_context_t* context = (task_context_t*)(stack_top - sizeof(task_context_t));
     
     // Zero out the context
     memset(context, 0, sizeof(task_context_t));
     
     // Set up initial register values
-    context->rip = (uint64_t)entry_point;    // Entry point
-    context->rflags = 0x202;                 // IF flag set (interrupts enabled)
-    context->cs = 0x08;                      // Kernel code segment
-    context->ss = 0x10;                      // Kernel data segment
-    context->rsp = stack_top;                // Set stack pointer to just below the context
+    context->rbx = (uint64_t)entry_point;             // Passed to task_start()
+    context->rip = (uint64_t)task_entry_trampoline;   // Entry point
+    context->rflags = 0x002;                          // IF clear until the switch completes
+    context->cs = 0x08;                               // Kernel code segment
+    context->ss = 0x10;                               // Kernel data segment
+    context->rsp = stack_top;                         // Initial stack pointer
     
     return context;
 }
 
+/*
+ * Complete a context switch on the new task's side
+ *
+ * Releases the run queue lock taken by __schedule() on the outgoing
+ * task's side. Interrupts stay disabled; the caller restores them.
+ */
+static void finish_task_switch(void) {
+    runqueue_t* rq = this_rq();
+    task_t* prev = rq->prev_task;
+    task_t* migrate = rq->migrate_task;
+    task_t* misplaced = rq->migrate_list;
+    
+    rq->prev_task = NULL;
+    rq->migrate_task = NULL;
+    rq->migrate_list = NULL;
+    
+    // The old task's stack is no longer in use
+    if (prev) {
+        prev->on_cpu = false;
+    }
+    
+    arch_spin_unlock(&rq->lock);
+    preempt_enable_no_resched();
+    
+    // Its affinity changed while it was running: move it now
+    if (migrate) {
+        activate_task(migrate);
+    }
+    activate_misplaced(misplaced);
+}
+
+/*
+ * First code run by a new task
+ */
+void task_start(void (*entry_point)(void)) {
+    finish_task_switch();
+    sti();
+    
+    entry_point();
+    
+    // Returning from the entry point ends the task
+    exit_task();
+}
+
 /*
  * Create a new task
+ *
+ * Idle tasks are not queued; init_scheduler_cpu() attaches them
+ * to their CPU directly.
  */
 static task_t* create_task(const char* name, void (*entry_point)(void), 
                            task_priority_t priority, uint32_t flags) {
-    enter_critical();
-    
     // Allocate and zero TCB
     task_t* task = (task_t*)kmalloc(sizeof(task_t));
     if (!task) {
         kernel_printf("Failed to allocate memory for task.\n");
-        exit_critical();
         return NULL;
     }
     memset(task, 0, sizeof(task_t));
@@ -312,18 +747,21 @@ static task_t* create_task(const char* name, void (*entry_point)(void),
     if (!task->kernel_stack) {
         kernel_printf("Failed to allocate kernel stack for task.\n");
         kfree(task);
-        exit_critical();
         return NULL;
     }
     
     // Initialize the task fields
-    task->pid = scheduler.next_pid++;
     strncpy(task->name, name, sizeof(task->name) - 1);
     task->state = TASK_STATE_READY;
     task->priority = priority;
     task->flags = flags;
     task->time_slice = DEFAULT_TIME_SLICE;
     task->remaining_ticks = task->time_slice;
+    task->sched_stats.ready_tsc = rdtsc();
+    
+    // Unpinned tasks run on housekeeping CPUs only
+    task->cpu = smp_processor_id();
+    task->cpus_allowed = housekeeping_mask();
     
     // For now, all tasks use the kernel's page directory
     task->page_dir = get_kernel_page_directory();
@@ -331,16 +769,25 @@ static task_t* create_task(const char* name, void (*entry_point)(void),
     // Setup initial stack frame and context
     task->context = setup_initial_stack(task, entry_point);
     
+    uint64_t irq_flags;
+    spin_lock_irqsave(&scheduler.lock, irq_flags);
+    
+    task->pid = scheduler.next_pid++;
+    
     // Add to the global task list
-    add_task_to_queue(&scheduler.task_list_head, task);
+    task->all_next = scheduler.task_list_head;
+    scheduler.task_list_head = task;
     scheduler.task_count++;
     
-    // Add to the ready queue
-    add_task_to_ready_queue(task);
+    // Add to a ready queue
+    if (!(flags & TASK_FLAG_IDLE)) {
+        activate_task(task);
+    }
+    
+    spin_unlock_irqrestore(&scheduler.lock, irq_flags);
     
     kernel_printf("Created task %s with PID %d\n", task->name, task->pid);
     
-    exit_critical();
     return task;
 }
 
@@ -363,7 +810,7 @@ pid_t create_user_task(const char* name, void (*entry_point)(void), task_priorit
 }
 
 /*
- * Find a task by PID
+ * Find a task by PID (scheduler.lock held)
  */
 static task_t* find_task_by_pid(pid_t pid) {
     task_t* task = scheduler.task_list_head;
@@ -371,58 +818,127 @@ static task_t* find_task_by_pid(pid_t pid) {
         if (task->pid == pid) {
             return task;
         }
-        task = task->next;
+        task = task->all_next;
     }
     return NULL;
 }
 
+/*
+ * Call fn for every task, with the scheduler lock held
+ */
+void for_each_task(void (*fn)(task_t* task, void* arg), void* arg) {
+    uint64_t flags;
+    spin_lock_irqsave(&scheduler.lock, flags);
+    
+    for (task_t* task = scheduler.task_list_head; task; task = task->all_next) {
+        fn(task, arg);
+    }
+    
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+}
+
 /*
  * Terminate a task
  */
 void terminate_task(pid_t pid) {
-    enter_critical();
-    
     // Can't terminate PID 0 or 1 (kernel tasks)
     if (pid <= PID_KERNEL) {
-        exit_critical();
         return;
     }
     
+    uint64_t flags;
+    spin_lock_irqsave(&scheduler.lock, flags);
+    
     // Find the task
     task_t* task = find_task_by_pid(pid);
-    if (!task) {
-        exit_critical();
+    if (!task || task->state == TASK_STATE_TERMINATED || (task->flags & TASK_FLAG_IDLE)) {
+        spin_unlock_irqrestore(&scheduler.lock, flags);
         return;
     }
     
+    // Remove from whichever queue holds it
+    switch (task->state) {
+        case TASK_STATE_READY:
+            dequeue_task_locked(task);
+            break;
+        case TASK_STATE_BLOCKED:
+            remove_task_from_queue(&scheduler.blocked_queue, task);
+            scheduler.blocked_count--;
+            break;
+        case TASK_STATE_SLEEPING:
+            remove_task_from_queue(&scheduler.sleeping_queue, task);
+            scheduler.sleeping_count--;
+            break;
+        default:
+            break;
+    }
+    
     // Mark task as terminated
     task->state = TASK_STATE_TERMINATED;
     
-    // Remove from any queue
-    for (int i = 0; i < 5; i++) {
-        remove_task_from_queue(&scheduler.ready_queue[i], task);
+    // Clean up task resources later, from a worker thread
+    // (For now, we don't free its memory since we might need to access
+    // its exit status or other data)
+    task->next = scheduler.reap_list;
+    scheduler.reap_list = task;
+    
+    bool is_current = (get_current_task() == task);
+    if (!is_current && task->on_cpu) {
+        // Running on another CPU: make it switch away
+        resched_cpu(task->cpu);
     }
-    remove_task_from_queue(&scheduler.blocked_queue, task);
-    remove_task_from_queue(&scheduler.sleeping_queue, task);
     
-    // Clean up task resources
-    // (For now, we just mark it as terminated but don't free its memory
-    // since we might need to access its exit status or other data)
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+    
+    queue_work(&task_reap_work);
     
     // If terminating current task, schedule next task
-    if (scheduler.current_task == task) {
-        schedule_next_task();
+    if (is_current) {
+        schedule();
     }
-    
-    exit_critical();
+}
+
+/*
+ * Run the cleanup handlers of terminated tasks
+ */
+static void reap_terminated_tasks(work_t* work) {
+    (void)work; // Unused parameter
+    
+    uint64_t flags;
+    spin_lock_irqsave(&scheduler.lock, flags);
+    task_t* list = scheduler.reap_list;
+    scheduler.reap_list = NULL;
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+    
+    while (list) {
+        task_t* task = list;
+        list = task->next;
+        task->next = NULL;
+        
+        for (uint32_t i = 0; i < cleanup_handler_count; i++) {
+            cleanup_handlers[i](task->pid);
+        }
+    }
+}
+
+/*
+ * Register a function that releases a terminated task's resources
+ */
+void register_task_cleanup_handler(void (*handler)(pid_t pid)) {
+    if (!handler || cleanup_handler_count >= MAX_CLEANUP_HANDLERS) {
+        kernel_printf("Cannot register task cleanup handler\n");
+        return;
+    }
+    cleanup_handlers[cleanup_handler_count++] = handler;
 }
 
 /*
  * Exit current task
  */
 void exit_task(void) {
-    if (scheduler.current_task) {
-        terminate_task(scheduler.current_task->pid);
+    task_t* current = get_current_task();
+    if (current) {
+        terminate_task(current->pid);
     }
     // Should never reach here if current task, but just in case
     while (1) {
@@ -431,110 +947,220 @@ void exit_task(void) {
 }
 
 /*
- * Switch to a specific task
+ * Keep a task that was preempted on its way to sleep runnable
+ * (interrupts disabled, no locks held)
+ *
+ * Between prepare_to_block() and schedule(), a task still has to
+ * publish that it waits and re-check its condition. Switched out there,
+ * it would wait for a wakeup nobody knows to send. Its wait is undone
+ * instead, as for a spurious wakeup, so that only a voluntary schedule()
+ * takes a waiting task off the CPU. A task blocked by block_task() from
+ * elsewhere is not waiting on its own and stays blocked. sleep_task()
+ * and block_task() on the current task keep interrupts off until they
+ * switch away, so they are never preempted in between.
  */
-static void switch_to_task(task_t* task) {
-    if (!task) {
+static void preempt_cancel_wait(task_t* task) {
+    if (!task->waiting) {
         return;
     }
     
-    // If already running this task, do nothing
-    if (scheduler.current_task == task) {
-        return;
-    }
+    spin_lock(&scheduler.lock);
     
-    // Update task state
-    if (task->state != TASK_STATE_RUNNING) {
+    // Recheck: a wakeup may have made it ready in the meantime
+    if (task->waiting && task->state == TASK_STATE_BLOCKED) {
+        remove_task_from_queue(&scheduler.blocked_queue, task);
+        scheduler.blocked_count--;
         task->state = TASK_STATE_RUNNING;
+        task->waiting = false;
     }
     
-    // Reset time slice
-    task->remaining_ticks = task->time_slice;
+    spin_unlock(&scheduler.lock);
+}
+
+/*
+ * Histogram bucket of a wake-to-run latency: bucket n holds [2^(n-1), 2^n) ns
+ */
+static uint32_t sched_lat_bucket(uint64_t ns) {
+    uint32_t bucket = ns ? 64 - (uint32_t)__builtin_clzll(ns) : 0;
+    return bucket < SCHED_LAT_BUCKETS ? bucket : SCHED_LAT_BUCKETS - 1;
+}
+
+/*
+ * Account a context switch: CPU time of the outgoing task, run queue
+ * wait and wakeup latency of the incoming one (rq->lock held)
+ */
+static void sched_stats_switch(runqueue_t* rq, task_t* prev, task_t* next, bool preempted) {
+    task_sched_stats_t* out = &prev->sched_stats;
+    task_sched_stats_t* in = &next->sched_stats;
+    uint64_t now = rdtsc();
+    
+    this_cpu_counter_inc(PCPU_SCHED_SWITCHES);
+    
+    out->run_cycles += now - out->run_tsc;
+    if (prev != rq->idle_task_tcb) {
+        if (preempted) {
+            // Waits in the run queue from now, but was not woken
+            out->nr_involuntary++;
+            out->ready_tsc = now;
+            out->woken = false;
+        } else if (prev->state == TASK_STATE_READY) {
+            // Woken before it got off the CPU: still runnable and queued
+            out->nr_involuntary++;
+        } else {
+            out->nr_voluntary++;
+        }
+    }
     
-    // Save old task pointer
-    task_t* old_task = scheduler.current_task;
+    in->run_tsc = now;
+    if (next == rq->idle_task_tcb) {
+        return;
+    }
     
-    // Update current task
-    scheduler.current_task = task;
+    uint64_t wait = now - in->ready_tsc;
+    in->wait_cycles += wait;
     
-    // If no previous task (first run), just load the new context
-    if (!old_task) {
-        // Switch to the new task's page directory if needed
-        if (task->page_dir) {
-            switch_page_directory(task->page_dir);
-        }
+    if (in->woken) {
+        uint64_t latency = tsc_to_ns(wait);
         
-        // Load the initial context
-        __asm__ volatile(
-            "movq %0, %%rsp\n"   // Load stack pointer
-            "popq %%r15\n"       // Restore registers
-            "popq %%r14\n"
-            "popq %%r13\n"
-            "popq %%r12\n"
-            "popq %%r11\n"
-            "popq %%r10\n"
-            "popq %%r9\n"
-            "popq %%r8\n"
-            "popq %%rdi\n"
-            "popq %%rsi\n"
-            "popq %%rdx\n"
-            "popq %%rcx\n"
-            "popq %%rbx\n"
-            "popq %%rax\n"
-            "iretq\n"            // Return to new task
-            : : "g"(task->context)
-        );
-    } else {
-        // Save old task state if it's still active
-        if (old_task->state != TASK_STATE_TERMINATED) {
-            if (old_task->state == TASK_STATE_RUNNING) {
-                old_task->state = TASK_STATE_READY;
-                add_task_to_ready_queue(old_task);
-            }
+        in->nr_wakeups++;
+        in->wake_latency_sum += latency;
+        if (latency > in->wake_latency_max) {
+            in->wake_latency_max = latency;
         }
-        
-        // Switch to the new task's page directory if needed
-        if (task->page_dir && old_task->page_dir != task->page_dir) {
-            switch_page_directory(task->page_dir);
-        }
-        
-        // Perform context switch
-        context_switch(&old_task->context, task->context);
+        in->wake_latency_hist[sched_lat_bucket(latency)]++;
+        in->woken = false;
     }
 }
 
 /*
- * Schedule the next task to run
+ * Pick the next task on this CPU and switch to it
+ *
+ * The run queue lock is held across context_switch() and released by
+ * finish_task_switch() on the other side, so the outgoing task cannot be
+ * picked up elsewhere before its registers are saved. A preempted task
+ * goes back on the run queue whatever its state; only a voluntary call
+ * leaves a task that is not running off it.
  */
-static void schedule_next_task(void) {
-    // If scheduler is not running yet, do nothing
-    if (!scheduler.scheduler_running) {
-        return;
+static void __schedule(bool preempt) {
+    uint64_t flags = local_irq_save();
+    runqueue_t* rq = this_rq();
+    uint32_t cpu = rq_cpu(rq);
+    
+    // Takes the scheduler lock, which nests outside the run queue lock
+    if (preempt) {
+        preempt_cancel_wait(rq->current_task);
+    } else {
+        // The wait prepare_to_block() started is what this switch is for
+        rq->current_task->waiting = false;
+    }
+    
+    spin_lock(&rq->lock);
+    clear_need_resched();
+    
+    // Pick up remote wakeups that raced with the IPI
+    task_t* misplaced = drain_wake_list(rq);
+    
+    task_t* prev = rq->current_task;
+    bool preempted = prev->state == TASK_STATE_RUNNING;
+    
+    // Requeue the old task if it was preempted rather than blocked
+    if (preempted) {
+        if (prev == rq->idle_task_tcb) {
+            prev->state = TASK_STATE_READY;
+        } else if (cpumask_test(prev->cpus_allowed, cpu)) {
+            enqueue_task(rq, prev);
+        } else {
+            // Affinity changed while it was running: migrated after the switch
+            prev->state = TASK_STATE_READY;
+            rq->migrate_task = prev;
+        }
     }
     
     // Get the next ready task
-    task_t* next_task = get_next_ready_task();
+    task_t* next = get_next_ready_task(rq);
+    
+    next->state = TASK_STATE_RUNNING;
+    next->cpu = cpu;
+    next->remaining_ticks = next->time_slice;
+    rq->current_task = next;
+    
+    rq_update_nr_running(rq);
+    
+    // If already running this task, do nothing
+    if (next == prev) {
+        arch_spin_unlock(&rq->lock);
+        activate_misplaced(misplaced);
+        local_irq_restore(flags);
+        preempt_enable_no_resched();
+        return;
+    }
+    
+    next->on_cpu = true;
+    rq->prev_task = prev;
+    rq->migrate_list = misplaced;
+    
+    trace_sched_switch(prev, next);
+    sched_stats_switch(rq, prev, next, preempted);
+    
+    // Switch to the new task's page directory if needed
+    if (next->page_dir && prev->page_dir != next->page_dir) {
+        switch_page_directory(next->page_dir);
+    }
+    
+    // Perform context switch
+    context_switch(&prev->context, next->context);
     
-    // Switch to the next task
-    switch_to_task(next_task);
+    // Running as prev again, possibly on another task's behalf
+    finish_task_switch();
+    local_irq_restore(flags);
 }
 
 /*
  * Main scheduling function - pick next task and switch to it
  */
 void schedule(void) {
-    enter_critical();
+    // If scheduler is not running yet, do nothing
+    if (!scheduler.scheduler_running) {
+        return;
+    }
     
-    // Check if we can actually schedule
-    if (!scheduler.scheduler_running || scheduler.in_critical_section) {
-        exit_critical();
+    // Sleeping with a spinlock held or inside an IRQ would deadlock
+    if (preempt_count() != 0) {
+        kernel_printf("BUG: scheduling while atomic (preempt_count 0x%x)\n", preempt_count());
         return;
     }
     
-    // Schedule the next task
-    schedule_next_task();
+    do {
+        __schedule(false);
+    } while (need_resched());
+}
+
+/*
+ * Preemption point: called by preempt_enable() when a reschedule is
+ * pending and preemption just became possible again
+ */
+void preempt_schedule(void) {
+    if (!scheduler.scheduler_running || !preemptible()) {
+        return;
+    }
     
-    exit_critical();
+    do {
+        __schedule(true);
+    } while (need_resched());
+}
+
+/*
+ * Preemption point on interrupt exit, called with interrupts disabled
+ * after the interrupt has been acknowledged
+ */
+void preempt_schedule_irq(void) {
+    if (!scheduler.scheduler_running || preempt_count() != 0) {
+        return;
+    }
+    
+    do {
+        __schedule(true);
+    } while (need_resched());
 }
 
 /*
@@ -551,23 +1177,39 @@ void yield(void) {
 static void yield_handler(cpu_context_t* context) {
     (void)context; // Unused parameter
     
-    // The handler simply calls schedule
-    schedule();
+    // Switch on the way out of the interrupt
+    set_need_resched();
+}
+
+/*
+ * Reschedule IPI handler - another CPU queued work for us
+ */
+static void reschedule_ipi_handler(cpu_context_t* context) {
+    (void)context; // Unused parameter
+    
+    tick_nohz_handle_kick();
+    
+    // Queue remotely woken tasks; this sets need_resched if one of them
+    // should preempt the current task
+    sched_wake_pending();
+    
+    // Explicit preemption requests set need_resched before the IPI
 }
 
 /*
  * Put the current task to sleep for the specified number of milliseconds
  */
 void sleep_task(uint64_t milliseconds) {
-    enter_critical();
-    
     // Get current task
-    task_t* task = scheduler.current_task;
-    if (!task || task == scheduler.idle_task_tcb) {
-        exit_critical();
+    runqueue_t* rq = this_rq();
+    task_t* task = rq->current_task;
+    if (!task || task == rq->idle_task_tcb) {
         return;
     }
     
+    uint64_t flags;
+    spin_lock_irqsave(&scheduler.lock, flags);
+    
     // Calculate wake tick
     // Assuming a 1000Hz timer (1ms per tick), otherwise scale accordingly
     uint64_t wake_tick = scheduler.tick_count + milliseconds;
@@ -575,166 +1217,655 @@ void sleep_task(uint64_t milliseconds) {
     
     // Update task state
     task->state = TASK_STATE_SLEEPING;
+    trace_sched_block(task, TRACE_BLOCK_SLEEP);
     
-    // Remove from any queue and add to sleeping queue
-    for (int i = 0; i < 5; i++) {
-        remove_task_from_queue(&scheduler.ready_queue[i], task);
-    }
-    add_task_to_queue(&scheduler.sleeping_queue, task);
-    scheduler.sleeping_count++;
+    // Add to the sleeping queue, the housekeeping CPU wakes it up
+    add_sleeping_task(task);
     
-    // Schedule another task
-    schedule_next_task();
+    // Interrupts stay off until the switch, so it is never preempted
+    // with its sleep half set up (see preempt_cancel_wait())
+    spin_unlock(&scheduler.lock);
     
-    exit_critical();
+    // Schedule another task
+    schedule();
+    local_irq_restore(flags);
 }
 
 /*
  * Wake up a sleeping task
  */
 void wake_task(pid_t pid) {
-    enter_critical();
+    uint64_t flags;
+    spin_lock_irqsave(&scheduler.lock, flags);
     
     // Find the task
     task_t* task = find_task_by_pid(pid);
-    if (!task || task->state != TASK_STATE_SLEEPING) {
-        exit_critical();
-        return;
+    if (task && task->state == TASK_STATE_SLEEPING) {
+        // Remove from sleeping queue
+        remove_task_from_queue(&scheduler.sleeping_queue, task);
+        scheduler.sleeping_count--;
+        
+        // Add to ready queue
+        activate_task(task);
+        trace_sched_wake(task);
     }
     
-    // Remove from sleeping queue
-    remove_task_from_queue(&scheduler.sleeping_queue, task);
-    scheduler.sleeping_count--;
-    
-    // Add to ready queue
-    add_task_to_ready_queue(task);
-    
-    exit_critical();
+    // Preempts right here if the woken task has a higher priority
+    spin_unlock_irqrestore(&scheduler.lock, flags);
 }
 
 /*
  * Block a task (waiting for an event)
  */
 void block_task(pid_t pid) {
-    enter_critical();
+    uint64_t flags;
+    spin_lock_irqsave(&scheduler.lock, flags);
     
     // Find the task
     task_t* task = find_task_by_pid(pid);
-    if (!task || task == scheduler.idle_task_tcb) {
-        exit_critical();
+    if (!task || (task->flags & TASK_FLAG_IDLE) ||
+        task->state == TASK_STATE_BLOCKED || task->state == TASK_STATE_TERMINATED) {
+        spin_unlock_irqrestore(&scheduler.lock, flags);
         return;
     }
     
-    // Update task state
+    // Take it off its ready queue if it was waiting to run
+    if (task->state == TASK_STATE_READY) {
+        dequeue_task_locked(task);
+    }
+    
+    // Update task state; blocked from outside, not a wait of its own
     task->state = TASK_STATE_BLOCKED;
+    task->waiting = false;
+    trace_sched_block(task, TRACE_BLOCK_WAIT);
     
-    // Remove from any queue and add to blocked queue
-    for (int i = 0; i < 5; i++) {
-        remove_task_from_queue(&scheduler.ready_queue[i], task);
-    }
+    // Add to blocked queue
     add_task_to_queue(&scheduler.blocked_queue, task);
     scheduler.blocked_count++;
     
-    // If blocking current task, schedule next task
-    if (scheduler.current_task == task) {
-        schedule_next_task();
+    bool is_current = (get_current_task() == task);
+    if (!is_current && task->on_cpu) {
+        // Running on another CPU: make it switch away
+        resched_cpu(task->cpu);
     }
     
-    exit_critical();
+    if (!is_current) {
+        spin_unlock_irqrestore(&scheduler.lock, flags);
+        return;
+    }
+    
+    // Blocking the current task: no preemption until it switches away,
+    // as in sleep_task()
+    spin_unlock(&scheduler.lock);
+    schedule();
+    local_irq_restore(flags);
 }
 
 /*
  * Unblock a task (resume after an event)
  */
 void unblock_task(pid_t pid) {
-    enter_critical();
+    uint64_t flags;
+    spin_lock_irqsave(&scheduler.lock, flags);
     
     // Find the task
     task_t* task = find_task_by_pid(pid);
-    if (!task || task->state != TASK_STATE_BLOCKED) {
-        exit_critical();
-        return;
+    if (task && task->state == TASK_STATE_BLOCKED) {
+        // Remove from blocked queue
+        remove_task_from_queue(&scheduler.blocked_queue, task);
+        scheduler.blocked_count--;
+        
+        // Add to ready queue
+        activate_task(task);
+        trace_sched_wake(task);
+    }
+    
+    // Preempts right here if the woken task has a higher priority
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+}
+
+/*
+ * Mark the current task blocked without switching away
+ *
+ * The caller then re-checks its wait condition and either calls
+ * schedule() or cancel_block(). A wakeup that arrives in between makes
+ * the task runnable again instead of being lost.
+ */
+void prepare_to_block(void) {
+    task_t* task = get_current_task();
+    uint64_t flags;
+    
+    spin_lock_irqsave(&scheduler.lock, flags);
+    task->state = TASK_STATE_BLOCKED;
+    task->waiting = true;
+    trace_sched_block(task, TRACE_BLOCK_WAIT);
+    add_task_to_queue(&scheduler.blocked_queue, task);
+    scheduler.blocked_count++;
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+}
+
+/*
+ * Undo prepare_to_block() when the wait condition is already met
+ */
+void cancel_block(void) {
+    task_t* task = get_current_task();
+    uint64_t flags;
+    
+    spin_lock_irqsave(&scheduler.lock, flags);
+    
+    if (task->state == TASK_STATE_BLOCKED) {
+        remove_task_from_queue(&scheduler.blocked_queue, task);
+        scheduler.blocked_count--;
+    } else if (task->state == TASK_STATE_READY) {
+        // Already woken and queued on our own run queue
+        dequeue_task_locked(task);
     }
+    task->state = TASK_STATE_RUNNING;
+    task->waiting = false;
+    
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+}
+
+/*
+ * Restrict a task to a set of CPUs
+ *
+ * Pinning a task to an isolated CPU is the only way to get it to run
+ * there. Returns 0 on success, -1 if the task does not exist or the mask
+ * contains no online CPU.
+ */
+int set_task_affinity(pid_t pid, cpumask_t mask) {
+    uint64_t flags;
+    spin_lock_irqsave(&scheduler.lock, flags);
     
-    // Remove from blocked queue
-    remove_task_from_queue(&scheduler.blocked_queue, task);
-    scheduler.blocked_count--;
+    task_t* task = find_task_by_pid(pid);
+    if (!task || (task->flags & TASK_FLAG_IDLE) ||
+        (mask & cpu_online_mask()) == CPU_MASK_NONE) {
+        spin_unlock_irqrestore(&scheduler.lock, flags);
+        return -1;
+    }
     
-    // Add to ready queue
-    add_task_to_ready_queue(task);
+    task->cpus_allowed = mask;
     
-    exit_critical();
+    if (!cpumask_test(mask, task->cpu)) {
+        if (task->state == TASK_STATE_READY && !task->on_cpu) {
+            // Move it to an allowed CPU right away
+            dequeue_task_locked(task);
+            activate_task(task);
+        } else if (task->on_cpu) {
+            // Migrated by __schedule() when it gets switched out
+            resched_cpu(task->cpu);
+        }
+    }
+    
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+    return 0;
 }
 
 /*
- * Check sleeping tasks and wake up any that have reached their wake time
+ * Change the priority of a task
+ *
+ * A queued task moves to the ready queue of its new priority; the CPU
+ * running the task reconsiders its choice. Returns 0 on success, -1 if
+ * the task does not exist or the priority is invalid.
  */
-static void check_sleeping_tasks(void) {
-    task_t* task = scheduler.sleeping_queue;
-    task_t* next;
+int set_task_priority(pid_t pid, task_priority_t priority) {
+    uint64_t flags;
     
-    while (task) {
-        next = task->next; // Save next pointer before potentially removing from queue
+    if (priority <= TASK_PRIORITY_IDLE || priority > TASK_PRIORITY_REALTIME) {
+        return -1;
+    }
+    
+    spin_lock_irqsave(&scheduler.lock, flags);
+    
+    task_t* task = find_task_by_pid(pid);
+    if (!task || (task->flags & TASK_FLAG_IDLE)) {
+        spin_unlock_irqrestore(&scheduler.lock, flags);
+        return -1;
+    }
+    
+    runqueue_t* rq = task_rq(task);
+    spin_lock(&rq->lock);
+    
+    if (task->state == TASK_STATE_READY && !task->wake_pending) {
+        // Requeue at the new priority
+        dequeue_task(task);
+        task->priority = priority;
+        enqueue_task(rq, task);
+        check_preempt_wakeup(rq, task);
+    } else {
+        // Tasks on a wake list are queued by the drain at the new priority
+        task->priority = priority;
+        if (task->state == TASK_STATE_RUNNING) {
+            resched_cpu(task->cpu);
+        }
+    }
+    
+    spin_unlock(&rq->lock);
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+    return 0;
+}
+
+/*
+ * Get the CPUs a task may run on
+ */
+cpumask_t get_task_affinity(pid_t pid) {
+    uint64_t flags;
+    cpumask_t mask = CPU_MASK_NONE;
+    
+    spin_lock_irqsave(&scheduler.lock, flags);
+    task_t* task = find_task_by_pid(pid);
+    if (task) {
+        mask = task->cpus_allowed;
+    }
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+    
+    return mask;
+}
+
+/*
+ * Get the scheduling statistics of a task
+ */
+int get_task_sched_info(pid_t pid, task_sched_info_t* info) {
+    uint64_t flags;
+    
+    spin_lock_irqsave(&scheduler.lock, flags);
+    task_t* task = find_task_by_pid(pid);
+    if (!task) {
+        spin_unlock_irqrestore(&scheduler.lock, flags);
+        return -1;
+    }
+    
+    runqueue_t* rq = &runqueues[task->cpu];
+    spin_lock(&rq->lock);
+    
+    task_sched_stats_t* stats = &task->sched_stats;
+    uint64_t now = rdtsc();
+    uint64_t run = stats->run_cycles;
+    uint64_t wait = stats->wait_cycles;
+    
+    // Include the run or wait in progress
+    if (task->state == TASK_STATE_RUNNING) {
+        run += now - stats->run_tsc;
+    } else if (task->state == TASK_STATE_READY && !task->on_cpu) {
+        wait += now - stats->ready_tsc;
+    }
+    
+    memset(info, 0, sizeof(*info));
+    info->pid = task->pid;
+    strncpy(info->name, task->name, sizeof(info->name) - 1);
+    info->state = task->state;
+    info->priority = task->priority;
+    info->cpu = task->cpu;
+    info->run_ns = tsc_to_ns(run);
+    info->wait_ns = tsc_to_ns(wait);
+    info->nr_voluntary = stats->nr_voluntary;
+    info->nr_involuntary = stats->nr_involuntary;
+    info->nr_wakeups = stats->nr_wakeups;
+    info->wake_latency_avg_ns = stats->nr_wakeups ?
+                                stats->wake_latency_sum / stats->nr_wakeups : 0;
+    info->wake_latency_max_ns = stats->wake_latency_max;
+    memcpy(info->wake_latency_hist, stats->wake_latency_hist, sizeof(info->wake_latency_hist));
+    
+    spin_unlock(&rq->lock);
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+    return 0;
+}
+
+/*
+ * Scheduler event count of a run queue's CPU since the last reset
+ */
+static uint64_t rq_counter(runqueue_t* rq, pcpu_counter_t id) {
+    int64_t count = __atomic_load_n(&get_cpu(rq_cpu(rq))->pcpu.counters[id], __ATOMIC_RELAXED);
+    return (uint64_t)(count - rq->counters_base[id - PCPU_SCHED_SWITCHES]);
+}
+
+/*
+ * Take the current scheduler event counts of a run queue's CPU as zero
+ */
+static void rq_counters_reset(runqueue_t* rq) {
+    for (uint32_t id = PCPU_SCHED_SWITCHES; id < PCPU_NR_COUNTERS; id++) {
+        rq->counters_base[id - PCPU_SCHED_SWITCHES] =
+            __atomic_load_n(&get_cpu(rq_cpu(rq))->pcpu.counters[id], __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Get the scheduling statistics of a CPU
+ */
+int get_cpu_sched_info(uint32_t cpu, cpu_sched_info_t* info) {
+    if (cpu >= MAX_CPUS || !cpumask_test(cpu_online_mask(), cpu)) {
+        return -1;
+    }
+    
+    runqueue_t* rq = &runqueues[cpu];
+    task_t* idle = rq->idle_task_tcb;
+    uint64_t flags;
+    
+    spin_lock_irqsave(&rq->lock, flags);
+    
+    uint64_t now = rdtsc();
+    uint64_t window = now - rq->stats_start;
+    uint64_t load = rq->load_sum + (uint64_t)rq->load_nr * (now - rq->load_tsc);
+    uint64_t idle_cycles = idle->sched_stats.run_cycles;
+    
+    if (rq->current_task == idle) {
+        idle_cycles += now - idle->sched_stats.run_tsc;
+    }
+    
+    info->window_ns = tsc_to_ns(window);
+    info->idle_ns = tsc_to_ns(idle_cycles);
+    info->nr_switches = rq_counter(rq, PCPU_SCHED_SWITCHES);
+    info->nr_wakeups = rq_counter(rq, PCPU_SCHED_WAKEUPS);
+    info->nr_remote_wakeups = rq_counter(rq, PCPU_SCHED_REMOTE_WAKEUPS);
+    info->nr_wake_ipis = rq_counter(rq, PCPU_SCHED_WAKE_IPIS);
+    info->avg_nr_running_x100 = window ? load * 100 / window : 0;
+    info->nr_running = rq_nr_running(rq);
+    
+    spin_unlock_irqrestore(&rq->lock, flags);
+    return 0;
+}
+
+/*
+ * Start a new statistics window
+ *
+ * A wait in progress is counted whole when the task gets a CPU.
+ */
+void reset_sched_stats(void) {
+    uint64_t flags;
+    
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpumask_test(cpu_online_mask(), cpu)) {
+            continue;
+        }
         
-        // Check if it's time to wake up the task
-        if (scheduler.tick_count >= task->wake_tick) {
-            // Remove from sleeping queue
-            remove_task_from_queue(&scheduler.sleeping_queue, task);
-            scheduler.sleeping_count--;
-            
-            // Add to ready queue
-            add_task_to_ready_queue(task);
+        runqueue_t* rq = &runqueues[cpu];
+        spin_lock_irqsave(&rq->lock, flags);
+        rq_counters_reset(rq);
+        rq->stats_start = rdtsc();
+        rq->load_sum = 0;
+        rq->load_tsc = rq->stats_start;
+        spin_unlock_irqrestore(&rq->lock, flags);
+    }
+    
+    spin_lock_irqsave(&scheduler.lock, flags);
+    
+    for (task_t* task = scheduler.task_list_head; task; task = task->all_next) {
+        runqueue_t* rq = &runqueues[task->cpu];
+        spin_lock(&rq->lock);
+        
+        task_sched_stats_t* stats = &task->sched_stats;
+        uint64_t ready_tsc = stats->ready_tsc;
+        bool woken = stats->woken;
+        
+        memset(stats, 0, sizeof(*stats));
+        stats->ready_tsc = ready_tsc;
+        stats->woken = woken;
+        stats->run_tsc = rdtsc();
+        
+        spin_unlock(&rq->lock);
+    }
+    
+    spin_unlock_irqrestore(&scheduler.lock, flags);
+}
+
+/*
+ * Upper bound of the wake-to-run latency below which a percentage of
+ * the wakeups fall
+ */
+static uint64_t sched_lat_percentile(const uint32_t* hist, uint64_t total, uint32_t pct) {
+    uint64_t target = (total * pct + 99) / 100;
+    uint64_t seen = 0;
+    
+    if (total == 0) {
+        return 0;
+    }
+    
+    for (uint32_t bucket = 0; bucket < SCHED_LAT_BUCKETS; bucket++) {
+        seen += hist[bucket];
+        if (seen >= target) {
+            return 1ULL << bucket;
+        }
+    }
+    return 1ULL << (SCHED_LAT_BUCKETS - 1);
+}
+
+typedef struct {
+    pid_t pids[SCHED_DUMP_MAX_TASKS];
+    uint32_t count;
+} sched_dump_pids_t;
+
+/*
+ * Collect the PID of a task for dump_sched_stats()
+ */
+static void sched_dump_collect(task_t* task, void* arg) {
+    sched_dump_pids_t* list = (sched_dump_pids_t*)arg;
+    if (list->count < SCHED_DUMP_MAX_TASKS) {
+        list->pids[list->count++] = task->pid;
+    }
+}
+
+/*
+ * Print per-CPU and per-task scheduling statistics
+ */
+void dump_sched_stats(void) {
+    cpu_sched_info_t cpu_info;
+    
+    kernel_printf("Scheduler statistics:\n");
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (get_cpu_sched_info(cpu, &cpu_info) != 0) {
+            continue;
+        }
+        
+        uint64_t idle_pct = cpu_info.window_ns ? cpu_info.idle_ns * 100 / cpu_info.window_ns : 0;
+        kernel_printf("  CPU %u: %llu switches, avg nr_running %llu.%02llu, "
+                      "%u running now, idle %llu%%\n",
+                      cpu, cpu_info.nr_switches,
+                      cpu_info.avg_nr_running_x100 / 100, cpu_info.avg_nr_running_x100 % 100,
+                      cpu_info.nr_running, idle_pct);
+        kernel_printf("         %llu wakeups, %llu from other CPUs, %llu wake IPIs sent\n",
+                      cpu_info.nr_wakeups, cpu_info.nr_remote_wakeups, cpu_info.nr_wake_ipis);
+    }
+    
+    // Query each task outside the lock for_each_task() holds
+    sched_dump_pids_t list = { .count = 0 };
+    task_sched_info_t info;
+    
+    for_each_task(sched_dump_collect, &list);
+    
+    kernel_printf("  %-5s %-16s %4s %12s %12s %8s %8s %8s  %s\n",
+                  "PID", "NAME", "CPU", "RUN ms", "WAIT ms", "VOL", "INVOL", "WAKEUPS",
+                  "WAKE LATENCY avg/p50/p99/max ns");
+    for (uint32_t i = 0; i < list.count; i++) {
+        if (get_task_sched_info(list.pids[i], &info) != 0) {
+            continue;
         }
         
-        task = next;
+        kernel_printf("  %-5d %-16s %4u %8llu.%03llu %8llu.%03llu %8llu %8llu %8llu  "
+                      "%llu/%llu/%llu/%llu\n",
+                      info.pid, info.name, info.cpu,
+                      info.run_ns / 1000000, info.run_ns / 1000 % 1000,
+                      info.wait_ns / 1000000, info.wait_ns / 1000 % 1000,
+                      info.nr_voluntary, info.nr_involuntary, info.nr_wakeups,
+                      info.wake_latency_avg_ns,
+                      sched_lat_percentile(info.wake_latency_hist, info.nr_wakeups, 50),
+                      sched_lat_percentile(info.wake_latency_hist, info.nr_wakeups, 99),
+                      info.wake_latency_max_ns);
     }
 }
 
 /*
- * Timer tick handler - called on each timer interrupt
+ * Check sleeping tasks and wake up any that have reached their wake time
+ * (scheduler.lock held)
+ *
+ * The queue is sorted by wake tick, so only expired tasks are visited.
  */
-static void timer_tick_handler(cpu_context_t* context) {
-    (void)context; // Unused parameter
+static void check_sleeping_tasks(void) {
+    task_t* task;
+    
+    while ((task = scheduler.sleeping_queue) != NULL &&
+           scheduler.tick_count >= task->wake_tick) {
+        // Remove from sleeping queue
+        remove_task_from_queue(&scheduler.sleeping_queue, task);
+        scheduler.sleeping_count--;
+        
+        // Add to ready queue
+        activate_task(task);
+        trace_sched_wake(task);
+    }
+}
+
+/*
+ * Scheduler part of the tick
+ *
+ * Runs with interrupts disabled. It never switches tasks itself: an
+ * expired time slice or a woken higher priority task sets need_resched
+ * and the switch happens on interrupt exit. Anything slow belongs in
+ * (delayed) work, not here.
+ */
+static void scheduler_tick(void) {
+    cpu_t* cpu = this_cpu();
+    runqueue_t* rq = this_rq();
     
-    // Increment tick count
-    scheduler.tick_count++;
+    cpu->ticks++;
     
-    // Check sleeping tasks
-    if (scheduler.sleeping_count > 0) {
-        check_sleeping_tasks();
+    // Global timekeeping and wakeups run on one housekeeping CPU only,
+    // isolated CPUs never pay for them
+    if (cpu->id == tick_do_timer_cpu()) {
+        spin_lock(&scheduler.lock);
+        
+        // Increment tick count
+        scheduler.tick_count++;
+        
+        // Check sleeping tasks
+        if (scheduler.sleeping_count > 0) {
+            check_sleeping_tasks();
+        }
+        
+        spin_unlock(&scheduler.lock);
     }
     
+    // Hand expired delayed work to this CPU's worker
+    workqueue_tick();
+    
     // If preemption is not enabled, just return
     if (!scheduler.preemption_enabled) {
         return;
     }
     
+    // Catch wakeups whose IPI could not be delivered
+    sched_wake_pending();
+    
+    spin_lock(&rq->lock);
+    
     // Decrease time slice counter for current task
-    if (scheduler.current_task && 
-        scheduler.current_task != scheduler.idle_task_tcb &&
-        scheduler.current_task->state == TASK_STATE_RUNNING) {
+    task_t* current = rq->current_task;
+    if (current && 
+        current != rq->idle_task_tcb &&
+        current->state == TASK_STATE_RUNNING) {
         
-        scheduler.current_task->total_ticks++;
+        current->total_ticks++;
         
-        if (scheduler.current_task->remaining_ticks > 0) {
-            scheduler.current_task->remaining_ticks--;
+        if (current->remaining_ticks > 0) {
+            current->remaining_ticks--;
         }
         
-        // If time slice expired, schedule next task
-        if (scheduler.current_task->remaining_ticks == 0) {
-            schedule();
+        // If time slice expired, let the next task run
+        if (current->remaining_ticks == 0) {
+            if (rq->ready_count > 0) {
+                set_need_resched();
+            } else {
+                current->remaining_ticks = current->time_slice;
+            }
         }
     }
+    
+    // Stop the tick if this nohz_full CPU is down to a single task
+    rq_update_nr_running(rq);
+    
+    spin_unlock(&rq->lock);
+}
+
+/*
+ * Timer tick handler - called on each timer interrupt
+ */
+static void timer_tick_handler(cpu_context_t* context) {
+    uint64_t start = rdtsc();
+    
+    profile_timer_tick(context);
+    scheduler_tick();
+    
+    tick_account_handler(start, rdtsc() - start);
 }
 
 /*
  * Idle task function - runs when no other tasks are ready
+ *
+ * Preemption stays disabled while idling; the loop itself switches away
+ * once need_resched is set, by an interrupt or by a remote store.
  */
 static void idle_task_function(void) {
+    preempt_disable();
+    
     while (1) {
-        // Halt the CPU until next interrupt (save power)
-        __asm__ volatile("hlt");
+        while (!need_resched()) {
+            cpu_idle();
+        }
+        
+        preempt_enable_no_resched();
+        schedule();
+        preempt_disable();
+    }
+}
+
+/*
+ * Set up the run queue and idle task of a CPU
+ *
+ * Called for the boot CPU by init_scheduler() and for every other CPU
+ * while it is being brought online.
+ */
+void init_scheduler_cpu(uint32_t cpu) {
+    runqueue_t* rq = &runqueues[cpu];
+    
+    memset(rq, 0, sizeof(runqueue_t));
+    spin_lock_init(&rq->lock);
+    rq->stats_start = rdtsc();
+    rq->load_tsc = rq->stats_start;
+    
+    // Create the idle task, pinned to this CPU
+    task_t* idle = create_task("idle", idle_task_function, 
+                               TASK_PRIORITY_IDLE, TASK_FLAG_KERNEL | TASK_FLAG_IDLE);
+    if (!idle) {
+        kernel_panic("Failed to create idle task for CPU %u!", cpu);
+        return;
+    }
+    
+    idle->cpu = cpu;
+    idle->cpus_allowed = cpumask_of(cpu);
+    rq->idle_task_tcb = idle;
+}
+
+/*
+ * Start running tasks on this CPU, beginning with its idle task
+ */
+static void start_scheduler_cpu(void) {
+    runqueue_t* rq = this_rq();
+    task_t* idle = rq->idle_task_tcb;
+    
+    // Same state __schedule() leaves behind: lock held, interrupts off
+    cli();
+    spin_lock(&rq->lock);
+    
+    idle->state = TASK_STATE_RUNNING;
+    idle->on_cpu = true;
+    idle->sched_stats.run_tsc = rdtsc();
+    rq->current_task = idle;
+    rq->prev_task = NULL;
+    
+    if (idle->page_dir) {
+        switch_page_directory(idle->page_dir);
     }
+    
+    context_load(idle->context);
 }
 
 /*
@@ -743,34 +1874,53 @@ static void idle_task_function(void) {
 void init_scheduler(void) {
     // Zero out scheduler state
     memset(&scheduler, 0, sizeof(scheduler));
+    memset(runqueues, 0, sizeof(runqueues));
+    spin_lock_init(&scheduler.lock);
     
     // Initialize PID assignment
     scheduler.next_pid = PID_KERNEL + 1; // Start at 2 (kernel is 1)
     
-    // Create the idle task
-    scheduler.idle_task_tcb = create_task("idle", idle_task_function, 
-                                          TASK_PRIORITY_IDLE, TASK_FLAG_KERNEL | TASK_FLAG_IDLE);
-    
-    if (!scheduler.idle_task_tcb) {
-        kernel_panic("Failed to create idle task!");
-        return;
-    }
+    // Create the boot CPU's run queue and idle task
+    init_scheduler_cpu(smp_processor_id());
     
     // Register interrupt handlers
     register_irq_handler(IRQ_TIMER, timer_tick_handler);
     register_isr_handler(INT_VECTOR_YIELD, yield_handler);
+    register_isr_handler(INT_VECTOR_RESCHEDULE, reschedule_ipi_handler);
     
+    kernel_printf("Scheduler initialized successfully\n");
+}
+
+/*
+ * Start scheduling on the boot CPU - does not return
+ *
+ * Tasks created between init_scheduler() and here are already queued and
+ * run as soon as the idle task notices need_resched.
+ */
+void start_scheduler(void) {
     // Enable timer IRQ
     enable_irq(IRQ_TIMER);
     
-    // Mark scheduler as running
-    scheduler.scheduler_running = true;
-    
     // Enable preemption
     scheduler.preemption_enabled = true;
     
-    kernel_printf("Scheduler initialized successfully\n");
+    // Mark scheduler as running; this also releases the waiting APs
+    __atomic_store_n(&scheduler.scheduler_running, true, __ATOMIC_RELEASE);
     
     // Start the idle task
-    switch_to_task(scheduler.idle_task_tcb);
+    start_scheduler_cpu();
+}
+
+/*
+ * Start scheduling on an application processor - does not return
+ *
+ * The AP waits for the boot CPU to start the scheduler, so everything
+ * initialization creates is in place before it runs a task.
+ */
+void start_scheduler_ap(void) {
+    while (!__atomic_load_n(&scheduler.scheduler_running, __ATOMIC_ACQUIRE)) {
+        cpu_relax();
+    }
+    
+    start_scheduler_cpu();
 }
@@ -0,0 +1,1342 @@
+/*
+ * EdgeX OS - Boot Tests and Benchmarks
+ *
+ * This file contains the tests, benchmarks and boot reports that run as
+ * kernel tasks. Each is compiled in with its CONFIG_ flag only; see
+ * include/edgex/selftest.h.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/interrupt.h>
+#include <edgex/scheduler.h>
+#include <edgex/cpu.h>
+#include <edgex/tick.h>
+#include <edgex/tsc.h>
+#include <edgex/workqueue.h>
+#include <edgex/softirq.h>
+#include <edgex/apic.h>
+#include <edgex/virtio_net.h>
+#include <edgex/virtio_blk.h>
+#include <edgex/net.h>
+#include <edgex/udp.h>
+#include <edgex/bcache.h>
+#include <edgex/tlog.h>
+#include <edgex/klog.h>
+#include <edgex/uart.h>
+#include <edgex/trace.h>
+#include <edgex/profile.h>
+#include <edgex/ipc.h>
+#include <edgex/ipc/common.h>
+#include <edgex/kmemprof.h>
+#include <edgex/selftest.h>
+
+#ifdef CONFIG_NOHZ_JITTER_TEST
+/*
+ * Jitter test - pin to the first isolated CPU and measure interference
+ * seen by a polling loop (boot with e.g. "isolcpus=1 nohz_full=1")
+ *
+ * The boot CPU is never isolated, so without isolcpus= or with no AP
+ * online the test says so rather than measure a housekeeping CPU.
+ */
+static void jitter_test_task(void) {
+    uint32_t target = MAX_CPUS;
+    
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpu_is_isolated(cpu) && cpumask_test(cpu_online_mask(), cpu)) {
+            target = cpu;
+            break;
+        }
+    }
+    
+    if (target == MAX_CPUS) {
+        kernel_printf("Jitter test: no isolated CPU online (%u CPUs up)\n", num_online_cpus());
+        return;
+    }
+    
+    if (set_task_affinity(get_current_pid(), cpumask_of(target)) != 0) {
+        kernel_printf("Jitter test: cannot pin to CPU %u\n", target);
+        return;
+    }
+    
+    while (1) {
+        tick_nohz_jitter_probe(1000);
+        sleep_task(1000);
+    }
+}
+#endif
+
+#ifdef CONFIG_IRQ_LATENCY_TEST
+/* CMOS RTC, used as a steady interrupt source */
+#define RTC_INDEX_PORT     0x70
+#define RTC_DATA_PORT      0x71
+#define RTC_NMI_DISABLE    0x80
+#define RTC_REG_A          0x0A
+#define RTC_REG_B          0x0B
+#define RTC_REG_C          0x0C
+#define RTC_RATE_64HZ      0x0A    /* 32768 >> (rate - 1) */
+#define RTC_PERIODIC_IRQ   0x40    /* Register B: periodic interrupt enable */
+
+/* Work done per RTC interrupt by the deliberately slow handler */
+#define SLOW_HANDLER_NS    3000000
+
+/*
+ * Read an RTC register
+ */
+static uint8_t rtc_read(uint8_t reg) {
+    outb(RTC_INDEX_PORT, RTC_NMI_DISABLE | reg);
+    return inb(RTC_DATA_PORT);
+}
+
+/*
+ * Write an RTC register
+ */
+static void rtc_write(uint8_t reg, uint8_t value) {
+    outb(RTC_INDEX_PORT, RTC_NMI_DISABLE | reg);
+    outb(RTC_DATA_PORT, value);
+}
+
+/*
+ * Burn SLOW_HANDLER_NS worth of CPU, standing in for a slow driver
+ */
+static void slow_handler_work(void) {
+    uint64_t end = rdtsc() + ns_to_tsc(SLOW_HANDLER_NS);
+    while (rdtsc() < end) {
+        cpu_relax();
+    }
+}
+
+/*
+ * RTC primary handler - acknowledge the interrupt
+ *
+ * With CONFIG_IRQ_LATENCY_TEST_INLINE the slow work runs right here, the
+ * way an unthreaded handler would, for comparison.
+ */
+static irqreturn_t rtc_slow_primary(uint8_t irq, void* dev_data) {
+    (void)irq;
+    (void)dev_data;
+    
+    // Reading register C acknowledges the RTC
+    rtc_read(RTC_REG_C);
+    
+#ifdef CONFIG_IRQ_LATENCY_TEST_INLINE
+    slow_handler_work();
+    return IRQ_HANDLED;
+#else
+    return IRQ_WAKE_THREAD;
+#endif
+}
+
+/*
+ * RTC thread handler - the slow part, preemptible
+ */
+static void rtc_slow_thread(uint8_t irq, void* dev_data) {
+    (void)irq;
+    (void)dev_data;
+    
+    slow_handler_work();
+}
+
+/*
+ * Interrupt latency test - run a slow RTC handler at 64 Hz and report
+ * how late the timer tick gets (boot with CONFIG_IRQ_LATENCY_TEST, and
+ * once more with CONFIG_IRQ_LATENCY_TEST_INLINE to compare)
+ */
+static void irq_latency_test_task(void) {
+    uint64_t flags = local_irq_save();
+    rtc_write(RTC_REG_A, (rtc_read(RTC_REG_A) & 0xF0) | RTC_RATE_64HZ);
+    rtc_write(RTC_REG_B, rtc_read(RTC_REG_B) | RTC_PERIODIC_IRQ);
+    rtc_read(RTC_REG_C);
+    local_irq_restore(flags);
+    
+    if (request_threaded_irq(IRQ_RTC, rtc_slow_primary, rtc_slow_thread,
+                             TASK_PRIORITY_LOW, "rtc-slow", NULL) != 0) {
+        kernel_printf("IRQ latency test: cannot request IRQ %u\n", IRQ_RTC);
+        return;
+    }
+    
+    while (1) {
+        sleep_task(5000);
+        dump_irq_stats();
+        dump_softirq_stats();
+        dump_tick_stats();
+        dump_sched_stats();
+    }
+}
+#endif
+
+#ifdef CONFIG_IRQ_THREAD_STRESS
+/* Rounds fired, and how long the thread may fall behind before we fail */
+#define IRQ_STRESS_ROUNDS        5000
+#define IRQ_STRESS_STALL_MS      500
+
+/* Longest the thread handler works, so the tick lands at varying points */
+#define IRQ_STRESS_MAX_WORK_NS   1500000
+
+/*
+ * A software interrupt line: firing it sends the IRQ's vector to its
+ * CPU as a self-IPI. Like a level-triggered line, a fire while masked
+ * stays latched and is delivered on unmask.
+ */
+static volatile bool irq_stress_masked;
+static volatile bool irq_stress_latched;
+static volatile uint8_t irq_stress_vector;
+static volatile uint32_t irq_stress_apic_id;
+
+/* Fires so far, and the fire count the thread handler last caught up to */
+static volatile uint64_t irq_stress_fired;
+static volatile uint64_t irq_stress_seen;
+static volatile uint64_t irq_stress_primary;
+static uint64_t irq_stress_rand = 0x9E3779B97F4A7C15ULL;
+
+static void irq_stress_mask(uint8_t irq) {
+    (void)irq;
+    irq_stress_masked = true;
+}
+
+static void irq_stress_unmask(uint8_t irq) {
+    (void)irq;
+    irq_stress_masked = false;
+    if (irq_stress_latched) {
+        irq_stress_latched = false;
+        lapic_send_ipi(irq_stress_apic_id, irq_stress_vector);
+    }
+}
+
+static void irq_stress_eoi(uint8_t irq) {
+    (void)irq;
+    lapic_eoi();
+}
+
+static int irq_stress_set_route(uint8_t irq, uint8_t vector, uint32_t apic_id) {
+    (void)irq;
+    irq_stress_vector = vector;
+    irq_stress_apic_id = apic_id;
+    return 0;
+}
+
+static irq_chip_t irq_stress_chip = {
+    .name = "stress",
+    .mask = irq_stress_mask,
+    .unmask = irq_stress_unmask,
+    .eoi = irq_stress_eoi,
+    .set_route = irq_stress_set_route,
+};
+
+/*
+ * Raise the line (task context)
+ */
+static void irq_stress_fire(void) {
+    uint64_t flags = local_irq_save();
+    irq_stress_fired++;
+    if (irq_stress_masked) {
+        irq_stress_latched = true;
+    } else {
+        lapic_send_ipi(irq_stress_apic_id, irq_stress_vector);
+    }
+    local_irq_restore(flags);
+}
+
+static irqreturn_t irq_stress_primary_handler(uint8_t irq, void* dev_data) {
+    (void)irq;
+    (void)dev_data;
+    irq_stress_primary++;
+    return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Thread handler: note what has been fired, then work a random while
+ */
+static void irq_stress_thread(uint8_t irq, void* dev_data) {
+    (void)irq;
+    (void)dev_data;
+    
+    __atomic_store_n(&irq_stress_seen, __atomic_load_n(&irq_stress_fired, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+    
+    irq_stress_rand ^= irq_stress_rand << 13;
+    irq_stress_rand ^= irq_stress_rand >> 7;
+    irq_stress_rand ^= irq_stress_rand << 17;
+    uint64_t end = rdtsc() + ns_to_tsc(irq_stress_rand % IRQ_STRESS_MAX_WORK_NS);
+    while (rdtsc() < end) {
+        cpu_relax();
+    }
+}
+
+/*
+ * Report the state of the line and stop
+ */
+static void irq_stress_fail(uint8_t irq, uint64_t round, const char* why) {
+    irq_stats_t stats;
+    get_irq_stats(irq, &stats);
+    kernel_panic("IRQ thread stress: IRQ %u %s in round %llu: fired %llu, handled up to %llu, "
+                 "line %s%s, %llu interrupts, %llu thread runs",
+                 irq, why, round, irq_stress_fired, irq_stress_seen,
+                 irq_stress_masked ? "masked" : "unmasked",
+                 irq_stress_latched ? " (latched)" : "",
+                 stats.count, stats.thread_runs);
+}
+
+/*
+ * Fail if the thread stopped catching up with the fires
+ */
+static void irq_stress_check(uint8_t irq, uint64_t round, uint64_t* last_seen, uint64_t* last_progress) {
+    uint64_t seen = __atomic_load_n(&irq_stress_seen, __ATOMIC_ACQUIRE);
+    uint64_t now = get_tick_count();
+    
+    if (seen == irq_stress_fired || seen != *last_seen) {
+        *last_seen = seen;
+        *last_progress = now;
+    } else if (now - *last_progress >= IRQ_STRESS_STALL_MS) {
+        irq_stress_fail(irq, round, "lost");
+    }
+}
+
+/*
+ * Threaded IRQ stress - fire a threaded IRQ while its thread is busy or
+ * on its way to block, and panic if an interrupt is ever left unhandled
+ * or the line stays masked
+ *
+ * The IRQ thread runs below this task, so each tick that ends our sleep
+ * preempts it at an arbitrary point: in its handler, or between
+ * prepare_to_block() and schedule(), where a lost wakeup used to leave
+ * the line masked for good.
+ */
+static void irq_thread_stress_task(void) {
+    if (irq_pic_mode()) {
+        kernel_printf("IRQ thread stress: needs the local APIC\n");
+        return;
+    }
+    
+    int irq = irq_alloc(&irq_stress_chip, 0, NULL);
+    if (irq < 0 || irq_set_affinity((uint8_t)irq, cpumask_of(smp_processor_id())) != 0) {
+        kernel_printf("IRQ thread stress: cannot allocate an IRQ\n");
+        return;
+    }
+    if (request_threaded_irq((uint8_t)irq, irq_stress_primary_handler, irq_stress_thread,
+                             TASK_PRIORITY_NORMAL, "irq-stress", NULL) != 0) {
+        kernel_printf("IRQ thread stress: cannot request IRQ %d\n", irq);
+        irq_release((uint8_t)irq);
+        return;
+    }
+    
+    uint64_t last_seen = 0, last_progress = get_tick_count();
+    uint64_t start = get_tick_count();
+    
+    for (uint64_t round = 1; round <= IRQ_STRESS_ROUNDS; round++) {
+        irq_stress_fire();
+        
+        // Fire a second time now and then: it has to coalesce
+        if ((round & 7) == 0) {
+            irq_stress_fire();
+        }
+        sleep_task(1);
+        irq_stress_check((uint8_t)irq, round, &last_seen, &last_progress);
+    }
+    
+    // Everything fired must get handled, with the line unmasked again
+    uint64_t deadline = get_tick_count() + IRQ_STRESS_STALL_MS;
+    while (irq_stress_seen != irq_stress_fired || irq_stress_masked || irq_stress_latched) {
+        if (get_tick_count() >= deadline) {
+            irq_stress_fail((uint8_t)irq, IRQ_STRESS_ROUNDS, "did not settle");
+        }
+        sleep_task(1);
+    }
+    
+    irq_stats_t stats;
+    get_irq_stats((uint8_t)irq, &stats);
+    kernel_printf("IRQ thread stress: PASS, %llu fires, %llu interrupts, %llu thread runs in %llu ms\n",
+                  irq_stress_fired, irq_stress_primary, stats.thread_runs,
+                  get_tick_count() - start);
+    
+    free_irq((uint8_t)irq);
+    irq_release((uint8_t)irq);
+}
+#endif
+
+#ifdef CONFIG_VIRTIO_NET_TEST
+/* Addresses of QEMU's user-mode network */
+#define NET_TEST_GUEST_IP    0x0A00020F   /* 10.0.2.15 */
+#define NET_TEST_GATEWAY_IP  0x0A000202   /* 10.0.2.2 */
+#define NET_TEST_BATCH       8
+#define ARP_FRAME_LEN        42
+
+static volatile uint64_t net_test_arp_replies;
+
+/*
+ * Count ARP replies; every buffer goes straight back to the driver
+ */
+static bool net_test_rx(virtio_net_t* net, uint16_t queue, uint32_t buf,
+                        void* data, uint32_t len, void* ctx) {
+    (void)net;
+    (void)queue;
+    (void)buf;
+    (void)ctx;
+    
+    uint8_t* frame = (uint8_t*)data;
+    if (len >= ARP_FRAME_LEN && frame[12] == 0x08 && frame[13] == 0x06 &&
+        frame[20] == 0x00 && frame[21] == 0x02) {
+        net_test_arp_replies++;
+    }
+    return false;
+}
+
+/*
+ * Store a big-endian 32-bit value
+ */
+static void put_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/*
+ * Build an ARP who-has request for the gateway
+ */
+static void build_arp_request(uint8_t* frame, const uint8_t* mac) {
+    static const uint8_t arp_hdr[8] = { 0x00, 0x01, 0x08, 0x00, 6, 4, 0x00, 0x01 };
+    
+    memset(frame, 0xFF, 6);
+    memcpy(frame + 6, mac, 6);
+    frame[12] = 0x08;
+    frame[13] = 0x06;
+    memcpy(frame + 14, arp_hdr, sizeof(arp_hdr));
+    memcpy(frame + 22, mac, 6);
+    put_be32(frame + 28, NET_TEST_GUEST_IP);
+    memset(frame + 32, 0, 6);
+    put_be32(frame + 38, NET_TEST_GATEWAY_IP);
+}
+
+/*
+ * Network test - send batches of ARP requests to the QEMU gateway (one
+ * doorbell per batch) and count the replies (run with make run-net)
+ */
+static void virtio_net_test_task(void) {
+    virtio_net_t* net = virtio_net_get(0);
+    if (!net) {
+        kernel_printf("Net test: no virtio-net device\n");
+        return;
+    }
+    
+    uint8_t* page = (uint8_t*)alloc_page();
+    if (!page) {
+        kernel_printf("Net test: out of memory\n");
+        return;
+    }
+    build_arp_request(page, net->mac);
+    virtio_net_set_handlers(net, net_test_rx, NULL, NULL);
+    
+    while (1) {
+        virtio_net_tx_t pkt = {
+            .phys = (uint64_t)page,   // Identity-mapped below 1GB
+            .len = ARP_FRAME_LEN,
+        };
+        for (int i = 0; i < NET_TEST_BATCH; i++) {
+            virtio_net_xmit(net, 0, &pkt, i < NET_TEST_BATCH - 1);
+        }
+        
+        sleep_task(5000);
+        kernel_printf("Net test: %llu ARP replies\n", net_test_arp_replies);
+        dump_virtio_net_stats(net);
+        dump_napi_stats(&net->queues[0].napi, "virtio-net rx0");
+    }
+}
+#endif
+
+#ifdef CONFIG_VIRTIO_BLK_TEST
+#define BLK_TEST_MAX_DEPTH   32
+#define BLK_TEST_IO_SECTORS  8      /* 4KB */
+#define BLK_TEST_RUN_MS      2000
+#define BLK_TEST_BUCKETS     32     /* Latency histogram, power-of-two ns buckets */
+
+static blk_request_t blk_test_reqs[BLK_TEST_MAX_DEPTH];
+static virtio_blk_cq_t blk_test_cq;
+
+/*
+ * Pick the next sector: random 4KB-aligned, or the next 4KB block
+ */
+static uint64_t blk_test_next_sector(virtio_blk_t* blk, bool sequential, uint64_t* state) {
+    uint64_t blocks = blk->capacity / BLK_TEST_IO_SECTORS;
+    
+    if (sequential) {
+        *state = (*state + 1) % blocks;
+        return *state * BLK_TEST_IO_SECTORS;
+    }
+    
+    // xorshift64
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (*state % blocks) * BLK_TEST_IO_SECTORS;
+}
+
+/*
+ * Latency below which the given percent of requests completed
+ */
+static uint64_t blk_test_percentile(const uint64_t* hist, uint64_t total, uint32_t percent) {
+    uint64_t target = (total * percent + 99) / 100;
+    uint64_t seen = 0;
+    
+    for (uint32_t i = 0; i < BLK_TEST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= target) {
+            return 1ULL << (i + 1);
+        }
+    }
+    return 1ULL << BLK_TEST_BUCKETS;
+}
+
+/*
+ * Keep depth requests in flight for BLK_TEST_RUN_MS and report IOPS and
+ * latency (batches of depth are submitted with one doorbell)
+ */
+static void blk_test_run(virtio_blk_t* blk, const char* name, uint32_t op,
+                         uint32_t depth, bool sequential) {
+    uint64_t hist[BLK_TEST_BUCKETS] = { 0 };
+    blk_request_t* done[BLK_TEST_MAX_DEPTH];
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    uint64_t completed = 0, errors = 0, total_ns = 0, max_ns = 0;
+    uint32_t inflight = 0;
+    
+    uint64_t start = rdtsc();
+    uint64_t end = start + ns_to_tsc((uint64_t)BLK_TEST_RUN_MS * 1000000);
+    
+    for (uint32_t i = 0; i < depth; i++) {
+        blk_request_t* req = &blk_test_reqs[i];
+        req->op = op;
+        req->sector = blk_test_next_sector(blk, sequential, &state);
+        req->nr_sectors = BLK_TEST_IO_SECTORS;
+        if (virtio_blk_submit(blk, req, i + 1 < depth) == 0) {
+            inflight++;
+        }
+    }
+    virtio_blk_unplug(blk);
+    
+    while (inflight > 0) {
+        uint32_t n = virtio_blk_cq_wait(&blk_test_cq, done, BLK_TEST_MAX_DEPTH);
+        bool resubmit = rdtsc() < end;
+        inflight -= n;
+        
+        for (uint32_t i = 0; i < n; i++) {
+            blk_request_t* req = done[i];
+            uint64_t ns = tsc_to_ns(req->complete_tsc - req->submit_tsc);
+            uint32_t bucket = 0;
+            while (bucket < BLK_TEST_BUCKETS - 1 && (ns >> (bucket + 1)) != 0) {
+                bucket++;
+            }
+            hist[bucket]++;
+            total_ns += ns;
+            max_ns = ns > max_ns ? ns : max_ns;
+            completed++;
+            errors += req->status < 0;
+            
+            if (resubmit) {
+                req->sector = blk_test_next_sector(blk, sequential, &state);
+                if (virtio_blk_submit(blk, req, i + 1 < n) == 0) {
+                    inflight++;
+                }
+            }
+        }
+        virtio_blk_unplug(blk);
+    }
+    
+    uint64_t elapsed_us = tsc_to_ns(rdtsc() - start) / 1000;
+    if (completed == 0 || elapsed_us == 0) {
+        kernel_printf("Block test %s: no requests completed\n", name);
+        return;
+    }
+    
+    kernel_printf("Block test %s QD%u: %llu IOPS, avg %llu us, p50 < %llu us, "
+                  "p99 < %llu us, max %llu us, %llu errors\n",
+                  name, depth, completed * 1000000 / elapsed_us, total_ns / completed / 1000,
+                  blk_test_percentile(hist, completed, 50) / 1000,
+                  blk_test_percentile(hist, completed, 99) / 1000, max_ns / 1000, errors);
+}
+
+/*
+ * Block test - measure 4KB IOPS and latency against the disk image
+ * (run with make run-blk; it overwrites the image)
+ */
+static void virtio_blk_test_task(void) {
+    virtio_blk_t* blk = virtio_blk_get(0);
+    if (!blk) {
+        kernel_printf("Block test: no virtio-blk device\n");
+        return;
+    }
+    
+    if (blk->capacity < BLK_TEST_IO_SECTORS || virtio_blk_cq_init(&blk_test_cq, BLK_TEST_MAX_DEPTH) < 0) {
+        kernel_printf("Block test: cannot set up\n");
+        return;
+    }
+    for (uint32_t i = 0; i < BLK_TEST_MAX_DEPTH; i++) {
+        blk_test_reqs[i].phys = (uint64_t)alloc_page();   // Identity-mapped below 1GB
+        blk_test_reqs[i].cq = &blk_test_cq;
+        if (!blk_test_reqs[i].phys) {
+            kernel_printf("Block test: out of memory\n");
+            return;
+        }
+    }
+    
+    // Sequential writes merge into large device requests
+    blk_test_run(blk, "seq write", BLK_OP_WRITE, BLK_TEST_MAX_DEPTH, true);
+    blk_test_run(blk, "rand read", BLK_OP_READ, 1, false);
+    blk_test_run(blk, "rand read", BLK_OP_READ, BLK_TEST_MAX_DEPTH, false);
+    
+    // Compare against an interrupt per completion
+    virtio_blk_set_coalesce(blk, 1);
+    blk_test_run(blk, "rand read (no coalescing)", BLK_OP_READ, BLK_TEST_MAX_DEPTH, false);
+    virtio_blk_set_coalesce(blk, VIRTIO_BLK_COALESCE_DEFAULT);
+    
+    dump_virtio_blk_stats(blk);
+}
+#endif
+
+#ifdef CONFIG_BCACHE_TEST
+#define BCACHE_TEST_BLOCKS    768     /* 3MB: fits in the default cache */
+#define BCACHE_TEST_SPAN      4096    /* Random reads within the first 16MB */
+#define BCACHE_TEST_WRITES    2048    /* 8MB: twice the cache */
+
+static uint64_t bcache_test_blocks[BCACHE_TEST_BLOCKS];
+
+/*
+ * Read a list of blocks through the cache and report the rate
+ */
+static void bcache_test_read(bcache_t* cache, const char* name, const uint64_t* blocks,
+                             uint32_t count) {
+    uint64_t start = rdtsc();
+    uint64_t sum = 0;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        bcache_buf_t* buf = bcache_read(cache, blocks[i]);
+        if (!buf) {
+            kernel_printf("Cache test: read error at block %llu\n", blocks[i]);
+            return;
+        }
+        sum += buf->data[0];
+        bcache_release(buf);
+    }
+    
+    uint64_t ns = tsc_to_ns(rdtsc() - start);
+    if (ns == 0) {
+        ns = 1;
+    }
+    kernel_printf("Cache test: %-16s %u blocks, %llu us/block, %llu MB/s (sum %llu)\n", name,
+                  count, ns / 1000 / count,
+                  (uint64_t)count * BCACHE_BLOCK_SIZE * 1000 / ns, sum);
+}
+
+/*
+ * Buffer cache test - write-back batching, then cold and warm reads,
+ * sequential and random (run with make run-blk; it overwrites the image)
+ */
+static void bcache_test_task(void) {
+    virtio_blk_t* blk = virtio_blk_get(0);
+    bcache_t* cache = blk ? bcache_create(blk, 0) : NULL;
+    if (!cache || cache->nr_blocks < BCACHE_TEST_WRITES) {
+        kernel_printf("Cache test: no virtio-blk device or too small\n");
+        return;
+    }
+    
+    // Twice the cache's worth of writes forces write-back while writing
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < BCACHE_TEST_WRITES; i++) {
+        bcache_buf_t* buf = bcache_get(cache, i);
+        memset(buf->data, (int)(i & 0xFF), BCACHE_BLOCK_SIZE);
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+    }
+    int ret = bcache_sync(cache);
+    kernel_printf("Cache test: wrote %u blocks in %llu us (sync %s), %llu write-back batches\n",
+                  BCACHE_TEST_WRITES, tsc_to_ns(rdtsc() - start) / 1000, ret == 0 ? "ok" : "failed",
+                  cache->stats.flushes);
+    dump_virtio_blk_stats(blk);
+    
+    // Sequential: the cold pass is carried by readahead
+    for (uint32_t i = 0; i < BCACHE_TEST_BLOCKS; i++) {
+        bcache_test_blocks[i] = i;
+    }
+    bcache_invalidate(cache);
+    bcache_test_read(cache, "seq cold", bcache_test_blocks, BCACHE_TEST_BLOCKS);
+    bcache_test_read(cache, "seq warm", bcache_test_blocks, BCACHE_TEST_BLOCKS);
+    
+    // Random: no readahead, every cold read waits for the device
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = 0; i < BCACHE_TEST_BLOCKS; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        bcache_test_blocks[i] = state % BCACHE_TEST_SPAN;
+    }
+    bcache_invalidate(cache);
+    bcache_test_read(cache, "random cold", bcache_test_blocks, BCACHE_TEST_BLOCKS);
+    bcache_test_read(cache, "random warm", bcache_test_blocks, BCACHE_TEST_BLOCKS);
+    
+    dump_bcache_stats(cache);
+}
+#endif
+
+#ifdef CONFIG_TLOG_BENCH
+#define TLOG_BENCH_START      16384   /* Blocks: the log lives at 64MB.. */
+#define TLOG_BENCH_BLOCKS     (1 + 32 * TLOG_SEG_BLOCKS)
+#define TLOG_BENCH_WRITERS    4
+#define TLOG_BENCH_MS         3000
+#define TLOG_BENCH_RECORD     64
+
+static tlog_t* tlog_bench_log;
+static tlog_ring_t* tlog_bench_rings[TLOG_BENCH_WRITERS];
+static volatile uint32_t tlog_bench_next;
+static volatile bool tlog_bench_stop;
+static volatile uint32_t tlog_bench_running;
+static volatile uint64_t tlog_bench_done;
+static volatile uint64_t tlog_bench_acked;
+
+/*
+ * Sample payload: key and seq in the first bytes
+ */
+static void tlog_bench_fill(uint8_t* data, uint64_t key, uint64_t n) {
+    memset(data, (int)(n & 0xFF), TLOG_BENCH_RECORD);
+    memcpy(data, &key, sizeof(key));
+    memcpy(data + 8, &n, sizeof(n));
+}
+
+/*
+ * Writer: synchronous appends, directly for even writers and through a
+ * shared ring for odd ones
+ */
+static void tlog_bench_writer(void) {
+    uint32_t id = __atomic_fetch_add(&tlog_bench_next, 1, __ATOMIC_SEQ_CST);
+    uint64_t key = 0x5E45000000ULL + id;
+    uint8_t data[TLOG_BENCH_RECORD];
+    tlog_ring_t* ring = tlog_bench_rings[id];
+
+    for (uint64_t n = 0; !tlog_bench_stop; n++) {
+        tlog_bench_fill(data, key, n);
+        if (ring) {
+            uint64_t entry = tlog_ring_put(ring, key, data, sizeof(data), true);
+            if (entry) {
+                tlog_ring_wait(ring, entry);
+            }
+        } else {
+            uint64_t seq = tlog_append(tlog_bench_log, key, data, sizeof(data));
+            if (seq == 0 || tlog_commit(tlog_bench_log, seq) < 0) {
+                break;
+            }
+            // Highest seq acknowledged as durable before the crash
+            uint64_t acked = tlog_bench_acked;
+            while (seq > acked &&
+                   !__atomic_compare_exchange_n(&tlog_bench_acked, &acked, seq, false,
+                                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            }
+        }
+        __atomic_fetch_add(&tlog_bench_done, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_sub(&tlog_bench_running, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Telemetry log benchmark (run with make run-blk): sustained synchronous
+ * appends from concurrent writers, then a reset with appends in flight.
+ * QEMU reboots the kernel, which reports the recovery instead.
+ */
+static void tlog_bench_task(void) {
+    virtio_blk_t* blk = virtio_blk_get(0);
+    tlog_t* log = blk ? tlog_open(blk, TLOG_BENCH_START, TLOG_BENCH_BLOCKS, false) : NULL;
+    if (!log) {
+        kernel_printf("Log bench: no virtio-blk device or too small\n");
+        return;
+    }
+    
+    // Second boot: check what survived the crash
+    if (log->stats.recovered_records > 0) {
+        uint8_t data[TLOG_BENCH_RECORD];
+        uint64_t seq;
+        kernel_printf("Log bench: recovered %llu records up to seq %llu in %llu us\n",
+                      log->stats.recovered_records, log->durable_seq, log->stats.recovery_us);
+        for (uint32_t id = 0; id < TLOG_BENCH_WRITERS; id++) {
+            if (tlog_latest(log, 0x5E45000000ULL + id, data, sizeof(data), &seq) > 0) {
+                uint64_t n;
+                memcpy(&n, data + 8, sizeof(n));
+                kernel_printf("Log bench: writer %u latest record #%llu (seq %llu)\n", id, n, seq);
+            }
+        }
+        return;
+    }
+    
+    tlog_bench_log = log;
+    for (uint32_t id = 1; id < TLOG_BENCH_WRITERS; id += 2) {
+        tlog_bench_rings[id] = tlog_ring_create(log);
+    }
+    
+    uint64_t start = rdtsc();
+    tlog_bench_running = TLOG_BENCH_WRITERS;
+    for (uint32_t id = 0; id < TLOG_BENCH_WRITERS; id++) {
+        create_kernel_task("tlogwriter", tlog_bench_writer, TASK_PRIORITY_NORMAL);
+    }
+    sleep_task(TLOG_BENCH_MS);
+    tlog_bench_stop = true;
+    while (tlog_bench_running) {
+        sleep_task(1);
+    }
+    uint64_t done = tlog_bench_done;
+    uint64_t commits = log->stats.commits;
+    uint64_t ns = tsc_to_ns(rdtsc() - start);
+    
+    kernel_printf("Log bench: %u writers, %llu durable appends/s, %llu commits "
+                  "(%llu appends per flush)\n",
+                  TLOG_BENCH_WRITERS, done * 1000000000ULL / (ns ? ns : 1), commits,
+                  commits ? done / commits : 0);
+    dump_tlog_stats(log);
+    
+    // Crash with unsynced appends in the batch and a commit in flight
+    uint8_t data[TLOG_BENCH_RECORD];
+    for (uint64_t n = 0; n < 1000; n++) {
+        tlog_bench_fill(data, 0x5E45FF0000ULL, n);
+        tlog_append(log, 0x5E45FF0000ULL, data, sizeof(data));
+    }
+    kernel_printf("Log bench: resetting with seq %llu acknowledged durable\n", tlog_bench_acked);
+    outb(0x64, 0xFE);
+}
+#endif
+
+#ifdef CONFIG_IPC_SCALE_BENCH
+#define IPC_SCALE_BENCH_MS    500
+
+static mutex_t ipc_scale_mutexes[MAX_CPUS];
+static uint32_t ipc_scale_cpus[MAX_CPUS];
+static volatile uint32_t ipc_scale_next;
+static volatile uint32_t ipc_scale_ready;
+static volatile uint32_t ipc_scale_running;
+static volatile bool ipc_scale_go;
+static volatile bool ipc_scale_stop;
+static volatile bool ipc_scale_shared;
+static volatile uint64_t ipc_scale_ops;
+
+/* Stand-in for the old global ipc_stats: one line every CPU writes */
+static volatile uint64_t ipc_scale_shared_count __attribute__((aligned(64)));
+
+/*
+ * Worker: lock and unlock a mutex of its own on its own CPU, so the only
+ * data CPUs could share is the statistics
+ */
+static void ipc_scale_worker(void) {
+    uint32_t id = __atomic_fetch_add(&ipc_scale_next, 1, __ATOMIC_SEQ_CST);
+    uint32_t cpu = ipc_scale_cpus[id];
+    mutex_t mutex = ipc_scale_mutexes[id];
+    uint64_t ops;
+    
+    set_task_affinity(get_current_pid(), cpumask_of(cpu));
+    while (smp_processor_id() != cpu) {
+        yield();
+    }
+    
+    __atomic_fetch_add(&ipc_scale_ready, 1, __ATOMIC_SEQ_CST);
+    while (!ipc_scale_go) {
+        cpu_relax();
+    }
+    
+    for (ops = 0; !ipc_scale_stop; ops++) {
+        mutex_lock(mutex);
+        if (ipc_scale_shared) {
+            __atomic_fetch_add(&ipc_scale_shared_count, 1, __ATOMIC_RELAXED);
+        }
+        mutex_unlock(mutex);
+        if (ipc_scale_shared) {
+            __atomic_fetch_add(&ipc_scale_shared_count, 1, __ATOMIC_RELAXED);
+        }
+    }
+    
+    __atomic_fetch_add(&ipc_scale_ops, ops, __ATOMIC_SEQ_CST);
+    __atomic_fetch_sub(&ipc_scale_running, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * One run with a worker on each of the first n CPUs; returns the
+ * lock/unlock pairs done
+ */
+static uint64_t ipc_scale_run(uint32_t n, bool shared) {
+    ipc_scale_next = 0;
+    ipc_scale_ready = 0;
+    ipc_scale_ops = 0;
+    ipc_scale_go = false;
+    ipc_scale_stop = false;
+    ipc_scale_shared = shared;
+    ipc_scale_running = n;
+    
+    // Lower priority than this task, so it gets its CPU back on time
+    for (uint32_t i = 0; i < n; i++) {
+        create_kernel_task("ipcworker", ipc_scale_worker, TASK_PRIORITY_LOW);
+    }
+    while (ipc_scale_ready < n) {
+        sleep_task(1);
+    }
+    
+    uint64_t start = rdtsc();
+    ipc_scale_go = true;
+    sleep_task(IPC_SCALE_BENCH_MS);
+    ipc_scale_stop = true;
+    while (ipc_scale_running) {
+        sleep_task(1);
+    }
+    uint64_t ns = tsc_to_ns(rdtsc() - start);
+    uint64_t ops = ipc_scale_ops;
+    
+    kernel_printf("IPC scale: %2u CPUs, %-15s %10llu ops/s, %5llu ns per lock+unlock per CPU\n",
+                  n, shared ? "shared counter" : "per-CPU only",
+                  ops * 1000000000ULL / (ns ? ns : 1), ops ? ns * n / ops : 0);
+    return ops;
+}
+
+/*
+ * IPC statistics scaling benchmark: uncontended mutex lock/unlock on 1..N
+ * CPUs. With per-CPU counters the time per operation stays flat as CPUs
+ * are added; the shared counter runs show what one global line costs.
+ * It needs the application processors up (at least two CPUs online);
+ * otherwise only the counter check runs and nothing is reported as a
+ * scaling result.
+ */
+static void ipc_scale_bench_task(void) {
+    cpumask_t online = cpu_online_mask();
+    uint32_t ncpus = 0;
+    uint32_t cpu;
+    uint64_t total = 0;
+    ipc_stats_t before, after;
+    
+    for_each_cpu(cpu, online) {
+        ipc_scale_cpus[ncpus] = cpu;
+        ipc_scale_mutexes[ncpus] = create_mutex("ipcscale");
+        if (!ipc_scale_mutexes[ncpus]) {
+            kernel_printf("IPC scale: cannot create mutexes\n");
+            return;
+        }
+        ncpus++;
+    }
+    
+    get_ipc_stats(&before);
+    if (ncpus < 2) {
+        kernel_printf("IPC scale: only %u CPU online, scaling not measured; "
+                      "checking the counters only\n", ncpus);
+        total += ipc_scale_run(1, false);
+    } else {
+        for (uint32_t n = 1; n <= ncpus; n++) {
+            total += ipc_scale_run(n, false);
+        }
+        for (uint32_t n = 1; n <= ncpus; n++) {
+            total += ipc_scale_run(n, true);
+        }
+    }
+    get_ipc_stats(&after);
+    
+    // Other tasks lock mutexes too, so the counters can only be ahead
+    uint64_t counted = after.mutex_operations - before.mutex_operations;
+    kernel_printf("IPC scale: %llu mutex operations counted, %llu done by the benchmark\n",
+                  counted, total * 2);
+    if (counted < total * 2) {
+        kernel_panic("IPC scale: per-CPU counters lost %llu of %llu mutex operations",
+                     total * 2 - counted, total * 2);
+    }
+}
+#endif
+
+#ifdef CONFIG_KLOG_BENCH
+#define KLOG_BENCH_CALLS      10000
+
+/*
+ * Kernel log benchmark: cost of LOG_INFO to the caller, with klogd
+ * draining behind it
+ */
+static void klog_bench_task(void) {
+    klog_stats_t before, after;
+    
+    // Let klogd start and the boot messages drain
+    sleep_task(100);
+    
+    for (int policy = KLOG_OVERWRITE; policy <= KLOG_DROP; policy++) {
+        klog_set_policy((klog_policy_t)policy);
+        klog_get_stats(&before);
+        
+        uint64_t start = rdtsc();
+        for (uint32_t i = 0; i < KLOG_BENCH_CALLS; i++) {
+            LOG_INFO("klog bench: message %u of %u, value 0x%08x", i, KLOG_BENCH_CALLS, i * 2654435761U);
+        }
+        uint64_t ns = tsc_to_ns(rdtsc() - start);
+        
+        klog_get_stats(&after);
+        sleep_task(500);
+        kernel_printf("Log bench (%s): %llu ns per LOG_INFO, %llu dropped, %llu overwritten\n",
+                      policy == KLOG_DROP ? "drop" : "overwrite", ns / KLOG_BENCH_CALLS,
+                      after.dropped - before.dropped, after.overwritten - before.overwritten);
+    }
+    
+    klog_set_policy(KLOG_OVERWRITE);
+    dump_klog_stats();
+}
+#endif
+
+#ifdef CONFIG_UART_BENCH
+#define UART_BENCH_MS         2000
+#define UART_BENCH_FRAME      1024
+
+typedef struct {
+    uint32_t baud;
+    uint64_t bytes;
+    uint64_t ns;
+    uart_stats_t stats;          /* Counts during the run */
+} uart_bench_result_t;
+
+/*
+ * Stream frames for UART_BENCH_MS and measure the rate the line took them at
+ */
+static void uart_bench_run(uart_t* uart, uint32_t baud, uart_bench_result_t* result) {
+    uint8_t data[UART_BENCH_FRAME];
+    uart_stats_t before, after;
+    
+    for (uint32_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)i;
+    }
+    result->baud = baud;
+    if (uart_set_baud(uart, baud) != 0) {
+        return;
+    }
+    uart_get_stats(uart, &before);
+    
+    uint64_t start = rdtsc();
+    uint64_t end = start + ns_to_tsc(UART_BENCH_MS * 1000000ULL);
+    while (rdtsc() < end) {
+        uart_write_frame(uart, UART_FRAME_BENCH, data, sizeof(data));
+    }
+    uart_drain(uart);
+    result->ns = tsc_to_ns(rdtsc() - start);
+    
+    uart_get_stats(uart, &after);
+    result->bytes = after.tx_bytes - before.tx_bytes;
+    result->stats.fifo_fills = after.fifo_fills - before.fifo_fills;
+    result->stats.tx_irqs = after.tx_irqs - before.tx_irqs;
+    result->stats.polled_bytes = after.polled_bytes - before.polled_bytes;
+}
+
+/*
+ * Serial output benchmark (run with make run-serial): binary frames on
+ * COM2 if there is one, else on COM1 in binary mode. QEMU sends as fast
+ * as the host takes the bytes whatever the divisor says, so there both
+ * runs show its unthrottled rate; real hardware shows the line rate.
+ */
+static void uart_bench_task(void) {
+    uart_bench_result_t results[2];
+    uart_t* uart = uart_get(1);
+    bool console = false;
+    
+    if (!uart) {
+        uart = uart_get(0);
+        console = true;
+    }
+    if (!uart) {
+        kernel_printf("UART bench: no serial port\n");
+        return;
+    }
+    
+    // Let the boot messages drain first
+    sleep_task(500);
+    if (console) {
+        uart_drain(uart);
+        uart_set_binary(uart, true);
+    }
+    
+    memset(results, 0, sizeof(results));
+    uart_bench_run(uart, 115200, &results[0]);
+    uart_bench_run(uart, 9600, &results[1]);
+    uart_set_baud(uart, UART_DEFAULT_BAUD);
+    
+    if (console) {
+        uart_set_binary(uart, false);
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        uart_bench_result_t* r = &results[i];
+        kernel_printf("UART bench: %u baud: %llu bytes/s (line rate %u), %llu bytes per FIFO fill, "
+                      "%llu irqs, %llu polled\n",
+                      r->baud, r->bytes * 1000000000ULL / (r->ns ? r->ns : 1), r->baud / 10,
+                      r->stats.fifo_fills ? r->bytes / r->stats.fifo_fills : 0,
+                      r->stats.tx_irqs, r->stats.polled_bytes);
+    }
+    dump_uart_stats();
+}
+#endif
+
+#ifdef CONFIG_TRACE
+#define TRACE_BOOT_MS         2000
+
+/*
+ * Send the trace of the first TRACE_BOOT_MS of scheduling out of COM2,
+ * or COM1 in binary mode (run with make run-trace)
+ */
+static void trace_boot_task(void) {
+    uart_t* uart = uart_get(1);
+    bool console = false;
+    
+    if (!uart) {
+        uart = uart_get(0);
+        console = true;
+    }
+    
+    sleep_task(TRACE_BOOT_MS);
+    trace_stop();
+    if (!uart) {
+        kernel_printf("trace: no serial port for the dump\n");
+        return;
+    }
+    
+    if (console) {
+        uart_drain(uart);
+        uart_set_binary(uart, true);
+    }
+    uint64_t records = trace_dump(uart);
+    if (console) {
+        uart_set_binary(uart, false);
+    }
+    kernel_printf("trace: sent %llu records to ttyS%u\n", records, console ? 0 : 1);
+}
+#endif
+
+#ifdef CONFIG_PROFILE
+#define PROFILE_BOOT_MS       3000
+
+/*
+ * Report the profile of the first PROFILE_BOOT_MS of scheduling: the
+ * folded stacks out of COM2, or COM1 in binary mode, then the flat
+ * profile to the log (run with make run-profile)
+ */
+static void profile_boot_task(void) {
+    uart_t* uart = uart_get(1);
+    bool console = false;
+    
+    if (!uart) {
+        uart = uart_get(0);
+        console = true;
+    }
+    
+    sleep_task(PROFILE_BOOT_MS);
+    if (profile_collect() == 0) {
+        return;
+    }
+    
+    if (uart) {
+        if (console) {
+            uart_drain(uart);
+            uart_set_binary(uart, true);
+        }
+        profile_write_folded(uart);
+        if (console) {
+            uart_set_binary(uart, false);
+        }
+        kernel_printf("profile: folded stacks sent to ttyS%u\n", console ? 0 : 1);
+    }
+    profile_print_flat();
+}
+#endif
+
+#ifdef CONFIG_KMEM_PROFILE
+#define KMEMPROF_BOOT_MS      5000
+#define KMEMPROF_BOOT_SITES   20
+
+/*
+ * Report the heap allocations of boot and the first KMEMPROF_BOOT_MS of
+ * scheduling to the log, then keep profiling
+ */
+static void kmemprof_boot_task(void) {
+    sleep_task(KMEMPROF_BOOT_MS);
+    kmemprof_report(KMEMPROF_BOOT_SITES);
+}
+#endif
+
+#ifdef CONFIG_UDP_BENCH
+#define UDP_BENCH_PORT       9000
+#define UDP_BENCH_BATCH      32
+#define UDP_BENCH_PAYLOAD    1024
+#define UDP_BENCH_SECONDS    10
+
+/*
+ * Print one second's worth of traffic
+ */
+static void udp_bench_report(const char* what, uint64_t packets, uint64_t bytes, uint64_t ms) {
+    if (ms == 0) {
+        ms = 1;
+    }
+    kernel_printf("UDP bench: %s %llu pps, %llu Mbit/s\n", what,
+                  packets * 1000 / ms, bytes * 8 / 1000 / ms);
+}
+
+/*
+ * Sender: batches of datagrams from transmit slots, one doorbell each
+ */
+static void udp_bench_send(udp_socket_t* sock, const net_addr_t* peer) {
+    uint32_t slots[UDP_BENCH_BATCH];
+    udp_desc_t descs[UDP_BENCH_BATCH];
+    uint64_t seq = 0, packets = 0, total = 0;
+    uint64_t start = get_tick_count(), last = start;
+    
+    while (get_tick_count() - start < UDP_BENCH_SECONDS * 1000) {
+        uint32_t n = udp_alloc_tx(sock, slots, UDP_BENCH_BATCH);
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t* payload = (uint8_t*)udp_tx_data(sock, slots[i]);
+            memcpy(payload, &seq, sizeof(seq));
+            seq++;
+            
+            descs[i].buf = slots[i];
+            descs[i].len = UDP_BENCH_PAYLOAD;
+            descs[i].port = UDP_BENCH_PORT;
+            descs[i].peer = *peer;
+        }
+        
+        uint32_t sent = udp_send(sock, descs, n);
+        if (sent < n) {
+            // Not sent: the sequence numbers are reused next time
+            udp_free_tx(sock, slots + sent, n - sent);
+            seq -= n - sent;
+        }
+        packets += sent;
+        
+        // Out of slots or waiting for the receiver's address
+        if (sent == 0) {
+            sleep_task(1);
+        }
+        
+        uint64_t now = get_tick_count();
+        if (now - last >= 1000) {
+            udp_bench_report("tx", packets, packets * UDP_BENCH_PAYLOAD, now - last);
+            total += packets;
+            packets = 0;
+            last = now;
+        }
+    }
+    
+    kernel_printf("UDP bench: sent %llu datagrams\n", total + packets);
+}
+
+/*
+ * Receiver: count datagrams and sequence gaps
+ */
+static void udp_bench_receive(udp_socket_t* sock) {
+    udp_desc_t descs[UDP_BENCH_BATCH * 2];
+    uint64_t expected = 0, lost = 0, packets = 0, bytes = 0;
+    uint64_t last = get_tick_count();
+    
+    while (1) {
+        uint32_t n = udp_wait(sock, descs, UDP_BENCH_BATCH * 2);
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t seq;
+            memcpy(&seq, udp_rx_data(sock, &descs[i]), sizeof(seq));
+            if (seq > expected) {
+                lost += seq - expected;
+            }
+            expected = seq + 1;
+            bytes += descs[i].len;
+        }
+        udp_release(sock, descs, n);
+        packets += n;
+        
+        uint64_t now = get_tick_count();
+        if (now - last >= 1000) {
+            udp_bench_report("rx", packets, bytes, now - last);
+            kernel_printf("UDP bench: %llu lost so far\n", lost);
+            packets = 0;
+            bytes = 0;
+            last = now;
+        }
+    }
+}
+
+/*
+ * UDP benchmark between two instances (run with make run-udp-bench):
+ * host 1 sends to host 2 for UDP_BENCH_SECONDS, host 2 counts. Build
+ * with CONFIG_UDP_BENCH_IPV6 to go over IPv6.
+ */
+static void udp_bench_task(void) {
+    const uint8_t* mac = net_mac();
+    udp_socket_t* sock = udp_open(UDP_BENCH_PORT);
+    if (!mac || !sock) {
+        kernel_printf("UDP bench: no network or port in use\n");
+        return;
+    }
+    
+    if (mac[5] != 1) {
+        udp_bench_receive(sock);
+        return;
+    }
+    
+#ifdef CONFIG_UDP_BENCH_IPV6
+    static const uint8_t receiver[16] = { 0xFD, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2 };
+    net_addr_t peer = net_addr_ipv6(receiver);
+#else
+    net_addr_t peer = net_addr_ipv4(10, 0, 0, 2);
+#endif
+    
+    // Give the receiver time to boot
+    sleep_task(2000);
+    udp_bench_send(sock, &peer);
+    
+    dump_udp_sockets();
+    dump_net_stats();
+    dump_virtio_net_stats(net_device());
+}
+#endif
+
+/*
+ * Create the tasks of the configured tests and benchmarks
+ */
+void start_selftests(void) {
+#ifdef CONFIG_NOHZ_JITTER_TEST
+    create_kernel_task("jitter", jitter_test_task, TASK_PRIORITY_REALTIME);
+#endif
+    
+#ifdef CONFIG_IRQ_LATENCY_TEST
+    create_kernel_task("irqlat", irq_latency_test_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_IRQ_THREAD_STRESS
+    create_kernel_task("irqstress", irq_thread_stress_task, TASK_PRIORITY_HIGH);
+#endif
+    
+#ifdef CONFIG_VIRTIO_NET_TEST
+    create_kernel_task("nettest", virtio_net_test_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_VIRTIO_BLK_TEST
+    create_kernel_task("blktest", virtio_blk_test_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_UDP_BENCH
+    create_kernel_task("udpbench", udp_bench_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_BCACHE_TEST
+    create_kernel_task("bcachetest", bcache_test_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_TLOG_BENCH
+    create_kernel_task("tlogbench", tlog_bench_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_KLOG_BENCH
+    create_kernel_task("klogbench", klog_bench_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_UART_BENCH
+    create_kernel_task("uartbench", uart_bench_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_IPC_SCALE_BENCH
+    create_kernel_task("ipcscale", ipc_scale_bench_task, TASK_PRIORITY_NORMAL);
+#endif
+    
+#ifdef CONFIG_TRACE
+    create_kernel_task("tracedump", trace_boot_task, TASK_PRIORITY_LOW);
+#endif
+    
+#ifdef CONFIG_PROFILE
+    create_kernel_task("profile", profile_boot_task, TASK_PRIORITY_LOW);
+#endif
+    
+#ifdef CONFIG_KMEM_PROFILE
+    create_kernel_task("kmemprof", kmemprof_boot_task, TASK_PRIORITY_LOW);
+#endif
+}
@@ -10,6 +10,7 @@
 #include <edgex/scheduler.h>
 #include <edgex/ipc.h>
 #include <edgex/vm.h>
+#include <edgex/percpu.h>
 
 /* Maximum number of shared memory regions in the system */
 #define MAX_SHARED_MEMORY_REGIONS 64
@@ -139,6 +140,7 @@ shared_memory_t create_shared_memory(const char* name, size_t size, uint32_t per
     shm->creation_time = get_tick_count();
     
     shm_count++;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_CREATED, 1, PCPU_IPC_SHARED_MEMORY, 1);
     
     // Automatically map into the creator's address space
     void* mapped_addr = map_shared_memory(shm, NULL, permissions);
@@ -188,6 +190,7 @@ static void destroy_shared_memory(void* shm_ptr) {
     memset(shm, 0, sizeof(struct shared_memory));
     
     shm_count--;
+    this_cpu_counters_add2(PCPU_IPC_OBJECTS_DESTROYED, 1, PCPU_IPC_SHARED_MEMORY, -1);
 }
 
 /*
@@ -214,6 +217,8 @@ void* map_shared_memory(shared_memory_t shm, void* addr, uint32_t permissions) {
         return NULL;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_SHARED_MEMORY_OPS);
+    
     pid_t pid = get_current_pid();
     
     // Lock the shared memory
@@ -269,6 +274,8 @@ int unmap_shared_memory(shared_memory_t shm) {
         return -1;
     }
     
+    this_cpu_counter_inc(PCPU_IPC_SHARED_MEMORY_OPS);
+    
     pid_t pid = get_current_pid();
     
     // Lock the shared memory
@@ -612,6 +619,30 @@ shared_memory_t find_shared_memory(const char* name) {
     return NULL;
 }
 
+/*
+ * Get the size of a shared memory region
+ */
+size_t shared_memory_size(shared_memory_t shm) {
+    if (!shm || shm->header.type != IPC_TYPE_SHARED_MEMORY) {
+        return 0;
+    }
+    return shm->size;
+}
+
+/*
+ * Get the physical address behind a byte offset of a region
+ *
+ * Lets drivers point device DMA straight at shared memory, so data
+ * lands in the consuming task's pages without a copy. Returns 0 if the
+ * offset is out of range.
+ */
+uint64_t shared_memory_phys(shared_memory_t shm, size_t offset) {
+    if (!shm || shm->header.type != IPC_TYPE_SHARED_MEMORY || offset >= shm->size) {
+        return 0;
+    }
+    return (uint64_t)shm->pages[offset / PAGE_SIZE] + (offset % PAGE_SIZE);
+}
+
 /*
  * Initialize the shared memory system
  */
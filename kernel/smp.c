@@ -0,0 +1,148 @@
+/*
+ * EdgeX OS - Application Processor Startup
+ *
+ * This file starts the CPUs the MADT enumerated besides the boot CPU,
+ * one at a time. Each is sent INIT and two STARTUP IPIs pointing at the
+ * trampoline (boot/trampoline.S), copied to a page below 1MB. The
+ * trampoline takes the AP to long mode on the kernel page tables and
+ * calls ap_start() on a stack of its own, which finishes the per-CPU
+ * setup and parks the AP until the boot CPU starts the scheduler.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/interrupt.h>
+#include <edgex/scheduler.h>
+#include <edgex/cpu.h>
+#include <edgex/apic.h>
+#include <edgex/tick.h>
+#include <edgex/tsc.h>
+#include <edgex/smp.h>
+
+/* Stack an AP runs on until it switches to its idle task */
+#define SMP_AP_STACK_SIZE     16384
+
+/* INIT-SIPI-SIPI timing (Intel MP specification) */
+#define SMP_INIT_DELAY_US     10000
+#define SMP_STARTUP_DELAY_US  200
+
+/* How long an AP gets to report in */
+#define SMP_BOOT_TIMEOUT_MS   100
+
+/* Trampoline image in the kernel, and its parameter block */
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_params[];
+extern uint8_t smp_trampoline_end[];
+
+typedef struct {
+    uint64_t cr3;               /* Kernel PML4, below 4GB */
+    uint64_t stack;             /* Initial stack pointer */
+    uint64_t cpu;               /* cpu_t of the AP */
+    uint64_t entry;             /* ap_start() */
+} __attribute__((packed)) smp_trampoline_params_t;
+
+/* Set by each AP once it is fully set up */
+static cpu_t* volatile smp_booted_cpu = NULL;
+
+/*
+ * Busy-wait on the TSC
+ */
+static void smp_delay_us(uint64_t us) {
+    uint64_t end = rdtsc() + ns_to_tsc(us * 1000);
+    while (rdtsc() < end) {
+        cpu_relax();
+    }
+}
+
+/*
+ * C entry point of an AP, called by the trampoline with interrupts off
+ */
+static void ap_start(cpu_t* cpu) {
+    // Same IDT as the boot CPU, then the GS base: everything after this
+    // reaches per-CPU state through it
+    init_interrupts_ap();
+    cpu_init_local(cpu);
+
+    lapic_init_local();
+    tick_register_device(cpu->id, lapic_timer_device(cpu->id));
+
+    // Done with the trampoline and its parameters
+    __atomic_store_n(&smp_booted_cpu, cpu, __ATOMIC_RELEASE);
+
+    start_scheduler_ap();
+}
+
+/*
+ * Start one AP and wait for it to report in
+ */
+static bool smp_boot_cpu(cpu_t* cpu, smp_trampoline_params_t* params) {
+    uint8_t* stack = kmalloc(SMP_AP_STACK_SIZE);
+    if (!stack) {
+        return false;
+    }
+
+    // Its run queue must exist before it comes online
+    init_scheduler_cpu(cpu->id);
+
+    params->stack = ((uint64_t)(stack + SMP_AP_STACK_SIZE)) & ~15ULL;
+    params->cpu = (uint64_t)cpu;
+    __atomic_store_n(&smp_booted_cpu, NULL, __ATOMIC_SEQ_CST);
+
+    lapic_send_init(cpu->apic_id);
+    smp_delay_us(SMP_INIT_DELAY_US);
+
+    // A second STARTUP is ignored by a CPU the first one started
+    for (int i = 0; i < 2; i++) {
+        lapic_send_startup(cpu->apic_id, SMP_TRAMPOLINE_BASE);
+        smp_delay_us(SMP_STARTUP_DELAY_US);
+    }
+
+    uint64_t deadline = rdtsc() + ns_to_tsc(SMP_BOOT_TIMEOUT_MS * 1000000ULL);
+    while (__atomic_load_n(&smp_booted_cpu, __ATOMIC_ACQUIRE) != cpu) {
+        if (rdtsc() > deadline) {
+            return false;
+        }
+        cpu_relax();
+    }
+    return true;
+}
+
+/*
+ * Start every enumerated application processor
+ */
+uint32_t smp_boot_cpus(void) {
+    uint64_t size = (uint64_t)(smp_trampoline_end - smp_trampoline_start);
+    uint32_t started = 0;
+    uint64_t cr3;
+
+    if (!apic_available()) {
+        kernel_printf("SMP: no local APIC, running on the boot CPU only\n");
+        return 0;
+    }
+
+    // The first megabyte is identity mapped and kept from the allocator
+    memcpy((void*)SMP_TRAMPOLINE_BASE, smp_trampoline_start, size);
+    smp_trampoline_params_t* params = (smp_trampoline_params_t*)
+        (SMP_TRAMPOLINE_BASE + (uint64_t)(smp_trampoline_params - smp_trampoline_start));
+
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    params->cr3 = cr3;
+    params->entry = (uint64_t)ap_start;
+
+    for (uint32_t id = 0; id < MAX_CPUS; id++) {
+        cpu_t* cpu = get_cpu(id);
+        if (!cpu || (cpu->flags & CPU_FLAG_ONLINE)) {
+            continue;
+        }
+
+        if (!smp_boot_cpu(cpu, params)) {
+            // It may still start late and read the parameters: stop here
+            kernel_printf("SMP: CPU %u (APIC ID %u) did not start\n", cpu->id, cpu->apic_id);
+            break;
+        }
+        started++;
+    }
+
+    kernel_printf("SMP: %u CPUs online\n", num_online_cpus());
+    return started;
+}
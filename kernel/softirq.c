@@ -0,0 +1,293 @@
+/*
+ * EdgeX OS - Software Interrupts
+ *
+ * This file implements per-CPU softirq vectors. A hardware interrupt
+ * handler only acknowledges its device and raises a softirq; the softirq
+ * runs right after the interrupt returns, with interrupts enabled, so
+ * other interrupts and the timer tick are never held off by the bulk of
+ * the work. Softirqs that keep re-raising themselves are bounded by a
+ * time budget and then continue in the per-CPU ksoftirqd thread, where
+ * the scheduler can preempt them.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/scheduler.h>
+#include <edgex/softirq.h>
+#include <edgex/preempt.h>
+#include <edgex/tsc.h>
+
+/* Passes over the pending mask before deferring to ksoftirqd */
+#define SOFTIRQ_MAX_RESTART   10
+
+/* Time spent in softirqs on interrupt exit before deferring to ksoftirqd */
+#define SOFTIRQ_BUDGET_NS     2000000
+
+/* Per-CPU softirq state */
+typedef struct {
+    pid_t ksoftirqd_pid;                  /* This CPU's ksoftirqd */
+    bool ksoftirqd_idle;                  /* ksoftirqd is blocked */
+    uint64_t raised_tsc[NR_SOFTIRQS];     /* When each pending vector was first raised */
+    softirq_stats_t stats;
+} cpu_softirq_t;
+
+static cpu_softirq_t softirq_cpus[MAX_CPUS];
+
+/* Actions, shared by all CPUs */
+static softirq_action_t softirq_vec[NR_SOFTIRQS];
+
+static const char* softirq_names[NR_SOFTIRQS] = {
+    "HI", "TIMER", "NET_TX", "NET_RX", "BLOCK", "SCHED"
+};
+
+/*
+ * Install the action of a softirq vector
+ */
+void open_softirq(softirq_nr_t nr, softirq_action_t action) {
+    if (nr >= NR_SOFTIRQS) {
+        kernel_printf("Error: Invalid softirq: %u\n", nr);
+        return;
+    }
+    softirq_vec[nr] = action;
+}
+
+/*
+ * Wake the local ksoftirqd (interrupts disabled)
+ */
+static void wakeup_ksoftirqd(cpu_softirq_t* cs) {
+    if (cs->ksoftirqd_idle && cs->ksoftirqd_pid != PID_INVALID) {
+        cs->ksoftirqd_idle = false;
+        unblock_task(cs->ksoftirqd_pid);
+    }
+}
+
+/*
+ * Mark a softirq pending on the local CPU (interrupts disabled)
+ */
+void raise_softirq_irqoff(softirq_nr_t nr) {
+    cpu_t* cpu = this_cpu();
+    cpu_softirq_t* cs = &softirq_cpus[cpu->id];
+    uint32_t bit = 1U << nr;
+
+    if (!(cpu->softirq_pending & bit)) {
+        cs->raised_tsc[nr] = rdtsc();
+        cpu->softirq_pending |= bit;
+    }
+    cs->stats.raised[nr]++;
+
+    // Raised from task context: no interrupt exit will run it, ksoftirqd must
+    if (!in_interrupt()) {
+        wakeup_ksoftirqd(cs);
+    }
+}
+
+/*
+ * Mark a softirq pending on the local CPU
+ */
+void raise_softirq(softirq_nr_t nr) {
+    uint64_t flags = local_irq_save();
+    raise_softirq_irqoff(nr);
+    local_irq_restore(flags);
+}
+
+/*
+ * Run pending softirqs (interrupts disabled on entry and exit)
+ *
+ * Returns true if softirqs are still pending after the budget ran out.
+ */
+static bool __do_softirq(void) {
+    cpu_t* cpu = this_cpu();
+    cpu_softirq_t* cs = &softirq_cpus[cpu->id];
+    uint64_t start = rdtsc();
+    uint64_t budget = ns_to_tsc(SOFTIRQ_BUDGET_NS);
+    int restart = SOFTIRQ_MAX_RESTART;
+
+    // Softirqs do not nest, and the CPU cannot change underneath us
+    preempt_count_add(SOFTIRQ_OFFSET);
+    barrier();
+
+    while (1) {
+        uint32_t pending = cpu->softirq_pending;
+        uint64_t raised[NR_SOFTIRQS];
+
+        cpu->softirq_pending = 0;
+        for (uint32_t nr = 0; nr < NR_SOFTIRQS; nr++) {
+            raised[nr] = cs->raised_tsc[nr];
+        }
+
+        // Actions run with interrupts enabled; they can raise again
+        local_irq_enable();
+
+        while (pending) {
+            uint32_t nr = (uint32_t)__builtin_ctz(pending);
+            pending &= ~(1U << nr);
+
+            if (!softirq_vec[nr]) {
+                continue;
+            }
+
+            uint64_t t0 = rdtsc();
+            uint64_t latency = tsc_to_ns(t0 - raised[nr]);
+
+            softirq_vec[nr]();
+
+            uint64_t run = tsc_to_ns(rdtsc() - t0);
+            cs->stats.runs[nr]++;
+            if (latency > cs->stats.max_latency_ns) {
+                cs->stats.max_latency_ns = latency;
+            }
+            if (run > cs->stats.max_run_ns) {
+                cs->stats.max_run_ns = run;
+            }
+        }
+
+        local_irq_disable();
+
+        if (!cpu->softirq_pending || --restart == 0 ||
+            rdtsc() - start >= budget) {
+            break;
+        }
+    }
+
+    barrier();
+    preempt_count_sub(SOFTIRQ_OFFSET);
+
+    return cpu->softirq_pending != 0;
+}
+
+/*
+ * Run pending softirqs on interrupt exit (interrupts disabled)
+ */
+void do_softirq(void) {
+    // Nested interrupt, softirq already running, or bottom halves disabled
+    if (in_interrupt() || !local_softirq_pending()) {
+        return;
+    }
+
+    if (__do_softirq()) {
+        cpu_softirq_t* cs = &softirq_cpus[smp_processor_id()];
+        cs->stats.deferred++;
+        wakeup_ksoftirqd(cs);
+    }
+}
+
+/*
+ * Re-enable softirqs and run any that were raised meanwhile
+ */
+void local_bh_enable(void) {
+    barrier();
+    preempt_count_sub(SOFTIRQ_OFFSET);
+
+    if (!in_interrupt() && local_softirq_pending()) {
+        uint64_t flags = local_irq_save();
+        do_softirq();
+        local_irq_restore(flags);
+    }
+
+    preempt_check_resched();
+}
+
+/*
+ * ksoftirqd - runs softirqs that overran the interrupt exit budget
+ */
+static void ksoftirqd_thread(void) {
+    cpu_t* cpu = this_cpu();
+    cpu_softirq_t* cs = &softirq_cpus[cpu->id];
+
+    while (1) {
+        uint64_t flags = local_irq_save();
+
+        if (cpu->softirq_pending) {
+            __do_softirq();
+            local_irq_restore(flags);
+
+            // Let the scheduler in between batches
+            preempt_check_resched();
+            continue;
+        }
+
+        local_irq_restore(flags);
+
+        // Mark ourselves blocked before the final check, so a raise
+        // between the check and schedule() is not lost
+        prepare_to_block();
+
+        flags = local_irq_save();
+        if (!cpu->softirq_pending) {
+            cs->ksoftirqd_idle = true;
+            local_irq_restore(flags);
+            schedule();
+        } else {
+            local_irq_restore(flags);
+            cancel_block();
+        }
+    }
+}
+
+/*
+ * Start ksoftirqd on every online CPU
+ */
+void init_softirqs(void) {
+    cpumask_t mask = cpu_online_mask();
+    uint32_t cpu;
+
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        softirq_cpus[i].ksoftirqd_pid = PID_INVALID;
+    }
+
+    for_each_cpu(cpu, mask) {
+        char name[16] = "ksoftirqd/";
+        uint32_t len = 10;
+
+        // Append the CPU number to the name
+        if (cpu >= 10) {
+            name[len++] = (char)('0' + cpu / 10);
+        }
+        name[len++] = (char)('0' + cpu % 10);
+        name[len] = '\0';
+
+        pid_t pid = create_kernel_task(name, ksoftirqd_thread, TASK_PRIORITY_NORMAL);
+        if (pid == PID_INVALID) {
+            kernel_panic("Failed to create ksoftirqd for CPU %u!", cpu);
+            return;
+        }
+        set_task_affinity(pid, cpumask_of(cpu));
+
+        softirq_cpus[cpu].ksoftirqd_pid = pid;
+    }
+
+    kernel_printf("Softirqs initialized on %u CPUs\n", cpumask_weight(mask));
+}
+
+/*
+ * Get softirq statistics for a CPU
+ */
+void get_softirq_stats(uint32_t cpu, softirq_stats_t* stats) {
+    if (!stats || cpu >= MAX_CPUS) {
+        return;
+    }
+    *stats = softirq_cpus[cpu].stats;
+}
+
+/*
+ * Print softirq statistics
+ */
+void dump_softirq_stats(void) {
+    kernel_printf("Softirqs:\n");
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        cpu_softirq_t* cs = &softirq_cpus[cpu];
+        if (cs->ksoftirqd_pid == PID_INVALID) {
+            continue;
+        }
+
+        kernel_printf("  CPU %u: max latency %llu ns, max run %llu ns, deferred %llu\n",
+                      cpu, cs->stats.max_latency_ns, cs->stats.max_run_ns,
+                      cs->stats.deferred);
+        for (uint32_t nr = 0; nr < NR_SOFTIRQS; nr++) {
+            if (cs->stats.raised[nr] == 0) {
+                continue;
+            }
+            kernel_printf("    %s: raised %llu, ran %llu\n",
+                          softirq_names[nr], cs->stats.raised[nr], cs->stats.runs[nr]);
+        }
+    }
+}
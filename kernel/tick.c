@@ -0,0 +1,235 @@
+/*
+ * EdgeX OS - Tick Management
+ *
+ * This file implements per-CPU tick devices and full-tickless mode.
+ * A nohz_full CPU that runs exactly one task stops its periodic tick,
+ * so a busy-polling task sees no timer interrupts at all. Timekeeping,
+ * sleeping-task wakeups and IPC timeouts stay on the housekeeping CPU.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/tick.h>
+#include <edgex/tsc.h>
+#include <edgex/interrupt.h>
+
+/*
+ * Register the tick device for a CPU and start it in periodic mode
+ */
+void tick_register_device(uint32_t cpu_id, tick_device_t* dev) {
+    cpu_t* cpu = get_cpu(cpu_id);
+    if (!cpu || !dev) {
+        return;
+    }
+
+    cpu->tick_dev = dev;
+    cpu->tick_stopped = false;
+
+    if (dev->set_periodic) {
+        dev->set_periodic(dev, TICK_HZ);
+    }
+
+    kernel_printf("CPU %u: tick device %s at %u Hz\n", cpu_id, dev->name, TICK_HZ);
+}
+
+/*
+ * Get the CPU responsible for global timekeeping
+ */
+uint32_t tick_do_timer_cpu(void) {
+    return BOOT_CPU_ID;
+}
+
+/*
+ * Stop the tick on the local CPU
+ */
+static void tick_stop(cpu_t* cpu) {
+    tick_device_t* dev = cpu->tick_dev;
+
+    // A tick shared with other CPUs (e.g. the PIT) cannot be stopped
+    if (!dev || !dev->stop || !(dev->features & TICK_FEAT_PERCPU)) {
+        return;
+    }
+
+    dev->stop(dev);
+    cpu->tick_stopped = true;
+    cpu->tick_stop_count++;
+}
+
+/*
+ * Restart the tick on the local CPU
+ */
+static void tick_restart(cpu_t* cpu) {
+    tick_device_t* dev = cpu->tick_dev;
+
+    cpu->tick_restart_pending = false;
+    if (!cpu->tick_stopped) {
+        return;
+    }
+
+    if (dev && dev->set_periodic) {
+        dev->set_periodic(dev, TICK_HZ);
+    }
+    cpu->tick_stopped = false;
+    cpu->tick_restart_count++;
+
+    // The gap since the last tick is not lateness
+    cpu->tick_last_tsc = 0;
+}
+
+/*
+ * Re-evaluate the tick on the local CPU
+ *
+ * Called by the scheduler after every scheduling decision and from the
+ * tick itself. nr_running counts runnable tasks on this CPU, including
+ * the one currently running but excluding the idle task.
+ */
+void tick_nohz_update(uint32_t nr_running) {
+    cpu_t* cpu = this_cpu();
+
+    if (!(cpu->flags & CPU_FLAG_NOHZ_FULL)) {
+        return;
+    }
+
+    if (nr_running == 1 && !cpu->tick_stopped && !cpu->tick_restart_pending) {
+        // A single task owns the CPU: nothing to time-slice, stop the tick
+        tick_stop(cpu);
+    } else if (nr_running != 1 && cpu->tick_stopped) {
+        // Competing tasks (or idle) need time slicing again
+        tick_restart(cpu);
+    }
+}
+
+/*
+ * Ask a CPU to restart its tick, e.g. after a second task was queued on it
+ */
+void tick_nohz_kick(uint32_t cpu_id) {
+    cpu_t* cpu = get_cpu(cpu_id);
+    if (!cpu || !cpu->tick_stopped) {
+        return;
+    }
+
+    if (cpu_id == smp_processor_id()) {
+        tick_restart(cpu);
+        return;
+    }
+
+    cpu->tick_restart_pending = true;
+    cpu_send_ipi(cpu_id, INT_VECTOR_RESCHEDULE);
+}
+
+/*
+ * Handle a remote tick restart request (called from the reschedule IPI)
+ */
+void tick_nohz_handle_kick(void) {
+    cpu_t* cpu = this_cpu();
+
+    if (cpu->tick_restart_pending) {
+        tick_restart(cpu);
+    }
+}
+
+/*
+ * Account one tick handler run on the calling CPU
+ *
+ * Besides the handler's own cost, this tracks how late each tick arrived
+ * relative to the previous one: anything that keeps interrupts disabled
+ * (a slow IRQ handler, a long critical section) shows up as lateness.
+ */
+void tick_account_handler(uint64_t start, uint64_t cycles) {
+    cpu_t* cpu = this_cpu();
+
+    cpu->tick_handler_cycles += cycles;
+    if (cycles > cpu->tick_handler_max) {
+        cpu->tick_handler_max = cycles;
+    }
+
+    // Skip the first tick and the first tick after a nohz restart
+    if (cpu->tick_last_tsc) {
+        uint64_t period = ns_to_tsc(1000000000ULL / TICK_HZ);
+        uint64_t gap = start - cpu->tick_last_tsc;
+
+        if (gap > period && gap - period > cpu->tick_max_lateness) {
+            cpu->tick_max_lateness = gap - period;
+        }
+    }
+    cpu->tick_last_tsc = start;
+}
+
+/*
+ * Print per-CPU tick handler cost
+ */
+void dump_tick_stats(void) {
+    kernel_printf("Tick handler cost:\n");
+    for (uint32_t id = 0; id < MAX_CPUS; id++) {
+        cpu_t* cpu = get_cpu(id);
+        if (!cpu || !(cpu->flags & CPU_FLAG_ONLINE) || cpu->ticks == 0) {
+            continue;
+        }
+
+        kernel_printf("  CPU %u: %llu ticks, avg %llu ns, max %llu ns, "
+                      "max lateness %llu ns, stopped %llu times\n",
+                      id, cpu->ticks,
+                      tsc_to_ns(cpu->tick_handler_cycles / cpu->ticks),
+                      tsc_to_ns(cpu->tick_handler_max),
+                      tsc_to_ns(cpu->tick_max_lateness),
+                      cpu->tick_stop_count);
+    }
+}
+
+/*
+ * Measure the jitter seen by a tight polling loop
+ *
+ * Spins on the TSC for the given duration and records every gap between
+ * consecutive reads that exceeds a few hundred nanoseconds: those gaps are
+ * time stolen by interrupts, IPIs or other kernel activity. On a properly
+ * isolated nohz_full CPU running only the probe, the maximum gap should
+ * stay in the sub-microsecond range.
+ */
+void tick_nohz_jitter_probe(uint64_t duration_ms) {
+    cpu_t* cpu = this_cpu();
+    uint64_t threshold = ns_to_tsc(500);
+    uint64_t end = rdtsc() + ns_to_tsc(duration_ms * 1000000ULL);
+    uint64_t prev = rdtsc();
+    uint64_t max_gap = 0;
+    uint64_t stolen = 0;
+    uint64_t gaps_1us = 0;
+    uint64_t gaps_10us = 0;
+    uint64_t gaps_100us = 0;
+    uint64_t loops = 0;
+    uint64_t ticks_before = cpu->ticks;
+
+    while (prev < end) {
+        uint64_t now = rdtsc();
+        uint64_t gap = now - prev;
+
+        if (gap > threshold) {
+            uint64_t gap_ns = tsc_to_ns(gap);
+
+            stolen += gap;
+            if (gap > max_gap) {
+                max_gap = gap;
+            }
+            if (gap_ns >= 100000) {
+                gaps_100us++;
+            } else if (gap_ns >= 10000) {
+                gaps_10us++;
+            } else if (gap_ns >= 1000) {
+                gaps_1us++;
+            }
+        }
+
+        prev = now;
+        loops++;
+    }
+
+    kernel_printf("Jitter probe on CPU %u (%s, tick %s) for %llu ms:\n",
+                  cpu->id,
+                  (cpu->flags & CPU_FLAG_ISOLATED) ? "isolated" : "housekeeping",
+                  cpu->tick_stopped ? "stopped" : "running",
+                  duration_ms);
+    kernel_printf("  loops: %llu, ticks taken: %llu\n", loops, cpu->ticks - ticks_before);
+    kernel_printf("  max gap: %llu ns, stolen: %llu ns\n",
+                  tsc_to_ns(max_gap), tsc_to_ns(stolen));
+    kernel_printf("  gaps 1-10us: %llu, 10-100us: %llu, >100us: %llu\n",
+                  gaps_1us, gaps_10us, gaps_100us);
+}
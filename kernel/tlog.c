@@ -0,0 +1,1091 @@
+/*
+ * EdgeX OS - Telemetry Log Store
+ *
+ * This file implements the segmented telemetry log. Appends copy the
+ * record into the filling batch under the log lock. A commit swaps in
+ * the other batch, so appends carry on while the committer writes the
+ * full one as a single merged request and flushes the device; whoever
+ * waits for a commit while another is running joins the next one. On
+ * open, the segments are scanned in generation order and the log ends
+ * at the first record that fails its checksum.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/scheduler.h>
+#include <edgex/tsc.h>
+#include <edgex/ipc.h>
+#include <edgex/virtio_blk.h>
+#include <edgex/tlog.h>
+
+#define TLOG_NO_SEGMENT     0xFFFFFFFF
+
+_Static_assert(sizeof(tlog_ring_entry_t) == 256, "tlog_ring_entry_t must stay 256 bytes");
+
+/* One store per system, served by one tlogd */
+static tlog_t tlog_store;
+static bool tlog_store_open;
+static uint32_t crc32_table[256];
+
+static int tlog_sync(tlog_t* log, uint64_t seq, uint64_t batch_nr);
+
+/* Synchronous I/O: requests finish in the BLOCK softirq */
+typedef struct {
+    spinlock_t lock;
+    uint32_t pending;
+    int status;
+    pid_t waiter;
+} tlog_io_t;
+
+/*
+ * CRC-32 (IEEE 802.3)
+ */
+static void crc32_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        crc32_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+
+    crc = ~crc;
+    while (len--) {
+        crc = crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/*
+ * Checksum of a record: the header after the crc field, then the data
+ */
+static uint32_t tlog_rec_crc(tlog_t* log, const tlog_rec_hdr_t* rec) {
+    uint32_t crc = crc32_update(log->epoch, (const uint8_t*)rec + sizeof(rec->crc),
+                                sizeof(*rec) - sizeof(rec->crc));
+    return crc32_update(crc, rec + 1, rec->len);
+}
+
+static inline uint32_t tlog_rec_size(uint16_t len) {
+    return (uint32_t)((sizeof(tlog_rec_hdr_t) + len + 7) & ~7UL);
+}
+
+/*
+ * Device sector of a segment block (block 0 of the range is the superblock)
+ */
+static inline uint64_t tlog_sector(tlog_t* log, uint32_t segment, uint32_t block) {
+    return (log->start_block + 1 + (uint64_t)segment * TLOG_SEG_BLOCKS + block) * TLOG_BLOCK_SECTORS;
+}
+
+static void tlog_io_done(blk_request_t* req) {
+    tlog_io_t* io = (tlog_io_t*)req->priv;
+    uint64_t flags;
+
+    spin_lock_irqsave(&io->lock, flags);
+    if (req->status != 0) {
+        io->status = -1;
+    }
+    if (--io->pending == 0 && io->waiter != PID_INVALID) {
+        unblock_task(io->waiter);
+    }
+    spin_unlock_irqrestore(&io->lock, flags);
+}
+
+static int tlog_io_wait(tlog_io_t* io) {
+    uint64_t flags;
+
+    for (;;) {
+        prepare_to_block();
+        spin_lock_irqsave(&io->lock, flags);
+        if (io->pending == 0) {
+            spin_unlock_irqrestore(&io->lock, flags);
+            cancel_block();
+            return io->status;
+        }
+        io->waiter = get_current_pid();
+        spin_unlock_irqrestore(&io->lock, flags);
+        schedule();
+    }
+}
+
+/*
+ * Read or write whole blocks, one request per page, and optionally flush
+ *
+ * The driver merges the requests into one when the blocks are adjacent.
+ */
+static int tlog_rw(tlog_t* log, blk_request_t* reqs, uint32_t op, uint64_t sector,
+                   uint8_t** pages, uint32_t count, bool flush) {
+    tlog_io_t io = { .lock = SPINLOCK_INIT, .pending = count };
+
+    for (uint32_t i = 0; i < count; i++) {
+        blk_request_t* req = &reqs[i];
+        memset(req, 0, sizeof(*req));
+        req->op = op;
+        req->sector = sector + (uint64_t)i * TLOG_BLOCK_SECTORS;
+        req->nr_sectors = TLOG_BLOCK_SECTORS;
+        req->phys = (uint64_t)pages[i];   // Identity-mapped page
+        req->done = tlog_io_done;
+        req->priv = &io;
+        if (virtio_blk_submit(log->blk, req, i + 1 < count) < 0) {
+            req->status = -1;
+            tlog_io_done(req);
+        }
+    }
+    virtio_blk_unplug(log->blk);
+
+    if (tlog_io_wait(&io) < 0 || !flush) {
+        return io.status;
+    }
+
+    // The flush covers the writes only once they have completed
+    blk_request_t* req = &reqs[count];
+    memset(req, 0, sizeof(*req));
+    req->op = BLK_OP_FLUSH;
+    req->done = tlog_io_done;
+    req->priv = &io;
+    io.pending = 1;
+    if (virtio_blk_submit(log->blk, req, false) < 0) {
+        return -1;
+    }
+    return tlog_io_wait(&io);
+}
+
+/*
+ * Find a key's index entry, creating it if asked (lock held)
+ */
+static tlog_index_entry_t* tlog_index_find(tlog_t* log, uint64_t key, bool create) {
+    uint32_t slot = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (TLOG_INDEX_SIZE - 1);
+
+    for (uint32_t probe = 0; probe < TLOG_INDEX_SIZE; probe++) {
+        tlog_index_entry_t* e = &log->index[(slot + probe) & (TLOG_INDEX_SIZE - 1)];
+        if (e->key == key) {
+            return e;
+        }
+        if (e->key == 0) {
+            // Keep the table at most 3/4 full so probes stay short
+            if (!create || log->nr_keys >= TLOG_INDEX_SIZE / 4 * 3) {
+                return NULL;
+            }
+            e->key = key;
+            log->nr_keys++;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Account a record in the index (lock held)
+ */
+static void tlog_index_record(tlog_t* log, const tlog_rec_hdr_t* rec, uint32_t segment,
+                              uint32_t block, uint32_t offset) {
+    tlog_index_entry_t* e = tlog_index_find(log, rec->key, true);
+    if (!e) {
+        return;
+    }
+
+    if (rec->type == TLOG_REC_TRIM) {
+        if (rec->seq > e->trim_seq) {
+            e->trim_seq = rec->seq;
+        }
+    } else if (rec->seq >= e->latest_seq) {
+        e->latest_seq = rec->seq;
+        e->segment = segment;
+        e->block = (uint16_t)block;
+        e->offset = (uint16_t)offset;
+    }
+}
+
+/*
+ * Start a new head segment in the filling batch (lock held)
+ *
+ * Its header block is written by the batch's commit.
+ */
+static int tlog_open_segment(tlog_t* log) {
+    tlog_batch_t* batch = log->filling;
+    uint32_t segment = TLOG_NO_SEGMENT;
+
+    for (uint32_t i = 0; i < log->nr_segments; i++) {
+        if (log->segments[i].state == TLOG_SEG_FREE) {
+            segment = i;
+            break;
+        }
+    }
+    // The last free segment is kept for compaction to copy into
+    if (segment == TLOG_NO_SEGMENT || (log->free_segments == 1 && !log->compacting)) {
+        return -1;
+    }
+
+    if (log->head != TLOG_NO_SEGMENT) {
+        log->segments[log->head].state = TLOG_SEG_SEALED;
+    }
+    log->head = segment;
+    log->free_segments--;
+    log->segments[segment].state = TLOG_SEG_OPEN;
+    log->segments[segment].generation = ++log->generation;
+    log->segments[segment].records = 0;
+
+    tlog_seg_hdr_t* hdr = (tlog_seg_hdr_t*)batch->pages[0];
+    memset(batch->pages[0], 0, TLOG_BLOCK_SIZE);
+    hdr->magic = TLOG_SEG_MAGIC;
+    hdr->generation = log->generation;
+
+    // The header fills block 0; records start in block 1
+    batch->segment = segment;
+    batch->first_block = 0;
+    batch->nr_blocks = 1;
+    batch->offset = TLOG_BLOCK_SIZE;
+    return 0;
+}
+
+typedef enum {
+    TLOG_APPEND_OK,
+    TLOG_APPEND_COMMIT,          /* Batch full: commit, then retry */
+    TLOG_APPEND_FULL             /* No free segment */
+} tlog_append_result_t;
+
+/*
+ * Add a record to the filling batch (lock held)
+ */
+static tlog_append_result_t tlog_append_locked(tlog_t* log, uint16_t type, uint64_t key,
+                                               uint64_t seq, uint64_t timestamp,
+                                               const void* data, uint16_t len) {
+    tlog_batch_t* batch = log->filling;
+    uint32_t size = tlog_rec_size(len);
+
+    if (batch->full) {
+        return TLOG_APPEND_COMMIT;
+    }
+    if (batch->segment == TLOG_NO_SEGMENT && tlog_open_segment(log) < 0) {
+        return TLOG_APPEND_FULL;
+    }
+
+    // Move to a new block when the record does not fit in this one
+    if (batch->nr_blocks == 0 || batch->offset + size > TLOG_BLOCK_SIZE) {
+        uint32_t next = batch->first_block + batch->nr_blocks;
+        if (next >= TLOG_SEG_BLOCKS || batch->nr_blocks == TLOG_BATCH_BLOCKS) {
+            batch->full = true;
+            return TLOG_APPEND_COMMIT;
+        }
+        memset(batch->pages[batch->nr_blocks], 0, TLOG_BLOCK_SIZE);
+        batch->nr_blocks++;
+        batch->offset = 0;
+    }
+
+    uint32_t block = batch->first_block + batch->nr_blocks - 1;
+    tlog_rec_hdr_t* rec = (tlog_rec_hdr_t*)(batch->pages[batch->nr_blocks - 1] + batch->offset);
+
+    if (seq == 0) {
+        seq = log->next_seq++;
+    }
+    rec->generation = log->segments[batch->segment].generation;
+    rec->len = len;
+    rec->type = type;
+    rec->reserved = 0;
+    rec->key = key;
+    rec->seq = seq;
+    rec->timestamp = timestamp;
+    memcpy(rec + 1, data, len);
+    rec->crc = tlog_rec_crc(log, rec);
+
+    tlog_index_record(log, rec, batch->segment, block, batch->offset);
+    log->segments[batch->segment].records++;
+    batch->offset += size;
+    if (seq > batch->last_seq) {
+        batch->last_seq = seq;
+    }
+    if (log->first_pending_tick == 0) {
+        log->first_pending_tick = get_tick_count();
+    }
+    return TLOG_APPEND_OK;
+}
+
+/*
+ * Append with retries through commits
+ *
+ * seq and timestamp are 0 for new records and kept for copied ones.
+ */
+static uint64_t tlog_append_record(tlog_t* log, uint16_t type, uint64_t key, uint64_t seq,
+                                   uint64_t timestamp, const void* data, uint16_t len) {
+    uint64_t flags;
+
+    if (key == 0 || len > TLOG_MAX_RECORD) {
+        return 0;
+    }
+    if (timestamp == 0) {
+        timestamp = tsc_now_ns();
+    }
+
+    for (;;) {
+        spin_lock_irqsave(&log->lock, flags);
+        uint64_t assigned = seq ? seq : log->next_seq;
+        tlog_append_result_t ret = tlog_append_locked(log, type, key, seq, timestamp, data, len);
+        uint64_t filling_nr = log->batches_taken + 1;
+        if (ret == TLOG_APPEND_OK) {
+            log->stats.appends++;
+        } else if (ret == TLOG_APPEND_FULL) {
+            log->stats.full_errors++;
+        }
+        spin_unlock_irqrestore(&log->lock, flags);
+
+        if (ret == TLOG_APPEND_OK) {
+            return assigned;
+        }
+        if (ret == TLOG_APPEND_FULL) {
+            return 0;
+        }
+        if (tlog_sync(log, 0, filling_nr) < 0) {
+            return 0;
+        }
+    }
+}
+
+/*
+ * Append a record
+ */
+uint64_t tlog_append(tlog_t* log, uint64_t key, const void* data, uint16_t len) {
+    return tlog_append_record(log, TLOG_REC_DATA, key, 0, 0, data, len);
+}
+
+/*
+ * Trim a key: its records up to seq are dropped by compaction
+ */
+uint64_t tlog_trim(tlog_t* log, uint64_t key, uint64_t seq) {
+    uint64_t flags;
+
+    spin_lock_irqsave(&log->lock, flags);
+    tlog_index_entry_t* e = tlog_index_find(log, key, false);
+    if (e && seq > e->trim_seq) {
+        e->trim_seq = seq;
+        log->compact_blocked = false;
+    }
+    spin_unlock_irqrestore(&log->lock, flags);
+
+    // Logged so the trim survives a restart (the record's seq is the trim point)
+    return tlog_append_record(log, TLOG_REC_TRIM, key, seq, 0, NULL, 0);
+}
+
+/*
+ * Wake the tasks waiting for a commit (lock held)
+ */
+static void tlog_wake_waiters(tlog_t* log) {
+    for (uint32_t i = 0; i < log->nr_waiters; i++) {
+        unblock_task(log->waiters[i]);
+    }
+    log->nr_waiters = 0;
+}
+
+/*
+ * Wait until seq and the batch numbered batch are durable
+ *
+ * The first caller to find no commit running becomes the committer for
+ * everything appended so far; the others wait and find their record
+ * durable or become the next committer.
+ */
+static int tlog_sync(tlog_t* log, uint64_t seq, uint64_t batch_nr) {
+    uint64_t flags;
+
+    for (;;) {
+        prepare_to_block();
+        spin_lock_irqsave(&log->lock, flags);
+        if (log->durable_seq >= seq && log->batches_durable >= batch_nr) {
+            spin_unlock_irqrestore(&log->lock, flags);
+            cancel_block();
+            return 0;
+        }
+        if (log->io_error) {
+            spin_unlock_irqrestore(&log->lock, flags);
+            cancel_block();
+            return -1;
+        }
+        if (log->committing) {
+            if (log->nr_waiters < sizeof(log->waiters) / sizeof(log->waiters[0])) {
+                log->waiters[log->nr_waiters++] = get_current_pid();
+                spin_unlock_irqrestore(&log->lock, flags);
+                schedule();
+            } else {
+                spin_unlock_irqrestore(&log->lock, flags);
+                cancel_block();
+                sleep_task(1);
+            }
+            continue;
+        }
+
+        // Become the committer: swap batches and let appends continue
+        tlog_batch_t* batch = log->filling;
+        tlog_batch_t* next = batch == &log->batches[0] ? &log->batches[1] : &log->batches[0];
+        uint32_t end = batch->first_block + batch->nr_blocks;
+        uint64_t last = batch->last_seq;
+        uint64_t nr = ++log->batches_taken;
+
+        next->segment = TLOG_NO_SEGMENT;
+        next->first_block = 0;
+        next->nr_blocks = 0;
+        next->offset = 0;
+        next->last_seq = 0;
+        next->full = false;
+
+        // Carry on in the same segment unless it ran out; a partial last
+        // block is written again with the records that follow
+        if (batch->segment != TLOG_NO_SEGMENT && !(batch->full && end == TLOG_SEG_BLOCKS)) {
+            next->segment = batch->segment;
+            if (batch->offset + sizeof(tlog_rec_hdr_t) <= TLOG_BLOCK_SIZE) {
+                memcpy(next->pages[0], batch->pages[batch->nr_blocks - 1], TLOG_BLOCK_SIZE);
+                next->first_block = end - 1;
+                next->nr_blocks = 1;
+                next->offset = batch->offset;
+            } else if (end < TLOG_SEG_BLOCKS) {
+                next->first_block = end;
+            } else {
+                next->segment = TLOG_NO_SEGMENT;
+            }
+        }
+
+        log->filling = next;
+        log->writing = batch;
+        log->committing = true;
+        log->first_pending_tick = 0;
+        spin_unlock_irqrestore(&log->lock, flags);
+        cancel_block();
+
+        int ret = 0;
+        if (batch->nr_blocks > 0) {
+            ret = tlog_rw(log, log->reqs, BLK_OP_WRITE,
+                          tlog_sector(log, batch->segment, batch->first_block),
+                          batch->pages, batch->nr_blocks, true);
+        }
+
+        spin_lock_irqsave(&log->lock, flags);
+        if (ret == 0) {
+            if (last > log->durable_seq) {
+                log->stats.committed_records += last - log->durable_seq;
+                log->durable_seq = last;
+            }
+            log->batches_durable = nr;
+            if (batch->nr_blocks > 0) {
+                log->stats.commits++;
+                log->stats.blocks_written += batch->nr_blocks;
+            }
+        } else {
+            log->io_error = true;
+        }
+        log->writing = NULL;
+        log->committing = false;
+        tlog_wake_waiters(log);
+        spin_unlock_irqrestore(&log->lock, flags);
+
+        if (ret < 0) {
+            LOG_ERROR("tlog: commit failed");
+            return -1;
+        }
+    }
+}
+
+/*
+ * Wait until seq is durable
+ */
+int tlog_commit(tlog_t* log, uint64_t seq) {
+    if (log->durable_seq >= seq) {
+        return 0;
+    }
+    return tlog_sync(log, seq, 0);
+}
+
+/*
+ * Copy out a key's latest record
+ */
+int tlog_latest(tlog_t* log, uint64_t key, void* data, uint16_t max, uint64_t* seq) {
+    uint64_t flags;
+    int ret = -1;
+
+    spin_lock_irqsave(&log->lock, flags);
+    tlog_index_entry_t* e = tlog_index_find(log, key, false);
+    if (!e || e->latest_seq == 0) {
+        spin_unlock_irqrestore(&log->lock, flags);
+        return -1;
+    }
+    uint32_t segment = e->segment, block = e->block, offset = e->offset;
+    uint64_t want = e->latest_seq;
+
+    // Not written yet, or being written: the batch has the newest copy
+    for (int i = 0; i < 2; i++) {
+        tlog_batch_t* batch = &log->batches[i];
+        if (batch->segment == segment && block >= batch->first_block &&
+            block < batch->first_block + batch->nr_blocks) {
+            tlog_rec_hdr_t* rec = (tlog_rec_hdr_t*)(batch->pages[block - batch->first_block] + offset);
+            if (rec->key == key && rec->seq == want) {
+                ret = rec->len < max ? rec->len : max;
+                memcpy(data, rec + 1, (size_t)ret);
+                *seq = rec->seq;
+            }
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&log->lock, flags);
+    if (ret >= 0) {
+        return ret;
+    }
+
+    uint8_t* page = (uint8_t*)alloc_page();
+    blk_request_t req;
+    if (!page) {
+        return -1;
+    }
+    if (tlog_rw(log, &req, BLK_OP_READ, tlog_sector(log, segment, block), &page, 1, false) == 0) {
+        tlog_rec_hdr_t* rec = (tlog_rec_hdr_t*)(page + offset);
+        if (rec->key == key && rec->seq == want && tlog_rec_crc(log, rec) == rec->crc) {
+            ret = rec->len < max ? rec->len : max;
+            memcpy(data, rec + 1, (size_t)ret);
+            *seq = rec->seq;
+        }
+    }
+    free_page(page);
+    return ret;
+}
+
+/*
+ * Walk the valid records of a block
+ *
+ * Returns how many bytes of records the block holds, or -1 if fn asked to
+ * stop; *end is set if a record failed its check (the segment ends there).
+ */
+typedef bool (*tlog_rec_fn_t)(tlog_t* log, const tlog_rec_hdr_t* rec, uint32_t segment,
+                              uint32_t block, uint32_t offset);
+
+static int tlog_scan_block(tlog_t* log, const uint8_t* page, uint32_t segment, uint32_t block,
+                           uint32_t generation, tlog_rec_fn_t fn, bool* end) {
+    uint32_t offset = 0;
+
+    *end = false;
+    while (offset + sizeof(tlog_rec_hdr_t) <= TLOG_BLOCK_SIZE) {
+        const tlog_rec_hdr_t* rec = (const tlog_rec_hdr_t*)(page + offset);
+
+        // A zero header is the unused rest of the block
+        if (rec->crc == 0 && rec->generation == 0 && rec->key == 0) {
+            break;
+        }
+        if (rec->generation != generation || rec->len > TLOG_MAX_RECORD ||
+            offset + tlog_rec_size(rec->len) > TLOG_BLOCK_SIZE || tlog_rec_crc(log, rec) != rec->crc) {
+            *end = true;
+            break;
+        }
+        if (!fn(log, rec, segment, block, offset)) {
+            return -1;
+        }
+        offset += tlog_rec_size(rec->len);
+    }
+    return (int)offset;
+}
+
+/*
+ * Walk the records of a segment, reading a batch of blocks at a time
+ *
+ * The segment ends at a record that fails its check or at a block with
+ * no records. Returns false if the walk was stopped or a read failed.
+ */
+static bool tlog_scan_segment(tlog_t* log, uint32_t segment, tlog_rec_fn_t fn) {
+    uint32_t generation = log->segments[segment].generation;
+    blk_request_t reqs[TLOG_BATCH_BLOCKS];
+
+    for (uint32_t block = 1; block < TLOG_SEG_BLOCKS; block += TLOG_BATCH_BLOCKS) {
+        uint32_t count = TLOG_SEG_BLOCKS - block;
+        if (count > TLOG_BATCH_BLOCKS) {
+            count = TLOG_BATCH_BLOCKS;
+        }
+        if (tlog_rw(log, reqs, BLK_OP_READ, tlog_sector(log, segment, block), log->scan_pages,
+                    count, false) < 0) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            bool end;
+            int used = tlog_scan_block(log, log->scan_pages[i], segment, block + i,
+                                       generation, fn, &end);
+            if (used < 0) {
+                return false;
+            }
+            if (end || used == 0) {
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+static bool tlog_recover_record(tlog_t* log, const tlog_rec_hdr_t* rec, uint32_t segment,
+                                uint32_t block, uint32_t offset) {
+    tlog_index_record(log, rec, segment, block, offset);
+    log->segments[segment].records++;
+    log->stats.recovered_records++;
+    if (rec->seq >= log->next_seq) {
+        log->next_seq = rec->seq + 1;
+    }
+    return true;
+}
+
+/*
+ * Write a fresh superblock and free every segment
+ */
+static int tlog_format(tlog_t* log) {
+    blk_request_t reqs[2];
+    uint8_t* zero = log->scan_pages[1];
+
+    // A new epoch invalidates every record left from before
+    log->epoch = (uint32_t)rdtsc() | 1;
+
+    memset(log->scan_pages[0], 0, TLOG_BLOCK_SIZE);
+    memset(zero, 0, TLOG_BLOCK_SIZE);
+    tlog_super_t* super = (tlog_super_t*)log->scan_pages[0];
+    super->magic = TLOG_MAGIC;
+    super->version = TLOG_VERSION;
+    super->seg_blocks = TLOG_SEG_BLOCKS;
+    super->nr_segments = log->nr_segments;
+    super->epoch = log->epoch;
+
+    // Zero every segment header, then write the superblock last
+    for (uint32_t i = 0; i < log->nr_segments; i++) {
+        if (tlog_rw(log, reqs, BLK_OP_WRITE, tlog_sector(log, i, 0), &zero, 1, false) < 0) {
+            return -1;
+        }
+    }
+    return tlog_rw(log, reqs, BLK_OP_WRITE, log->start_block * TLOG_BLOCK_SECTORS,
+                   log->scan_pages, 1, true);
+}
+
+/*
+ * Rebuild the in-memory state from the device
+ *
+ * Every segment found is sealed: appends go to a new segment, so nothing
+ * written after the end found here (a torn batch) can join the log later.
+ */
+static int tlog_recover(tlog_t* log) {
+    blk_request_t req;
+    uint32_t order[TLOG_MAX_SEGMENTS];
+    uint32_t used = 0;
+
+    // Segment headers
+    for (uint32_t i = 0; i < log->nr_segments; i++) {
+        if (tlog_rw(log, &req, BLK_OP_READ, tlog_sector(log, i, 0), log->scan_pages, 1, false) < 0) {
+            return -1;
+        }
+        tlog_seg_hdr_t* hdr = (tlog_seg_hdr_t*)log->scan_pages[0];
+        if (hdr->magic != TLOG_SEG_MAGIC || hdr->generation == 0) {
+            continue;
+        }
+
+        log->segments[i].state = TLOG_SEG_SEALED;
+        log->segments[i].generation = hdr->generation;
+        log->free_segments--;
+        if (hdr->generation > log->generation) {
+            log->generation = hdr->generation;
+        }
+
+        // Insertion sort by generation
+        uint32_t j = used++;
+        while (j > 0 && log->segments[order[j - 1]].generation > hdr->generation) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    // Replay oldest first so later copies win in the index
+    for (uint32_t k = 0; k < used; k++) {
+        if (!tlog_scan_segment(log, order[k], tlog_recover_record)) {
+            return -1;
+        }
+    }
+
+    log->durable_seq = log->next_seq - 1;
+    return 0;
+}
+
+/*
+ * Whether compaction would drop a record (lock held)
+ */
+static bool tlog_record_dead(tlog_t* log, const tlog_rec_hdr_t* rec) {
+    if (rec->type != TLOG_REC_DATA) {
+        return true;
+    }
+    tlog_index_entry_t* e = tlog_index_find(log, rec->key, false);
+    return e && rec->seq <= e->trim_seq;
+}
+
+static bool tlog_count_dead(tlog_t* log, const tlog_rec_hdr_t* rec, uint32_t segment,
+                            uint32_t block, uint32_t offset) {
+    uint64_t flags;
+    (void)block;
+    (void)offset;
+
+    spin_lock_irqsave(&log->lock, flags);
+    if (tlog_record_dead(log, rec)) {
+        log->segments[segment].dead++;
+    }
+    spin_unlock_irqrestore(&log->lock, flags);
+    return true;
+}
+
+/*
+ * Copy a record that is still live to the head (compaction)
+ */
+static bool tlog_compact_record(tlog_t* log, const tlog_rec_hdr_t* rec, uint32_t segment,
+                                uint32_t block, uint32_t offset) {
+    uint64_t flags;
+    (void)segment;
+    (void)block;
+    (void)offset;
+
+    // Trim records are dropped too: what they hide is older than them
+    spin_lock_irqsave(&log->lock, flags);
+    bool dead = tlog_record_dead(log, rec);
+    spin_unlock_irqrestore(&log->lock, flags);
+    if (dead) {
+        return true;
+    }
+
+    // Keep seq and timestamp so trims still apply to the copy
+    if (!tlog_append_record(log, TLOG_REC_DATA, rec->key, rec->seq, rec->timestamp,
+                            rec + 1, rec->len)) {
+        return false;
+    }
+    log->stats.compacted_records++;
+    return true;
+}
+
+/*
+ * Free the oldest sealed segment, copying its live records to the head
+ */
+static void tlog_compact(tlog_t* log) {
+    uint32_t victim = TLOG_NO_SEGMENT;
+    uint64_t flags;
+
+    spin_lock_irqsave(&log->lock, flags);
+    for (uint32_t i = 0; i < log->nr_segments; i++) {
+        if (log->segments[i].state == TLOG_SEG_SEALED &&
+            (victim == TLOG_NO_SEGMENT || log->segments[i].generation < log->segments[victim].generation)) {
+            victim = i;
+        }
+    }
+    uint64_t taken = log->batches_taken;
+    spin_unlock_irqrestore(&log->lock, flags);
+    if (victim == TLOG_NO_SEGMENT) {
+        return;
+    }
+
+    // The victim's last batch may still be on its way to the disk
+    if (tlog_sync(log, 0, taken) < 0) {
+        return;
+    }
+
+    // Copying a segment that is all live would only move it; wait for trims
+    log->segments[victim].dead = 0;
+    if (!tlog_scan_segment(log, victim, tlog_count_dead)) {
+        log->stats.compact_errors++;
+        return;
+    }
+    if (log->segments[victim].dead == 0) {
+        log->compact_blocked = true;
+        return;
+    }
+
+    log->compacting = true;
+    bool copied = tlog_scan_segment(log, victim, tlog_compact_record);
+    log->compacting = false;
+    if (!copied) {
+        log->stats.compact_errors++;
+        return;
+    }
+
+    // The copies must be durable before the original goes
+    spin_lock_irqsave(&log->lock, flags);
+    taken = log->batches_taken + 1;
+    spin_unlock_irqrestore(&log->lock, flags);
+    if (tlog_sync(log, 0, taken) < 0) {
+        return;
+    }
+
+    blk_request_t reqs[2];
+    uint8_t* zero = log->scan_pages[0];
+    memset(zero, 0, TLOG_BLOCK_SIZE);
+    if (tlog_rw(log, reqs, BLK_OP_WRITE, tlog_sector(log, victim, 0), &zero, 1, true) < 0) {
+        log->stats.compact_errors++;
+        return;
+    }
+
+    spin_lock_irqsave(&log->lock, flags);
+    log->segments[victim].state = TLOG_SEG_FREE;
+    log->segments[victim].generation = 0;
+    log->segments[victim].records = 0;
+    log->segments[victim].dead = 0;
+    log->free_segments++;
+    log->stats.compactions++;
+    spin_unlock_irqrestore(&log->lock, flags);
+}
+
+/*
+ * Kernel address of a ring region offset (entries never cross a page)
+ */
+static inline void* tlog_ring_ptr(tlog_ring_t* ring, uint32_t offset) {
+    return (void*)(uintptr_t)(ring->pages[offset >> PAGE_SHIFT] + (offset & (PAGE_SIZE - 1)));
+}
+
+static inline tlog_ring_entry_t* tlog_ring_entry(tlog_ring_t* ring, uint32_t idx) {
+    return (tlog_ring_entry_t*)tlog_ring_ptr(ring, PAGE_SIZE +
+                                             (idx & (TLOG_RING_ENTRIES - 1)) * sizeof(tlog_ring_entry_t));
+}
+
+/*
+ * Create a shared ring for one producer
+ */
+tlog_ring_t* tlog_ring_create(tlog_t* log) {
+    static uint32_t nr_rings;
+    tlog_ring_t* ring = (tlog_ring_t*)kzalloc(sizeof(tlog_ring_t));
+    if (!ring) {
+        return NULL;
+    }
+
+    ring->log = log;
+    ring->id = nr_rings++;
+    ring->nr_pages = 1 + TLOG_RING_ENTRIES * sizeof(tlog_ring_entry_t) / PAGE_SIZE;
+    ring->pages = (uint64_t*)kzalloc(ring->nr_pages * sizeof(uint64_t));
+    if (!ring->pages) {
+        return NULL;
+    }
+
+    strncpy(ring->name, "tlog.", sizeof(ring->name) - 1);
+    ring->name[5] = (char)('0' + ring->id / 10 % 10);
+    ring->name[6] = (char)('0' + ring->id % 10);
+    ring->shm = create_shared_memory(ring->name, (size_t)ring->nr_pages * PAGE_SIZE,
+                                     SHM_PERM_READ | SHM_PERM_WRITE, SHM_FLAG_CREATE);
+
+    for (uint32_t i = 0; i < ring->nr_pages; i++) {
+        if (ring->shm) {
+            ring->pages[i] = shared_memory_phys(ring->shm, (size_t)i * PAGE_SIZE);
+        } else {
+            // Without the IPC layer only kernel tasks can produce
+            void* page = alloc_page();
+            if (!page) {
+                return NULL;
+            }
+            ring->pages[i] = (uint64_t)page;
+        }
+        memset((void*)(uintptr_t)ring->pages[i], 0, PAGE_SIZE);
+    }
+    ring->hdr = (tlog_ring_hdr_t*)(uintptr_t)ring->pages[0];
+
+    uint64_t flags;
+    spin_lock_irqsave(&log->lock, flags);
+    ring->next = log->rings;
+    log->rings = ring;
+    spin_unlock_irqrestore(&log->lock, flags);
+    return ring;
+}
+
+/*
+ * Producer: put an entry
+ */
+uint64_t tlog_ring_put(tlog_ring_t* ring, uint64_t key, const void* data, uint16_t len, bool sync) {
+    uint32_t tail = ring->hdr->tail;
+
+    if (len > TLOG_RING_DATA ||
+        tail - __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE) >= TLOG_RING_ENTRIES) {
+        return 0;
+    }
+
+    tlog_ring_entry_t* entry = tlog_ring_entry(ring, tail);
+    entry->key = key;
+    entry->len = len;
+    entry->sync = sync;
+    memcpy(entry->data, data, len);
+    __atomic_store_n(&ring->hdr->tail, tail + 1, __ATOMIC_RELEASE);
+
+    // Entry numbers count from 1, in put order
+    return ++ring->produced;
+}
+
+/*
+ * Producer: wait until an entry is durable
+ */
+void tlog_ring_wait(tlog_ring_t* ring, uint64_t entry) {
+    for (;;) {
+        if (__atomic_load_n(&ring->hdr->durable, __ATOMIC_ACQUIRE) >= entry) {
+            return;
+        }
+
+        // Blocked before the final check, so a commit in between is not lost
+        prepare_to_block();
+        __atomic_store_n(&ring->waiter, get_current_pid(), __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->hdr->durable, __ATOMIC_SEQ_CST) >= entry) {
+            __atomic_store_n(&ring->waiter, PID_INVALID, __ATOMIC_SEQ_CST);
+            cancel_block();
+            return;
+        }
+        schedule();
+    }
+}
+
+/*
+ * Drain every ring into the log; returns true if an entry asked for a
+ * commit
+ */
+static bool tlogd_drain(tlog_t* log, uint32_t* drained) {
+    bool sync = false;
+
+    for (tlog_ring_t* ring = log->rings; ring; ring = ring->next) {
+        uint32_t head = ring->hdr->head;
+        uint32_t tail = __atomic_load_n(&ring->hdr->tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail) {
+            tlog_ring_entry_t* entry = tlog_ring_entry(ring, head);
+            uint64_t seq = tlog_append(log, entry->key, entry->data, entry->len);
+            if (seq == 0) {
+                ring->hdr->dropped++;
+            } else {
+                ring->last_seq = seq;
+            }
+            sync |= entry->sync != 0;
+            head++;
+            ring->consumed++;
+            (*drained)++;
+        }
+        __atomic_store_n(&ring->hdr->head, head, __ATOMIC_RELEASE);
+    }
+    return sync;
+}
+
+/*
+ * Tell producers how far their entries are durable
+ */
+static void tlogd_publish(tlog_t* log) {
+    for (tlog_ring_t* ring = log->rings; ring; ring = ring->next) {
+        if (ring->last_seq > log->durable_seq || ring->hdr->durable == ring->consumed) {
+            continue;
+        }
+        __atomic_store_n(&ring->hdr->durable, ring->consumed, __ATOMIC_SEQ_CST);
+
+        pid_t waiter = __atomic_exchange_n(&ring->waiter, PID_INVALID, __ATOMIC_SEQ_CST);
+        if (waiter != PID_INVALID) {
+            unblock_task(waiter);
+        }
+    }
+}
+
+/*
+ * tlogd: drain the rings, commit when asked or when the commit window
+ * has passed, and compact when free segments run low
+ */
+static void tlogd_main(void) {
+    tlog_t* log = &tlog_store;
+
+    while (1) {
+        uint32_t drained = 0;
+        bool sync = tlogd_drain(log, &drained);
+
+        uint64_t pending = log->first_pending_tick;
+        if (sync || (pending && get_tick_count() - pending >= TLOG_COMMIT_MS)) {
+            tlog_commit(log, log->next_seq - 1);
+        }
+        tlogd_publish(log);
+
+        if (log->free_segments < TLOG_COMPACT_FREE_MIN && !log->compact_blocked) {
+            tlog_compact(log);
+        }
+
+        if (drained == 0) {
+            sleep_task(1);
+        }
+    }
+}
+
+/*
+ * Open the store
+ */
+tlog_t* tlog_open(virtio_blk_t* blk, uint64_t start_block, uint64_t nr_blocks, bool format) {
+    tlog_t* log = &tlog_store;
+    blk_request_t req;
+
+    if (!blk || tlog_store_open || nr_blocks < 1 + 4 * TLOG_SEG_BLOCKS ||
+        (start_block + nr_blocks) * TLOG_BLOCK_SECTORS > blk->capacity) {
+        return NULL;
+    }
+
+    memset(log, 0, sizeof(*log));
+    log->blk = blk;
+    log->start_block = start_block;
+    log->nr_segments = (uint32_t)((nr_blocks - 1) / TLOG_SEG_BLOCKS);
+    if (log->nr_segments > TLOG_MAX_SEGMENTS) {
+        log->nr_segments = TLOG_MAX_SEGMENTS;
+    }
+    log->free_segments = log->nr_segments;
+    log->lock = (spinlock_t)SPINLOCK_INIT;
+    log->head = TLOG_NO_SEGMENT;
+    log->next_seq = 1;
+    log->filling = &log->batches[0];
+    log->batches[0].segment = TLOG_NO_SEGMENT;
+    log->batches[1].segment = TLOG_NO_SEGMENT;
+
+    log->index = (tlog_index_entry_t*)kzalloc(TLOG_INDEX_SIZE * sizeof(tlog_index_entry_t));
+    if (!log->index) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < TLOG_BATCH_BLOCKS; i++) {
+        log->batches[0].pages[i] = (uint8_t*)alloc_page();
+        log->batches[1].pages[i] = (uint8_t*)alloc_page();
+        log->scan_pages[i] = (uint8_t*)alloc_page();
+        if (!log->batches[0].pages[i] || !log->batches[1].pages[i] || !log->scan_pages[i]) {
+            LOG_ERROR("tlog: out of memory");
+            return NULL;
+        }
+    }
+    crc32_init();
+
+    uint64_t start = rdtsc();
+    if (tlog_rw(log, &req, BLK_OP_READ, start_block * TLOG_BLOCK_SECTORS, log->scan_pages, 1, false) < 0) {
+        return NULL;
+    }
+    tlog_super_t* super = (tlog_super_t*)log->scan_pages[0];
+    bool valid = super->magic == TLOG_MAGIC && super->version == TLOG_VERSION &&
+                 super->seg_blocks == TLOG_SEG_BLOCKS && super->nr_segments == log->nr_segments;
+    log->epoch = super->epoch;
+
+    if (format || !valid) {
+        if (tlog_format(log) < 0) {
+            LOG_ERROR("tlog: cannot format");
+            return NULL;
+        }
+        kernel_printf("tlog: formatted %u segments of %u KB\n", log->nr_segments,
+                      TLOG_SEG_BLOCKS * TLOG_BLOCK_SIZE / 1024);
+    } else {
+        if (tlog_recover(log) < 0) {
+            LOG_ERROR("tlog: recovery failed");
+            return NULL;
+        }
+        log->stats.recovery_us = tsc_to_ns(rdtsc() - start) / 1000;
+        kernel_printf("tlog: recovered %llu records (%u keys, %u of %u segments) in %llu us\n",
+                      log->stats.recovered_records, log->nr_keys,
+                      log->nr_segments - log->free_segments, log->nr_segments,
+                      log->stats.recovery_us);
+    }
+
+    tlog_store_open = true;
+    log->service = create_kernel_task("tlogd", tlogd_main, TASK_PRIORITY_HIGH);
+    return log;
+}
+
+/*
+ * Print counters
+ */
+void dump_tlog_stats(tlog_t* log) {
+    tlog_stats_t* s = &log->stats;
+
+    kernel_printf("tlog: %llu appends, %llu commits (%llu records, %llu blocks), durable seq %llu\n",
+                  s->appends, s->commits, s->committed_records, s->blocks_written,
+                  log->durable_seq);
+    kernel_printf("      %u keys, %u free segments, %llu compactions (%llu records copied), "
+                  "%llu refused\n",
+                  log->nr_keys, log->free_segments, s->compactions, s->compacted_records,
+                  s->full_errors);
+}
@@ -0,0 +1,202 @@
+/*
+ * EdgeX OS - Tracepoints
+ *
+ * This file implements the per-CPU trace rings. A CPU writes only its
+ * own ring, with interrupts off, so a record costs a timestamp and a
+ * 32-byte store. The rings keep the newest records: once full, each new
+ * record replaces the oldest. Readers only look at a ring after tracing
+ * has stopped and its CPU has left the tracepoint it was in.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/scheduler.h>
+#include <edgex/tsc.h>
+#include <edgex/uart.h>
+#include <edgex/trace.h>
+
+#ifdef CONFIG_TRACE
+
+#define TRACE_BUF_MASK          (TRACE_BUF_RECORDS - 1)
+#define TRACE_FRAME_RECORDS     (UART_FRAME_MAX / sizeof(trace_record_t))
+#define TRACE_FRAME_TASKS       (UART_FRAME_MAX / sizeof(trace_task_t))
+
+typedef struct {
+    uint64_t head;               /* Records written, free running */
+    volatile uint32_t busy;      /* Inside trace_emit() */
+    trace_record_t* records;
+} __attribute__((aligned(64))) trace_buf_t;
+
+volatile bool trace_on;
+
+static trace_buf_t trace_bufs[MAX_CPUS];
+
+/* Task list staging for trace_dump() */
+static trace_task_t trace_tasks[TRACE_FRAME_TASKS];
+static uint32_t trace_nr_tasks;
+static uart_t* trace_uart;
+
+/*
+ * Write a record into this CPU's ring
+ */
+void trace_emit(uint16_t event, uint64_t arg0, uint64_t arg1) {
+    uint64_t flags = local_irq_save();
+    uint32_t cpu = smp_processor_id();
+    trace_buf_t* buf = &trace_bufs[cpu];
+
+    buf->busy = 1;
+    barrier();
+    if (trace_on && buf->records) {
+        task_t* current = get_current_task();
+        trace_record_t* rec = &buf->records[buf->head & TRACE_BUF_MASK];
+
+        rec->tsc = rdtsc();
+        rec->event = event;
+        rec->cpu = (uint8_t)cpu;
+        rec->reserved = 0;
+        rec->pid = current ? current->pid : 0;
+        rec->arg0 = arg0;
+        rec->arg1 = arg1;
+        buf->head++;
+    }
+    barrier();
+    buf->busy = 0;
+    local_irq_restore(flags);
+}
+
+/*
+ * Allocate the rings of the CPUs online now
+ */
+void init_trace(void) {
+    cpumask_t online = cpu_online_mask();
+    uint32_t cpus = 0;
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpumask_test(online, cpu)) {
+            continue;
+        }
+        trace_bufs[cpu].records = kzalloc(TRACE_BUF_RECORDS * sizeof(trace_record_t));
+        if (!trace_bufs[cpu].records) {
+            kernel_printf("trace: no memory for CPU %u\n", cpu);
+            continue;
+        }
+        cpus++;
+    }
+
+    kernel_printf("trace: %u records per CPU on %u CPUs\n", TRACE_BUF_RECORDS, cpus);
+}
+
+/*
+ * Wait until no CPU is inside trace_emit() (tracing off)
+ */
+static void trace_quiesce(void) {
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        while (trace_bufs[cpu].busy) {
+            cpu_relax();
+        }
+    }
+}
+
+void trace_start(void) {
+    trace_on = false;
+    trace_quiesce();
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        trace_bufs[cpu].head = 0;
+    }
+    __atomic_store_n(&trace_on, true, __ATOMIC_RELEASE);
+}
+
+void trace_stop(void) {
+    __atomic_store_n(&trace_on, false, __ATOMIC_RELEASE);
+    trace_quiesce();
+}
+
+/*
+ * Send the staged task entries as a frame
+ */
+static void trace_flush_tasks(void) {
+    if (trace_nr_tasks > 0) {
+        uart_write_frame(trace_uart, UART_FRAME_TRACE_TASK, trace_tasks,
+                         trace_nr_tasks * sizeof(trace_task_t));
+        trace_nr_tasks = 0;
+    }
+}
+
+static void trace_add_task(task_t* task, void* arg) {
+    (void)arg;
+
+    trace_task_t* entry = &trace_tasks[trace_nr_tasks++];
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = task->pid;
+    memcpy(entry->name, task->name, sizeof(entry->name) - 1);
+
+    // Only long task lists are sent with the scheduler lock held
+    if (trace_nr_tasks == TRACE_FRAME_TASKS) {
+        trace_flush_tasks();
+    }
+}
+
+/*
+ * Send the rings out of a port: an info frame, the task names, then each
+ * CPU's records oldest first. Returns the records sent.
+ */
+uint64_t trace_dump(uart_t* uart) {
+    trace_info_t info;
+    uint64_t lost = 0;
+    uint32_t cpus = 0;
+
+    trace_stop();
+
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        trace_buf_t* buf = &trace_bufs[cpu];
+        if (buf->records) {
+            cpus++;
+            if (buf->head > TRACE_BUF_RECORDS) {
+                lost += buf->head - TRACE_BUF_RECORDS;
+            }
+        }
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.magic = TRACE_INFO_MAGIC;
+    info.version = TRACE_INFO_VERSION;
+    info.record_size = sizeof(trace_record_t);
+    info.tsc_khz = tsc_khz();
+    info.nr_cpus = cpus;
+    info.lost = lost;
+    uart_write_frame(uart, UART_FRAME_TRACE_INFO, &info, sizeof(info));
+
+    trace_uart = uart;
+    trace_nr_tasks = 0;
+    for_each_task(trace_add_task, NULL);
+    trace_flush_tasks();
+
+    uint64_t records = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        trace_buf_t* buf = &trace_bufs[cpu];
+        if (!buf->records) {
+            continue;
+        }
+
+        uint64_t pos = buf->head > TRACE_BUF_RECORDS ? buf->head - TRACE_BUF_RECORDS : 0;
+        while (pos < buf->head) {
+            // A frame of records, up to the end of the ring
+            uint64_t n = buf->head - pos;
+            uint64_t until_wrap = TRACE_BUF_RECORDS - (pos & TRACE_BUF_MASK);
+            if (n > TRACE_FRAME_RECORDS) {
+                n = TRACE_FRAME_RECORDS;
+            }
+            if (n > until_wrap) {
+                n = until_wrap;
+            }
+            uart_write_frame(uart, UART_FRAME_TRACE_DATA, &buf->records[pos & TRACE_BUF_MASK],
+                             n * sizeof(trace_record_t));
+            pos += n;
+        }
+        records += buf->head < TRACE_BUF_RECORDS ? buf->head : TRACE_BUF_RECORDS;
+    }
+    uart_drain(uart);
+    return records;
+}
+
+#endif /* CONFIG_TRACE */
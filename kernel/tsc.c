@@ -0,0 +1,116 @@
+/*
+ * EdgeX OS - Time Stamp Counter
+ *
+ * This file calibrates the TSC against PIT channel 2 and provides
+ * cycle/nanosecond conversion for latency measurements.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/tsc.h>
+
+/* PIT channel 2 is gated through the keyboard controller port B */
+#define PIT_CHANNEL2_DATA   0x42
+#define PIT_COMMAND_PORT    0x43
+#define PIT_PORT_B          0x61
+#define PIT_FREQUENCY       1193182
+
+/* Calibration window (10ms) */
+#define CALIBRATE_MS        10
+#define CALIBRATE_LATCH     ((PIT_FREQUENCY * CALIBRATE_MS) / 1000)
+
+/* Fallback when calibration fails */
+#define TSC_DEFAULT_KHZ     1000000
+
+/* Fixed-point multiplier for cycles -> ns (ns = cycles * mult >> shift) */
+#define TSC_SCALE_SHIFT     22
+
+static uint64_t tsc_freq_khz = 0;
+static uint64_t tsc_ns_mult = 0;
+static uint64_t tsc_base = 0;
+
+/*
+ * Measure TSC cycles elapsed while PIT channel 2 counts down
+ */
+static uint64_t measure_tsc_with_pit(void) {
+    // Enable the channel 2 gate, disable the speaker output
+    outb(PIT_PORT_B, (inb(PIT_PORT_B) & ~0x02) | 0x01);
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(PIT_COMMAND_PORT, 0xB0);
+    outb(PIT_CHANNEL2_DATA, CALIBRATE_LATCH & 0xFF);
+    outb(PIT_CHANNEL2_DATA, (CALIBRATE_LATCH >> 8) & 0xFF);
+
+    uint64_t start = rdtsc();
+    uint64_t loops = 0;
+
+    // OUT2 (bit 5 of port B) goes high at terminal count
+    while ((inb(PIT_PORT_B) & 0x20) == 0) {
+        if (++loops > 100000000ULL) {
+            return 0;
+        }
+    }
+
+    return rdtsc() - start;
+}
+
+/*
+ * Calibrate the TSC
+ */
+void init_tsc(void) {
+    uint64_t best = 0;
+
+    // Take the fastest of a few runs to discard SMI/virtualization noise
+    for (int i = 0; i < 3; i++) {
+        uint64_t cycles = measure_tsc_with_pit();
+        if (cycles && (best == 0 || cycles < best)) {
+            best = cycles;
+        }
+    }
+
+    if (best) {
+        tsc_freq_khz = best / CALIBRATE_MS;
+    } else {
+        tsc_freq_khz = TSC_DEFAULT_KHZ;
+        kernel_printf("TSC calibration failed, assuming %llu kHz\n", tsc_freq_khz);
+    }
+
+    tsc_ns_mult = (1000000ULL << TSC_SCALE_SHIFT) / tsc_freq_khz;
+    tsc_base = rdtsc();
+
+    kernel_printf("TSC calibrated at %llu.%03llu MHz\n",
+                  tsc_freq_khz / 1000, tsc_freq_khz % 1000);
+}
+
+/*
+ * Get the TSC frequency in kHz
+ */
+uint64_t tsc_khz(void) {
+    return tsc_freq_khz;
+}
+
+/*
+ * Convert TSC cycles to nanoseconds
+ */
+uint64_t tsc_to_ns(uint64_t cycles) {
+    // Split to avoid overflowing the 64-bit intermediate product
+    uint64_t hi = cycles >> 32;
+    uint64_t lo = cycles & 0xFFFFFFFFULL;
+
+    return ((hi * tsc_ns_mult) << (32 - TSC_SCALE_SHIFT)) +
+           ((lo * tsc_ns_mult) >> TSC_SCALE_SHIFT);
+}
+
+/*
+ * Convert nanoseconds to TSC cycles
+ */
+uint64_t ns_to_tsc(uint64_t ns) {
+    return (ns / 1000000ULL) * tsc_freq_khz +
+           ((ns % 1000000ULL) * tsc_freq_khz) / 1000000ULL;
+}
+
+/*
+ * Nanoseconds since calibration
+ */
+uint64_t tsc_now_ns(void) {
+    return tsc_to_ns(rdtsc() - tsc_base);
+}
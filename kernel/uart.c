@@ -0,0 +1,455 @@
+/*
+ * EdgeX OS - 16550 UART
+ *
+ * This file implements the serial ports. A writer copies its bytes into
+ * the port's ring and returns; the THRE interrupt then refills the TX
+ * FIFO a whole FIFO at a time, so the CPU takes one interrupt per 16
+ * bytes (64 on a 16750) instead of waiting on the line for each byte.
+ * Before interrupts are up, when the ring is full and after a panic the
+ * writer sends by polling, still a FIFO at a time.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/interrupt.h>
+#include <edgex/spinlock.h>
+#include <edgex/klog.h>
+#include <edgex/uart.h>
+
+#define UART_RING_MASK          (UART_TX_RING_SIZE - 1)
+
+/* Bounded wait for a lock a panicking CPU may never get */
+#define UART_PANIC_SPINS        10000000
+
+static uart_t uart_ports[UART_MAX_PORTS];
+static const uint16_t uart_bases[UART_MAX_PORTS] = { UART_COM1_PORT, UART_COM2_PORT };
+static const uint8_t uart_irqs[UART_MAX_PORTS] = { IRQ_COM1, IRQ_COM2 };
+
+static void uart_console_write(const char* buf, size_t len);
+static void uart_console_flush(void);
+
+static klog_console_t uart_console = {
+    .name = "ttyS0",
+    .write = uart_console_write,
+    .flush = uart_console_flush,
+    .next = NULL
+};
+
+static inline uint8_t uart_in(uart_t* uart, uint16_t reg) {
+    return inb(uart->base + reg);
+}
+
+static inline void uart_out(uart_t* uart, uint16_t reg, uint8_t value) {
+    outb(uart->base + reg, value);
+}
+
+static inline uint32_t uart_used(uart_t* uart) {
+    return uart->head - uart->tail;
+}
+
+/*
+ * Take the port lock with interrupts off; the lock is raw so it works
+ * before the per-CPU data exists and from the interrupt handler
+ */
+static inline uint64_t uart_lock(uart_t* uart) {
+    uint64_t flags = local_irq_save();
+    arch_spin_lock(&uart->lock);
+    return flags;
+}
+
+static inline void uart_unlock(uart_t* uart, uint64_t flags) {
+    arch_spin_unlock(&uart->lock);
+    local_irq_restore(flags);
+}
+
+static void uart_set_thri(uart_t* uart, bool enable) {
+    if (uart->thri_enabled != enable) {
+        uart->thri_enabled = enable;
+        uart_out(uart, UART_IER, enable ? UART_IER_THRI : 0);
+    }
+}
+
+/*
+ * Move up to a FIFO of bytes from the ring to the port if its FIFO is
+ * empty (lock held); returns the bytes moved
+ */
+static uint32_t uart_fill_fifo(uart_t* uart) {
+    if (!(uart_in(uart, UART_LSR) & UART_LSR_THRE)) {
+        return 0;
+    }
+
+    uint32_t n = uart_used(uart);
+    if (n > uart->fifo_size) {
+        n = uart->fifo_size;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uart_out(uart, UART_THR, uart->ring[(uart->tail + i) & UART_RING_MASK]);
+    }
+    uart->tail += n;
+    if (n > 0) {
+        uart->stats.tx_bytes += n;
+        uart->stats.fifo_fills++;
+    }
+    return n;
+}
+
+/*
+ * Send by polling until the ring has room for len bytes (lock held)
+ */
+static void uart_poll_out(uart_t* uart, uint32_t len) {
+    while (UART_TX_RING_SIZE - uart_used(uart) < len) {
+        uint32_t n = uart_fill_fifo(uart);
+        if (n == 0) {
+            cpu_relax();
+        }
+        uart->stats.polled_bytes += n;
+    }
+}
+
+/*
+ * Start sending what was queued (lock held)
+ */
+static void uart_kick(uart_t* uart) {
+    if (!uart->irq_mode || uart->polled) {
+        uart_poll_out(uart, UART_TX_RING_SIZE);
+        return;
+    }
+
+    // The interrupt comes when the FIFO filled here runs empty
+    uart_fill_fifo(uart);
+    uart_set_thri(uart, uart_used(uart) > 0);
+}
+
+/*
+ * Copy bytes into the ring, waiting on the line if it is full (lock held)
+ */
+static void uart_put(uart_t* uart, const uint8_t* data, uint32_t len) {
+    if (UART_TX_RING_SIZE - uart_used(uart) < len) {
+        uart->stats.ring_full++;
+        uart_poll_out(uart, len);
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        uart->ring[(uart->head + i) & UART_RING_MASK] = data[i];
+    }
+    uart->head += len;
+}
+
+/*
+ * THRE interrupt: refill the FIFO, stop when the ring is empty
+ */
+static irqreturn_t uart_interrupt(uint8_t irq, void* dev_data) {
+    uart_t* uart = (uart_t*)dev_data;
+    irqreturn_t ret = IRQ_NONE;
+
+    arch_spin_lock(&uart->lock);
+    for (;;) {
+        uint8_t iir = uart_in(uart, UART_IIR);
+        if (iir & UART_IIR_NO_INT) {
+            break;
+        }
+        ret = IRQ_HANDLED;
+
+        switch (iir & UART_IIR_ID_MASK) {
+        case UART_IIR_THRI:
+            uart->stats.tx_irqs++;
+            uart_fill_fifo(uart);
+            break;
+        case UART_IIR_RDI:
+        case UART_IIR_TIMEOUT:
+            // Nothing reads the port yet
+            while (uart_in(uart, UART_LSR) & UART_LSR_DR) {
+                uart_in(uart, UART_RBR);
+            }
+            break;
+        default:
+            uart_in(uart, UART_LSR);
+            break;
+        }
+    }
+    uart_set_thri(uart, uart_used(uart) > 0 && !uart->polled);
+    arch_spin_unlock(&uart->lock);
+
+    return ret;
+}
+
+/*
+ * Program the divisor (lock held, FIFO drained)
+ */
+static void uart_program_baud(uart_t* uart, uint32_t baud) {
+    uint16_t divisor = (uint16_t)(UART_CLOCK_BAUD / baud);
+
+    uart_out(uart, UART_LCR, UART_LCR_DLAB);
+    uart_out(uart, UART_DLL, (uint8_t)(divisor & 0xFF));
+    uart_out(uart, UART_DLM, (uint8_t)(divisor >> 8));
+    uart_out(uart, UART_LCR, UART_LCR_8N1);
+    uart->baud = baud;
+}
+
+/*
+ * Check for a port and set it up: 8N1, FIFOs on, interrupts off
+ */
+static bool uart_probe(uart_t* uart, uint16_t base, uint8_t irq) {
+    uart->base = base;
+    uart->irq = irq;
+    spin_lock_init(&uart->lock);
+
+    // No port: the scratch register does not keep what we write
+    uart_out(uart, UART_SCR, 0x5A);
+    if (uart_in(uart, UART_SCR) != 0x5A) {
+        return false;
+    }
+    uart_out(uart, UART_SCR, 0xA5);
+    if (uart_in(uart, UART_SCR) != 0xA5) {
+        return false;
+    }
+
+    uart_out(uart, UART_IER, 0);
+    uart_program_baud(uart, UART_DEFAULT_BAUD);
+
+    // The 64-byte FIFO bit is only writable with DLAB set
+    uart_out(uart, UART_LCR, UART_LCR_DLAB);
+    uart_out(uart, UART_FCR, UART_FCR_ENABLE | UART_FCR_CLEAR_RX | UART_FCR_CLEAR_TX |
+                             UART_FCR_64BYTE | UART_FCR_TRIGGER_14);
+    uart_out(uart, UART_LCR, UART_LCR_8N1);
+
+    uint8_t iir = uart_in(uart, UART_IIR);
+    if ((iir & UART_IIR_FIFO_MASK) != UART_IIR_FIFO_MASK) {
+        uart->fifo_size = 1;
+    } else {
+        uart->fifo_size = (iir & 0x20) ? 64 : 16;
+    }
+
+    uart_out(uart, UART_MCR, UART_MCR_DTR | UART_MCR_RTS | UART_MCR_OUT2);
+    uart->present = true;
+    return true;
+}
+
+/*
+ * Log console on COM1: newlines become CR LF
+ */
+static void uart_console_write(const char* buf, size_t len) {
+    uart_t* uart = &uart_ports[0];
+    uint8_t chunk[256];
+    uint32_t n = 0;
+
+    if (uart->binary) {
+        __atomic_fetch_add(&uart->stats.text_suppressed, len, __ATOMIC_RELAXED);
+        return;
+    }
+
+    uint64_t flags = uart_lock(uart);
+    for (size_t i = 0; i < len; i++) {
+        if (n + 2 > sizeof(chunk)) {
+            uart_put(uart, chunk, n);
+            n = 0;
+        }
+        if (buf[i] == '\n') {
+            chunk[n++] = '\r';
+        }
+        chunk[n++] = (uint8_t)buf[i];
+    }
+    uart_put(uart, chunk, n);
+    uart_kick(uart);
+    uart_unlock(uart, flags);
+}
+
+/*
+ * Panic: switch COM1 to polling and send everything queued
+ *
+ * The lock may belong to the code the panic interrupted; after a while
+ * the ring is sent without it.
+ */
+static void uart_console_flush(void) {
+    uart_t* uart = &uart_ports[0];
+    bool locked = false;
+
+    for (uint32_t spins = 0; spins < UART_PANIC_SPINS && !locked; spins++) {
+        locked = arch_spin_trylock(&uart->lock);
+        if (!locked) {
+            cpu_relax();
+        }
+    }
+
+    uart->polled = true;
+    uart->binary = false;
+    uart_set_thri(uart, false);
+    uart_poll_out(uart, UART_TX_RING_SIZE);
+    while (!(uart_in(uart, UART_LSR) & UART_LSR_TEMT)) {
+        cpu_relax();
+    }
+
+    if (locked) {
+        arch_spin_unlock(&uart->lock);
+    }
+}
+
+/*
+ * Find the ports and put the log on COM1
+ */
+void init_uart(void) {
+    for (uint32_t i = 0; i < UART_MAX_PORTS; i++) {
+        uart_probe(&uart_ports[i], uart_bases[i], uart_irqs[i]);
+    }
+
+    if (uart_ports[0].present) {
+        klog_register_console(&uart_console);
+        kernel_printf("uart: ttyS0 at 0x%x, %u baud, %u-byte FIFO\n", uart_ports[0].base,
+                      uart_ports[0].baud, uart_ports[0].fifo_size);
+    }
+    if (uart_ports[1].present) {
+        kernel_printf("uart: ttyS1 at 0x%x, %u-byte FIFO\n", uart_ports[1].base,
+                      uart_ports[1].fifo_size);
+    }
+}
+
+/*
+ * Hand the draining to the THRE interrupt
+ */
+void uart_enable_irqs(void) {
+    for (uint32_t i = 0; i < UART_MAX_PORTS; i++) {
+        uart_t* uart = &uart_ports[i];
+        if (!uart->present) {
+            continue;
+        }
+        if (request_irq(uart->irq, uart_interrupt, i == 0 ? "ttyS0" : "ttyS1", uart) != 0) {
+            continue;
+        }
+
+        uint64_t flags = uart_lock(uart);
+        uart->irq_mode = true;
+        uart_kick(uart);
+        uart_unlock(uart, flags);
+    }
+}
+
+uart_t* uart_get(uint32_t index) {
+    if (index >= UART_MAX_PORTS || !uart_ports[index].present) {
+        return NULL;
+    }
+    return &uart_ports[index];
+}
+
+/*
+ * Wait until the ring and the transmitter are empty
+ */
+void uart_drain(uart_t* uart) {
+    for (;;) {
+        uint64_t flags = uart_lock(uart);
+
+        // Poll if the interrupt cannot come (off here, or not set up)
+        if (!uart->irq_mode || uart->polled || !(flags & RFLAGS_IF)) {
+            uart->stats.polled_bytes += uart_fill_fifo(uart);
+        }
+        bool empty = uart_used(uart) == 0 && (uart_in(uart, UART_LSR) & UART_LSR_TEMT);
+        uart_unlock(uart, flags);
+
+        if (empty) {
+            return;
+        }
+        cpu_relax();
+    }
+}
+
+int uart_set_baud(uart_t* uart, uint32_t baud) {
+    if (baud == 0 || baud > UART_CLOCK_BAUD || UART_CLOCK_BAUD / baud > 0xFFFF) {
+        return -1;
+    }
+
+    uart_drain(uart);
+    uint64_t flags = uart_lock(uart);
+    uart_program_baud(uart, baud);
+    uart_unlock(uart, flags);
+    return 0;
+}
+
+void uart_write(uart_t* uart, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+
+    while (len > 0) {
+        uint32_t n = len > UART_TX_RING_SIZE / 2 ? UART_TX_RING_SIZE / 2 : (uint32_t)len;
+        uint64_t flags = uart_lock(uart);
+        uart_put(uart, p, n);
+        uart_kick(uart);
+        uart_unlock(uart, flags);
+        p += n;
+        len -= n;
+    }
+}
+
+/*
+ * Fletcher-16 over part of a frame
+ */
+static void uart_frame_sum(const uint8_t* data, uint32_t len, uint32_t* sum1, uint32_t* sum2) {
+    for (uint32_t i = 0; i < len; i++) {
+        *sum1 = (*sum1 + data[i]) % 255;
+        *sum2 = (*sum2 + *sum1) % 255;
+    }
+}
+
+/*
+ * Queue data as frames; each frame enters the ring whole, so text from
+ * other CPUs never lands inside one
+ */
+void uart_write_frame(uart_t* uart, uint8_t type, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+
+    do {
+        uint32_t n = len > UART_FRAME_MAX ? UART_FRAME_MAX : (uint32_t)len;
+        uint8_t hdr[UART_FRAME_HDR_LEN];
+        uint8_t trailer[2];
+        uint32_t sum1 = 0, sum2 = 0;
+
+        memcpy(hdr, UART_FRAME_SYNC, UART_FRAME_SYNC_LEN);
+        hdr[UART_FRAME_SYNC_LEN] = type;
+        hdr[UART_FRAME_SYNC_LEN + 1] = (uint8_t)(n & 0xFF);
+        hdr[UART_FRAME_SYNC_LEN + 2] = (uint8_t)(n >> 8);
+        uart_frame_sum(hdr + UART_FRAME_SYNC_LEN, 3, &sum1, &sum2);
+        uart_frame_sum(p, n, &sum1, &sum2);
+        trailer[0] = (uint8_t)sum1;
+        trailer[1] = (uint8_t)sum2;
+
+        uint64_t flags = uart_lock(uart);
+        if (UART_TX_RING_SIZE - uart_used(uart) < sizeof(hdr) + n + sizeof(trailer)) {
+            uart->stats.ring_full++;
+            uart_poll_out(uart, sizeof(hdr) + n + sizeof(trailer));
+        }
+        uart_put(uart, hdr, sizeof(hdr));
+        uart_put(uart, p, n);
+        uart_put(uart, trailer, sizeof(trailer));
+        uart->stats.frames++;
+        uart_kick(uart);
+        uart_unlock(uart, flags);
+
+        p += n;
+        len -= n;
+    } while (len > 0);
+}
+
+/*
+ * Binary mode: log text for the port is dropped (and counted) so a
+ * stream of frames gets the whole line
+ */
+void uart_set_binary(uart_t* uart, bool binary) {
+    uart->binary = binary;
+}
+
+void uart_get_stats(uart_t* uart, uart_stats_t* stats) {
+    uint64_t flags = uart_lock(uart);
+    *stats = uart->stats;
+    uart_unlock(uart, flags);
+}
+
+void dump_uart_stats(void) {
+    for (uint32_t i = 0; i < UART_MAX_PORTS; i++) {
+        uart_t* uart = &uart_ports[i];
+        uart_stats_t s;
+
+        if (!uart->present) {
+            continue;
+        }
+        uart_get_stats(uart, &s);
+        kernel_printf("ttyS%u: %llu bytes in %llu FIFO fills (%llu irqs, %llu polled), "
+                      "%llu frames, %llu ring full, %llu text suppressed\n",
+                      i, s.tx_bytes, s.fifo_fills, s.tx_irqs, s.polled_bytes, s.frames,
+                      s.ring_full, s.text_suppressed);
+    }
+}
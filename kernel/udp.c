@@ -0,0 +1,496 @@
+/*
+ * EdgeX OS - UDP Sockets
+ *
+ * This file implements the socket side of the UDP stack. Each socket
+ * region has a single-producer, single-consumer descriptor ring per
+ * network queue: the queue's NET_RX softirq produces and the socket's
+ * task consumes, so neither side takes a lock on the data path. Transmit
+ * slots are handed out from a free list and come back on TX completion.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/cpu.h>
+#include <edgex/scheduler.h>
+#include <edgex/ipc.h>
+#include <edgex/virtio_net.h>
+#include <edgex/net.h>
+#include <edgex/udp.h>
+
+_Static_assert(sizeof(udp_desc_t) == 32, "udp_desc_t must stay 32 bytes");
+_Static_assert(sizeof(udp_shared_t) <= PAGE_SIZE, "udp_shared_t must fit in one page");
+
+static udp_socket_t udp_sockets[UDP_MAX_SOCKETS];
+static volatile uint32_t udp_busy[UDP_MAX_SOCKETS];   /* Deliveries in progress */
+static spinlock_t udp_lock = SPINLOCK_INIT;
+
+/*
+ * Kernel address of a region offset (objects never cross a page)
+ */
+static inline void* udp_ptr(udp_socket_t* sock, uint32_t offset) {
+    // Region pages are below the identity-mapped limit
+    return (void*)(uintptr_t)(sock->pages[offset >> PAGE_SHIFT] + (offset & (PAGE_SIZE - 1)));
+}
+
+static inline udp_desc_t* udp_ring_entry(udp_socket_t* sock, uint32_t ring, uint32_t idx) {
+    uint32_t offset = sock->shared->rings_offset +
+                      (ring * UDP_RING_SIZE + (idx & (UDP_RING_SIZE - 1))) * sizeof(udp_desc_t);
+    return (udp_desc_t*)udp_ptr(sock, offset);
+}
+
+static inline uint32_t udp_tx_offset(udp_socket_t* sock, uint32_t slot) {
+    return sock->shared->tx_offset + slot * UDP_TX_SLOT_SIZE + NET_UDP_HEADROOM;
+}
+
+/*
+ * Write a port number into a region name ("udp.<port>")
+ */
+static void udp_region_name(char* name, uint16_t port) {
+    char digits[6];
+    int n = 0;
+
+    strncpy(name, "udp.", 16);
+    do {
+        digits[n++] = (char)('0' + port % 10);
+        port /= 10;
+    } while (port);
+
+    int pos = 4;
+    while (n) {
+        name[pos++] = digits[--n];
+    }
+    name[pos] = '\0';
+}
+
+/*
+ * Allocate a socket's region, shared if the IPC layer is up
+ */
+static int udp_alloc_region(udp_socket_t* sock, uint32_t nr_rings) {
+    uint32_t ring_pages = (nr_rings * UDP_RING_SIZE * sizeof(udp_desc_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t tx_pages = UDP_TX_SLOTS * UDP_TX_SLOT_SIZE / PAGE_SIZE;
+
+    sock->nr_pages = 1 + ring_pages + tx_pages;
+    sock->pages = (uint64_t*)kzalloc(sock->nr_pages * sizeof(uint64_t));
+    if (!sock->pages) {
+        return -1;
+    }
+
+    udp_region_name(sock->name, sock->port);
+    sock->shm = create_shared_memory(sock->name, (size_t)sock->nr_pages * PAGE_SIZE,
+                                     SHM_PERM_READ | SHM_PERM_WRITE, SHM_FLAG_CREATE);
+
+    for (uint32_t i = 0; i < sock->nr_pages; i++) {
+        if (sock->shm) {
+            sock->pages[i] = shared_memory_phys(sock->shm, (size_t)i * PAGE_SIZE);
+        } else {
+            // Without the IPC layer the socket is usable from kernel tasks only
+            void* page = alloc_page();
+            if (!page) {
+                return -1;
+            }
+            memset(page, 0, PAGE_SIZE);
+            sock->pages[i] = (uint64_t)page;
+        }
+    }
+
+    sock->shared = (udp_shared_t*)(uintptr_t)sock->pages[0];
+    memset(sock->shared, 0, sizeof(udp_shared_t));
+    sock->shared->nr_rings = nr_rings;
+    sock->shared->rings_offset = PAGE_SIZE;
+    sock->shared->tx_offset = (1 + ring_pages) * PAGE_SIZE;
+    sock->shared->tx_slots = UDP_TX_SLOTS;
+    return 0;
+}
+
+/*
+ * Release a socket's region, complete or partly allocated
+ */
+static void udp_free_region(udp_socket_t* sock) {
+    if (sock->shm) {
+        destroy_shared_memory(sock->shm);
+        sock->shm = NULL;
+    } else if (sock->pages) {
+        for (uint32_t i = 0; i < sock->nr_pages; i++) {
+            if (sock->pages[i]) {
+                free_page((void*)(uintptr_t)sock->pages[i]);
+            }
+        }
+    }
+    kfree(sock->pages);
+    sock->pages = NULL;
+    sock->shared = NULL;
+}
+
+/*
+ * Open a socket bound to a local port
+ */
+udp_socket_t* udp_open(uint16_t port) {
+    virtio_net_t* net = net_device();
+    udp_socket_t* sock = NULL;
+    uint64_t flags;
+
+    if (!net || port == 0) {
+        return NULL;
+    }
+
+    spin_lock_irqsave(&udp_lock, flags);
+    for (uint32_t i = 0; i < UDP_MAX_SOCKETS; i++) {
+        if (udp_sockets[i].port == port) {
+            spin_unlock_irqrestore(&udp_lock, flags);
+            return NULL;
+        }
+        if (!sock && !udp_sockets[i].in_use) {
+            sock = &udp_sockets[i];
+        }
+    }
+    if (sock) {
+        sock->in_use = true;
+        sock->port = port;
+    }
+    spin_unlock_irqrestore(&udp_lock, flags);
+
+    if (!sock) {
+        return NULL;
+    }
+
+    uint32_t nr_rings = net->nr_queues < UDP_MAX_RX_QUEUES ? net->nr_queues : UDP_MAX_RX_QUEUES;
+    if (udp_alloc_region(sock, nr_rings) < 0) {
+        LOG_ERROR("udp: cannot allocate socket for port %u", port);
+        udp_free_region(sock);
+        sock->port = 0;
+        sock->in_use = false;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < UDP_TX_SLOTS; i++) {
+        sock->tx_free[i] = (uint16_t)(UDP_TX_SLOTS - 1 - i);
+        sock->tx_is_free[i] = true;
+    }
+    sock->tx_free_count = UDP_TX_SLOTS;
+    sock->waiter = 0;
+    memset(&sock->stats, 0, sizeof(sock->stats));
+
+    // Deliveries start once the port is visible
+    __atomic_store_n(&sock->open, true, __ATOMIC_RELEASE);
+    return sock;
+}
+
+/*
+ * Close a socket
+ *
+ * Buffers still in the receive rings go back to the device. The region
+ * is released once the device is done with every transmit slot, so the
+ * caller must first free slots it has not sent.
+ */
+void udp_close(udp_socket_t* sock) {
+    udp_desc_t descs[32];
+    uint32_t n;
+
+    __atomic_store_n(&sock->open, false, __ATOMIC_SEQ_CST);
+
+    // Wait for deliveries that saw the socket open
+    while (__atomic_load_n(&udp_busy[sock->id], __ATOMIC_ACQUIRE) != 0) {
+        cpu_relax();
+    }
+
+    while ((n = udp_recv(sock, descs, 32)) > 0) {
+        udp_release(sock, descs, n);
+    }
+
+    // Sent datagrams complete within the neighbor timeout at worst
+    while (__atomic_load_n(&sock->tx_free_count, __ATOMIC_ACQUIRE) < UDP_TX_SLOTS) {
+        sleep_task(10);
+    }
+
+    udp_free_region(sock);
+    sock->port = 0;
+    __atomic_store_n(&sock->in_use, false, __ATOMIC_RELEASE);
+}
+
+/*
+ * Find the open socket for a port
+ */
+static udp_socket_t* udp_lookup(uint16_t port) {
+    for (uint32_t i = 0; i < UDP_MAX_SOCKETS; i++) {
+        if (__atomic_load_n(&udp_sockets[i].open, __ATOMIC_ACQUIRE) && udp_sockets[i].port == port) {
+            return &udp_sockets[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Queue a received datagram on its socket (NET_RX softirq)
+ *
+ * Returns false if there is no socket or its ring is full; the caller
+ * then keeps ownership of the buffer.
+ */
+bool udp_deliver(uint16_t port, uint16_t queue, uint32_t buf, uint32_t offset, uint32_t len,
+                 const net_addr_t* peer, uint16_t peer_port) {
+    udp_socket_t* sock = udp_lookup(port);
+    if (!sock) {
+        return false;
+    }
+
+    uint32_t id = sock->id;
+    __atomic_add_fetch(&udp_busy[id], 1, __ATOMIC_SEQ_CST);
+
+    // Closed between the lookup and the busy count
+    if (!__atomic_load_n(&sock->open, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&udp_busy[id], 1, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    uint32_t ring = queue % sock->shared->nr_rings;
+    udp_ring_idx_t* idx = &sock->shared->rx[ring];
+    uint32_t tail = idx->tail;
+    bool queued = false;
+
+    if (tail - __atomic_load_n(&idx->head, __ATOMIC_ACQUIRE) < UDP_RING_SIZE) {
+        udp_desc_t* desc = udp_ring_entry(sock, ring, tail);
+        desc->buf = buf;
+        desc->offset = (uint16_t)offset;
+        desc->len = (uint16_t)len;
+        desc->queue = queue;
+        desc->port = peer_port;
+        desc->peer = *peer;
+        __atomic_store_n(&idx->tail, tail + 1, __ATOMIC_SEQ_CST);
+        sock->stats.rx_packets++;
+        queued = true;
+
+        // Pairs with the waiter's store before its final check
+        pid_t waiter = __atomic_exchange_n(&sock->waiter, 0, __ATOMIC_SEQ_CST);
+        if (waiter) {
+            sock->stats.wakeups++;
+            unblock_task(waiter);
+        }
+    } else {
+        sock->stats.rx_ring_full++;
+    }
+
+    __atomic_sub_fetch(&udp_busy[id], 1, __ATOMIC_RELEASE);
+    return queued;
+}
+
+/*
+ * Take received descriptors without blocking
+ */
+uint32_t udp_recv(udp_socket_t* sock, udp_desc_t* descs, uint32_t max) {
+    uint32_t n = 0;
+
+    for (uint32_t ring = 0; ring < sock->shared->nr_rings && n < max; ring++) {
+        udp_ring_idx_t* idx = &sock->shared->rx[ring];
+        uint32_t head = idx->head;
+        uint32_t tail = __atomic_load_n(&idx->tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail && n < max) {
+            descs[n++] = *udp_ring_entry(sock, ring, head);
+            head++;
+        }
+        __atomic_store_n(&idx->head, head, __ATOMIC_RELEASE);
+    }
+
+    return n;
+}
+
+/*
+ * Any ring non-empty
+ */
+static bool udp_rx_pending(udp_socket_t* sock) {
+    for (uint32_t ring = 0; ring < sock->shared->nr_rings; ring++) {
+        udp_ring_idx_t* idx = &sock->shared->rx[ring];
+        if (__atomic_load_n(&idx->tail, __ATOMIC_SEQ_CST) != idx->head) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Take received descriptors, blocking until there is at least one
+ */
+uint32_t udp_wait(udp_socket_t* sock, udp_desc_t* descs, uint32_t max) {
+    for (;;) {
+        uint32_t n = udp_recv(sock, descs, max);
+        if (n > 0) {
+            return n;
+        }
+
+        // Blocked before the final check, so a delivery in between is not lost
+        prepare_to_block();
+        __atomic_store_n(&sock->waiter, get_current_pid(), __ATOMIC_SEQ_CST);
+        if (udp_rx_pending(sock)) {
+            __atomic_store_n(&sock->waiter, 0, __ATOMIC_SEQ_CST);
+            cancel_block();
+            continue;
+        }
+        schedule();
+    }
+}
+
+/*
+ * Kernel address of a received payload
+ */
+void* udp_rx_data(udp_socket_t* sock, const udp_desc_t* desc) {
+    uint8_t* frame = (uint8_t*)virtio_net_rx_data(net_device(), desc->buf);
+    (void)sock;
+    return frame ? frame + desc->offset : NULL;
+}
+
+/*
+ * Return received buffers to the device
+ */
+void udp_release(udp_socket_t* sock, const udp_desc_t* descs, uint32_t count) {
+    virtio_net_t* net = net_device();
+    (void)sock;
+
+    for (uint32_t i = 0; i < count; i++) {
+        virtio_net_rx_release(net, descs[i].queue, descs[i].buf);
+    }
+}
+
+/*
+ * Take free transmit slots
+ */
+uint32_t udp_alloc_tx(udp_socket_t* sock, uint32_t* slots, uint32_t count) {
+    uint32_t n = 0;
+    uint64_t flags;
+
+    spin_lock_irqsave(&sock->tx_lock, flags);
+    while (n < count && sock->tx_free_count > 0) {
+        uint16_t slot = sock->tx_free[--sock->tx_free_count];
+        sock->tx_is_free[slot] = false;
+        slots[n++] = slot;
+    }
+    spin_unlock_irqrestore(&sock->tx_lock, flags);
+
+    return n;
+}
+
+/*
+ * Put a slot back on the free list (tx_lock held)
+ *
+ * Slots out of range or already free are counted and dropped: a double
+ * free would otherwise hand the slot out twice and overflow the list.
+ */
+static void udp_put_tx_slot(udp_socket_t* sock, uint32_t slot) {
+    if (slot >= UDP_TX_SLOTS || sock->tx_is_free[slot] || sock->tx_free_count >= UDP_TX_SLOTS) {
+        sock->stats.tx_bad_free++;
+        return;
+    }
+    sock->tx_is_free[slot] = true;
+    sock->tx_free[sock->tx_free_count++] = (uint16_t)slot;
+}
+
+/*
+ * Give back transmit slots that were not sent
+ */
+void udp_free_tx(udp_socket_t* sock, const uint32_t* slots, uint32_t count) {
+    uint64_t flags;
+
+    spin_lock_irqsave(&sock->tx_lock, flags);
+    for (uint32_t i = 0; i < count; i++) {
+        udp_put_tx_slot(sock, slots[i]);
+    }
+    spin_unlock_irqrestore(&sock->tx_lock, flags);
+}
+
+/*
+ * Kernel address of a transmit slot's payload
+ */
+void* udp_tx_data(udp_socket_t* sock, uint32_t slot) {
+    if (slot >= UDP_TX_SLOTS) {
+        return NULL;
+    }
+    return udp_ptr(sock, udp_tx_offset(sock, slot));
+}
+
+/*
+ * Send a batch of datagrams from transmit slots
+ */
+uint32_t udp_send(udp_socket_t* sock, const udp_desc_t* descs, uint32_t count) {
+    virtio_net_t* net = net_device();
+    uint16_t queue = (uint16_t)(smp_processor_id() % net->nr_queues);
+    uint32_t sent = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const udp_desc_t* desc = &descs[i];
+        uint32_t max = desc->peer.family == NET_AF_INET ? UDP_MAX_PAYLOAD : UDP_MAX_PAYLOAD - 20;
+
+        if (desc->buf >= UDP_TX_SLOTS || desc->len > max) {
+            break;
+        }
+
+        uint32_t offset = udp_tx_offset(sock, desc->buf);
+        uint64_t phys = sock->pages[offset >> PAGE_SHIFT] + (offset & (PAGE_SIZE - 1));
+        void* cookie = (void*)(uintptr_t)(((uint64_t)(sock->id + 1) << 16) | desc->buf);
+
+        if (net_udp_output(queue, &desc->peer, desc->port, sock->port, udp_ptr(sock, offset),
+                           phys, desc->len, cookie, i + 1 < count) < 0) {
+            break;
+        }
+        sent++;
+    }
+
+    // A refused datagram left the earlier ones without a doorbell
+    if (sent < count) {
+        sock->stats.tx_failed += count - sent;
+        if (sent > 0) {
+            net_flush(queue);
+        }
+    }
+    sock->stats.tx_packets += sent;
+    return sent;
+}
+
+/*
+ * A transmit slot is free again (TX completion or neighbor timeout)
+ */
+void udp_tx_complete(void* cookie, bool sent) {
+    uint64_t value = (uint64_t)(uintptr_t)cookie;
+    uint32_t id = (uint32_t)(value >> 16) - 1;
+    uint32_t slot = (uint32_t)(value & 0xFFFF);
+    uint64_t flags;
+
+    if (id >= UDP_MAX_SOCKETS || slot >= UDP_TX_SLOTS) {
+        return;
+    }
+
+    udp_socket_t* sock = &udp_sockets[id];
+    if (!sent) {
+        sock->stats.tx_failed++;
+    }
+
+    spin_lock_irqsave(&sock->tx_lock, flags);
+    udp_put_tx_slot(sock, slot);
+    spin_unlock_irqrestore(&sock->tx_lock, flags);
+}
+
+/*
+ * Set up the socket table
+ */
+void init_udp(void) {
+    memset(udp_sockets, 0, sizeof(udp_sockets));
+    for (uint32_t i = 0; i < UDP_MAX_SOCKETS; i++) {
+        udp_sockets[i].id = i;
+        udp_sockets[i].tx_lock = (spinlock_t)SPINLOCK_INIT;
+    }
+}
+
+/*
+ * Print open sockets
+ */
+void dump_udp_sockets(void) {
+    kernel_printf("UDP sockets:\n");
+    for (uint32_t i = 0; i < UDP_MAX_SOCKETS; i++) {
+        udp_socket_t* sock = &udp_sockets[i];
+        if (!sock->open) {
+            continue;
+        }
+        kernel_printf("  %-6u %s, rx %llu (%llu ring full), tx %llu (%llu failed), %llu wakeups, "
+                      "%u tx slots free (%llu bad frees)\n",
+                      sock->port, sock->shm ? "shared" : "private", sock->stats.rx_packets,
+                      sock->stats.rx_ring_full, sock->stats.tx_packets, sock->stats.tx_failed,
+                      sock->stats.wakeups, sock->tx_free_count, sock->stats.tx_bad_free);
+    }
+}
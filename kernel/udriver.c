@@ -0,0 +1,402 @@
+/*
+ * EdgeX OS - User-Space Device Drivers
+ *
+ * This file implements the kernel side of user-space drivers. A bound
+ * PCI function gets a window of its owner's address space for BARs and
+ * DMA pools. Interrupts are counted in a shared page from the primary
+ * handler, so a polling driver never needs the kernel to see them; an
+ * IRQ thread signals a bound event for drivers that sleep instead. When
+ * the owner exits, the device is stopped before its DMA memory is freed.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/interrupt.h>
+#include <edgex/scheduler.h>
+#include <edgex/spinlock.h>
+#include <edgex/ipc.h>
+#include <edgex/pci.h>
+#include <edgex/udriver.h>
+
+static udriver_t udrivers[UDRIVER_MAX_DEVICES];
+static spinlock_t udriver_lock = SPINLOCK_INIT;
+
+/*
+ * Reserve address space in the device's window
+ */
+static uint64_t udriver_reserve(udriver_t* drv, uint64_t size) {
+    size = (size + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+    if (drv->window_used + size > UDRIVER_WINDOW_SIZE) {
+        return 0;
+    }
+
+    uint64_t vaddr = drv->window + drv->window_used;
+    drv->window_used += size;
+    return vaddr;
+}
+
+/*
+ * Primary handler: count the interrupt where the driver can see it
+ */
+static irqreturn_t udriver_irq_primary(uint8_t irq, void* dev_data) {
+    udriver_irq_t* ui = (udriver_irq_t*)dev_data;
+    (void)irq;
+
+    ui->drv->shared->irq_count[ui->index]++;
+    return ui->event ? IRQ_WAKE_THREAD : IRQ_HANDLED;
+}
+
+/*
+ * IRQ thread: wake a driver sleeping on the event
+ */
+static void udriver_irq_thread(uint8_t irq, void* dev_data) {
+    udriver_irq_t* ui = (udriver_irq_t*)dev_data;
+    (void)irq;
+
+    event_t event = ui->event;
+    if (event) {
+        event_signal(event);
+    }
+}
+
+/*
+ * Bind a PCI function to a task
+ */
+udriver_t* udriver_attach(pci_device_t* pci, pid_t owner) {
+    udriver_t* drv = NULL;
+    uint64_t flags;
+
+    struct page_directory* pd = find_page_directory(owner);
+    if (!pd) {
+        kernel_printf("udriver: task %d has no address space\n", owner);
+        return NULL;
+    }
+
+    spin_lock_irqsave(&udriver_lock, flags);
+    if (!pci->driver_data) {
+        for (uint32_t i = 0; i < UDRIVER_MAX_DEVICES; i++) {
+            if (!udrivers[i].pci) {
+                drv = &udrivers[i];
+                drv->pci = pci;
+                pci->driver_data = drv;
+                break;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&udriver_lock, flags);
+
+    if (!drv) {
+        kernel_printf("udriver: %x:%x.%x is busy\n", pci->bus, pci->slot, pci->func);
+        return NULL;
+    }
+
+    drv->owner = owner;
+    drv->pd = pd;
+    drv->id = (uint32_t)(drv - udrivers);
+    drv->window = UDRIVER_VADDR_BASE + drv->id * UDRIVER_WINDOW_SIZE;
+    drv->window_used = 0;
+
+    // The shared page comes first in the window, read-only to the task
+    drv->shared = (udriver_shared_t*)alloc_page();
+    drv->shared_vaddr = udriver_reserve(drv, PAGE_SIZE);
+    if (!drv->shared || map_device_memory(pd, drv->shared_vaddr, (uint64_t)drv->shared,
+                                          PAGE_SIZE, false, false) != 0) {
+        kernel_printf("udriver: cannot map the shared page for task %d\n", owner);
+        if (drv->shared) {
+            free_page(drv->shared);
+        }
+        drv->shared = NULL;
+        spin_lock_irqsave(&udriver_lock, flags);
+        pci->driver_data = NULL;
+        drv->pci = NULL;
+        spin_unlock_irqrestore(&udriver_lock, flags);
+        return NULL;
+    }
+    memset(drv->shared, 0, PAGE_SIZE);
+
+    pci_enable_device(pci);
+
+    kernel_printf("udriver%u: %x:%x.%x (%x:%x) bound to task %d\n", drv->id, pci->bus,
+                  pci->slot, pci->func, pci->vendor_id, pci->device_id, owner);
+    return drv;
+}
+
+/*
+ * Map a memory BAR into the owner
+ */
+uint64_t udriver_map_bar(udriver_t* drv, uint32_t bar) {
+    if (bar >= PCI_MAX_BARS) {
+        return 0;
+    }
+    if (drv->bar_vaddr[bar]) {
+        return drv->bar_vaddr[bar];
+    }
+
+    pci_bar_t* b = &drv->pci->bars[bar];
+    if (b->size == 0 || b->is_io) {
+        return 0;
+    }
+
+    uint64_t vaddr = udriver_reserve(drv, b->size);
+    if (!vaddr || map_device_memory(drv->pd, vaddr, b->phys, b->size, true, true) != 0) {
+        return 0;
+    }
+
+    drv->bar_vaddr[bar] = vaddr;
+    return vaddr;
+}
+
+/*
+ * Allocate a DMA pool and map it into the owner
+ */
+uint64_t udriver_dma_alloc(udriver_t* drv, uint32_t pages, uint64_t* phys) {
+    udriver_dma_t* dma = NULL;
+
+    for (uint32_t i = 0; i < UDRIVER_MAX_DMA; i++) {
+        if (!drv->dma[i].vaddr) {
+            dma = &drv->dma[i];
+            break;
+        }
+    }
+    if (!dma || pages == 0) {
+        return 0;
+    }
+
+    uint64_t vaddr = udriver_reserve(drv, (uint64_t)pages * PAGE_SIZE);
+    dma->phys = (uint64_t*)kzalloc(pages * sizeof(uint64_t));
+    if (!vaddr || !dma->phys) {
+        return 0;
+    }
+
+    // Pages need not be contiguous: the device gets one address per page
+    uint32_t mapped = 0;
+    while (mapped < pages) {
+        void* page = alloc_page();
+        if (!page) {
+            break;
+        }
+        memset(page, 0, PAGE_SIZE);
+        dma->phys[dma->pages++] = (uint64_t)page;
+
+        if (map_device_memory(drv->pd, vaddr + (uint64_t)mapped * PAGE_SIZE, (uint64_t)page,
+                              PAGE_SIZE, true, false) != 0) {
+            break;
+        }
+        mapped++;
+    }
+
+    if (mapped < pages) {
+        kernel_printf("udriver%u: cannot allocate %u DMA pages\n", drv->id, pages);
+        if (mapped) {
+            unmap_memory_range(drv->pd, vaddr, (uint64_t)mapped * PAGE_SIZE, false);
+        }
+        for (uint32_t i = 0; i < dma->pages; i++) {
+            free_page((void*)dma->phys[i]);
+        }
+        dma->pages = 0;
+        return 0;
+    }
+
+    memcpy(phys, dma->phys, pages * sizeof(uint64_t));
+    dma->vaddr = vaddr;
+    return vaddr;
+}
+
+/*
+ * Pin a buffer in the owner's address space for DMA
+ */
+int udriver_dma_pin(udriver_t* drv, uint64_t vaddr, size_t size, uint64_t* phys, size_t max_pages) {
+    udriver_pin_t* pin = NULL;
+
+    for (uint32_t i = 0; i < UDRIVER_MAX_PINS; i++) {
+        if (!drv->pins[i].size) {
+            pin = &drv->pins[i];
+            break;
+        }
+    }
+    if (!pin) {
+        return -1;
+    }
+
+    int pages = pin_user_pages(drv->pd, vaddr, size, phys, max_pages);
+    if (pages > 0) {
+        pin->vaddr = vaddr;
+        pin->size = size;
+    }
+    return pages;
+}
+
+/*
+ * Release a pinned buffer
+ */
+int udriver_dma_unpin(udriver_t* drv, uint64_t vaddr, size_t size) {
+    for (uint32_t i = 0; i < UDRIVER_MAX_PINS; i++) {
+        udriver_pin_t* pin = &drv->pins[i];
+        if (pin->size && pin->vaddr == vaddr && pin->size == size) {
+            pin->size = 0;
+            return unpin_user_pages(drv->pd, vaddr, size);
+        }
+    }
+    return -1;
+}
+
+/*
+ * Set up MSI/MSI-X vectors that count into the shared page
+ */
+int udriver_alloc_irqs(udriver_t* drv, uint32_t nvec) {
+    if (drv->nr_vectors) {
+        return -1;
+    }
+    if (nvec > UDRIVER_MAX_IRQS) {
+        nvec = UDRIVER_MAX_IRQS;
+    }
+
+    int ret = pci_alloc_irq_vectors(drv->pci, nvec);
+    if (ret <= 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)ret; i++) {
+        udriver_irq_t* ui = &drv->irqs[i];
+        int irq = pci_irq_vector(drv->pci, i);
+
+        ui->drv = drv;
+        ui->index = i;
+        ui->event = NULL;
+        if (irq < 0 || request_threaded_irq((uint8_t)irq, udriver_irq_primary, udriver_irq_thread,
+                                            TASK_PRIORITY_HIGH, "udriver", ui) != 0) {
+            break;
+        }
+        ui->irq = (uint8_t)irq;
+        drv->nr_vectors++;
+    }
+
+    return (int)drv->nr_vectors;
+}
+
+/*
+ * Signal an event on every interrupt of a vector (NULL to stop)
+ */
+int udriver_bind_irq_event(udriver_t* drv, uint32_t index, event_t event) {
+    if (index >= drv->nr_vectors) {
+        return -1;
+    }
+
+    drv->irqs[index].event = event;
+    return 0;
+}
+
+/*
+ * Steer a vector to the CPU the driver polls on
+ */
+int udriver_irq_set_cpu(udriver_t* drv, uint32_t index, uint32_t cpu) {
+    if (index >= drv->nr_vectors) {
+        return -1;
+    }
+
+    return pci_irq_set_cpu(drv->pci, index, cpu);
+}
+
+/*
+ * Unbind a device from its owner
+ */
+void udriver_detach(udriver_t* drv) {
+    pci_device_t* pci = drv->pci;
+    uint64_t flags;
+
+    if (!pci) {
+        return;
+    }
+
+    // Stop the device from mastering the bus before its memory goes away
+    uint16_t command = pci_read_config16(pci, PCI_COMMAND);
+    pci_write_config16(pci, PCI_COMMAND, command & ~PCI_COMMAND_MASTER);
+
+    for (uint32_t i = 0; i < drv->nr_vectors; i++) {
+        free_irq(drv->irqs[i].irq);
+        drv->irqs[i].irq = 0;
+        drv->irqs[i].event = NULL;
+    }
+    if (drv->nr_vectors) {
+        pci_free_irq_vectors(pci);
+        drv->nr_vectors = 0;
+    }
+
+    for (uint32_t i = 0; i < UDRIVER_MAX_PINS; i++) {
+        if (drv->pins[i].size) {
+            unpin_user_pages(drv->pd, drv->pins[i].vaddr, drv->pins[i].size);
+            drv->pins[i].size = 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < UDRIVER_MAX_DMA; i++) {
+        udriver_dma_t* dma = &drv->dma[i];
+        if (dma->vaddr) {
+            unmap_memory_range(drv->pd, dma->vaddr, (uint64_t)dma->pages * PAGE_SIZE, false);
+            for (uint32_t p = 0; p < dma->pages; p++) {
+                free_page((void*)dma->phys[p]);
+            }
+            dma->vaddr = 0;
+            dma->pages = 0;
+        }
+    }
+
+    for (uint32_t bar = 0; bar < PCI_MAX_BARS; bar++) {
+        if (drv->bar_vaddr[bar]) {
+            unmap_memory_range(drv->pd, drv->bar_vaddr[bar], pci->bars[bar].size, false);
+            drv->bar_vaddr[bar] = 0;
+        }
+    }
+
+    unmap_memory_range(drv->pd, drv->shared_vaddr, PAGE_SIZE, false);
+    free_page(drv->shared);
+    drv->shared = NULL;
+
+    kernel_printf("udriver%u: %x:%x.%x released by task %d\n", drv->id, pci->bus,
+                  pci->slot, pci->func, drv->owner);
+
+    spin_lock_irqsave(&udriver_lock, flags);
+    pci->driver_data = NULL;
+    drv->pci = NULL;
+    spin_unlock_irqrestore(&udriver_lock, flags);
+}
+
+/*
+ * Task cleanup: release the devices an exiting task owned
+ */
+static void udriver_task_cleanup(pid_t pid) {
+    for (uint32_t i = 0; i < UDRIVER_MAX_DEVICES; i++) {
+        if (udrivers[i].pci && udrivers[i].owner == pid) {
+            udriver_detach(&udrivers[i]);
+        }
+    }
+}
+
+/*
+ * Set up the framework
+ */
+void init_udriver(void) {
+    register_task_cleanup_handler(udriver_task_cleanup);
+}
+
+/*
+ * Print bound devices
+ */
+void dump_udrivers(void) {
+    kernel_printf("User-space drivers:\n");
+
+    for (uint32_t i = 0; i < UDRIVER_MAX_DEVICES; i++) {
+        udriver_t* drv = &udrivers[i];
+        if (!drv->pci) {
+            continue;
+        }
+
+        kernel_printf("  udriver%u: %x:%x.%x task %d, %u vectors, %llu KB mapped\n",
+                      i, drv->pci->bus, drv->pci->slot, drv->pci->func, drv->owner,
+                      drv->nr_vectors, drv->window_used / 1024);
+        for (uint32_t v = 0; v < drv->nr_vectors; v++) {
+            kernel_printf("    vector %u: IRQ %u, %llu interrupts%s\n", v, drv->irqs[v].irq,
+                          drv->shared->irq_count[v], drv->irqs[v].event ? ", event" : "");
+        }
+    }
+}
@@ -0,0 +1,718 @@
+/*
+ * EdgeX OS - Virtio
+ *
+ * This file implements the virtio 1.x PCI transport and the two ring
+ * layouts. Ring memory comes from single physical pages below the 1GB
+ * identity map, so the driver's view and the device's (physical) view
+ * of each ring are the same address.
+ *
+ * Doorbells are the expensive part of a virtqueue: each one is a trap to
+ * the hypervisor. Buffers are only published by virtqueue_add(), and
+ * virtqueue_kick() rings the doorbell once per batch, skipping it when
+ * the device has said (via the event index or the no-notify flag) that
+ * it is still walking the ring and will see the new buffers anyway.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/interrupt.h>
+#include <edgex/pci.h>
+#include <edgex/virtio.h>
+
+/* Vendor capability layout */
+#define VIRTIO_CAP_CFG_TYPE        3
+#define VIRTIO_CAP_BAR             4
+#define VIRTIO_CAP_OFFSET          8
+#define VIRTIO_CAP_LENGTH          12
+#define VIRTIO_CAP_NOTIFY_MULT     16
+
+/* Transitional (0.9.5) PCI device IDs; the subsystem ID is the type */
+#define VIRTIO_PCI_LEGACY_FIRST    0x1000
+#define VIRTIO_PCI_LEGACY_LAST     0x103F
+
+/* Physical memory below this is identity mapped (rings must live here) */
+#define VIRTIO_IDENTITY_LIMIT      (1ULL << 30)
+
+/* Volatile access to ring fields shared with the device */
+#define VQ_READ16(field)           (*(volatile uint16_t*)&(field))
+#define VQ_WRITE16(field, value)   (*(volatile uint16_t*)&(field) = (value))
+
+/* avail_event: the 16 bits after the last element of the used ring */
+typedef uint16_t __attribute__((may_alias)) vq_alias16_t;
+#define VQ_AVAIL_EVENT(vq)         ((volatile vq_alias16_t*)&(vq)->used->ring[(vq)->num])
+
+/*
+ * Full barrier: orders our ring stores before the loads that decide
+ * whether the device needs a notification or an interrupt is pending
+ */
+static inline void virtio_mb(void) {
+    __asm__ volatile("mfence" ::: "memory");
+}
+
+/*
+ * Event index check shared by both layouts: has the device asked to be
+ * notified (or to notify) once the index passes event_idx?
+ */
+static inline bool vring_need_event(uint16_t event_idx, uint16_t new_idx, uint16_t old_idx) {
+    return (uint16_t)(new_idx - event_idx - 1) < (uint16_t)(new_idx - old_idx);
+}
+
+/*
+ * Allocate a zeroed page for ring memory
+ */
+static void* virtio_alloc_ring_page(void) {
+    void* page = alloc_page();
+
+    if (page && (uint64_t)page + PAGE_SIZE > VIRTIO_IDENTITY_LIMIT) {
+        LOG_ERROR("virtio: ring page %p above the identity map", page);
+        free_page(page);
+        return NULL;
+    }
+    if (page) {
+        memset(page, 0, PAGE_SIZE);
+    }
+    return page;
+}
+
+/*
+ * Find the index'th virtio function of a given type
+ */
+pci_device_t* virtio_pci_find(uint16_t device_id, uint32_t index) {
+    for (uint32_t i = 0; i < pci_device_count(); i++) {
+        pci_device_t* dev = pci_get_device(i);
+        if (dev->vendor_id != VIRTIO_PCI_VENDOR_ID) {
+            continue;
+        }
+
+        bool match = dev->device_id == VIRTIO_PCI_MODERN_DEVICE_BASE + device_id ||
+                     (dev->device_id >= VIRTIO_PCI_LEGACY_FIRST &&
+                      dev->device_id <= VIRTIO_PCI_LEGACY_LAST &&
+                      dev->subsystem_id == device_id);
+        if (match && index-- == 0) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Map the region described by a virtio vendor capability
+ */
+static volatile uint8_t* virtio_map_cap(pci_device_t* pci, uint8_t cap) {
+    uint8_t bar = pci_read_config8(pci, cap + VIRTIO_CAP_BAR);
+    uint32_t offset = pci_read_config32(pci, cap + VIRTIO_CAP_OFFSET);
+
+    uint8_t* base = (uint8_t*)pci_map_bar(pci, bar);
+    return base ? (volatile uint8_t*)(base + offset) : NULL;
+}
+
+/*
+ * Reset the device
+ */
+void virtio_reset(virtio_device_t* vdev) {
+    vdev->common->device_status = 0;
+
+    // The device acknowledges the reset by reading back 0
+    while (vdev->common->device_status != 0) {
+        __asm__ volatile("pause");
+    }
+}
+
+/*
+ * Locate the transport structures, reset and acknowledge the device
+ */
+int virtio_init_device(virtio_device_t* vdev, pci_device_t* pci, uint16_t device_id) {
+    memset(vdev, 0, sizeof(*vdev));
+    vdev->pci = pci;
+    vdev->device_id = device_id;
+
+    for (uint8_t cap = pci_find_capability(pci, PCI_CAP_ID_VNDR, 0); cap;
+         cap = pci_find_capability(pci, PCI_CAP_ID_VNDR, cap)) {
+        uint8_t type = pci_read_config8(pci, cap + VIRTIO_CAP_CFG_TYPE);
+
+        // Use the first capability of each type, as the spec recommends
+        if (type == VIRTIO_PCI_CAP_COMMON_CFG && !vdev->common) {
+            vdev->common = (volatile virtio_pci_common_cfg_t*)virtio_map_cap(pci, cap);
+        } else if (type == VIRTIO_PCI_CAP_NOTIFY_CFG && !vdev->notify_base) {
+            vdev->notify_base = virtio_map_cap(pci, cap);
+            vdev->notify_multiplier = pci_read_config32(pci, cap + VIRTIO_CAP_NOTIFY_MULT);
+        } else if (type == VIRTIO_PCI_CAP_ISR_CFG && !vdev->isr) {
+            vdev->isr = virtio_map_cap(pci, cap);
+        } else if (type == VIRTIO_PCI_CAP_DEVICE_CFG && !vdev->device_cfg) {
+            vdev->device_cfg = virtio_map_cap(pci, cap);
+        }
+    }
+
+    // Legacy-only devices (no modern capabilities) are not supported
+    if (!vdev->common || !vdev->notify_base) {
+        kernel_printf("virtio: %x:%x.%x has no modern interface\n",
+                      pci->bus, pci->slot, pci->func);
+        return -1;
+    }
+
+    pci_enable_device(pci);
+    virtio_reset(vdev);
+
+    vdev->common->device_status = VIRTIO_STATUS_ACKNOWLEDGE;
+    vdev->common->device_status = VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER;
+    return 0;
+}
+
+/*
+ * Negotiate features: accept what both sides support
+ */
+int virtio_negotiate(virtio_device_t* vdev, uint64_t driver_features) {
+    volatile virtio_pci_common_cfg_t* common = vdev->common;
+    uint64_t device_features;
+
+    common->device_feature_select = 0;
+    device_features = common->device_feature;
+    common->device_feature_select = 1;
+    device_features |= (uint64_t)common->device_feature << 32;
+
+    driver_features |= 1ULL << VIRTIO_F_VERSION_1;
+    vdev->features = device_features & driver_features;
+
+    if (!virtio_has_feature(vdev, VIRTIO_F_VERSION_1)) {
+        kernel_printf("virtio: device does not offer VERSION_1\n");
+        common->device_status |= VIRTIO_STATUS_FAILED;
+        return -1;
+    }
+
+    common->driver_feature_select = 0;
+    common->driver_feature = (uint32_t)vdev->features;
+    common->driver_feature_select = 1;
+    common->driver_feature = (uint32_t)(vdev->features >> 32);
+
+    common->device_status |= VIRTIO_STATUS_FEATURES_OK;
+    if (!(common->device_status & VIRTIO_STATUS_FEATURES_OK)) {
+        kernel_printf("virtio: device rejected features %llx\n", vdev->features);
+        common->device_status |= VIRTIO_STATUS_FAILED;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Allocate MSI-X vectors (one per queue the caller intends to steer)
+ *
+ * Returns the number allocated; 0 means the queues must be polled.
+ */
+int virtio_alloc_vectors(virtio_device_t* vdev, uint32_t nvec) {
+    int ret = pci_alloc_irq_vectors(vdev->pci, nvec);
+
+    // Virtio only defines per-queue routing for MSI-X
+    if (ret > 0 && vdev->pci->irq_mode != PCI_IRQ_MSIX) {
+        pci_free_irq_vectors(vdev->pci);
+        ret = -1;
+    }
+
+    vdev->nr_vectors = ret > 0 ? (uint32_t)ret : 0;
+    vdev->common->config_msix_vector = VIRTIO_MSI_NO_VECTOR;
+    return (int)vdev->nr_vectors;
+}
+
+/*
+ * Queue interrupt: hand the queue to its driver
+ */
+static irqreturn_t virtio_vq_interrupt(uint8_t irq, void* dev_data) {
+    virtqueue_t* vq = (virtqueue_t*)dev_data;
+    (void)irq;
+
+    vq->stats.interrupts++;
+    if (vq->callback) {
+        vq->callback(vq);
+    }
+    return IRQ_HANDLED;
+}
+
+/*
+ * Allocate the ring memory for a split virtqueue
+ */
+static int vq_alloc_split(virtqueue_t* vq) {
+    vq->desc = (vring_desc_t*)virtio_alloc_ring_page();
+    vq->avail = (vring_avail_t*)virtio_alloc_ring_page();
+    vq->used = (vring_used_t*)virtio_alloc_ring_page();
+    if (!vq->desc || !vq->avail || !vq->used) {
+        return -1;
+    }
+
+    // All descriptors start on the free chain
+    for (uint16_t i = 0; i < vq->num - 1; i++) {
+        vq->desc[i].next = i + 1;
+    }
+    vq->free_head = 0;
+    return 0;
+}
+
+/*
+ * Allocate the ring memory for a packed virtqueue
+ */
+static int vq_alloc_packed(virtqueue_t* vq) {
+    uint8_t* events = (uint8_t*)virtio_alloc_ring_page();
+
+    vq->pdesc = (vring_packed_desc_t*)virtio_alloc_ring_page();
+    vq->id_next = (uint16_t*)kzalloc(vq->num * sizeof(uint16_t));
+    vq->id_len = (uint16_t*)kzalloc(vq->num * sizeof(uint16_t));
+    if (!events || !vq->pdesc || !vq->id_next || !vq->id_len) {
+        return -1;
+    }
+
+    // Separate cache lines for the two event suppression structures
+    vq->driver_event = (vring_packed_event_t*)events;
+    vq->device_event = (vring_packed_event_t*)(events + 64);
+
+    for (uint16_t i = 0; i < vq->num; i++) {
+        vq->id_next[i] = i + 1;
+    }
+    vq->free_id = 0;
+    vq->avail_wrap = true;
+    vq->used_wrap = true;
+    vq->event_flags = VRING_PACKED_EVENT_F_ENABLE;
+    return 0;
+}
+
+/*
+ * Create and enable a virtqueue
+ *
+ * vector is the MSI-X vector index (from virtio_alloc_vectors), or -1
+ * for a queue that is only polled.
+ */
+virtqueue_t* virtio_setup_vq(virtio_device_t* vdev, uint16_t index, uint16_t max_size,
+                             int vector, virtqueue_callback_t callback, void* priv) {
+    volatile virtio_pci_common_cfg_t* common = vdev->common;
+
+    if (index >= VIRTIO_MAX_QUEUES || index >= common->num_queues) {
+        return NULL;
+    }
+
+    common->queue_select = index;
+    uint16_t num = common->queue_size;
+    if (num == 0) {
+        return NULL;
+    }
+    if (num > max_size) {
+        num = max_size;
+    }
+    if (num > VIRTIO_MAX_QUEUE_SIZE) {
+        num = VIRTIO_MAX_QUEUE_SIZE;
+    }
+    // Split rings need a power of two; use one for packed rings as well
+    while (num & (num - 1)) {
+        num &= num - 1;
+    }
+
+    virtqueue_t* vq = (virtqueue_t*)kzalloc(sizeof(virtqueue_t));
+    if (!vq) {
+        return NULL;
+    }
+    vq->vdev = vdev;
+    vq->index = index;
+    vq->num = num;
+    vq->num_free = num;
+    vq->packed = virtio_has_feature(vdev, VIRTIO_F_RING_PACKED);
+    vq->event_idx = virtio_has_feature(vdev, VIRTIO_F_EVENT_IDX);
+    vq->callback = callback;
+    vq->priv = priv;
+    vq->irq = -1;
+    vq->tokens = (void**)kzalloc(num * sizeof(void*));
+
+    if (!vq->tokens || (vq->packed ? vq_alloc_packed(vq) : vq_alloc_split(vq)) < 0) {
+        kernel_printf("virtio: out of memory for queue %u\n", index);
+        return NULL;
+    }
+
+    common->queue_size = num;
+    if (vq->packed) {
+        common->queue_desc = (uint64_t)vq->pdesc;
+        common->queue_driver = (uint64_t)vq->driver_event;
+        common->queue_device = (uint64_t)vq->device_event;
+    } else {
+        common->queue_desc = (uint64_t)vq->desc;
+        common->queue_driver = (uint64_t)vq->avail;
+        common->queue_device = (uint64_t)vq->used;
+    }
+
+    if (vector >= 0 && (uint32_t)vector < vdev->nr_vectors) {
+        common->queue_msix_vector = (uint16_t)vector;
+        if (common->queue_msix_vector != (uint16_t)vector) {
+            kernel_printf("virtio: queue %u rejected MSI-X vector %d\n", index, vector);
+        } else {
+            vq->irq = pci_irq_vector(vdev->pci, (uint32_t)vector);
+        }
+    } else {
+        common->queue_msix_vector = VIRTIO_MSI_NO_VECTOR;
+    }
+
+    vq->notify = (volatile uint16_t*)(vdev->notify_base +
+                                      common->queue_notify_off * vdev->notify_multiplier);
+    common->queue_enable = 1;
+
+    if (vq->irq >= 0) {
+        request_irq((uint8_t)vq->irq, virtio_vq_interrupt, "virtio", vq);
+    } else {
+        virtqueue_disable_cb(vq);
+    }
+
+    vdev->vqs[index] = vq;
+    if (index >= vdev->nr_vqs) {
+        vdev->nr_vqs = index + 1;
+    }
+    return vq;
+}
+
+/*
+ * Tell the device the driver is ready; the function is now bound
+ */
+void virtio_device_ready(virtio_device_t* vdev) {
+    vdev->pci->driver_data = vdev;
+    vdev->common->device_status |= VIRTIO_STATUS_DRIVER_OK;
+}
+
+/*
+ * Read the device-specific configuration
+ */
+void virtio_read_config(virtio_device_t* vdev, uint32_t offset, void* buf, uint32_t len) {
+    uint8_t* out = (uint8_t*)buf;
+    uint8_t generation;
+
+    if (!vdev->device_cfg) {
+        memset(buf, 0, len);
+        return;
+    }
+
+    // The generation changes if the device updated the config mid-read
+    do {
+        generation = vdev->common->config_generation;
+        for (uint32_t i = 0; i < len; i++) {
+            out[i] = vdev->device_cfg[offset + i];
+        }
+    } while (generation != vdev->common->config_generation);
+}
+
+/*
+ * Steer a queue's interrupt to a CPU
+ */
+int virtio_vq_set_cpu(virtqueue_t* vq, uint32_t cpu) {
+    if (vq->irq < 0 || cpu >= MAX_CPUS) {
+        return -1;
+    }
+    return irq_set_affinity((uint8_t)vq->irq, cpumask_of(cpu));
+}
+
+/*
+ * Split ring: post a descriptor chain
+ */
+static int vq_add_split(virtqueue_t* vq, const virtio_sg_t* sg, uint32_t out,
+                        uint32_t total, void* token) {
+    uint16_t head = vq->free_head;
+    uint16_t i = head;
+
+    for (uint32_t n = 0; n < total; n++) {
+        vq->desc[i].addr = sg[n].addr;
+        vq->desc[i].len = sg[n].len;
+        vq->desc[i].flags = (n >= out ? VRING_DESC_F_WRITE : 0) |
+                            (n + 1 < total ? VRING_DESC_F_NEXT : 0);
+        // The chain's last next field keeps pointing into the free chain
+        i = vq->desc[i].next;
+    }
+
+    vq->free_head = i;
+    vq->tokens[head] = token;
+
+    vq->avail->ring[vq->avail_idx & (vq->num - 1)] = head;
+    vq->avail_idx++;
+
+    // Descriptors and the ring entry before the index (x86 keeps stores ordered)
+    barrier();
+    VQ_WRITE16(vq->avail->idx, vq->avail_idx);
+
+    vq->added++;
+    return 0;
+}
+
+/*
+ * Packed ring: post a descriptor chain
+ */
+static int vq_add_packed(virtqueue_t* vq, const virtio_sg_t* sg, uint32_t out,
+                         uint32_t total, void* token) {
+    uint16_t id = vq->free_id;
+    uint16_t head = vq->next_avail;
+    uint16_t head_flags = 0;
+
+    for (uint32_t n = 0; n < total; n++) {
+        vring_packed_desc_t* desc = &vq->pdesc[vq->next_avail];
+        uint16_t flags = (n >= out ? VRING_DESC_F_WRITE : 0) |
+                         (n + 1 < total ? VRING_DESC_F_NEXT : 0) |
+                         (vq->avail_wrap ? VRING_PACKED_DESC_F_AVAIL : VRING_PACKED_DESC_F_USED);
+
+        desc->addr = sg[n].addr;
+        desc->len = sg[n].len;
+        desc->id = id;
+
+        // The head's flags make the whole chain visible, so they go last
+        if (n == 0) {
+            head_flags = flags;
+        } else {
+            VQ_WRITE16(desc->flags, flags);
+        }
+
+        if (++vq->next_avail >= vq->num) {
+            vq->next_avail = 0;
+            vq->avail_wrap = !vq->avail_wrap;
+        }
+    }
+
+    vq->free_id = vq->id_next[id];
+    vq->id_len[id] = (uint16_t)total;
+    vq->tokens[id] = token;
+
+    barrier();
+    VQ_WRITE16(vq->pdesc[head].flags, head_flags);
+
+    // Packed event offsets count descriptors, not buffers
+    vq->added += (uint16_t)total;
+    return 0;
+}
+
+/*
+ * Post a buffer: out device-readable segments followed by in writable ones
+ *
+ * Returns 0, or -1 if the ring is full. The device is not notified
+ * until virtqueue_kick().
+ */
+int virtqueue_add(virtqueue_t* vq, const virtio_sg_t* sg, uint32_t out, uint32_t in, void* token) {
+    uint32_t total = out + in;
+
+    if (total == 0 || total > vq->num_free || token == NULL) {
+        return -1;
+    }
+
+    int ret = vq->packed ? vq_add_packed(vq, sg, out, total, token)
+                         : vq_add_split(vq, sg, out, total, token);
+    if (ret == 0) {
+        vq->num_free -= (uint16_t)total;
+        vq->stats.added++;
+    }
+    return ret;
+}
+
+/*
+ * Notify the device of buffers added since the last kick, if it wants it
+ *
+ * Returns true if the doorbell was written.
+ */
+bool virtqueue_kick(virtqueue_t* vq) {
+    bool needed;
+
+    if (vq->added == 0) {
+        return false;
+    }
+
+    // Publish the ring before reading the device's suppression state
+    virtio_mb();
+
+    if (vq->packed) {
+        uint16_t new_idx = vq->next_avail;
+        uint16_t old_idx = new_idx - vq->added;
+        uint16_t flags = VQ_READ16(vq->device_event->flags);
+
+        if (flags == VRING_PACKED_EVENT_F_DESC) {
+            uint16_t off_wrap = VQ_READ16(vq->device_event->off_wrap);
+            uint16_t event_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_WRAP_SHIFT);
+            bool wrap = (off_wrap >> VRING_PACKED_EVENT_WRAP_SHIFT) & 1;
+
+            if (wrap != vq->avail_wrap) {
+                event_idx -= vq->num;
+            }
+            needed = vring_need_event(event_idx, new_idx, old_idx);
+        } else {
+            needed = flags != VRING_PACKED_EVENT_F_DISABLE;
+        }
+    } else if (vq->event_idx) {
+        uint16_t avail_event = *VQ_AVAIL_EVENT(vq);
+        needed = vring_need_event(avail_event, vq->avail_idx, vq->avail_idx - vq->added);
+    } else {
+        needed = !(VQ_READ16(vq->used->flags) & VRING_USED_F_NO_NOTIFY);
+    }
+
+    vq->added = 0;
+
+    if (needed) {
+        *vq->notify = vq->index;
+        vq->stats.kicks++;
+    } else {
+        vq->stats.kicks_suppressed++;
+    }
+    return needed;
+}
+
+/*
+ * Check for a used buffer without consuming it
+ */
+bool virtqueue_has_used(virtqueue_t* vq) {
+    if (vq->packed) {
+        uint16_t flags = VQ_READ16(vq->pdesc[vq->last_used_idx].flags);
+        bool avail = (flags & VRING_PACKED_DESC_F_AVAIL) != 0;
+        bool used = (flags & VRING_PACKED_DESC_F_USED) != 0;
+        return avail == vq->used_wrap && used == vq->used_wrap;
+    }
+    return vq->last_used_idx != VQ_READ16(vq->used->idx);
+}
+
+/*
+ * Take the next used buffer
+ *
+ * Returns its token and stores the number of bytes the device wrote in
+ * len, or returns NULL if nothing is pending.
+ */
+void* virtqueue_get_buf(virtqueue_t* vq, uint32_t* len) {
+    void* token;
+    uint16_t id;
+
+    if (!virtqueue_has_used(vq)) {
+        return NULL;
+    }
+
+    // Read the entry only after seeing it published
+    barrier();
+
+    if (vq->packed) {
+        vring_packed_desc_t* desc = &vq->pdesc[vq->last_used_idx];
+        id = desc->id;
+        if (len) {
+            *len = desc->len;
+        }
+
+        uint16_t count = vq->id_len[id];
+        vq->num_free += count;
+        vq->id_next[id] = vq->free_id;
+        vq->free_id = id;
+
+        vq->last_used_idx += count;
+        if (vq->last_used_idx >= vq->num) {
+            vq->last_used_idx -= vq->num;
+            vq->used_wrap = !vq->used_wrap;
+        }
+
+        if (vq->event_flags == VRING_PACKED_EVENT_F_DESC) {
+            VQ_WRITE16(vq->driver_event->off_wrap,
+                       vq->last_used_idx | (vq->used_wrap << VRING_PACKED_EVENT_WRAP_SHIFT));
+        }
+    } else {
+        vring_used_elem_t* elem = &vq->used->ring[vq->last_used_idx & (vq->num - 1)];
+        id = (uint16_t)elem->id;
+        if (len) {
+            *len = elem->len;
+        }
+
+        // Return the chain to the free list
+        uint16_t i = id;
+        vq->num_free++;
+        while (vq->desc[i].flags & VRING_DESC_F_NEXT) {
+            i = vq->desc[i].next;
+            vq->num_free++;
+        }
+        vq->desc[i].next = vq->free_head;
+        vq->free_head = id;
+
+        vq->last_used_idx++;
+
+        // With event index, interrupts are requested past what we consumed
+        if (vq->event_idx && !(vq->avail_flags & VRING_AVAIL_F_NO_INTERRUPT)) {
+            VQ_WRITE16(vq->avail->ring[vq->num], vq->last_used_idx);
+        }
+    }
+
+    token = vq->tokens[id];
+    vq->tokens[id] = NULL;
+    vq->stats.completed++;
+    return token;
+}
+
+/*
+ * Ask the device not to interrupt (polling mode)
+ *
+ * Best effort: an interrupt already in flight may still arrive.
+ */
+void virtqueue_disable_cb(virtqueue_t* vq) {
+    if (vq->packed) {
+        if (vq->event_flags != VRING_PACKED_EVENT_F_DISABLE) {
+            vq->event_flags = VRING_PACKED_EVENT_F_DISABLE;
+            VQ_WRITE16(vq->driver_event->flags, vq->event_flags);
+        }
+        return;
+    }
+
+    if (!(vq->avail_flags & VRING_AVAIL_F_NO_INTERRUPT)) {
+        vq->avail_flags |= VRING_AVAIL_F_NO_INTERRUPT;
+        // With event index the device ignores the flag; used_event stops advancing
+        if (!vq->event_idx) {
+            VQ_WRITE16(vq->avail->flags, vq->avail_flags);
+        }
+    }
+}
+
+/*
+ * Re-enable interrupts after polling
+ *
+ * Returns false if buffers were used meanwhile: the caller must poll
+ * again, since no interrupt will be sent for them.
+ */
+bool virtqueue_enable_cb(virtqueue_t* vq) {
+    if (vq->packed) {
+        if (vq->event_idx) {
+            VQ_WRITE16(vq->driver_event->off_wrap,
+                       vq->last_used_idx | (vq->used_wrap << VRING_PACKED_EVENT_WRAP_SHIFT));
+            barrier();
+            vq->event_flags = VRING_PACKED_EVENT_F_DESC;
+        } else {
+            vq->event_flags = VRING_PACKED_EVENT_F_ENABLE;
+        }
+        VQ_WRITE16(vq->driver_event->flags, vq->event_flags);
+    } else {
+        vq->avail_flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+        if (vq->event_idx) {
+            VQ_WRITE16(vq->avail->ring[vq->num], vq->last_used_idx);
+        } else {
+            VQ_WRITE16(vq->avail->flags, vq->avail_flags);
+        }
+    }
+
+    // The device may have used buffers before it saw the change
+    virtio_mb();
+    return !virtqueue_has_used(vq);
+}
+
+/*
+ * Re-enable interrupts, but only after count more buffers are used
+ *
+ * Without VIRTIO_F_EVENT_IDX the device cannot delay its interrupt and
+ * this is virtqueue_enable_cb(). The caller must not ask for more
+ * buffers than it has outstanding, or the interrupt never comes.
+ */
+bool virtqueue_enable_cb_delayed(virtqueue_t* vq, uint16_t count) {
+    if (!vq->event_idx || count <= 1) {
+        return virtqueue_enable_cb(vq);
+    }
+
+    uint16_t off = vq->last_used_idx + count - 1;
+    if (vq->packed) {
+        bool wrap = vq->used_wrap;
+        if (off >= vq->num) {
+            off -= vq->num;
+            wrap = !wrap;
+        }
+        VQ_WRITE16(vq->driver_event->off_wrap, off | (wrap << VRING_PACKED_EVENT_WRAP_SHIFT));
+        barrier();
+        vq->event_flags = VRING_PACKED_EVENT_F_DESC;
+        VQ_WRITE16(vq->driver_event->flags, vq->event_flags);
+    } else {
+        vq->avail_flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+        VQ_WRITE16(vq->avail->ring[vq->num], off);
+    }
+
+    virtio_mb();
+    return !virtqueue_has_used(vq);
+}
@@ -0,0 +1,592 @@
+/*
+ * EdgeX OS - Virtio Block Device
+ *
+ * This file implements the virtio-blk driver. Each CPU submits to its own
+ * queue, whose MSI-X vector is steered back to that CPU, so a request
+ * never bounces between CPUs. Requests submitted with the "more" hint are
+ * held in a plug and merged while they continue the previous request's
+ * sectors; the plug goes to the device as one request with one data
+ * segment per merged request. The interrupt only schedules the BLOCK
+ * softirq, which reaps completions and re-arms the queue to interrupt
+ * again after a batch of completions rather than after each one.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/cpu.h>
+#include <edgex/tsc.h>
+#include <edgex/scheduler.h>
+#include <edgex/softirq.h>
+#include <edgex/spinlock.h>
+#include <edgex/virtio.h>
+#include <edgex/virtio_blk.h>
+
+/* DMA area per device request: header, then the status byte */
+#define VIRTIO_BLK_CMD_DMA_SIZE     32
+#define VIRTIO_BLK_STATUS_OFFSET    sizeof(virtio_blk_req_hdr_t)
+
+static virtio_blk_t virtio_blk_devices[VIRTIO_BLK_MAX_DEVICES];
+static uint32_t nr_virtio_blk = 0;
+
+/* Per-CPU list of queues with completions to reap (interrupts disabled) */
+static virtio_blk_queue_t* blk_softirq_list[MAX_CPUS];
+
+/*
+ * Status byte the device writes for a request
+ */
+static inline uint8_t virtio_blk_cmd_status(virtio_blk_cmd_t* cmd) {
+    return *((volatile uint8_t*)cmd->hdr + VIRTIO_BLK_STATUS_OFFSET);
+}
+
+/*
+ * Hand a completed request to its owner
+ */
+static void virtio_blk_deliver(blk_request_t* req) {
+    req->complete_tsc = rdtsc();
+
+    virtio_blk_cq_t* cq = req->cq;
+    if (!cq) {
+        if (req->done) {
+            req->done(req);
+        }
+        return;
+    }
+
+    uint64_t flags;
+    spin_lock_irqsave(&cq->lock, flags);
+    cq->ring[cq->tail & (cq->size - 1)] = req;
+    cq->tail++;
+    pid_t waiter = cq->waiter;
+    cq->waiter = PID_INVALID;
+    spin_unlock_irqrestore(&cq->lock, flags);
+
+    if (waiter != PID_INVALID) {
+        unblock_task(waiter);
+    }
+}
+
+/*
+ * Put a device request on the ring (queue lock held)
+ *
+ * Returns false if the ring has no room; the caller defers it.
+ */
+static bool virtio_blk_add(virtio_blk_queue_t* q, virtio_blk_cmd_t* cmd) {
+    virtio_sg_t sg[VIRTIO_BLK_MAX_SEGS + 2];
+    uint32_t n = 0;
+    uint32_t out;
+
+    sg[n].addr = cmd->hdr_phys;
+    sg[n].len = sizeof(virtio_blk_req_hdr_t);
+    n++;
+    for (blk_request_t* req = cmd->reqs; req; req = req->next) {
+        sg[n].addr = req->phys;
+        sg[n].len = req->nr_sectors * VIRTIO_BLK_SECTOR_SIZE;
+        n++;
+    }
+
+    // Reads: the device writes the data segments along with the status
+    out = cmd->hdr->type == VIRTIO_BLK_T_IN ? 1 : n;
+
+    sg[n].addr = cmd->hdr_phys + VIRTIO_BLK_STATUS_OFFSET;
+    sg[n].len = 1;
+    n++;
+
+    if (virtqueue_add(q->vq, sg, out, n - out, cmd) < 0) {
+        return false;
+    }
+    q->inflight++;
+    q->stats.dispatched++;
+    return true;
+}
+
+/*
+ * Send a device request, behind any that are already waiting for room
+ * (queue lock held)
+ */
+static void virtio_blk_dispatch(virtio_blk_queue_t* q, virtio_blk_cmd_t* cmd) {
+    if (!q->deferred && virtio_blk_add(q, cmd)) {
+        return;
+    }
+
+    cmd->next = NULL;
+    if (q->deferred_tail) {
+        q->deferred_tail->next = cmd;
+    } else {
+        q->deferred = cmd;
+    }
+    q->deferred_tail = cmd;
+    q->stats.deferred++;
+}
+
+/*
+ * Check whether a request continues the plugged device request
+ */
+static bool virtio_blk_can_merge(virtio_blk_t* blk, virtio_blk_cmd_t* cmd, blk_request_t* req) {
+    if (cmd->hdr->type != req->op || req->op == BLK_OP_FLUSH) {
+        return false;
+    }
+    if (cmd->last->sector + cmd->last->nr_sectors != req->sector) {
+        return false;
+    }
+    if (cmd->nr_segs >= blk->seg_max || cmd->nr_segs >= VIRTIO_BLK_MAX_SEGS) {
+        return false;
+    }
+    return cmd->nr_sectors + req->nr_sectors <= VIRTIO_BLK_MAX_MERGE_SECTORS;
+}
+
+/*
+ * Submit a request on the calling CPU's queue
+ */
+int virtio_blk_submit(virtio_blk_t* blk, blk_request_t* req, bool more) {
+    uint64_t flags;
+
+    if (req->op == BLK_OP_FLUSH) {
+        req->sector = 0;
+        req->nr_sectors = 0;
+    } else if (req->op == BLK_OP_READ || req->op == BLK_OP_WRITE) {
+        if (req->nr_sectors == 0 || req->nr_sectors > VIRTIO_BLK_MAX_MERGE_SECTORS ||
+            req->sector + req->nr_sectors > blk->capacity) {
+            return -1;
+        }
+        if (req->op == BLK_OP_WRITE && blk->read_only) {
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+
+    // Reserve the completion slot up front so the softirq never finds the ring full
+    if (req->cq) {
+        spin_lock_irqsave(&req->cq->lock, flags);
+        if (req->cq->reserved == req->cq->size) {
+            spin_unlock_irqrestore(&req->cq->lock, flags);
+            return -1;
+        }
+        req->cq->reserved++;
+        spin_unlock_irqrestore(&req->cq->lock, flags);
+    }
+
+    req->next = NULL;
+    req->status = 0;
+    req->submit_tsc = rdtsc();
+
+    // Without a volatile write cache there is nothing to flush
+    if (req->op == BLK_OP_FLUSH && !virtio_has_feature(&blk->vdev, VIRTIO_BLK_F_FLUSH)) {
+        virtio_blk_deliver(req);
+        return 0;
+    }
+
+    // Migrating after this read only means using another CPU's queue once
+    virtio_blk_queue_t* q = &blk->queues[smp_processor_id() % blk->nr_queues];
+
+    spin_lock_irqsave(&q->lock, flags);
+
+    virtio_blk_cmd_t* cmd = q->plug;
+    if (cmd && virtio_blk_can_merge(blk, cmd, req)) {
+        cmd->last->next = req;
+        cmd->last = req;
+        cmd->nr_segs++;
+        cmd->nr_sectors += req->nr_sectors;
+        q->stats.merged++;
+    } else {
+        if (cmd) {
+            virtio_blk_dispatch(q, cmd);
+            q->plug = NULL;
+        }
+
+        cmd = q->free_cmds;
+        if (!cmd) {
+            virtqueue_kick(q->vq);
+            spin_unlock_irqrestore(&q->lock, flags);
+
+            if (req->cq) {
+                spin_lock_irqsave(&req->cq->lock, flags);
+                req->cq->reserved--;
+                spin_unlock_irqrestore(&req->cq->lock, flags);
+            }
+            return -1;
+        }
+        q->free_cmds = cmd->next;
+
+        cmd->hdr->type = req->op;
+        cmd->hdr->reserved = 0;
+        cmd->hdr->sector = req->sector;
+        cmd->reqs = req;
+        cmd->last = req;
+        cmd->nr_segs = req->op == BLK_OP_FLUSH ? 0 : 1;
+        cmd->nr_sectors = req->nr_sectors;
+
+        // A flush has no data segment
+        if (req->op == BLK_OP_FLUSH) {
+            cmd->reqs = NULL;
+        }
+        q->plug = cmd;
+    }
+    q->stats.requests++;
+
+    if (!more || req->op == BLK_OP_FLUSH) {
+        virtio_blk_dispatch(q, q->plug);
+        q->plug = NULL;
+        virtqueue_kick(q->vq);
+    }
+
+    spin_unlock_irqrestore(&q->lock, flags);
+    return 0;
+}
+
+/*
+ * Send requests held back for merging to the device
+ */
+void virtio_blk_unplug(virtio_blk_t* blk) {
+    uint64_t flags;
+
+    for (uint16_t i = 0; i < blk->nr_queues; i++) {
+        virtio_blk_queue_t* q = &blk->queues[i];
+
+        spin_lock_irqsave(&q->lock, flags);
+        if (q->plug) {
+            virtio_blk_dispatch(q, q->plug);
+            q->plug = NULL;
+            virtqueue_kick(q->vq);
+        }
+        spin_unlock_irqrestore(&q->lock, flags);
+    }
+}
+
+/*
+ * Reap completed device requests and re-arm the queue's interrupt
+ */
+static void virtio_blk_complete(virtio_blk_queue_t* q) {
+    blk_request_t* done;
+    blk_request_t** done_tail;
+    virtio_blk_cmd_t* cmd;
+    uint64_t flags;
+    bool armed;
+
+    q->stats.irq_polls++;
+
+    do {
+        done = NULL;
+        done_tail = &done;
+
+        spin_lock_irqsave(&q->lock, flags);
+        while ((cmd = (virtio_blk_cmd_t*)virtqueue_get_buf(q->vq, NULL)) != NULL) {
+            int status = virtio_blk_cmd_status(cmd) == VIRTIO_BLK_S_OK ? 0 : -1;
+            blk_request_t* req = cmd->reqs;
+
+            // A flush carries its request outside the segment list
+            if (cmd->hdr->type == VIRTIO_BLK_T_FLUSH) {
+                req = cmd->last;
+            }
+
+            for (; req; req = req->next) {
+                req->status = status;
+                *done_tail = req;
+                done_tail = &req->next;
+            }
+
+            if (status < 0) {
+                q->stats.errors++;
+            }
+            q->stats.completed++;
+            q->inflight--;
+            cmd->next = q->free_cmds;
+            q->free_cmds = cmd;
+        }
+
+        // Ring space was freed: move waiting requests onto it
+        bool added = false;
+        while (q->deferred && virtio_blk_add(q, q->deferred)) {
+            q->deferred = q->deferred->next;
+            added = true;
+        }
+        if (!q->deferred) {
+            q->deferred_tail = NULL;
+        }
+        if (added) {
+            virtqueue_kick(q->vq);
+        }
+
+        // Interrupt again after a batch, but never wait for more than is in flight
+        uint16_t batch = q->blk->coalesce;
+        if (batch > q->inflight) {
+            batch = (uint16_t)q->inflight;
+        }
+        armed = batch > 1 ? virtqueue_enable_cb_delayed(q->vq, batch) : virtqueue_enable_cb(q->vq);
+        if (!armed) {
+            virtqueue_disable_cb(q->vq);
+        }
+        spin_unlock_irqrestore(&q->lock, flags);
+
+        // Completion handlers may submit again, so run them unlocked
+        while (done) {
+            blk_request_t* req = done;
+            done = req->next;
+            req->next = NULL;
+            virtio_blk_deliver(req);
+        }
+    } while (!armed);
+}
+
+/*
+ * BLOCK softirq: reap the queues whose interrupts fired on this CPU
+ */
+static void virtio_blk_softirq(void) {
+    uint32_t cpu = smp_processor_id();
+
+    uint64_t flags = local_irq_save();
+    virtio_blk_queue_t* q = blk_softirq_list[cpu];
+    blk_softirq_list[cpu] = NULL;
+    local_irq_restore(flags);
+
+    while (q) {
+        virtio_blk_queue_t* next = q->next;
+
+        // Clear first: an interrupt from here on schedules the queue again
+        __atomic_store_n(&q->scheduled, 0, __ATOMIC_RELEASE);
+        virtio_blk_complete(q);
+        q = next;
+    }
+}
+
+/*
+ * Queue interrupt: leave the work to the softirq
+ */
+static void virtio_blk_interrupt(virtqueue_t* vq) {
+    virtio_blk_queue_t* q = (virtio_blk_queue_t*)vq->priv;
+    uint32_t cpu = smp_processor_id();
+
+    virtqueue_disable_cb(vq);
+    if (__atomic_exchange_n(&q->scheduled, 1, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    q->next = blk_softirq_list[cpu];
+    blk_softirq_list[cpu] = q;
+    raise_softirq_irqoff(SOFTIRQ_BLOCK);
+}
+
+/*
+ * Set how many completions the device batches per interrupt
+ */
+void virtio_blk_set_coalesce(virtio_blk_t* blk, uint16_t count) {
+    blk->coalesce = count > 0 ? count : 1;
+}
+
+/*
+ * Set up a completion queue
+ */
+int virtio_blk_cq_init(virtio_blk_cq_t* cq, uint32_t size) {
+    uint32_t n = 1;
+    while (n < size) {
+        n <<= 1;
+    }
+
+    memset(cq, 0, sizeof(*cq));
+    cq->lock = (spinlock_t)SPINLOCK_INIT;
+    cq->ring = (blk_request_t**)kzalloc(n * sizeof(blk_request_t*));
+    if (!cq->ring) {
+        return -1;
+    }
+    cq->size = n;
+    cq->waiter = PID_INVALID;
+    return 0;
+}
+
+/*
+ * Take up to max completed requests without blocking
+ */
+uint32_t virtio_blk_cq_reap(virtio_blk_cq_t* cq, blk_request_t** reqs, uint32_t max) {
+    uint64_t flags;
+    uint32_t n = 0;
+
+    spin_lock_irqsave(&cq->lock, flags);
+    while (n < max && cq->head != cq->tail) {
+        reqs[n++] = cq->ring[cq->head & (cq->size - 1)];
+        cq->head++;
+    }
+    cq->reserved -= n;
+    spin_unlock_irqrestore(&cq->lock, flags);
+
+    return n;
+}
+
+/*
+ * Take up to max completed requests, blocking until there is one
+ */
+uint32_t virtio_blk_cq_wait(virtio_blk_cq_t* cq, blk_request_t** reqs, uint32_t max) {
+    uint64_t flags;
+
+    for (;;) {
+        uint32_t n = virtio_blk_cq_reap(cq, reqs, max);
+        if (n > 0) {
+            return n;
+        }
+
+        // Blocked before the final check, so a completion in between is not lost
+        prepare_to_block();
+
+        spin_lock_irqsave(&cq->lock, flags);
+        if (cq->head != cq->tail) {
+            spin_unlock_irqrestore(&cq->lock, flags);
+            cancel_block();
+            continue;
+        }
+        cq->waiter = get_current_pid();
+        spin_unlock_irqrestore(&cq->lock, flags);
+
+        schedule();
+    }
+}
+
+/*
+ * Get a probed device
+ */
+virtio_blk_t* virtio_blk_get(uint32_t index) {
+    return index < nr_virtio_blk ? &virtio_blk_devices[index] : NULL;
+}
+
+/*
+ * Set up one request queue
+ */
+static int virtio_blk_setup_queue(virtio_blk_t* blk, uint16_t index) {
+    virtio_blk_queue_t* q = &blk->queues[index];
+
+    q->blk = blk;
+    q->index = index;
+    q->lock = (spinlock_t)SPINLOCK_INIT;
+
+    q->vq = virtio_setup_vq(&blk->vdev, index, VIRTIO_BLK_RING_SIZE, index,
+                            virtio_blk_interrupt, q);
+    if (!q->vq) {
+        return -1;
+    }
+
+    // Headers and status bytes share one DMA page
+    uint8_t* dma = (uint8_t*)alloc_page();
+    q->cmds = (virtio_blk_cmd_t*)kzalloc(VIRTIO_BLK_MAX_CMDS * sizeof(virtio_blk_cmd_t));
+    if (!dma || !q->cmds) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < VIRTIO_BLK_MAX_CMDS; i++) {
+        virtio_blk_cmd_t* cmd = &q->cmds[i];
+        cmd->hdr = (virtio_blk_req_hdr_t*)(dma + i * VIRTIO_BLK_CMD_DMA_SIZE);
+        cmd->hdr_phys = (uint64_t)cmd->hdr;
+        cmd->next = q->free_cmds;
+        q->free_cmds = cmd;
+    }
+
+    // Queue i belongs to CPU i; its completions run there
+    q->cpu = index % num_online_cpus();
+    virtio_vq_set_cpu(q->vq, q->cpu);
+    return 0;
+}
+
+/*
+ * Bring up one device
+ */
+static int virtio_blk_probe(virtio_blk_t* blk, pci_device_t* pci) {
+    virtio_blk_config_t config;
+
+    if (virtio_init_device(&blk->vdev, pci, VIRTIO_ID_BLOCK) < 0) {
+        return -1;
+    }
+
+    uint64_t features = (1ULL << VIRTIO_BLK_F_SEG_MAX) | (1ULL << VIRTIO_BLK_F_BLK_SIZE) |
+                        (1ULL << VIRTIO_BLK_F_RO) | (1ULL << VIRTIO_BLK_F_FLUSH) |
+                        (1ULL << VIRTIO_BLK_F_MQ) | (1ULL << VIRTIO_F_EVENT_IDX) |
+                        (1ULL << VIRTIO_F_RING_PACKED);
+    if (virtio_negotiate(&blk->vdev, features) < 0) {
+        return -1;
+    }
+
+    virtio_read_config(&blk->vdev, 0, &config, sizeof(config));
+    blk->capacity = config.capacity;
+    blk->read_only = virtio_has_feature(&blk->vdev, VIRTIO_BLK_F_RO);
+    blk->coalesce = VIRTIO_BLK_COALESCE_DEFAULT;
+
+    // Data segments per request the device accepts
+    blk->seg_max = 1;
+    if (virtio_has_feature(&blk->vdev, VIRTIO_BLK_F_SEG_MAX) && config.seg_max > 1) {
+        blk->seg_max = config.seg_max;
+    }
+
+    // One queue per CPU, up to what the device offers
+    blk->nr_queues = 1;
+    if (virtio_has_feature(&blk->vdev, VIRTIO_BLK_F_MQ) && config.num_queues > 1) {
+        blk->nr_queues = config.num_queues;
+    }
+    if (blk->nr_queues > num_online_cpus()) {
+        blk->nr_queues = (uint16_t)num_online_cpus();
+    }
+    if (blk->nr_queues > VIRTIO_BLK_MAX_QUEUES) {
+        blk->nr_queues = VIRTIO_BLK_MAX_QUEUES;
+    }
+
+    // Completions are interrupt driven: every queue needs a vector
+    int vectors = virtio_alloc_vectors(&blk->vdev, blk->nr_queues);
+    if (vectors <= 0) {
+        kernel_printf("virtio-blk%u: no MSI-X vectors\n", blk->id);
+        return -1;
+    }
+    if (vectors < blk->nr_queues) {
+        blk->nr_queues = (uint16_t)vectors;
+    }
+
+    for (uint16_t i = 0; i < blk->nr_queues; i++) {
+        if (virtio_blk_setup_queue(blk, i) < 0) {
+            kernel_printf("virtio-blk%u: failed to set up queue %u\n", blk->id, i);
+            return -1;
+        }
+    }
+
+    virtio_device_ready(&blk->vdev);
+
+    kernel_printf("virtio-blk%u: %llu sectors, %u queues, %s ring, seg_max %u%s\n",
+                  blk->id, blk->capacity, blk->nr_queues,
+                  virtio_has_feature(&blk->vdev, VIRTIO_F_RING_PACKED) ? "packed" : "split",
+                  blk->seg_max, blk->read_only ? ", read-only" : "");
+    return 0;
+}
+
+/*
+ * Probe all virtio-blk devices
+ */
+void init_virtio_blk(void) {
+    pci_device_t* pci;
+
+    open_softirq(SOFTIRQ_BLOCK, virtio_blk_softirq);
+
+    for (uint32_t i = 0; (pci = virtio_pci_find(VIRTIO_ID_BLOCK, i)) != NULL; i++) {
+        if (nr_virtio_blk >= VIRTIO_BLK_MAX_DEVICES) {
+            break;
+        }
+
+        virtio_blk_t* blk = &virtio_blk_devices[nr_virtio_blk];
+        blk->id = nr_virtio_blk;
+        if (virtio_blk_probe(blk, pci) == 0) {
+            nr_virtio_blk++;
+        } else {
+            virtio_reset(&blk->vdev);
+        }
+    }
+}
+
+/*
+ * Print per-queue statistics
+ */
+void dump_virtio_blk_stats(virtio_blk_t* blk) {
+    kernel_printf("virtio-blk%u statistics (coalesce %u):\n", blk->id, blk->coalesce);
+
+    for (uint16_t i = 0; i < blk->nr_queues; i++) {
+        virtio_blk_queue_t* q = &blk->queues[i];
+        kernel_printf("  queue %u (CPU %u): %llu requests, %llu merged, %llu dispatched, "
+                      "%llu completed, %llu errors, %llu deferred\n",
+                      i, q->cpu, q->stats.requests, q->stats.merged, q->stats.dispatched,
+                      q->stats.completed, q->stats.errors, q->stats.deferred);
+        kernel_printf("           %llu interrupts, %llu softirq runs, %llu kicks, "
+                      "%llu suppressed\n",
+                      q->vq->stats.interrupts, q->stats.irq_polls, q->vq->stats.kicks,
+                      q->vq->stats.kicks_suppressed);
+    }
+}
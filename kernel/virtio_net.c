@@ -0,0 +1,620 @@
+/*
+ * EdgeX OS - Virtio Network Device
+ *
+ * This file implements the virtio-net driver. Every queue pair has its
+ * own MSI-X vector for RX, steered to the CPU that consumes the queue;
+ * the first interrupt switches the queue to NAPI polling, which keeps
+ * running from the NET_RX softirq while packets keep arriving. TX
+ * completions are reaped lazily (no TX interrupts) and TX doorbells are
+ * batched by the caller's "more" hint. RX buffers are refilled in
+ * batches so that one doorbell covers many buffers.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/ipc.h>
+#include <edgex/cpu.h>
+#include <edgex/tsc.h>
+#include <edgex/spinlock.h>
+#include <edgex/virtio.h>
+#include <edgex/napi.h>
+#include <edgex/virtio_net.h>
+
+/* Control virtqueue commands */
+#define VIRTIO_NET_CTRL_MQ                 4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET    0
+#define VIRTIO_NET_OK                      0
+
+/* Control command timeout */
+#define VIRTIO_NET_CTRL_TIMEOUT_NS         100000000
+
+/* RX buffers per queue: a full ring plus as many held by the consumer */
+#define VIRTIO_NET_RX_BUFS_PER_QUEUE       (2 * VIRTIO_NET_RING_SIZE)
+
+static virtio_net_t virtio_net_devices[VIRTIO_NET_MAX_DEVICES];
+static uint32_t nr_virtio_net = 0;
+
+/*
+ * Post free RX buffers
+ *
+ * Waits for a batch to accumulate unless the ring is running dry, so
+ * the doorbell cost is shared by VIRTIO_NET_RX_REFILL_BATCH buffers.
+ */
+static void virtio_net_refill(virtio_net_queue_t* q, bool force) {
+    virtio_net_t* net = q->net;
+    virtqueue_t* vq = q->rx;
+    uint64_t flags;
+    uint32_t posted = 0;
+
+    // Fewer than a quarter of the ring posted counts as running dry
+    bool low = vq->num_free > vq->num - vq->num / 4;
+    if (!force && !low && q->rx_free_count < VIRTIO_NET_RX_REFILL_BATCH) {
+        return;
+    }
+
+    spin_lock_irqsave(&q->rx_lock, flags);
+    while (q->rx_free_count > 0 && virtqueue_num_free(vq) > 0) {
+        uint32_t buf = q->rx_free[q->rx_free_count - 1];
+        virtio_sg_t sg = {
+            .addr = net->rx_buf_phys[buf],
+            .len = VIRTIO_NET_RX_BUF_SIZE,
+        };
+
+        // Token is buffer ID + 1 so that buffer 0 is not a NULL token
+        if (virtqueue_add(vq, &sg, 0, 1, (void*)(uintptr_t)(buf + 1)) < 0) {
+            break;
+        }
+        q->rx_free_count--;
+        posted++;
+    }
+    if (posted == 0 && vq->num_free == vq->num) {
+        q->stats.rx_starved++;
+    }
+    spin_unlock_irqrestore(&q->rx_lock, flags);
+
+    if (posted) {
+        q->stats.rx_refills++;
+        virtqueue_kick(vq);
+    }
+}
+
+/*
+ * Return an RX buffer to its queue's free list
+ */
+void virtio_net_rx_release(virtio_net_t* net, uint16_t queue, uint32_t buf) {
+    if (queue >= net->nr_queues) {
+        return;
+    }
+
+    virtio_net_queue_t* q = &net->queues[queue];
+    uint64_t flags;
+
+    spin_lock_irqsave(&q->rx_lock, flags);
+    q->rx_free[q->rx_free_count++] = buf;
+    spin_unlock_irqrestore(&q->rx_lock, flags);
+}
+
+/*
+ * Get the kernel view of an RX buffer's packet data
+ */
+void* virtio_net_rx_data(virtio_net_t* net, uint32_t buf) {
+    if (buf >= net->rx_bufs) {
+        return NULL;
+    }
+    // The pool's pages are below the identity-mapped limit
+    return (void*)(uintptr_t)(net->rx_buf_phys[buf] + sizeof(virtio_net_hdr_t));
+}
+
+/*
+ * Reap finished transmissions (tx_lock held)
+ */
+static void virtio_net_tx_reclaim(virtio_net_queue_t* q) {
+    virtio_net_t* net = q->net;
+    void* token;
+
+    while ((token = virtqueue_get_buf(q->tx, NULL)) != NULL) {
+        uint16_t slot = (uint16_t)((uintptr_t)token - 1);
+        void* cookie = q->tx_cookies[slot];
+
+        q->tx_cookies[slot] = NULL;
+        q->tx_free[q->tx_free_count++] = slot;
+
+        if (net->tx_done) {
+            net->tx_done(net, q->index, cookie);
+        }
+    }
+}
+
+/*
+ * Process received packets (the caller owns the queue's poll state)
+ */
+static int virtio_net_rx_process(virtio_net_queue_t* q, int budget) {
+    virtio_net_t* net = q->net;
+    uint32_t len;
+    void* token;
+    int work = 0;
+
+    while (work < budget && (token = virtqueue_get_buf(q->rx, &len)) != NULL) {
+        uint32_t buf = (uint32_t)((uintptr_t)token - 1);
+        bool kept = false;
+
+        if (len > sizeof(virtio_net_hdr_t)) {
+            uint32_t pkt_len = len - sizeof(virtio_net_hdr_t);
+            q->stats.rx_packets++;
+            q->stats.rx_bytes += pkt_len;
+
+            if (net->rx_handler) {
+                kept = net->rx_handler(net, q->index, buf, virtio_net_rx_data(net, buf),
+                                       pkt_len, net->rx_ctx);
+            }
+        }
+
+        if (kept) {
+            q->stats.rx_kept++;
+        } else {
+            virtio_net_rx_release(net, q->index, buf);
+        }
+        work++;
+    }
+
+    // TX has no interrupt; reap completions while we are here
+    uint64_t flags;
+    spin_lock_irqsave(&q->tx_lock, flags);
+    virtio_net_tx_reclaim(q);
+    spin_unlock_irqrestore(&q->tx_lock, flags);
+
+    virtio_net_refill(q, false);
+    return work;
+}
+
+/*
+ * NAPI poll function
+ */
+static int virtio_net_napi_poll(napi_t* napi, int budget) {
+    virtio_net_queue_t* q = (virtio_net_queue_t*)napi->priv;
+    int work = virtio_net_rx_process(q, budget);
+
+    if (work < budget && !q->busy_poll) {
+        napi_complete(napi);
+
+        // Back to interrupt mode, unless packets slipped in meanwhile
+        if (!virtqueue_enable_cb(q->rx) && napi_schedule(napi)) {
+            virtqueue_disable_cb(q->rx);
+        }
+    }
+    return work;
+}
+
+/*
+ * RX interrupt: switch the queue to polling
+ */
+static void virtio_net_rx_interrupt(virtqueue_t* vq) {
+    virtio_net_queue_t* q = (virtio_net_queue_t*)vq->priv;
+
+    virtqueue_disable_cb(vq);
+    if (!q->busy_poll) {
+        napi_schedule(&q->napi);
+    }
+}
+
+/*
+ * Poll a queue from its consumer (busy polling mode)
+ */
+int virtio_net_poll(virtio_net_t* net, uint16_t queue, int budget) {
+    if (queue >= net->nr_queues) {
+        return -1;
+    }
+
+    virtio_net_queue_t* q = &net->queues[queue];
+
+    // The NAPI scheduled bit doubles as the queue's poll ownership
+    if (__atomic_fetch_or(&q->napi.state, NAPI_STATE_SCHED, __ATOMIC_ACQUIRE) & NAPI_STATE_SCHED) {
+        return 0;
+    }
+
+    q->stats.busy_polls++;
+    int work = virtio_net_rx_process(q, budget);
+    napi_complete(&q->napi);
+    return work;
+}
+
+/*
+ * Switch a queue between interrupt-driven NAPI and consumer polling
+ */
+void virtio_net_set_busy_poll(virtio_net_t* net, uint16_t queue, bool enable) {
+    if (queue >= net->nr_queues) {
+        return;
+    }
+
+    virtio_net_queue_t* q = &net->queues[queue];
+
+    // A queue without an interrupt vector can only be polled
+    if (!enable && q->rx->irq < 0) {
+        return;
+    }
+    q->busy_poll = enable;
+
+    if (enable) {
+        virtqueue_disable_cb(q->rx);
+    } else if (!virtqueue_enable_cb(q->rx) && napi_schedule(&q->napi)) {
+        virtqueue_disable_cb(q->rx);
+    }
+}
+
+/*
+ * Transmit a frame
+ */
+int virtio_net_xmit(virtio_net_t* net, uint16_t queue, const virtio_net_tx_t* pkt, bool more) {
+    if (queue >= net->nr_queues) {
+        return -1;
+    }
+
+    virtio_net_queue_t* q = &net->queues[queue];
+    uint64_t flags;
+
+    spin_lock_irqsave(&q->tx_lock, flags);
+
+    if (q->tx_free_count == 0 || virtqueue_num_free(q->tx) < 2) {
+        virtio_net_tx_reclaim(q);
+    }
+    if (q->tx_free_count == 0 || virtqueue_num_free(q->tx) < 2) {
+        // Make sure the device is working on what is queued
+        virtqueue_kick(q->tx);
+        q->stats.tx_full++;
+        spin_unlock_irqrestore(&q->tx_lock, flags);
+        return -1;
+    }
+
+    uint16_t slot = q->tx_free[--q->tx_free_count];
+    virtio_net_hdr_t* hdr = &q->tx_hdrs[slot];
+
+    memset(hdr, 0, sizeof(*hdr));
+    if (pkt->csum_offset && virtio_net_has_csum_offload(net)) {
+        hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr->csum_start = pkt->csum_start;
+        hdr->csum_offset = pkt->csum_offset;
+    }
+
+    virtio_sg_t sg[2] = {
+        { .addr = q->tx_hdrs_phys + slot * sizeof(virtio_net_hdr_t),
+          .len = sizeof(virtio_net_hdr_t) },
+        { .addr = pkt->phys, .len = pkt->len },
+    };
+
+    q->tx_cookies[slot] = pkt->cookie;
+    virtqueue_add(q->tx, sg, 2, 0, (void*)(uintptr_t)(slot + 1));
+    q->stats.tx_packets++;
+    q->stats.tx_bytes += pkt->len;
+
+    if (!more) {
+        virtqueue_kick(q->tx);
+    }
+
+    spin_unlock_irqrestore(&q->tx_lock, flags);
+    return 0;
+}
+
+/*
+ * Ring the TX doorbell for frames queued with more set
+ */
+void virtio_net_flush(virtio_net_t* net, uint16_t queue) {
+    if (queue >= net->nr_queues) {
+        return;
+    }
+
+    virtio_net_queue_t* q = &net->queues[queue];
+    uint64_t flags;
+
+    spin_lock_irqsave(&q->tx_lock, flags);
+    virtqueue_kick(q->tx);
+    spin_unlock_irqrestore(&q->tx_lock, flags);
+}
+
+/*
+ * Checksum offload is available on transmit
+ */
+bool virtio_net_has_csum_offload(virtio_net_t* net) {
+    return virtio_has_feature(&net->vdev, VIRTIO_NET_F_CSUM);
+}
+
+/*
+ * Check whether the device vouched for a received packet's checksum
+ */
+bool virtio_net_rx_csum_valid(virtio_net_t* net, uint32_t buf) {
+    if (buf >= net->rx_bufs || !virtio_has_feature(&net->vdev, VIRTIO_NET_F_GUEST_CSUM)) {
+        return false;
+    }
+
+    // A partially checksummed packet came from a local sender and is intact
+    virtio_net_hdr_t* hdr = (virtio_net_hdr_t*)(uintptr_t)net->rx_buf_phys[buf];
+    return (hdr->flags & (VIRTIO_NET_HDR_F_DATA_VALID | VIRTIO_NET_HDR_F_NEEDS_CSUM)) != 0;
+}
+
+/*
+ * Install the consumer callbacks
+ */
+void virtio_net_set_handlers(virtio_net_t* net, virtio_net_rx_handler_t rx,
+                             virtio_net_tx_done_t tx_done, void* ctx) {
+    net->rx_ctx = ctx;
+    net->tx_done = tx_done;
+    __atomic_store_n(&net->rx_handler, rx, __ATOMIC_RELEASE);
+}
+
+/*
+ * Steer a queue's interrupt to a CPU
+ */
+int virtio_net_set_queue_cpu(virtio_net_t* net, uint16_t queue, uint32_t cpu) {
+    if (queue >= net->nr_queues) {
+        return -1;
+    }
+
+    virtio_net_queue_t* q = &net->queues[queue];
+    int ret = virtio_vq_set_cpu(q->rx, cpu);
+    if (ret == 0) {
+        q->cpu = cpu;
+    }
+    return ret;
+}
+
+/*
+ * Get a probed device
+ */
+virtio_net_t* virtio_net_get(uint32_t index) {
+    return index < nr_virtio_net ? &virtio_net_devices[index] : NULL;
+}
+
+/*
+ * Send a command on the control queue and wait for the answer
+ */
+static int virtio_net_ctrl_cmd(virtio_net_t* net, uint8_t class, uint8_t cmd,
+                               const void* data, uint32_t len) {
+    uint8_t* buf = (uint8_t*)alloc_page();
+    if (!buf || !net->ctrl) {
+        return -1;
+    }
+
+    uint64_t phys = (uint64_t)buf;
+    buf[0] = class;
+    buf[1] = cmd;
+    memcpy(buf + 2, data, len);
+    buf[2 + len] = 0xFF;
+
+    virtio_sg_t sg[3] = {
+        { .addr = phys, .len = 2 },
+        { .addr = phys + 2, .len = len },
+        { .addr = phys + 2 + len, .len = 1 },
+    };
+
+    int ret = -1;
+    if (virtqueue_add(net->ctrl, sg, 2, 1, buf) == 0) {
+        virtqueue_kick(net->ctrl);
+
+        uint64_t deadline = rdtsc() + ns_to_tsc(VIRTIO_NET_CTRL_TIMEOUT_NS);
+        while (!virtqueue_has_used(net->ctrl) && rdtsc() < deadline) {
+            __asm__ volatile("pause");
+        }
+        if (virtqueue_get_buf(net->ctrl, NULL) == buf && buf[2 + len] == VIRTIO_NET_OK) {
+            ret = 0;
+        }
+    }
+
+    free_page(buf);
+    return ret;
+}
+
+/*
+ * Allocate the RX buffer pool, preferably as a shared memory region
+ */
+static int virtio_net_alloc_rx_pool(virtio_net_t* net) {
+    net->rx_bufs = net->nr_queues * VIRTIO_NET_RX_BUFS_PER_QUEUE;
+    net->rx_buf_phys = (uint64_t*)kzalloc(net->rx_bufs * sizeof(uint64_t));
+    if (!net->rx_buf_phys) {
+        return -1;
+    }
+
+    // Consumers map the region read-only and read packets in place
+    strncpy(net->rx_pool_name, "virtio-net0.rx", sizeof(net->rx_pool_name) - 1);
+    net->rx_pool_name[10] = (char)('0' + net->id);
+    net->rx_pool = create_shared_memory(net->rx_pool_name,
+                                        (size_t)net->rx_bufs * VIRTIO_NET_RX_BUF_SIZE,
+                                        SHM_PERM_READ, SHM_FLAG_CREATE);
+
+    uint32_t per_page = PAGE_SIZE / VIRTIO_NET_RX_BUF_SIZE;
+    uint8_t* page = NULL;
+
+    for (uint32_t i = 0; i < net->rx_bufs; i++) {
+        if (net->rx_pool) {
+            net->rx_buf_phys[i] = shared_memory_phys(net->rx_pool,
+                                                     (size_t)i * VIRTIO_NET_RX_BUF_SIZE);
+        } else {
+            // Without the IPC layer the pool stays kernel-private
+            if (i % per_page == 0) {
+                page = (uint8_t*)alloc_page();
+                if (!page) {
+                    return -1;
+                }
+            }
+            net->rx_buf_phys[i] = (uint64_t)(page + (i % per_page) * VIRTIO_NET_RX_BUF_SIZE);
+        }
+    }
+
+    if (!net->rx_pool) {
+        kernel_printf("virtio-net%u: RX pool is not shared (no shared memory)\n", net->id);
+    }
+    return 0;
+}
+
+/*
+ * Set up one queue pair
+ */
+static int virtio_net_setup_queue(virtio_net_t* net, uint16_t index) {
+    virtio_net_queue_t* q = &net->queues[index];
+    int vector = index < net->vdev.nr_vectors ? (int)index : -1;
+
+    q->net = net;
+    q->index = index;
+    q->rx_lock = (spinlock_t)SPINLOCK_INIT;
+    q->tx_lock = (spinlock_t)SPINLOCK_INIT;
+    napi_init(&q->napi, virtio_net_napi_poll, NAPI_POLL_WEIGHT, q);
+
+    q->rx = virtio_setup_vq(&net->vdev, 2 * index, VIRTIO_NET_RING_SIZE, vector,
+                            virtio_net_rx_interrupt, q);
+    q->tx = virtio_setup_vq(&net->vdev, 2 * index + 1, VIRTIO_NET_RING_SIZE, -1, NULL, q);
+    if (!q->rx || !q->tx) {
+        return -1;
+    }
+
+    // Without a vector the queue can only be busy polled
+    if (q->rx->irq < 0) {
+        q->busy_poll = true;
+    }
+
+    // All of this queue's RX buffers start out free
+    q->rx_first = index * VIRTIO_NET_RX_BUFS_PER_QUEUE;
+    q->rx_free = (uint32_t*)kzalloc(VIRTIO_NET_RX_BUFS_PER_QUEUE * sizeof(uint32_t));
+    if (!q->rx_free) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < VIRTIO_NET_RX_BUFS_PER_QUEUE; i++) {
+        q->rx_free[q->rx_free_count++] = q->rx_first + i;
+    }
+
+    // Two descriptors per frame: header and data
+    uint16_t slots = q->tx->num / 2;
+    q->tx_hdrs = (virtio_net_hdr_t*)alloc_page();
+    q->tx_free = (uint16_t*)kzalloc(slots * sizeof(uint16_t));
+    q->tx_cookies = (void**)kzalloc(slots * sizeof(void*));
+    if (!q->tx_hdrs || !q->tx_free || !q->tx_cookies) {
+        return -1;
+    }
+    q->tx_hdrs_phys = (uint64_t)q->tx_hdrs;
+    for (uint16_t i = 0; i < slots; i++) {
+        q->tx_free[q->tx_free_count++] = i;
+    }
+
+    // Spread queues over the online CPUs: queue i belongs to CPU i
+    q->cpu = index % num_online_cpus();
+    virtio_vq_set_cpu(q->rx, q->cpu);
+    return 0;
+}
+
+/*
+ * Bring up one device
+ */
+static int virtio_net_probe(virtio_net_t* net, pci_device_t* pci) {
+    virtio_net_config_t config;
+
+    if (virtio_init_device(&net->vdev, pci, VIRTIO_ID_NET) < 0) {
+        return -1;
+    }
+
+    uint64_t features = (1ULL << VIRTIO_NET_F_MAC) | (1ULL << VIRTIO_NET_F_STATUS) |
+                        (1ULL << VIRTIO_NET_F_MTU) | (1ULL << VIRTIO_NET_F_CSUM) |
+                        (1ULL << VIRTIO_NET_F_GUEST_CSUM) |
+                        (1ULL << VIRTIO_NET_F_CTRL_VQ) | (1ULL << VIRTIO_NET_F_MQ) |
+                        (1ULL << VIRTIO_F_EVENT_IDX) | (1ULL << VIRTIO_F_RING_PACKED);
+    if (virtio_negotiate(&net->vdev, features) < 0) {
+        return -1;
+    }
+
+    virtio_read_config(&net->vdev, 0, &config, sizeof(config));
+    memcpy(net->mac, config.mac, sizeof(net->mac));
+    net->mtu = virtio_has_feature(&net->vdev, VIRTIO_NET_F_MTU) ? config.mtu : 1500;
+
+    // One queue pair per CPU, up to what the device offers
+    uint16_t max_pairs = 1;
+    if (virtio_has_feature(&net->vdev, VIRTIO_NET_F_MQ) &&
+        virtio_has_feature(&net->vdev, VIRTIO_NET_F_CTRL_VQ)) {
+        max_pairs = config.max_virtqueue_pairs;
+    }
+    net->nr_queues = max_pairs;
+    if (net->nr_queues > num_online_cpus()) {
+        net->nr_queues = (uint16_t)num_online_cpus();
+    }
+    if (net->nr_queues > VIRTIO_NET_MAX_QUEUES) {
+        net->nr_queues = VIRTIO_NET_MAX_QUEUES;
+    }
+
+    // One vector per RX queue; without MSI-X the queues are busy polled
+    if (virtio_alloc_vectors(&net->vdev, net->nr_queues) < net->nr_queues) {
+        kernel_printf("virtio-net%u: fewer MSI-X vectors than queues\n", net->id);
+    }
+
+    for (uint16_t i = 0; i < net->nr_queues; i++) {
+        if (virtio_net_setup_queue(net, i) < 0) {
+            kernel_printf("virtio-net%u: failed to set up queue %u\n", net->id, i);
+            return -1;
+        }
+    }
+
+    if (virtio_has_feature(&net->vdev, VIRTIO_NET_F_CTRL_VQ)) {
+        net->ctrl = virtio_setup_vq(&net->vdev, 2 * max_pairs, 16, -1, NULL, net);
+    }
+
+    if (virtio_net_alloc_rx_pool(net) < 0) {
+        kernel_printf("virtio-net%u: out of memory for RX buffers\n", net->id);
+        return -1;
+    }
+
+    virtio_device_ready(&net->vdev);
+
+    if (net->nr_queues > 1) {
+        uint16_t pairs = net->nr_queues;
+        if (virtio_net_ctrl_cmd(net, VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+                                &pairs, sizeof(pairs)) < 0) {
+            kernel_printf("virtio-net%u: device refused %u queue pairs\n", net->id, pairs);
+            net->nr_queues = 1;
+        }
+    }
+
+    for (uint16_t i = 0; i < net->nr_queues; i++) {
+        virtio_net_refill(&net->queues[i], true);
+    }
+
+    kernel_printf("virtio-net%u: %x:%x:%x:%x:%x:%x, %u queues, %s ring, MTU %u%s\n",
+                  net->id, net->mac[0], net->mac[1], net->mac[2], net->mac[3],
+                  net->mac[4], net->mac[5], net->nr_queues,
+                  virtio_has_feature(&net->vdev, VIRTIO_F_RING_PACKED) ? "packed" : "split",
+                  net->mtu, virtio_net_has_csum_offload(net) ? ", TX csum offload" : "");
+    return 0;
+}
+
+/*
+ * Probe all virtio-net devices
+ */
+void init_virtio_net(void) {
+    pci_device_t* pci;
+
+    for (uint32_t i = 0; (pci = virtio_pci_find(VIRTIO_ID_NET, i)) != NULL; i++) {
+        if (nr_virtio_net >= VIRTIO_NET_MAX_DEVICES) {
+            break;
+        }
+
+        virtio_net_t* net = &virtio_net_devices[nr_virtio_net];
+        net->id = nr_virtio_net;
+        if (virtio_net_probe(net, pci) == 0) {
+            nr_virtio_net++;
+        } else {
+            virtio_reset(&net->vdev);
+        }
+    }
+}
+
+/*
+ * Print per-queue statistics
+ */
+void dump_virtio_net_stats(virtio_net_t* net) {
+    kernel_printf("virtio-net%u statistics:\n", net->id);
+
+    for (uint16_t i = 0; i < net->nr_queues; i++) {
+        virtio_net_queue_t* q = &net->queues[i];
+        kernel_printf("  queue %u (CPU %u, %s): rx %llu pkts %llu bytes, %llu refills, "
+                      "%llu starved; tx %llu pkts, %llu kicks, %llu suppressed, %llu full\n",
+                      i, q->cpu, q->busy_poll ? "busy poll" : "napi",
+                      q->stats.rx_packets, q->stats.rx_bytes, q->stats.rx_refills,
+                      q->stats.rx_starved, q->stats.tx_packets, q->tx->stats.kicks,
+                      q->tx->stats.kicks_suppressed, q->stats.tx_full);
+        kernel_printf("           rx irqs %llu, napi polls %llu, busy polls %llu\n",
+                      q->rx->stats.interrupts, q->napi.stats.polls, q->stats.busy_polls);
+    }
+}
@@ -0,0 +1,295 @@
+/*
+ * EdgeX OS - String Formatting
+ *
+ * This file implements vsnprintf() and friends for the kernel. It covers
+ * the conversions the kernel uses (d i u x X o p s c %) with flags
+ * ("-0+ #"), width and precision (also as '*'), and the hh, h, l, ll, z
+ * and t length modifiers. Floating point is not supported.
+ */
+
+#include <edgex/kernel.h>
+
+/* Output state: characters past the end are counted but not stored */
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t len;
+} fmt_out_t;
+
+#define FMT_LEFT        (1 << 0)
+#define FMT_ZERO        (1 << 1)
+#define FMT_PLUS        (1 << 2)
+#define FMT_SPACE       (1 << 3)
+#define FMT_ALT         (1 << 4)
+#define FMT_UPPER       (1 << 5)
+
+static inline void fmt_putc(fmt_out_t* out, char c) {
+    if (out->len + 1 < out->size) {
+        out->buf[out->len] = c;
+    }
+    out->len++;
+}
+
+static void fmt_pad(fmt_out_t* out, char c, int count) {
+    while (count-- > 0) {
+        fmt_putc(out, c);
+    }
+}
+
+/*
+ * Format an integer with its sign or prefix, precision and padding
+ */
+static void fmt_number(fmt_out_t* out, uint64_t value, bool negative, uint32_t base,
+                       int flags, int width, int precision) {
+    const char* digits = (flags & FMT_UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[24];
+    int n = 0;
+    char sign = 0;
+    const char* prefix = "";
+    bool nonzero = value != 0;
+
+    // A zero value with zero precision prints no digits
+    if (value != 0 || precision != 0) {
+        do {
+            tmp[n++] = digits[value % base];
+            value /= base;
+        } while (value != 0);
+    }
+
+    if (negative) {
+        sign = '-';
+    } else if (flags & FMT_PLUS) {
+        sign = '+';
+    } else if (flags & FMT_SPACE) {
+        sign = ' ';
+    }
+    if (flags & FMT_ALT) {
+        if (base == 16 && nonzero) {
+            prefix = (flags & FMT_UPPER) ? "0X" : "0x";
+        } else if (base == 8 && precision <= n && (nonzero || n == 0)) {
+            // Only when needed to make the first digit a zero
+            prefix = "0";
+        }
+    }
+
+    int prefix_len = sign ? 1 : 0;
+    for (const char* p = prefix; *p; p++) {
+        prefix_len++;
+    }
+    int zeros = precision > n ? precision - n : 0;
+    int pad = width - prefix_len - zeros - n;
+
+    // The 0 flag is ignored when a precision is given
+    if ((flags & FMT_ZERO) && !(flags & FMT_LEFT) && precision < 0) {
+        zeros += pad > 0 ? pad : 0;
+        pad = 0;
+    }
+
+    if (!(flags & FMT_LEFT)) {
+        fmt_pad(out, ' ', pad);
+    }
+    if (sign) {
+        fmt_putc(out, sign);
+    }
+    while (*prefix) {
+        fmt_putc(out, *prefix++);
+    }
+    fmt_pad(out, '0', zeros);
+    while (n > 0) {
+        fmt_putc(out, tmp[--n]);
+    }
+    if (flags & FMT_LEFT) {
+        fmt_pad(out, ' ', pad);
+    }
+}
+
+static void fmt_string(fmt_out_t* out, const char* s, int flags, int width, int precision) {
+    int len = 0;
+
+    if (!s) {
+        s = "(null)";
+    }
+    while (s[len] && (precision < 0 || len < precision)) {
+        len++;
+    }
+
+    if (!(flags & FMT_LEFT)) {
+        fmt_pad(out, ' ', width - len);
+    }
+    for (int i = 0; i < len; i++) {
+        fmt_putc(out, s[i]);
+    }
+    if (flags & FMT_LEFT) {
+        fmt_pad(out, ' ', width - len);
+    }
+}
+
+/*
+ * Format into buf (always NUL-terminated if size > 0)
+ *
+ * Returns the length the full output would have, like C99 vsnprintf().
+ */
+int vsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    fmt_out_t out = { .buf = buf, .size = size, .len = 0 };
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            fmt_putc(&out, *fmt++);
+            continue;
+        }
+        fmt++;
+
+        // Flags
+        int flags = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') {
+                flags |= FMT_LEFT;
+            } else if (*fmt == '0') {
+                flags |= FMT_ZERO;
+            } else if (*fmt == '+') {
+                flags |= FMT_PLUS;
+            } else if (*fmt == ' ') {
+                flags |= FMT_SPACE;
+            } else if (*fmt == '#') {
+                flags |= FMT_ALT;
+            } else {
+                break;
+            }
+        }
+
+        // Width and precision
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                flags |= FMT_LEFT;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                width = width * 10 + (*fmt++ - '0');
+            }
+        }
+
+        int precision = -1;
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                precision = va_arg(args, int);
+                fmt++;
+            } else {
+                while (*fmt >= '0' && *fmt <= '9') {
+                    precision = precision * 10 + (*fmt++ - '0');
+                }
+            }
+        }
+
+        // Length modifier: 0 int, -1 short, -2 char, 1 long, 2 long long
+        int length = 0;
+        if (*fmt == 'h') {
+            length = -1;
+            if (*++fmt == 'h') {
+                length = -2;
+                fmt++;
+            }
+        } else if (*fmt == 'l') {
+            length = 1;
+            if (*++fmt == 'l') {
+                length = 2;
+                fmt++;
+            }
+        } else if (*fmt == 'z' || *fmt == 't' || *fmt == 'j') {
+            length = 2;
+            fmt++;
+        }
+
+        char conv = *fmt;
+        if (conv == '\0') {
+            break;
+        }
+        fmt++;
+
+        switch (conv) {
+        case 'd':
+        case 'i': {
+            int64_t v;
+            if (length >= 1) {
+                v = length == 2 ? va_arg(args, long long) : va_arg(args, long);
+            } else {
+                v = va_arg(args, int);
+                if (length == -1) {
+                    v = (short)v;
+                } else if (length == -2) {
+                    v = (signed char)v;
+                }
+            }
+            fmt_number(&out, v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v, v < 0, 10,
+                       flags, width, precision);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o': {
+            uint64_t v;
+            if (length >= 1) {
+                v = length == 2 ? va_arg(args, unsigned long long) : va_arg(args, unsigned long);
+            } else {
+                v = va_arg(args, unsigned int);
+                if (length == -1) {
+                    v = (uint16_t)v;
+                } else if (length == -2) {
+                    v = (uint8_t)v;
+                }
+            }
+            if (conv == 'X') {
+                flags |= FMT_UPPER;
+            }
+            fmt_number(&out, v, false, conv == 'u' ? 10 : (conv == 'o' ? 8 : 16),
+                       flags & ~(FMT_PLUS | FMT_SPACE), width, precision);
+            break;
+        }
+        case 'p':
+            fmt_number(&out, (uint64_t)(uintptr_t)va_arg(args, void*), false, 16,
+                       (flags | FMT_ALT) & ~(FMT_PLUS | FMT_SPACE), width, precision);
+            break;
+        case 's':
+            fmt_string(&out, va_arg(args, const char*), flags, width, precision);
+            break;
+        case 'c': {
+            char c = (char)va_arg(args, int);
+            if (!(flags & FMT_LEFT)) {
+                fmt_pad(&out, ' ', width - 1);
+            }
+            fmt_putc(&out, c);
+            if (flags & FMT_LEFT) {
+                fmt_pad(&out, ' ', width - 1);
+            }
+            break;
+        }
+        case '%':
+            fmt_putc(&out, '%');
+            break;
+        default:
+            // Unknown conversion: print it as written
+            fmt_putc(&out, '%');
+            fmt_putc(&out, conv);
+            break;
+        }
+    }
+
+    if (size > 0) {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return (int)out.len;
+}
+
+int snprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return len;
+}
@@ -0,0 +1,417 @@
+/*
+ * EdgeX OS - Work Queues
+ *
+ * This file implements per-CPU kernel worker threads. Interrupt handlers
+ * and the tick queue work items instead of doing slow work inline; each
+ * CPU's kworker runs them in task context, preemptibly and with
+ * interrupts enabled. Work aimed at an isolated CPU is redirected to a
+ * housekeeping CPU so isolated CPUs never run kernel background work.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/scheduler.h>
+#include <edgex/workqueue.h>
+#include <edgex/spinlock.h>
+#include <edgex/softirq.h>
+#include <edgex/tsc.h>
+
+/* Interval between timeout sweeps */
+#define TIMEOUT_CHECK_INTERVAL_MS 10
+
+/* Maximum number of registered timeout checkers */
+#define MAX_TIMEOUT_CHECKERS      8
+
+/* No delayed work armed */
+#define NO_EXPIRY                 (~0ULL)
+
+/* Per-CPU work queue */
+typedef struct {
+    spinlock_t lock;
+    work_t* head;                 /* Work ready to run, FIFO */
+    work_t* tail;
+    delayed_work_t* timers;       /* Delayed work sorted by expiry */
+    volatile uint64_t next_expiry; /* Expiry of the first timer (lockless check) */
+    pid_t worker_pid;             /* This CPU's kworker */
+    bool worker_idle;             /* Worker is blocked waiting for work */
+    workqueue_stats_t stats;
+} cpu_workqueue_t;
+
+static cpu_workqueue_t workqueues[MAX_CPUS];
+
+/* Periodic timeout sweeps */
+typedef struct {
+    void (*checker)(void);
+    delayed_work_t work;
+} timeout_checker_t;
+
+static timeout_checker_t timeout_checkers[MAX_TIMEOUT_CHECKERS];
+static uint32_t timeout_checker_count = 0;
+
+/*
+ * Initialize a work item
+ */
+void init_work(work_t* work, work_func_t func, void* data) {
+    memset(work, 0, sizeof(work_t));
+    work->func = func;
+    work->data = data;
+}
+
+/*
+ * Initialize a delayed work item
+ */
+void init_delayed_work(delayed_work_t* dwork, work_func_t func, void* data) {
+    memset(dwork, 0, sizeof(delayed_work_t));
+    init_work(&dwork->work, func, data);
+}
+
+/*
+ * Choose the CPU whose worker runs an item
+ *
+ * Isolated CPUs never run deferred work, and nohz_full CPUs cannot host
+ * timers because their tick may be stopped.
+ */
+static uint32_t workqueue_target_cpu(uint32_t cpu, bool timer) {
+    if (!cpumask_test(cpu_online_mask(), cpu) || cpu_is_isolated(cpu) ||
+        (timer && cpu_is_nohz_full(cpu))) {
+        uint32_t target = housekeeping_any_cpu();
+        workqueues[target].stats.redirected++;
+        return target;
+    }
+    return cpu;
+}
+
+/*
+ * Append an item to a run list (wq->lock held)
+ *
+ * Returns true if the worker has to be woken up.
+ */
+static bool insert_work(cpu_workqueue_t* wq, work_t* work) {
+    work->next = NULL;
+    work->queued_tsc = rdtsc();
+    
+    if (wq->tail) {
+        wq->tail->next = work;
+    } else {
+        wq->head = work;
+    }
+    wq->tail = work;
+    wq->stats.queued++;
+    
+    if (wq->worker_idle && wq->worker_pid != PID_INVALID) {
+        wq->worker_idle = false;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Queue work on a specific CPU
+ */
+bool queue_work_on(uint32_t cpu, work_t* work) {
+    if (!work || !work->func) {
+        return false;
+    }
+    
+    // Already queued: the pending run will see the new state too
+    if (__atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQ_REL)) {
+        workqueues[work->cpu].stats.coalesced++;
+        return false;
+    }
+    
+    uint32_t target = workqueue_target_cpu(cpu, false);
+    cpu_workqueue_t* wq = &workqueues[target];
+    uint64_t flags;
+    
+    work->cpu = target;
+    
+    spin_lock_irqsave(&wq->lock, flags);
+    bool wake = insert_work(wq, work);
+    spin_unlock_irqrestore(&wq->lock, flags);
+    
+    if (wake) {
+        unblock_task(wq->worker_pid);
+    }
+    return true;
+}
+
+/*
+ * Queue work on the current CPU
+ */
+bool queue_work(work_t* work) {
+    return queue_work_on(smp_processor_id(), work);
+}
+
+/*
+ * Queue work after a delay
+ */
+bool queue_delayed_work(delayed_work_t* dwork, uint64_t delay_ms) {
+    if (!dwork) {
+        return false;
+    }
+    
+    if (delay_ms == 0) {
+        return queue_work(&dwork->work);
+    }
+    
+    if (__atomic_exchange_n(&dwork->work.pending, 1, __ATOMIC_ACQ_REL)) {
+        workqueues[dwork->work.cpu].stats.coalesced++;
+        return false;
+    }
+    
+    uint32_t target = workqueue_target_cpu(smp_processor_id(), true);
+    cpu_workqueue_t* wq = &workqueues[target];
+    uint64_t flags;
+    
+    dwork->work.cpu = target;
+    dwork->expires = get_tick_count() + delay_ms;
+    
+    spin_lock_irqsave(&wq->lock, flags);
+    
+    // Keep the timer list sorted so the tick only looks at its head
+    delayed_work_t** link = &wq->timers;
+    while (*link && (*link)->expires <= dwork->expires) {
+        link = &(*link)->next;
+    }
+    dwork->next = *link;
+    *link = dwork;
+    dwork->timer_pending = 1;
+    wq->next_expiry = wq->timers->expires;
+    
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return true;
+}
+
+/*
+ * Cancel delayed work that has not expired yet
+ *
+ * Returns false if it was not pending or is already queued to run.
+ */
+bool cancel_delayed_work(delayed_work_t* dwork) {
+    if (!dwork || !dwork->timer_pending) {
+        return false;
+    }
+    
+    cpu_workqueue_t* wq = &workqueues[dwork->work.cpu];
+    bool cancelled = false;
+    uint64_t flags;
+    
+    spin_lock_irqsave(&wq->lock, flags);
+    
+    for (delayed_work_t** link = &wq->timers; *link; link = &(*link)->next) {
+        if (*link == dwork) {
+            *link = dwork->next;
+            dwork->next = NULL;
+            dwork->timer_pending = 0;
+            __atomic_store_n(&dwork->work.pending, 0, __ATOMIC_RELEASE);
+            cancelled = true;
+            break;
+        }
+    }
+    wq->next_expiry = wq->timers ? wq->timers->expires : NO_EXPIRY;
+    
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return cancelled;
+}
+
+/*
+ * Tick hook: raise the timer softirq once delayed work has expired
+ *
+ * The common case is a single comparison in the interrupt; the timer
+ * list itself is walked by the softirq, with interrupts enabled.
+ */
+void workqueue_tick(void) {
+    cpu_workqueue_t* wq = &workqueues[smp_processor_id()];
+    
+    if (wq->next_expiry <= get_tick_count()) {
+        raise_softirq_irqoff(SOFTIRQ_TIMER);
+    }
+}
+
+/*
+ * Timer softirq: move expired delayed work to the run list
+ */
+static void workqueue_timer_softirq(void) {
+    cpu_workqueue_t* wq = &workqueues[smp_processor_id()];
+    uint64_t now = get_tick_count();
+    bool wake = false;
+    uint64_t flags;
+    
+    spin_lock_irqsave(&wq->lock, flags);
+    
+    while (wq->timers && wq->timers->expires <= now) {
+        delayed_work_t* dwork = wq->timers;
+        wq->timers = dwork->next;
+        dwork->next = NULL;
+        dwork->timer_pending = 0;
+        wake |= insert_work(wq, &dwork->work);
+    }
+    wq->next_expiry = wq->timers ? wq->timers->expires : NO_EXPIRY;
+    
+    spin_unlock_irqrestore(&wq->lock, flags);
+    
+    if (wake) {
+        unblock_task(wq->worker_pid);
+    }
+}
+
+/*
+ * Take the next item off a run list
+ */
+static work_t* dequeue_work(cpu_workqueue_t* wq) {
+    uint64_t flags;
+    
+    spin_lock_irqsave(&wq->lock, flags);
+    work_t* work = wq->head;
+    if (work) {
+        wq->head = work->next;
+        if (!wq->head) {
+            wq->tail = NULL;
+        }
+        work->next = NULL;
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    
+    return work;
+}
+
+/*
+ * Worker thread - one per CPU, pinned
+ */
+static void worker_thread(void) {
+    cpu_workqueue_t* wq = &workqueues[smp_processor_id()];
+    uint64_t flags;
+    
+    while (1) {
+        work_t* work = dequeue_work(wq);
+        
+        if (work) {
+            uint64_t latency = tsc_to_ns(rdtsc() - work->queued_tsc);
+            if (latency > wq->stats.max_latency_ns) {
+                wq->stats.max_latency_ns = latency;
+            }
+            
+            // Clear pending first so the item can requeue itself
+            __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+            work->func(work);
+            wq->stats.executed++;
+            continue;
+        }
+        
+        // Mark ourselves blocked before the final check, so a wakeup
+        // between the check and schedule() is not lost
+        prepare_to_block();
+        
+        spin_lock_irqsave(&wq->lock, flags);
+        if (wq->head == NULL) {
+            wq->worker_idle = true;
+            spin_unlock_irqrestore(&wq->lock, flags);
+            schedule();
+        } else {
+            spin_unlock_irqrestore(&wq->lock, flags);
+            cancel_block();
+        }
+    }
+}
+
+/*
+ * Start the worker thread of a CPU
+ */
+void workqueue_init_cpu(uint32_t cpu) {
+    cpu_workqueue_t* wq = &workqueues[cpu];
+    char name[16] = "kworker/";
+    uint32_t len = 8;
+    
+    if (wq->worker_pid != PID_INVALID) {
+        return;
+    }
+    
+    // Append the CPU number to the name
+    if (cpu >= 10) {
+        name[len++] = (char)('0' + cpu / 10);
+    }
+    name[len++] = (char)('0' + cpu % 10);
+    name[len] = '\0';
+    
+    pid_t pid = create_kernel_task(name, worker_thread, TASK_PRIORITY_HIGH);
+    if (pid == PID_INVALID) {
+        kernel_panic("Failed to create worker thread for CPU %u!", cpu);
+        return;
+    }
+    set_task_affinity(pid, cpumask_of(cpu));
+    
+    wq->worker_pid = pid;
+}
+
+/*
+ * Start workers on every online housekeeping CPU
+ */
+void init_workqueues(void) {
+    cpumask_t mask = housekeeping_mask();
+    uint32_t cpu;
+    
+    // Nothing armed yet: keep the tick hook from raising the softirq
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        workqueues[cpu].next_expiry = NO_EXPIRY;
+    }
+    
+    open_softirq(SOFTIRQ_TIMER, workqueue_timer_softirq);
+    
+    for_each_cpu(cpu, mask) {
+        workqueue_init_cpu(cpu);
+    }
+    
+    kernel_printf("Work queues initialized on %u CPUs\n", cpumask_weight(mask));
+}
+
+/*
+ * Run a timeout checker and rearm it
+ */
+static void timeout_checker_work(work_t* work) {
+    timeout_checker_t* tc = (timeout_checker_t*)work->data;
+    
+    tc->checker();
+    queue_delayed_work(&tc->work, TIMEOUT_CHECK_INTERVAL_MS);
+}
+
+/*
+ * Run a timeout sweep periodically from a worker thread
+ */
+void register_timeout_checker(void (*checker)(void)) {
+    if (!checker || timeout_checker_count >= MAX_TIMEOUT_CHECKERS) {
+        kernel_printf("Cannot register timeout checker\n");
+        return;
+    }
+    
+    timeout_checker_t* tc = &timeout_checkers[timeout_checker_count++];
+    tc->checker = checker;
+    init_delayed_work(&tc->work, timeout_checker_work, tc);
+    queue_delayed_work(&tc->work, TIMEOUT_CHECK_INTERVAL_MS);
+}
+
+/*
+ * Get work queue statistics for a CPU
+ */
+void get_workqueue_stats(uint32_t cpu, workqueue_stats_t* stats) {
+    if (!stats || cpu >= MAX_CPUS) {
+        return;
+    }
+    *stats = workqueues[cpu].stats;
+}
+
+/*
+ * Print work queue statistics
+ */
+void dump_workqueue_stats(void) {
+    kernel_printf("Work queues:\n");
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        cpu_workqueue_t* wq = &workqueues[cpu];
+        if (wq->worker_pid == PID_INVALID) {
+            continue;
+        }
+        
+        kernel_printf("  CPU %u (PID %d): queued %llu, coalesced %llu, executed %llu, "
+                      "redirected %llu, max latency %llu ns\n",
+                      cpu, wq->worker_pid, wq->stats.queued, wq->stats.coalesced,
+                      wq->stats.executed, wq->stats.redirected, wq->stats.max_latency_ns);
+    }
+}
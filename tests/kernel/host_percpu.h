@@ -0,0 +1,36 @@
+/*
+ * EdgeX OS - Per-CPU Data in Host Tests
+ *
+ * Kernel code reaches its per-CPU block through %gs (this_cpu(),
+ * smp_processor_id(), preemption counts, per-CPU counters). On x86-64
+ * Linux a test process can point its own GS base at a cpu_t with
+ * arch_prctl(), so that code runs unchanged on the host.
+ *
+ * Tests define _GNU_SOURCE before any include to get syscall().
+ */
+
+#ifndef TESTS_HOST_PERCPU_H
+#define TESTS_HOST_PERCPU_H
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+#include <asm/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Run the calling thread as the given CPU
+ */
+static inline void host_percpu_enter(cpu_t* cpu, uint32_t id) {
+    cpu->self = cpu;
+    cpu->id = id;
+    if (syscall(SYS_arch_prctl, ARCH_SET_GS, (unsigned long)cpu) != 0) {
+        perror("arch_prctl(ARCH_SET_GS)");
+        exit(1);
+    }
+}
+
+#endif /* TESTS_HOST_PERCPU_H */
@@ -0,0 +1,381 @@
+/*
+ * EdgeX OS - Buffer Cache Unit Tests
+ *
+ * This file tests the block buffer cache (kernel/bcache.c) on the host,
+ * over a fake device that completes every request on submission: hash
+ * chains that share a bucket, the LRU order and which buffer a miss
+ * reuses, hits and evictions through bcache_read(), and write-back in
+ * block order with one doorbell per batch.
+ */
+
+#define _GNU_SOURCE
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/scheduler.h>
+#include <edgex/bcache.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "kernel/host_percpu.h"
+
+/* cli/sti fault in user mode; a test thread is never interrupted anyway */
+#define local_irq_save()            0ULL
+#define local_irq_restore(flags)    ((void)(flags))
+
+/* The kernel prints uint64_t with %llu; on the host it is unsigned long */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "kernel/bcache.c"
+#pragma GCC diagnostic pop
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_U64(expected, actual, message) \
+    do { \
+        if ((uint64_t)(expected) != (uint64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        test_reset(); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+#define TEST_BUFFERS        4
+#define TEST_MAX_REQUESTS   64
+
+/* The running CPU, reached through %gs */
+static cpu_t test_cpu;
+
+/* Fake device: requests complete on submission and are recorded */
+static virtio_blk_t test_blk;
+static struct {
+    uint32_t op;
+    uint64_t block;
+    bool more;
+} test_requests[TEST_MAX_REQUESTS];
+static uint32_t test_nr_requests;
+static uint32_t test_unplugs;
+
+int virtio_blk_submit(virtio_blk_t* blk, blk_request_t* req, bool more) {
+    (void)blk;
+    if (test_nr_requests < TEST_MAX_REQUESTS) {
+        test_requests[test_nr_requests].op = req->op;
+        test_requests[test_nr_requests].block = req->sector / BCACHE_BLOCK_SECTORS;
+        test_requests[test_nr_requests].more = more;
+        test_nr_requests++;
+    }
+    req->status = 0;
+    req->done(req);
+    return 0;
+}
+
+void virtio_blk_unplug(virtio_blk_t* blk) {
+    (void)blk;
+    test_unplugs++;
+}
+
+/* Kernel services used by bcache.c */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+int klog_printf(int level, const char* fmt, ...) {
+    va_list args;
+    (void)level;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+void* kzalloc(size_t size) {
+    return calloc(1, size);
+}
+
+void* alloc_page(void) {
+    return aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+}
+
+shared_memory_t create_shared_memory(const char* name, size_t size, uint32_t permissions,
+                                     uint32_t flags) {
+    (void)name;
+    (void)size;
+    (void)permissions;
+    (void)flags;
+    return NULL;
+}
+
+uint64_t shared_memory_phys(shared_memory_t shm, size_t offset) {
+    (void)shm;
+    (void)offset;
+    return 0;
+}
+
+pid_t create_kernel_task(const char* name, void (*entry_point)(void), task_priority_t priority) {
+    (void)name;
+    (void)entry_point;
+    (void)priority;
+    return 2;
+}
+
+/* Every request completes before bcache_wait() is reached */
+pid_t get_current_pid(void) { return 1; }
+uint64_t get_tick_count(void) { return 0; }
+void prepare_to_block(void) {}
+void cancel_block(void) {}
+void schedule(void) {}
+void unblock_task(pid_t pid) { (void)pid; }
+void sleep_task(uint64_t milliseconds) { (void)milliseconds; }
+void preempt_schedule(void) {}
+
+/*
+ * Start every test with no caches and a 1MB device
+ */
+static void test_reset(void) {
+    memset(bcaches, 0, sizeof(bcaches));
+    nr_bcaches = 0;
+    bcache_flusher_pid = 0;
+    memset(&test_blk, 0, sizeof(test_blk));
+    test_blk.capacity = 256 * BCACHE_BLOCK_SECTORS;
+    test_nr_requests = 0;
+    test_unplugs = 0;
+}
+
+/*
+ * Check that the LRU list holds exactly the given buffers, oldest first
+ */
+static bool lru_is(bcache_t* cache, const uint32_t* order, uint32_t count) {
+    bcache_buf_t* buf = cache->lru_head;
+    bcache_buf_t* prev = NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!buf || buf->index != order[i] || buf->lru_prev != prev) {
+            return false;
+        }
+        prev = buf;
+        buf = buf->lru_next;
+    }
+    return buf == NULL && cache->lru_tail == prev;
+}
+
+/*
+ * Test lookups in chains that share a bucket, and removal from them
+ */
+static int test_hash_chains(void) {
+    bcache_t* cache = bcache_create(&test_blk, TEST_BUFFERS);
+    TEST_ASSERT(cache != NULL, "cache created");
+    TEST_ASSERT_EQUAL_U64(TEST_BUFFERS - 1, cache->hash_mask, "one bucket per buffer");
+
+    // Find blocks that land in the same bucket
+    uint64_t blocks[TEST_BUFFERS];
+    uint32_t n = 0;
+    for (uint64_t b = 0; n < TEST_BUFFERS; b++) {
+        if (bcache_hash(cache, b) == bcache_hash(cache, 7)) {
+            blocks[n++] = b;
+        }
+    }
+    for (uint32_t i = 0; i < TEST_BUFFERS; i++) {
+        cache->bufs[i].block = blocks[i];
+        bcache_hash_insert(cache, &cache->bufs[i]);
+    }
+
+    for (uint32_t i = 0; i < TEST_BUFFERS; i++) {
+        TEST_ASSERT(bcache_lookup(cache, blocks[i]) == &cache->bufs[i], "found in a shared chain");
+    }
+    TEST_ASSERT(bcache_lookup(cache, blocks[TEST_BUFFERS - 1] + 1) == NULL, "absent block");
+
+    // Removing from the middle keeps the rest of the chain
+    bcache_hash_remove(cache, &cache->bufs[1]);
+    TEST_ASSERT(bcache_lookup(cache, blocks[1]) == NULL, "removed block");
+    TEST_ASSERT_EQUAL_U64(BCACHE_NO_BLOCK, cache->bufs[1].block, "removed buffer has no block");
+    TEST_ASSERT(bcache_lookup(cache, blocks[0]) == &cache->bufs[0], "chain after the removed one");
+    TEST_ASSERT(bcache_lookup(cache, blocks[2]) == &cache->bufs[2], "chain before the removed one");
+    TEST_ASSERT(bcache_lookup(cache, blocks[3]) == &cache->bufs[3], "chain head");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test the LRU order and which buffer a miss takes
+ */
+static int test_lru_reuse(void) {
+    bcache_t* cache = bcache_create(&test_blk, TEST_BUFFERS);
+    TEST_ASSERT(cache != NULL, "cache created");
+
+    static const uint32_t initial[] = { 0, 1, 2, 3 };
+    TEST_ASSERT(lru_is(cache, initial, 4), "buffers in index order");
+
+    // Touching the head, the middle and the tail
+    bcache_lru_touch(cache, &cache->bufs[0]);
+    bcache_lru_touch(cache, &cache->bufs[2]);
+    bcache_lru_touch(cache, &cache->bufs[2]);
+    static const uint32_t touched[] = { 1, 3, 0, 2 };
+    TEST_ASSERT(lru_is(cache, touched, 4), "touched buffers at the tail");
+
+    // A miss takes the oldest buffer that is idle, clean and unreferenced
+    cache->bufs[1].refcount = 1;
+    cache->bufs[3].flags = BCACHE_DIRTY;
+    bcache_buf_t* buf = bcache_reuse(cache, 42);
+    TEST_ASSERT(buf == &cache->bufs[0], "skips referenced and dirty buffers");
+    TEST_ASSERT(bcache_lookup(cache, 42) == buf, "reused buffer hashed");
+    static const uint32_t reused[] = { 1, 3, 2, 0 };
+    TEST_ASSERT(lru_is(cache, reused, 4), "reused buffer most recent");
+    TEST_ASSERT_EQUAL_U64(0, cache->stats.evictions, "empty buffer is not an eviction");
+
+    // Taking a buffer that holds a block evicts that block
+    buf = bcache_reuse(cache, 43);
+    TEST_ASSERT(buf == &cache->bufs[2], "next idle buffer");
+    TEST_ASSERT(bcache_reuse(cache, 44) == &cache->bufs[0], "then the oldest cached block");
+    TEST_ASSERT(bcache_lookup(cache, 42) == NULL, "evicted block gone");
+    TEST_ASSERT_EQUAL_U64(1, cache->stats.evictions, "eviction counted");
+
+    // Nothing left when every buffer is busy
+    cache->bufs[0].refcount = 1;
+    cache->bufs[2].flags = BCACHE_WRITING;
+    TEST_ASSERT(bcache_reuse(cache, 45) == NULL, "every buffer busy");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test hits, misses and evictions through bcache_read()
+ */
+static int test_read_evicts_lru(void) {
+    bcache_t* cache = bcache_create(&test_blk, TEST_BUFFERS);
+    static const uint64_t blocks[] = { 0, 10, 20, 30 };
+
+    // Scattered blocks, so readahead stays off
+    for (uint32_t i = 0; i < 4; i++) {
+        bcache_buf_t* buf = bcache_read(cache, blocks[i]);
+        TEST_ASSERT(buf != NULL && (buf->flags & BCACHE_VALID), "block read in");
+        bcache_release(buf);
+    }
+    TEST_ASSERT_EQUAL_U64(4, test_nr_requests, "one read per block");
+    TEST_ASSERT_EQUAL_U64(4, cache->stats.misses, "misses");
+
+    // A hit makes block 0 recent, so block 10 is the one to go
+    bcache_buf_t* buf = bcache_read(cache, 0);
+    TEST_ASSERT(buf != NULL, "hit");
+    bcache_release(buf);
+    TEST_ASSERT_EQUAL_U64(1, cache->stats.hits, "hit counted");
+    TEST_ASSERT_EQUAL_U64(4, test_nr_requests, "no read for a hit");
+
+    buf = bcache_read(cache, 50);
+    TEST_ASSERT(buf != NULL, "miss with a full cache");
+    bcache_release(buf);
+    TEST_ASSERT(bcache_lookup(cache, 10) == NULL, "least recently used block evicted");
+    TEST_ASSERT(bcache_lookup(cache, 0) && bcache_lookup(cache, 20) && bcache_lookup(cache, 30),
+                "other blocks kept");
+    TEST_ASSERT_EQUAL_U64(1, cache->stats.evictions, "eviction counted");
+
+    // A referenced block is not evicted
+    bcache_buf_t* held = bcache_read(cache, 20);
+    buf = bcache_read(cache, 60);
+    bcache_release(buf);
+    TEST_ASSERT(bcache_lookup(cache, 20) == held, "held block kept");
+    TEST_ASSERT(bcache_lookup(cache, 30) == NULL, "oldest unheld block evicted");
+    bcache_release(held);
+
+    TEST_ASSERT(bcache_read(cache, 256) == NULL, "block past the device");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that write-back goes out in block order as one batch
+ */
+static int test_writeback_order(void) {
+    bcache_t* cache = bcache_create(&test_blk, TEST_BUFFERS);
+    static const uint64_t blocks[] = { 30, 10, 20 };
+
+    for (uint32_t i = 0; i < 3; i++) {
+        bcache_buf_t* buf = bcache_get(cache, blocks[i]);
+        TEST_ASSERT(buf != NULL, "block without a read");
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+    }
+    TEST_ASSERT_EQUAL_U64(0, test_nr_requests, "no I/O for bcache_get()");
+    TEST_ASSERT_EQUAL_U64(3, cache->nr_dirty, "dirty blocks");
+
+    bcache_writeback(cache);
+    TEST_ASSERT_EQUAL_U64(3, test_nr_requests, "one write per block");
+    for (uint32_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_U64(BLK_OP_WRITE, test_requests[i].op, "write");
+        TEST_ASSERT_EQUAL_U64(10 + i * 10, test_requests[i].block, "in block order");
+        TEST_ASSERT(test_requests[i].more == (i < 2), "doorbell on the last one only");
+    }
+    TEST_ASSERT_EQUAL_U64(0, cache->nr_dirty, "clean after the write");
+    TEST_ASSERT_EQUAL_U64(0, cache->nr_writing, "writes completed");
+    TEST_ASSERT_EQUAL_U64(1, cache->stats.flushes, "one batch");
+    TEST_ASSERT_EQUAL_U64(3, cache->stats.writebacks, "blocks written");
+
+    // Nothing dirty: no batch
+    bcache_writeback(cache);
+    TEST_ASSERT_EQUAL_U64(3, test_nr_requests, "nothing to write");
+    TEST_ASSERT_EQUAL_U64(1, cache->stats.flushes, "no empty batch");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    host_percpu_enter(&test_cpu, 0);
+
+    printf("============================\n");
+    printf("Buffer Cache Tests\n");
+    printf("============================\n\n");
+
+    TEST_RUN(test_hash_chains);
+    TEST_RUN(test_lru_reuse);
+    TEST_RUN(test_read_evicts_lru);
+    TEST_RUN(test_writeback_order);
+
+    /* Summary */
+    printf("\n============================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("============================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
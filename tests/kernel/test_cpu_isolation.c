@@ -0,0 +1,263 @@
+/*
+ * EdgeX OS - CPU Isolation Unit Tests
+ *
+ * This file tests the isolcpus= and nohz_full= command line parsing in
+ * kernel/cpu.c on the host: CPU list syntax, rejecting malformed lists, the
+ * boot CPU staying a housekeeping CPU, and the flags and masks that
+ * enumerated CPUs end up with.
+ */
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "kernel/cpu.c"
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_MASK(expected, actual, message) \
+    do { \
+        if ((cpumask_t)(expected) != (cpumask_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected 0x%llx, got 0x%llx)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        test_reset(); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/* Kernel log output goes to stdout */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+/*
+ * Forget enumerated CPUs and isolation settings
+ */
+static void test_reset(void) {
+    memset(cpus, 0, sizeof(cpus));
+    cpu_count = 0;
+    present_mask = CPU_MASK_NONE;
+    online_mask = CPU_MASK_NONE;
+    isolated_mask = CPU_MASK_NONE;
+    nohz_full_mask = CPU_MASK_NONE;
+}
+
+/*
+ * Enumerate CPUs 0..count-1 and mark them online
+ */
+static void test_add_cpus(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        cpu_t* cpu = cpu_add(i * 2);
+        cpu->flags |= CPU_FLAG_ONLINE;
+        cpumask_set(&online_mask, cpu->id);
+    }
+}
+
+/*
+ * Test single CPUs, ranges and their combinations
+ */
+static int test_list_syntax(void) {
+    cpumask_t mask;
+
+    parse_cpu_list("5", &mask);
+    TEST_ASSERT_MASK(0x20, mask, "single CPU");
+
+    parse_cpu_list("1-3", &mask);
+    TEST_ASSERT_MASK(0x0E, mask, "range");
+
+    parse_cpu_list("1-3,6,8-9", &mask);
+    TEST_ASSERT_MASK(0x34E, mask, "ranges and single CPUs");
+
+    parse_cpu_list("4-4", &mask);
+    TEST_ASSERT_MASK(0x10, mask, "one-CPU range");
+
+    parse_cpu_list("3,1,3", &mask);
+    TEST_ASSERT_MASK(0x0A, mask, "repeated and unordered CPUs");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test where parsing stops and that malformed lists are ignored whole
+ */
+static int test_list_edges(void) {
+    cpumask_t mask = ~CPU_MASK_NONE;
+    const char* end;
+
+    // The list ends at the next option
+    end = parse_cpu_list("2,4 quiet", &mask);
+    TEST_ASSERT_MASK(0x14, mask, "list before another option");
+    TEST_ASSERT(strcmp(end, " quiet") == 0, "stops at the space");
+
+    // Empty and non-numeric lists clear the mask and skip the word
+    end = parse_cpu_list("", &mask);
+    TEST_ASSERT_MASK(CPU_MASK_NONE, mask, "empty list");
+    mask = ~CPU_MASK_NONE;
+    end = parse_cpu_list("abc quiet", &mask);
+    TEST_ASSERT_MASK(CPU_MASK_NONE, mask, "non-numeric list");
+    TEST_ASSERT(strcmp(end, " quiet") == 0, "skips the malformed word");
+
+    // Open and reversed ranges, empty entries and trailing junk
+    static const char* const bad[] = {
+        "1-", "3-1", "-2", "1,", ",1", "1,,2", "1-2-3", "2,3x"
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        mask = ~CPU_MASK_NONE;
+        parse_cpu_list(bad[i], &mask);
+        TEST_ASSERT_MASK(CPU_MASK_NONE, mask, bad[i]);
+    }
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that lists naming CPUs past MAX_CPUS are rejected
+ */
+static int test_list_range(void) {
+    cpumask_t mask;
+
+    parse_cpu_list("0-63", &mask);
+    TEST_ASSERT_MASK(~CPU_MASK_NONE, mask, "all CPUs");
+
+    parse_cpu_list("62-200", &mask);
+    TEST_ASSERT_MASK(CPU_MASK_NONE, mask, "range past MAX_CPUS");
+
+    parse_cpu_list("1,64", &mask);
+    TEST_ASSERT_MASK(CPU_MASK_NONE, mask, "CPU past MAX_CPUS");
+
+    // Large enough to overflow 32 bits
+    parse_cpu_list("4294967297", &mask);
+    TEST_ASSERT_MASK(CPU_MASK_NONE, mask, "huge CPU number");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test option parsing on a full command line
+ */
+static int test_cmdline(void) {
+    cpu_parse_cmdline("console=ttyS0 isolcpus=2-3 quiet nohz_full=3,5  root=/dev/vda");
+    TEST_ASSERT_MASK(0x0C, isolated_mask, "isolcpus=");
+    TEST_ASSERT_MASK(0x28, nohz_full_mask, "nohz_full=");
+
+    // Options that merely start with the same letters are ignored
+    test_reset();
+    cpu_parse_cmdline("isolcpu=1 nohz=on isolcpusx=2");
+    TEST_ASSERT_MASK(CPU_MASK_NONE, isolated_mask, "similar option names");
+
+    // A malformed list is ignored, the options after it still apply
+    test_reset();
+    cpu_parse_cmdline("isolcpus=2-1 nohz_full=3");
+    TEST_ASSERT_MASK(CPU_MASK_NONE, isolated_mask, "malformed isolcpus=");
+    TEST_ASSERT_MASK(0x08, nohz_full_mask, "nohz_full= after it");
+
+    // NULL and empty command lines
+    test_reset();
+    cpu_parse_cmdline(NULL);
+    cpu_parse_cmdline("");
+    TEST_ASSERT_MASK(CPU_MASK_NONE, isolated_mask | nohz_full_mask, "no command line");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that the boot CPU is never isolated
+ */
+static int test_boot_cpu(void) {
+    cpu_parse_cmdline("isolcpus=0-2 nohz_full=0,3");
+    TEST_ASSERT_MASK(0x06, isolated_mask, "boot CPU dropped from isolcpus=");
+    TEST_ASSERT_MASK(0x08, nohz_full_mask, "boot CPU dropped from nohz_full=");
+
+    test_add_cpus(4);
+    TEST_ASSERT(!cpu_is_isolated(BOOT_CPU_ID), "boot CPU not isolated");
+    TEST_ASSERT(!cpu_is_nohz_full(BOOT_CPU_ID), "boot CPU keeps its tick");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test the flags and housekeeping mask of enumerated CPUs
+ */
+static int test_cpu_flags(void) {
+    // CPUs enumerated before the command line is parsed are updated
+    test_add_cpus(2);
+    cpu_parse_cmdline("isolcpus=1,3 nohz_full=3");
+    test_add_cpus(4);
+
+    TEST_ASSERT(cpu_count == 4, "CPUs enumerated once each");
+    TEST_ASSERT(cpu_is_isolated(1) && cpu_is_isolated(3), "isolated CPUs");
+    TEST_ASSERT(!cpu_is_isolated(2), "housekeeping CPU");
+    TEST_ASSERT(cpu_is_nohz_full(3) && !cpu_is_nohz_full(1), "nohz_full CPUs");
+    TEST_ASSERT(!cpu_is_isolated(10), "CPU that does not exist");
+    TEST_ASSERT_MASK(0x05, housekeeping_mask(), "housekeeping mask");
+
+    // With every online CPU isolated the boot CPU does the housekeeping
+    test_reset();
+    test_add_cpus(1);
+    cpu_parse_cmdline("isolcpus=1-7");
+    TEST_ASSERT_MASK(cpumask_of(BOOT_CPU_ID), housekeeping_mask(), "boot CPU only");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    printf("============================\n");
+    printf("CPU Isolation Tests\n");
+    printf("============================\n\n");
+
+    TEST_RUN(test_list_syntax);
+    TEST_RUN(test_list_edges);
+    TEST_RUN(test_list_range);
+    TEST_RUN(test_cmdline);
+    TEST_RUN(test_boot_cpu);
+    TEST_RUN(test_cpu_flags);
+
+    /* Summary */
+    printf("\n============================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("============================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+/*
+ * EdgeX OS - Initial Ramdisk Unit Tests
+ *
+ * This file tests kernel/initrd.c on the host: which boot module is taken
+ * as the archive from the module command lines, the physical range kept
+ * from the allocator, and the checks made on the archive's file table
+ * before files can be looked up. The archive is built in a page-aligned
+ * host buffer, which stands in for the identity-mapped module.
+ */
+
+#define _GNU_SOURCE
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/initrd.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+/* The kernel prints uint64_t with %llu; on the host it is unsigned long */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "kernel/initrd.c"
+#pragma GCC diagnostic pop
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_U64(expected, actual, message) \
+    do { \
+        if ((uint64_t)(expected) != (uint64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        test_reset(); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/* Size of the test archive */
+#define TEST_ARCHIVE_PAGES      8
+#define TEST_ARCHIVE_SIZE       (TEST_ARCHIVE_PAGES * PAGE_SIZE)
+
+static uint8_t* test_archive;
+
+/* The last range kept from the allocator */
+static struct {
+    uint32_t calls;
+    void* start;
+    size_t size;
+} test_reserved;
+
+int kernel_log_level = LOG_LEVEL_ERROR;
+
+/* Kernel services used by initrd.c */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+int klog_printf(int level, const char* fmt, ...) {
+    (void)level;
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+void reserve_page_range(void* start, size_t size) {
+    test_reserved.calls++;
+    test_reserved.start = start;
+    test_reserved.size = size;
+}
+
+/* Mapping into tasks is not exercised here */
+struct page_directory* find_page_directory(pid_t owner_pid) { (void)owner_pid; return NULL; }
+int map_device_memory(struct page_directory* pd, uint64_t vaddr, uint64_t paddr, size_t size,
+                      bool writable, bool uncached) {
+    (void)pd;
+    (void)vaddr;
+    (void)paddr;
+    (void)size;
+    (void)writable;
+    (void)uncached;
+    return -1;
+}
+int unmap_memory_range(struct page_directory* pd, uint64_t vaddr, size_t size, bool free_phys) {
+    (void)pd;
+    (void)vaddr;
+    (void)size;
+    (void)free_phys;
+    return -1;
+}
+uint64_t tsc_to_ns(uint64_t cycles) { return cycles; }
+
+/*
+ * Forget the module and its files
+ */
+static void test_reset(void) {
+    initrd_start = 0;
+    initrd_end = 0;
+    initrd_named = false;
+    memset(initrd_files, 0, sizeof(initrd_files));
+    initrd_nr_files = 0;
+    memset(&test_reserved, 0, sizeof(test_reserved));
+}
+
+/*
+ * Start an archive of nr_files entries with data from the second page
+ */
+static initrd_entry_t* test_archive_init(uint32_t nr_files) {
+    initrd_header_t* hdr = (initrd_header_t*)test_archive;
+
+    memset(test_archive, 0, TEST_ARCHIVE_SIZE);
+    hdr->magic = INITRD_MAGIC;
+    hdr->version = INITRD_VERSION;
+    hdr->nr_files = nr_files;
+    hdr->data_offset = PAGE_SIZE;
+    hdr->total_size = TEST_ARCHIVE_SIZE;
+    return (initrd_entry_t*)(hdr + 1);
+}
+
+static void test_archive_entry(initrd_entry_t* e, const char* name, uint64_t offset,
+                               uint64_t size) {
+    strncpy(e->name, name, INITRD_NAME_MAX - 1);
+    e->offset = offset;
+    e->size = size;
+}
+
+/*
+ * Test which module command lines name the initrd
+ */
+static int test_module_names(void) {
+    static const char* const named[] = { "initrd", "initrd ", "initrd root=/models", "initrd\tx" };
+    static const char* const others[] = {
+        "initrd2", "initrd.img", "initr", "init", "xinitrd", " initrd", "INITRD", "kernel.sym", ""
+    };
+
+    for (size_t i = 0; i < sizeof(named) / sizeof(named[0]); i++) {
+        TEST_ASSERT(initrd_module_named(named[i]), named[i]);
+    }
+    for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+        TEST_ASSERT(!initrd_module_named(others[i]), others[i]);
+    }
+    TEST_ASSERT(!initrd_module_named(NULL), "no command line");
+
+    // Stops at the terminator of a short line: nothing past it is read
+    char shortline[3] = { 'i', 'n', '\0' };
+    TEST_ASSERT(!initrd_module_named(shortline), "short line");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that the first module named "initrd" wins over everything else
+ */
+static int test_first_named_wins(void) {
+    initrd_add_module(0x100000, 0x101000, "kernel.sym");
+    TEST_ASSERT_EQUAL_U64(0, initrd_end, "other names never taken");
+
+    initrd_add_module(0x200000, 0x201000, NULL);
+    TEST_ASSERT_EQUAL_U64(0x200000, initrd_start, "unnamed module as a fallback");
+
+    initrd_add_module(0x300000, 0x304000, "initrd2");
+    TEST_ASSERT_EQUAL_U64(0x200000, initrd_start, "initrd2 is not the initrd");
+
+    initrd_add_module(0x400000, 0x408000, "initrd root=/models");
+    TEST_ASSERT_EQUAL_U64(0x400000, initrd_start, "named module replaces the fallback");
+    TEST_ASSERT_EQUAL_U64(0x408000, initrd_end, "named module end");
+
+    initrd_add_module(0x500000, 0x501000, "initrd");
+    initrd_add_module(0x600000, 0x601000, "");
+    TEST_ASSERT_EQUAL_U64(0x400000, initrd_start, "first named module kept");
+    TEST_ASSERT_EQUAL_U64(0x408000, initrd_end, "first named module end kept");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that only the first unnamed module is a fallback
+ */
+static int test_unnamed_fallback(void) {
+    initrd_add_module(0x200000, 0x202000, "");
+    initrd_add_module(0x300000, 0x301000, NULL);
+    initrd_add_module(0x400000, 0x401000, "modules.bin");
+    TEST_ASSERT_EQUAL_U64(0x200000, initrd_start, "first unnamed module kept");
+    TEST_ASSERT_EQUAL_U64(0x202000, initrd_end, "first unnamed module end");
+
+    initrd_reserve();
+    TEST_ASSERT_EQUAL_U64(1, test_reserved.calls, "module reserved");
+    TEST_ASSERT_EQUAL_U64(0x200000, (uintptr_t)test_reserved.start, "reserved start");
+    TEST_ASSERT_EQUAL_U64(0x2000, test_reserved.size, "reserved size");
+
+    // Nothing to keep without a module
+    test_reset();
+    initrd_add_module(0x400000, 0x401000, "modules.bin");
+    initrd_reserve();
+    TEST_ASSERT_EQUAL_U64(0, test_reserved.calls, "nothing reserved");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that bad file table entries are skipped and good ones served
+ */
+static int test_archive_entries(void) {
+    initrd_entry_t* e = test_archive_init(6);
+
+    test_archive_entry(&e[0], "models/a.bin", PAGE_SIZE, 2 * PAGE_SIZE + 100);
+    test_archive_entry(&e[1], "models/unaligned", 3 * PAGE_SIZE + 8, 16);
+    test_archive_entry(&e[2], "models/header", 0, 16);
+    test_archive_entry(&e[3], "models/past-end", 6 * PAGE_SIZE, 3 * PAGE_SIZE);
+    test_archive_entry(&e[4], "models/b.bin", 4 * PAGE_SIZE, 0);
+    memset(e[5].name, 'x', INITRD_NAME_MAX);
+    e[5].offset = 5 * PAGE_SIZE;
+    e[5].size = 1;
+
+    initrd_add_module((uintptr_t)test_archive, (uintptr_t)test_archive + TEST_ARCHIVE_SIZE,
+                      "initrd");
+    init_initrd();
+    TEST_ASSERT_EQUAL_U64(2, initrd_count(), "only the good entries");
+
+    const initrd_file_t* a = initrd_lookup("models/a.bin");
+    TEST_ASSERT(a != NULL, "a.bin found");
+    TEST_ASSERT_EQUAL_U64((uintptr_t)test_archive + PAGE_SIZE, a->phys, "a.bin data");
+    TEST_ASSERT_EQUAL_U64(INITRD_VADDR_BASE + PAGE_SIZE, a->vaddr, "a.bin address in tasks");
+    TEST_ASSERT_EQUAL_U64(2 * PAGE_SIZE + 100, a->size, "a.bin size");
+    TEST_ASSERT(initrd_data(a) == test_archive + PAGE_SIZE, "kernel view of a.bin");
+
+    TEST_ASSERT(initrd_lookup("models/b.bin") != NULL, "b.bin found");
+    TEST_ASSERT(initrd_lookup("models/a.bi") == NULL, "prefix does not match");
+    TEST_ASSERT(initrd_lookup("models/a.bin2") == NULL, "longer name does not match");
+    TEST_ASSERT(initrd_lookup("models/unaligned") == NULL, "unaligned entry skipped");
+    TEST_ASSERT(initrd_lookup("models/past-end") == NULL, "entry past the end skipped");
+    TEST_ASSERT(initrd_file(2) == NULL, "index past the list");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that a module that is not a usable archive gives no files
+ */
+static int test_archive_rejected(void) {
+    initrd_header_t* hdr = (initrd_header_t*)test_archive;
+    uint64_t start = (uintptr_t)test_archive;
+    initrd_entry_t* e;
+
+    e = test_archive_init(1);
+    test_archive_entry(e, "a", PAGE_SIZE, 1);
+    hdr->magic ^= 1;
+    initrd_add_module(start, start + TEST_ARCHIVE_SIZE, "initrd");
+    init_initrd();
+    TEST_ASSERT_EQUAL_U64(0, initrd_count(), "bad magic");
+
+    // Archive larger than the module
+    test_reset();
+    e = test_archive_init(1);
+    test_archive_entry(e, "a", PAGE_SIZE, 1);
+    initrd_add_module(start, start + TEST_ARCHIVE_SIZE - PAGE_SIZE, "initrd");
+    init_initrd();
+    TEST_ASSERT_EQUAL_U64(0, initrd_count(), "truncated module");
+
+    // File table running into the data
+    test_reset();
+    e = test_archive_init(PAGE_SIZE / sizeof(initrd_entry_t) + 1);
+    initrd_add_module(start, start + TEST_ARCHIVE_SIZE, "initrd");
+    init_initrd();
+    TEST_ASSERT_EQUAL_U64(0, initrd_count(), "file table overlaps data");
+
+    // Files are mapped in place: the module must start on a page
+    test_reset();
+    e = test_archive_init(1);
+    test_archive_entry(e, "a", PAGE_SIZE, 1);
+    initrd_add_module(start + 64, start + TEST_ARCHIVE_SIZE, "initrd");
+    init_initrd();
+    TEST_ASSERT_EQUAL_U64(0, initrd_count(), "unaligned module");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    test_archive = aligned_alloc(PAGE_SIZE, TEST_ARCHIVE_SIZE);
+    if (!test_archive) {
+        return 1;
+    }
+
+    printf("===========================\n");
+    printf("Initial Ramdisk Tests\n");
+    printf("===========================\n\n");
+
+    TEST_RUN(test_module_names);
+    TEST_RUN(test_first_named_wins);
+    TEST_RUN(test_unnamed_fallback);
+    TEST_RUN(test_archive_entries);
+    TEST_RUN(test_archive_rejected);
+
+    /* Summary */
+    printf("\n===========================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("===========================\n");
+
+    free(test_archive);
+    return (test_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+/*
+ * EdgeX OS - IPC Latency Histogram Unit Tests
+ *
+ * This file tests the log-linear buckets of the IPC latency histograms
+ * (kernel/ipc_latency.c) on the host: bucket boundaries and widths over
+ * the whole range, clamping into the last bucket, and the percentiles
+ * and averages a summary reports for known distributions.
+ */
+
+#define _GNU_SOURCE
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "kernel/host_percpu.h"
+
+/* The kernel prints uint64_t with %llu; on the host it is unsigned long */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "kernel/ipc_latency.c"
+#pragma GCC diagnostic pop
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_U64(expected, actual, message) \
+    do { \
+        if ((uint64_t)(expected) != (uint64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/* The running CPU, reached through %gs */
+static cpu_t test_cpu;
+
+/* Kernel services used by ipc_latency.c */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+void* kzalloc(size_t size) {
+    return calloc(1, size);
+}
+
+cpumask_t cpu_online_mask(void) {
+    return cpumask_of(0);
+}
+
+void preempt_schedule(void) {
+}
+
+/* One cycle per nanosecond keeps summaries in recorded units */
+uint64_t tsc_to_ns(uint64_t cycles) {
+    return cycles;
+}
+
+/*
+ * Test that small values get a bucket each
+ */
+static int test_exact_buckets(void) {
+    for (uint64_t v = 0; v < IPC_LAT_SUB_BUCKETS; v++) {
+        TEST_ASSERT_EQUAL_U64(v, ipc_lat_bucket(v), "exact bucket");
+        TEST_ASSERT_EQUAL_U64(v, ipc_lat_bucket_start((uint32_t)v), "exact bucket start");
+    }
+    TEST_ASSERT_EQUAL_U64(IPC_LAT_SUB_BUCKETS, ipc_lat_bucket(IPC_LAT_SUB_BUCKETS),
+                          "first log-linear bucket");
+    return TEST_PASSED;
+}
+
+/*
+ * Test that buckets tile the range: each starts where the previous
+ * ends, and holds exactly the values from its start to the next start
+ */
+static int test_bucket_boundaries(void) {
+    for (uint32_t b = 0; b < IPC_LAT_BUCKETS - 1; b++) {
+        uint64_t start = ipc_lat_bucket_start(b);
+        uint64_t next = ipc_lat_bucket_start(b + 1);
+
+        TEST_ASSERT(start < next, "bucket starts increase");
+        TEST_ASSERT_EQUAL_U64(b, ipc_lat_bucket(start), "first value of a bucket");
+        TEST_ASSERT_EQUAL_U64(b, ipc_lat_bucket(next - 1), "last value of a bucket");
+        TEST_ASSERT_EQUAL_U64(b + 1, ipc_lat_bucket(next), "first value of the next bucket");
+    }
+    return TEST_PASSED;
+}
+
+/*
+ * Test that a bucket is never wider than 1/IPC_LAT_SUB_BUCKETS of its values
+ */
+static int test_bucket_width(void) {
+    for (uint32_t b = IPC_LAT_SUB_BUCKETS; b < IPC_LAT_BUCKETS - 1; b++) {
+        uint64_t start = ipc_lat_bucket_start(b);
+        uint64_t width = ipc_lat_bucket_start(b + 1) - start;
+
+        TEST_ASSERT(width * IPC_LAT_SUB_BUCKETS <= start, "relative bucket width");
+    }
+
+    // Each power of two starts a group of IPC_LAT_SUB_BUCKETS buckets
+    for (uint32_t exp = IPC_LAT_SUB_BITS; exp < 34; exp++) {
+        TEST_ASSERT_EQUAL_U64((exp - IPC_LAT_SUB_BITS + 1) * IPC_LAT_SUB_BUCKETS,
+                              ipc_lat_bucket(1ULL << exp), "power of two");
+    }
+    return TEST_PASSED;
+}
+
+/*
+ * Test that values past 2^34 cycles land in the last bucket
+ */
+static int test_bucket_clamp(void) {
+    TEST_ASSERT_EQUAL_U64(IPC_LAT_BUCKETS - 1, ipc_lat_bucket((1ULL << 34) - 1), "top of the range");
+    TEST_ASSERT_EQUAL_U64(IPC_LAT_BUCKETS - 1, ipc_lat_bucket(1ULL << 34), "past the range");
+    TEST_ASSERT_EQUAL_U64(IPC_LAT_BUCKETS - 1, ipc_lat_bucket(1ULL << 50), "far past the range");
+    TEST_ASSERT_EQUAL_U64(IPC_LAT_BUCKETS - 1, ipc_lat_bucket(~0ULL), "largest value");
+    return TEST_PASSED;
+}
+
+/*
+ * Test random values against the bucket bounds
+ */
+static int test_bucket_random(void) {
+    uint64_t x = 0x2545F4914F6CDD1DULL;
+
+    for (int i = 0; i < 1000000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        // Spread over all magnitudes below 2^34
+        uint64_t v = x >> (30 + (x & 31));
+        uint32_t b = ipc_lat_bucket(v);
+
+        TEST_ASSERT(ipc_lat_bucket_start(b) <= v, "value after its bucket start");
+        TEST_ASSERT(b == IPC_LAT_BUCKETS - 1 || v < ipc_lat_bucket_start(b + 1),
+                    "value before the next bucket");
+    }
+    return TEST_PASSED;
+}
+
+/*
+ * Test the summary of a known distribution
+ */
+static int test_summary(void) {
+    ipc_lat_summary_t summary;
+
+    ipc_lat_id_t id = ipc_lat_register(IPC_LAT_MUTEX_WAIT, "test_mutex");
+    TEST_ASSERT(id != IPC_LAT_NONE, "object registered");
+
+    TEST_ASSERT(ipc_lat_summary(id, &summary) == 0, "summary of a new object");
+    TEST_ASSERT_EQUAL_U64(0, summary.count, "no operations yet");
+    TEST_ASSERT(strcmp(summary.name, "test_mutex") == 0, "object name");
+
+    // 1000 operations: 900 of 100 cycles, 90 of 10000, 9 of 1000000, one of 5000000
+    for (int i = 0; i < 900; i++) {
+        ipc_lat_record(id, 100);
+    }
+    for (int i = 0; i < 90; i++) {
+        ipc_lat_record(id, 10000);
+    }
+    for (int i = 0; i < 9; i++) {
+        ipc_lat_record(id, 1000000);
+    }
+    ipc_lat_record(id, 5000000);
+
+    TEST_ASSERT(ipc_lat_summary(id, &summary) == 0, "summary");
+    TEST_ASSERT_EQUAL_U64(1000, summary.count, "operation count");
+    TEST_ASSERT_EQUAL_U64((900 * 100 + 90 * 10000 + 9 * 1000000 + 5000000) / 1000,
+                          summary.avg_ns, "average");
+    TEST_ASSERT_EQUAL_U64(5000000, summary.max_ns, "maximum");
+
+    // Percentiles report the end of the bucket that holds them
+    TEST_ASSERT_EQUAL_U64(ipc_lat_bucket_start(ipc_lat_bucket(100) + 1) - 1, summary.p50_ns, "p50");
+    TEST_ASSERT_EQUAL_U64(ipc_lat_bucket_start(ipc_lat_bucket(10000) + 1) - 1, summary.p99_ns, "p99");
+    TEST_ASSERT_EQUAL_U64(ipc_lat_bucket_start(ipc_lat_bucket(1000000) + 1) - 1, summary.p999_ns, "p99.9");
+    TEST_ASSERT(summary.p50_ns >= 100 && summary.p50_ns < 100 + 100 / IPC_LAT_SUB_BUCKETS,
+                "p50 within 1/8 of the value");
+
+    // A percentile never exceeds the maximum
+    ipc_lat_reset();
+    ipc_lat_record(id, 1000);
+    TEST_ASSERT(ipc_lat_summary(id, &summary) == 0, "summary of one operation");
+    TEST_ASSERT_EQUAL_U64(1000, summary.p50_ns, "p50 capped at the maximum");
+    TEST_ASSERT_EQUAL_U64(1000, summary.p999_ns, "p99.9 capped at the maximum");
+
+    // Unregistered objects have no summary and record nothing
+    ipc_lat_unregister(id);
+    TEST_ASSERT(ipc_lat_summary(id, &summary) == -1, "no summary after unregister");
+    ipc_lat_record(IPC_LAT_NONE, 100);
+    TEST_ASSERT(ipc_lat_summary(IPC_LAT_NONE, &summary) == -1, "untracked object");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    printf("============================\n");
+    printf("IPC Latency Histogram Tests\n");
+    printf("============================\n\n");
+
+    host_percpu_enter(&test_cpu, 0);
+    init_ipc_latency();
+
+    TEST_RUN(test_exact_buckets);
+    TEST_RUN(test_bucket_boundaries);
+    TEST_RUN(test_bucket_width);
+    TEST_RUN(test_bucket_clamp);
+    TEST_RUN(test_bucket_random);
+    TEST_RUN(test_summary);
+
+    /* Summary */
+    printf("\n============================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("============================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,295 @@
+/*
+ * EdgeX OS - Heap Profiler Sampling Unit Tests
+ *
+ * This file tests the byte sampling of the kernel heap profiler
+ * (kernel/kmemprof.c) on the host: the range and mean of the random
+ * interval between samples, recording everything at rate 0, always
+ * sampling allocations larger than the interval, the estimates scaled
+ * up from the samples, and frees closing the sampled objects.
+ */
+
+#define _GNU_SOURCE
+#define CONFIG_KMEM_PROFILE
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/kmemprof.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "kernel/host_percpu.h"
+
+/* cli/sti fault in user mode; a test thread is never interrupted anyway */
+#define local_irq_save()            0ULL
+#define local_irq_restore(flags)    ((void)(flags))
+
+/* The kernel prints uint64_t with %llu; on the host it is unsigned long */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "kernel/kmemprof.c"
+#pragma GCC diagnostic pop
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_U64(expected, actual, message) \
+    do { \
+        if ((uint64_t)(expected) != (uint64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+/* Within pct percent of the expected value */
+#define TEST_ASSERT_NEAR(expected, actual, pct, message) \
+    do { \
+        uint64_t e_ = (uint64_t)(expected); \
+        uint64_t a_ = (uint64_t)(actual); \
+        uint64_t d_ = a_ > e_ ? a_ - e_ : e_ - a_; \
+        if (d_ * 100 > e_ * (pct)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu +-%u%%, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)e_, (unsigned)(pct), \
+                (unsigned long long)a_); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        test_reset(); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/* Fake call sites and object addresses; never dereferenced */
+#define TEST_SITE_A         0x1000
+#define TEST_SITE_B         0x2000
+#define TEST_HEAP           0x10000000UL
+
+/* The running CPU, reached through %gs */
+static cpu_t test_cpu;
+
+/* Kernel services used by kmemprof.c */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+const char* ksym_lookup(uint64_t addr, uint64_t* offset) {
+    (void)addr;
+    *offset = 0;
+    return NULL;
+}
+
+void get_heap_stats(size_t* used, size_t* size) {
+    *used = 0;
+    *size = 0;
+}
+
+uint64_t tsc_to_ns(uint64_t cycles) {
+    return cycles;
+}
+
+/*
+ * Stop the profiler and forget every site
+ */
+static void test_reset(void) {
+    kmemprof_stop();
+    memset(kmemprof_sites, 0, sizeof(kmemprof_sites));
+    memset(kmemprof_objects, 0, sizeof(kmemprof_objects));
+    memset(kmemprof_cpus, 0, sizeof(kmemprof_cpus));
+    kmemprof_objects_used = 0;
+    kmemprof_overflow = 0;
+    kmemprof_dropped = 0;
+}
+
+/*
+ * Allocate count objects of size bytes from a site; returns the first address
+ */
+static uintptr_t test_alloc(uintptr_t site, uint32_t count, size_t size) {
+    static uintptr_t next = TEST_HEAP;
+    uintptr_t first = next;
+
+    for (uint32_t i = 0; i < count; i++) {
+        kmemprof_alloc((void*)next, size, site);
+        next += size;
+    }
+    return first;
+}
+
+/*
+ * Test that intervals stay in [rate/2, 3*rate/2) and average the rate
+ */
+static int test_interval_range(void) {
+    kmemprof_cpu_t pc = { .countdown = 0, .rng = 0 };
+    uint64_t sum = 0;
+    int64_t min = INT64_MAX;
+    int64_t max = 0;
+    const uint32_t draws = 100000;
+
+    kmemprof_rate = 4096;
+    for (uint32_t i = 0; i < draws; i++) {
+        int64_t interval = kmemprof_next_interval(&pc);
+        TEST_ASSERT(interval >= 2048 && interval < 6144, "interval in [rate/2, 3*rate/2)");
+        min = interval < min ? interval : min;
+        max = interval > max ? interval : max;
+        sum += (uint64_t)interval;
+    }
+    TEST_ASSERT_NEAR(4096, sum / draws, 1, "mean interval is the rate");
+    TEST_ASSERT(min < 2048 + 64 && max >= 6144 - 64, "whole range used");
+
+    // Not a fixed period: consecutive intervals differ
+    TEST_ASSERT(kmemprof_next_interval(&pc) != kmemprof_next_interval(&pc), "intervals vary");
+
+    kmemprof_rate = 0;
+    TEST_ASSERT_EQUAL_U64(0, kmemprof_next_interval(&pc), "rate 0: no interval");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that rate 0 records every allocation at its real size
+ */
+static int test_rate_zero(void) {
+    kmemprof_start(0);
+    test_alloc(TEST_SITE_A, 100, 16);
+    test_alloc(TEST_SITE_B, 3, 100);
+
+    kmemprof_site_t* a = kmemprof_site_get(TEST_SITE_A);
+    kmemprof_site_t* b = kmemprof_site_get(TEST_SITE_B);
+    TEST_ASSERT_EQUAL_U64(100, a->samples, "every allocation sampled");
+    TEST_ASSERT_EQUAL_U64(100, a->allocs, "each stands for itself");
+    TEST_ASSERT_EQUAL_U64(1600, a->bytes, "exact bytes");
+    TEST_ASSERT_EQUAL_U64(3, b->samples, "sites counted apart");
+    TEST_ASSERT_EQUAL_U64(100, b->max_size, "largest allocation");
+
+    // Nothing is recorded once stopped
+    kmemprof_stop();
+    test_alloc(TEST_SITE_A, 10, 16);
+    TEST_ASSERT_EQUAL_U64(100, a->samples, "stopped");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that small allocations are sampled by bytes and scaled back up
+ */
+static int test_sampled_estimates(void) {
+    const uint32_t count = 200000;
+    const size_t size = 64;
+
+    kmemprof_start(KMEMPROF_DEFAULT_RATE);
+    test_alloc(TEST_SITE_A, count, size);
+
+    kmemprof_site_t* a = kmemprof_site_get(TEST_SITE_A);
+    uint64_t expected_samples = (uint64_t)count * size / KMEMPROF_DEFAULT_RATE;
+    TEST_ASSERT_NEAR(expected_samples, a->samples, 5, "one sample per rate bytes");
+    TEST_ASSERT_EQUAL_U64(a->samples * (KMEMPROF_DEFAULT_RATE / size), a->allocs,
+                          "a sample stands for rate/size allocations");
+    TEST_ASSERT_NEAR(count, a->allocs, 5, "estimated allocations");
+    TEST_ASSERT_NEAR((uint64_t)count * size, a->bytes, 5, "estimated bytes");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that allocations larger than any interval are always sampled
+ */
+static int test_large_always_sampled(void) {
+    kmemprof_start(KMEMPROF_DEFAULT_RATE);
+    test_alloc(TEST_SITE_B, 50, KMEMPROF_DEFAULT_RATE * 3 / 2);
+
+    kmemprof_site_t* b = kmemprof_site_get(TEST_SITE_B);
+    TEST_ASSERT_EQUAL_U64(50, b->samples, "every large allocation sampled");
+    TEST_ASSERT_EQUAL_U64(50, b->allocs, "weight one each");
+    TEST_ASSERT_EQUAL_U64(50ULL * KMEMPROF_DEFAULT_RATE * 3 / 2, b->bytes, "exact bytes");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that frees close the sampled objects and ignore the rest
+ */
+static int test_free_sampled(void) {
+    kmemprof_start(0);
+    uintptr_t first = test_alloc(TEST_SITE_A, 20, 32);
+    TEST_ASSERT_EQUAL_U64(20, kmemprof_objects_used, "objects tracked");
+
+    for (uint32_t i = 0; i < 10; i++) {
+        kmemprof_free((void*)(first + i * 32));
+    }
+    kmemprof_site_t* a = kmemprof_site_get(TEST_SITE_A);
+    TEST_ASSERT_EQUAL_U64(10, a->frees, "frees counted");
+    TEST_ASSERT_EQUAL_U64(320, a->freed_bytes, "freed bytes");
+    TEST_ASSERT_EQUAL_U64(10, kmemprof_objects_used, "slots given back");
+    TEST_ASSERT_EQUAL_U64(320, kmemprof_live_bytes(a), "live bytes");
+
+    // A second free and a free of an object never sampled change nothing
+    kmemprof_free((void*)first);
+    kmemprof_free((void*)(TEST_HEAP - 64));
+    TEST_ASSERT_EQUAL_U64(10, a->frees, "double free ignored");
+
+    uint64_t lifetimes = 0;
+    for (uint32_t bucket = 0; bucket < KMEMPROF_LIFE_BUCKETS; bucket++) {
+        lifetimes += a->life_hist[bucket];
+    }
+    TEST_ASSERT_EQUAL_U64(10, lifetimes, "one lifetime per free");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    host_percpu_enter(&test_cpu, 0);
+
+    printf("============================\n");
+    printf("Heap Profiler Sampling Tests\n");
+    printf("============================\n\n");
+
+    TEST_RUN(test_interval_range);
+    TEST_RUN(test_rate_zero);
+    TEST_RUN(test_sampled_estimates);
+    TEST_RUN(test_large_always_sampled);
+    TEST_RUN(test_free_sampled);
+
+    /* Summary */
+    printf("\n============================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("============================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
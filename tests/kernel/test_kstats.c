@@ -0,0 +1,432 @@
+/*
+ * EdgeX OS - Statistics Page Unit Tests
+ *
+ * This file tests kernel/kstats.c on the host: the header monitoring
+ * tasks find before the first update, what a sample takes from the
+ * scheduler, memory and IPC queries, and the sequence count around
+ * publishing. A writer thread publishes while the test reads the pages
+ * the way a task does, and no read that passes kstats_read_retry() may
+ * mix two updates.
+ */
+
+#define _GNU_SOURCE
+
+#include <edgex/kernel.h>
+#include <edgex/memory.h>
+#include <edgex/scheduler.h>
+#include <edgex/kstats.h>
+#include <edgex/ipc/message.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
+
+/* The kernel prints uint64_t with %llu; on the host it is unsigned long */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "kernel/kstats.c"
+#pragma GCC diagnostic pop
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_U64(expected, actual, message) \
+    do { \
+        if ((uint64_t)(expected) != (uint64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/* More tasks than the page holds; PID 5 exits before it is queried */
+#define TEST_NR_TASKS           (KSTATS_MAX_TASKS + 6)
+#define TEST_EXITED_PID         5
+#define TEST_NR_QUEUES          3
+#define TEST_READ_NS            (200 * 1000000ULL)   /* Long enough for many preemptions */
+
+static task_t test_tasks[TEST_NR_TASKS];
+static uint32_t test_kernel_tasks;
+static volatile bool test_writer_stop;
+
+/* Memory and IPC queries */
+void get_memory_stats(uint64_t* total, uint64_t* free, uint64_t* used) {
+    *total = 1024 * PAGE_SIZE;
+    *free = 600 * PAGE_SIZE;
+    if (used) {
+        *used = 424 * PAGE_SIZE;
+    }
+}
+
+uint64_t get_zone_free_pages(memory_zone_type_t zone) {
+    return 100 + (uint64_t)zone;
+}
+
+void get_ipc_stats(ipc_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->message_queue_count = TEST_NR_QUEUES;
+    stats->message_operations = 77;
+}
+
+uint32_t get_message_queue_depths(message_queue_depth_t* depths, uint32_t max) {
+    uint32_t count = TEST_NR_QUEUES < max ? TEST_NR_QUEUES : max;
+
+    for (uint32_t i = 0; i < count; i++) {
+        memset(&depths[i], 0, sizeof(depths[i]));
+        snprintf(depths[i].name, sizeof(depths[i].name), "queue%u", i);
+        depths[i].owner = (pid_t)(10 + i);
+        depths[i].depth = i;
+        depths[i].max_messages = 64;
+        depths[i].messages_sent = 1000 + i;
+    }
+    return count;
+}
+
+/* Scheduler queries: CPUs 0, 1 and 3 are online */
+int get_cpu_sched_info(uint32_t cpu, cpu_sched_info_t* info) {
+    if (cpu != 0 && cpu != 1 && cpu != 3) {
+        return -1;
+    }
+    memset(info, 0, sizeof(*info));
+    info->nr_running = cpu + 1;
+    info->nr_switches = 1000 * (cpu + 1);
+    info->idle_ns = 5;
+    return 0;
+}
+
+void for_each_task(void (*fn)(task_t* task, void* arg), void* arg) {
+    for (uint32_t i = 0; i < TEST_NR_TASKS; i++) {
+        fn(&test_tasks[i], arg);
+    }
+}
+
+int get_task_sched_info(pid_t pid, task_sched_info_t* info) {
+    if (pid == TEST_EXITED_PID) {
+        return -1;
+    }
+    memset(info, 0, sizeof(*info));
+    info->pid = pid;
+    info->state = TASK_STATE_READY;
+    info->priority = TASK_PRIORITY_NORMAL;
+    info->run_ns = (uint64_t)pid * 100;
+    // A full-length name, with no terminator
+    memset(info->name, 'a' + pid % 26, sizeof(info->name));
+    return 0;
+}
+
+/* Kernel services used by kstats.c */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+void* kzalloc(size_t size) {
+    return calloc(1, size);
+}
+
+void* alloc_page(void) {
+    return aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+}
+
+void free_page(void* page) {
+    free(page);
+}
+
+pid_t create_kernel_task(const char* name, void (*entry_point)(void), task_priority_t priority) {
+    (void)name;
+    (void)entry_point;
+    (void)priority;
+    test_kernel_tasks++;
+    return 2;
+}
+
+void sleep_task(uint64_t milliseconds) { (void)milliseconds; }
+uint64_t tsc_to_ns(uint64_t cycles) { return cycles; }
+
+/* Mapping into tasks is not exercised here */
+struct page_directory* find_page_directory(pid_t owner_pid) { (void)owner_pid; return NULL; }
+int map_device_memory(struct page_directory* pd, uint64_t vaddr, uint64_t paddr, size_t size,
+                      bool writable, bool uncached) {
+    (void)pd;
+    (void)vaddr;
+    (void)paddr;
+    (void)size;
+    (void)writable;
+    (void)uncached;
+    return -1;
+}
+int unmap_memory_range(struct page_directory* pd, uint64_t vaddr, size_t size, bool free_phys) {
+    (void)pd;
+    (void)vaddr;
+    (void)size;
+    (void)free_phys;
+    return -1;
+}
+
+static uint64_t test_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* The first published page, as a task sees it at KSTATS_VADDR */
+static const kstats_page_t* test_page(void) {
+    return (const kstats_page_t*)(uintptr_t)kstats_phys[0];
+}
+
+/*
+ * Copy the published pages into one buffer under the sequence count;
+ * returns the number of attempts
+ */
+static uint32_t test_read(kstats_page_t* copy) {
+    const kstats_page_t* page = test_page();
+    uint32_t attempts = 0;
+    uint32_t seq;
+
+    do {
+        attempts++;
+        seq = kstats_read_begin(page);
+        for (uint32_t i = 0; i < KSTATS_PAGES; i++) {
+            size_t offset = (size_t)i * PAGE_SIZE;
+            if (offset >= sizeof(*copy)) {
+                break;
+            }
+            size_t len = sizeof(*copy) - offset < PAGE_SIZE ? sizeof(*copy) - offset : PAGE_SIZE;
+            memcpy((uint8_t*)copy + offset, (const void*)(uintptr_t)kstats_phys[i], len);
+        }
+    } while (kstats_read_retry(page, seq));
+
+    return attempts;
+}
+
+/*
+ * Put the update number in fields spread over every page
+ */
+static void test_fill(kstats_page_t* stats, uint64_t n) {
+    stats->updates = n;
+    stats->total_pages = n;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        stats->cpus[i].nr_switches = n;
+    }
+    for (uint32_t i = 0; i < KSTATS_MAX_TASKS; i++) {
+        stats->tasks[i].run_ns = n;
+    }
+    for (uint32_t i = 0; i < KSTATS_MAX_QUEUES; i++) {
+        stats->queues[i].messages_sent = n;
+    }
+}
+
+/*
+ * Check that a copy holds one update only
+ */
+static bool test_consistent(const kstats_page_t* stats) {
+    uint64_t n = stats->updates;
+
+    if (stats->total_pages != n) {
+        return false;
+    }
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (stats->cpus[i].nr_switches != n) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < KSTATS_MAX_TASKS; i++) {
+        if (stats->tasks[i].run_ns != n) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < KSTATS_MAX_QUEUES; i++) {
+        if (stats->queues[i].messages_sent != n) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Test that the pages carry the header before the first update
+ */
+static int test_init_header(void) {
+    init_kstats();
+    TEST_ASSERT(kstats_buffer != NULL && kstats_phys[0] != 0, "pages allocated");
+    TEST_ASSERT_EQUAL_U64(1, test_kernel_tasks, "kstatsd started");
+
+    const kstats_page_t* page = test_page();
+    TEST_ASSERT_EQUAL_U64(KSTATS_MAGIC, page->magic, "magic");
+    TEST_ASSERT_EQUAL_U64(KSTATS_VERSION, page->version, "version");
+    TEST_ASSERT_EQUAL_U64(sizeof(kstats_page_t), page->size, "size");
+    TEST_ASSERT_EQUAL_U64(KSTATS_INTERVAL_MS, page->interval_ms, "interval");
+    TEST_ASSERT_EQUAL_U64(2, page->seq, "one complete update");
+    TEST_ASSERT_EQUAL_U64(0, page->updates, "no sample yet");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test what one sample takes from the kernel's queries
+ */
+static int test_sample(void) {
+    for (uint32_t i = 0; i < TEST_NR_TASKS; i++) {
+        test_tasks[i].pid = (pid_t)(i + 1);
+    }
+
+    kstats_sample(kstats_buffer);
+    kstats_buffer->updates++;
+    kstats_publish(kstats_buffer);
+
+    static kstats_page_t copy;
+    test_read(&copy);
+
+    TEST_ASSERT_EQUAL_U64(1024, copy.total_pages, "total pages");
+    TEST_ASSERT_EQUAL_U64(600, copy.free_pages, "free pages");
+    TEST_ASSERT_EQUAL_U64(100 + ZONE_TYPES_COUNT - 1, copy.zone_free_pages[ZONE_TYPES_COUNT - 1],
+                          "zone free pages");
+    TEST_ASSERT_EQUAL_U64(77, copy.ipc.message_operations, "IPC counters");
+
+    // CPU 2 is offline: a hole, with the count covering CPU 3
+    TEST_ASSERT_EQUAL_U64(4, copy.nr_cpus, "CPU entries");
+    TEST_ASSERT(copy.cpus[0].online && copy.cpus[1].online && copy.cpus[3].online, "online CPUs");
+    TEST_ASSERT(!copy.cpus[2].online && copy.cpus[2].nr_switches == 0, "offline CPU empty");
+    TEST_ASSERT_EQUAL_U64(4000, copy.cpus[3].nr_switches, "CPU 3 switches");
+    TEST_ASSERT_EQUAL_U64(4, copy.cpus[3].nr_running, "CPU 3 run queue");
+
+    // Tasks past the table are counted, exited ones left out
+    TEST_ASSERT_EQUAL_U64(TEST_NR_TASKS - KSTATS_MAX_TASKS, copy.tasks_dropped, "tasks dropped");
+    TEST_ASSERT_EQUAL_U64(KSTATS_MAX_TASKS - 1, copy.nr_tasks, "tasks listed");
+    TEST_ASSERT_EQUAL_U64(TEST_EXITED_PID - 1, copy.tasks[TEST_EXITED_PID - 2].pid,
+                          "task before the exited one");
+    TEST_ASSERT_EQUAL_U64(TEST_EXITED_PID + 1, copy.tasks[TEST_EXITED_PID - 1].pid,
+                          "exited task skipped");
+    TEST_ASSERT_EQUAL_U64(100, copy.tasks[0].run_ns, "task run time");
+    TEST_ASSERT_EQUAL_U64(KSTATS_NAME_LEN - 1, strlen(copy.tasks[0].name), "name terminated");
+
+    TEST_ASSERT_EQUAL_U64(TEST_NR_QUEUES, copy.nr_queues, "queues");
+    TEST_ASSERT(strcmp(copy.queues[2].name, "queue2") == 0, "queue name");
+    TEST_ASSERT_EQUAL_U64(1002, copy.queues[2].messages_sent, "queue counters");
+
+    TEST_ASSERT_EQUAL_U64(4, copy.seq, "sequence after the update");
+    TEST_ASSERT_EQUAL_U64(1, copy.updates, "update count");
+    TEST_ASSERT_EQUAL_U64(KSTATS_MAGIC, copy.magic, "header kept");
+
+    return TEST_PASSED;
+}
+
+/*
+ * kstatsd's part: publish new numbers, over and over
+ */
+static void* test_publisher(void* arg) {
+    uint64_t n = kstats_buffer->updates;
+    (void)arg;
+
+    while (!test_writer_stop) {
+        test_fill(kstats_buffer, ++n);
+        kstats_publish(kstats_buffer);
+    }
+    return NULL;
+}
+
+/*
+ * Test that reads during updates are retried, never torn
+ */
+static int test_concurrent_reads(void) {
+    static kstats_page_t copy;
+    pthread_t writer;
+    uint64_t last = 0;
+    uint32_t reads = 0;
+    uint32_t torn = 0;
+    uint32_t retried = 0;
+    uint32_t updates_seen = 0;
+
+    test_fill(kstats_buffer, kstats_buffer->updates);
+    kstats_publish(kstats_buffer);
+
+    test_writer_stop = false;
+    TEST_ASSERT(pthread_create(&writer, NULL, test_publisher, NULL) == 0, "writer started");
+
+    uint64_t end = test_now_ns() + TEST_READ_NS;
+    while (test_now_ns() < end) {
+        reads++;
+        if (test_read(&copy) > 1) {
+            retried++;
+        }
+        if (!test_consistent(&copy) || (copy.seq & 1) != 0) {
+            torn++;
+        }
+        if (copy.updates != last) {
+            updates_seen++;
+            last = copy.updates;
+        }
+    }
+
+    test_writer_stop = true;
+    pthread_join(writer, NULL);
+
+    TEST_ASSERT_EQUAL_U64(0, torn, "torn reads");
+    TEST_ASSERT(updates_seen > 1, "reads overlapped updates");
+    printf("  %u reads, %u retried, %u updates seen\n", reads, retried, updates_seen);
+
+    // After the writer stops the pages match its last update
+    test_read(&copy);
+    TEST_ASSERT_EQUAL_U64(kstats_buffer->updates, copy.updates, "last update visible");
+    TEST_ASSERT_EQUAL_U64(kstats_buffer->seq + 1, copy.seq, "sequence even at rest");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    printf("===========================\n");
+    printf("Statistics Page Tests\n");
+    printf("===========================\n\n");
+
+    // In order: the later tests use the pages the first one set up
+    TEST_RUN(test_init_header);
+    TEST_RUN(test_sample);
+    TEST_RUN(test_concurrent_reads);
+
+    /* Summary */
+    printf("\n===========================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("===========================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,407 @@
+/*
+ * EdgeX OS - Lock Statistics Unit Tests
+ *
+ * This file tests the lock class table of kernel/lockstat.c on the host:
+ * classes keyed by object name or spinlock call site, what happens when
+ * the table is full, the wait and hold counters and their power-of-two
+ * histograms, the list of tasks that waited longest, and reset. Spinlocks
+ * go through spin_lock() built with CONFIG_LOCK_STAT, so the call site
+ * seen is the real one.
+ */
+
+#define _GNU_SOURCE
+#define CONFIG_LOCK_STAT
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/spinlock.h>
+#include <edgex/lockstat.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "kernel/host_percpu.h"
+
+/* cli/sti fault in user mode; a test thread is never interrupted anyway */
+#define local_irq_save()            0ULL
+#define local_irq_restore(flags)    ((void)(flags))
+
+/* The kernel prints uint64_t with %llu; on the host it is unsigned long */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "kernel/lockstat.c"
+#pragma GCC diagnostic pop
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_U64(expected, actual, message) \
+    do { \
+        if ((uint64_t)(expected) != (uint64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        test_reset(); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/* Fake spinlock call sites, well away from the test's own code */
+#define TEST_SITE_BASE      0x7000000000ULL
+
+/* The running CPU, reached through %gs */
+static cpu_t test_cpu;
+
+/* Task charged for a contended acquisition */
+static pid_t test_pid = 1;
+
+/* Kernel services used by lockstat.c */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+const char* ksym_lookup(uint64_t addr, uint64_t* offset) {
+    (void)addr;
+    *offset = 0;
+    return NULL;
+}
+
+pid_t get_current_pid(void) { return test_pid; }
+uint64_t tsc_to_ns(uint64_t cycles) { return cycles; }
+void preempt_schedule(void) {}
+
+/*
+ * Empty the class table
+ */
+static void test_reset(void) {
+    memset(lockstat_classes, 0, sizeof(lockstat_classes));
+    lockstat_overflow = 0;
+    test_pid = 1;
+}
+
+/* Two call sites taking the same lock */
+static __attribute__((noinline)) void test_lock_site_a(spinlock_t* lock) {
+    spin_lock(lock);
+    spin_unlock(lock);
+}
+
+static __attribute__((noinline)) void test_lock_site_b(spinlock_t* lock) {
+    spin_lock(lock);
+    spin_unlock(lock);
+}
+
+static uint64_t test_hist_total(const uint64_t* hist) {
+    uint64_t total = 0;
+
+    for (uint32_t bucket = 0; bucket < LOCKSTAT_HIST_BUCKETS; bucket++) {
+        total += hist[bucket];
+    }
+    return total;
+}
+
+/*
+ * Test that classes are keyed by type and name, or by call site
+ */
+static int test_class_keys(void) {
+    lockstat_class_t* mutex = lockstat_class_named(LOCKSTAT_MUTEX, "model_lock");
+
+    TEST_ASSERT(mutex != NULL, "class created");
+    TEST_ASSERT(lockstat_class_named(LOCKSTAT_MUTEX, "model_lock") == mutex, "same name, same class");
+    TEST_ASSERT(lockstat_class_named(LOCKSTAT_SEMAPHORE, "model_lock") != mutex,
+                "type is part of the key");
+    TEST_ASSERT(lockstat_class_named(LOCKSTAT_MUTEX, "model_lock2") != mutex, "longer name differs");
+    TEST_ASSERT(lockstat_class_named(LOCKSTAT_MUTEX, "model_loc") != mutex, "prefix differs");
+    TEST_ASSERT(strcmp(mutex->name, "model_lock") == 0, "name stored");
+
+    // Unnamed objects share one class
+    lockstat_class_t* unnamed = lockstat_class_named(LOCKSTAT_MUTEX, NULL);
+    TEST_ASSERT(unnamed != NULL && lockstat_class_named(LOCKSTAT_MUTEX, "") == unnamed,
+                "no name and empty name");
+
+    // Names are compared as far as a class stores them
+    char long_a[64];
+    char long_b[64];
+    memset(long_a, 'q', sizeof(long_a) - 1);
+    long_a[sizeof(long_a) - 1] = '\0';
+    memcpy(long_b, long_a, sizeof(long_b));
+    long_b[LOCKSTAT_NAME_LEN + 4] = 'r';
+    lockstat_class_t* truncated = lockstat_class_named(LOCKSTAT_MUTEX, long_a);
+    TEST_ASSERT(truncated == lockstat_class_named(LOCKSTAT_MUTEX, long_b), "long names truncated");
+    TEST_ASSERT_EQUAL_U64(LOCKSTAT_NAME_LEN - 1, strlen(truncated->name), "stored name terminated");
+
+    // Spinlocks by call site
+    lockstat_class_t* site = lockstat_class_get(LOCKSTAT_SPINLOCK, TEST_SITE_BASE, NULL);
+    TEST_ASSERT(site == lockstat_class_get(LOCKSTAT_SPINLOCK, TEST_SITE_BASE, NULL), "same site");
+    TEST_ASSERT(site != lockstat_class_get(LOCKSTAT_SPINLOCK, TEST_SITE_BASE + 1, NULL),
+                "other site");
+    TEST_ASSERT_EQUAL_U64(TEST_SITE_BASE, site->site, "site stored");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that a full table hands out no class and counts what it missed
+ */
+static int test_table_full(void) {
+    lockstat_class_t* first = lockstat_class_named(LOCKSTAT_MUTEX, "full");
+
+    for (uint32_t i = 1; i < LOCKSTAT_MAX_CLASSES; i++) {
+        lockstat_class_t* cls = lockstat_class_get(LOCKSTAT_SPINLOCK, TEST_SITE_BASE + i, NULL);
+        TEST_ASSERT(cls != NULL, "class until the table is full");
+    }
+
+    TEST_ASSERT(lockstat_class_get(LOCKSTAT_SPINLOCK, TEST_SITE_BASE + LOCKSTAT_MAX_CLASSES,
+                                   NULL) == NULL, "no class once full");
+    TEST_ASSERT(lockstat_class_named(LOCKSTAT_MUTEX, "late") == NULL, "no named class once full");
+    TEST_ASSERT(lockstat_class_named(LOCKSTAT_MUTEX, "full") == first,
+                "existing classes still found");
+    TEST_ASSERT(lockstat_class_get(LOCKSTAT_SPINLOCK, TEST_SITE_BASE + 1, NULL) != NULL,
+                "existing sites still found");
+
+    // Every slot is probed: only the key, type included, may match
+    TEST_ASSERT(lockstat_class_named(LOCKSTAT_SEMAPHORE, "full") == NULL, "no match across types");
+
+    lockstat_acquired(NULL, 100, true);
+    lockstat_acquired(NULL, 0, false);
+    lockstat_released(NULL, 0);
+    TEST_ASSERT_EQUAL_U64(2, lockstat_overflow, "acquisitions without a class");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test the power-of-two histogram buckets
+ */
+static int test_buckets(void) {
+    TEST_ASSERT_EQUAL_U64(0, lockstat_bucket(0), "zero");
+    TEST_ASSERT_EQUAL_U64(1, lockstat_bucket(1), "one cycle");
+    TEST_ASSERT_EQUAL_U64(2, lockstat_bucket(2), "two");
+    TEST_ASSERT_EQUAL_U64(2, lockstat_bucket(3), "up to four");
+    TEST_ASSERT_EQUAL_U64(3, lockstat_bucket(4), "four");
+    TEST_ASSERT_EQUAL_U64(11, lockstat_bucket(1024), "1024");
+    TEST_ASSERT_EQUAL_U64(LOCKSTAT_HIST_BUCKETS - 1, lockstat_bucket(1ULL << 45), "clamped");
+    TEST_ASSERT_EQUAL_U64(LOCKSTAT_HIST_BUCKETS - 1, lockstat_bucket(UINT64_MAX), "largest");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test the acquisition, wait and hold counters
+ */
+static int test_counters(void) {
+    lockstat_class_t* cls = lockstat_class_named(LOCKSTAT_SEMAPHORE, "frames");
+
+    lockstat_acquired(cls, 0, false);
+    lockstat_acquired(cls, 0, false);
+    lockstat_acquired(cls, 100, true);
+    lockstat_acquired(cls, 3000, true);
+    lockstat_acquired(cls, 50, true);
+
+    TEST_ASSERT_EQUAL_U64(5, cls->acquisitions, "acquisitions");
+    TEST_ASSERT_EQUAL_U64(3, cls->contended, "contended");
+    TEST_ASSERT_EQUAL_U64(3150, cls->wait_cycles, "wait time");
+    TEST_ASSERT_EQUAL_U64(3000, cls->wait_max, "longest wait");
+    TEST_ASSERT_EQUAL_U64(3, test_hist_total(cls->wait_hist), "waits in the histogram");
+    TEST_ASSERT_EQUAL_U64(1, cls->wait_hist[lockstat_bucket(3000)], "3000 cycles bucket");
+
+    uint64_t now = rdtsc();
+    lockstat_released(cls, now);
+    lockstat_released(cls, now - 1000000);
+    TEST_ASSERT_EQUAL_U64(2, cls->releases, "releases");
+    TEST_ASSERT(cls->hold_max >= 1000000 && cls->hold_cycles >= cls->hold_max, "hold time");
+    TEST_ASSERT_EQUAL_U64(2, test_hist_total(cls->hold_hist), "holds in the histogram");
+
+    // The percentile bound covers the wait it stands for
+    TEST_ASSERT(lockstat_percentile(cls->wait_hist, cls->contended, 99) >= 3000, "p99 bound");
+    TEST_ASSERT(lockstat_percentile(cls->wait_hist, cls->contended, 50) >= 100 &&
+                lockstat_percentile(cls->wait_hist, cls->contended, 50) < 3000, "p50 bound");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that the waiter list keeps the tasks that waited longest
+ */
+static int test_top_waiters(void) {
+    lockstat_class_t* cls = lockstat_class_named(LOCKSTAT_MUTEX, "queue");
+
+    // PIDs 1 to 4 fill the list, PID 1 twice
+    for (pid_t pid = 1; pid <= LOCKSTAT_TOP_WAITERS; pid++) {
+        test_pid = pid;
+        lockstat_acquired(cls, (uint64_t)pid * 100, true);
+    }
+    test_pid = 1;
+    lockstat_acquired(cls, 150, true);
+
+    lockstat_waiter_t* one = NULL;
+    for (uint32_t i = 0; i < LOCKSTAT_TOP_WAITERS; i++) {
+        if (cls->waiters[i].pid == 1) {
+            one = &cls->waiters[i];
+        }
+    }
+    TEST_ASSERT(one != NULL, "PID 1 listed");
+    TEST_ASSERT_EQUAL_U64(2, one->contended, "waits of one task added up");
+    TEST_ASSERT_EQUAL_U64(250, one->wait_cycles, "wait time added up");
+
+    // Shorter than every listed task: not listed
+    test_pid = 9;
+    lockstat_acquired(cls, 10, true);
+    for (uint32_t i = 0; i < LOCKSTAT_TOP_WAITERS; i++) {
+        TEST_ASSERT(cls->waiters[i].pid != 9, "short waiter not listed");
+    }
+
+    // Longer: replaces the task that waited least (PID 2, 200 cycles)
+    test_pid = 10;
+    lockstat_acquired(cls, 5000, true);
+    bool found_new = false;
+    for (uint32_t i = 0; i < LOCKSTAT_TOP_WAITERS; i++) {
+        TEST_ASSERT(cls->waiters[i].pid != 2, "least waiter replaced");
+        if (cls->waiters[i].pid == 10) {
+            found_new = cls->waiters[i].contended == 1 && cls->waiters[i].wait_cycles == 5000;
+        }
+    }
+    TEST_ASSERT(found_new, "long waiter listed from zero");
+    TEST_ASSERT_EQUAL_U64(7, cls->contended, "class counts every wait");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that spinlocks are counted against the site taking them
+ */
+static int test_spinlock_sites(void) {
+    spinlock_t lock = SPINLOCK_INIT;
+
+    for (int i = 0; i < 3; i++) {
+        test_lock_site_a(&lock);
+    }
+    test_lock_site_b(&lock);
+
+    lockstat_class_t* a = NULL;
+    lockstat_class_t* b = NULL;
+    uint32_t classes = 0;
+    for (uint32_t i = 0; i < LOCKSTAT_MAX_CLASSES; i++) {
+        lockstat_class_t* cls = &lockstat_classes[i];
+        if (cls->state != LOCKSTAT_READY) {
+            continue;
+        }
+        classes++;
+        if (cls->acquisitions == 3) {
+            a = cls;
+        } else if (cls->acquisitions == 1) {
+            b = cls;
+        }
+    }
+    TEST_ASSERT_EQUAL_U64(2, classes, "one class per site");
+    TEST_ASSERT(a != NULL && b != NULL, "each site counted apart");
+    TEST_ASSERT(a->site - (uintptr_t)test_lock_site_a < 128, "site inside the caller");
+    TEST_ASSERT(b->site - (uintptr_t)test_lock_site_b < 128, "other site inside its caller");
+    TEST_ASSERT_EQUAL_U64(LOCKSTAT_SPINLOCK, a->type, "spinlock class");
+    TEST_ASSERT_EQUAL_U64(3, a->releases, "holds timed");
+    TEST_ASSERT_EQUAL_U64(0, a->contended, "never contended");
+    TEST_ASSERT(lock.lock_class == NULL && !spin_is_locked(&lock), "released");
+
+    // A failed trylock is not an acquisition
+    spin_lock(&lock);
+    lockstat_class_t* held = lock.lock_class;
+    TEST_ASSERT(!lockstat_spin_trylock(&lock, TEST_SITE_BASE), "trylock fails while held");
+    TEST_ASSERT(lock.lock_class == held, "holder's class kept");
+    spin_unlock(&lock);
+    TEST_ASSERT(lockstat_class_get(LOCKSTAT_SPINLOCK, TEST_SITE_BASE, NULL)->acquisitions == 0,
+                "failed trylock not counted");
+
+    TEST_ASSERT(lockstat_spin_trylock(&lock, TEST_SITE_BASE), "trylock on a free lock");
+    TEST_ASSERT(lock.lock_class->site == TEST_SITE_BASE, "trylock site");
+    lockstat_spin_release(&lock);
+    arch_spin_unlock(&lock);
+    TEST_ASSERT(lockstat_class_get(LOCKSTAT_SPINLOCK, TEST_SITE_BASE, NULL)->acquisitions == 1,
+                "trylock counted");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that reset clears the numbers and keeps the classes
+ */
+static int test_reset_keeps_classes(void) {
+    lockstat_class_t* cls = lockstat_class_named(LOCKSTAT_MUTEX, "kept");
+
+    lockstat_acquired(cls, 700, true);
+    lockstat_released(cls, rdtsc());
+    lockstat_acquired(NULL, 0, false);
+
+    lockstat_reset();
+    TEST_ASSERT(lockstat_class_named(LOCKSTAT_MUTEX, "kept") == cls, "class kept");
+    TEST_ASSERT(strcmp(cls->name, "kept") == 0 && cls->type == LOCKSTAT_MUTEX, "key kept");
+    TEST_ASSERT_EQUAL_U64(0, cls->acquisitions, "acquisitions cleared");
+    TEST_ASSERT_EQUAL_U64(0, cls->contended + cls->wait_cycles + cls->wait_max, "waits cleared");
+    TEST_ASSERT_EQUAL_U64(0, cls->releases + cls->hold_cycles + cls->hold_max, "holds cleared");
+    TEST_ASSERT_EQUAL_U64(0, test_hist_total(cls->wait_hist) + test_hist_total(cls->hold_hist),
+                          "histograms cleared");
+    TEST_ASSERT_EQUAL_U64(0, cls->waiters[0].contended, "waiters cleared");
+    TEST_ASSERT_EQUAL_U64(0, lockstat_overflow, "overflow cleared");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    host_percpu_enter(&test_cpu, 0);
+
+    printf("===========================\n");
+    printf("Lock Statistics Tests\n");
+    printf("===========================\n\n");
+
+    TEST_RUN(test_class_keys);
+    TEST_RUN(test_table_full);
+    TEST_RUN(test_buckets);
+    TEST_RUN(test_counters);
+    TEST_RUN(test_top_waiters);
+    TEST_RUN(test_spinlock_sites);
+    TEST_RUN(test_reset_keeps_classes);
+
+    /* Summary */
+    printf("\n===========================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("===========================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,629 @@
+/*
+ * EdgeX OS - Network Checksum and Receive Unit Tests
+ *
+ * This file tests the Internet checksum helpers of kernel/net.c against
+ * a plain byte-pair reference, the IPv4 and IPv6 pseudo-header sums, and
+ * the length and checksum checks the receive path makes before a UDP
+ * datagram reaches a socket. Frames are built here with the reference
+ * checksum and fed to the receive handler as if the device had written
+ * them.
+ */
+
+#define _GNU_SOURCE
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/scheduler.h>
+#include <edgex/net.h>
+#include <edgex/udp.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "kernel/host_percpu.h"
+
+/* cli/sti fault in user mode; a test thread is never interrupted anyway */
+#define local_irq_save()            0ULL
+#define local_irq_restore(flags)    ((void)(flags))
+
+/* The kernel prints uint64_t with %llu; on the host it is unsigned long */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "kernel/net.c"
+#pragma GCC diagnostic pop
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_U64(expected, actual, message) \
+    do { \
+        if ((uint64_t)(expected) != (uint64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        test_reset(); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/* Local and peer endpoints of the test frames */
+#define TEST_LOCAL_PORT     7000
+#define TEST_PEER_PORT      40000
+#define TEST_FRAME_SIZE     VIRTIO_NET_RX_BUF_SIZE
+
+static const uint8_t test_local6[16] = { 0x20, 0x01, 0x0D, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x15 };
+static const uint8_t test_peer6[16] = { 0x20, 0x01, 0x0D, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01 };
+
+/* The running CPU, reached through %gs */
+static cpu_t test_cpu;
+
+/* Whether the fake device says it verified the checksum */
+static bool test_rx_csum_valid;
+
+/* The last datagram handed to a socket */
+static struct {
+    uint32_t count;
+    uint16_t port;
+    uint32_t offset;
+    uint32_t len;
+    net_addr_t peer;
+    uint16_t peer_port;
+} test_delivered;
+
+static uint8_t test_frame[TEST_FRAME_SIZE];
+
+/* Device and socket layer seen by net.c */
+bool virtio_net_rx_csum_valid(virtio_net_t* net, uint32_t buf) {
+    (void)net;
+    (void)buf;
+    return test_rx_csum_valid;
+}
+
+bool udp_deliver(uint16_t port, uint16_t queue, uint32_t buf, uint32_t offset, uint32_t len,
+                 const net_addr_t* peer, uint16_t peer_port) {
+    (void)queue;
+    (void)buf;
+    test_delivered.count++;
+    test_delivered.port = port;
+    test_delivered.offset = offset;
+    test_delivered.len = len;
+    test_delivered.peer = *peer;
+    test_delivered.peer_port = peer_port;
+    return true;
+}
+
+/* Transmit side: never reached by the receive tests */
+virtio_net_t* virtio_net_get(uint32_t index) { (void)index; return NULL; }
+void virtio_net_set_handlers(virtio_net_t* net, virtio_net_rx_handler_t rx,
+                             virtio_net_tx_done_t tx_done, void* ctx) {
+    (void)net;
+    (void)rx;
+    (void)tx_done;
+    (void)ctx;
+}
+int virtio_net_xmit(virtio_net_t* net, uint16_t queue, const virtio_net_tx_t* pkt, bool more) {
+    (void)net;
+    (void)queue;
+    (void)pkt;
+    (void)more;
+    return -1;
+}
+void virtio_net_flush(virtio_net_t* net, uint16_t queue) { (void)net; (void)queue; }
+bool virtio_net_has_csum_offload(virtio_net_t* net) { (void)net; return false; }
+void udp_tx_complete(void* cookie, bool sent) { (void)cookie; (void)sent; }
+void init_udp(void) {}
+
+/* Kernel services used by net.c */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+void* alloc_page(void) {
+    return aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+}
+
+pid_t create_kernel_task(const char* name, void (*entry_point)(void), task_priority_t priority) {
+    (void)name;
+    (void)entry_point;
+    (void)priority;
+    return 2;
+}
+
+uint64_t get_tick_count(void) { return 1; }
+void sleep_task(uint64_t milliseconds) { (void)milliseconds; }
+void preempt_schedule(void) {}
+
+/*
+ * RFC 1071 checksum the long way: big-endian byte pairs, end-around carry
+ */
+static uint16_t test_ref_csum(const uint8_t* data, size_t len) {
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i < len; i += 2) {
+        uint16_t word = (uint16_t)(data[i] << 8);
+        if (i + 1 < len) {
+            word |= data[i + 1];
+        }
+        sum += word;
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/* The kernel's checksum of a buffer, in wire order */
+static uint16_t test_net_csum(const void* data, size_t len) {
+    return ntohs(net_csum_fold(net_csum_add(0, data, len)));
+}
+
+/* Reference UDP checksum over an explicit pseudo-header */
+static uint16_t test_ref_udp_csum(uint8_t family, const uint8_t* src, const uint8_t* dst,
+                                  const uint8_t* udp, uint16_t len) {
+    static uint8_t buf[40 + TEST_FRAME_SIZE];
+    size_t alen = family == NET_AF_INET ? 4 : 16;
+    size_t off = 0;
+
+    memcpy(buf + off, src, alen);
+    off += alen;
+    memcpy(buf + off, dst, alen);
+    off += alen;
+    if (family == NET_AF_INET) {
+        // Zero, protocol, UDP length
+        buf[off++] = 0;
+        buf[off++] = IP_PROTO_UDP;
+        buf[off++] = (uint8_t)(len >> 8);
+        buf[off++] = (uint8_t)len;
+    } else {
+        // 32-bit length, three zero bytes, next header
+        buf[off++] = 0;
+        buf[off++] = 0;
+        buf[off++] = (uint8_t)(len >> 8);
+        buf[off++] = (uint8_t)len;
+        buf[off++] = 0;
+        buf[off++] = 0;
+        buf[off++] = 0;
+        buf[off++] = IP_PROTO_UDP;
+    }
+    memcpy(buf + off, udp, len);
+    return test_ref_csum(buf, off + len);
+}
+
+/*
+ * Fill a UDP header and payload; the checksum is left to the caller
+ */
+static void test_fill_udp(uint8_t* l4, uint16_t payload_len) {
+    udp_hdr_t* udp = (udp_hdr_t*)l4;
+
+    udp->src_port = htons(TEST_PEER_PORT);
+    udp->dst_port = htons(TEST_LOCAL_PORT);
+    udp->len = htons((uint16_t)(sizeof(udp_hdr_t) + payload_len));
+    udp->csum = 0;
+    for (uint16_t i = 0; i < payload_len; i++) {
+        l4[sizeof(udp_hdr_t) + i] = (uint8_t)(i * 7 + 3);
+    }
+}
+
+/*
+ * Recompute the IPv4 header checksum after changing a field
+ */
+static void test_ipv4_rehash(uint8_t* frame) {
+    ipv4_hdr_t* ip = (ipv4_hdr_t*)(frame + ETH_HLEN);
+
+    ip->csum = 0;
+    ip->csum = htons(test_ref_csum((const uint8_t*)ip, sizeof(ipv4_hdr_t)));
+}
+
+/*
+ * Build a valid IPv4 UDP frame to us; returns its length
+ */
+static uint32_t test_ipv4_frame(uint8_t* frame, uint16_t payload_len) {
+    eth_hdr_t* eth = (eth_hdr_t*)frame;
+    ipv4_hdr_t* ip = (ipv4_hdr_t*)(frame + ETH_HLEN);
+    uint8_t* l4 = frame + ETH_HLEN + sizeof(ipv4_hdr_t);
+    uint16_t udp_len = (uint16_t)(sizeof(udp_hdr_t) + payload_len);
+    net_addr_t peer = net_addr_ipv4(10, 0, 2, 2);
+
+    memset(frame, 0, TEST_FRAME_SIZE);
+    eth->type = htons(ETH_TYPE_IPV4);
+    ip->ver_ihl = 0x45;
+    ip->total_len = htons((uint16_t)(sizeof(ipv4_hdr_t) + udp_len));
+    ip->ttl = IPV4_DEFAULT_TTL;
+    ip->proto = IP_PROTO_UDP;
+    memcpy(&ip->src, peer.addr, 4);
+    ip->dst = net_cfg.ipv4;
+    test_ipv4_rehash(frame);
+
+    test_fill_udp(l4, payload_len);
+    uint16_t csum = test_ref_udp_csum(NET_AF_INET, (const uint8_t*)&ip->src,
+                                      (const uint8_t*)&ip->dst, l4, udp_len);
+    ((udp_hdr_t*)l4)->csum = htons(csum == 0 ? 0xFFFF : csum);
+
+    return ETH_HLEN + sizeof(ipv4_hdr_t) + udp_len;
+}
+
+/*
+ * Build a valid IPv6 UDP frame to us; returns its length
+ */
+static uint32_t test_ipv6_frame(uint8_t* frame, uint16_t payload_len) {
+    eth_hdr_t* eth = (eth_hdr_t*)frame;
+    ipv6_hdr_t* ip6 = (ipv6_hdr_t*)(frame + ETH_HLEN);
+    uint8_t* l4 = frame + ETH_HLEN + IPV6_HLEN;
+    uint16_t udp_len = (uint16_t)(sizeof(udp_hdr_t) + payload_len);
+
+    memset(frame, 0, TEST_FRAME_SIZE);
+    eth->type = htons(ETH_TYPE_IPV6);
+    ip6->ver_tc_flow = htonl(6U << 28);
+    ip6->payload_len = htons(udp_len);
+    ip6->next_hdr = IP_PROTO_UDP;
+    ip6->hop_limit = IPV6_DEFAULT_HOPS;
+    memcpy(ip6->src, test_peer6, 16);
+    memcpy(ip6->dst, test_local6, 16);
+
+    test_fill_udp(l4, payload_len);
+    uint16_t csum = test_ref_udp_csum(NET_AF_INET6, ip6->src, ip6->dst, l4, udp_len);
+    ((udp_hdr_t*)l4)->csum = htons(csum == 0 ? 0xFFFF : csum);
+
+    return ETH_HLEN + IPV6_HLEN + udp_len;
+}
+
+/*
+ * Feed a frame to the receive handler; returns whether it was delivered
+ */
+static bool test_rx(uint32_t len) {
+    uint32_t before = test_delivered.count;
+    bool kept = net_rx(NULL, 0, 0, test_frame, len, NULL);
+
+    return kept && test_delivered.count == before + 1;
+}
+
+/*
+ * Configure the interface and forget the last delivery
+ */
+static void test_reset(void) {
+    net_addr_t local = net_addr_ipv4(10, 0, 2, 15);
+
+    memset(&net_cfg, 0, sizeof(net_cfg));
+    memcpy(&net_cfg.ipv4, local.addr, 4);
+    memcpy(net_cfg.ipv6, test_local6, 16);
+    memset(&net_stats, 0, sizeof(net_stats));
+    memset(&test_delivered, 0, sizeof(test_delivered));
+    test_rx_csum_valid = false;
+}
+
+/*
+ * Test the checksum against published examples
+ */
+static int test_csum_vectors(void) {
+    // RFC 1071 section 3: the words sum to 0xDDF2
+    static const uint8_t rfc1071[] = { 0x00, 0x01, 0xF2, 0x03, 0xF4, 0xF5, 0xF6, 0xF7 };
+    TEST_ASSERT_EQUAL_U64(0x220D, test_net_csum(rfc1071, sizeof(rfc1071)), "RFC 1071 example");
+
+    // An IPv4 header carrying checksum 0xB861
+    uint8_t ip[] = { 0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+                     0xB8, 0x61, 0xC0, 0xA8, 0x00, 0x01, 0xC0, 0xA8, 0x00, 0xC7 };
+    TEST_ASSERT_EQUAL_U64(0, test_net_csum(ip, sizeof(ip)), "valid header verifies to zero");
+    ip[10] = 0;
+    ip[11] = 0;
+    TEST_ASSERT_EQUAL_U64(0xB861, test_net_csum(ip, sizeof(ip)), "header checksum computed");
+
+    // Nothing summed is all ones complemented
+    TEST_ASSERT_EQUAL_U64(0xFFFF, test_net_csum(ip, 0), "empty buffer");
+    TEST_ASSERT_EQUAL_U64(0xFFFF, ntohs(net_csum_fold(0)), "zero accumulator");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test odd lengths, split sums and carries against the reference
+ */
+static int test_csum_reference(void) {
+    static uint8_t data[70000];
+    uint32_t seed = 12345;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+
+    for (size_t len = 0; len <= 300; len++) {
+        TEST_ASSERT_EQUAL_U64(test_ref_csum(data, len), test_net_csum(data, len),
+                              "every length from 0 to 300");
+
+        // Sums continue across any even split
+        for (size_t split = 0; split <= len; split += 2) {
+            uint32_t sum = net_csum_add(0, data, split);
+            sum = net_csum_add(sum, data + split, len - split);
+            TEST_ASSERT_EQUAL_U64(test_ref_csum(data, len), ntohs(net_csum_fold(sum)),
+                                  "split sum");
+        }
+    }
+
+    // An odd byte is padded with zero, not with whatever follows it
+    uint8_t odd[3] = { 0x12, 0x34, 0x56 };
+    uint8_t padded[4] = { 0x12, 0x34, 0x56, 0x00 };
+    TEST_ASSERT_EQUAL_U64(test_net_csum(padded, 4), test_net_csum(odd, 3), "odd byte padding");
+
+    // Enough all-ones words to carry out of the 32-bit accumulator many times
+    memset(data, 0xFF, sizeof(data));
+    TEST_ASSERT_EQUAL_U64(test_ref_csum(data, sizeof(data)), test_net_csum(data, sizeof(data)),
+                          "all ones");
+    data[sizeof(data) - 1] = 0x01;
+    TEST_ASSERT_EQUAL_U64(test_ref_csum(data, sizeof(data)), test_net_csum(data, sizeof(data)),
+                          "all ones but one byte");
+
+    // A running accumulator near the top folds correctly
+    uint32_t sum = net_csum_add(0xFFFFFFFF, data, 64);
+    TEST_ASSERT_EQUAL_U64(test_ref_csum(data, 64), ntohs(net_csum_fold(sum)),
+                          "accumulator carry");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test the pseudo-header sums against explicit pseudo-headers
+ */
+static int test_pseudo_sum(void) {
+    uint8_t udp[8 + 301];
+    const uint8_t src4[4] = { 192, 168, 1, 10 };
+    const uint8_t dst4[4] = { 10, 0, 2, 15 };
+
+    for (uint16_t payload = 0; payload <= 301; payload += 43) {
+        uint16_t len = (uint16_t)(sizeof(udp_hdr_t) + payload);
+        test_fill_udp(udp, payload);
+
+        uint32_t sum = net_pseudo_sum(NET_AF_INET, src4, dst4, IP_PROTO_UDP, len);
+        TEST_ASSERT_EQUAL_U64(test_ref_udp_csum(NET_AF_INET, src4, dst4, udp, len),
+                              ntohs(net_csum_fold(net_csum_add(sum, udp, len))), "IPv4 UDP");
+
+        sum = net_pseudo_sum(NET_AF_INET6, test_peer6, test_local6, IP_PROTO_UDP, len);
+        TEST_ASSERT_EQUAL_U64(test_ref_udp_csum(NET_AF_INET6, test_peer6, test_local6, udp, len),
+                              ntohs(net_csum_fold(net_csum_add(sum, udp, len))), "IPv6 UDP");
+    }
+
+    // The addresses are part of the sum: swapping one byte changes it
+    uint8_t other[4] = { 10, 0, 2, 16 };
+    uint16_t len = (uint16_t)(sizeof(udp_hdr_t) + 16);
+    test_fill_udp(udp, 16);
+    TEST_ASSERT(net_csum_fold(net_csum_add(net_pseudo_sum(NET_AF_INET, src4, dst4, IP_PROTO_UDP,
+                                                          len), udp, len)) !=
+                net_csum_fold(net_csum_add(net_pseudo_sum(NET_AF_INET, src4, other, IP_PROTO_UDP,
+                                                          len), udp, len)),
+                "destination covered");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that a valid IPv4 datagram reaches its socket intact
+ */
+static int test_rx_ipv4(void) {
+    uint32_t len = test_ipv4_frame(test_frame, 33);
+
+    TEST_ASSERT(test_rx(len), "delivered");
+    TEST_ASSERT_EQUAL_U64(TEST_LOCAL_PORT, test_delivered.port, "port");
+    TEST_ASSERT_EQUAL_U64(ETH_HLEN + sizeof(ipv4_hdr_t) + sizeof(udp_hdr_t),
+                          test_delivered.offset, "payload offset");
+    TEST_ASSERT_EQUAL_U64(33, test_delivered.len, "payload length");
+    TEST_ASSERT_EQUAL_U64(TEST_PEER_PORT, test_delivered.peer_port, "peer port");
+    net_addr_t peer = net_addr_ipv4(10, 0, 2, 2);
+    TEST_ASSERT(net_addr_equal(&peer, &test_delivered.peer), "peer address");
+
+    // Ethernet pads short frames: the trailer is not payload
+    test_ipv4_frame(test_frame, 4);
+    TEST_ASSERT(test_rx(60), "padded frame delivered");
+    TEST_ASSERT_EQUAL_U64(4, test_delivered.len, "padding ignored");
+
+    // A zero checksum means none over IPv4
+    len = test_ipv4_frame(test_frame, 20);
+    ((udp_hdr_t*)(test_frame + ETH_HLEN + sizeof(ipv4_hdr_t)))->csum = 0;
+    TEST_ASSERT(test_rx(len), "no checksum");
+    TEST_ASSERT_EQUAL_U64(0, net_stats.rx_dropped, "nothing dropped");
+    TEST_ASSERT_EQUAL_U64(3, net_stats.rx_udp, "datagrams counted");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that inconsistent IPv4 and UDP lengths are dropped
+ */
+static int test_rx_ipv4_lengths(void) {
+    ipv4_hdr_t* ip = (ipv4_hdr_t*)(test_frame + ETH_HLEN);
+    udp_hdr_t* udp = (udp_hdr_t*)(test_frame + ETH_HLEN + sizeof(ipv4_hdr_t));
+    uint64_t dropped = 0;
+    uint32_t len;
+
+    // Checksums pass: only the length checks stand in the way
+    test_rx_csum_valid = true;
+
+    // Shorter than the Ethernet or IPv4 header
+    len = test_ipv4_frame(test_frame, 16);
+    TEST_ASSERT(!test_rx(ETH_HLEN - 1), "runt frame");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "runt dropped");
+    TEST_ASSERT(!test_rx(ETH_HLEN + sizeof(ipv4_hdr_t) - 1), "truncated IPv4 header");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "truncated header dropped");
+
+    // IPv4 total length past the end of the frame
+    TEST_ASSERT(!test_rx(len - 1), "truncated datagram");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "truncated datagram dropped");
+
+    // Total length shorter than the IPv4 header
+    ip->total_len = htons(sizeof(ipv4_hdr_t) - 4);
+    test_ipv4_rehash(test_frame);
+    TEST_ASSERT(!test_rx(len), "total length below header");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "short total length dropped");
+
+    // Room for the IPv4 header but not for a UDP header
+    ip->total_len = htons(sizeof(ipv4_hdr_t) + sizeof(udp_hdr_t) - 1);
+    test_ipv4_rehash(test_frame);
+    TEST_ASSERT(!test_rx(len), "no room for UDP header");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "short UDP dropped");
+
+    // UDP length beyond the IPv4 payload
+    len = test_ipv4_frame(test_frame, 16);
+    udp->len = htons(sizeof(udp_hdr_t) + 17);
+    TEST_ASSERT(!test_rx(len + 64), "UDP length past IPv4 payload");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "long UDP length dropped");
+
+    // UDP length shorter than its own header
+    udp->len = htons(sizeof(udp_hdr_t) - 1);
+    TEST_ASSERT(!test_rx(len), "UDP length below header");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "short UDP length dropped");
+
+    // Header length field below 20 bytes
+    len = test_ipv4_frame(test_frame, 16);
+    ip->ver_ihl = 0x44;
+    test_ipv4_rehash(test_frame);
+    TEST_ASSERT(!test_rx(len), "IHL below 5");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "short IHL dropped");
+
+    TEST_ASSERT_EQUAL_U64(0, test_delivered.count, "nothing delivered");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that IPv4 and UDP checksums are verified unless the device did
+ */
+static int test_rx_ipv4_checksums(void) {
+    ipv4_hdr_t* ip = (ipv4_hdr_t*)(test_frame + ETH_HLEN);
+    uint8_t* payload = test_frame + ETH_HLEN + sizeof(ipv4_hdr_t) + sizeof(udp_hdr_t);
+    uint32_t len;
+
+    len = test_ipv4_frame(test_frame, 40);
+    ip->ttl--;
+    TEST_ASSERT(!test_rx(len), "bad header checksum");
+    TEST_ASSERT_EQUAL_U64(1, net_stats.rx_dropped, "bad header dropped");
+
+    len = test_ipv4_frame(test_frame, 40);
+    payload[39] ^= 0x01;
+    TEST_ASSERT(!test_rx(len), "bad UDP checksum");
+    TEST_ASSERT_EQUAL_U64(2, net_stats.rx_dropped, "bad datagram dropped");
+
+    // The device already checked it: the UDP sum is not redone
+    test_rx_csum_valid = true;
+    TEST_ASSERT(test_rx(len), "offloaded checksum trusted");
+    TEST_ASSERT_EQUAL_U64(1, net_stats.rx_csum_offloaded, "offload counted");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test IPv6 delivery and its length and checksum checks
+ */
+static int test_rx_ipv6(void) {
+    ipv6_hdr_t* ip6 = (ipv6_hdr_t*)(test_frame + ETH_HLEN);
+    udp_hdr_t* udp = (udp_hdr_t*)(test_frame + ETH_HLEN + IPV6_HLEN);
+    uint64_t dropped = 0;
+    uint32_t len;
+
+    len = test_ipv6_frame(test_frame, 57);
+    TEST_ASSERT(test_rx(len), "delivered");
+    TEST_ASSERT_EQUAL_U64(ETH_HLEN + IPV6_HLEN + sizeof(udp_hdr_t), test_delivered.offset,
+                          "payload offset");
+    TEST_ASSERT_EQUAL_U64(57, test_delivered.len, "payload length");
+    net_addr_t peer = net_addr_ipv6(test_peer6);
+    TEST_ASSERT(net_addr_equal(&peer, &test_delivered.peer), "peer address");
+
+    // The checksum is mandatory over IPv6
+    udp->csum = 0;
+    TEST_ASSERT(!test_rx(len), "zero checksum");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "zero checksum dropped");
+
+    len = test_ipv6_frame(test_frame, 57);
+    test_frame[len - 1] ^= 0x80;
+    TEST_ASSERT(!test_rx(len), "bad checksum");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "bad checksum dropped");
+
+    // Lengths, with the checksum out of the way
+    test_rx_csum_valid = true;
+    len = test_ipv6_frame(test_frame, 57);
+    TEST_ASSERT(!test_rx(ETH_HLEN + IPV6_HLEN - 1), "truncated IPv6 header");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "truncated header dropped");
+    TEST_ASSERT(!test_rx(len - 1), "payload length past the frame");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "truncated payload dropped");
+
+    ip6->payload_len = htons(sizeof(udp_hdr_t) - 2);
+    TEST_ASSERT(!test_rx(len), "no room for UDP header");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "short payload dropped");
+
+    len = test_ipv6_frame(test_frame, 57);
+    udp->len = htons(sizeof(udp_hdr_t) + 58);
+    TEST_ASSERT(!test_rx(len + 64), "UDP length past IPv6 payload");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "long UDP length dropped");
+
+    len = test_ipv6_frame(test_frame, 57);
+    ip6->ver_tc_flow = htonl(4U << 28);
+    TEST_ASSERT(!test_rx(len), "wrong version");
+    TEST_ASSERT_EQUAL_U64(++dropped, net_stats.rx_dropped, "wrong version dropped");
+
+    // Not ours: ignored, not counted as malformed
+    len = test_ipv6_frame(test_frame, 57);
+    ip6->dst[15] = 0x16;
+    TEST_ASSERT(!test_rx(len), "other destination");
+    TEST_ASSERT_EQUAL_U64(dropped, net_stats.rx_dropped, "other destination not dropped");
+
+    TEST_ASSERT_EQUAL_U64(1, test_delivered.count, "only the valid datagram delivered");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    host_percpu_enter(&test_cpu, 0);
+
+    printf("=====================================\n");
+    printf("Network Checksum and Receive Tests\n");
+    printf("=====================================\n\n");
+
+    TEST_RUN(test_csum_vectors);
+    TEST_RUN(test_csum_reference);
+    TEST_RUN(test_pseudo_sum);
+    TEST_RUN(test_rx_ipv4);
+    TEST_RUN(test_rx_ipv4_lengths);
+    TEST_RUN(test_rx_ipv4_checksums);
+    TEST_RUN(test_rx_ipv6);
+
+    /* Summary */
+    printf("\n=====================================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("=====================================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
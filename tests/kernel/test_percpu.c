@@ -0,0 +1,307 @@
+/*
+ * EdgeX OS - Per-CPU Counter Unit Tests
+ *
+ * This file tests the per-CPU counters (kernel/percpu.c) on the host.
+ * Each CPU is a cpu_t the test's GS base is pointed at, so the %gs
+ * relative updates run unchanged. It checks sums over the online CPUs,
+ * snapshots against a concurrent grouped update on another CPU, and the
+ * fold thresholds of batched counters for positive and negative deltas.
+ */
+
+#define _GNU_SOURCE
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/percpu.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "kernel/host_percpu.h"
+
+/* cli/sti fault in user mode; a test thread is never interrupted anyway */
+#define local_irq_save()            0ULL
+#define local_irq_restore(flags)    ((void)(flags))
+
+#include "kernel/percpu.c"
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_I64(expected, actual, message) \
+    do { \
+        if ((int64_t)(expected) != (int64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %lld, got %lld)\n", \
+                __FILE__, __LINE__, message, (long long)(expected), \
+                (long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        test_reset(); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+#define TEST_CPUS           4
+#define TEST_BATCH          32
+#define TEST_SNAPSHOTS      100000
+
+static cpu_t test_cpus[TEST_CPUS];
+static cpumask_t test_online;
+
+/* CPU enumeration used by percpu.c */
+cpu_t* get_cpu(uint32_t id) {
+    return id < TEST_CPUS ? &test_cpus[id] : NULL;
+}
+
+cpumask_t cpu_online_mask(void) {
+    return test_online;
+}
+
+/*
+ * Clear every CPU's counters, bring all test CPUs online and run on CPU 0
+ */
+static void test_reset(void) {
+    memset(test_cpus, 0, sizeof(test_cpus));
+    test_online = CPU_MASK_NONE;
+    for (uint32_t i = 0; i < TEST_CPUS; i++) {
+        cpumask_set(&test_online, i);
+    }
+    host_percpu_enter(&test_cpus[0], 0);
+}
+
+/*
+ * Test single-counter updates and sums over the online CPUs
+ */
+static int test_counter_sum(void) {
+    this_cpu_counter_add(PCPU_SCHED_SWITCHES, 5);
+    this_cpu_counter_inc(PCPU_SCHED_SWITCHES);
+    TEST_ASSERT_EQUAL_I64(6, test_cpus[0].pcpu.counters[PCPU_SCHED_SWITCHES], "own slot updated");
+
+    host_percpu_enter(&test_cpus[2], 2);
+    this_cpu_counter_add(PCPU_SCHED_SWITCHES, 10);
+    this_cpu_counter_dec(PCPU_SCHED_SWITCHES);
+    TEST_ASSERT_EQUAL_I64(6, test_cpus[0].pcpu.counters[PCPU_SCHED_SWITCHES], "other CPU untouched");
+    TEST_ASSERT_EQUAL_I64(15, pcpu_counter_sum(PCPU_SCHED_SWITCHES), "sum over CPUs");
+    TEST_ASSERT_EQUAL_I64(0, pcpu_counter_sum(PCPU_SCHED_WAKEUPS), "other counter untouched");
+
+    // A counter can go below zero on one CPU and still sum right
+    host_percpu_enter(&test_cpus[3], 3);
+    this_cpu_counter_add(PCPU_SCHED_SWITCHES, -20);
+    TEST_ASSERT_EQUAL_I64(-5, pcpu_counter_sum(PCPU_SCHED_SWITCHES), "negative slot");
+
+    // Offline CPUs are not read
+    cpumask_clear(&test_online, 3);
+    TEST_ASSERT_EQUAL_I64(15, pcpu_counter_sum(PCPU_SCHED_SWITCHES), "offline CPU skipped");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that a snapshot sums every counter and sees grouped updates
+ */
+static int test_snapshot(void) {
+    int64_t counters[PCPU_NR_COUNTERS];
+
+    this_cpu_counters_add2(PCPU_IPC_MUTEXES, 1, PCPU_IPC_OBJECTS_CREATED, 1);
+    host_percpu_enter(&test_cpus[1], 1);
+    this_cpu_counters_add2(PCPU_IPC_MUTEXES, -1, PCPU_IPC_OBJECTS_DESTROYED, 1);
+    this_cpu_counter_add(PCPU_SCHED_WAKEUPS, 7);
+
+    memset(counters, 0xff, sizeof(counters));
+    pcpu_counters_snapshot(counters);
+    TEST_ASSERT_EQUAL_I64(0, counters[PCPU_IPC_MUTEXES], "grouped updates summed");
+    TEST_ASSERT_EQUAL_I64(1, counters[PCPU_IPC_OBJECTS_CREATED], "first CPU's update");
+    TEST_ASSERT_EQUAL_I64(1, counters[PCPU_IPC_OBJECTS_DESTROYED], "second CPU's update");
+    TEST_ASSERT_EQUAL_I64(7, counters[PCPU_SCHED_WAKEUPS], "single update");
+    TEST_ASSERT_EQUAL_I64(0, counters[PCPU_MEM_PAGE_ALLOCS], "untouched counter zeroed");
+
+    // Both sequence counts are even again
+    TEST_ASSERT((test_cpus[0].pcpu.seq & 1) == 0 && (test_cpus[1].pcpu.seq & 1) == 0,
+                "sequence counts even");
+    TEST_ASSERT_EQUAL_I64(2, test_cpus[1].pcpu.seq, "one grouped update on CPU 1");
+
+    return TEST_PASSED;
+}
+
+static volatile bool test_writer_stop;
+
+/*
+ * Writer on CPU 1: move one unit between two counters, over and over
+ */
+static void* test_snapshot_writer(void* arg) {
+    (void)arg;
+    host_percpu_enter(&test_cpus[1], 1);
+    while (!test_writer_stop) {
+        this_cpu_counters_add2(PCPU_IPC_ACTIVE_WAITERS, 1, PCPU_IPC_TIMEOUTS, -1);
+        this_cpu_counters_add2(PCPU_IPC_ACTIVE_WAITERS, -1, PCPU_IPC_TIMEOUTS, 1);
+    }
+    return NULL;
+}
+
+/*
+ * Test that snapshots never see half of a grouped update made
+ * concurrently on another CPU
+ */
+static int test_snapshot_concurrent(void) {
+    int64_t counters[PCPU_NR_COUNTERS];
+    pthread_t writer;
+    int torn = 0;
+
+    test_writer_stop = false;
+    TEST_ASSERT(pthread_create(&writer, NULL, test_snapshot_writer, NULL) == 0, "writer started");
+
+    for (int i = 0; i < TEST_SNAPSHOTS; i++) {
+        pcpu_counters_snapshot(counters);
+        if (counters[PCPU_IPC_ACTIVE_WAITERS] + counters[PCPU_IPC_TIMEOUTS] != 0) {
+            torn++;
+        }
+    }
+
+    test_writer_stop = true;
+    pthread_join(writer, NULL);
+
+    TEST_ASSERT_EQUAL_I64(0, torn, "torn snapshots");
+    TEST_ASSERT_EQUAL_I64(0, pcpu_counter_sum(PCPU_IPC_ACTIVE_WAITERS), "writer left no delta");
+    return TEST_PASSED;
+}
+
+/*
+ * Test that positive deltas fold exactly at the batch size
+ */
+static int test_batch_fold(void) {
+    pcpu_batch_t counter = PCPU_BATCH_INIT(PCPU_MEM_FREE_PAGES, TEST_BATCH);
+    int64_t* pending = &test_cpus[0].pcpu.counters[PCPU_MEM_FREE_PAGES];
+
+    for (int i = 0; i < TEST_BATCH - 1; i++) {
+        pcpu_batch_add(&counter, 1);
+    }
+    TEST_ASSERT_EQUAL_I64(0, pcpu_batch_read(&counter), "nothing folded below the batch");
+    TEST_ASSERT_EQUAL_I64(TEST_BATCH - 1, *pending, "delta pending");
+    TEST_ASSERT_EQUAL_I64(TEST_BATCH - 1, pcpu_batch_sum(&counter), "sum includes pending");
+
+    pcpu_batch_add(&counter, 1);
+    TEST_ASSERT_EQUAL_I64(TEST_BATCH, pcpu_batch_read(&counter), "folded at the batch");
+    TEST_ASSERT_EQUAL_I64(0, *pending, "pending cleared");
+
+    // A delta past the batch folds all of it at once
+    pcpu_batch_add(&counter, 3);
+    pcpu_batch_add(&counter, 100);
+    TEST_ASSERT_EQUAL_I64(TEST_BATCH + 103, pcpu_batch_read(&counter), "large delta folded");
+    TEST_ASSERT_EQUAL_I64(0, *pending, "nothing left pending");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test negative deltas: they fold at -batch, and cancel pending positives
+ */
+static int test_batch_negative(void) {
+    pcpu_batch_t counter = PCPU_BATCH_INIT(PCPU_MEM_FREE_PAGES, TEST_BATCH);
+    int64_t* pending = &test_cpus[0].pcpu.counters[PCPU_MEM_FREE_PAGES];
+
+    pcpu_batch_add(&counter, TEST_BATCH - 1);
+    pcpu_batch_add(&counter, -(TEST_BATCH - 1));
+    TEST_ASSERT_EQUAL_I64(0, pcpu_batch_read(&counter), "opposite deltas never fold");
+    TEST_ASSERT_EQUAL_I64(0, *pending, "opposite deltas cancel");
+
+    pcpu_batch_add(&counter, 20);
+    pcpu_batch_add(&counter, -40);
+    TEST_ASSERT_EQUAL_I64(0, pcpu_batch_read(&counter), "swing within the batch");
+    TEST_ASSERT_EQUAL_I64(-20, *pending, "negative delta pending");
+
+    pcpu_batch_add(&counter, -(TEST_BATCH - 21));
+    TEST_ASSERT_EQUAL_I64(0, pcpu_batch_read(&counter), "nothing folded above -batch");
+    pcpu_batch_add(&counter, -1);
+    TEST_ASSERT_EQUAL_I64(-TEST_BATCH, pcpu_batch_read(&counter), "folded at -batch");
+    TEST_ASSERT_EQUAL_I64(0, *pending, "pending cleared");
+    TEST_ASSERT_EQUAL_I64(-TEST_BATCH, pcpu_batch_sum(&counter), "negative sum");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test batched counters across CPUs: pending deltas stay per CPU, and
+ * the folded count is never off by a batch or more per CPU
+ */
+static int test_batch_cpus(void) {
+    pcpu_batch_t counter = PCPU_BATCH_INIT(PCPU_MEM_PAGE_ALLOCS, TEST_BATCH);
+    int64_t expected = 0;
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+
+    for (int i = 0; i < 100000; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        uint32_t cpu = (uint32_t)(x % TEST_CPUS);
+        int64_t delta = (int64_t)((x >> 8) % (2 * TEST_BATCH + 1)) - TEST_BATCH;
+
+        host_percpu_enter(&test_cpus[cpu], cpu);
+        pcpu_batch_add(&counter, delta);
+        expected += delta;
+
+        int64_t slack = expected - pcpu_batch_read(&counter);
+        TEST_ASSERT(slack < TEST_CPUS * TEST_BATCH && slack > -TEST_CPUS * TEST_BATCH,
+                    "folded count within a batch per CPU");
+        for (uint32_t c = 0; c < TEST_CPUS; c++) {
+            int64_t pending = test_cpus[c].pcpu.counters[PCPU_MEM_PAGE_ALLOCS];
+            TEST_ASSERT(pending < TEST_BATCH && pending > -TEST_BATCH, "pending below the batch");
+        }
+    }
+    TEST_ASSERT_EQUAL_I64(expected, pcpu_batch_sum(&counter), "exact sum");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    printf("============================\n");
+    printf("Per-CPU Counter Tests\n");
+    printf("============================\n\n");
+
+    TEST_RUN(test_counter_sum);
+    TEST_RUN(test_snapshot);
+    TEST_RUN(test_snapshot_concurrent);
+    TEST_RUN(test_batch_fold);
+    TEST_RUN(test_batch_negative);
+    TEST_RUN(test_batch_cpus);
+
+    /* Summary */
+    printf("\n============================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("============================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
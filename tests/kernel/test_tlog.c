@@ -0,0 +1,402 @@
+/*
+ * EdgeX OS - Telemetry Log Recovery Unit Tests
+ *
+ * This file tests log replay in kernel/tlog.c on the host, over an
+ * in-memory disk that completes every request on submission. Records
+ * are appended and committed, the disk is damaged the way a crash or a
+ * bad sector would, and the store is opened again: replay has to stop at
+ * the first torn record, bad checksum or stale generation, keep nothing
+ * past it, and put new appends where the damaged tail cannot rejoin.
+ */
+
+#define _GNU_SOURCE
+
+#include <edgex/kernel.h>
+#include <edgex/cpu.h>
+#include <edgex/scheduler.h>
+#include <edgex/tsc.h>
+#include <edgex/tlog.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "kernel/host_percpu.h"
+
+/* cli/sti fault in user mode; a test thread is never interrupted anyway */
+#define local_irq_save()            0ULL
+#define local_irq_restore(flags)    ((void)(flags))
+
+/* The kernel prints uint64_t with %llu; on the host it is unsigned long */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#include "kernel/tlog.c"
+#pragma GCC diagnostic pop
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL_U64(expected, actual, message) \
+    do { \
+        if ((uint64_t)(expected) != (uint64_t)(actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %llu, got %llu)\n", \
+                __FILE__, __LINE__, message, (unsigned long long)(expected), \
+                (unsigned long long)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        test_reset(); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/* Superblock and four segments, the smallest store tlog_open() takes */
+#define TEST_DISK_BLOCKS    (1 + 4 * TLOG_SEG_BLOCKS)
+#define TEST_RECORD_LEN     40
+
+/* The running CPU, reached through %gs */
+static cpu_t test_cpu;
+
+/* In-memory disk: requests complete on submission */
+static virtio_blk_t test_blk;
+static uint8_t* test_disk;
+
+int virtio_blk_submit(virtio_blk_t* blk, blk_request_t* req, bool more) {
+    uint8_t* data = test_disk + req->sector * VIRTIO_BLK_SECTOR_SIZE;
+    size_t len = (size_t)req->nr_sectors * VIRTIO_BLK_SECTOR_SIZE;
+    (void)blk;
+    (void)more;
+
+    if (req->op == BLK_OP_READ) {
+        memcpy((void*)(uintptr_t)req->phys, data, len);
+    } else if (req->op == BLK_OP_WRITE) {
+        memcpy(data, (void*)(uintptr_t)req->phys, len);
+    }
+    req->status = 0;
+    req->done(req);
+    return 0;
+}
+
+void virtio_blk_unplug(virtio_blk_t* blk) {
+    (void)blk;
+}
+
+/* Kernel services used by tlog.c */
+int kernel_printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+int klog_printf(int level, const char* fmt, ...) {
+    va_list args;
+    (void)level;
+    va_start(args, fmt);
+    int len = vprintf(fmt, args);
+    va_end(args);
+    return len;
+}
+
+void* kzalloc(size_t size) {
+    return calloc(1, size);
+}
+
+void* alloc_page(void) {
+    return aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+}
+
+void free_page(void* page) {
+    free(page);
+}
+
+shared_memory_t create_shared_memory(const char* name, size_t size, uint32_t permissions,
+                                     uint32_t flags) {
+    (void)name;
+    (void)size;
+    (void)permissions;
+    (void)flags;
+    return NULL;
+}
+
+uint64_t shared_memory_phys(shared_memory_t shm, size_t offset) {
+    (void)shm;
+    (void)offset;
+    return 0;
+}
+
+pid_t create_kernel_task(const char* name, void (*entry_point)(void), task_priority_t priority) {
+    (void)name;
+    (void)entry_point;
+    (void)priority;
+    return 2;
+}
+
+uint64_t tsc_to_ns(uint64_t cycles) { return cycles; }
+uint64_t tsc_now_ns(void) { return rdtsc(); }
+
+/* Every request completes before a task would block */
+pid_t get_current_pid(void) { return 1; }
+uint64_t get_tick_count(void) { return 1; }
+void prepare_to_block(void) {}
+void cancel_block(void) {}
+void schedule(void) {}
+void unblock_task(pid_t pid) { (void)pid; }
+void sleep_task(uint64_t milliseconds) { (void)milliseconds; }
+void preempt_schedule(void) {}
+
+/*
+ * Start every test with a blank disk
+ */
+static void test_reset(void) {
+    free(test_disk);
+    test_disk = calloc(TEST_DISK_BLOCKS, TLOG_BLOCK_SIZE);
+    memset(&test_blk, 0, sizeof(test_blk));
+    test_blk.capacity = (uint64_t)TEST_DISK_BLOCKS * TLOG_BLOCK_SECTORS;
+    tlog_store_open = false;
+}
+
+/*
+ * Open the store again, as after a reboot
+ */
+static tlog_t* test_reopen(void) {
+    tlog_store_open = false;
+    return tlog_open(&test_blk, 0, TEST_DISK_BLOCKS, false);
+}
+
+/*
+ * Append records for keys first..last, each holding its key, and commit
+ */
+static uint64_t test_append(tlog_t* log, uint64_t first, uint64_t last, uint16_t len) {
+    uint8_t data[TLOG_BLOCK_SIZE];
+    uint64_t seq = 0;
+
+    for (uint64_t key = first; key <= last; key++) {
+        memset(data, (int)key, len);
+        memcpy(data, &key, sizeof(key));
+        seq = tlog_append(log, key, data, len);
+        if (seq == 0) {
+            return 0;
+        }
+    }
+    return tlog_commit(log, seq) == 0 ? seq : 0;
+}
+
+/*
+ * On-disk location of a key's latest record
+ */
+static tlog_rec_hdr_t* test_disk_record(tlog_t* log, uint64_t key) {
+    tlog_index_entry_t* e = tlog_index_find(log, key, false);
+    if (!e) {
+        return NULL;
+    }
+    return (tlog_rec_hdr_t*)(test_disk + tlog_sector(log, e->segment, e->block) *
+                             VIRTIO_BLK_SECTOR_SIZE + e->offset);
+}
+
+/*
+ * Check whether a key replayed with its own data
+ */
+static bool test_has_key(tlog_t* log, uint64_t key) {
+    uint8_t data[TLOG_BLOCK_SIZE];
+    uint64_t seq;
+    uint64_t stored;
+
+    if (tlog_latest(log, key, data, sizeof(data), &seq) < (int)sizeof(stored)) {
+        return false;
+    }
+    memcpy(&stored, data, sizeof(stored));
+    return stored == key;
+}
+
+/*
+ * Test that an undamaged log replays completely
+ */
+static int test_replay_all(void) {
+    tlog_t* log = tlog_open(&test_blk, 0, TEST_DISK_BLOCKS, true);
+    TEST_ASSERT(log != NULL, "store formatted");
+    TEST_ASSERT_EQUAL_U64(10, test_append(log, 1, 10, TEST_RECORD_LEN), "records committed");
+
+    log = test_reopen();
+    TEST_ASSERT(log != NULL, "store reopened");
+    TEST_ASSERT_EQUAL_U64(10, log->stats.recovered_records, "every record replayed");
+    TEST_ASSERT_EQUAL_U64(11, log->next_seq, "sequence continues");
+    TEST_ASSERT_EQUAL_U64(10, log->durable_seq, "replayed records durable");
+    for (uint64_t key = 1; key <= 10; key++) {
+        TEST_ASSERT(test_has_key(log, key), "record readable after replay");
+    }
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that replay stops at a record whose data fails its checksum
+ */
+static int test_replay_bad_crc(void) {
+    tlog_t* log = tlog_open(&test_blk, 0, TEST_DISK_BLOCKS, true);
+    test_append(log, 1, 10, TEST_RECORD_LEN);
+
+    // One flipped bit in the data of the fourth record
+    tlog_rec_hdr_t* rec = test_disk_record(log, 4);
+    TEST_ASSERT(rec != NULL, "record on disk");
+    ((uint8_t*)(rec + 1))[TEST_RECORD_LEN - 1] ^= 0x01;
+
+    log = test_reopen();
+    TEST_ASSERT(log != NULL, "store reopened");
+    TEST_ASSERT_EQUAL_U64(3, log->stats.recovered_records, "records before the bad one");
+    TEST_ASSERT_EQUAL_U64(4, log->next_seq, "sequence resumes at the bad record");
+    TEST_ASSERT(test_has_key(log, 3), "last good record kept");
+    for (uint64_t key = 4; key <= 10; key++) {
+        TEST_ASSERT(!test_has_key(log, key), "nothing from the bad record on");
+    }
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that replay stops at a record torn by a partial write
+ */
+static int test_replay_torn_record(void) {
+    tlog_t* log = tlog_open(&test_blk, 0, TEST_DISK_BLOCKS, true);
+    test_append(log, 1, 10, TEST_RECORD_LEN);
+
+    // The write stopped halfway through the sixth record's header
+    tlog_rec_hdr_t* rec = test_disk_record(log, 6);
+    uint8_t* block_end = test_disk + (((uint8_t*)rec - test_disk) / TLOG_BLOCK_SIZE + 1) *
+                         TLOG_BLOCK_SIZE;
+    uint8_t* torn = (uint8_t*)rec + sizeof(tlog_rec_hdr_t) / 2;
+    memset(torn, 0, (size_t)(block_end - torn));
+
+    log = test_reopen();
+    TEST_ASSERT_EQUAL_U64(5, log->stats.recovered_records, "records before the torn one");
+    TEST_ASSERT(test_has_key(log, 5), "last complete record kept");
+    TEST_ASSERT(!test_has_key(log, 6), "torn record dropped");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that a batch torn between blocks ends the segment at the gap
+ */
+static int test_replay_torn_batch(void) {
+    // Records of about a quarter block: three blocks' worth
+    const uint16_t len = TLOG_BLOCK_SIZE / 4 - sizeof(tlog_rec_hdr_t);
+    tlog_t* log = tlog_open(&test_blk, 0, TEST_DISK_BLOCKS, true);
+    test_append(log, 1, 12, len);
+
+    tlog_index_entry_t* first = tlog_index_find(log, 1, false);
+    tlog_index_entry_t* last = tlog_index_find(log, 12, false);
+    TEST_ASSERT(last->block == first->block + 2, "records span three blocks");
+
+    // The middle block never reached the disk, the last one did
+    uint64_t sector = tlog_sector(log, first->segment, first->block + 1);
+    memset(test_disk + sector * VIRTIO_BLK_SECTOR_SIZE, 0, TLOG_BLOCK_SIZE);
+
+    log = test_reopen();
+    TEST_ASSERT_EQUAL_U64(4, log->stats.recovered_records, "records of the first block only");
+    TEST_ASSERT(test_has_key(log, 4), "first block kept");
+    TEST_ASSERT(!test_has_key(log, 9) && !test_has_key(log, 12), "blocks after the gap dropped");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that a record left from an earlier use of the segment ends it,
+ * even with a valid checksum
+ */
+static int test_replay_stale_generation(void) {
+    tlog_t* log = tlog_open(&test_blk, 0, TEST_DISK_BLOCKS, true);
+    test_append(log, 1, 10, TEST_RECORD_LEN);
+
+    tlog_rec_hdr_t* rec = test_disk_record(log, 7);
+    rec->generation--;
+    rec->crc = tlog_rec_crc(log, rec);
+
+    log = test_reopen();
+    TEST_ASSERT_EQUAL_U64(6, log->stats.recovered_records, "records before the stale one");
+    TEST_ASSERT(!test_has_key(log, 7), "stale record dropped");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test that appends after a damaged replay go where the tail cannot
+ * hide them
+ */
+static int test_replay_after_recovery(void) {
+    tlog_t* log = tlog_open(&test_blk, 0, TEST_DISK_BLOCKS, true);
+    test_append(log, 1, 10, TEST_RECORD_LEN);
+    uint32_t old_segment = tlog_index_find(log, 1, false)->segment;
+
+    tlog_rec_hdr_t* rec = test_disk_record(log, 4);
+    rec->crc ^= 1;
+
+    // Appends after recovery go to a new segment
+    log = test_reopen();
+    TEST_ASSERT_EQUAL_U64(3, log->stats.recovered_records, "damaged log replayed");
+    TEST_ASSERT(test_append(log, 100, 101, TEST_RECORD_LEN) != 0, "appends after recovery");
+    TEST_ASSERT(tlog_index_find(log, 100, false)->segment != old_segment, "in a new segment");
+
+    // The next replay stops at the same record and still finds the new ones
+    log = test_reopen();
+    TEST_ASSERT_EQUAL_U64(5, log->stats.recovered_records, "old prefix and new records");
+    TEST_ASSERT(test_has_key(log, 100) && test_has_key(log, 101), "new records replayed");
+    TEST_ASSERT(!test_has_key(log, 4) && !test_has_key(log, 10), "damaged tail stays out");
+    TEST_ASSERT_EQUAL_U64(6, log->next_seq, "sequence past every replayed record");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    host_percpu_enter(&test_cpu, 0);
+
+    printf("============================\n");
+    printf("Telemetry Log Recovery Tests\n");
+    printf("============================\n\n");
+
+    TEST_RUN(test_replay_all);
+    TEST_RUN(test_replay_bad_crc);
+    TEST_RUN(test_replay_torn_record);
+    TEST_RUN(test_replay_torn_batch);
+    TEST_RUN(test_replay_stale_generation);
+    TEST_RUN(test_replay_after_recovery);
+
+    /* Summary */
+    printf("\n============================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("============================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
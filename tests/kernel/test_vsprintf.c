@@ -0,0 +1,257 @@
+/*
+ * EdgeX OS - String Formatting Unit Tests
+ *
+ * This file tests the kernel's vsnprintf() (kernel/vsprintf.c) on the
+ * host. The kernel version is built in under another name and checked
+ * against the C library for every conversion, flag and length modifier
+ * it supports, and for truncation and the returned length.
+ */
+
+#include <edgex/kernel.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Build the kernel implementation next to the C library's */
+#define vsnprintf kernel_vsnprintf
+#define snprintf kernel_snprintf
+#include "kernel/vsprintf.c"
+#undef vsnprintf
+#undef snprintf
+
+/* Test framework declarations */
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("ASSERTION FAILED at %s:%d: %s\n", __FILE__, __LINE__, message); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_EQUAL(expected, actual, message) \
+    do { \
+        if ((expected) != (actual)) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected %d, got %d)\n", \
+                __FILE__, __LINE__, message, (int)(expected), (int)(actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_STRING_EQUAL(expected, actual, message) \
+    do { \
+        if (strcmp((expected), (actual)) != 0) { \
+            printf("ASSERTION FAILED at %s:%d: %s (expected '%s', got '%s')\n", \
+                __FILE__, __LINE__, message, (expected), (actual)); \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test_func) \
+    do { \
+        printf("Running test: %s\n", #test_func); \
+        int result = test_func(); \
+        if (result == TEST_PASSED) { \
+            printf("PASSED: %s\n", #test_func); \
+            test_passed++; \
+        } else { \
+            printf("FAILED: %s\n", #test_func); \
+            test_failed++; \
+        } \
+        total_tests++; \
+    } while (0)
+
+/*
+ * Format with both implementations and compare output and return value
+ */
+#define CHECK_FORMAT(...) \
+    do { \
+        if (check_format(__FILE__, __LINE__, __VA_ARGS__) != TEST_PASSED) { \
+            return TEST_FAILED; \
+        } \
+    } while (0)
+
+static int check_format(const char* file, int line, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static int check_format(const char* file, int line, const char* fmt, ...) {
+    char expected[256];
+    char actual[256];
+    va_list args;
+
+    va_start(args, fmt);
+    int expected_len = vsnprintf(expected, sizeof(expected), fmt, args);
+    va_end(args);
+
+    memset(actual, 'X', sizeof(actual));
+    va_start(args, fmt);
+    int actual_len = kernel_vsnprintf(actual, sizeof(actual), fmt, args);
+    va_end(args);
+
+    if (expected_len != actual_len || strcmp(expected, actual) != 0) {
+        printf("ASSERTION FAILED at %s:%d: format \"%s\" (expected '%s' [%d], got '%s' [%d])\n",
+               file, line, fmt, expected, expected_len, actual, actual_len);
+        return TEST_FAILED;
+    }
+    return TEST_PASSED;
+}
+
+/*
+ * Test signed and unsigned decimal conversions
+ */
+static int test_decimal(void) {
+    CHECK_FORMAT("%d", 0);
+    CHECK_FORMAT("%d %i", 42, -42);
+    CHECK_FORMAT("%d", INT32_MIN);
+    CHECK_FORMAT("%d", INT32_MAX);
+    CHECK_FORMAT("%u", 4000000000u);
+    CHECK_FORMAT("%ld", -1234567890123L);
+    CHECK_FORMAT("%lld", (long long)INT64_MIN);
+    CHECK_FORMAT("%llu", (unsigned long long)UINT64_MAX);
+    CHECK_FORMAT("%zu %zd", (size_t)123456789, (ssize_t)-5);
+    CHECK_FORMAT("%td", (ptrdiff_t)-77);
+    CHECK_FORMAT("%hd %hu", (short)-1234, (unsigned short)65535);
+    CHECK_FORMAT("%hhd %hhu", (signed char)-128, (unsigned char)255);
+    return TEST_PASSED;
+}
+
+/*
+ * Test hexadecimal, octal and pointer conversions
+ */
+static int test_hex_octal(void) {
+    CHECK_FORMAT("%x %X", 0xdeadbeefu, 0xdeadbeefu);
+    CHECK_FORMAT("%llx", 0x0123456789abcdefULL);
+    CHECK_FORMAT("%#x %#X %#x", 255u, 255u, 0u);
+    CHECK_FORMAT("%o %#o %#o", 8u, 8u, 0u);
+    CHECK_FORMAT("%#.5o %#.0o", 8u, 0u);
+    CHECK_FORMAT("%hhx", (unsigned char)0xab);
+    CHECK_FORMAT("%p", (void*)(uintptr_t)0x1000);
+    CHECK_FORMAT("%p", (void*)(uintptr_t)0xffff800000100000ULL);
+    return TEST_PASSED;
+}
+
+/*
+ * Test flags, width and precision, also given as '*'
+ */
+static int test_flags_width_precision(void) {
+    CHECK_FORMAT("[%5d] [%-5d] [%05d]", 42, 42, 42);
+    CHECK_FORMAT("[%+d] [% d] [%+d]", 42, 42, -42);
+    CHECK_FORMAT("[%05d]", -42);
+    CHECK_FORMAT("[%.3d] [%8.3d] [%-8.3d]", 7, -7, 7);
+    CHECK_FORMAT("[%.0d] [%5.0d]", 0, 0);
+    CHECK_FORMAT("[%#010x] [%#-10x]", 0x1234u, 0x1234u);
+    CHECK_FORMAT("[%*d] [%-*d] [%*d]", 6, 1, 6, 1, -6, 1);
+    CHECK_FORMAT("[%.*d] [%*.*x]", 4, 5, 8, 6, 0xabcu);
+    return TEST_PASSED;
+}
+
+/*
+ * Test strings, characters and literal percent signs
+ */
+static int test_strings_chars(void) {
+    CHECK_FORMAT("%s", "edgex");
+    CHECK_FORMAT("[%10s] [%-10s]", "abc", "abc");
+    CHECK_FORMAT("[%.2s] [%6.2s] [%.*s]", "abcdef", "abcdef", 3, "abcdef");
+    CHECK_FORMAT("[%c] [%3c] [%-3c]", 'a', 'b', 'c');
+    CHECK_FORMAT("100%% %s", "done");
+    CHECK_FORMAT("%s=%d, %s=%#x", "pid", 12, "flags", 0x80u);
+    return TEST_PASSED;
+}
+
+/*
+ * Test kernel-specific behavior the C library leaves undefined
+ */
+static int test_kernel_extensions(void) {
+    char buf[32];
+
+    int len = kernel_snprintf(buf, sizeof(buf), "%s", (const char*)NULL);
+    TEST_ASSERT_STRING_EQUAL("(null)", buf, "NULL string");
+    TEST_ASSERT_EQUAL(6, len, "NULL string length");
+
+    // Unknown conversions are printed as written
+    len = kernel_snprintf(buf, sizeof(buf), "a%qb");
+    TEST_ASSERT_STRING_EQUAL("a%qb", buf, "unknown conversion");
+    TEST_ASSERT_EQUAL(4, len, "unknown conversion length");
+
+    // A trailing '%' ends the output
+    len = kernel_snprintf(buf, sizeof(buf), "abc%");
+    TEST_ASSERT_STRING_EQUAL("abc", buf, "trailing percent");
+    TEST_ASSERT_EQUAL(3, len, "trailing percent length");
+
+    // Flags that do not apply are ignored: '0' with '-' or a precision,
+    // signs on unsigned conversions
+    kernel_snprintf(buf, sizeof(buf), "[%-05d] [%08.3d]", -42, 7);
+    TEST_ASSERT_STRING_EQUAL("[-42  ] [     007]", buf, "ignored zero flag");
+    kernel_snprintf(buf, sizeof(buf), "[%+u] [% x]", 5u, 10u);
+    TEST_ASSERT_STRING_EQUAL("[5] [a]", buf, "sign flags on unsigned");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Test truncation: always terminated, full length returned
+ */
+static int test_truncation(void) {
+    char buf[8];
+
+    memset(buf, 'X', sizeof(buf));
+    int len = kernel_snprintf(buf, sizeof(buf), "%s-%d", "overflow", 12345);
+    TEST_ASSERT_EQUAL(14, len, "length of the untruncated output");
+    TEST_ASSERT_STRING_EQUAL("overflo", buf, "truncated output");
+
+    memset(buf, 'X', sizeof(buf));
+    len = kernel_snprintf(buf, 1, "abc");
+    TEST_ASSERT_EQUAL(3, len, "length with a one-byte buffer");
+    TEST_ASSERT_EQUAL('\0', buf[0], "one-byte buffer terminated");
+
+    // size 0: nothing is written, not even the terminator
+    memset(buf, 'X', sizeof(buf));
+    len = kernel_snprintf(buf, 0, "%d", 123456);
+    TEST_ASSERT_EQUAL(6, len, "length with size 0");
+    TEST_ASSERT_EQUAL('X', buf[0], "nothing written with size 0");
+
+    len = kernel_snprintf(NULL, 0, "%08x", 1u);
+    TEST_ASSERT_EQUAL(8, len, "length with a NULL buffer");
+
+    // Exactly fitting output
+    len = kernel_snprintf(buf, sizeof(buf), "%7d", 1);
+    TEST_ASSERT_EQUAL(7, len, "exact fit length");
+    TEST_ASSERT_STRING_EQUAL("      1", buf, "exact fit output");
+
+    return TEST_PASSED;
+}
+
+/*
+ * Main test function
+ */
+int main(int argc, char** argv) {
+    int test_passed = 0;
+    int test_failed = 0;
+    int total_tests = 0;
+
+    printf("============================\n");
+    printf("String Formatting Tests\n");
+    printf("============================\n\n");
+
+    TEST_RUN(test_decimal);
+    TEST_RUN(test_hex_octal);
+    TEST_RUN(test_flags_width_precision);
+    TEST_RUN(test_strings_chars);
+    TEST_RUN(test_kernel_extensions);
+    TEST_RUN(test_truncation);
+
+    /* Summary */
+    printf("\n============================\n");
+    printf("Test Summary:\n");
+    printf("  Total tests: %d\n", total_tests);
+    printf("  Passed:      %d\n", test_passed);
+    printf("  Failed:      %d\n", test_failed);
+    printf("============================\n");
+
+    return (test_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+#
+# EdgeX OS - Initial Ramdisk Builder
+#
+# Packs a directory into the read-only archive the kernel maps files from
+# (see include/edgex/initrd.h). Every file starts on a page boundary so
+# tasks can map it in place.
+#
+# Usage: mkinitrd.py <directory> <output>
+
+import os
+import struct
+import sys
+
+INITRD_MAGIC = 0x44525845      # "EXRD"
+INITRD_VERSION = 1
+INITRD_NAME_MAX = 48
+PAGE_SIZE = 4096
+
+HEADER = struct.Struct("<IIIIQ40x")
+ENTRY = struct.Struct("<%dsQQ" % INITRD_NAME_MAX)
+
+
+def page_align(n):
+    return (n + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)
+
+
+def collect(root):
+    files = []
+    for dirpath, dirnames, filenames in os.walk(root):
+        dirnames.sort()
+        for name in sorted(filenames):
+            path = os.path.join(dirpath, name)
+            rel = os.path.relpath(path, root).replace(os.sep, "/")
+            if len(rel.encode()) >= INITRD_NAME_MAX:
+                sys.exit("mkinitrd: name too long: %s" % rel)
+            files.append((rel, path))
+    return files
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: mkinitrd.py <directory> <output>")
+    root, output = sys.argv[1], sys.argv[2]
+
+    files = collect(root)
+    data_offset = page_align(HEADER.size + len(files) * ENTRY.size)
+
+    entries = []
+    offset = data_offset
+    for rel, path in files:
+        size = os.path.getsize(path)
+        entries.append((rel, path, offset, size))
+        offset = page_align(offset + size)
+    total_size = offset
+
+    with open(output, "wb") as out:
+        out.write(HEADER.pack(INITRD_MAGIC, INITRD_VERSION, len(entries), data_offset, total_size))
+        for rel, _, off, size in entries:
+            out.write(ENTRY.pack(rel.encode(), off, size))
+        for rel, path, off, size in entries:
+            out.seek(off)
+            with open(path, "rb") as f:
+                out.write(f.read())
+        out.truncate(total_size)
+
+    print("mkinitrd: %d files, %d KB" % (len(entries), total_size // 1024))
+
+
+if __name__ == "__main__":
+    main()
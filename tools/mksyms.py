@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+#
+# EdgeX OS - Kernel Symbol Table Generator
+#
+# Reads `nm -n --defined-only` output of a linked kernel on stdin and
+# writes an assembly file with its code symbols, sorted by address, for
+# the second link (see include/edgex/ksyms.h). Empty input gives an empty
+# table, which the first link uses.
+#
+# Usage: nm -n --defined-only kernel | mksyms.py > ksyms.s
+
+import sys
+
+CODE_TYPES = "tTwW"
+
+# Section markers from boot/linker.ld, which share addresses with functions
+LINKER_SYMBOLS = {"_kernel_physical_start", "_kernel_virtual_start",
+                  "_text_start", "_text_end"}
+
+
+def read_symbols(lines):
+    symbols = []
+    seen = set()
+    for line in lines:
+        fields = line.split()
+        if len(fields) != 3 or fields[1] not in CODE_TYPES:
+            continue
+        addr, name = int(fields[0], 16), fields[2]
+        # Local labels, section markers and aliases of an address already named
+        if name.startswith(".L") or name in LINKER_SYMBOLS or addr in seen:
+            continue
+        seen.add(addr)
+        symbols.append((addr, name))
+    symbols.sort()
+    return symbols
+
+
+def emit(symbols, out):
+    out.write("# Generated by tools/mksyms.py\n")
+    out.write("\t.section .ksyms, \"a\"\n")
+    out.write("\t.balign 8\n")
+    out.write("\t.globl ksym_table_count\n")
+    out.write("ksym_table_count:\n\t.quad %d\n" % len(symbols))
+
+    out.write("\t.globl ksym_table_addrs\n")
+    out.write("ksym_table_addrs:\n")
+    for addr, _ in symbols:
+        out.write("\t.quad 0x%x\n" % addr)
+
+    out.write("\t.globl ksym_table_name_offsets\n")
+    out.write("ksym_table_name_offsets:\n")
+    offset = 0
+    for _, name in symbols:
+        out.write("\t.long %d\n" % offset)
+        offset += len(name) + 1
+
+    out.write("\t.globl ksym_table_names\n")
+    out.write("ksym_table_names:\n")
+    for _, name in symbols:
+        out.write("\t.asciz \"%s\"\n" % name)
+
+
+def main():
+    emit(read_symbols(sys.stdin), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+# EdgeX OS - Trace Converter
+#
+# Turns the trace frames in a serial capture (see include/edgex/trace.h)
+# into Chrome trace JSON, which ui.perfetto.dev and chrome://tracing
+# open. CPUs and tasks each get a track: CPU tracks show the running
+# task and IRQs, task tracks show when the task ran, blocked and woke,
+# its messages (with send -> receive arrows) and its mutex waits.
+#
+# Usage: trace2json.py <capture> [output.json]
+
+import json
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from uartsplit import split  # noqa: E402
+
+FRAME_TRACE_INFO = 2
+FRAME_TRACE_TASK = 3
+FRAME_TRACE_DATA = 4
+
+INFO = struct.Struct("<IHHQIIQ")
+TASK = struct.Struct("<iI32s")
+RECORD = struct.Struct("<QHBBiQQ")
+
+TRACE_INFO_MAGIC = 0x45435254
+
+(SCHED_SWITCH, SCHED_WAKE, SCHED_BLOCK, MSG_SEND, MSG_RECEIVE, MUTEX_CONTEND,
+ MUTEX_ACQUIRE, PAGE_FAULT, IRQ_ENTRY, IRQ_EXIT) = range(1, 11)
+
+PID_CPUS = 0
+PID_TASKS = 1
+
+
+class Converter:
+    def __init__(self, tsc_khz, names):
+        self.tsc_khz = tsc_khz
+        self.names = names
+        self.events = []
+        self.t0 = None
+
+    def ts(self, tsc):
+        return (tsc - self.t0) * 1000.0 / self.tsc_khz
+
+    def task_name(self, pid):
+        return self.names.get(pid, "pid %d" % pid)
+
+    def emit(self, **event):
+        self.events.append(event)
+
+    def slice(self, pid, tid, name, start, end, cat, args=None):
+        event = dict(ph="X", pid=pid, tid=tid, name=name, cat=cat, ts=start, dur=max(end - start, 0.001))
+        if args:
+            event["args"] = args
+        self.emit(**event)
+
+    def instant(self, pid, tid, name, ts, cat, args):
+        self.emit(ph="i", s="t", pid=pid, tid=tid, name=name, cat=cat, ts=ts, args=args)
+
+    def convert(self, records):
+        self.t0 = min(r[0] for r in records)
+        end_ts = self.ts(max(r[0] for r in records))
+        running = {}      # cpu -> (pid, start)
+        irq_depth = {}    # cpu -> open IRQ slices
+        mutex_wait = {}   # pid -> (mutex, start)
+
+        for tsc, event, cpu, _, pid, arg0, arg1 in sorted(records):
+            now = self.ts(tsc)
+            running.setdefault(cpu, (pid, now))
+
+            if event == SCHED_SWITCH:
+                prev, start = running[cpu]
+                self.slice(PID_CPUS, cpu, self.task_name(prev), start, now, "sched")
+                self.slice(PID_TASKS, prev, "running", start, now, "sched", {"cpu": cpu})
+                running[cpu] = (arg1 & 0xFFFFFFFF, now)
+            elif event == SCHED_WAKE:
+                self.instant(PID_TASKS, arg0, "wake", now, "sched",
+                             {"by": self.task_name(pid), "cpu": arg1})
+            elif event == SCHED_BLOCK:
+                self.instant(PID_TASKS, arg0, "sleep" if arg1 == 1 else "block", now, "sched", {})
+            elif event in (MSG_SEND, MSG_RECEIVE):
+                send = event == MSG_SEND
+                self.slice(PID_TASKS, pid, "send" if send else "receive", now, now, "ipc",
+                           {"queue": "0x%x" % arg0, "message": arg1})
+                flow = dict(pid=PID_TASKS, tid=pid, name="message", cat="ipc", ts=now, id=arg1)
+                if send:
+                    self.emit(ph="s", **flow)
+                else:
+                    self.emit(ph="f", bp="e", **flow)
+            elif event == MUTEX_CONTEND:
+                mutex_wait[pid] = (arg0, now, arg1)
+            elif event == MUTEX_ACQUIRE:
+                mutex, start, owner = mutex_wait.pop(pid, (arg0, now, 0))
+                self.slice(PID_TASKS, pid, "mutex wait", start, now, "lock",
+                           {"mutex": "0x%x" % mutex, "owner": self.task_name(owner)})
+            elif event == PAGE_FAULT:
+                self.instant(PID_CPUS, cpu, "page fault", now, "mm",
+                             {"address": "0x%x" % arg0, "error": arg1, "task": self.task_name(pid)})
+            elif event == IRQ_ENTRY:
+                irq_depth[cpu] = irq_depth.get(cpu, 0) + 1
+                self.emit(ph="B", pid=PID_CPUS, tid=cpu, name="irq %d" % arg0, cat="irq", ts=now)
+            elif event == IRQ_EXIT:
+                # The ring may start inside an IRQ
+                if irq_depth.get(cpu, 0) > 0:
+                    irq_depth[cpu] -= 1
+                    self.emit(ph="E", pid=PID_CPUS, tid=cpu, ts=now)
+
+        for cpu, (pid, start) in running.items():
+            self.slice(PID_CPUS, cpu, self.task_name(pid), start, end_ts, "sched")
+            self.slice(PID_TASKS, pid, "running", start, end_ts, "sched", {"cpu": cpu})
+
+        self.emit(ph="M", pid=PID_CPUS, name="process_name", args={"name": "CPUs"})
+        self.emit(ph="M", pid=PID_TASKS, name="process_name", args={"name": "Tasks"})
+        for cpu in sorted(running):
+            self.emit(ph="M", pid=PID_CPUS, tid=cpu, name="thread_name", args={"name": "CPU %d" % cpu})
+        for pid, name in sorted(self.names.items()):
+            self.emit(ph="M", pid=PID_TASKS, tid=pid, name="thread_name",
+                      args={"name": "%s (%d)" % (name, pid)})
+        return self.events
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.exit("usage: trace2json.py <capture> [output.json]")
+
+    with open(sys.argv[1], "rb") as f:
+        _, payloads, _, _ = split(f.read())
+
+    info = payloads.get(FRAME_TRACE_INFO, b"")
+    if len(info) < INFO.size:
+        sys.exit("trace2json: no trace in %s" % sys.argv[1])
+    # The last dump in the capture wins
+    magic, version, record_size, tsc_khz, nr_cpus, _, lost = INFO.unpack_from(info, len(info) - INFO.size)
+    if magic != TRACE_INFO_MAGIC or record_size != RECORD.size or tsc_khz == 0:
+        sys.exit("trace2json: unsupported trace (version %d)" % version)
+
+    names = {}
+    tasks = payloads.get(FRAME_TRACE_TASK, b"")
+    for off in range(0, len(tasks) - TASK.size + 1, TASK.size):
+        pid, _, name = TASK.unpack_from(tasks, off)
+        names[pid] = name.split(b"\0", 1)[0].decode("utf-8", "replace")
+
+    data = payloads.get(FRAME_TRACE_DATA, b"")
+    records = [RECORD.unpack_from(data, off) for off in range(0, len(data) - RECORD.size + 1, RECORD.size)]
+    if not records:
+        sys.exit("trace2json: trace has no records")
+
+    events = Converter(tsc_khz, names).convert(records)
+    out = open(sys.argv[2], "w") if len(sys.argv) == 3 else sys.stdout
+    json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, out)
+    if out is not sys.stdout:
+        out.close()
+
+    print("trace2json: %d records from %d CPUs, %d tasks, %d lost" % (len(records), nr_cpus, len(names), lost),
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# EdgeX OS - Serial Capture Splitter
+#
+# Separates the binary frames the kernel writes to a serial port (see
+# include/edgex/uart.h) from the text around them. Text goes to stdout,
+# the payload of each frame type to <prefix>.<type>.bin.
+#
+# Usage: uartsplit.py <capture> <prefix>
+
+import sys
+
+FRAME_SYNC = b"\x00\xffEX"
+FRAME_HDR_LEN = len(FRAME_SYNC) + 3
+
+
+def fletcher16(data):
+    sum1 = sum2 = 0
+    for b in data:
+        sum1 = (sum1 + b) % 255
+        sum2 = (sum2 + sum1) % 255
+    return sum1, sum2
+
+
+def split(capture):
+    text = bytearray()
+    payloads = {}
+    frames = bad = 0
+    pos = 0
+
+    while pos < len(capture):
+        start = capture.find(FRAME_SYNC, pos)
+        if start < 0:
+            text += capture[pos:]
+            break
+        text += capture[pos:start]
+
+        hdr = capture[start + len(FRAME_SYNC):start + FRAME_HDR_LEN]
+        if len(hdr) < 3:
+            break
+        ftype = hdr[0]
+        length = hdr[1] | (hdr[2] << 8)
+        end = start + FRAME_HDR_LEN + length
+        payload = capture[start + FRAME_HDR_LEN:end]
+        trailer = capture[end:end + 2]
+
+        if len(trailer) < 2 or fletcher16(hdr + payload) != (trailer[0], trailer[1]):
+            # Not a frame after all, or a damaged one: resync past the marker
+            bad += 1
+            text += capture[start:start + 1]
+            pos = start + 1
+            continue
+
+        payloads.setdefault(ftype, bytearray()).extend(payload)
+        frames += 1
+        pos = end + 2
+
+    return bytes(text), payloads, frames, bad
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: uartsplit.py <capture> <prefix>")
+
+    with open(sys.argv[1], "rb") as f:
+        capture = f.read()
+
+    text, payloads, frames, bad = split(capture)
+    sys.stdout.write(text.decode("utf-8", "replace"))
+
+    for ftype, data in sorted(payloads.items()):
+        name = "%s.%d.bin" % (sys.argv[2], ftype)
+        with open(name, "wb") as out:
+            out.write(data)
+        print("uartsplit: type %d: %d bytes -> %s" % (ftype, len(data), name), file=sys.stderr)
+    print("uartsplit: %d frames, %d bad" % (frames, bad), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()